@@ -0,0 +1,13 @@
+#pragma once
+// libE57Format benchmarks Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+namespace Benchmarks
+{
+   /// Register the end-to-end read and write benchmarks. Files of 1 GB and more are only included
+   /// if @a includeLarge is set.
+   void registerReadWrite( bool includeLarge );
+
+   /// Remove the files written for the read benchmarks.
+   void removeReadWriteFiles();
+}
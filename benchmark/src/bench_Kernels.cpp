@@ -0,0 +1,468 @@
+// libE57Format benchmarks Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Micro-benchmarks of the encoders, decoders, checksums, and page I/O on their own.
+//
+// The integer encoders and decoders are run for each bit width with every register type which can
+// hold it (the library picks the smallest). Each benchmark reports records/sec (items_per_second)
+// and bytes/sec of packed data (bytes_per_second).
+//
+// These use the library's internal classes, which are not exported from the shared library, so
+// they are only built with the static one.
+
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "CRC32C.h"
+#include "CheckedFile.h"
+#include "Decoder.h"
+#include "Encoder.h"
+#include "SourceDestBufferImpl.h"
+
+namespace
+{
+   // Number of records encoded or decoded in each iteration
+   constexpr size_t cRecordCount = 64 * 1024;
+
+   // Encoders and decoders need an ImageFile for their buffers. Nothing is written to it.
+   constexpr char cImageFileName[] = "./bench-kernels.e57";
+
+   constexpr char cPageFileName[] = "./bench-pages.e57";
+
+   // Bytes in each CheckedFile read or write
+   constexpr size_t cTransferSize = 64 * 1024;
+
+   // Smallest and largest values which need exactly @a bits bits
+   void limitsFor( unsigned bits, int64_t &minimum, int64_t &maximum )
+   {
+      if ( bits == 64 )
+      {
+         minimum = std::numeric_limits<int64_t>::min();
+         maximum = std::numeric_limits<int64_t>::max();
+      }
+      else
+      {
+         minimum = 0;
+         maximum = static_cast<int64_t>( ( uint64_t{ 1 } << bits ) - 1 );
+      }
+   }
+
+   std::vector<int64_t> randomIntegers( int64_t minimum, int64_t maximum )
+   {
+      std::mt19937_64 generator( 42 );
+      std::uniform_int_distribution<int64_t> distribution( minimum, maximum );
+
+      std::vector<int64_t> values( cRecordCount );
+      for ( auto &value : values )
+      {
+         value = distribution( generator );
+      }
+
+      return values;
+   }
+
+   template <typename T> std::vector<T> randomReals()
+   {
+      std::mt19937 generator( 42 );
+      std::uniform_real_distribution<T> distribution( -1000.0, 1000.0 );
+
+      std::vector<T> values( cRecordCount );
+      for ( auto &value : values )
+      {
+         value = distribution( generator );
+      }
+
+      return values;
+   }
+
+   std::vector<e57::ustring> randomStrings( size_t length )
+   {
+      std::mt19937 generator( 42 );
+      std::uniform_int_distribution<int> distribution( 'a', 'z' );
+
+      std::vector<e57::ustring> values( cRecordCount );
+      for ( auto &value : values )
+      {
+         value.resize( length );
+
+         for ( auto &c : value )
+         {
+            c = static_cast<char>( distribution( generator ) );
+         }
+      }
+
+      return values;
+   }
+
+   void setRates( benchmark::State &state, size_t records, size_t bytes )
+   {
+      state.SetItemsProcessed( static_cast<int64_t>( state.iterations() * records ) );
+      state.SetBytesProcessed( static_cast<int64_t>( state.iterations() * bytes ) );
+   }
+
+   // Encode all of the records in @a sbuf and return the encoder's output
+   std::vector<char> encodeAll( e57::Encoder &encoder, e57::SourceDestBuffer &sbuf )
+   {
+      sbuf.impl()->rewind();
+      encoder.outputClear();
+
+      while ( sbuf.impl()->nextIndex() < sbuf.capacity() )
+      {
+         encoder.processRecords( sbuf.capacity() );
+      }
+
+      encoder.registerFlushToOutput();
+
+      std::vector<char> output( encoder.outputAvailable() );
+      encoder.outputRead( output.data(), output.size() );
+
+      return output;
+   }
+
+   void benchEncoder( benchmark::State &state, e57::Encoder &encoder,
+                      e57::SourceDestBuffer &sbuf )
+   {
+      size_t bytes = 0;
+
+      for ( auto _ : state )
+      {
+         sbuf.impl()->rewind();
+         encoder.outputClear();
+
+         while ( sbuf.impl()->nextIndex() < sbuf.capacity() )
+         {
+            encoder.processRecords( sbuf.capacity() );
+         }
+
+         encoder.registerFlushToOutput();
+         bytes = encoder.outputAvailable();
+      }
+
+      setRates( state, sbuf.capacity(), bytes );
+   }
+
+   void benchDecoder( benchmark::State &state, e57::Decoder &decoder,
+                      e57::SourceDestBuffer &dbuf, const std::vector<char> &packed )
+   {
+      for ( auto _ : state )
+      {
+         dbuf.impl()->rewind();
+         decoder.seek( 0, 0, 0 );
+         decoder.inputProcess( packed.data(), packed.size() );
+      }
+
+      if ( dbuf.impl()->nextIndex() != dbuf.capacity() )
+      {
+         state.SkipWithError( "Not all records were decoded" );
+      }
+
+      setRates( state, dbuf.capacity(), packed.size() );
+   }
+
+   // Enough room for all of the output of an encoder, plus its register
+   unsigned outputSize( size_t bytes )
+   {
+      return static_cast<unsigned>( bytes + 64 );
+   }
+
+   template <typename RegisterT> void encodeBitpackInteger( benchmark::State &state )
+   {
+      const auto bits = static_cast<unsigned>( state.range( 0 ) );
+
+      int64_t minimum = 0;
+      int64_t maximum = 0;
+      limitsFor( bits, minimum, maximum );
+
+      std::vector<int64_t> values = randomIntegers( minimum, maximum );
+
+      e57::ImageFile imf( cImageFileName, "w" );
+      e57::SourceDestBuffer sbuf( imf, "value", values.data(), values.size(), true );
+
+      e57::BitpackIntegerEncoder<RegisterT> encoder( false, 0, sbuf,
+                                                     outputSize( values.size() * 8 ), minimum,
+                                                     maximum, 1.0, 0.0 );
+
+      benchEncoder( state, encoder, sbuf );
+
+      imf.cancel();
+   }
+
+   template <typename RegisterT> void decodeBitpackInteger( benchmark::State &state )
+   {
+      const auto bits = static_cast<unsigned>( state.range( 0 ) );
+
+      int64_t minimum = 0;
+      int64_t maximum = 0;
+      limitsFor( bits, minimum, maximum );
+
+      std::vector<int64_t> values = randomIntegers( minimum, maximum );
+      std::vector<int64_t> decoded( values.size() );
+
+      e57::ImageFile imf( cImageFileName, "w" );
+      e57::SourceDestBuffer sbuf( imf, "value", values.data(), values.size(), true );
+      e57::SourceDestBuffer dbuf( imf, "value", decoded.data(), decoded.size(), true );
+
+      e57::BitpackIntegerEncoder<RegisterT> encoder( false, 0, sbuf,
+                                                     outputSize( values.size() * 8 ), minimum,
+                                                     maximum, 1.0, 0.0 );
+      const std::vector<char> packed = encodeAll( encoder, sbuf );
+
+      e57::BitpackIntegerDecoder<RegisterT> decoder( false, 0, dbuf, minimum, maximum, 1.0, 0.0,
+                                                     decoded.size() );
+
+      benchDecoder( state, decoder, dbuf, packed );
+
+      if ( decoded != values )
+      {
+         state.SkipWithError( "Decoded values differ" );
+      }
+
+      imf.cancel();
+   }
+
+   template <typename T> e57::FloatPrecision precisionOf()
+   {
+      return ( sizeof( T ) == sizeof( float ) ) ? e57::PrecisionSingle : e57::PrecisionDouble;
+   }
+
+   template <typename T> void encodeBitpackFloat( benchmark::State &state )
+   {
+      std::vector<T> values = randomReals<T>();
+
+      e57::ImageFile imf( cImageFileName, "w" );
+      e57::SourceDestBuffer sbuf( imf, "value", values.data(), values.size() );
+
+      e57::BitpackFloatEncoder encoder( 0, sbuf, outputSize( values.size() * sizeof( T ) ),
+                                        precisionOf<T>() );
+
+      benchEncoder( state, encoder, sbuf );
+
+      imf.cancel();
+   }
+
+   template <typename T> void decodeBitpackFloat( benchmark::State &state )
+   {
+      std::vector<T> values = randomReals<T>();
+      std::vector<T> decoded( values.size() );
+
+      e57::ImageFile imf( cImageFileName, "w" );
+      e57::SourceDestBuffer sbuf( imf, "value", values.data(), values.size() );
+      e57::SourceDestBuffer dbuf( imf, "value", decoded.data(), decoded.size() );
+
+      e57::BitpackFloatEncoder encoder( 0, sbuf, outputSize( values.size() * sizeof( T ) ),
+                                        precisionOf<T>() );
+      const std::vector<char> packed = encodeAll( encoder, sbuf );
+
+      e57::BitpackFloatDecoder decoder( 0, dbuf, precisionOf<T>(), decoded.size() );
+
+      benchDecoder( state, decoder, dbuf, packed );
+
+      if ( decoded != values )
+      {
+         state.SkipWithError( "Decoded values differ" );
+      }
+
+      imf.cancel();
+   }
+
+   void encodeBitpackString( benchmark::State &state )
+   {
+      const auto length = static_cast<size_t>( state.range( 0 ) );
+
+      std::vector<e57::ustring> values = randomStrings( length );
+
+      e57::ImageFile imf( cImageFileName, "w" );
+      e57::SourceDestBuffer sbuf( imf, "value", &values );
+
+      // Each string has a prefix of up to 8 bytes
+      e57::BitpackStringEncoder encoder( 0, sbuf, outputSize( values.size() * ( length + 8 ) ) );
+
+      benchEncoder( state, encoder, sbuf );
+
+      imf.cancel();
+   }
+
+   void decodeBitpackString( benchmark::State &state )
+   {
+      const auto length = static_cast<size_t>( state.range( 0 ) );
+
+      std::vector<e57::ustring> values = randomStrings( length );
+      std::vector<e57::ustring> decoded( values.size() );
+
+      e57::ImageFile imf( cImageFileName, "w" );
+      e57::SourceDestBuffer sbuf( imf, "value", &values );
+      e57::SourceDestBuffer dbuf( imf, "value", &decoded );
+
+      e57::BitpackStringEncoder encoder( 0, sbuf, outputSize( values.size() * ( length + 8 ) ) );
+      const std::vector<char> packed = encodeAll( encoder, sbuf );
+
+      e57::BitpackStringDecoder decoder( 0, dbuf, decoded.size() );
+
+      benchDecoder( state, decoder, dbuf, packed );
+
+      if ( decoded != values )
+      {
+         state.SkipWithError( "Decoded values differ" );
+      }
+
+      imf.cancel();
+   }
+
+   void encodeConstantInteger( benchmark::State &state )
+   {
+      std::vector<int64_t> values( cRecordCount, 42 );
+
+      e57::ImageFile imf( cImageFileName, "w" );
+      e57::SourceDestBuffer sbuf( imf, "value", values.data(), values.size(), true );
+
+      e57::ConstantIntegerEncoder encoder( 0, sbuf, 42 );
+
+      benchEncoder( state, encoder, sbuf );
+
+      imf.cancel();
+   }
+
+   void decodeConstantInteger( benchmark::State &state )
+   {
+      std::vector<int64_t> decoded( cRecordCount );
+
+      e57::ImageFile imf( cImageFileName, "w" );
+      e57::SourceDestBuffer dbuf( imf, "value", decoded.data(), decoded.size(), true );
+
+      e57::ConstantIntegerDecoder decoder( false, 0, dbuf, 42, 1.0, 0.0, decoded.size() );
+
+      benchDecoder( state, decoder, dbuf, {} );
+
+      imf.cancel();
+   }
+
+   void checksum( benchmark::State &state )
+   {
+      const auto size = static_cast<size_t>( state.range( 0 ) );
+
+      std::vector<char> buffer( size, 'x' );
+
+      for ( auto _ : state )
+      {
+         benchmark::DoNotOptimize( e57::crc32c( buffer.data(), buffer.size() ) );
+      }
+
+      setRates( state, 1, size );
+   }
+
+   // The checksums of the logical parts of consecutive physical pages, as they are written
+   void checksumPages( benchmark::State &state )
+   {
+      const auto pageCount = static_cast<size_t>( state.range( 0 ) );
+
+      std::vector<char> buffer( pageCount * e57::CheckedFile::physicalPageSize, 'x' );
+      std::vector<uint32_t> crcs( pageCount );
+
+      for ( auto _ : state )
+      {
+         e57::crc32cBlocks( buffer.data(), e57::CheckedFile::physicalPageSize,
+                            e57::CheckedFile::logicalPageSize, pageCount, crcs.data() );
+
+         benchmark::DoNotOptimize( crcs.data() );
+      }
+
+      setRates( state, pageCount, pageCount * e57::CheckedFile::logicalPageSize );
+   }
+
+   void writePages( size_t size )
+   {
+      const std::vector<char> buffer( cTransferSize, 'x' );
+
+      e57::CheckedFile file( e57::ustring( cPageFileName ), e57::CheckedFile::Write,
+                             e57::ChecksumAll );
+
+      for ( size_t written = 0; written < size; written += cTransferSize )
+      {
+         file.write( buffer.data(), buffer.size() );
+      }
+
+      file.close();
+   }
+
+   void checkedFileWrite( benchmark::State &state )
+   {
+      const auto size = static_cast<size_t>( state.range( 0 ) ) * 1024 * 1024;
+
+      for ( auto _ : state )
+      {
+         writePages( size );
+      }
+
+      setRates( state, size / e57::CheckedFile::logicalPageSize, size );
+
+      std::remove( cPageFileName );
+   }
+
+   void checkedFileReadAt( benchmark::State &state )
+   {
+      const auto size = static_cast<size_t>( state.range( 0 ) ) * 1024 * 1024;
+      const auto policy = static_cast<e57::ReadChecksumPolicy>( state.range( 1 ) );
+
+      writePages( size );
+
+      std::vector<char> buffer( cTransferSize );
+
+      for ( auto _ : state )
+      {
+         e57::CheckedFile file( e57::ustring( cPageFileName ), e57::CheckedFile::Read, policy );
+
+         for ( size_t offset = 0; offset < size; offset += cTransferSize )
+         {
+            file.readAt( offset, buffer.data(), buffer.size() );
+         }
+
+         file.close();
+      }
+
+      setRates( state, size / e57::CheckedFile::logicalPageSize, size );
+
+      std::remove( cPageFileName );
+   }
+}
+
+BENCHMARK_TEMPLATE( encodeBitpackInteger, uint8_t )->ArgName( "bits" )->DenseRange( 1, 8 );
+BENCHMARK_TEMPLATE( encodeBitpackInteger, uint16_t )->ArgName( "bits" )->DenseRange( 1, 16 );
+BENCHMARK_TEMPLATE( encodeBitpackInteger, uint32_t )->ArgName( "bits" )->DenseRange( 1, 32 );
+BENCHMARK_TEMPLATE( encodeBitpackInteger, uint64_t )->ArgName( "bits" )->DenseRange( 1, 64 );
+
+BENCHMARK_TEMPLATE( decodeBitpackInteger, uint8_t )->ArgName( "bits" )->DenseRange( 1, 8 );
+BENCHMARK_TEMPLATE( decodeBitpackInteger, uint16_t )->ArgName( "bits" )->DenseRange( 1, 16 );
+BENCHMARK_TEMPLATE( decodeBitpackInteger, uint32_t )->ArgName( "bits" )->DenseRange( 1, 32 );
+BENCHMARK_TEMPLATE( decodeBitpackInteger, uint64_t )->ArgName( "bits" )->DenseRange( 1, 64 );
+
+BENCHMARK_TEMPLATE( encodeBitpackFloat, float );
+BENCHMARK_TEMPLATE( encodeBitpackFloat, double );
+BENCHMARK_TEMPLATE( decodeBitpackFloat, float );
+BENCHMARK_TEMPLATE( decodeBitpackFloat, double );
+
+BENCHMARK( encodeBitpackString )->ArgName( "length" )->Arg( 8 )->Arg( 64 )->Arg( 1024 );
+BENCHMARK( decodeBitpackString )->ArgName( "length" )->Arg( 8 )->Arg( 64 )->Arg( 1024 );
+
+BENCHMARK( encodeConstantInteger );
+BENCHMARK( decodeConstantInteger );
+
+// A page's data, the most read or written at once, and a large buffer
+BENCHMARK( checksum )
+   ->ArgName( "bytes" )
+   ->Arg( e57::CheckedFile::logicalPageSize )
+   ->Arg( 64 * e57::CheckedFile::logicalPageSize )
+   ->Arg( 1024 * 1024 );
+
+BENCHMARK( checksumPages )->ArgName( "pages" )->Arg( 4 )->Arg( 64 );
+
+BENCHMARK( checkedFileWrite )->ArgName( "MB" )->Arg( 64 )->Unit( benchmark::kMillisecond );
+BENCHMARK( checkedFileReadAt )
+   ->ArgNames( { "MB", "checksumPolicy" } )
+   ->Args( { 64, e57::ChecksumNone } )
+   ->Args( { 64, e57::ChecksumAll } )
+   ->Unit( benchmark::kMillisecond );
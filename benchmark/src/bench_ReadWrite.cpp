@@ -0,0 +1,435 @@
+// libE57Format benchmarks Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// End-to-end benchmarks which write and read synthetic scans through the simple API.
+//
+// Each benchmark is named <Write|Read>/<coordinates>/<fields>/<size>[/<checksum policy>] and
+// reports points/sec (items_per_second) and MB/s of file (bytes_per_second). The size is the
+// approximate size of the file. Points are written and read in chunks so that large files don't
+// need buffers for all of their points.
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+
+#include "E57SimpleReader.h"
+#include "E57SimpleWriter.h"
+
+#include "Benchmarks.h"
+
+namespace
+{
+   enum class Coordinates
+   {
+      Float,
+      Double,
+      ScaledInteger,
+   };
+
+   enum class Fields
+   {
+      XYZ,
+      XYZIntensity,
+      XYZIntensityColour,
+   };
+
+   struct Config
+   {
+      Coordinates coordinates;
+      Fields fields;
+      int64_t sizeMB;
+   };
+
+   // Number of points in each write() or read()
+   constexpr size_t cChunkSize = 1024 * 1024;
+
+   // Points are in a cube of +/- this many metres
+   constexpr double cExtent = 100.0;
+
+   // Scale for scaled integer coordinates (1 mm)
+   constexpr double cScale = 0.001;
+
+   // Files written for the read benchmarks. They are reused by each policy and removed at the end.
+   std::set<std::string> sReadFiles;
+
+   const char *toString( Coordinates coordinates )
+   {
+      switch ( coordinates )
+      {
+         case Coordinates::Float:
+            return "Float";
+         case Coordinates::Double:
+            return "Double";
+         case Coordinates::ScaledInteger:
+            return "ScaledInt";
+      }
+
+      return "";
+   }
+
+   const char *toString( Fields fields )
+   {
+      switch ( fields )
+      {
+         case Fields::XYZ:
+            return "XYZ";
+         case Fields::XYZIntensity:
+            return "XYZI";
+         case Fields::XYZIntensityColour:
+            return "XYZIRGB";
+      }
+
+      return "";
+   }
+
+   const char *checksumName( e57::ReadChecksumPolicy policy )
+   {
+      switch ( policy )
+      {
+         case e57::ChecksumNone:
+            return "ChecksumNone";
+         case e57::ChecksumSparse:
+            return "ChecksumSparse";
+         case e57::ChecksumHalf:
+            return "ChecksumHalf";
+         default:
+            return "ChecksumAll";
+      }
+   }
+
+   // Approximate number of bytes each point takes in the file.
+   int64_t bytesPerPoint( const Config &config )
+   {
+      int64_t bytes = 0;
+
+      switch ( config.coordinates )
+      {
+         case Coordinates::Float:
+            bytes = 3 * sizeof( float );
+            break;
+
+         case Coordinates::Double:
+            bytes = 3 * sizeof( double );
+            break;
+
+         case Coordinates::ScaledInteger:
+            // 2 * cExtent / cScale needs 18 bits
+            bytes = 7;
+            break;
+      }
+
+      if ( config.fields != Fields::XYZ )
+      {
+         bytes += sizeof( float );
+      }
+
+      if ( config.fields == Fields::XYZIntensityColour )
+      {
+         bytes += 3;
+      }
+
+      return bytes;
+   }
+
+   size_t pointCount( const Config &config )
+   {
+      return static_cast<size_t>( config.sizeMB * 1024 * 1024 / bytesPerPoint( config ) );
+   }
+
+   std::string fileName( const char *prefix, const Config &config )
+   {
+      return std::string( "./bench-" ) + prefix + "-" + toString( config.coordinates ) + "-" +
+             toString( config.fields ) + "-" + std::to_string( config.sizeMB ) + "MB.e57";
+   }
+
+   int64_t fileSize( const std::string &file )
+   {
+      std::ifstream stream( file, std::ios::binary | std::ios::ate );
+
+      return static_cast<int64_t>( stream.tellg() );
+   }
+
+   e57::Data3D makeHeader( const Config &config )
+   {
+      e57::Data3D header;
+      header.guid = "Benchmark Scan Header GUID";
+      header.description = "libE57Format benchmark: synthetic points";
+      header.pointCount = pointCount( config );
+
+      header.pointFields.cartesianXField = true;
+      header.pointFields.cartesianYField = true;
+      header.pointFields.cartesianZField = true;
+
+      switch ( config.coordinates )
+      {
+         case Coordinates::Float:
+            header.pointFields.pointRangeNodeType = e57::NumericalNodeType::Float;
+            break;
+
+         case Coordinates::Double:
+            header.pointFields.pointRangeNodeType = e57::NumericalNodeType::Double;
+            break;
+
+         case Coordinates::ScaledInteger:
+            header.pointFields.pointRangeNodeType = e57::NumericalNodeType::ScaledInteger;
+            header.pointFields.pointRangeScale = cScale;
+            header.pointFields.pointRangeMinimum = -cExtent;
+            header.pointFields.pointRangeMaximum = cExtent;
+            break;
+      }
+
+      if ( config.fields != Fields::XYZ )
+      {
+         header.pointFields.intensityField = true;
+         header.intensityLimits.intensityMinimum = 0.0;
+         header.intensityLimits.intensityMaximum = 1.0;
+      }
+
+      if ( config.fields == Fields::XYZIntensityColour )
+      {
+         header.pointFields.colorRedField = true;
+         header.pointFields.colorGreenField = true;
+         header.pointFields.colorBlueField = true;
+
+         header.colorLimits.colorRedMaximum = 255;
+         header.colorLimits.colorGreenMaximum = 255;
+         header.colorLimits.colorBlueMaximum = 255;
+      }
+
+      return header;
+   }
+
+   // Make buffers for one chunk of the points described by @a header. The buffer constructor may
+   // adjust the point fields, so they are copied back to the header.
+   template <typename COORDTYPE>
+   std::unique_ptr<e57::Data3DPointsData_t<COORDTYPE>> makeChunkBuffers( e57::Data3D &header )
+   {
+      e57::Data3D chunkHeader = header;
+      chunkHeader.pointCount = std::min( cChunkSize, header.pointCount );
+
+      std::unique_ptr<e57::Data3DPointsData_t<COORDTYPE>> buffers(
+         new e57::Data3DPointsData_t<COORDTYPE>( chunkHeader ) );
+
+      header.pointFields = chunkHeader.pointFields;
+
+      return buffers;
+   }
+
+   template <typename COORDTYPE>
+   void fillChunk( e57::Data3DPointsData_t<COORDTYPE> &buffers, const e57::Data3D &header,
+                   size_t count )
+   {
+      std::mt19937 generator( 42 );
+      std::uniform_real_distribution<COORDTYPE> coordinate( -cExtent, cExtent );
+      std::uniform_real_distribution<float> intensity( 0.0f, 1.0f );
+      std::uniform_int_distribution<int> colour( 0, 255 );
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         buffers.cartesianX[i] = coordinate( generator );
+         buffers.cartesianY[i] = coordinate( generator );
+         buffers.cartesianZ[i] = coordinate( generator );
+
+         if ( header.pointFields.intensityField )
+         {
+            buffers.intensity[i] = intensity( generator );
+         }
+
+         if ( header.pointFields.colorRedField )
+         {
+            buffers.colorRed[i] = static_cast<uint16_t>( colour( generator ) );
+            buffers.colorGreen[i] = static_cast<uint16_t>( colour( generator ) );
+            buffers.colorBlue[i] = static_cast<uint16_t>( colour( generator ) );
+         }
+      }
+   }
+
+   template <typename COORDTYPE> void writeFile( const Config &config, const std::string &file )
+   {
+      e57::Data3D header = makeHeader( config );
+
+      auto buffers = makeChunkBuffers<COORDTYPE>( header );
+      const size_t chunkSize = std::min( cChunkSize, header.pointCount );
+
+      fillChunk( *buffers, header, chunkSize );
+
+      e57::WriterOptions options;
+      options.guid = "Benchmark File GUID";
+
+      e57::Writer writer( file, options );
+
+      const int64_t scanIndex = writer.NewData3D( header );
+
+      e57::CompressedVectorWriter dataWriter =
+         writer.SetUpData3DPointsData( scanIndex, chunkSize, *buffers );
+
+      for ( size_t written = 0; written < header.pointCount; written += chunkSize )
+      {
+         dataWriter.write( std::min( chunkSize, header.pointCount - written ) );
+      }
+
+      dataWriter.close();
+      writer.Close();
+   }
+
+   template <typename COORDTYPE>
+   size_t readFile( const std::string &file, e57::ReadChecksumPolicy policy )
+   {
+      e57::ReaderOptions options;
+      options.checksumPolicy = policy;
+
+      e57::Reader reader( file, options );
+
+      e57::Data3D header;
+      reader.ReadData3D( 0, header );
+
+      auto buffers = makeChunkBuffers<COORDTYPE>( header );
+      const size_t chunkSize = std::min( cChunkSize, header.pointCount );
+
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( 0, chunkSize, *buffers );
+
+      size_t count = 0;
+      unsigned read = 0;
+
+      while ( ( read = dataReader.read() ) > 0 )
+      {
+         count += read;
+      }
+
+      dataReader.close();
+      reader.Close();
+
+      return count;
+   }
+
+   void writeFile( const Config &config, const std::string &file )
+   {
+      if ( config.coordinates == Coordinates::Float )
+      {
+         writeFile<float>( config, file );
+      }
+      else
+      {
+         writeFile<double>( config, file );
+      }
+   }
+
+   size_t readFile( const Config &config, const std::string &file,
+                     e57::ReadChecksumPolicy policy )
+   {
+      if ( config.coordinates == Coordinates::Float )
+      {
+         return readFile<float>( file, policy );
+      }
+
+      return readFile<double>( file, policy );
+   }
+
+   void setRates( benchmark::State &state, size_t points, int64_t bytes )
+   {
+      state.SetItemsProcessed( static_cast<int64_t>( state.iterations() * points ) );
+      state.SetBytesProcessed( static_cast<int64_t>( state.iterations() ) * bytes );
+   }
+
+   void benchWrite( benchmark::State &state, Config config )
+   {
+      const std::string file = fileName( "write", config );
+
+      for ( auto _ : state )
+      {
+         writeFile( config, file );
+      }
+
+      setRates( state, pointCount( config ), fileSize( file ) );
+
+      std::remove( file.c_str() );
+   }
+
+   void benchRead( benchmark::State &state, Config config, e57::ReadChecksumPolicy policy )
+   {
+      const std::string file = fileName( "read", config );
+
+      if ( sReadFiles.insert( file ).second )
+      {
+         writeFile( config, file );
+      }
+
+      size_t points = 0;
+
+      for ( auto _ : state )
+      {
+         points = readFile( config, file, policy );
+      }
+
+      if ( points != pointCount( config ) )
+      {
+         state.SkipWithError( "Wrong number of points read" );
+         return;
+      }
+
+      setRates( state, points, fileSize( file ) );
+   }
+}
+
+namespace Benchmarks
+{
+   void registerReadWrite( bool includeLarge )
+   {
+      std::vector<int64_t> sizesMB{ 1, 16, 256 };
+
+      if ( includeLarge )
+      {
+         sizesMB.insert( sizesMB.end(), { 1024, 10 * 1024 } );
+      }
+
+      const Coordinates coordinates[] = { Coordinates::Float, Coordinates::Double,
+                                          Coordinates::ScaledInteger };
+      const Fields fields[] = { Fields::XYZ, Fields::XYZIntensity, Fields::XYZIntensityColour };
+      const e57::ReadChecksumPolicy policies[] = { e57::ChecksumNone, e57::ChecksumSparse,
+                                                   e57::ChecksumAll };
+
+      for ( const auto sizeMB : sizesMB )
+      {
+         for ( const auto coordinate : coordinates )
+         {
+            for ( const auto field : fields )
+            {
+               const Config config{ coordinate, field, sizeMB };
+               const std::string name = std::string( toString( coordinate ) ) + "/" +
+                                        toString( field ) + "/" + std::to_string( sizeMB ) + "MB";
+
+               benchmark::RegisterBenchmark( ( "Write/" + name ).c_str(), benchWrite, config )
+                  ->Unit( benchmark::kMillisecond )
+                  ->UseRealTime();
+
+               for ( const auto policy : policies )
+               {
+                  benchmark::RegisterBenchmark(
+                     ( "Read/" + name + "/" + checksumName( policy ) ).c_str(), benchRead, config,
+                     policy )
+                     ->Unit( benchmark::kMillisecond )
+                     ->UseRealTime();
+               }
+            }
+         }
+      }
+   }
+
+   void removeReadWriteFiles()
+   {
+      for ( const auto &file : sReadFiles )
+      {
+         std::remove( file.c_str() );
+      }
+
+      sReadFiles.clear();
+   }
+}
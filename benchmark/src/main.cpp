@@ -0,0 +1,44 @@
+// libE57Format benchmarks Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <iostream>
+
+#include "benchmark/benchmark.h"
+
+#include "E57Version.h"
+
+#include "Benchmarks.h"
+
+int main( int argc, char **argv )
+{
+   benchmark::Initialize( &argc, argv );
+
+   // Anything Google Benchmark didn't recognize is ours
+   bool includeLarge = false;
+
+   for ( int i = 1; i < argc; ++i )
+   {
+      if ( std::strcmp( argv[i], "--large" ) == 0 )
+      {
+         includeLarge = true;
+      }
+      else
+      {
+         std::cerr << "Unrecognized argument: " << argv[i] << std::endl;
+         std::cerr << "Usage: benchE57 [--large] [benchmark options]" << std::endl;
+         return 1;
+      }
+   }
+
+   std::cout << "e57Format version: " << e57::Version::library() << std::endl;
+
+   Benchmarks::registerReadWrite( includeLarge );
+
+   benchmark::RunSpecifiedBenchmarks();
+   benchmark::Shutdown();
+
+   Benchmarks::removeReadWriteFiles();
+
+   return 0;
+}
@@ -0,0 +1,159 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+/// @file E57DatasetReader.h Reading a dataset made of many E57 files as one.
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "E57SimpleReader.h"
+
+namespace e57
+{
+   /// Options to the DatasetReader constructor
+   struct E57_DLL DatasetReaderOptions
+   {
+      /// Options every file is opened with. Their executor (see ReaderOptions::executor) also
+      /// runs the work the DatasetReader itself does in parallel.
+      ReaderOptions readerOptions;
+
+      /// Number of files to open, or to read the points of in DatasetReader::ForEachData3D(), at
+      /// the same time, including the calling thread. 0 (the default) uses as many as the
+      /// executor can run at once.
+      unsigned threadCount = 0;
+
+      /// Take the metadata of each file from its MetadataSummary sidecar if it is up to date (see
+      /// Reader::ReadMetadataSummary()), writing a new one if it isn't, and only open the file when
+      /// more than its summary is needed. A dataset which has been opened before then opens
+      /// without parsing any XML.
+      bool useMetadataSummaries = false;
+   };
+
+   /// @brief Where one of the Data3D or Image2D of a DatasetReader is
+   struct E57_DLL DatasetLocation
+   {
+      size_t fileIndex = 0; ///< Index of the file (see DatasetReader::GetFilePath())
+      int64_t index = 0;    ///< Index of the Data3D or Image2D in that file
+   };
+
+   /// @brief Called by DatasetReader::ForEachData3D() for each Data3D
+   /// @details @a reader is the Reader of the file holding Data3D @a dataIndex of the dataset,
+   /// which is Data3D @a fileDataIndex of that file.
+   using DatasetData3DTask =
+      std::function<void( int64_t dataIndex, Reader &reader, int64_t fileDataIndex )>;
+
+   class DatasetReaderImpl;
+
+   /// @brief Reads a dataset delivered as many E57 files (e.g. one per scan) as one.
+   /// @details The files are opened in parallel, and the Data3D and Image2D of all of them are
+   /// numbered one after another, in the order of the files. Each file has its own Reader, which
+   /// may be used on one thread at a time. The Readers of different files may be used at the
+   /// same time.
+   ///
+   /// @code
+   /// e57::DatasetReader dataset( e57::DatasetReader::FindFiles( "project/scans" ) );
+   ///
+   /// dataset.ForEachData3D( []( int64_t dataIndex, e57::Reader &reader, int64_t fileDataIndex ) {
+   ///    // read the points of Data3D fileDataIndex of reader
+   /// } );
+   /// @endcode
+   class E57_DLL DatasetReader
+   {
+   public:
+      /// @brief DatasetReader constructor
+      /// @param [in] filePaths Paths of the E57 files of the dataset
+      /// @param [in] options Options to be used for the files
+      /// @throw E57Exception if one of the files can't be opened
+      explicit DatasetReader( const std::vector<ustring> &filePaths,
+                              const DatasetReaderOptions &options = {} );
+
+      /// @brief Returns the paths of the files in the directory at directoryPath whose names end
+      /// with extension (ignoring case), sorted by name
+      /// @details Subdirectories aren't searched.
+      /// @throw ::ErrorOpenFailed if the directory can't be read
+      static std::vector<ustring> FindFiles( const ustring &directoryPath,
+                                             const ustring &extension = ".e57" );
+
+      /// @brief Closes the files which are open
+      /// @details They are opened again if they are needed later. None of their Readers may be
+      /// in use.
+      void Close();
+
+      /// @name Files
+      ///@{
+
+      /// @brief Returns the number of files in the dataset
+      size_t GetFileCount() const;
+
+      /// @brief Returns the path of the file at fileIndex
+      /// @throw ::ErrorBadAPIArgument if fileIndex is out of range
+      ustring GetFilePath( size_t fileIndex ) const;
+
+      /// @brief Returns the metadata summary of the file at fileIndex
+      /// @return Returns false if fileIndex is out of range
+      bool GetMetadataSummary( size_t fileIndex, MetadataSummary &summary ) const;
+
+      /// @brief Returns the Reader of the file at fileIndex, opening the file if it hasn't been
+      /// @throw ::ErrorBadAPIArgument if fileIndex is out of range
+      /// @throw E57Exception if the file can't be opened
+      Reader GetReader( size_t fileIndex ) const;
+
+      ///@}
+
+      /// @name Data3D
+      ///@{
+
+      /// @brief Returns the number of Data3D in all the files
+      int64_t GetData3DCount() const;
+
+      /// @brief Returns the file holding Data3D dataIndex, and its index in it
+      /// @throw ::ErrorBadAPIArgument if dataIndex is out of range
+      DatasetLocation GetData3DLocation( int64_t dataIndex ) const;
+
+      /// @brief Returns the summary of Data3D dataIndex without opening its file
+      /// @return Returns false if dataIndex is out of range
+      bool GetData3DSummary( int64_t dataIndex, Data3DSummary &summary ) const;
+
+      /// @brief Returns the header of Data3D dataIndex (see Reader::ReadData3D())
+      /// @return Returns false if dataIndex is out of range
+      bool ReadData3D( int64_t dataIndex, Data3D &data3DHeader ) const;
+
+      /// @brief Calls task for every Data3D of the dataset, for several files at a time
+      /// @details Tasks for the Data3D of different files run at the same time on the executor
+      /// and the calling thread (see DatasetReaderOptions::threadCount), opening the files as
+      /// needed. The Data3D of each file are given to the task one after another, in order, on
+      /// one thread. Returns once every task has finished.
+      /// @throw The first exception thrown by a task (or by opening a file), once the others
+      /// have finished
+      void ForEachData3D( const DatasetData3DTask &task ) const;
+
+      ///@}
+
+      /// @name Image2D
+      ///@{
+
+      /// @brief Returns the number of Image2D in all the files
+      int64_t GetImage2DCount() const;
+
+      /// @brief Returns the file holding Image2D imageIndex, and its index in it
+      /// @throw ::ErrorBadAPIArgument if imageIndex is out of range
+      DatasetLocation GetImage2DLocation( int64_t imageIndex ) const;
+
+      /// @brief Returns the summary of Image2D imageIndex without opening its file
+      /// @return Returns false if imageIndex is out of range
+      bool GetImage2DSummary( int64_t imageIndex, Image2DSummary &summary ) const;
+
+      /// @brief Returns the header of Image2D imageIndex (see Reader::ReadImage2D())
+      /// @return Returns false if imageIndex is out of range
+      bool ReadImage2D( int64_t imageIndex, Image2D &image2DHeader ) const;
+
+      ///@}
+
+      /// @cond documentNonPublic The following isn't part of the API, and isn't documented.
+   protected:
+      std::shared_ptr<DatasetReaderImpl> impl_;
+      /// @endcond
+   };
+}
@@ -142,6 +142,9 @@ namespace e57
       /// when "recordCount" is 0. "fileOffset" must be greater than 0 (Table 9 in the standard).
       ErrorData3DReadInvalidZeroRecords = 53,
 
+      /// a read or write was stopped by a CancellationToken
+      ErrorCancelled = 54,
+
       /// @deprecated Will be removed in 4.0. Use e57::Success.
       E57_SUCCESS E57_DEPRECATED_ENUM( "Will be removed in 4.0. Use Success." ) = Success,
       /// @deprecated Will be removed in 4.0. Use e57::ErrorBadCVHeader.
@@ -31,8 +31,14 @@
 
 /// @file  E57Format.h Header file for the E57 API.
 
+#include <array>
+#include <atomic>
 #include <cfloat>
 #include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <limits>
 #include <memory>
 #include <vector>
 
@@ -114,6 +120,8 @@ namespace e57
       Real32 = 9,   ///< C++ float type
       Real64 = 10,  ///< C++ double type
       UString = 11, ///< Unicode UTF-8 std::string
+      Bits = 12,    ///< Unsigned integers of 1, 2, 4, or 8 bits packed into bytes (see PackedBits)
+      Real16 = 13,  ///< IEEE 754 half precision float (see Float16)
 
       /// @deprecated Will be removed in 4.0. Use e57::Int8.
       E57_INT8 E57_DEPRECATED_ENUM( "Will be removed in 4.0. Use Int8." ) = Int8,
@@ -147,7 +155,7 @@ namespace e57
       ChecksumNone = 0,    ///< Do not verify the checksums. (fast)
       ChecksumSparse = 25, ///< Only verify 25% of the checksums. The last block is always verified.
       ChecksumHalf = 50,   ///< Only verify 50% of the checksums. The last block is always verified.
-      ChecksumAll = 100    ///< Verify all checksums. This is the default. (slow)
+      ChecksumAll = 100    ///< Verify all checksums. This is the default.
    };
 
    /// @brief Specifies the percentage of checksums which are verified when reading an ImageFile
@@ -363,6 +371,134 @@ public:
       /// @endcond
    };
 
+   /// @brief Variable length strings stored back to back in one array of characters, for use as a
+   /// SourceDestBuffer.
+   /// @details String @a i is the characters from data[offsets[i]] up to data[offsets[i + 1]], so
+   /// offsets always has one more element than there are strings. Reading strings into an arena
+   /// takes a few allocations per block of records instead of one per string.
+   struct E57_DLL StringArena
+   {
+      /// Characters of all the strings
+      std::vector<char> data;
+
+      /// Where each string starts in data, followed by the end of the last one
+      std::vector<size_t> offsets = { 0 };
+
+      /// Number of strings
+      size_t size() const
+      {
+         return offsets.empty() ? 0 : offsets.size() - 1;
+      }
+
+      /// Address of the first character of string @a index (which isn't null-terminated)
+      const char *string( size_t index ) const
+      {
+         return data.data() + offsets[index];
+      }
+
+      /// Length of string @a index in bytes
+      size_t length( size_t index ) const
+      {
+         return offsets[index + 1] - offsets[index];
+      }
+
+      /// Copy of string @a index
+      ustring get( size_t index ) const
+      {
+         return { string( index ), length( index ) };
+      }
+
+      /// Add a string to the end
+      void append( const char *value, size_t length )
+      {
+         data.insert( data.end(), value, value + length );
+         offsets.push_back( data.size() );
+      }
+
+      void append( const ustring &value )
+      {
+         append( value.data(), value.size() );
+      }
+
+      /// Remove all the strings, keeping the memory
+      void clear()
+      {
+         data.clear();
+         offsets.assign( 1, 0 );
+      }
+   };
+
+   /// @brief Small unsigned integers packed into bytes, for use as a SourceDestBuffer.
+   /// @details Each value takes bitsPerValue bits (1, 2, 4, or 8), least significant bit first,
+   /// so value @a i is in byte i * bitsPerValue / 8 and no value spans two bytes. One bit flags
+   /// (e.g. "isColorInvalid") take an eighth of the memory of an array of int8_t.
+   struct E57_DLL PackedBits
+   {
+      /// First byte of the values
+      uint8_t *data = nullptr;
+
+      /// Number of bits in each value: 1, 2, 4, or 8
+      unsigned bitsPerValue = 1;
+
+      /// Number of bytes holding @a count values of @a bitsPerValue bits
+      static size_t byteCount( size_t count, unsigned bitsPerValue )
+      {
+         return ( count * bitsPerValue + 7 ) / 8;
+      }
+
+      /// Largest value which fits: 2^bitsPerValue - 1
+      unsigned maximum() const
+      {
+         return ( 1U << bitsPerValue ) - 1;
+      }
+
+      /// Value @a index
+      unsigned get( size_t index ) const
+      {
+         const size_t bit = index * bitsPerValue;
+
+         return ( data[bit / 8] >> ( bit % 8 ) ) & maximum();
+      }
+
+      /// Set value @a index to the low bitsPerValue bits of @a value
+      void set( size_t index, unsigned value ) const
+      {
+         const size_t bit = index * bitsPerValue;
+         const unsigned shift = bit % 8;
+         uint8_t &byte = data[bit / 8];
+
+         byte = static_cast<uint8_t>( ( byte & ~( maximum() << shift ) ) |
+                                      ( ( value & maximum() ) << shift ) );
+      }
+   };
+
+   /// @brief A half precision (IEEE 754 binary16) floating point number, for use as a
+   /// SourceDestBuffer.
+   /// @details Only its 16 bits are kept, laid out the way GPUs expect them, so an array of
+   /// uint16_t holding half floats may be used through a cast. It has 11 significant bits
+   /// (about 3 decimal digits), and its finite values are within ±65504 (maximum()), so it suits
+   /// values which are small or relative to a nearby origin (see SourceDestBuffer::setOrigin()).
+   struct E57_DLL Float16
+   {
+      /// The raw bits: sign, 5 bit exponent, 10 bit mantissa
+      uint16_t bits = 0;
+
+      Float16() = default;
+
+      /// The nearest half precision value to @a value (ties to even). Anything which doesn't
+      /// round to a finite one becomes infinite.
+      explicit Float16( double value );
+
+      /// The value, which is exact: every half precision value is also a double.
+      explicit operator double() const;
+
+      /// Largest finite value
+      static constexpr double maximum()
+      {
+         return 65504.0;
+      }
+   };
+
    class E57_DLL SourceDestBuffer
    {
    public:
@@ -397,8 +533,15 @@ public:
       SourceDestBuffer( const ImageFile &destImageFile, const ustring &pathName, double *b,
                         size_t capacity, bool doConversion = false, bool doScaling = false,
                         size_t stride = sizeof( double ) );
+      SourceDestBuffer( const ImageFile &destImageFile, const ustring &pathName, Float16 *b,
+                        size_t capacity, bool doConversion = false, bool doScaling = false,
+                        size_t stride = sizeof( Float16 ) );
       SourceDestBuffer( const ImageFile &destImageFile, const ustring &pathName,
                         std::vector<ustring> *b );
+      SourceDestBuffer( const ImageFile &destImageFile, const ustring &pathName, StringArena *b,
+                        size_t capacity );
+      SourceDestBuffer( const ImageFile &destImageFile, const ustring &pathName, PackedBits b,
+                        size_t capacity, bool doConversion = false, bool doScaling = false );
 
       ustring pathName() const;
       enum MemoryRepresentation memoryRepresentation() const;
@@ -407,6 +550,9 @@ public:
       bool doScaling() const;
       size_t stride() const;
 
+      double origin() const;
+      void setOrigin( double origin );
+
       // Diagnostic functions:
       void dump( int indent = 0, std::ostream &os = std::cout ) const;
       void checkInvariant( bool doRecurse = true ) const;
@@ -419,6 +565,264 @@ public:
       /// @endcond
    };
 
+   /// @brief The values of one field which a record must have to be read (see
+   /// CompressedVectorReaderOptions::recordFilter)
+   struct E57_DLL RecordFieldRange
+   {
+      /// Path name of the field in the prototype (e.g. "cartesianInvalidState")
+      ustring fieldName;
+
+      /// Smallest value kept
+      double minimum = -std::numeric_limits<double>::infinity();
+
+      /// Largest value kept
+      double maximum = std::numeric_limits<double>::infinity();
+   };
+
+   /// @brief Lets reads and writes be stopped from another thread
+   /// @details Give the same token to any number of readers and writers (see
+   /// CompressedVectorReaderOptions::cancellation and CompressedVectorWriterOptions::cancellation)
+   /// and call cancel() on any thread. Each of them checks it before every packet it reads or
+   /// writes, and throws ErrorCancelled once it is set.
+   class E57_DLL CancellationToken
+   {
+   public:
+      /// @brief Ask everything using the token to stop
+      void cancel()
+      {
+         cancelled_.store( true, std::memory_order_relaxed );
+      }
+
+      /// @brief Whether cancel() has been called
+      bool isCancelled() const
+      {
+         return cancelled_.load( std::memory_order_relaxed );
+      }
+
+   private:
+      std::atomic<bool> cancelled_{ false };
+   };
+
+   /// @brief How far a CompressedVectorReader or CompressedVectorWriter has got
+   struct E57_DLL CompressedVectorProgress
+   {
+      /// Records read (the position of the reader in the CompressedVector), or given to write()
+      uint64_t recordsDone = 0;
+
+      /// Records in the CompressedVector being read, or 0 for a writer, which can't know
+      uint64_t recordCount = 0;
+
+      /// Bytes of data packets decoded (up to the end of the last one a read used), or written
+      uint64_t bytesDone = 0;
+
+      /// Bytes of data packets in the CompressedVector being read, or 0 for a writer
+      uint64_t byteCount = 0;
+   };
+
+   /// @brief Called by a CompressedVectorReader or CompressedVectorWriter as it goes (see
+   /// CompressedVectorReaderOptions::progress)
+   /// @details It is called on the thread doing the read or write, so it should return quickly.
+   /// It must not throw: to stop, cancel a CancellationToken given to the reader or writer.
+   using ProgressCallback = std::function<void( const CompressedVectorProgress &progress )>;
+
+   /// @brief The values of one field of a RecordBlock, as they are stored in its dbuf
+   /// @details T must be the type of the dbuf's MemoryRepresentation (e.g. float for Real32).
+   template <typename T> struct StridedSpan
+   {
+      const char *data = nullptr; ///< The first value
+      size_t stride = sizeof( T ); ///< Bytes from one value to the next
+      size_t count = 0;            ///< Number of values
+
+      size_t size() const
+      {
+         return count;
+      }
+
+      const T &operator[]( size_t i ) const
+      {
+         return *reinterpret_cast<const T *>( data + i * stride );
+      }
+   };
+
+   /// @brief One field of a RecordBlock
+   struct E57_DLL RecordBlockField
+   {
+      /// Path name of the field (see SourceDestBuffer::pathName())
+      ustring pathName;
+
+      /// How its values are stored (see SourceDestBuffer::memoryRepresentation())
+      MemoryRepresentation representation = Int8;
+
+      /// The value of the first record of the block, or nullptr for UString and Bits dbufs,
+      /// whose values can't be reached this way
+      const char *data = nullptr;
+
+      /// Bytes from one value to the next
+      size_t stride = 0;
+
+      /// Subtracted from each value before it was stored (see SourceDestBuffer::setOrigin())
+      double origin = 0.0;
+
+      /// The values of the block's records, of the type T of representation
+      template <typename T> StridedSpan<T> values( size_t count ) const
+      {
+         return { data, stride, count };
+      }
+   };
+
+   /// @brief A block of records read by a CompressedVectorReader, given to each of its
+   /// CompressedVectorReduction
+   /// @details The values are those left in the dbufs, after the records have been converted,
+   /// transformed, and filtered (see CompressedVectorReaderOptions).
+   struct E57_DLL RecordBlock
+   {
+      /// Number of records
+      size_t recordCount = 0;
+
+      /// The fields read, in the order of the dbufs given to the reader
+      std::vector<RecordBlockField> fields;
+
+      /// The field called pathName, or nullptr if it isn't read
+      const RecordBlockField *field( const ustring &pathName ) const
+      {
+         for ( const auto &f : fields )
+         {
+            if ( f.pathName == pathName )
+            {
+               return &f;
+            }
+         }
+
+         return nullptr;
+      }
+
+      /// The values of the field called pathName (see RecordBlockField::values()), or an empty
+      /// span if it isn't read
+      template <typename T> StridedSpan<T> values( const ustring &pathName ) const
+      {
+         const RecordBlockField *f = field( pathName );
+
+         return f ? f->values<T>( recordCount ) : StridedSpan<T>{};
+      }
+   };
+
+   /// @brief Computes something from the records as a CompressedVectorReader reads them, e.g. a
+   /// histogram of intensities, colour statistics, or the density of the points
+   /// @details Give reductions to a reader with CompressedVectorReaderOptions::reductions. Each
+   /// block of records read is split among the reader's decode threads: every thread reduces its
+   /// share into a partial of its own, made by makePartial(), and at the end of each read() the
+   /// partials are combined into the reduction in a fixed order. So the reduction is complete
+   /// after the last read(), in the same pass as the points are read, and the result doesn't
+   /// depend on the number of threads as long as combining partials is associative.
+   class E57_DLL CompressedVectorReduction
+   {
+   public:
+      virtual ~CompressedVectorReduction() = default;
+
+      /// @brief Returns a new, empty reduction of the same kind, to collect the records of one
+      /// thread
+      virtual std::unique_ptr<CompressedVectorReduction> makePartial() const = 0;
+
+      /// @brief Adds the records of block. Called on one thread at a time for each partial.
+      virtual void reduce( const RecordBlock &block ) = 0;
+
+      /// @brief Adds a partial made by makePartial(), which has reduced some of the records
+      virtual void combine( const CompressedVectorReduction &partial ) = 0;
+   };
+
+   /// @brief Options used when creating a CompressedVectorReader
+   /// @see CompressedVectorNode::reader
+   struct E57_DLL CompressedVectorReaderOptions
+   {
+      /// Number of threads used to decode the bytestreams, including the calling thread. With 1
+      /// (the default) everything is decoded on the calling thread.
+      unsigned decodeThreadCount = 1;
+
+      /// Number of packets to read ahead on a background thread while the current one is being
+      /// decoded. This overlaps file reads with decoding, which helps most on slow (e.g. network)
+      /// storage. 0 (the default) reads packets only when they are needed.
+      unsigned readAheadPacketCount = 0;
+
+      /// Number of packets kept in the read cache (must be at least 1). Each one takes up to
+      /// 64 KiB. A larger cache avoids re-reading packets when many bytestreams are spread
+      /// unevenly across packets; a smaller one saves memory.
+      unsigned packetCacheSize = 32;
+
+      /// Number of records each read() decodes for all the bytestreams before moving on to the
+      /// next ones. With interleaved (strided) buffers this keeps the records being filled in the
+      /// CPU cache until every field of them is written, which helps records with many fields.
+      /// Pick a tile whose records fit in L1 or L2 (typically a few hundred to a few thousand);
+      /// very small tiles add overhead. 0 (the default) decodes each bytestream into the whole of
+      /// its buffer in turn.
+      unsigned decodeTileSize = 0;
+
+      /// Only read every Nth record: the first one, then the one N records after it, and so on. For
+      /// previews of large point clouds. The records in between aren't converted or stored, and
+      /// packets holding only skipped records of fixed-width fields aren't read. seek() takes
+      /// record numbers of the whole CompressedVector, and reading continues every N records from
+      /// there. Must be at least 1 (the default, which reads every record).
+      unsigned recordStride = 1;
+
+      /// Names of the three fields holding the range, azimuth, and elevation (in radians) of a
+      /// point (e.g. "sphericalRange", "sphericalAzimuth", and "sphericalElevation") to convert to
+      /// cartesian coordinates as they are read. After each block of records is decoded, the
+      /// dbufs of the three fields hold x, y, and z instead, so points stored as spherical
+      /// coordinates can be read straight into cartesian buffers. This is done before
+      /// transformFields, which should then name the same three fields. All three must be read
+      /// into Real32 or Real64 dbufs. Empty names (the default) convert nothing.
+      std::array<ustring, 3> sphericalFields;
+
+      /// Names of the three fields holding the x, y, and z coordinates of a point (e.g.
+      /// "cartesianX", "cartesianY", and "cartesianZ") to transform by transformMatrix as they are
+      /// read. Each block of records is transformed as soon as it is decoded (with decodeTileSize,
+      /// each tile), while it is still in the CPU cache, so no separate pass over the points is
+      /// needed. All three must be read into Real32 or Real64 dbufs. Empty names (the default)
+      /// transform nothing.
+      std::array<ustring, 3> transformFields;
+
+      /// The row-major 3×4 affine transform (a rotation in the first three columns, and a
+      /// translation in the last) applied to the fields named by transformFields. Their values
+      /// are replaced by transformMatrix times ( x, y, z, 1 ), computed in double precision.
+      std::array<double, 12> transformMatrix = { { 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0,
+                                                   1.0, 0.0 } };
+
+      /// Only keep the records whose fields are all within these ranges (inclusive; NaN is
+      /// never kept), e.g. { "cartesianInvalidState", 0, 0 } to drop invalid points, or ranges of
+      /// x, y, and z for a box. Each block of records is tested as soon as it is decoded (and
+      /// converted and transformed), and only the kept ones are left in the dbufs. read() then
+      /// returns the number kept, and goes on decoding until the dbufs are full of kept records or
+      /// there are no more. The values are tested as they are stored in the dbufs; fields which
+      /// aren't read are decoded into buffers of the reader's own. Empty (the default) keeps every
+      /// record.
+      std::vector<RecordFieldRange> recordFilter;
+
+      /// Reductions given every block of records read (with decodeTileSize, each tile) while it
+      /// is still in the CPU cache, once it has been converted, transformed, and filtered. The
+      /// blocks are shared among the decodeThreadCount threads (see CompressedVectorReduction),
+      /// and each reduction has been given the records of a read() when it returns. They must not
+      /// be used elsewhere while a read() is running. Empty (the default) reduces nothing.
+      std::vector<std::shared_ptr<CompressedVectorReduction>> reductions;
+
+      /// Called with how far the reader has got after every progressPacketInterval data packets
+      /// it decodes, and at the end of each read(). Empty (the default) reports nothing.
+      ProgressCallback progress{};
+
+      /// Number of data packets (up to 64 KiB each) decoded between calls to progress. Must be at
+      /// least 1.
+      unsigned progressPacketInterval = 16;
+
+      /// Checked before each read() and each data packet it decodes. Once it is cancelled,
+      /// read() throws ErrorCancelled, and the records it had decoded are lost (seek() to read
+      /// them again). nullptr (the default) can't be cancelled.
+      std::shared_ptr<CancellationToken> cancellation{};
+   };
+
+   /// @brief Called when a CompressedVectorReader::readAsync() finishes
+   /// @details Gets the number of records read, or the exception the read threw (and 0). It is
+   /// called on one of the library's background threads, and must not throw. It may start
+   /// another read, but must not destroy the reader while other reads of it are waiting.
+   using ReadCompletion = std::function<void( unsigned recordCount, std::exception_ptr error )>;
+
    class E57_DLL CompressedVectorReader
    {
    public:
@@ -426,7 +830,10 @@ public:
 
       unsigned read();
       unsigned read( std::vector<SourceDestBuffer> &dbufs );
-      void seek( int64_t recordNumber ); // !!! not implemented yet
+      std::future<unsigned> readAsync();
+      std::future<unsigned> readAsync( const std::vector<SourceDestBuffer> &dbufs );
+      void readAsync( const ReadCompletion &done );
+      void seek( int64_t recordNumber );
       void close();
       bool isOpen();
       CompressedVectorNode compressedVectorNode() const;
@@ -447,6 +854,77 @@ public:
       /// @endcond
    };
 
+   /// @brief Options used when creating a CompressedVectorWriter
+   /// @see CompressedVectorNode::writer
+   struct E57_DLL CompressedVectorWriterOptions
+   {
+      /// Write a tree of index packets at the end of the binary section so readers can seek()
+      /// without scanning every data packet. Adds a few bytes per data packet.
+      bool writeIndexPackets = false;
+
+      /// Number of threads used to encode the bytestreams. Values above 1 encode them
+      /// concurrently. The file written is identical whatever the number of threads.
+      unsigned encodeThreadCount = 1;
+
+      /// Number of finished packets which may be waiting to be written to the file by a
+      /// background thread while the next ones are encoded. 0 writes each packet before encoding
+      /// the next. Nothing else may write to the file (e.g. a BlobNode) while the writer is open.
+      /// Has no effect with stageInMemory.
+      unsigned writeBehindPacketCount = 0;
+
+      /// Keep track of the smallest and largest value written to each numeric field as records
+      /// are written, so they can be found with CompressedVectorWriter::fieldLimits() without
+      /// another pass over the data.
+      bool collectFieldLimits = false;
+
+      /// Build the whole binary section in memory, and only write it to the file when the writer
+      /// is closed. Any number of writers using this option (on different CompressedVectorNodes)
+      /// can be open at once, and used on different threads at the same time, but nothing else
+      /// may write to the file (e.g. a BlobNode) until they are all closed. Uses memory for the
+      /// whole encoded section.
+      bool stageInMemory = false;
+
+      /// Put each bytestream in packets of its own, written in runs of this many packets,
+      /// instead of sharing every packet among all the bytestreams. A reader which only reads
+      /// some of the fields then has much less of the file to read. Uses memory for up to this
+      /// many packets (64 KiB each) per bytestream. Can't be used with writeIndexPackets. 0 (the
+      /// default) shares packets.
+      unsigned columnarRunPackets = 0;
+
+      /// Check the values given to each write() against the prototype with one pass over each
+      /// buffer before any of them are encoded, and then encode them without checking each
+      /// value. A write() with a value out of range still throws, and writes nothing. Meant for
+      /// data which is known to be valid, as NaNs given for integer fields aren't caught.
+      bool validatePerWrite = false;
+
+      /// Longest time in milliseconds the records given to write() are held by the writer before
+      /// they are written to the file, so a reader following the file sees them soon after they
+      /// are written. It is checked at the end of each write(), which writes whatever is held
+      /// (see CompressedVectorWriter::flush) once the oldest records are this old. 0 (the
+      /// default) only writes a packet once it is nearly full. Has no effect with stageInMemory.
+      unsigned maxPacketLatencyMs = 0;
+
+      /// Most records to put in one data packet. The packet is written once it has this many,
+      /// even if it isn't full. 0 (the default) only writes a packet once it is nearly full.
+      /// Can't be used with columnarRunPackets.
+      unsigned maxPacketRecords = 0;
+
+      /// Called with how far the writer has got after every progressPacketInterval data packets
+      /// it writes (or stages), and at the end of each write(). Empty (the default) reports
+      /// nothing.
+      ProgressCallback progress{};
+
+      /// Number of data packets (up to 64 KiB each) written between calls to progress. Must be
+      /// at least 1.
+      unsigned progressPacketInterval = 16;
+
+      /// Checked before each write() and each data packet written. Once it is cancelled, write()
+      /// and flush() throw ErrorCancelled, and close() writes nothing more, leaving the
+      /// CompressedVectorNode without its data, so the ImageFile should then be cancelled (see
+      /// ImageFile::cancel()). nullptr (the default) can't be cancelled.
+      std::shared_ptr<CancellationToken> cancellation{};
+   };
+
    class E57_DLL CompressedVectorWriter
    {
    public:
@@ -454,9 +932,11 @@ public:
 
       void write( size_t recordCount );
       void write( std::vector<SourceDestBuffer> &sbufs, size_t recordCount );
+      void flush();
       void close();
       bool isOpen();
       CompressedVectorNode compressedVectorNode() const;
+      bool fieldLimits( const ustring &pathName, double &minimum, double &maximum ) const;
 
       void dump( int indent = 0, std::ostream &os = std::cout ) const;
       void checkInvariant( bool doRecurse = true );
@@ -487,7 +967,13 @@ public:
 
       // Iterators
       CompressedVectorWriter writer( std::vector<SourceDestBuffer> &sbufs );
+      CompressedVectorWriter writer( std::vector<SourceDestBuffer> &sbufs,
+                                     const CompressedVectorWriterOptions &options );
       CompressedVectorReader reader( const std::vector<SourceDestBuffer> &dbufs );
+      CompressedVectorReader reader( const std::vector<SourceDestBuffer> &dbufs,
+                                     const CompressedVectorReaderOptions &options );
+
+      void copyFrom( const CompressedVectorNode &source );
 
       // Up/Down cast conversion
       operator Node() const;
@@ -685,6 +1171,11 @@ public:
       /// @endcond
    };
 
+   /// @brief Called by BlobNode::write() for the next bytes to write to the blob
+   /// @details Put up to count bytes in buffer and return how many were put there. Returning 0
+   /// before all of the bytes have been given is an error.
+   using BlobSource = std::function<size_t( uint8_t *buffer, size_t count )>;
+
    class E57_DLL BlobNode
    {
    public:
@@ -693,7 +1184,14 @@ public:
 
       int64_t byteCount() const;
       void read( uint8_t *buf, int64_t start, size_t count );
+      void read( uint8_t *buf, int64_t start, size_t count, unsigned threadCount );
       void write( uint8_t *buf, int64_t start, size_t count );
+      void write( uint8_t *buf, int64_t start, size_t count, unsigned threadCount );
+      void write( const BlobSource &source, int64_t start, size_t count,
+                  unsigned threadCount = 1 );
+      int64_t importFile( const ustring &fileName, int64_t start = 0, unsigned threadCount = 1 );
+      void importFile( int fd, int64_t fileOffset, int64_t start, size_t count,
+                       unsigned threadCount = 1 );
 
       // Up/Down cast conversion
       operator Node() const;
@@ -727,23 +1225,420 @@ public:
       /// @endcond
    };
 
+   /// @brief Counts for one field read from a CompressedVector
+   /// @see ImageFileStatistics
+   struct E57_DLL ChannelStatistics
+   {
+      /// Absolute path name of the field (e.g. "/data3D/0/points/cartesianX")
+      ustring pathName;
+
+      /// Number of data packets whose bytestream for the field was used up by decoding.
+      uint64_t packetsDecoded = 0;
+
+      /// Number of records of the field read.
+      uint64_t recordsRead = 0;
+   };
+
+   /// @brief Performance counters for an ImageFile
+   /// @details These are only collected if the library was built with the cmake option
+   /// E57_ENABLE_STATISTICS. Otherwise @a enabled is false and everything is zero.
+   /// @see ImageFile::statistics()
+   struct E57_DLL ImageFileStatistics
+   {
+      /// The library was built to collect statistics.
+      bool enabled = false;
+
+      /// Bytes of pages read from the file (or memory buffer), including their checksums.
+      uint64_t bytesRead = 0;
+
+      /// Number of pages read from the file.
+      uint64_t pagesRead = 0;
+
+      /// Bytes of pages written to the file, including their checksums.
+      uint64_t bytesWritten = 0;
+
+      /// Number of pages written to the file.
+      uint64_t pagesWritten = 0;
+
+      /// Number of page checksums verified when reading.
+      uint64_t checksumsVerified = 0;
+
+      /// Number of times a CompressedVectorReader found the packet it needed in its cache.
+      uint64_t packetCacheHits = 0;
+
+      /// Number of times a CompressedVectorReader had to read the packet it needed (or wait for
+      /// read-ahead to finish reading it).
+      uint64_t packetCacheMisses = 0;
+
+      /// Number of those misses which were found in the ImageFile's shared packet cache (see
+      /// ImageFileOptions::sharedPacketCacheSize), so the packet wasn't read again.
+      uint64_t sharedPacketCacheHits = 0;
+
+      /// Number of data packets written by CompressedVectorWriters.
+      uint64_t dataPacketsWritten = 0;
+
+      /// Bytes of those data packets, including their headers and padding.
+      uint64_t dataPacketBytesWritten = 0;
+
+      /// How full the data packets written are on average: dataPacketBytesWritten over the
+      /// largest size of that many packets (64 KiB each), or 0 if none have been written.
+      double dataPacketFillRatio = 0.0;
+
+      /// Counts for each field read by CompressedVectorReaders, sorted by path name.
+      std::vector<ChannelStatistics> channels;
+
+      /// Time spent parsing the XML section, including reading it and parsing deferred XML (see
+      /// ImageFileOptions::lazyLoadXml).
+      double xmlParseSeconds = 0.0;
+
+      /// Time CompressedVectorReaders spent decoding bytestreams.
+      double decodeSeconds = 0.0;
+
+      /// Time spent reading and writing pages, added up across threads. Pages of memory-mapped
+      /// files and memory buffers are counted but not timed.
+      double ioSeconds = 0.0;
+   };
+
+   /// @brief Bytes of memory held by each part of an ImageFile
+   /// @details Unlike ImageFileStatistics these are always counted. Buffers of the application's
+   /// own (such as those of SourceDestBuffers) aren't included.
+   /// @see ImageFile::memoryUsage(), ImageFileOptions::memoryBudget
+   struct E57_DLL ImageFileMemoryUsage
+   {
+      /// Packets cached by open CompressedVectorReaders (see
+      /// CompressedVectorReaderOptions::packetCacheSize).
+      uint64_t packetCache = 0;
+
+      /// Packets read ahead by open CompressedVectorReaders (see
+      /// CompressedVectorReaderOptions::readAheadPacketCount).
+      uint64_t readAhead = 0;
+
+      /// Input buffers of the decoders of open CompressedVectorReaders.
+      uint64_t decoders = 0;
+
+      /// Output buffers of the encoders of open CompressedVectorWriters.
+      uint64_t encoders = 0;
+
+      /// Packets waiting to be written by open CompressedVectorWriters (see
+      /// CompressedVectorWriterOptions::writeBehindPacketCount and stageInMemory).
+      uint64_t writeBuffers = 0;
+
+      /// Nodes read from the XML section, including their arena (see
+      /// ImageFileOptions::useNodeArena).
+      uint64_t nodes = 0;
+
+      /// XML waiting to be parsed (see ImageFileOptions::lazyLoadXml), and the copy of the XML
+      /// section held while it is split up.
+      uint64_t xml = 0;
+
+      /// Sum of all of the above.
+      uint64_t total = 0;
+
+      /// Largest total since the ImageFile was opened.
+      uint64_t peak = 0;
+
+      /// The budget (see ImageFileOptions::memoryBudget), or 0 if there is none.
+      uint64_t budget = 0;
+   };
+
+   /// @brief Where an ImageFile opened for reading gets its bytes from
+   /// @details Implement this to read E57 data from somewhere other than a local file or a
+   /// buffer in memory (an object store, for example) and open it with
+   /// ImageFile::ImageFile( const std::shared_ptr<ReadSource> &, const ImageFileOptions & ).
+   ///
+   /// The library reads whole 1024 byte pages, and usually many of them at once. Concurrent
+   /// CompressedVectorReaders, read-ahead, and checksum verification read on several threads at
+   /// the same time, so implementations must be thread safe.
+   class E57_DLL ReadSource
+   {
+   public:
+      /// @brief A range of bytes to read into a buffer
+      struct Range
+      {
+         uint64_t offset = 0;    ///< Offset of the first byte from the start of the source
+         char *buffer = nullptr; ///< Where to put the bytes
+         size_t count = 0;       ///< Number of bytes
+      };
+
+      virtual ~ReadSource() = default;
+
+      /// @brief Name used in error messages and returned by ImageFile::fileName()
+      virtual ustring name() const;
+
+      /// @brief Total number of bytes in the source
+      virtual uint64_t size() const = 0;
+
+      /// @brief Read exactly @a count bytes starting at @a offset into @a buffer
+      /// @details Throw an exception if they can't all be read. Exceptions which aren't
+      /// E57Exceptions are reported as ::ErrorReadFailed.
+      virtual void readAt( uint64_t offset, char *buffer, size_t count ) = 0;
+
+      /// @brief Read each of @a ranges
+      /// @details The default calls readAt() for each one in turn. Override this to issue them
+      /// together (e.g. as vectored or batched requests).
+      virtual void readRanges( const std::vector<Range> &ranges );
+
+      /// @brief Start reading @a count bytes starting at @a offset into @a buffer
+      /// @details The future becomes ready (or holds the exception) when the read is done, and
+      /// @a buffer must stay valid until then. The default calls readAt() before returning.
+      virtual std::future<void> readAtAsync( uint64_t offset, char *buffer, size_t count );
+
+      /// @brief All of the bytes, if they are in memory for as long as the source exists
+      /// @details Pages are then checksummed and copied straight from here instead of being read.
+      /// The default returns nullptr.
+      virtual const char *data() const;
+   };
+
+   class BlockCacheReadSourceImpl;
+
+   /// @brief A ReadSource which reads another one in large aligned blocks and caches them
+   /// @details Use this in front of a ReadSource where each read is expensive, such as HTTP range
+   /// requests to an object store. Reads of blocks which aren't cached are joined together, so
+   /// blocks next to each other are fetched with a single readAt() of @a source, and the most
+   /// recently used blocks are kept (up to @a maxBlockCount of them).
+   ///
+   /// Opening a file reads its header (at the start) and its XML section (usually at the end), and
+   /// reading a Data3D reads the range its packets are in, so only a few requests are made.
+   class E57_DLL BlockCacheReadSource : public ReadSource
+   {
+   public:
+      static constexpr size_t cDefaultBlockSize = 4 * 1024 * 1024;
+      static constexpr size_t cDefaultMaxBlockCount = 16;
+
+      /// @param [in] source Where to read the blocks from
+      /// @param [in] blockSize Size of each block (rounded up to a multiple of 1024)
+      /// @param [in] maxBlockCount Most blocks to cache
+      /// @throw ::ErrorBadAPIArgument if @a source is null or a size is 0
+      explicit BlockCacheReadSource( const std::shared_ptr<ReadSource> &source,
+                                     size_t blockSize = cDefaultBlockSize,
+                                     size_t maxBlockCount = cDefaultMaxBlockCount );
+
+      ustring name() const override;
+      uint64_t size() const override;
+      void readAt( uint64_t offset, char *buffer, size_t count ) override;
+      void readRanges( const std::vector<Range> &ranges ) override;
+
+      /// @brief Number of reads made from the underlying source
+      uint64_t fetchCount() const;
+
+      /// @brief Number of bytes read from the underlying source
+      uint64_t bytesFetched() const;
+
+   private:
+      std::shared_ptr<BlockCacheReadSourceImpl> impl_;
+   };
+
+   /// @brief Runs the work the library does in parallel
+   /// @details Decoding and encoding on several threads, checksums, blob transfers, read-ahead,
+   /// write-behind, and CompressedVectorReader::readAsync() are all split into tasks which are
+   /// given to an executor instead of threads of the library's own. Implement this to run them on
+   /// a thread pool you already have, and pass it in ImageFileOptions::executor.
+   ///
+   /// The library never waits for a task to start without being able to do its work itself, so
+   /// tasks may be queued for as long as needed, but each one must run eventually.
+   class E57_DLL Executor
+   {
+   public:
+      virtual ~Executor() = default;
+
+      /// @brief Run @a task on one of the executor's threads, now or later
+      virtual void execute( std::function<void()> task ) = 0;
+
+      /// @brief Number of tasks the executor can run at the same time
+      virtual unsigned concurrency() const = 0;
+   };
+
+   class WorkStealingExecutorImpl;
+
+   /// @brief An Executor with a fixed set of threads which steal tasks from each other
+   /// @details Each thread has its own queue. Tasks given by one of the threads go on its own
+   /// queue, and a thread with nothing to do takes the oldest task of another one. This is what
+   /// ImageFiles use when they aren't given an executor (see defaultExecutor()).
+   class E57_DLL WorkStealingExecutor : public Executor
+   {
+   public:
+      /// @param [in] threadCount Number of threads, or 0 for one per hardware thread
+      explicit WorkStealingExecutor( unsigned threadCount = 0 );
+
+      /// Runs the tasks still queued, then stops the threads
+      ~WorkStealingExecutor() override;
+
+      void execute( std::function<void()> task ) override;
+      unsigned concurrency() const override;
+
+      /// @brief The executor shared by everything which isn't given one
+      /// @details Its threads are started the first time it is used.
+      static std::shared_ptr<Executor> defaultExecutor();
+
+   private:
+      std::shared_ptr<WorkStealingExecutorImpl> impl_;
+   };
+
+   /// @brief Where an ImageFile being written puts its bytes
+   /// @details Implement this to write E57 data somewhere other than a local file and create
+   /// the ImageFile with
+   /// ImageFile::ImageFile( const std::shared_ptr<WriteSink> &, const ImageFileOptions & ).
+   /// MemoryWriteSink collects them in memory.
+   ///
+   /// The library writes whole 1024 byte pages, mostly one after another at the end. Some are
+   /// written again later though: the file header at the start is written by ImageFile::close(),
+   /// the header of each binary section when its writer closes, and a partly filled last page
+   /// is read back and rewritten as more is added. So the bytes are only an E57 file once
+   /// close() returns. Calls are made from one thread at a time, but not always the same one.
+   class E57_DLL WriteSink
+   {
+   public:
+      virtual ~WriteSink() = default;
+
+      /// @brief Name used in error messages and returned by ImageFile::fileName()
+      virtual ustring name() const;
+
+      /// @brief Number of bytes written, up to the end of the furthest write
+      virtual uint64_t size() const = 0;
+
+      /// @brief Write @a count bytes from @a buffer starting at @a offset
+      /// @details This may be past the end, in which case the bytes in between are zero.
+      /// Exceptions which aren't E57Exceptions are reported as ::ErrorWriteFailed.
+      virtual void writeAt( uint64_t offset, const char *buffer, size_t count ) = 0;
+
+      /// @brief Read back @a count of the bytes written starting at @a offset into @a buffer
+      virtual void readAt( uint64_t offset, char *buffer, size_t count ) = 0;
+
+      /// @brief Get ready for the data to grow to @a size bytes (see ImageFile::reserveSpace())
+      /// @details The default does nothing.
+      virtual void reserve( uint64_t size );
+   };
+
+   /// @brief A WriteSink which collects an E57 file in memory
+   /// @details Use this to produce a file without writing it to the disk, for example to send it
+   /// as an HTTP response. Once the ImageFile is closed, buffer() holds the whole file.
+   class E57_DLL MemoryWriteSink : public WriteSink
+   {
+   public:
+      explicit MemoryWriteSink( const ustring &name = "<MemoryWriteSink>" );
+
+      ustring name() const override;
+      uint64_t size() const override;
+      void writeAt( uint64_t offset, const char *buffer, size_t count ) override;
+      void readAt( uint64_t offset, char *buffer, size_t count ) override;
+      void reserve( uint64_t size ) override;
+
+      /// @brief The bytes written so far
+      const std::vector<char> &buffer() const;
+
+      /// @brief Move the bytes written out of the sink, leaving it empty
+      std::vector<char> takeBuffer();
+
+   private:
+      ustring name_;
+      std::vector<char> buffer_;
+   };
+
+   /// @brief Options used when opening an ImageFile
+   /// @see ImageFile::ImageFile
+   struct E57_DLL ImageFileOptions
+   {
+      /// The percentage of checksums we compute and verify when reading (see
+      /// ReadChecksumPolicy).
+      ReadChecksumPolicy checksumPolicy = ChecksumAll;
+
+      /// When reading, only parse the XML of each child of /data3D and /images2D the first time
+      /// one of its nodes is used, instead of when the file is opened. This makes opening files
+      /// with many scans much faster when only some of them are needed. Ignored when writing or
+      /// appending.
+      bool lazyLoadXml = false;
+
+      /// Have the XML parser validate the XML section and do schema processing when reading.
+      /// Turning this off uses a minimal parser configuration, which is faster for files from
+      /// trusted sources. Files which aren't valid E57 are still rejected when their nodes are
+      /// built.
+      bool validateXml = true;
+
+      /// When reading, allocate the nodes built from the XML section from a few large blocks of
+      /// memory instead of one at a time. The blocks are released together once the ImageFile
+      /// and all of its nodes are gone. This avoids fragmenting the heap in programs which open
+      /// many files. Ignored when writing.
+      bool useNodeArena = false;
+
+      /// When reading, verify the checksum of every page of the file when it is opened, using
+      /// this many threads (see ImageFile::verifyChecksums()), and then read it without checking
+      /// them again (checksumPolicy is ignored). 0 (the default) doesn't verify up front.
+      unsigned verifyChecksumThreadCount = 0;
+
+      /// When writing, collect the pages in large aligned buffers and write them with direct I/O
+      /// (O_DIRECT on Linux, F_NOCACHE on macOS, FILE_FLAG_NO_BUFFERING on Windows), so writing
+      /// very large files doesn't push everything else out of the OS page cache. If the file
+      /// system doesn't allow direct I/O, the file is written as usual. Ignored when reading or
+      /// appending.
+      bool directIo = false;
+
+      /// When writing, keep a journal next to the file (named like it with ".journal" added) so
+      /// that ImageFile::recover() can turn what was written into a valid file if the program
+      /// stops before close(). It is written whenever a CompressedVectorWriter closes, and after
+      /// every this many data packets while one is open, so at most this many packets of points
+      /// are lost. The writers end their bytestreams at chunk boundaries to allow this, as with
+      /// CompressedVectorWriterOptions::writeIndexPackets. Writers using stageInMemory or
+      /// columnarRunPackets are only journaled once they close. close() removes the journal.
+      /// Turns off directIo. 0 (the default) doesn't keep a journal.
+      unsigned journalInterval = 0;
+
+      /// When reading, allow the file to still be being written by another ImageFile with a
+      /// journalInterval. Until the writer closes it, the file is read as its journal describes
+      /// it, and ImageFile::refresh() picks up what has been written since. Complete files are
+      /// read as usual. A followed file is read without memory-mapping it and with lazyLoadXml
+      /// off, and its readers don't read ahead (see
+      /// CompressedVectorReaderOptions::readAheadPacketCount). Ignored when writing or
+      /// appending.
+      bool follow = false;
+
+      /// Where the file's parallel work runs (see Executor). nullptr (the default) uses
+      /// WorkStealingExecutor::defaultExecutor().
+      std::shared_ptr<Executor> executor{};
+
+      /// Most bytes of memory the file may hold (see ImageFileMemoryUsage), or 0 (the default)
+      /// for no limit. Packet caches, read-ahead, and write-behind are made smaller (or left out)
+      /// to keep within it. What is needed to work at all (one cached packet for each reader,
+      /// decoders, encoders, and nodes) is always allocated, even if it goes over.
+      uint64_t memoryBudget = 0;
+
+      /// Number of packets (up to 64 KiB each) read by any of the file's CompressedVectorReaders
+      /// to keep for the others, e.g. when several threads read the same section. A packet one
+      /// of them has read and verified is then copied from there instead of being read again.
+      /// The cache is split into shards with locks of their own, so readers on different
+      /// threads rarely wait for each other. Used when reading (not following) a file. 0 (the
+      /// default) shares nothing.
+      unsigned sharedPacketCacheSize = 0;
+   };
+
    class E57_DLL ImageFile
    {
    public:
       ImageFile() = delete;
       ImageFile( const ustring &fname, const ustring &mode,
                  ReadChecksumPolicy checksumPolicy = ChecksumAll );
+      ImageFile( const ustring &fname, const ustring &mode, const ImageFileOptions &options );
       ImageFile( const char *input, uint64_t size,
                  ReadChecksumPolicy checksumPolicy = ChecksumAll );
+      ImageFile( const char *input, uint64_t size, const ImageFileOptions &options );
+      ImageFile( const std::shared_ptr<ReadSource> &source, const ImageFileOptions &options = {} );
+      ImageFile( const std::shared_ptr<WriteSink> &sink, const ImageFileOptions &options = {} );
 
       StructureNode root() const;
       void close();
       void cancel();
+      static void recover( const ustring &fname );
       bool isOpen() const;
       bool isWritable() const;
       ustring fileName() const;
       int writerCount() const;
       int readerCount() const;
+      void verifyChecksums( unsigned threadCount = 1 ) const;
+      bool refresh();
+      void reserveSpace( uint64_t byteCount );
+      ImageFileStatistics statistics() const;
+      void resetStatistics();
+      ImageFileMemoryUsage memoryUsage() const;
+      void setMemoryBudget( uint64_t byteCount );
 
       // Manipulate registered extensions in the file
       void extensionsAdd( const ustring &prefix, const ustring &uri );
@@ -787,4 +1682,24 @@ public:
       std::shared_ptr<ImageFileImpl> impl_;
       /// @endcond
    };
+
+   /// @brief Record what the library is doing on each thread, for viewing on a timeline
+   /// @details Scoped events are recorded around reading and decoding packets, writing packets,
+   /// parsing XML, and file reads and writes, on whichever thread does them. They are only recorded
+   /// if the library was built with the cmake option E57_ENABLE_TRACING.
+   ///
+   /// The trace is written in the Chrome trace event format (JSON), which can be opened with
+   /// chrome://tracing or https://ui.perfetto.dev.
+   namespace Tracing
+   {
+      /// @brief Start recording events, discarding any recorded before.
+      /// @return false if the library was built without E57_ENABLE_TRACING.
+      E57_DLL bool start();
+
+      /// @brief Stop recording events and write them to @a fileName.
+      /// @details If the library was built without E57_ENABLE_TRACING, the trace has no events.
+      /// @throw ::ErrorOpenFailed
+      /// @throw ::ErrorWriteFailed
+      E57_DLL void stop( const ustring &fileName );
+   }
 }
@@ -33,6 +33,9 @@
 /// @file
 /// @brief Data structures for E57 Simple API
 
+#include <map>
+#include <mutex>
+
 #include "E57Format.h"
 
 namespace e57
@@ -616,6 +619,54 @@ namespace e57
       size_t pointCount = 0;
    };
 
+   /// @brief Provides the memory for the buffers of a Data3DPointsData_t
+   /// @details Each Data3DPointsData_t takes one block for all of its buffers. Blocks must be
+   /// aligned to Data3DPointsData_t::cAlignment bytes. The allocator must outlive the points
+   /// data using it, and may be used from several threads at once.
+   class E57_DLL Data3DPointsAllocator
+   {
+   public:
+      virtual ~Data3DPointsAllocator() = default;
+
+      /// @brief Allocate @a size bytes (never 0) aligned to Data3DPointsData_t::cAlignment
+      virtual void *allocate( size_t size ) = 0;
+
+      /// @brief Free @a memory, which allocate( @a size ) returned
+      virtual void deallocate( void *memory, size_t size ) = 0;
+   };
+
+   /// @brief A Data3DPointsAllocator which keeps freed blocks to hand out again.
+   /// @details Reading or writing scans one after another with the same pool allocates once for
+   /// the largest scan instead of once per scan. A block is reused for any request it is big
+   /// enough for. Cached blocks are freed by release() and by the destructor.
+   class E57_DLL Data3DPointsBufferPool : public Data3DPointsAllocator
+   {
+   public:
+      Data3DPointsBufferPool() = default;
+      ~Data3DPointsBufferPool() override;
+
+      Data3DPointsBufferPool( const Data3DPointsBufferPool & ) = delete;
+      Data3DPointsBufferPool &operator=( const Data3DPointsBufferPool & ) = delete;
+
+      void *allocate( size_t size ) override;
+      void deallocate( void *memory, size_t size ) override;
+
+      /// @brief Free the cached blocks. Blocks in use aren't affected.
+      void release();
+
+      /// @brief The number of bytes in cached blocks
+      size_t cachedSize() const;
+
+   private:
+      mutable std::mutex mutex_;
+
+      /// Blocks which aren't in use, by size
+      std::multimap<size_t, void *> free_;
+
+      /// Size of each block in use
+      std::map<void *, size_t> used_;
+   };
+
    /// @brief Stores pointers to user-provided buffers
    template <typename COORDTYPE> struct Data3DPointsData_t
    {
@@ -632,17 +683,41 @@ namespace e57
       This constructor will also adjust the min/max fields in the data3D pointFields if
       we are using floats, and run some validation on the Data3D.
 
+      All the buffers share one block of memory, and each one starts on a cAlignment byte
+      boundary.
+
+      With @a packInvalidStates, the invalid state fields get packed buffers (e.g.
+      cartesianInvalidStateBits) instead of int8_t ones, which take an eighth (or a quarter) of
+      the memory.
+
       @param [in] data3D Completed header which indicates the fields we are using
+      @param [in] allocator Where to get the memory from (nullptr for the heap)
+      @param [in] packInvalidStates Allocate the packed invalid state buffers instead of the
+      int8_t ones
 
       @throw ::ErrorValueOutOfBounds
       @throw ::ErrorInvalidNodeType
       */
-      explicit Data3DPointsData_t( e57::Data3D &data3D );
+      explicit Data3DPointsData_t( e57::Data3D &data3D,
+                                   Data3DPointsAllocator *allocator = nullptr,
+                                   bool packInvalidStates = false );
 
-      /// @brief Destructor will delete any memory allocated using the Data3DPointsData_t( const
+      /// @brief Destructor will free any memory allocated using the Data3DPointsData_t( const
       /// e57::Data3D & ) constructor
       ~Data3DPointsData_t();
 
+      /// @brief Take the buffers (and any memory) of @a other, which is left empty
+      Data3DPointsData_t( Data3DPointsData_t &&other ) noexcept;
+      Data3DPointsData_t &operator=( Data3DPointsData_t &&other ) noexcept;
+
+      // The memory has one owner
+      Data3DPointsData_t( const Data3DPointsData_t & ) = delete;
+      Data3DPointsData_t &operator=( const Data3DPointsData_t & ) = delete;
+
+      /// Alignment (in bytes) of the buffers allocated by the Data3DPointsData_t( e57::Data3D & )
+      /// constructor, enough for any SIMD instructions
+      static constexpr size_t cAlignment = 64;
+
       /// @brief Pointer to a buffer with the X coordinate (in meters) of the point in Cartesian
       /// coordinates
       COORDTYPE *cartesianX = nullptr;
@@ -714,6 +789,26 @@ namespace e57
       /// @brief Value = 0 if the timeStamp is considered valid, 1 otherwise
       int8_t *isTimeStampInvalid = nullptr;
 
+      /// @name Packed invalid states
+      /// The invalid state fields above packed into bits (see PackedBits), e.g.
+      /// `points.isColorInvalidBits.get( i )`. cartesianInvalidState and sphericalInvalidState
+      /// take 2 bits a point and the others 1, so a billion points need 250 or 125 MB for each
+      /// field instead of 1 GB.
+      ///
+      /// Points are read into and written from these when the int8_t buffer of the same field
+      /// is nullptr. They are decoded and encoded by copying the bits straight from and to the
+      /// file, but can't be used with a spatial order (see WriterOptions::spatialOrder) or to
+      /// read a level of detail, and Reader::ReadData3DGridRows() fills them on one thread.
+      ///@{
+
+      PackedBits cartesianInvalidStateBits{ nullptr, 2 }; ///< See cartesianInvalidState
+      PackedBits isIntensityInvalidBits{ nullptr, 1 };    ///< See isIntensityInvalid
+      PackedBits isColorInvalidBits{ nullptr, 1 };        ///< See isColorInvalid
+      PackedBits sphericalInvalidStateBits{ nullptr, 2 }; ///< See sphericalInvalidState
+      PackedBits isTimeStampInvalidBits{ nullptr, 1 };    ///< See isTimeStampInvalid
+
+      ///@}
+
       /// @name Extension: E57_EXT_surface_normals
       /// The following fields are part of the
       /// [E57_EXT_surface_normals](http://www.libe57.org/E57_EXT_surface_normals.txt) extension.
@@ -729,11 +824,28 @@ namespace e57
       ///@}
 
    private:
-      /// @brief Keeps track of whether we used the Data3D constructor or not so we can free our
-      /// memory.
-      bool _selfAllocated = false;
+      /// Call @a function on each buffer pointer of @a a with the same one of @a b
+      template <typename Function>
+      static void _forEachBuffer( Data3DPointsData_t &a, Data3DPointsData_t &b,
+                                  Function function );
+
+      void _free();
+
+      /// @brief The memory allocated by the Data3D constructor for all the buffers, or nullptr
+      /// if they are the user's
+      void *_memory = nullptr;
+
+      /// Size of _memory
+      size_t _memorySize = 0;
+
+      /// Where _memory came from (nullptr for the heap)
+      Data3DPointsAllocator *_allocator = nullptr;
    };
 
+   /// @cond documentNonPublic
+   template <typename COORDTYPE> constexpr size_t Data3DPointsData_t<COORDTYPE>::cAlignment;
+   /// @endcond
+
    using Data3DPointsFloat = Data3DPointsData_t<float>;
    using Data3DPointsDouble = Data3DPointsData_t<double>;
 
@@ -747,6 +859,39 @@ namespace e57
    extern template struct Data3DPointsData_t<float>;
    extern template struct Data3DPointsData_t<double>;
 
+   /// @brief Describes one field of the points in a Data3DPointsInterleaved
+   struct E57_DLL Data3DPointField
+   {
+      /// Name of the field in the Data3D's points prototype (e.g. "cartesianX" or "colorRed")
+      ustring name;
+
+      /// @brief Type of the field in memory
+      /// @details Values are converted to and from the type in the file (and scaled for
+      /// ScaledInteger fields). UString and Bits aren't allowed.
+      MemoryRepresentation type = Real64;
+
+      /// Offset of the field from the start of each point in bytes (e.g. using offsetof()). The
+      /// field must be aligned for its type.
+      size_t offset = 0;
+   };
+
+   /// @brief Points stored one after another in the user's memory (an array of structs), instead
+   /// of in a buffer for each field like Data3DPointsData_t
+   /// @details The fields are read and written in place, so they don't need to be copied into
+   /// separate buffers first.
+   struct E57_DLL Data3DPointsInterleaved
+   {
+      /// Start of the first point
+      void *base = nullptr;
+
+      /// Distance between the start of one point and the start of the next in bytes (e.g.
+      /// sizeof() the struct)
+      size_t stride = 0;
+
+      /// The fields to read or write
+      std::vector<Data3DPointField> fields;
+   };
+
    /// @brief Stores an image that is to be used only as a visual reference.
    struct E57_DLL VisualReferenceRepresentation
    {
@@ -996,4 +1141,66 @@ namespace e57
       E57_CYLINDRICAL E57_DEPRECATED_ENUM( "Will be removed in 4.0. Use ProjectionCylindrical." ) =
          ProjectionCylindrical,
    };
+
+   /// @brief The metadata of one Data3D kept in a MetadataSummary
+   struct E57_DLL Data3DSummary
+   {
+      ustring name;        ///< Data3D::name
+      ustring guid;        ///< Data3D::guid
+      ustring description; ///< Data3D::description
+
+      RigidBodyTransform pose;         ///< Data3D::pose
+      IndexBounds indexBounds;         ///< Data3D::indexBounds
+      CartesianBounds cartesianBounds; ///< Data3D::cartesianBounds
+      SphericalBounds sphericalBounds; ///< Data3D::sphericalBounds
+
+      int64_t pointCount = 0; ///< Data3D::pointCount
+
+      bool hasCartesian = false; ///< Whether the points have cartesianX, Y, and Z
+      bool hasSpherical = false; ///< Whether the points have sphericalRange, Azimuth, and Elevation
+      bool hasIntensity = false; ///< Whether the points have intensity
+      bool hasColor = false;     ///< Whether the points have colorRed, Green, and Blue
+   };
+
+   /// @brief The metadata of one Image2D kept in a MetadataSummary
+   struct E57_DLL Image2DSummary
+   {
+      ustring name;                 ///< Image2D::name
+      ustring guid;                 ///< Image2D::guid
+      ustring description;          ///< Image2D::description
+      ustring associatedData3DGuid; ///< Image2D::associatedData3DGuid
+
+      RigidBodyTransform pose; ///< Image2D::pose
+
+      /// The projection of the image, and its size in pixels (see Reader::GetImage2DSizes())
+      Image2DProjection projection = ProjectionNone;
+      int64_t width = 0;
+      int64_t height = 0;
+   };
+
+   /// @brief A compact summary of the metadata catalogues ask about, which can be saved next to
+   /// an E57 file and read back without parsing the file's XML.
+   /// @see Reader::GetMetadataSummary(), Reader::ReadMetadataSummary()
+   struct E57_DLL MetadataSummary
+   {
+      ustring guid;               ///< E57Root::guid
+      ustring coordinateMetadata; ///< E57Root::coordinateMetadata
+
+      /// Size in bytes and modification time (in nanoseconds since the epoch) of the file it was
+      /// made from, used to tell whether a saved summary is out of date. 0 if it wasn't made from
+      /// a local file.
+      uint64_t fileSize = 0;
+      int64_t fileModified = 0;
+
+      std::vector<Data3DSummary> data3D;
+      std::vector<Image2DSummary> images2D;
+
+      /// @brief Encode the summary in a compact binary form
+      std::vector<char> serialize() const;
+
+      /// @brief Decode a summary from serialize()
+      /// @return Returns false, leaving the summary unchanged, if data isn't a summary this
+      /// version of the library can read
+      bool deserialize( const std::vector<char> &data );
+   };
 } // end namespace e57
@@ -35,6 +35,9 @@
 /// @details This includes support for the
 /// [E57_EXT_surface_normals](http://www.libe57.org/E57_EXT_surface_normals.txt) extension.
 
+#include <array>
+#include <functional>
+
 #include "E57SimpleData.h"
 
 namespace e57
@@ -44,8 +47,128 @@ namespace e57
    {
       /// Set how frequently to verify the checksums (see ReadChecksumPolicy).
       ReadChecksumPolicy checksumPolicy = ChecksumAll;
+
+      /// Number of threads to use when decoding each Data3D's points (see
+      /// CompressedVectorReaderOptions::decodeThreadCount)
+      unsigned decodeThreadCount = 1;
+
+      /// Number of packets to read ahead when reading each Data3D's points (see
+      /// CompressedVectorReaderOptions::readAheadPacketCount)
+      unsigned readAheadPacketCount = 0;
+
+      /// Number of packets to cache when reading each Data3D's points (see
+      /// CompressedVectorReaderOptions::packetCacheSize)
+      unsigned packetCacheSize = 32;
+
+      /// Number of records to decode for every field at a time when reading each Data3D's points
+      /// (see CompressedVectorReaderOptions::decodeTileSize)
+      unsigned decodeTileSize = 0;
+
+      /// Only read every Nth point of each Data3D, for previews (see
+      /// CompressedVectorReaderOptions::recordStride). The buffers then only need room for
+      /// 1 / recordStride of the points.
+      unsigned recordStride = 1;
+
+      /// Only parse the metadata of each Data3D and Image2D when it is first used (see
+      /// ImageFileOptions::lazyLoadXml). Makes opening files with many scans faster.
+      bool lazyLoadXml = false;
+
+      /// Have the XML parser validate the file's XML (see ImageFileOptions::validateXml). Turn
+      /// this off to open files from trusted sources faster.
+      bool validateXml = true;
+
+      /// Allocate the file's metadata nodes from a few large blocks of memory (see
+      /// ImageFileOptions::useNodeArena).
+      bool useNodeArena = false;
+
+      /// Verify every page of the file when it is opened using this many threads, then read it
+      /// without checking again (see ImageFileOptions::verifyChecksumThreadCount). 0 (the default)
+      /// uses checksumPolicy instead.
+      unsigned verifyChecksumThreadCount = 0;
+
+      /// Allow the file to still be being written by a Writer with a journalInterval (see
+      /// ImageFileOptions::follow). Refresh() then picks up the points written since. Only used
+      /// when the Reader is opened from a file path.
+      bool follow = false;
+
+      /// Read the points of each Data3D which only has spherical coordinates as cartesian ones.
+      /// Data3D headers from ReadData3D() report cartesianX, cartesianY, cartesianZ, and
+      /// cartesianInvalidState fields instead of the spherical ones, and each block of points is
+      /// converted in place as it is decoded (see CompressedVectorReaderOptions::sphericalFields),
+      /// so no spherical buffers are needed.
+      bool sphericalToCartesian = false;
+
+      /// Transform the cartesianX, cartesianY, and cartesianZ of each Data3D's points by its pose
+      /// (Data3D::pose) as they are read, so the points of every Data3D come out in the same
+      /// (project) coordinates. Each block of points is transformed as it is decoded (see
+      /// CompressedVectorReaderOptions::transformFields). Spherical coordinates and the Data3D
+      /// headers (e.g. Data3D::cartesianBounds) are left as they are.
+      bool applyPose = false;
+
+      /// A row-major 4×4 affine transform applied to the cartesian coordinates of every Data3D's
+      /// points as they are read, after the pose if applyPose is set. The last row must be
+      /// 0 0 0 1. The default is the identity, which leaves the points alone.
+      std::array<double, 16> transform = { { 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0,
+                                             0.0, 0.0, 0.0, 0.0, 1.0 } };
+
+      /// Drop the points whose coordinates are invalid (whose cartesianInvalidState, or
+      /// sphericalInvalidState if a Data3D only has that, isn't 0) as they are read by
+      /// SetUpData3DPointsData(), SetUpData3DLevelOfDetailData(), and ReadData3DPointsChunked().
+      /// Each block of points is tested as it is decoded and only the valid ones are put in the
+      /// buffers, so CompressedVectorReader::read() returns how many there are (see
+      /// CompressedVectorReaderOptions::recordFilter). The invalid states needn't be read.
+      bool skipInvalidPoints = false;
+
+      /// Ranges of values which points' fields must be in to be read, dropping the others just like
+      /// skipInvalidPoints. For example, { "intensity", 0.1 } drops dim points,
+      /// { "isColorInvalid", 0, 0 } drops points without color, and ranges of cartesianX,
+      /// cartesianY, and cartesianZ keep a box (tested after sphericalToCartesian, applyPose, and
+      /// transform). Ranges of fields a Data3D doesn't have are left out.
+      std::vector<RecordFieldRange> pointFilter{};
+
+      /// Where ReadData3DPointsChunked(), ReadData3DPointsInBox(), and ReadData3DLines() get the
+      /// memory for the buffers they read into (nullptr for the heap). With a
+      /// Data3DPointsBufferPool, reading one Data3D after another reuses the same memory. It must
+      /// outlive the Reader.
+      Data3DPointsAllocator *pointsAllocator = nullptr;
+
+      /// Number of threads to read the pages of each Image2D's blob and check their checksums
+      /// with in ReadImage2DData() (see BlobNode::read()). Only large images gain from this.
+      unsigned imageThreadCount = 1;
+
+      /// Where the parallel work of the options above runs (see ImageFileOptions::executor).
+      /// nullptr means WorkStealingExecutor::defaultExecutor().
+      std::shared_ptr<Executor> executor{};
+
+      /// Most bytes of memory the file may hold, or 0 for no limit (see
+      /// ImageFileOptions::memoryBudget). GetRawIMF().memoryUsage() tells how much it holds.
+      uint64_t memoryBudget = 0;
+
+      /// Called with how far each Data3D's points have been read (see
+      /// CompressedVectorReaderOptions::progress)
+      ProgressCallback progress{};
+
+      /// Stops reading each Data3D's points once it is cancelled, by throwing ::ErrorCancelled
+      /// (see CompressedVectorReaderOptions::cancellation)
+      std::shared_ptr<CancellationToken> cancellation{};
    };
 
+   /// @brief Called by Reader::ReadData3DPointsChunked() and Reader::ReadData3DPointsInBox() with
+   /// each block of points.
+   /// @details The first count elements of each non-NULL buffer in points hold the block. The
+   /// buffers are reused for the next block, so copy anything which is needed later.
+   /// @return Return true to keep reading, false to stop
+   template <typename COORDTYPE>
+   using Data3DPointsCallback =
+      std::function<bool( const Data3DPointsData_t<COORDTYPE> &points, size_t count )>;
+
+   /// @brief Called by Reader::ReadData3DLines() with the points of one line.
+   /// @details The first count elements of each non-NULL buffer in points hold all the points of
+   /// the line whose idElementValue is line. The buffers are reused for the next line.
+   template <typename COORDTYPE>
+   using Data3DLineCallback = std::function<void(
+      int64_t line, const Data3DPointsData_t<COORDTYPE> &points, size_t count )>;
+
    /// @brief Used for reading an E57 file using E57 Simple API.
    ///
    /// The Reader includes support for the
@@ -58,6 +181,11 @@ namespace e57
       /// @param [in] options Options to be used for the file
       Reader( const ustring &filePath, const ReaderOptions &options );
 
+      /// @brief Reader constructor
+      /// @param [in] source Where to read the E57 data from (see ReadSource)
+      /// @param [in] options Options to be used for the file
+      Reader( const std::shared_ptr<ReadSource> &source, const ReaderOptions &options );
+
       /// @brief Reader constructor (deprecated)
       /// @param [in] filePath Path to E57 file
       /// @deprecated Will be removed in 4.0. Use Reader( const ustring &, const ReaderOptions & )
@@ -72,6 +200,13 @@ namespace e57
       /// @brief Closes the file
       bool Close();
 
+      /// @brief Catches up with the Writer of a file opened with ReaderOptions::follow
+      /// @details The points written since are added to the pointCount of each Data3D, and
+      /// readers from SetUpData3DPointsData() carry on into them (see ImageFile::refresh()).
+      /// Data3D added after the file was opened are only seen by opening it again.
+      /// @return Returns true if anything was added, or the Writer closed the file
+      bool Refresh();
+
       /// @name File information
       ///@{
 
@@ -80,6 +215,34 @@ namespace e57
       /// @return Returns true if successful
       bool GetE57Root( E57Root &fileHeader ) const;
 
+      /// @brief Returns the metadata of the file and each of its Data3D and Image2D
+      /// @details The summary can be saved with MetadataSummary::serialize() and used later
+      /// instead of opening the file again. If the Reader was opened from a file path, its size
+      /// and modification time are recorded, as ReadMetadataSummary() needs.
+      /// @param [out] summary the metadata
+      /// @return Returns true if successful
+      bool GetMetadataSummary( MetadataSummary &summary ) const;
+
+      /// @brief Get the metadata of the E57 file at filePath, without opening it if a sidecar
+      /// file holds an up-to-date summary
+      /// @details The sidecar is MetadataSummarySidecarPath( filePath ). If it was made from a
+      /// file of the same size and modification time, the summary is read from it without
+      /// parsing any XML. Otherwise the file is opened with options, and the sidecar is written
+      /// (if writeSidecar) for the next time. Failing to write the sidecar isn't an error.
+      /// @param [in] filePath Path to E57 file
+      /// @param [out] summary the metadata
+      /// @param [in] options Options used if the file has to be opened
+      /// @param [in] writeSidecar Whether to write a new sidecar if there isn't an up-to-date one
+      /// @return Returns true if successful
+      /// @throw E57Exception if the file has to be opened, and can't be
+      static bool ReadMetadataSummary( const ustring &filePath, MetadataSummary &summary,
+                                       const ReaderOptions &options = {},
+                                       bool writeSidecar = true );
+
+      /// @brief Returns the path of the sidecar file ReadMetadataSummary() keeps the summary of the
+      /// file at filePath in
+      static ustring MetadataSummarySidecarPath( const ustring &filePath );
+
       ///@}
 
       /// @name Image2D
@@ -170,6 +333,8 @@ namespace e57
       /// @brief Use this to read the actual 3D data
       /// @details All the non-NULL buffers in buffers have number of elements = pointCount.
       ///          Call the CompressedVectorReader::read() until all data is read.
+      ///          Readers set up this way may be used on different threads at the same time,
+      ///          for example to read several Data3D in parallel.
       /// @param [in] dataIndex data block index
       /// @param [in] pointCount size of each element buffer.
       /// @param [in] buffers pointers to user-provided buffers
@@ -181,6 +346,171 @@ namespace e57
       CompressedVectorReader SetUpData3DPointsData( int64_t dataIndex, size_t pointCount,
                                                     const Data3DPointsDouble &buffers ) const;
 
+      /// @brief Use this to read the 3D data straight into an array of point structs
+      /// @details Each field of points is read in place using its offset and the stride, so the
+      /// points don't need to be copied out of separate buffers. points must have room for
+      /// pointCount points. Fields which aren't in the Data3D are skipped, leaving their values
+      /// in points unchanged.
+      /// @param [in] dataIndex data block index
+      /// @param [in] pointCount number of points points has room for
+      /// @param [in] points layout of the user-provided points
+      /// @return vector reader setup to read the selected data into points
+      /// @throw ::ErrorBadAPIArgument if points has no base or stride, or a field doesn't fit in
+      /// the stride
+      CompressedVectorReader SetUpData3DPointsData( int64_t dataIndex, size_t pointCount,
+                                                    const Data3DPointsInterleaved &points ) const;
+
+      /// @brief Find the level of detail of a Data3D with the most points that fit in pointBudget
+      /// @details Level 0 is the Data3D's points. If it was written with
+      /// WriterOptions::levelOfDetailCount, levels 1 and up are coarser copies of them, each with
+      /// one in eight of the points of the one before. If even the coarsest level has more than
+      /// pointBudget points, it is picked anyway.
+      /// @param [in] dataIndex data block index
+      /// @param [in] pointBudget largest number of points wanted
+      /// @param [out] level the level to pass to SetUpData3DLevelOfDetailData()
+      /// @param [out] pointCount number of points in level
+      /// @return Returns true if successful, false if dataIndex is invalid
+      bool GetData3DLevelOfDetail( int64_t dataIndex, int64_t pointBudget, int64_t &level,
+                                   int64_t &pointCount ) const;
+
+      /// @brief Use this to read one level of detail of the 3D data
+      /// @details The same as SetUpData3DPointsData(), but reads the points of level (see
+      /// GetData3DLevelOfDetail()). Level 0 reads all of the points.
+      /// @param [in] dataIndex data block index
+      /// @param [in] level level of detail to read
+      /// @param [in] pointCount size of each element buffer.
+      /// @param [in] buffers pointers to user-provided buffers
+      /// @return vector reader setup to read the selected data into the provided buffers
+      /// @throw ::ErrorBadAPIArgument if the Data3D doesn't have level
+      CompressedVectorReader SetUpData3DLevelOfDetailData( int64_t dataIndex, int64_t level,
+                                                           size_t pointCount,
+                                                           const Data3DPointsFloat &buffers ) const;
+
+      /// @overload
+      CompressedVectorReader SetUpData3DLevelOfDetailData(
+         int64_t dataIndex, int64_t level, size_t pointCount,
+         const Data3DPointsDouble &buffers ) const;
+
+      /// @overload
+      CompressedVectorReader SetUpData3DLevelOfDetailData(
+         int64_t dataIndex, int64_t level, size_t pointCount,
+         const Data3DPointsInterleaved &points ) const;
+
+      /// @brief Read the 3D data in blocks of up to chunkSize points, passing each block to
+      /// callback
+      /// @details The buffers for each field in the Data3D header are allocated once, holding
+      /// chunkSize points, and reused for every block, so a scan of any size is read using the
+      /// same amount of memory.
+      ///
+      ///          Several Data3D (or the same one) may be read at once by calling this from
+      ///          different threads.
+      /// @param [in] dataIndex data block index
+      /// @param [in] chunkSize maximum number of points in each block
+      /// @param [in] callback function to call with each block
+      /// @return Returns the number of points read, or 0 if dataIndex is invalid
+      /// @throw ::ErrorBadAPIArgument if chunkSize is 0
+      int64_t ReadData3DPointsChunked( int64_t dataIndex, size_t chunkSize,
+                                       const Data3DPointsCallback<float> &callback ) const;
+
+      /// @overload
+      int64_t ReadData3DPointsChunked( int64_t dataIndex, size_t chunkSize,
+                                       const Data3DPointsCallback<double> &callback ) const;
+
+      /// @brief Read the 3D data points whose cartesian coordinates are inside box, in blocks of
+      /// up to chunkSize points, passing each block to callback
+      /// @details If the Data3D was written with WriterOptions::spatialIndexChunkSize, only the
+      /// runs of points whose bounds intersect box are decoded. Otherwise every point is read
+      /// and checked. Points without valid cartesian coordinates are never passed on.
+      ///
+      ///          Blocks may hold fewer than chunkSize points, but are never empty. Memory use is
+      ///          the same as ReadData3DPointsChunked().
+      ///
+      ///          With ReaderOptions::applyPose or ReaderOptions::transform, box is in the
+      ///          coordinates the points are transformed to.
+      /// @param [in] dataIndex data block index
+      /// @param [in] box bounds (inclusive) of the points to read
+      /// @param [in] chunkSize maximum number of points in each block
+      /// @param [in] callback function to call with each block
+      /// @return Returns the number of points passed to callback, or 0 if dataIndex is invalid
+      /// @throw ::ErrorBadAPIArgument if chunkSize is 0, or the Data3D has no cartesian
+      /// coordinates
+      int64_t ReadData3DPointsInBox( int64_t dataIndex, const CartesianBounds &box,
+                                     size_t chunkSize,
+                                     const Data3DPointsCallback<float> &callback ) const;
+
+      /// @overload
+      int64_t ReadData3DPointsInBox( int64_t dataIndex, const CartesianBounds &box,
+                                     size_t chunkSize,
+                                     const Data3DPointsCallback<double> &callback ) const;
+
+      /// @brief Read some of the lines of a Data3D whose points are grouped by line
+      /// @details The lines are found using the Data3D's GroupingByLine groups (see
+      /// ReadData3DGroupsData()), and only their points are read, seeking straight to each one.
+      /// Lines the Data3D doesn't have are skipped.
+      ///
+      ///          The lines are shared between threadCount threads, each with its own buffers
+      ///          for every field in the Data3D header, so callback may be called from several
+      ///          threads at once, and not in the order of lines.
+      /// @param [in] dataIndex data block index
+      /// @param [in] lines the idElementValue (row or column number) of each line to read
+      /// @param [in] threadCount number of threads to read with
+      /// @param [in] callback function to call with each line
+      /// @return Returns the number of points read, or 0 if dataIndex is invalid
+      /// @throw ::ErrorBadAPIArgument if the Data3D's points aren't grouped by line
+      int64_t ReadData3DLines( int64_t dataIndex, const std::vector<int64_t> &lines,
+                               unsigned threadCount,
+                               const Data3DLineCallback<float> &callback ) const;
+
+      /// @overload
+      int64_t ReadData3DLines( int64_t dataIndex, const std::vector<int64_t> &lines,
+                               unsigned threadCount,
+                               const Data3DLineCallback<double> &callback ) const;
+
+      /// @brief Read the points of a structured Data3D into dense row × column grids
+      /// @details Each non-NULL buffer in grid has a cell for every row and column in the
+      /// Data3D's indexBounds, in row order: the point with rowIndex r and columnIndex c goes in
+      /// cell (r - rowMinimum) × columns + (c - columnMinimum), where columns is columnMaximum -
+      /// columnMinimum + 1. Only the fields grid has buffers for are decoded. Cells without a
+      /// point are left as they are, so fill them first (or use the invalid state fields) to
+      /// tell them apart. If several points have the same row and column, which one is kept
+      /// isn't defined.
+      ///
+      ///          The points are decoded in blocks on threadCount threads, and put straight into
+      ///          the grid.
+      /// @param [in] dataIndex data block index
+      /// @param [in] grid user-provided buffers with a cell for each row and column
+      /// @param [in] threadCount number of threads to read with
+      /// @return Returns the number of points put in grid, or 0 if dataIndex is invalid
+      /// @throw ::ErrorBadAPIArgument if the Data3D has no rowIndex or columnIndex
+      int64_t ReadData3DGrid( int64_t dataIndex, const Data3DPointsFloat &grid,
+                              unsigned threadCount = 1 ) const;
+
+      /// @overload
+      int64_t ReadData3DGrid( int64_t dataIndex, const Data3DPointsDouble &grid,
+                              unsigned threadCount = 1 ) const;
+
+      /// @brief Read a band of rows of a structured Data3D into dense row × column grids
+      /// @details The same as ReadData3DGrid(), but grid only has cells for rowCount rows
+      /// starting at firstRow, so the point with rowIndex r and columnIndex c goes in cell
+      /// (r - firstRow) × columns + (c - columnMinimum).
+      ///
+      ///          If the points are grouped by row (GroupingByLine::idElementName is
+      ///          "rowIndex"), only the lines of those rows are read, seeking to each one using
+      ///          its startPointIndex. Otherwise all the points are read and the others skipped.
+      /// @param [in] dataIndex data block index
+      /// @param [in] firstRow rowIndex of the first row of grid
+      /// @param [in] rowCount number of rows in grid
+      /// @param [in] grid user-provided buffers with a cell for each row and column
+      /// @param [in] threadCount number of threads to read with
+      /// @return Returns the number of points put in grid, or 0 if dataIndex is invalid
+      /// @throw ::ErrorBadAPIArgument if the Data3D has no rowIndex or columnIndex
+      int64_t ReadData3DGridRows( int64_t dataIndex, int64_t firstRow, int64_t rowCount,
+                                  const Data3DPointsFloat &grid, unsigned threadCount = 1 ) const;
+
+      /// @overload
+      int64_t ReadData3DGridRows( int64_t dataIndex, int64_t firstRow, int64_t rowCount,
+                                  const Data3DPointsDouble &grid, unsigned threadCount = 1 ) const;
+
       ///@}
 
       /// @name File information
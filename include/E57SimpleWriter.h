@@ -39,6 +39,14 @@
 
 namespace e57
 {
+   /// Orders in which WriterOptions::spatialOrder can write points
+   enum class SpatialOrder
+   {
+      None = 0, ///< Write them in the order given
+      Morton,   ///< Sort them along a Morton (Z-order) curve
+      Hilbert,  ///< Sort them along a Hilbert curve, which keeps neighbours a little closer
+   };
+
    /// Options to the Writer constructor
    struct E57_DLL WriterOptions
    {
@@ -47,6 +55,137 @@ namespace e57
 
       /// Information describing the Coordinate Reference System to be used for the file
       ustring coordinateMetadata;
+
+      /// Write index packets for each Data3D's points so readers can seek within them quickly
+      bool writeIndexPackets = false;
+
+      /// Number of threads to use when encoding each Data3D's points (see
+      /// CompressedVectorWriterOptions::encodeThreadCount)
+      unsigned encodeThreadCount = 1;
+
+      /// Number of packets of each Data3D's points which may be written in the background while
+      /// the next ones are encoded (see CompressedVectorWriterOptions::writeBehindPacketCount)
+      unsigned writeBehindPacketCount = 0;
+
+      /// Build each Data3D's points in memory and write them when the writer is closed, so the
+      /// points of several Data3D can be written on different threads at the same time (see
+      /// CompressedVectorWriterOptions::stageInMemory)
+      bool stageInMemory = false;
+
+      /// Write each field of each Data3D's points in runs of packets of their own, so readers of
+      /// only some fields read less of the file (see
+      /// CompressedVectorWriterOptions::columnarRunPackets). Can't be used with writeIndexPackets.
+      unsigned columnarRunPackets = 0;
+
+      /// Check each block of points written against the limits of their fields in one pass,
+      /// instead of as each point is encoded (see CompressedVectorWriterOptions::validatePerWrite)
+      bool validatePerWrite = false;
+
+      /// If not 0, WriteData3DData() also records the cartesian bounds of each run of this many
+      /// points, so Reader::ReadData3DPointsInBox() can skip the ones outside its box. Combine
+      /// with writeIndexPackets so the reader can seek to the runs quickly.
+      size_t spatialIndexChunkSize = 0;
+
+      /// If not 0, WriteData3DData() also writes up to this many coarser copies of each Data3D's
+      /// points, each holding one in eight of the points of the one before, so
+      /// Reader::GetData3DLevelOfDetail() can pick one small enough for a preview. Readers which
+      /// don't know the extension ignore them.
+      size_t levelOfDetailCount = 0;
+
+      /// If not SpatialOrder::None, WriteData3DData() sorts each run of spatialOrderChunkSize
+      /// points along this curve through their cartesian coordinates before writing them, so
+      /// points which are near each other in space are near each other in the file. This makes
+      /// the chunk bounds of spatialIndexChunkSize much tighter, and delta encoding
+      /// (deltaEncodePoints) more effective. Points without valid cartesian coordinates go at the
+      /// end of their run, and Data3D without cartesian coordinates are written in order.
+      /// @note The points' indices change, so don't use this with WriteData3DGroupsData().
+      SpatialOrder spatialOrder = SpatialOrder::None;
+
+      /// Number of points sorted at a time with spatialOrder. A copy of this many points is kept
+      /// while writing.
+      size_t spatialOrderChunkSize = 1'048'576;
+
+      /// Work out each Data3D's cartesianBounds and sphericalBounds from its points as they are
+      /// written, instead of needing them in the Data3D header. Only bounds which weren't set in
+      /// the header are filled in, and they are added to the file when the Writer is closed.
+      bool computeBounds = false;
+
+      /// Store each Data3D's integer and scaled integer cartesian coordinates, rowIndex, and
+      /// columnIndex as differences from the previous point using the delta codec extension.
+      /// Scan-ordered points usually take far fewer bits this way, but only readers which support
+      /// the extension can read them.
+      bool deltaEncodePoints = false;
+
+      /// Store each Data3D's Float and Double point fields, such as timeStamp, as the XOR of their
+      /// bits with those of the previous point using the XOR codec extension. This is lossless,
+      /// and neighbouring values which are close together take far fewer bytes, especially when
+      /// compressed further with zstdLevel. Only readers which support the extension can read them.
+      bool xorEncodeFloats = false;
+
+      /// Write the file with direct I/O, bypassing the OS page cache (see
+      /// ImageFileOptions::directIo)
+      bool directIo = false;
+
+      /// Add the new Data3D and Image2D to the end of the existing E57 file at filePath instead of
+      /// replacing it. What is already in the file isn't rewritten, so this takes as long as
+      /// writing the new data does, whatever the size of the file (see ImageFile::ImageFile in
+      /// append mode). guid and coordinateMetadata are ignored, since the file already has them,
+      /// and so is directIo.
+      bool append = false;
+
+      /// Keep a journal of what has been written every this many data packets, so
+      /// ImageFile::recover() can save the points written so far if the program stops before
+      /// the Writer is closed (see ImageFileOptions::journalInterval). 0 doesn't keep one.
+      unsigned journalInterval = 0;
+
+      /// Reserve disk space for each Data3D's points when NewData3D() is called, estimated from
+      /// its pointCount and fields, so the file is allocated in as few pieces as possible (see
+      /// ImageFile::reserveSpace())
+      bool reserveSpace = false;
+
+      /// Let WriteData3DData() write the spherical coordinates of a Data3D whose header has
+      /// sphericalRange/Azimuth/Elevation fields from its cartesian buffers, when the spherical
+      /// buffers are null, so they needn't be worked out and stored by the caller. They are
+      /// computed a block of points at a time, and cartesianInvalidState is written as
+      /// sphericalInvalidState if that is missing too. Can't be used with spatialOrder or
+      /// levelOfDetailCount.
+      bool computeSpherical = false;
+
+      /// If greater than 0, the point coordinates of each Data3D whose pointRangeNodeType is Float
+      /// or Double are stored as scaled integers with this scale instead, with limits just wide
+      /// enough for the points, so each coordinate takes as few bits as the precision allows. The
+      /// limits come from the cartesianBounds and sphericalBounds of the header if they are set,
+      /// or else from the points of the first WriteData3DData() or SetUpData3DPointsData(). In
+      /// that case any points written later must be inside the limits of the first ones, or
+      /// writing them throws ::ErrorValueOutOfBounds.
+      double pointPrecision = 0.0;
+
+      /// If not 0, compress the bytestreams of every point field of each Data3D with zstd at this
+      /// level (1-22, or negative for faster levels) using the zstd codec extension, after they
+      /// are encoded as usual. Only readers which support the extension can read them.
+      /// @note The library must be built with E57_ENABLE_ZSTD, otherwise writing the points throws
+      /// ::ErrorNotImplemented.
+      int zstdLevel = 0;
+
+      /// Number of threads to fill the pages of each Image2D's blob and calculate their checksums
+      /// with when it is written (see BlobNode::write()). Only large images gain from this.
+      unsigned imageThreadCount = 1;
+
+      /// Where the parallel work of the options above runs (see ImageFileOptions::executor).
+      /// nullptr means WorkStealingExecutor::defaultExecutor().
+      std::shared_ptr<Executor> executor{};
+
+      /// Most bytes of memory the file may hold, or 0 for no limit (see
+      /// ImageFileOptions::memoryBudget). GetRawIMF().memoryUsage() tells how much it holds.
+      uint64_t memoryBudget = 0;
+
+      /// Called with how far each Data3D's points have been written (see
+      /// CompressedVectorWriterOptions::progress)
+      ProgressCallback progress{};
+
+      /// Stops writing each Data3D's points once it is cancelled, by throwing ::ErrorCancelled
+      /// (see CompressedVectorWriterOptions::cancellation)
+      std::shared_ptr<CancellationToken> cancellation{};
    };
 
    /// @brief Used for writing an E57 file using the E57 Simple API.
@@ -112,6 +251,30 @@ namespace e57
                                 Image2DProjection imageProjection, void *buffer, int64_t start,
                                 int64_t count );
 
+      /// @brief Writes image data given by a callback, so it needn't be in memory all at once
+      /// @details @p source is called until it has given @p count bytes (see BlobSource).
+      /// @param [in] imageIndex picture block index given by the NewImage2D
+      /// @param [in] imageType identifies the image format desired.
+      /// @param [in] imageProjection identifies the projection desired.
+      /// @param [in] source called for the data to write, in order
+      /// @param [in] start position in the block to start writing
+      /// @param [in] count number of bytes to write
+      /// @return Returns the number of bytes written
+      int64_t WriteImage2DData( int64_t imageIndex, Image2DType imageType,
+                                Image2DProjection imageProjection, const BlobSource &source,
+                                int64_t start, int64_t count );
+
+      /// @brief Writes the whole contents of a file as image data, such as a JPEG from a camera
+      /// @details The file is read straight into the pages written, without being loaded into
+      /// memory first (see BlobNode::importFile()). The image must be big enough for the file.
+      /// @param [in] imageIndex picture block index given by the NewImage2D
+      /// @param [in] imageType identifies the image format desired.
+      /// @param [in] imageProjection identifies the projection desired.
+      /// @param [in] fileName the file to write
+      /// @return Returns the number of bytes written
+      int64_t WriteImage2DFile( int64_t imageIndex, Image2DType imageType,
+                                Image2DProjection imageProjection, const ustring &fileName );
+
       ///@}
 
       /// @name Data3D
@@ -124,11 +287,26 @@ namespace e57
       /// @param [in,out] data3DHeader metadata about what is included in the buffers
       /// @param [in] buffers pointers to user-provided buffers containing the actual data
       /// @return Returns the index of the new scan's data3D block.
+      /// @note With WriterOptions::spatialIndexChunkSize, this also writes the chunk bounds used
+      /// by Reader::ReadData3DPointsInBox(), and with WriterOptions::levelOfDetailCount the levels
+      /// of detail used by Reader::GetData3DLevelOfDetail().
       int64_t WriteData3DData( Data3D &data3DHeader, const Data3DPointsFloat &buffers );
 
       /// @overload
       int64_t WriteData3DData( Data3D &data3DHeader, const Data3DPointsDouble &buffers );
 
+      /// @brief Writes the Data3D data from points stored one after another in memory
+      /// @details Each field of @p points is read in place using its offset and the stride, so
+      /// the points don't need to be copied into separate buffers first. Unlike the overloads
+      /// taking Data3DPointsData_t, limits missing from @p data3DHeader aren't worked out from the
+      /// points, so fill them in first.
+      /// @param [in,out] data3DHeader metadata about what is included in the points
+      /// @param [in] points where the points are, and the fields to write
+      /// @return Returns the index of the new scan's data3D block.
+      /// @throw ::ErrorBadAPIArgument @p points has no base or stride, or one of its fields
+      /// doesn't fit in the stride or has the UString type.
+      int64_t WriteData3DData( Data3D &data3DHeader, const Data3DPointsInterleaved &points );
+
       /// @brief Writes a new Data3D header
       /// @details The user needs to config a Data3D structure with all the scanning information
       /// before making this call.
@@ -142,6 +320,9 @@ namespace e57
       /// buffers)
       /// @param [in] buffers pointers to user-provided buffers
       /// @return returns a vector writer setup to write the selected scan data
+      /// @details With WriterOptions::stageInMemory, writers for different Data3D may be set up,
+      /// used, and closed on different threads at the same time. Create all of the Data3D with
+      /// NewData3D() first.
       CompressedVectorWriter SetUpData3DPointsData( int64_t dataIndex, size_t pointCount,
                                                     const Data3DPointsFloat &buffers );
 
@@ -149,6 +330,15 @@ namespace e57
       CompressedVectorWriter SetUpData3DPointsData( int64_t dataIndex, size_t pointCount,
                                                     const Data3DPointsDouble &buffers );
 
+      /// @brief Sets up a writer to write scan data from points stored one after another in
+      /// memory (see WriteData3DData( Data3D &, const Data3DPointsInterleaved & ))
+      /// @param [in] dataIndex index returned by NewData3D
+      /// @param [in] pointCount Number of points to write at a time
+      /// @param [in] points where the points are, and the fields to write
+      /// @return returns a vector writer setup to write the selected scan data
+      CompressedVectorWriter SetUpData3DPointsData( int64_t dataIndex, size_t pointCount,
+                                                    const Data3DPointsInterleaved &points );
+
       /// @brief Writes out the group data
       /// @param [in] dataIndex data block index given by the NewData3D
       /// @param [in] groupCount size of each of the buffers given
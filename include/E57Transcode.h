@@ -0,0 +1,126 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+/// @file E57Transcode.h Copying an E57 file into another, changing how its points are stored.
+
+#include <limits>
+#include <vector>
+
+#include "E57Format.h"
+
+namespace e57
+{
+   /// @brief How to store one field of the CompressedVectors of a transcoded file
+   /// @details It applies to the field called fieldName in the prototype of every
+   /// CompressedVector which has one.
+   struct E57_DLL TranscodeFieldConversion
+   {
+      /// Path name of the field in the prototype (e.g. "cartesianX")
+      ustring fieldName;
+
+      /// What to store the field as: TypeFloat or TypeScaledInteger. The field must be an
+      /// Integer, ScaledInteger, or Float.
+      NodeType type = TypeScaledInteger;
+
+      /// Precision of a TypeFloat field
+      FloatPrecision precision = PrecisionDouble;
+
+      /// Scale of a TypeScaledInteger field, e.g. 0.001 to keep coordinates in metres to the
+      /// nearest millimetre. Values are rounded to the nearest multiple of it.
+      double scale = 1.0;
+
+      /// Offset of a TypeScaledInteger field
+      double offset = 0.0;
+
+      /// Smallest and largest value of the field. NaN (the default) takes the limits of the
+      /// field in the source, which must then be finite (i.e. not the defaults of a FloatNode)
+      /// for a TypeScaledInteger field. Writing a value outside them throws
+      /// ::ErrorValueOutOfBounds.
+      double minimum = std::numeric_limits<double>::quiet_NaN();
+      double maximum = std::numeric_limits<double>::quiet_NaN(); ///< @copydoc minimum
+   };
+
+   /// @brief Options to transcode()
+   struct E57_DLL TranscodeOptions
+   {
+      /// Fields whose type to change. The CompressedVectors holding them are decoded and
+      /// encoded again.
+      std::vector<TranscodeFieldConversion> conversions;
+
+      /// Encode every CompressedVector again, even those whose fields aren't converted, e.g. to
+      /// add index packets. Without it, the binary sections of the others are copied as they
+      /// are (see CompressedVectorNode::copyFrom()), without decoding them.
+      bool reencode = false;
+
+      /// Store the CompressedVectors which are encoded again with the codecs chosen by
+      /// deltaFields, xorEncodeFloats, and zstdLevel instead of those of the source. The codecs
+      /// of a CompressedVector with converted fields are always replaced.
+      bool replaceCodecs = false;
+
+      /// Names of the Integer and ScaledInteger fields to store as differences from the previous
+      /// record (e.g. "cartesianX", "cartesianY", and "cartesianZ") when the codecs are replaced.
+      std::vector<ustring> deltaFields;
+
+      /// When the codecs are replaced, store each Float field as the XOR with the previous
+      /// record.
+      bool xorEncodeFloats = false;
+
+      /// When the codecs are replaced, compress every field with zstd at this level (1 to 22).
+      /// Requires the library to have been built with E57_ENABLE_ZSTD. 0 (the default) doesn't
+      /// use zstd.
+      int zstdLevel = 0;
+
+      /// Number of records decoded, converted, and encoded at a time. The next block is decoded
+      /// on a background thread while one is encoded, so about twice this many records are held
+      /// in memory. Must be at least 1.
+      size_t blockRecordCount = 64 * 1024;
+
+      /// Options for the readers of the source CompressedVectors (decodeThreadCount,
+      /// readAheadPacketCount, packetCacheSize, progress, and cancellation are used)
+      CompressedVectorReaderOptions readerOptions;
+
+      /// Options for the writers of the CompressedVectors encoded again (all but stageInMemory,
+      /// which would hold a whole section in memory, are used)
+      CompressedVectorWriterOptions writerOptions;
+
+      /// Number of threads used to copy blobs, including the calling thread
+      unsigned blobThreadCount = 1;
+   };
+
+   /// @brief Copies the contents of one E57 file into another, changing how the points are
+   /// stored
+   /// @details The extensions and every node of @a source are copied to the root of @a dest, and
+   /// the binary sections of its blobs and CompressedVectors are copied after them, one at a
+   /// time. A CompressedVector whose fields are converted (or all of them, with
+   /// TranscodeOptions::reencode) is decoded, converted, and encoded in blocks: each block is
+   /// decoded on a background thread while the one before it is encoded, using the decode and
+   /// encode threads and write-behind of the reader and writer options. Only two blocks (and
+   /// the reader's and writer's packets) are in memory at a time, whatever the size of the
+   /// file. Other CompressedVectors are copied without decoding them.
+   ///
+   /// If this throws (e.g. ::ErrorCancelled), @a dest is left partly written and should be
+   /// cancelled (see ImageFile::cancel()).
+   /// @param [in] source The file to copy, opened for reading
+   /// @param [in] dest The file to copy it into, opened for writing, whose root must not have
+   /// children of the same names
+   /// @param [in] options How to store the CompressedVectors
+   /// @throw ::ErrorBadAPIArgument if an option, or a conversion of a field, isn't valid
+   /// @throw E57Exception if reading or writing fails
+   E57_DLL void transcode( const ImageFile &source, ImageFile &dest,
+                           const TranscodeOptions &options = {} );
+
+   /// @brief Copies the E57 file at @a sourcePath to a new file at @a destPath, changing how
+   /// the points are stored (see transcode(const ImageFile &, ImageFile &, const
+   /// TranscodeOptions &))
+   /// @details If this throws, nothing is left at @a destPath.
+   /// @param [in] sourcePath The file to copy
+   /// @param [in] destPath The file to write
+   /// @param [in] options How to store the CompressedVectors
+   /// @param [in] fileOptions Options to open both files with
+   /// @throw ::ErrorBadAPIArgument if an option, or a conversion of a field, isn't valid
+   /// @throw E57Exception if reading or writing fails
+   E57_DLL void transcode( const ustring &sourcePath, const ustring &destPath,
+                           const TranscodeOptions &options = {},
+                           const ImageFileOptions &fileOptions = {} );
+}
@@ -0,0 +1,315 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+/// @file E57TypedReader.h Reading CompressedVectors whose record layout is fixed at compile time.
+
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "E57Format.h"
+
+namespace e57
+{
+   /// @brief The MemoryRepresentation of a C++ type which can be read by
+   /// TypedCompressedVectorReader.
+   template <typename T> struct MemoryRepresentationOf;
+
+   /// @cond documentNonPublic The following isn't part of the API, and isn't documented.
+   template <> struct MemoryRepresentationOf<int8_t>
+   {
+      static constexpr MemoryRepresentation value = Int8;
+   };
+   template <> struct MemoryRepresentationOf<uint8_t>
+   {
+      static constexpr MemoryRepresentation value = UInt8;
+   };
+   template <> struct MemoryRepresentationOf<int16_t>
+   {
+      static constexpr MemoryRepresentation value = Int16;
+   };
+   template <> struct MemoryRepresentationOf<uint16_t>
+   {
+      static constexpr MemoryRepresentation value = UInt16;
+   };
+   template <> struct MemoryRepresentationOf<int32_t>
+   {
+      static constexpr MemoryRepresentation value = Int32;
+   };
+   template <> struct MemoryRepresentationOf<uint32_t>
+   {
+      static constexpr MemoryRepresentation value = UInt32;
+   };
+   template <> struct MemoryRepresentationOf<int64_t>
+   {
+      static constexpr MemoryRepresentation value = Int64;
+   };
+   template <> struct MemoryRepresentationOf<bool>
+   {
+      static constexpr MemoryRepresentation value = Bool;
+   };
+   template <> struct MemoryRepresentationOf<float>
+   {
+      static constexpr MemoryRepresentation value = Real32;
+   };
+   template <> struct MemoryRepresentationOf<double>
+   {
+      static constexpr MemoryRepresentation value = Real64;
+   };
+   /// @endcond
+
+   /// @brief Check that the field @a name of the records of @a cv can be read into memory of
+   /// type @a type without losing anything.
+   /// @details Integers must fit in @a type, or @a type must be floating point. Floats can only be
+   /// read into floating point types, and double precision ones only into double.
+   /// @return The type of the field's node (::TypeInteger, ::TypeScaledInteger or ::TypeFloat)
+   /// @throw ::ErrorPathUndefined if the records have no field @a name
+   /// @throw ::ErrorExpectingNumeric if the field isn't a number
+   /// @throw ::ErrorConversionRequired if the field's values can't all be held by @a type
+   E57_DLL NodeType checkTypedField( const CompressedVectorNode &cv, const ustring &name,
+                                     MemoryRepresentation type );
+
+   /// @brief Reads the records of a CompressedVector into an array of std::tuple whose types are
+   /// fixed at compile time.
+   /// @details Each of Fields describes one field of the records: its C++ type and its name in
+   /// the prototype.
+   ///
+   /// @code
+   /// struct Red
+   /// {
+   ///    using type = uint8_t;
+   ///    static const char *name() { return "colorRed"; }
+   /// };
+   ///
+   /// TypedCompressedVectorReader<TypedFields::CartesianX<float>, TypedFields::CartesianY<float>,
+   ///                             TypedFields::CartesianZ<float>, Red> reader( points, 4096 );
+   ///
+   /// while ( const size_t count = reader.read() )
+   /// {
+   ///    for ( size_t i = 0; i < count; ++i )
+   ///    {
+   ///       const float x = reader.get<0>( i );
+   ///       ...
+   ///    }
+   /// }
+   /// @endcode
+   ///
+   /// The layout is checked against the prototype (see checkTypedField()) when the reader is
+   /// created, so every conversion which read() does is known to succeed. Each field is decoded
+   /// straight into its element of the tuples, with no copies or per-record type checks.
+   template <typename... Fields> class TypedCompressedVectorReader
+   {
+   public:
+      /// One record
+      using Record = std::tuple<typename Fields::type...>;
+
+      /// @brief Create a reader which reads up to @a recordCount records of @a cv at a time.
+      /// @throw ::ErrorBadAPIArgument if @a recordCount is 0
+      /// @throw Anything thrown by checkTypedField() or CompressedVectorNode::reader()
+      TypedCompressedVectorReader( CompressedVectorNode cv, size_t recordCount,
+                                   const CompressedVectorReaderOptions &options = {} ) :
+         records_( checkedRecordCount( recordCount ) ),
+         reader_( makeReader( cv, options, std::index_sequence_for<Fields...>{} ) )
+      {
+      }
+
+      // The buffers point into records_, so the reader can't be copied
+      TypedCompressedVectorReader( const TypedCompressedVectorReader & ) = delete;
+      TypedCompressedVectorReader &operator=( const TypedCompressedVectorReader & ) = delete;
+
+      /// @brief Read the next records into records().
+      /// @return The number of records read, which is 0 once they have all been read
+      size_t read()
+      {
+         return reader_.read();
+      }
+
+      /// @brief Set the record number of the next record read()
+      void seek( int64_t recordNumber )
+      {
+         reader_.seek( recordNumber );
+      }
+
+      void close()
+      {
+         reader_.close();
+      }
+
+      bool isOpen()
+      {
+         return reader_.isOpen();
+      }
+
+      /// @brief The records. Only the ones returned by the last read() are valid.
+      const std::vector<Record> &records() const
+      {
+         return records_;
+      }
+
+      /// @brief Field @a I of record @a index
+      template <size_t I>
+      const typename std::tuple_element<I, Record>::type &get( size_t index ) const
+      {
+         return std::get<I>( records_[index] );
+      }
+
+   private:
+      template <size_t I> using FieldType = typename std::tuple_element<I, Record>::type;
+
+      static size_t checkedRecordCount( size_t recordCount )
+      {
+         if ( recordCount == 0 )
+         {
+            throw E57Exception( ErrorBadAPIArgument, "recordCount=0", __FILE__, __LINE__,
+                                static_cast<const char *>( __FUNCTION__ ) );
+         }
+
+         return recordCount;
+      }
+
+      template <size_t... I>
+      CompressedVectorReader makeReader( CompressedVectorNode &cv,
+                                         const CompressedVectorReaderOptions &options,
+                                         std::index_sequence<I...> )
+      {
+         ImageFile imf = cv.destImageFile();
+
+         std::vector<SourceDestBuffer> buffers;
+         buffers.reserve( sizeof...( Fields ) );
+
+         // Unpack in order (C++14 has no fold expressions)
+         const int unused[] = { 0, ( addBuffer<I, Fields>( imf, cv, buffers ), 0 )... };
+         (void)unused;
+
+         return cv.reader( buffers, options );
+      }
+
+      template <size_t I, typename Field>
+      void addBuffer( ImageFile &imf, const CompressedVectorNode &cv,
+                      std::vector<SourceDestBuffer> &buffers )
+      {
+         using T = FieldType<I>;
+
+         static_assert( std::is_arithmetic<T>::value, "Fields must have an arithmetic type." );
+
+         const NodeType nodeType = checkTypedField( cv, Field::name(),
+                                                    MemoryRepresentationOf<T>::value );
+
+         // Only integers being read into floating point memory need converting
+         const bool doConversion = std::is_floating_point<T>::value && ( nodeType != TypeFloat );
+         const bool doScaling = ( nodeType == TypeScaledInteger );
+
+         buffers.emplace_back( imf, Field::name(), &std::get<I>( records_.front() ),
+                               records_.size(), doConversion, doScaling, sizeof( Record ) );
+      }
+
+      std::vector<Record> records_;
+      CompressedVectorReader reader_;
+   };
+
+   /// Field descriptions of the standard Data3D point fields for TypedCompressedVectorReader
+   namespace TypedFields
+   {
+      template <typename T> struct CartesianX
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "cartesianX";
+         }
+      };
+
+      template <typename T> struct CartesianY
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "cartesianY";
+         }
+      };
+
+      template <typename T> struct CartesianZ
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "cartesianZ";
+         }
+      };
+
+      template <typename T> struct SphericalRange
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "sphericalRange";
+         }
+      };
+
+      template <typename T> struct SphericalAzimuth
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "sphericalAzimuth";
+         }
+      };
+
+      template <typename T> struct SphericalElevation
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "sphericalElevation";
+         }
+      };
+
+      template <typename T> struct Intensity
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "intensity";
+         }
+      };
+
+      template <typename T> struct ColorRed
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "colorRed";
+         }
+      };
+
+      template <typename T> struct ColorGreen
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "colorGreen";
+         }
+      };
+
+      template <typename T> struct ColorBlue
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "colorBlue";
+         }
+      };
+
+      template <typename T> struct TimeStamp
+      {
+         using type = T;
+         static const char *name()
+         {
+            return "timeStamp";
+         }
+      };
+   }
+}
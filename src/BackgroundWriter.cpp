@@ -0,0 +1,103 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "BackgroundWriter.h"
+#include "CheckedFile.h"
+#include "Tracing.h"
+
+namespace e57
+{
+   BackgroundWriter::BackgroundWriter( CheckedFile *file, unsigned queueLength ) :
+      file_( file ), queueLength_( std::max( queueLength, 1U ) ), queue_( file->executor() )
+   {
+   }
+
+   void BackgroundWriter::write( uint64_t logicalOffset, const char *buf, size_t size )
+   {
+      queue_.wait( queueLength_ - 1 );
+
+      std::vector<char> data;
+
+      {
+         std::lock_guard<std::mutex> lock( mutex_ );
+
+         rethrowError();
+
+         // Reuse the buffers of blocks already written
+         if ( !freeBuffers_.empty() )
+         {
+            data = std::move( freeBuffers_.back() );
+            freeBuffers_.pop_back();
+         }
+      }
+
+      data.assign( buf, buf + size );
+
+      queue_.post( [this, logicalOffset, data = std::move( data )]() mutable {
+         writeBlock( logicalOffset, data );
+      } );
+   }
+
+   void BackgroundWriter::wait()
+   {
+      queue_.wait();
+
+      std::lock_guard<std::mutex> lock( mutex_ );
+
+      rethrowError();
+   }
+
+   void BackgroundWriter::rethrowError()
+   {
+      if ( error_ )
+      {
+         std::exception_ptr error = error_;
+         error_ = nullptr;
+
+         std::rethrow_exception( error );
+      }
+   }
+
+   void BackgroundWriter::writeBlock( uint64_t logicalOffset, std::vector<char> &data )
+   {
+      bool failed;
+
+      {
+         std::lock_guard<std::mutex> lock( mutex_ );
+
+         // Once a write fails, the ones after it are pointless
+         failed = failed_;
+      }
+
+      std::exception_ptr error;
+
+      if ( !failed )
+      {
+         try
+         {
+#ifdef E57_ENABLE_TRACING
+            TraceScope trace( "BackgroundWriter::write", data.size() );
+#endif
+
+            file_->seek( logicalOffset );
+            file_->write( data.data(), data.size() );
+         }
+         catch ( ... )
+         {
+            error = std::current_exception();
+         }
+      }
+
+      std::lock_guard<std::mutex> lock( mutex_ );
+
+      if ( error )
+      {
+         error_ = error;
+         failed_ = true;
+      }
+
+      freeBuffers_.push_back( std::move( data ) );
+   }
+}
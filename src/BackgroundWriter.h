@@ -0,0 +1,60 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "TaskQueue.h"
+
+namespace e57
+{
+   class CheckedFile;
+
+   /// Writes blocks to a CheckedFile on the file's executor, in the order they were given, so the
+   /// caller can carry on (e.g. encoding the next packet) while the previous one is written.
+   ///
+   /// Nothing else may use the file until wait() returns.
+   class BackgroundWriter
+   {
+   public:
+      /// @param file File to write to.
+      /// @param queueLength Number of blocks which may be waiting to be written before write()
+      /// blocks. Must be at least 1.
+      BackgroundWriter( CheckedFile *file, unsigned queueLength );
+
+      /// Writes anything still queued. Errors are ignored, so call wait() first to find out about
+      /// them.
+      ~BackgroundWriter() = default;
+
+      BackgroundWriter( const BackgroundWriter & ) = delete;
+      BackgroundWriter &operator=( const BackgroundWriter & ) = delete;
+
+      /// Copy @a size bytes of @a buf and queue them to be written at @a logicalOffset. Waits for
+      /// room in the queue if it is full. If an earlier write failed, its exception is rethrown.
+      void write( uint64_t logicalOffset, const char *buf, size_t size );
+
+      /// Wait until everything queued has been written. If any write failed, its exception is
+      /// rethrown.
+      void wait();
+
+   private:
+      void writeBlock( uint64_t logicalOffset, std::vector<char> &data );
+      void rethrowError();
+
+      CheckedFile *file_;
+      const size_t queueLength_;
+
+      std::mutex mutex_; // protects everything below
+      std::vector<std::vector<char>> freeBuffers_;
+      std::exception_ptr error_;
+      bool failed_ = false; // a write has failed, so the ones after it are skipped
+
+      /// Last, so it finishes the writes before the rest goes
+      TaskQueue queue_;
+   };
+}
@@ -0,0 +1,1958 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "BitpackKernels.h"
+#include "E57Format.h"
+
+// Pick the vector instructions (if any) available for this compiler & architecture.
+#if ( defined( __GNUC__ ) || defined( __clang__ ) ) &&                                            \
+   ( defined( __x86_64__ ) || defined( __i386__ ) )
+#include <immintrin.h>
+#define E57_BITPACK_X86
+#define E57_BITPACK_TARGET_SSE41 __attribute__( ( target( "sse4.1" ) ) )
+#define E57_BITPACK_TARGET_AVX2 __attribute__( ( target( "avx2" ) ) )
+#elif defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <immintrin.h>
+#include <intrin.h>
+#define E57_BITPACK_X86
+#define E57_BITPACK_TARGET_SSE41
+#define E57_BITPACK_TARGET_AVX2
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+// NEON is part of every ARMv8 CPU, so no need to check for it.
+#include <arm_neon.h>
+#define E57_BITPACK_NEON
+#endif
+
+namespace
+{
+   // Values are unpacked to a small buffer of raw values, then the minimum is added while storing
+   // them, so the raw buffer stays in L1 cache.
+   constexpr size_t cBlockSize = 256;
+
+   // Unpack count values at least significant bit first starting at firstBit (< 8) of inbuf.
+   // Returns the number of values unpacked, which may be fewer than count (or none) if the
+   // function doesn't handle this width.
+   using Raw32Function = size_t ( * )( const char *inbuf, size_t inbufSize, size_t firstBit,
+                                       unsigned bitsPerRecord, size_t count, uint32_t *raw );
+
+   // Pack count values starting at bit firstBit of out. Returns the number of values packed,
+   // which may be fewer than count (or none) if the function doesn't handle this width.
+   using Pack32Function = size_t ( * )( const uint32_t *raw, size_t count, unsigned bitsPerRecord,
+                                        size_t firstBit, char *out );
+
+   // Scale or unscale count values. Returns the number of values done, which may be fewer than
+   // count (the rest are left for the scalar loop).
+   template <typename T>
+   using ScaleFunction = size_t ( * )( const int64_t *raw, size_t count, double scale,
+                                       double offset, double origin, T *out );
+   using UnscaleFunction = size_t ( * )( const double *in, size_t count, double scale,
+                                         double offset, int64_t *raw );
+
+   // Transform count contiguous points. Returns the number of points done, which may be fewer
+   // than count (the rest are left for the scalar loop).
+   template <typename T>
+   using TransformFunction = size_t ( * )( const double *matrix, size_t count, T *x, T *y, T *z );
+   template <typename T>
+   using SphericalFunction = size_t ( * )( size_t count, T *range, T *azimuth, T *elevation );
+
+   // Results smaller than this in magnitude can be converted to int64_t with the magic number
+   // trick: adding 1.5 * 2^52 puts the integer in the low bits of the double's mantissa.
+   constexpr double cExactIntLimit = 2251799813685248.0;    // 2^51
+   constexpr double cMagicIntToDouble = 6755399441055744.0; // 1.5 * 2^52
+
+   // sin() and cos() of angles smaller than this in magnitude are found by reducing them to
+   // [-pi/4, pi/4] and using the polynomials below (from Cephes). Others use std::sin() and
+   // std::cos().
+   constexpr double cSinCosLimit = 268435456.0; // 2^28
+
+   // pi/2 split into three parts, so k * pi/2 can be subtracted with little rounding error
+   constexpr double cTwoOverPi = 0.63661977236758134308;
+   constexpr double cPiOver2High = 1.57079625129699707031;
+   constexpr double cPiOver2Middle = 7.54978941586159635335e-8;
+   constexpr double cPiOver2Low = 5.39030285815811905290e-15;
+
+   constexpr double cSinCoefficients[] = { 1.58962301576546568060e-10, -2.50507477628578072866e-8,
+                                           2.75573136213857245213e-6,  -1.98412698295895385996e-4,
+                                           8.33333333332211858878e-3,  -1.66666666666666307295e-1 };
+   constexpr double cCosCoefficients[] = { -1.13585365213876817300e-11, 2.08757008419747316778e-9,
+                                           -2.75573141792967388112e-7,  2.48015872888517045348e-5,
+                                           -1.38888888888730564116e-3,  4.16666666666665929218e-2 };
+
+   // sin() and cos() of x. The vector versions do exactly the same operations, so they give the
+   // same results.
+   inline void sinCosScalar( double x, double &sine, double &cosine )
+   {
+      const double ax = std::fabs( x );
+
+      if ( !( ax < cSinCosLimit ) )
+      {
+         sine = std::sin( x );
+         cosine = std::cos( x );
+         return;
+      }
+
+      // Reduce to z in [-pi/4, pi/4], where x = k * pi/2 + z
+      const double k = std::floor( ax * cTwoOverPi + 0.5 );
+      const double z = ( ( ax - k * cPiOver2High ) - k * cPiOver2Middle ) - k * cPiOver2Low;
+      const double zz = z * z;
+
+      double sinPoly = cSinCoefficients[0];
+      double cosPoly = cCosCoefficients[0];
+
+      for ( size_t j = 1; j < 6; ++j )
+      {
+         sinPoly = sinPoly * zz + cSinCoefficients[j];
+         cosPoly = cosPoly * zz + cCosCoefficients[j];
+      }
+
+      const double sinZ = z + ( z * zz ) * sinPoly;
+      const double cosZ = ( 1.0 - 0.5 * zz ) + ( zz * zz ) * cosPoly;
+
+      const auto quadrant = static_cast<int64_t>( k );
+
+      sine = ( ( quadrant & 1 ) != 0 ) ? cosZ : sinZ;
+      cosine = ( ( quadrant & 1 ) != 0 ) ? sinZ : cosZ;
+
+      if ( ( quadrant & 2 ) != 0 )
+      {
+         sine = -sine;
+      }
+
+      if ( ( ( quadrant + 1 ) & 2 ) != 0 )
+      {
+         cosine = -cosine;
+      }
+
+      if ( std::signbit( x ) )
+      {
+         sine = -sine;
+      }
+   }
+
+   // Convert one point from ( range, azimuth, elevation ) to ( x, y, z ) in place
+   template <typename T>
+   inline void sphericalToCartesianScalar( T *range, T *azimuth, T *elevation )
+   {
+      double sinAzimuth = 0.0;
+      double cosAzimuth = 0.0;
+      double sinElevation = 0.0;
+      double cosElevation = 0.0;
+
+      sinCosScalar( *azimuth, sinAzimuth, cosAzimuth );
+      sinCosScalar( *elevation, sinElevation, cosElevation );
+
+      const double r = *range;
+      const double horizontal = r * cosElevation;
+
+      *range = static_cast<T>( horizontal * cosAzimuth );
+      *azimuth = static_cast<T>( horizontal * sinAzimuth );
+      *elevation = static_cast<T>( r * sinElevation );
+   }
+
+   // Round value to half precision in one step (going through float could round twice)
+   inline uint16_t halfFromDouble( double value )
+   {
+      uint64_t bits;
+      memcpy( &bits, &value, sizeof( bits ) );
+
+      const auto sign = static_cast<uint16_t>( ( bits >> 48 ) & 0x8000 );
+      const uint64_t magnitude = bits & 0x7FFFFFFFFFFFFFFFULL;
+
+      // NaN stays NaN (quiet), and infinity stays infinite
+      if ( magnitude >= 0x7FF0000000000000ULL )
+      {
+         return sign | ( ( magnitude > 0x7FF0000000000000ULL ) ? 0x7E00 : 0x7C00 );
+      }
+
+      const double absolute = std::fabs( value );
+
+      // Halfway between the largest finite value and the next power of two rounds up (to even)
+      if ( absolute >= 65520.0 )
+      {
+         return sign | 0x7C00;
+      }
+
+      // Subnormal: a multiple of 2^-24, so scale it to an integer and round to nearest even. A
+      // result of 0x400 is the smallest normal number, which is the right encoding too.
+      if ( absolute < 6.103515625e-05 ) // 2^-14
+      {
+         return sign | static_cast<uint16_t>( std::nearbyint( absolute * 16777216.0 ) );
+      }
+
+      // Normal: keep the top 10 bits of the mantissa and round on the other 42. A carry out of
+      // the mantissa moves to the next exponent, which is also right.
+      const auto exponent = static_cast<int>( magnitude >> 52 ) - 1023;
+      const uint64_t mantissa = magnitude & 0xFFFFFFFFFFFFFULL;
+      const uint64_t rest = mantissa & 0x3FFFFFFFFFFULL;
+      const uint64_t halfway = uint64_t{ 1 } << 41;
+
+      auto half = static_cast<uint16_t>( ( ( exponent + 15 ) << 10 ) | ( mantissa >> 42 ) );
+
+      if ( ( rest > halfway ) || ( ( rest == halfway ) && ( ( half & 1 ) != 0 ) ) )
+      {
+         ++half;
+      }
+
+      return sign | half;
+   }
+
+   inline double doubleFromHalf( uint16_t bits )
+   {
+      const unsigned exponent = ( bits >> 10 ) & 0x1F;
+      const unsigned mantissa = bits & 0x3FF;
+
+      double value = 0.0;
+
+      if ( exponent == 0 )
+      {
+         value = std::ldexp( mantissa, -24 );
+      }
+      else if ( exponent == 0x1F )
+      {
+         value = ( mantissa == 0 ) ? std::numeric_limits<double>::infinity()
+                                   : std::numeric_limits<double>::quiet_NaN();
+      }
+      else
+      {
+         value = std::ldexp( mantissa | 0x400, static_cast<int>( exponent ) - 25 );
+      }
+
+      return ( ( bits & 0x8000 ) != 0 ) ? -value : value;
+   }
+
+   inline uint64_t bitMask( unsigned bitsPerRecord )
+   {
+      return ( bitsPerRecord == 64 ) ? ~uint64_t{ 0 } : ( uint64_t{ 1 } << bitsPerRecord ) - 1;
+   }
+
+   // Get the (unmasked) bits starting at bit of inbuf without reading past inbufSize.
+   inline uint64_t readBits( const char *inbuf, size_t inbufSize, size_t bit,
+                             unsigned bitsPerRecord )
+   {
+      const size_t byte = bit / 8;
+      const auto shift = static_cast<unsigned>( bit % 8 );
+
+      uint64_t word = 0;
+      memcpy( &word, inbuf + byte, std::min( sizeof( word ), inbufSize - byte ) );
+
+      uint64_t value = word >> shift;
+
+      // The top bits of a wide value which doesn't start on a byte boundary are in a ninth byte
+      if ( shift + bitsPerRecord > 64 )
+      {
+         value |= static_cast<uint64_t>( static_cast<uint8_t>( inbuf[byte + 8] ) )
+                  << ( 64 - shift );
+      }
+
+      return value;
+   }
+
+   template <unsigned Bits> constexpr uint64_t fixedMask()
+   {
+      return ( Bits == 64 ) ? ~uint64_t{ 0 } : ( uint64_t{ 1 } << ( Bits % 64 ) ) - 1;
+   }
+
+   // Unpack eight values of Bits bits, starting at bit firstBit (less than 8) of group. The
+   // loop has a constant trip count, so it is unrolled with constant offsets (and, when called
+   // with a firstBit of 0, constant shifts).
+   template <unsigned Bits, typename RawT>
+   inline void unpackGroup( const char *group, size_t firstBit, RawT *raw )
+   {
+      for ( size_t j = 0; j < 8; ++j )
+      {
+         const size_t bit = firstBit + j * Bits;
+
+         uint64_t word;
+         memcpy( &word, group + bit / 8, sizeof( word ) );
+
+         raw[j] = static_cast<RawT>( ( word >> ( bit % 8 ) ) & fixedMask<Bits>() );
+      }
+   }
+
+   template <unsigned Bits, typename RawT>
+   void unpackScalar( const char *inbuf, size_t inbufSize, size_t firstBit, size_t count,
+                      RawT *raw )
+   {
+      size_t i = 0;
+
+      // Eight values fill Bits bytes, so every group of them starts at the same bit of its first
+      // byte. While there is a whole word left to load for the last one we don't have to check
+      // the end of inbuf, and every value up to 57 bits fits in one word.
+      if ( Bits <= 57 )
+      {
+         constexpr size_t cGroupLoadEnd = ( 7 + 7 * Bits ) / 8 + sizeof( uint64_t );
+
+         size_t groupByte = 0;
+
+         for ( ; ( i + 8 <= count ) && ( groupByte + cGroupLoadEnd <= inbufSize );
+               i += 8, groupByte += Bits )
+         {
+            if ( firstBit == 0 )
+            {
+               unpackGroup<Bits>( inbuf + groupByte, 0, raw + i );
+            }
+            else
+            {
+               unpackGroup<Bits>( inbuf + groupByte, firstBit, raw + i );
+            }
+         }
+      }
+
+      for ( size_t bit = firstBit + i * Bits; i < count; ++i, bit += Bits )
+      {
+         raw[i] = static_cast<RawT>( readBits( inbuf, inbufSize, bit, Bits ) & fixedMask<Bits>() );
+      }
+   }
+
+   template <unsigned Bits, typename RawT>
+   void packScalar( const RawT *raw, size_t count, size_t firstBit, char *out )
+   {
+      char *outp = out + firstBit / 8;
+
+      // Start with the bits already in the first byte
+      auto accBits = static_cast<unsigned>( firstBit % 8 );
+      uint64_t acc = static_cast<uint8_t>( *outp ) & bitMask( accBits );
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         const auto value = static_cast<uint64_t>( raw[i] );
+
+         acc |= value << accBits;
+         accBits += Bits;
+
+         // Write each word as it fills, and start the next one with whatever didn't fit
+         if ( accBits >= 64 )
+         {
+            memcpy( outp, &acc, sizeof( acc ) );
+            outp += sizeof( acc );
+
+            accBits -= 64;
+            acc = ( accBits > 0 ) ? value >> ( Bits - accBits ) : 0;
+         }
+      }
+
+      memcpy( outp, &acc, ( accBits + 7 ) / 8 );
+   }
+
+#if defined( E57_BITPACK_X86 )
+   // Byte-aligned 8 and 16 bit values.
+   E57_BITPACK_TARGET_SSE41 size_t unpackSSE41( const char *inbuf, size_t /*inbufSize*/,
+                                                size_t firstBit, unsigned bitsPerRecord,
+                                                size_t count, uint32_t *raw )
+   {
+      if ( firstBit != 0 )
+      {
+         return 0;
+      }
+
+      size_t i = 0;
+
+      if ( bitsPerRecord == 8 )
+      {
+         for ( ; i + 16 <= count; i += 16 )
+         {
+            const __m128i v = _mm_loadu_si128( reinterpret_cast<const __m128i *>( inbuf + i ) );
+            auto out = reinterpret_cast<__m128i *>( raw + i );
+
+            _mm_storeu_si128( out, _mm_cvtepu8_epi32( v ) );
+            _mm_storeu_si128( out + 1, _mm_cvtepu8_epi32( _mm_srli_si128( v, 4 ) ) );
+            _mm_storeu_si128( out + 2, _mm_cvtepu8_epi32( _mm_srli_si128( v, 8 ) ) );
+            _mm_storeu_si128( out + 3, _mm_cvtepu8_epi32( _mm_srli_si128( v, 12 ) ) );
+         }
+      }
+      else if ( bitsPerRecord == 16 )
+      {
+         for ( ; i + 8 <= count; i += 8 )
+         {
+            const __m128i v =
+               _mm_loadu_si128( reinterpret_cast<const __m128i *>( inbuf + 2 * i ) );
+            auto out = reinterpret_cast<__m128i *>( raw + i );
+
+            _mm_storeu_si128( out, _mm_cvtepu16_epi32( v ) );
+            _mm_storeu_si128( out + 1, _mm_cvtepu16_epi32( _mm_srli_si128( v, 8 ) ) );
+         }
+      }
+
+      return i;
+   }
+
+   // Any width up to 25 bits, so every value is within a 32-bit load from its first byte. Eight
+   // values at a time are gathered from their byte offsets, then shifted and masked.
+   E57_BITPACK_TARGET_AVX2 size_t unpackAVX2( const char *inbuf, size_t inbufSize,
+                                              size_t firstBit, unsigned bitsPerRecord,
+                                              size_t count, uint32_t *raw )
+   {
+      if ( ( firstBit == 0 ) && ( bitsPerRecord == 8 || bitsPerRecord == 16 ) )
+      {
+         return unpackSSE41( inbuf, inbufSize, firstBit, bitsPerRecord, count, raw );
+      }
+
+      if ( ( bitsPerRecord > 25 ) || ( inbufSize < sizeof( uint32_t ) ) )
+      {
+         return 0;
+      }
+
+      // Only gather values where all four bytes from their first byte are in inbuf
+      const size_t lastLoadBit = ( inbufSize - sizeof( uint32_t ) ) * 8 + 7;
+
+      if ( lastLoadBit < firstBit )
+      {
+         return 0;
+      }
+
+      const size_t safeCount = std::min( count, ( lastLoadBit - firstBit ) / bitsPerRecord + 1 );
+
+      const __m256i mask = _mm256_set1_epi32( static_cast<int>( bitMask( bitsPerRecord ) ) );
+      const __m256i seven = _mm256_set1_epi32( 7 );
+      const __m256i step = _mm256_set1_epi32( static_cast<int>( 8 * bitsPerRecord ) );
+
+      __m256i bitPos =
+         _mm256_add_epi32( _mm256_set1_epi32( static_cast<int>( firstBit ) ),
+                           _mm256_mullo_epi32( _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ),
+                                               _mm256_set1_epi32( static_cast<int>(
+                                                  bitsPerRecord ) ) ) );
+
+      const auto base = reinterpret_cast<const int *>( inbuf );
+
+      size_t i = 0;
+
+      for ( ; i + 8 <= safeCount; i += 8 )
+      {
+         const __m256i byteOffset = _mm256_srli_epi32( bitPos, 3 );
+         const __m256i shift = _mm256_and_si256( bitPos, seven );
+
+         __m256i v = _mm256_i32gather_epi32( base, byteOffset, 1 );
+         v = _mm256_and_si256( _mm256_srlv_epi32( v, shift ), mask );
+
+         _mm256_storeu_si256( reinterpret_cast<__m256i *>( raw + i ), v );
+
+         bitPos = _mm256_add_epi32( bitPos, step );
+      }
+
+      return i;
+   }
+
+   // Byte-aligned 8, 12, 16, and 32 bit values.
+   E57_BITPACK_TARGET_SSE41 size_t packSSE41( const uint32_t *raw, size_t count,
+                                              unsigned bitsPerRecord, size_t firstBit, char *out )
+   {
+      if ( firstBit % 8 != 0 )
+      {
+         return 0;
+      }
+
+      out += firstBit / 8;
+
+      auto in = reinterpret_cast<const __m128i *>( raw );
+
+      size_t i = 0;
+
+      switch ( bitsPerRecord )
+      {
+         case 8:
+            // Values are known to fit, so the saturating packs just narrow them
+            for ( ; i + 16 <= count; i += 16, in += 4, out += 16 )
+            {
+               const __m128i low = _mm_packus_epi32( _mm_loadu_si128( in ),
+                                                     _mm_loadu_si128( in + 1 ) );
+               const __m128i high = _mm_packus_epi32( _mm_loadu_si128( in + 2 ),
+                                                      _mm_loadu_si128( in + 3 ) );
+
+               _mm_storeu_si128( reinterpret_cast<__m128i *>( out ),
+                                 _mm_packus_epi16( low, high ) );
+            }
+            break;
+
+         case 12:
+         {
+            // Join pairs of values into 24 bits in each 64-bit lane, then squeeze out the
+            // unused bytes.
+            const __m128i lowMask = _mm_set1_epi64x( 0xFFF );
+            const __m128i highMask = _mm_set1_epi64x( 0xFFF000 );
+            const __m128i firstHalf =
+               _mm_setr_epi8( 0, 1, 2, 8, 9, 10, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 );
+            const __m128i secondHalf =
+               _mm_setr_epi8( -1, -1, -1, -1, -1, -1, 0, 1, 2, 8, 9, 10, -1, -1, -1, -1 );
+
+            for ( ; i + 8 <= count; i += 8, in += 2, out += 12 )
+            {
+               __m128i a = _mm_loadu_si128( in );
+               __m128i b = _mm_loadu_si128( in + 1 );
+
+               a = _mm_or_si128( _mm_and_si128( a, lowMask ),
+                                 _mm_and_si128( _mm_srli_epi64( a, 20 ), highMask ) );
+               b = _mm_or_si128( _mm_and_si128( b, lowMask ),
+                                 _mm_and_si128( _mm_srli_epi64( b, 20 ), highMask ) );
+
+               _mm_storeu_si128( reinterpret_cast<__m128i *>( out ),
+                                 _mm_or_si128( _mm_shuffle_epi8( a, firstHalf ),
+                                               _mm_shuffle_epi8( b, secondHalf ) ) );
+            }
+            break;
+         }
+
+         case 16:
+            for ( ; i + 8 <= count; i += 8, in += 2, out += 16 )
+            {
+               _mm_storeu_si128(
+                  reinterpret_cast<__m128i *>( out ),
+                  _mm_packus_epi32( _mm_loadu_si128( in ), _mm_loadu_si128( in + 1 ) ) );
+            }
+            break;
+
+         case 32:
+            memcpy( out, raw, count * sizeof( uint32_t ) );
+            i = count;
+            break;
+
+         default:
+            break;
+      }
+
+      return i;
+   }
+
+   // Convert int64_t to the nearest double (which SSE and AVX2 have no instruction for) by
+   // splitting each value into its top 48 and bottom 16 bits, so only the final add rounds.
+   E57_BITPACK_TARGET_SSE41 inline __m128d toDoubleSSE41( __m128i x )
+   {
+      __m128i high = _mm_srai_epi32( x, 16 );
+      high = _mm_blend_epi16( high, _mm_setzero_si128(), 0x33 );
+      high = _mm_add_epi64( high, _mm_castpd_si128( _mm_set1_pd( 442721857769029238784.0 ) ) );
+
+      const __m128i low =
+         _mm_blend_epi16( x, _mm_castpd_si128( _mm_set1_pd( 4503599627370496.0 ) ), 0x88 );
+
+      const __m128d f =
+         _mm_sub_pd( _mm_castsi128_pd( high ), _mm_set1_pd( 442726361368656609280.0 ) );
+
+      return _mm_add_pd( f, _mm_castsi128_pd( low ) );
+   }
+
+   E57_BITPACK_TARGET_SSE41 size_t unscaleSSE41( const double *in, size_t count, double scale,
+                                                 double offset, int64_t *raw )
+   {
+      const __m128d vScale = _mm_set1_pd( scale );
+      const __m128d vOffset = _mm_set1_pd( offset );
+      const __m128d half = _mm_set1_pd( 0.5 );
+      const __m128d signBit = _mm_set1_pd( -0.0 );
+      const __m128d limit = _mm_set1_pd( cExactIntLimit );
+      const __m128d magic = _mm_set1_pd( cMagicIntToDouble );
+
+      size_t i = 0;
+
+      for ( ; i + 2 <= count; i += 2 )
+      {
+         const __m128d value = _mm_floor_pd( _mm_add_pd(
+            _mm_div_pd( _mm_sub_pd( _mm_loadu_pd( in + i ), vOffset ), vScale ), half ) );
+
+         // Ordered compare, so NaN fails too
+         if ( _mm_movemask_pd( _mm_cmplt_pd( _mm_andnot_pd( signBit, value ), limit ) ) != 0x3 )
+         {
+            break;
+         }
+
+         const __m128i result = _mm_sub_epi64( _mm_castpd_si128( _mm_add_pd( value, magic ) ),
+                                               _mm_castpd_si128( magic ) );
+
+         _mm_storeu_si128( reinterpret_cast<__m128i *>( raw + i ), result );
+      }
+
+      return i;
+   }
+
+   E57_BITPACK_TARGET_AVX2 inline __m256d toDoubleAVX2( __m256i x )
+   {
+      __m256i high = _mm256_srai_epi32( x, 16 );
+      high = _mm256_blend_epi16( high, _mm256_setzero_si256(), 0x33 );
+      high =
+         _mm256_add_epi64( high, _mm256_castpd_si256( _mm256_set1_pd( 442721857769029238784.0 ) ) );
+
+      const __m256i low =
+         _mm256_blend_epi16( x, _mm256_castpd_si256( _mm256_set1_pd( 4503599627370496.0 ) ), 0x88 );
+
+      const __m256d f =
+         _mm256_sub_pd( _mm256_castsi256_pd( high ), _mm256_set1_pd( 442726361368656609280.0 ) );
+
+      return _mm256_add_pd( f, _mm256_castsi256_pd( low ) );
+   }
+
+   E57_BITPACK_TARGET_AVX2 size_t unscaleAVX2( const double *in, size_t count, double scale,
+                                               double offset, int64_t *raw )
+   {
+      const __m256d vScale = _mm256_set1_pd( scale );
+      const __m256d vOffset = _mm256_set1_pd( offset );
+      const __m256d half = _mm256_set1_pd( 0.5 );
+      const __m256d signBit = _mm256_set1_pd( -0.0 );
+      const __m256d limit = _mm256_set1_pd( cExactIntLimit );
+      const __m256d magic = _mm256_set1_pd( cMagicIntToDouble );
+
+      size_t i = 0;
+
+      for ( ; i + 4 <= count; i += 4 )
+      {
+         const __m256d value = _mm256_floor_pd( _mm256_add_pd(
+            _mm256_div_pd( _mm256_sub_pd( _mm256_loadu_pd( in + i ), vOffset ), vScale ), half ) );
+
+         // Ordered compare, so NaN fails too
+         const __m256d inRange = _mm256_cmp_pd( _mm256_andnot_pd( signBit, value ), limit,
+                                                _CMP_LT_OQ );
+
+         if ( _mm256_movemask_pd( inRange ) != 0xF )
+         {
+            break;
+         }
+
+         const __m256i result =
+            _mm256_sub_epi64( _mm256_castpd_si256( _mm256_add_pd( value, magic ) ),
+                              _mm256_castpd_si256( magic ) );
+
+         _mm256_storeu_si256( reinterpret_cast<__m256i *>( raw + i ), result );
+      }
+
+      return i;
+   }
+
+   // Points are loaded and stored as doubles, so float ones are transformed in double
+   // precision just like double ones, and each is only rounded to float when stored.
+   E57_BITPACK_TARGET_SSE41 inline __m128d load2SSE41( const double *in )
+   {
+      return _mm_loadu_pd( in );
+   }
+
+   E57_BITPACK_TARGET_SSE41 inline __m128d load2SSE41( const float *in )
+   {
+      return _mm_cvtps_pd( _mm_castpd_ps( _mm_load_sd( reinterpret_cast<const double *>( in ) ) ) );
+   }
+
+   E57_BITPACK_TARGET_SSE41 inline void store2SSE41( __m128d value, double *out )
+   {
+      _mm_storeu_pd( out, value );
+   }
+
+   E57_BITPACK_TARGET_SSE41 inline void store2SSE41( __m128d value, float *out )
+   {
+      _mm_store_sd( reinterpret_cast<double *>( out ), _mm_castps_pd( _mm_cvtpd_ps( value ) ) );
+   }
+
+   template <typename T>
+   E57_BITPACK_TARGET_SSE41 size_t scaleSSE41( const int64_t *raw, size_t count, double scale,
+                                               double offset, double origin, T *out )
+   {
+      const __m128d vScale = _mm_set1_pd( scale );
+      const __m128d vOffset = _mm_set1_pd( offset );
+      const __m128d vOrigin = _mm_set1_pd( origin );
+
+      size_t i = 0;
+
+      for ( ; i + 2 <= count; i += 2 )
+      {
+         const __m128d value =
+            toDoubleSSE41( _mm_loadu_si128( reinterpret_cast<const __m128i *>( raw + i ) ) );
+
+         store2SSE41(
+            _mm_sub_pd( _mm_add_pd( _mm_mul_pd( value, vScale ), vOffset ), vOrigin ), out + i );
+      }
+
+      return i;
+   }
+
+   // One row of the matrix, with the same operations in the same order as the scalar loop
+   E57_BITPACK_TARGET_SSE41 inline __m128d transformRowSSE41( const double *row, __m128d x,
+                                                             __m128d y, __m128d z )
+   {
+      const __m128d sum = _mm_add_pd( _mm_mul_pd( _mm_set1_pd( row[0] ), x ),
+                                      _mm_mul_pd( _mm_set1_pd( row[1] ), y ) );
+
+      return _mm_add_pd( _mm_add_pd( sum, _mm_mul_pd( _mm_set1_pd( row[2] ), z ) ),
+                         _mm_set1_pd( row[3] ) );
+   }
+
+   template <typename T>
+   E57_BITPACK_TARGET_SSE41 size_t transformSSE41( const double *matrix, size_t count, T *x, T *y,
+                                                   T *z )
+   {
+      size_t i = 0;
+
+      for ( ; i + 2 <= count; i += 2 )
+      {
+         const __m128d vx = load2SSE41( x + i );
+         const __m128d vy = load2SSE41( y + i );
+         const __m128d vz = load2SSE41( z + i );
+
+         store2SSE41( transformRowSSE41( matrix, vx, vy, vz ), x + i );
+         store2SSE41( transformRowSSE41( matrix + 4, vx, vy, vz ), y + i );
+         store2SSE41( transformRowSSE41( matrix + 8, vx, vy, vz ), z + i );
+      }
+
+      return i;
+   }
+
+   E57_BITPACK_TARGET_AVX2 inline __m256d load4AVX2( const double *in )
+   {
+      return _mm256_loadu_pd( in );
+   }
+
+   E57_BITPACK_TARGET_AVX2 inline __m256d load4AVX2( const float *in )
+   {
+      return _mm256_cvtps_pd( _mm_loadu_ps( in ) );
+   }
+
+   E57_BITPACK_TARGET_AVX2 inline void store4AVX2( __m256d value, double *out )
+   {
+      _mm256_storeu_pd( out, value );
+   }
+
+   E57_BITPACK_TARGET_AVX2 inline void store4AVX2( __m256d value, float *out )
+   {
+      _mm_storeu_ps( out, _mm256_cvtpd_ps( value ) );
+   }
+
+   template <typename T>
+   E57_BITPACK_TARGET_AVX2 size_t scaleAVX2( const int64_t *raw, size_t count, double scale,
+                                             double offset, double origin, T *out )
+   {
+      const __m256d vScale = _mm256_set1_pd( scale );
+      const __m256d vOffset = _mm256_set1_pd( offset );
+      const __m256d vOrigin = _mm256_set1_pd( origin );
+
+      size_t i = 0;
+
+      for ( ; i + 4 <= count; i += 4 )
+      {
+         const __m256d value =
+            toDoubleAVX2( _mm256_loadu_si256( reinterpret_cast<const __m256i *>( raw + i ) ) );
+
+         store4AVX2( _mm256_sub_pd( _mm256_add_pd( _mm256_mul_pd( value, vScale ), vOffset ),
+                                    vOrigin ),
+                     out + i );
+      }
+
+      return i;
+   }
+
+   E57_BITPACK_TARGET_AVX2 inline __m256d transformRowAVX2( const double *row, __m256d x,
+                                                           __m256d y, __m256d z )
+   {
+      const __m256d sum = _mm256_add_pd( _mm256_mul_pd( _mm256_set1_pd( row[0] ), x ),
+                                         _mm256_mul_pd( _mm256_set1_pd( row[1] ), y ) );
+
+      return _mm256_add_pd( _mm256_add_pd( sum, _mm256_mul_pd( _mm256_set1_pd( row[2] ), z ) ),
+                            _mm256_set1_pd( row[3] ) );
+   }
+
+   template <typename T>
+   E57_BITPACK_TARGET_AVX2 size_t transformAVX2( const double *matrix, size_t count, T *x, T *y,
+                                                 T *z )
+   {
+      size_t i = 0;
+
+      for ( ; i + 4 <= count; i += 4 )
+      {
+         const __m256d vx = load4AVX2( x + i );
+         const __m256d vy = load4AVX2( y + i );
+         const __m256d vz = load4AVX2( z + i );
+
+         store4AVX2( transformRowAVX2( matrix, vx, vy, vz ), x + i );
+         store4AVX2( transformRowAVX2( matrix + 4, vx, vy, vz ), y + i );
+         store4AVX2( transformRowAVX2( matrix + 8, vx, vy, vz ), z + i );
+      }
+
+      return i;
+   }
+
+   E57_BITPACK_TARGET_SSE41 inline void sinCosSSE41( __m128d x, __m128d &sine, __m128d &cosine )
+   {
+      const __m128d signBit = _mm_set1_pd( -0.0 );
+      const __m128d ax = _mm_andnot_pd( signBit, x );
+
+      const __m128d k = _mm_floor_pd(
+         _mm_add_pd( _mm_mul_pd( ax, _mm_set1_pd( cTwoOverPi ) ), _mm_set1_pd( 0.5 ) ) );
+
+      __m128d z = _mm_sub_pd( ax, _mm_mul_pd( k, _mm_set1_pd( cPiOver2High ) ) );
+      z = _mm_sub_pd( z, _mm_mul_pd( k, _mm_set1_pd( cPiOver2Middle ) ) );
+      z = _mm_sub_pd( z, _mm_mul_pd( k, _mm_set1_pd( cPiOver2Low ) ) );
+
+      const __m128d zz = _mm_mul_pd( z, z );
+
+      __m128d sinPoly = _mm_set1_pd( cSinCoefficients[0] );
+      __m128d cosPoly = _mm_set1_pd( cCosCoefficients[0] );
+
+      for ( size_t j = 1; j < 6; ++j )
+      {
+         sinPoly = _mm_add_pd( _mm_mul_pd( sinPoly, zz ), _mm_set1_pd( cSinCoefficients[j] ) );
+         cosPoly = _mm_add_pd( _mm_mul_pd( cosPoly, zz ), _mm_set1_pd( cCosCoefficients[j] ) );
+      }
+
+      const __m128d sinZ = _mm_add_pd( z, _mm_mul_pd( _mm_mul_pd( z, zz ), sinPoly ) );
+      const __m128d cosZ =
+         _mm_add_pd( _mm_sub_pd( _mm_set1_pd( 1.0 ), _mm_mul_pd( _mm_set1_pd( 0.5 ), zz ) ),
+                     _mm_mul_pd( _mm_mul_pd( zz, zz ), cosPoly ) );
+
+      // k is a whole number less than 2^31, so converting it is exact
+      const __m128i quadrant = _mm_cvtepi32_epi64( _mm_cvtpd_epi32( k ) );
+      const __m128i one = _mm_set1_epi64x( 1 );
+      const __m128i two = _mm_set1_epi64x( 2 );
+
+      const __m128d swap =
+         _mm_castsi128_pd( _mm_cmpeq_epi64( _mm_and_si128( quadrant, one ), one ) );
+
+      const __m128d sinSign =
+         _mm_castsi128_pd( _mm_slli_epi64( _mm_and_si128( quadrant, two ), 62 ) );
+      const __m128d cosSign = _mm_castsi128_pd(
+         _mm_slli_epi64( _mm_and_si128( _mm_add_epi64( quadrant, one ), two ), 62 ) );
+
+      sine = _mm_xor_pd( _mm_xor_pd( _mm_blendv_pd( sinZ, cosZ, swap ), sinSign ),
+                         _mm_and_pd( x, signBit ) );
+      cosine = _mm_xor_pd( _mm_blendv_pd( cosZ, sinZ, swap ), cosSign );
+   }
+
+   template <typename T>
+   E57_BITPACK_TARGET_SSE41 size_t sphericalSSE41( size_t count, T *range, T *azimuth,
+                                                   T *elevation )
+   {
+      const __m128d limit = _mm_set1_pd( cSinCosLimit );
+      const __m128d signBit = _mm_set1_pd( -0.0 );
+
+      size_t i = 0;
+
+      for ( ; i + 2 <= count; i += 2 )
+      {
+         const __m128d r = load2SSE41( range + i );
+         const __m128d a = load2SSE41( azimuth + i );
+         const __m128d e = load2SSE41( elevation + i );
+
+         // Ordered compare, so NaN fails too
+         const __m128d inRange = _mm_and_pd( _mm_cmplt_pd( _mm_andnot_pd( signBit, a ), limit ),
+                                             _mm_cmplt_pd( _mm_andnot_pd( signBit, e ), limit ) );
+
+         if ( _mm_movemask_pd( inRange ) != 0x3 )
+         {
+            for ( size_t j = i; j < i + 2; ++j )
+            {
+               sphericalToCartesianScalar( range + j, azimuth + j, elevation + j );
+            }
+
+            continue;
+         }
+
+         __m128d sinAzimuth;
+         __m128d cosAzimuth;
+         __m128d sinElevation;
+         __m128d cosElevation;
+
+         sinCosSSE41( a, sinAzimuth, cosAzimuth );
+         sinCosSSE41( e, sinElevation, cosElevation );
+
+         const __m128d horizontal = _mm_mul_pd( r, cosElevation );
+
+         store2SSE41( _mm_mul_pd( horizontal, cosAzimuth ), range + i );
+         store2SSE41( _mm_mul_pd( horizontal, sinAzimuth ), azimuth + i );
+         store2SSE41( _mm_mul_pd( r, sinElevation ), elevation + i );
+      }
+
+      return i;
+   }
+
+   E57_BITPACK_TARGET_AVX2 inline void sinCosAVX2( __m256d x, __m256d &sine, __m256d &cosine )
+   {
+      const __m256d signBit = _mm256_set1_pd( -0.0 );
+      const __m256d ax = _mm256_andnot_pd( signBit, x );
+
+      const __m256d k = _mm256_floor_pd( _mm256_add_pd(
+         _mm256_mul_pd( ax, _mm256_set1_pd( cTwoOverPi ) ), _mm256_set1_pd( 0.5 ) ) );
+
+      __m256d z = _mm256_sub_pd( ax, _mm256_mul_pd( k, _mm256_set1_pd( cPiOver2High ) ) );
+      z = _mm256_sub_pd( z, _mm256_mul_pd( k, _mm256_set1_pd( cPiOver2Middle ) ) );
+      z = _mm256_sub_pd( z, _mm256_mul_pd( k, _mm256_set1_pd( cPiOver2Low ) ) );
+
+      const __m256d zz = _mm256_mul_pd( z, z );
+
+      __m256d sinPoly = _mm256_set1_pd( cSinCoefficients[0] );
+      __m256d cosPoly = _mm256_set1_pd( cCosCoefficients[0] );
+
+      for ( size_t j = 1; j < 6; ++j )
+      {
+         sinPoly =
+            _mm256_add_pd( _mm256_mul_pd( sinPoly, zz ), _mm256_set1_pd( cSinCoefficients[j] ) );
+         cosPoly =
+            _mm256_add_pd( _mm256_mul_pd( cosPoly, zz ), _mm256_set1_pd( cCosCoefficients[j] ) );
+      }
+
+      const __m256d sinZ = _mm256_add_pd( z, _mm256_mul_pd( _mm256_mul_pd( z, zz ), sinPoly ) );
+      const __m256d cosZ = _mm256_add_pd(
+         _mm256_sub_pd( _mm256_set1_pd( 1.0 ), _mm256_mul_pd( _mm256_set1_pd( 0.5 ), zz ) ),
+         _mm256_mul_pd( _mm256_mul_pd( zz, zz ), cosPoly ) );
+
+      // k is a whole number less than 2^31, so converting it is exact
+      const __m256i quadrant = _mm256_cvtepi32_epi64( _mm256_cvtpd_epi32( k ) );
+      const __m256i one = _mm256_set1_epi64x( 1 );
+      const __m256i two = _mm256_set1_epi64x( 2 );
+
+      const __m256d swap =
+         _mm256_castsi256_pd( _mm256_cmpeq_epi64( _mm256_and_si256( quadrant, one ), one ) );
+
+      const __m256d sinSign =
+         _mm256_castsi256_pd( _mm256_slli_epi64( _mm256_and_si256( quadrant, two ), 62 ) );
+      const __m256d cosSign = _mm256_castsi256_pd(
+         _mm256_slli_epi64( _mm256_and_si256( _mm256_add_epi64( quadrant, one ), two ), 62 ) );
+
+      sine = _mm256_xor_pd( _mm256_xor_pd( _mm256_blendv_pd( sinZ, cosZ, swap ), sinSign ),
+                            _mm256_and_pd( x, signBit ) );
+      cosine = _mm256_xor_pd( _mm256_blendv_pd( cosZ, sinZ, swap ), cosSign );
+   }
+
+   template <typename T>
+   E57_BITPACK_TARGET_AVX2 size_t sphericalAVX2( size_t count, T *range, T *azimuth, T *elevation )
+   {
+      const __m256d limit = _mm256_set1_pd( cSinCosLimit );
+      const __m256d signBit = _mm256_set1_pd( -0.0 );
+
+      size_t i = 0;
+
+      for ( ; i + 4 <= count; i += 4 )
+      {
+         const __m256d r = load4AVX2( range + i );
+         const __m256d a = load4AVX2( azimuth + i );
+         const __m256d e = load4AVX2( elevation + i );
+
+         // Ordered compare, so NaN fails too
+         const __m256d inRange =
+            _mm256_and_pd( _mm256_cmp_pd( _mm256_andnot_pd( signBit, a ), limit, _CMP_LT_OQ ),
+                           _mm256_cmp_pd( _mm256_andnot_pd( signBit, e ), limit, _CMP_LT_OQ ) );
+
+         if ( _mm256_movemask_pd( inRange ) != 0xF )
+         {
+            for ( size_t j = i; j < i + 4; ++j )
+            {
+               sphericalToCartesianScalar( range + j, azimuth + j, elevation + j );
+            }
+
+            continue;
+         }
+
+         __m256d sinAzimuth;
+         __m256d cosAzimuth;
+         __m256d sinElevation;
+         __m256d cosElevation;
+
+         sinCosAVX2( a, sinAzimuth, cosAzimuth );
+         sinCosAVX2( e, sinElevation, cosElevation );
+
+         const __m256d horizontal = _mm256_mul_pd( r, cosElevation );
+
+         store4AVX2( _mm256_mul_pd( horizontal, cosAzimuth ), range + i );
+         store4AVX2( _mm256_mul_pd( horizontal, sinAzimuth ), azimuth + i );
+         store4AVX2( _mm256_mul_pd( r, sinElevation ), elevation + i );
+      }
+
+      return i;
+   }
+
+   bool hasSSE41()
+   {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+      int info[4];
+      __cpuid( info, 1 );
+
+      return ( info[2] & ( 1 << 19 ) ) != 0;
+#else
+      return __builtin_cpu_supports( "sse4.1" );
+#endif
+   }
+
+   bool hasAVX2()
+   {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+      int info[4];
+      __cpuid( info, 1 );
+
+      // The OS has to save the AVX registers too
+      const bool osSavesAVX = ( ( info[2] & ( 1 << 27 ) ) != 0 ) &&
+                              ( ( info[2] & ( 1 << 28 ) ) != 0 ) &&
+                              ( ( _xgetbv( 0 ) & 6 ) == 6 );
+
+      if ( !osSavesAVX )
+      {
+         return false;
+      }
+
+      __cpuidex( info, 7, 0 );
+
+      return ( info[1] & ( 1 << 5 ) ) != 0;
+#else
+      return __builtin_cpu_supports( "avx2" );
+#endif
+   }
+#elif defined( E57_BITPACK_NEON )
+   // Byte-aligned 8 and 16 bit values.
+   size_t unpackNEON( const char *inbuf, size_t /*inbufSize*/, size_t firstBit,
+                      unsigned bitsPerRecord, size_t count, uint32_t *raw )
+   {
+      if ( firstBit != 0 )
+      {
+         return 0;
+      }
+
+      const auto in = reinterpret_cast<const uint8_t *>( inbuf );
+
+      size_t i = 0;
+
+      if ( bitsPerRecord == 8 )
+      {
+         for ( ; i + 16 <= count; i += 16 )
+         {
+            const uint8x16_t v = vld1q_u8( in + i );
+            const uint16x8_t low = vmovl_u8( vget_low_u8( v ) );
+            const uint16x8_t high = vmovl_u8( vget_high_u8( v ) );
+
+            vst1q_u32( raw + i, vmovl_u16( vget_low_u16( low ) ) );
+            vst1q_u32( raw + i + 4, vmovl_u16( vget_high_u16( low ) ) );
+            vst1q_u32( raw + i + 8, vmovl_u16( vget_low_u16( high ) ) );
+            vst1q_u32( raw + i + 12, vmovl_u16( vget_high_u16( high ) ) );
+         }
+      }
+      else if ( bitsPerRecord == 16 )
+      {
+         for ( ; i + 8 <= count; i += 8 )
+         {
+            const uint16x8_t v = vreinterpretq_u16_u8( vld1q_u8( in + 2 * i ) );
+
+            vst1q_u32( raw + i, vmovl_u16( vget_low_u16( v ) ) );
+            vst1q_u32( raw + i + 4, vmovl_u16( vget_high_u16( v ) ) );
+         }
+      }
+
+      return i;
+   }
+
+   // Byte-aligned 8, 16, and 32 bit values.
+   size_t packNEON( const uint32_t *raw, size_t count, unsigned bitsPerRecord, size_t firstBit,
+                    char *out )
+   {
+      if ( firstBit % 8 != 0 )
+      {
+         return 0;
+      }
+
+      auto outp = reinterpret_cast<uint8_t *>( out + firstBit / 8 );
+
+      size_t i = 0;
+
+      switch ( bitsPerRecord )
+      {
+         case 8:
+            // Values are known to fit, so narrowing just drops the zero bytes
+            for ( ; i + 8 <= count; i += 8, outp += 8 )
+            {
+               const uint16x8_t v = vcombine_u16( vmovn_u32( vld1q_u32( raw + i ) ),
+                                                  vmovn_u32( vld1q_u32( raw + i + 4 ) ) );
+
+               vst1_u8( outp, vmovn_u16( v ) );
+            }
+            break;
+
+         case 16:
+            for ( ; i + 8 <= count; i += 8, outp += 16 )
+            {
+               const uint16x8_t v = vcombine_u16( vmovn_u32( vld1q_u32( raw + i ) ),
+                                                  vmovn_u32( vld1q_u32( raw + i + 4 ) ) );
+
+               vst1q_u8( outp, vreinterpretq_u8_u16( v ) );
+            }
+            break;
+
+         case 32:
+            memcpy( outp, raw, count * sizeof( uint32_t ) );
+            i = count;
+            break;
+
+         default:
+            break;
+      }
+
+      return i;
+   }
+
+   size_t unscaleNEON( const double *in, size_t count, double scale, double offset,
+                       int64_t *raw )
+   {
+      const float64x2_t vScale = vdupq_n_f64( scale );
+      const float64x2_t vOffset = vdupq_n_f64( offset );
+      const float64x2_t half = vdupq_n_f64( 0.5 );
+      const float64x2_t limit = vdupq_n_f64( cExactIntLimit );
+
+      size_t i = 0;
+
+      for ( ; i + 2 <= count; i += 2 )
+      {
+         const float64x2_t value = vrndmq_f64(
+            vaddq_f64( vdivq_f64( vsubq_f64( vld1q_f64( in + i ), vOffset ), vScale ), half ) );
+
+         // Ordered compare, so NaN fails too
+         const uint64x2_t inRange = vcaltq_f64( value, limit );
+
+         if ( ( vgetq_lane_u64( inRange, 0 ) & vgetq_lane_u64( inRange, 1 ) ) == 0 )
+         {
+            break;
+         }
+
+         // value is a whole number, so truncating is exact
+         vst1q_s64( raw + i, vcvtq_s64_f64( value ) );
+      }
+
+      return i;
+   }
+
+   inline float64x2_t load2NEON( const double *in )
+   {
+      return vld1q_f64( in );
+   }
+
+   inline float64x2_t load2NEON( const float *in )
+   {
+      return vcvt_f64_f32( vld1_f32( in ) );
+   }
+
+   inline void store2NEON( float64x2_t value, double *out )
+   {
+      vst1q_f64( out, value );
+   }
+
+   inline void store2NEON( float64x2_t value, float *out )
+   {
+      vst1_f32( out, vcvt_f32_f64( value ) );
+   }
+
+   template <typename T>
+   size_t scaleNEON( const int64_t *raw, size_t count, double scale, double offset, double origin,
+                     T *out )
+   {
+      const float64x2_t vScale = vdupq_n_f64( scale );
+      const float64x2_t vOffset = vdupq_n_f64( offset );
+      const float64x2_t vOrigin = vdupq_n_f64( origin );
+
+      size_t i = 0;
+
+      for ( ; i + 2 <= count; i += 2 )
+      {
+         const float64x2_t value = vcvtq_f64_s64( vld1q_s64( raw + i ) );
+
+         store2NEON( vsubq_f64( vaddq_f64( vmulq_f64( value, vScale ), vOffset ), vOrigin ),
+                     out + i );
+      }
+
+      return i;
+   }
+
+   inline float64x2_t transformRowNEON( const double *row, float64x2_t x, float64x2_t y,
+                                        float64x2_t z )
+   {
+      // Separate multiplies and adds (not vfmaq), as in the scalar loop
+      const float64x2_t sum =
+         vaddq_f64( vmulq_n_f64( x, row[0] ), vmulq_n_f64( y, row[1] ) );
+
+      return vaddq_f64( vaddq_f64( sum, vmulq_n_f64( z, row[2] ) ), vdupq_n_f64( row[3] ) );
+   }
+
+   template <typename T>
+   size_t transformNEON( const double *matrix, size_t count, T *x, T *y, T *z )
+   {
+      size_t i = 0;
+
+      for ( ; i + 2 <= count; i += 2 )
+      {
+         const float64x2_t vx = load2NEON( x + i );
+         const float64x2_t vy = load2NEON( y + i );
+         const float64x2_t vz = load2NEON( z + i );
+
+         store2NEON( transformRowNEON( matrix, vx, vy, vz ), x + i );
+         store2NEON( transformRowNEON( matrix + 4, vx, vy, vz ), y + i );
+         store2NEON( transformRowNEON( matrix + 8, vx, vy, vz ), z + i );
+      }
+
+      return i;
+   }
+
+   inline void sinCosNEON( float64x2_t x, float64x2_t &sine, float64x2_t &cosine )
+   {
+      const float64x2_t ax = vabsq_f64( x );
+      const float64x2_t k =
+         vrndmq_f64( vaddq_f64( vmulq_n_f64( ax, cTwoOverPi ), vdupq_n_f64( 0.5 ) ) );
+
+      float64x2_t z = vsubq_f64( ax, vmulq_n_f64( k, cPiOver2High ) );
+      z = vsubq_f64( z, vmulq_n_f64( k, cPiOver2Middle ) );
+      z = vsubq_f64( z, vmulq_n_f64( k, cPiOver2Low ) );
+
+      const float64x2_t zz = vmulq_f64( z, z );
+
+      float64x2_t sinPoly = vdupq_n_f64( cSinCoefficients[0] );
+      float64x2_t cosPoly = vdupq_n_f64( cCosCoefficients[0] );
+
+      // Separate multiplies and adds (not vfmaq), as in the scalar version
+      for ( size_t j = 1; j < 6; ++j )
+      {
+         sinPoly = vaddq_f64( vmulq_f64( sinPoly, zz ), vdupq_n_f64( cSinCoefficients[j] ) );
+         cosPoly = vaddq_f64( vmulq_f64( cosPoly, zz ), vdupq_n_f64( cCosCoefficients[j] ) );
+      }
+
+      const float64x2_t sinZ = vaddq_f64( z, vmulq_f64( vmulq_f64( z, zz ), sinPoly ) );
+      const float64x2_t cosZ = vaddq_f64( vsubq_f64( vdupq_n_f64( 1.0 ), vmulq_n_f64( zz, 0.5 ) ),
+                                         vmulq_f64( vmulq_f64( zz, zz ), cosPoly ) );
+
+      const int64x2_t quadrant = vcvtq_s64_f64( k );
+      const int64x2_t one = vdupq_n_s64( 1 );
+      const int64x2_t two = vdupq_n_s64( 2 );
+
+      const uint64x2_t swap = vceqq_s64( vandq_s64( quadrant, one ), one );
+
+      const uint64x2_t sinSign =
+         vreinterpretq_u64_s64( vshlq_n_s64( vandq_s64( quadrant, two ), 62 ) );
+      const uint64x2_t cosSign =
+         vreinterpretq_u64_s64( vshlq_n_s64( vandq_s64( vaddq_s64( quadrant, one ), two ), 62 ) );
+      const uint64x2_t xSign = vandq_u64( vreinterpretq_u64_f64( x ), vdupq_n_u64( 1ULL << 63 ) );
+
+      const uint64x2_t sinBits = vreinterpretq_u64_f64( vbslq_f64( swap, cosZ, sinZ ) );
+      const uint64x2_t cosBits = vreinterpretq_u64_f64( vbslq_f64( swap, sinZ, cosZ ) );
+
+      sine = vreinterpretq_f64_u64( veorq_u64( veorq_u64( sinBits, sinSign ), xSign ) );
+      cosine = vreinterpretq_f64_u64( veorq_u64( cosBits, cosSign ) );
+   }
+
+   template <typename T>
+   size_t sphericalNEON( size_t count, T *range, T *azimuth, T *elevation )
+   {
+      const float64x2_t limit = vdupq_n_f64( cSinCosLimit );
+
+      size_t i = 0;
+
+      for ( ; i + 2 <= count; i += 2 )
+      {
+         const float64x2_t r = load2NEON( range + i );
+         const float64x2_t a = load2NEON( azimuth + i );
+         const float64x2_t e = load2NEON( elevation + i );
+
+         // Ordered compare, so NaN fails too
+         const uint64x2_t inRange = vandq_u64( vcaltq_f64( a, limit ), vcaltq_f64( e, limit ) );
+
+         if ( ( vgetq_lane_u64( inRange, 0 ) & vgetq_lane_u64( inRange, 1 ) ) == 0 )
+         {
+            for ( size_t j = i; j < i + 2; ++j )
+            {
+               sphericalToCartesianScalar( range + j, azimuth + j, elevation + j );
+            }
+
+            continue;
+         }
+
+         float64x2_t sinAzimuth;
+         float64x2_t cosAzimuth;
+         float64x2_t sinElevation;
+         float64x2_t cosElevation;
+
+         sinCosNEON( a, sinAzimuth, cosAzimuth );
+         sinCosNEON( e, sinElevation, cosElevation );
+
+         const float64x2_t horizontal = vmulq_f64( r, cosElevation );
+
+         store2NEON( vmulq_f64( horizontal, cosAzimuth ), range + i );
+         store2NEON( vmulq_f64( horizontal, sinAzimuth ), azimuth + i );
+         store2NEON( vmulq_f64( r, sinElevation ), elevation + i );
+      }
+
+      return i;
+   }
+#endif
+
+   // Whether the kernels for each instruction set may be used. The AVX2 ones are only used when
+   // allowed and the CPU has them, and the SSE 4.1 ones fill in for any which are missing.
+#if defined( E57_BITPACK_X86 )
+   bool useAVX2( e57::KernelInstructions instructions )
+   {
+      return ( ( instructions == e57::KernelInstructions::AVX2 ) ||
+               ( instructions == e57::KernelInstructions::Best ) ) &&
+             hasAVX2();
+   }
+
+   bool useSSE41( e57::KernelInstructions instructions )
+   {
+      return ( ( instructions == e57::KernelInstructions::SSE41 ) ||
+               ( instructions == e57::KernelInstructions::AVX2 ) ||
+               ( instructions == e57::KernelInstructions::Best ) ) &&
+             hasSSE41();
+   }
+#elif defined( E57_BITPACK_NEON )
+   bool useNEON( e57::KernelInstructions instructions )
+   {
+      return ( instructions == e57::KernelInstructions::NEON ) ||
+             ( instructions == e57::KernelInstructions::Best );
+   }
+#endif
+
+   Raw32Function selectRaw32Function( e57::KernelInstructions instructions )
+   {
+#if defined( E57_BITPACK_X86 )
+      if ( useAVX2( instructions ) )
+      {
+         return unpackAVX2;
+      }
+
+      if ( useSSE41( instructions ) )
+      {
+         return unpackSSE41;
+      }
+#elif defined( E57_BITPACK_NEON )
+      if ( useNEON( instructions ) )
+      {
+         return unpackNEON;
+      }
+#endif
+
+      return nullptr;
+   }
+
+   template <typename T>
+   ScaleFunction<T> selectScaleFunction( e57::KernelInstructions instructions )
+   {
+#if defined( E57_BITPACK_X86 )
+      if ( useAVX2( instructions ) )
+      {
+         return scaleAVX2<T>;
+      }
+
+      if ( useSSE41( instructions ) )
+      {
+         return scaleSSE41<T>;
+      }
+#elif defined( E57_BITPACK_NEON )
+      if ( useNEON( instructions ) )
+      {
+         return scaleNEON<T>;
+      }
+#endif
+
+      return nullptr;
+   }
+
+   UnscaleFunction selectUnscaleFunction( e57::KernelInstructions instructions )
+   {
+#if defined( E57_BITPACK_X86 )
+      if ( useAVX2( instructions ) )
+      {
+         return unscaleAVX2;
+      }
+
+      if ( useSSE41( instructions ) )
+      {
+         return unscaleSSE41;
+      }
+#elif defined( E57_BITPACK_NEON )
+      if ( useNEON( instructions ) )
+      {
+         return unscaleNEON;
+      }
+#endif
+
+      return nullptr;
+   }
+
+   template <typename T>
+   TransformFunction<T> selectTransformFunction( e57::KernelInstructions instructions )
+   {
+#if defined( E57_BITPACK_X86 )
+      if ( useAVX2( instructions ) )
+      {
+         return transformAVX2<T>;
+      }
+
+      if ( useSSE41( instructions ) )
+      {
+         return transformSSE41<T>;
+      }
+#elif defined( E57_BITPACK_NEON )
+      if ( useNEON( instructions ) )
+      {
+         return transformNEON<T>;
+      }
+#endif
+
+      return nullptr;
+   }
+
+   template <typename T>
+   SphericalFunction<T> selectSphericalFunction( e57::KernelInstructions instructions )
+   {
+#if defined( E57_BITPACK_X86 )
+      if ( useAVX2( instructions ) )
+      {
+         return sphericalAVX2<T>;
+      }
+
+      if ( useSSE41( instructions ) )
+      {
+         return sphericalSSE41<T>;
+      }
+#elif defined( E57_BITPACK_NEON )
+      if ( useNEON( instructions ) )
+      {
+         return sphericalNEON<T>;
+      }
+#endif
+
+      return nullptr;
+   }
+
+   Pack32Function selectPack32Function( e57::KernelInstructions instructions )
+   {
+#if defined( E57_BITPACK_X86 )
+      if ( useSSE41( instructions ) )
+      {
+         return packSSE41;
+      }
+#elif defined( E57_BITPACK_NEON )
+      if ( useNEON( instructions ) )
+      {
+         return packNEON;
+      }
+#endif
+
+      return nullptr;
+   }
+
+   // The kernels for one output type
+   template <typename T> struct TypedKernels
+   {
+      ScaleFunction<T> scale;
+      TransformFunction<T> transform;
+      SphericalFunction<T> spherical;
+   };
+
+   // The kernels in use. A null one means the scalar code does everything.
+   struct Kernels
+   {
+      Raw32Function raw32;
+      Pack32Function pack32;
+      UnscaleFunction unscale;
+      TypedKernels<float> floatKernels;
+      TypedKernels<double> doubleKernels;
+   };
+
+   template <typename T> TypedKernels<T> selectTypedKernels( e57::KernelInstructions instructions )
+   {
+      return { selectScaleFunction<T>( instructions ), selectTransformFunction<T>( instructions ),
+               selectSphericalFunction<T>( instructions ) };
+   }
+
+   Kernels selectKernels( e57::KernelInstructions instructions )
+   {
+      return { selectRaw32Function( instructions ), selectPack32Function( instructions ),
+               selectUnscaleFunction( instructions ), selectTypedKernels<float>( instructions ),
+               selectTypedKernels<double>( instructions ) };
+   }
+
+   // Picked for the CPU the first time a kernel is needed, and only changed after that by
+   // e57::useKernelInstructions().
+   Kernels &kernels()
+   {
+      static Kernels sKernels = selectKernels( e57::KernelInstructions::Best );
+
+      return sKernels;
+   }
+
+   template <typename T> const TypedKernels<T> &typedKernels();
+
+   template <> const TypedKernels<float> &typedKernels()
+   {
+      return kernels().floatKernels;
+   }
+
+   template <> const TypedKernels<double> &typedKernels()
+   {
+      return kernels().doubleKernels;
+   }
+
+   bool hasInstructions( e57::KernelInstructions instructions )
+   {
+      switch ( instructions )
+      {
+         case e57::KernelInstructions::None:
+         case e57::KernelInstructions::Best:
+            return true;
+
+#if defined( E57_BITPACK_X86 )
+         case e57::KernelInstructions::SSE41:
+            return hasSSE41();
+
+         case e57::KernelInstructions::AVX2:
+            return hasAVX2();
+#elif defined( E57_BITPACK_NEON )
+         case e57::KernelInstructions::NEON:
+            return true;
+#endif
+
+         default:
+            return false;
+      }
+   }
+
+   // Unpack values of up to 32 bits, firstBit < 8.
+   template <unsigned Bits>
+   void unpackRaw32( const char *inbuf, size_t inbufSize, size_t firstBit, size_t count,
+                     uint32_t *raw )
+   {
+      const Raw32Function raw32Function = kernels().raw32;
+
+      if ( ( firstBit == 0 ) && ( Bits == 32 ) )
+      {
+         memcpy( raw, inbuf, count * sizeof( uint32_t ) );
+         return;
+      }
+
+      size_t done = 0;
+
+      if ( ( Bits > 0 ) && ( raw32Function != nullptr ) )
+      {
+         done = raw32Function( inbuf, inbufSize, firstBit, Bits, count, raw );
+      }
+
+      if ( done < count )
+      {
+         const size_t bit = firstBit + done * Bits;
+
+         unpackScalar<Bits>( inbuf + bit / 8, inbufSize - bit / 8, bit % 8, count - done,
+                             raw + done );
+      }
+   }
+
+   template <unsigned Bits>
+   void packRaw32( const uint32_t *raw, size_t count, size_t firstBit, char *out )
+   {
+      const Pack32Function pack32Function = kernels().pack32;
+
+      size_t done = 0;
+
+      if ( ( Bits > 0 ) && ( pack32Function != nullptr ) )
+      {
+         done = pack32Function( raw, count, Bits, firstBit, out );
+      }
+
+      if ( done < count )
+      {
+         packScalar<Bits>( raw + done, count - done, firstBit + done * Bits, out );
+      }
+   }
+
+   // Tables of the functions for each width, indexed by the width
+   template <size_t... Bits>
+   std::array<e57::BitUnpacker::Raw32Function, sizeof...( Bits )>
+      raw32Functions( std::index_sequence<Bits...> )
+   {
+      return { { &unpackRaw32<Bits>... } };
+   }
+
+   template <size_t... Bits>
+   std::array<e57::BitUnpacker::Raw64Function, sizeof...( Bits )>
+      raw64Functions( std::index_sequence<Bits...> )
+   {
+      return { { &unpackScalar<Bits, uint64_t>... } };
+   }
+
+   template <size_t... Bits>
+   std::array<e57::BitPacker::Pack32Function, sizeof...( Bits )>
+      pack32Functions( std::index_sequence<Bits...> )
+   {
+      return { { &packRaw32<Bits>... } };
+   }
+
+   template <size_t... Bits>
+   std::array<e57::BitPacker::Pack64Function, sizeof...( Bits )>
+      pack64Functions( std::index_sequence<Bits...> )
+   {
+      return { { &packScalar<Bits, uint64_t>... } };
+   }
+
+   // Add minimum using T's width. Since the results fit in T, wrapping there gives the same
+   // answer as wrapping at 64 bits, and it lets the compiler vectorize the loop.
+   template <typename T, typename RawT>
+   void addMinimum( const RawT *raw, size_t count, int64_t minimum, T *out )
+   {
+      using UnsignedT = typename std::make_unsigned<T>::type;
+
+      const auto min = static_cast<UnsignedT>( minimum );
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         out[i] =
+            static_cast<T>( static_cast<UnsignedT>( min + static_cast<UnsignedT>( raw[i] ) ) );
+      }
+   }
+}
+
+namespace e57
+{
+   BitUnpacker::BitUnpacker( unsigned bitsPerRecord ) : bitsPerRecord_( bitsPerRecord )
+   {
+      static const auto sRaw32Functions = raw32Functions( std::make_index_sequence<33>{} );
+      static const auto sRaw64Functions = raw64Functions( std::make_index_sequence<65>{} );
+
+      if ( bitsPerRecord < sRaw32Functions.size() )
+      {
+         raw32_ = sRaw32Functions[bitsPerRecord];
+      }
+      else
+      {
+         raw64_ = sRaw64Functions.at( bitsPerRecord );
+      }
+   }
+
+   template <typename T>
+   void BitUnpacker::unpack( const char *inbuf, size_t inbufSize, size_t firstBit,
+                             int64_t minimum, size_t count, T *out ) const
+   {
+      // Start from the byte containing the first value
+      inbuf += firstBit / 8;
+      inbufSize -= firstBit / 8;
+      firstBit %= 8;
+
+      if ( raw64_ != nullptr )
+      {
+         uint64_t raw[cBlockSize];
+
+         for ( size_t done = 0; done < count; done += cBlockSize )
+         {
+            const size_t n = std::min( cBlockSize, count - done );
+            const size_t bit = firstBit + done * bitsPerRecord_;
+
+            raw64_( inbuf + bit / 8, inbufSize - bit / 8, bit % 8, n, raw );
+            addMinimum( raw, n, minimum, out + done );
+         }
+
+         return;
+      }
+
+      uint32_t raw[cBlockSize];
+
+      for ( size_t done = 0; done < count; done += cBlockSize )
+      {
+         const size_t n = std::min( cBlockSize, count - done );
+         const size_t bit = firstBit + done * bitsPerRecord_;
+
+         raw32_( inbuf + bit / 8, inbufSize - bit / 8, bit % 8, n, raw );
+         addMinimum( raw, n, minimum, out + done );
+      }
+   }
+
+   template void BitUnpacker::unpack( const char *, size_t, size_t, int64_t, size_t,
+                                      int8_t * ) const;
+   template void BitUnpacker::unpack( const char *, size_t, size_t, int64_t, size_t,
+                                      uint8_t * ) const;
+   template void BitUnpacker::unpack( const char *, size_t, size_t, int64_t, size_t,
+                                      int16_t * ) const;
+   template void BitUnpacker::unpack( const char *, size_t, size_t, int64_t, size_t,
+                                      uint16_t * ) const;
+   template void BitUnpacker::unpack( const char *, size_t, size_t, int64_t, size_t,
+                                      int32_t * ) const;
+   template void BitUnpacker::unpack( const char *, size_t, size_t, int64_t, size_t,
+                                      uint32_t * ) const;
+   template void BitUnpacker::unpack( const char *, size_t, size_t, int64_t, size_t,
+                                      int64_t * ) const;
+
+   BitPacker::BitPacker( unsigned bitsPerRecord ) : bitsPerRecord_( bitsPerRecord )
+   {
+      static const auto sPack32Functions = pack32Functions( std::make_index_sequence<33>{} );
+      static const auto sPack64Functions = pack64Functions( std::make_index_sequence<65>{} );
+
+      if ( bitsPerRecord < sPack32Functions.size() )
+      {
+         pack32_ = sPack32Functions[bitsPerRecord];
+      }
+
+      pack64_ = sPack64Functions.at( bitsPerRecord );
+   }
+
+   void BitPacker::pack( const uint32_t *raw, size_t count, size_t firstBit, char *out ) const
+   {
+      if ( pack32_ == nullptr )
+      {
+         // 32 bit values in a wider field
+         for ( size_t done = 0; done < count; done += cBlockSize )
+         {
+            const size_t n = std::min( cBlockSize, count - done );
+
+            uint64_t wide[cBlockSize];
+            std::copy_n( raw + done, n, wide );
+
+            pack64_( wide, n, firstBit + done * bitsPerRecord_, out );
+         }
+
+         return;
+      }
+
+      pack32_( raw, count, firstBit, out );
+   }
+
+   void BitPacker::pack( const uint64_t *raw, size_t count, size_t firstBit, char *out ) const
+   {
+      pack64_( raw, count, firstBit, out );
+   }
+
+   template <typename T>
+   void unpackBits( const char *inbuf, size_t inbufSize, size_t firstBit, unsigned bitsPerRecord,
+                    int64_t minimum, size_t count, T *out )
+   {
+      BitUnpacker( bitsPerRecord ).unpack( inbuf, inbufSize, firstBit, minimum, count, out );
+   }
+
+   template void unpackBits( const char *, size_t, size_t, unsigned, int64_t, size_t, int8_t * );
+   template void unpackBits( const char *, size_t, size_t, unsigned, int64_t, size_t, uint8_t * );
+   template void unpackBits( const char *, size_t, size_t, unsigned, int64_t, size_t, int16_t * );
+   template void unpackBits( const char *, size_t, size_t, unsigned, int64_t, size_t,
+                             uint16_t * );
+   template void unpackBits( const char *, size_t, size_t, unsigned, int64_t, size_t, int32_t * );
+   template void unpackBits( const char *, size_t, size_t, unsigned, int64_t, size_t,
+                             uint32_t * );
+   template void unpackBits( const char *, size_t, size_t, unsigned, int64_t, size_t, int64_t * );
+
+   void packBits( const uint32_t *raw, size_t count, unsigned bitsPerRecord, size_t firstBit,
+                  char *out )
+   {
+      BitPacker( bitsPerRecord ).pack( raw, count, firstBit, out );
+   }
+
+   void packBits( const uint64_t *raw, size_t count, unsigned bitsPerRecord, size_t firstBit,
+                  char *out )
+   {
+      BitPacker( bitsPerRecord ).pack( raw, count, firstBit, out );
+   }
+
+   void copyBits( const char *in, size_t inFirstBit, char *out, size_t outFirstBit,
+                  size_t bitCount )
+   {
+      if ( bitCount == 0 )
+      {
+         return;
+      }
+
+      const auto *src = reinterpret_cast<const uint8_t *>( in ) + inFirstBit / 8;
+      auto *dst = reinterpret_cast<uint8_t *>( out ) + outFirstBit / 8;
+      const unsigned inShift = inFirstBit % 8;
+      const unsigned outShift = outFirstBit % 8;
+
+      // Up to 8 bits from bit @a bit (counted from inShift) of src, without reading past the
+      // byte holding the last one
+      const auto readBits = [src, inShift]( size_t bit, unsigned count ) {
+         const size_t position = inShift + bit;
+         const unsigned shift = position % 8;
+         unsigned value = src[position / 8] >> shift;
+
+         if ( shift + count > 8 )
+         {
+            value |= static_cast<unsigned>( src[position / 8 + 1] ) << ( 8 - shift );
+         }
+
+         return value & ( ( 1U << count ) - 1 );
+      };
+
+      // The first byte of out keeps its bits before outShift
+      const auto head = static_cast<unsigned>( std::min<size_t>( 8 - outShift, bitCount ) );
+
+      dst[0] = static_cast<uint8_t>( ( dst[0] & ( ( 1U << outShift ) - 1 ) ) |
+                                     ( readBits( 0, head ) << outShift ) );
+
+      size_t done = head;
+      size_t j = 1;
+
+      if ( ( inShift + done ) % 8 == 0 )
+      {
+         const size_t bytes = ( bitCount - done ) / 8;
+
+         memcpy( dst + j, src + ( inShift + done ) / 8, bytes );
+
+         j += bytes;
+         done += 8 * bytes;
+      }
+      else
+      {
+         for ( ; bitCount - done >= 8; done += 8, ++j )
+         {
+            dst[j] = static_cast<uint8_t>( readBits( done, 8 ) );
+         }
+      }
+
+      if ( done < bitCount )
+      {
+         const auto tail = static_cast<unsigned>( bitCount - done );
+
+         dst[j] = static_cast<uint8_t>( readBits( done, tail ) );
+      }
+   }
+
+   template <typename T>
+   void scaleValues( const int64_t *raw, size_t count, double scale, double offset,
+                     double origin, T *out )
+   {
+      const ScaleFunction<T> scaleFunction = typedKernels<T>().scale;
+
+      size_t i = 0;
+
+      if ( scaleFunction != nullptr )
+      {
+         i = scaleFunction( raw, count, scale, offset, origin, out );
+      }
+
+      for ( ; i < count; ++i )
+      {
+         out[i] = static_cast<T>( static_cast<double>( raw[i] ) * scale + offset - origin );
+      }
+   }
+
+   template void scaleValues( const int64_t *, size_t, double, double, double, float * );
+   template void scaleValues( const int64_t *, size_t, double, double, double, double * );
+
+   size_t scaleValues( const int64_t *raw, size_t count, double scale, double offset,
+                       double origin, Float16 *out )
+   {
+      // Scale a block at a time into doubles with the kernels, then round each to half
+      // precision while the block is still in L1 cache
+      double scaled[cBlockSize];
+
+      for ( size_t done = 0; done < count; done += cBlockSize )
+      {
+         const size_t blockCount = std::min( count - done, cBlockSize );
+
+         scaleValues( raw + done, blockCount, scale, offset, origin, scaled );
+
+         for ( size_t i = 0; i < blockCount; ++i )
+         {
+            if ( std::fabs( scaled[i] ) > Float16::maximum() )
+            {
+               return done + i;
+            }
+
+            out[done + i].bits = halfFromDouble( scaled[i] );
+         }
+      }
+
+      return count;
+   }
+
+   uint16_t toFloat16Bits( double value )
+   {
+      return halfFromDouble( value );
+   }
+
+   double fromFloat16Bits( uint16_t bits )
+   {
+      return doubleFromHalf( bits );
+   }
+
+   size_t unscaleValues( const double *in, size_t count, double scale, double offset,
+                         int64_t *raw )
+   {
+      const UnscaleFunction unscaleFunction = kernels().unscale;
+
+      size_t i = 0;
+
+      if ( unscaleFunction != nullptr )
+      {
+         i = unscaleFunction( in, count, scale, offset, raw );
+      }
+
+      for ( ; i < count; ++i )
+      {
+         const double value = std::floor( ( in[i] - offset ) / scale + 0.5 );
+
+         if ( !( std::fabs( value ) < cExactIntLimit ) )
+         {
+            break;
+         }
+
+         raw[i] = static_cast<int64_t>( value );
+      }
+
+      return i;
+   }
+
+   template <typename T>
+   void transformPoints( const double *matrix, size_t count, size_t stride, T *x, T *y, T *z )
+   {
+      const TransformFunction<T> transformFunction = typedKernels<T>().transform;
+
+      size_t i = 0;
+
+      if ( ( stride == sizeof( T ) ) && ( transformFunction != nullptr ) )
+      {
+         i = transformFunction( matrix, count, x, y, z );
+      }
+
+      auto *xBytes = reinterpret_cast<char *>( x );
+      auto *yBytes = reinterpret_cast<char *>( y );
+      auto *zBytes = reinterpret_cast<char *>( z );
+
+      for ( ; i < count; ++i )
+      {
+         T *px = reinterpret_cast<T *>( xBytes + i * stride );
+         T *py = reinterpret_cast<T *>( yBytes + i * stride );
+         T *pz = reinterpret_cast<T *>( zBytes + i * stride );
+
+         const double vx = *px;
+         const double vy = *py;
+         const double vz = *pz;
+
+         *px = static_cast<T>( ( matrix[0] * vx + matrix[1] * vy ) + matrix[2] * vz + matrix[3] );
+         *py = static_cast<T>( ( matrix[4] * vx + matrix[5] * vy ) + matrix[6] * vz + matrix[7] );
+         *pz =
+            static_cast<T>( ( matrix[8] * vx + matrix[9] * vy ) + matrix[10] * vz + matrix[11] );
+      }
+   }
+
+   template void transformPoints( const double *, size_t, size_t, float *, float *, float * );
+   template void transformPoints( const double *, size_t, size_t, double *, double *, double * );
+
+   template <typename T>
+   void sphericalToCartesian( size_t count, size_t stride, T *range, T *azimuth, T *elevation )
+   {
+      const SphericalFunction<T> sphericalFunction = typedKernels<T>().spherical;
+
+      size_t i = 0;
+
+      if ( ( stride == sizeof( T ) ) && ( sphericalFunction != nullptr ) )
+      {
+         i = sphericalFunction( count, range, azimuth, elevation );
+      }
+
+      auto *rangeBytes = reinterpret_cast<char *>( range );
+      auto *azimuthBytes = reinterpret_cast<char *>( azimuth );
+      auto *elevationBytes = reinterpret_cast<char *>( elevation );
+
+      for ( ; i < count; ++i )
+      {
+         sphericalToCartesianScalar( reinterpret_cast<T *>( rangeBytes + i * stride ),
+                                     reinterpret_cast<T *>( azimuthBytes + i * stride ),
+                                     reinterpret_cast<T *>( elevationBytes + i * stride ) );
+      }
+   }
+
+   template void sphericalToCartesian( size_t, size_t, float *, float *, float * );
+   template void sphericalToCartesian( size_t, size_t, double *, double *, double * );
+
+   bool useKernelInstructions( KernelInstructions instructions )
+   {
+      if ( !hasInstructions( instructions ) )
+      {
+         return false;
+      }
+
+      kernels() = selectKernels( instructions );
+
+      return true;
+   }
+}
@@ -0,0 +1,187 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstddef>
+#include <cstdint>
+
+namespace e57
+{
+   struct Float16;
+
+   /// Unpack @a count values of @a bitsPerRecord bits each from @a inbuf, add @a minimum to each,
+   /// and store them in @a out.
+   ///
+   /// Values are packed least significant bit first (as in E57 bytestreams), starting at bit
+   /// @a firstBit of inbuf. No more than @a inbufSize bytes of inbuf are read, so it must hold
+   /// at least every bit of the values.
+   ///
+   /// The addition wraps the same way as it does when decoding one value at a time, and the
+   /// caller is responsible for making sure every possible result fits in T.
+   ///
+   /// The common widths are unpacked with SSE 4.1, AVX2, or NEON if the CPU has them. Which
+   /// functions are used is decided once, the first time any of these kernels is called (see
+   /// useKernelInstructions()).
+   template <typename T>
+   void unpackBits( const char *inbuf, size_t inbufSize, size_t firstBit, unsigned bitsPerRecord,
+                    int64_t minimum, size_t count, T *out );
+
+   /// Pack the low @a bitsPerRecord bits of each of @a count raw values into @a out, least
+   /// significant bit first, starting at bit @a firstBit.
+   ///
+   /// Raw values must already have the field's minimum subtracted, and must fit in bitsPerRecord
+   /// bits. Use the uint32_t version for widths up to 32 bits, and the uint64_t one for wider
+   /// ones.
+   ///
+   /// Bits of out before firstBit are kept. Bits after the last value in its final byte are
+   /// zero, and up to 16 bytes after that may be overwritten, so out must have room for them.
+   ///
+   /// 8, 12, 16, and 32 bit values starting on a byte boundary use SSE 4.1 or NEON if the CPU
+   /// has them.
+   void packBits( const uint32_t *raw, size_t count, unsigned bitsPerRecord, size_t firstBit,
+                  char *out );
+   void packBits( const uint64_t *raw, size_t count, unsigned bitsPerRecord, size_t firstBit,
+                  char *out );
+
+   /// Copy @a bitCount bits, starting at bit @a inFirstBit of @a in, to @a out starting at bit
+   /// @a outFirstBit, for values which are already packed the way they are stored (e.g. the one
+   /// bit flags of a PackedBits buffer).
+   ///
+   /// As with packBits(), bits of out before outFirstBit are kept and bits after the last one in
+   /// its final byte are zero, but nothing after that byte is written. No byte of in after the
+   /// one holding the last bit is read. When both start at the same bit of a byte, the whole
+   /// bytes between them are copied with memcpy().
+   void copyBits( const char *in, size_t inFirstBit, char *out, size_t outFirstBit,
+                  size_t bitCount );
+
+   /// Unpacks values of one width, like unpackBits(). The functions for the width are looked up
+   /// once, when the unpacker is made, instead of on every call.
+   ///
+   /// The scalar code is instantiated for every width from 0 to 64 bits, so its shifts and masks
+   /// are constants. Eight values always fill a whole number of bytes, so they are unpacked eight
+   /// at a time with the same unrolled code for each group.
+   class BitUnpacker
+   {
+   public:
+      explicit BitUnpacker( unsigned bitsPerRecord = 0 );
+
+      /// Unpack @a count values with @a minimum added to each, as unpackBits() does
+      template <typename T>
+      void unpack( const char *inbuf, size_t inbufSize, size_t firstBit, int64_t minimum,
+                   size_t count, T *out ) const;
+
+      unsigned bitsPerRecord() const
+      {
+         return bitsPerRecord_;
+      }
+
+      /// Unpack @a count raw values starting at bit @a firstBit (less than 8) of @a inbuf
+      using Raw32Function = void ( * )( const char *inbuf, size_t inbufSize, size_t firstBit,
+                                        size_t count, uint32_t *raw );
+      using Raw64Function = void ( * )( const char *inbuf, size_t inbufSize, size_t firstBit,
+                                        size_t count, uint64_t *raw );
+
+   private:
+      unsigned bitsPerRecord_;
+
+      // Only one of these is set: raw32_ for widths up to 32 bits, raw64_ for wider ones
+      Raw32Function raw32_ = nullptr;
+      Raw64Function raw64_ = nullptr;
+   };
+
+   /// Packs values of one width, like packBits(), with the functions for the width looked up
+   /// once when the packer is made. As with BitUnpacker, the scalar code is instantiated for
+   /// every width.
+   class BitPacker
+   {
+   public:
+      explicit BitPacker( unsigned bitsPerRecord = 0 );
+
+      /// Pack @a count raw values as packBits() does
+      void pack( const uint32_t *raw, size_t count, size_t firstBit, char *out ) const;
+      void pack( const uint64_t *raw, size_t count, size_t firstBit, char *out ) const;
+
+      unsigned bitsPerRecord() const
+      {
+         return bitsPerRecord_;
+      }
+
+      using Pack32Function = void ( * )( const uint32_t *raw, size_t count, size_t firstBit,
+                                         char *out );
+      using Pack64Function = void ( * )( const uint64_t *raw, size_t count, size_t firstBit,
+                                         char *out );
+
+   private:
+      unsigned bitsPerRecord_;
+      Pack32Function pack32_ = nullptr;
+      Pack64Function pack64_ = nullptr;
+   };
+
+   /// Store @a raw[i] * @a scale + @a offset - @a origin in @a out[i] for each of @a count
+   /// values, as a ScaledInteger's raw values are scaled when reading (see
+   /// SourceDestBuffer::setOrigin()). T is double or float.
+   ///
+   /// The multiply, add, and subtract are separate double precision operations, as when scaling
+   /// one value at a time, and every int64_t is converted to the nearest double. Float results
+   /// are only rounded when they are stored. Uses SSE 4.1, AVX2, or NEON if the CPU has them.
+   template <typename T>
+   void scaleValues( const int64_t *raw, size_t count, double scale, double offset,
+                     double origin, T *out );
+
+   /// The Float16 version of scaleValues(). Stops at the first result which is larger than
+   /// Float16::maximum() in magnitude, and returns the number of values stored before it, so
+   /// the caller can report it.
+   size_t scaleValues( const int64_t *raw, size_t count, double scale, double offset,
+                       double origin, Float16 *out );
+
+   /// The bits of the half precision value nearest to @a value (ties to even), and the value of
+   /// half precision @a bits (see Float16)
+   uint16_t toFloat16Bits( double value );
+   double fromFloat16Bits( uint16_t bits );
+
+   /// Store floor( ( @a in[i] - @a offset ) / @a scale + 0.5 ) in @a raw[i] for each of @a count
+   /// values, as a ScaledInteger's values are unscaled when writing.
+   ///
+   /// Stops at the first result which is NaN or not less than 2^51 in magnitude, and returns the
+   /// number of values converted before it. The caller should convert the rest itself so it can
+   /// check and report them. Uses SSE 4.1, AVX2, or NEON if the CPU has them.
+   size_t unscaleValues( const double *in, size_t count, double scale, double offset,
+                         int64_t *raw );
+
+   /// Replace each of @a count points ( @a x[i], @a y[i], @a z[i] ) by the row-major 3×4 affine
+   /// @a matrix times ( x, y, z, 1 ). Each point is @a stride bytes after the one before it in
+   /// x, y, and z.
+   ///
+   /// Points are transformed in double precision, as ( m0 x + m1 y ) + m2 z + m3 for each row,
+   /// with separate multiplies and adds. Contiguous points (stride is sizeof( T )) use SSE 4.1,
+   /// AVX2, or NEON if the CPU has them.
+   template <typename T>
+   void transformPoints( const double *matrix, size_t count, size_t stride, T *x, T *y, T *z );
+
+   /// Replace each of @a count points ( @a range[i], @a azimuth[i], @a elevation[i] ) (in
+   /// radians) by its cartesian coordinates ( x, y, z ), with x in range, y in azimuth, and z in
+   /// elevation. Each point is @a stride bytes after the one before it.
+   ///
+   /// Points are converted in double precision. Angles smaller than 2^28 in magnitude use a
+   /// polynomial sin() and cos() (within 2 ulps of std::sin() and std::cos()), with SSE 4.1,
+   /// AVX2, or NEON if the CPU has them and the points are contiguous. The results are the same
+   /// whichever is used.
+   template <typename T>
+   void sphericalToCartesian( size_t count, size_t stride, T *range, T *azimuth, T *elevation );
+
+   /// The instructions the kernels above may use, besides the scalar code
+   enum class KernelInstructions
+   {
+      None,  ///< Only the scalar code
+      SSE41, ///< SSE 4.1
+      AVX2,  ///< AVX2, and SSE 4.1 where there is no AVX2 version
+      NEON,  ///< NEON
+      Best,  ///< Whatever the CPU has (the default)
+   };
+
+   /// Limit the kernels above to @a instructions, so tests can check each version gives the
+   /// same results. Returns false, and changes nothing, if the CPU doesn't have them.
+   ///
+   /// This is not thread safe: nothing may be using the kernels while it is called.
+   bool useKernelInstructions( KernelInstructions instructions );
+}
@@ -227,6 +227,9 @@ Since @a buf is a byte buffer, byte ordering is irrelevant (it will come out in
 it went in). There is no constraint on the ordering of reads. Any part of the Blob data can be read
 zero or more times.
 
+On an ImageFile opened for reading, blobs may be read on several threads at the same time, along
+with any CompressedVectorReaders of the file.
+
 @pre The destination ImageFile must be open (i.e. destImageFile().isOpen()).
 @pre buf != NULL
 @pre 0 <= @a start < byteCount()
@@ -247,6 +250,34 @@ void BlobNode::read( uint8_t *buf, int64_t start, size_t count )
    impl_->read( buf, start, count );
 }
 
+/*!
+@brief Read a buffer of bytes from a blob on several threads.
+
+@param [in] buf A memory buffer to store bytes read from the blob.
+@param [in] start The index of the first byte in blob to read.
+@param [in] count The number of bytes to read.
+@param [in] threadCount The number of threads to read with.
+
+@details
+Like BlobNode::read(uint8_t*, int64_t, size_t), but the pages of large reads are read and their
+checksums checked on up to @a threadCount threads. This only helps large images and other big
+blobs. The pages are only read in parallel from an ImageFile opened for reading; otherwise they are
+read on the calling thread.
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorSeekFailed
+@throw ::ErrorReadFailed
+@throw ::ErrorBadChecksum
+@throw ::ErrorInternal All objects in undocumented state
+
+@see BlobNode::read(uint8_t*, int64_t, size_t)
+*/
+void BlobNode::read( uint8_t *buf, int64_t start, size_t count, unsigned threadCount )
+{
+   impl_->read( buf, start, count, threadCount );
+}
+
 /*!
 @brief Write a buffer of bytes to a blob.
 
@@ -293,6 +324,141 @@ void BlobNode::write( uint8_t *buf, int64_t start, size_t count )
    impl_->write( buf, start, count );
 }
 
+/*!
+@brief Write a buffer of bytes to a blob, checksumming on several threads.
+
+@param [in] buf A memory buffer of bytes to write to the blob.
+@param [in] start The index of the first byte in blob to write to.
+@param [in] count The number of bytes to write.
+@param [in] threadCount The number of threads to prepare the pages with.
+
+@details
+Like BlobNode::write(uint8_t*, int64_t, size_t), but the pages of large writes are filled and their
+checksums calculated on up to @a threadCount threads. The pages are still written to the file in
+order from the calling thread.
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorFileReadOnly
+@throw ::ErrorNodeUnattached
+@throw ::ErrorSeekFailed
+@throw ::ErrorReadFailed
+@throw ::ErrorWriteFailed
+@throw ::ErrorBadChecksum
+@throw ::ErrorInternal All objects in undocumented state
+
+@see BlobNode::write(uint8_t*, int64_t, size_t)
+*/
+void BlobNode::write( uint8_t *buf, int64_t start, size_t count, unsigned threadCount )
+{
+   impl_->write( buf, start, count, threadCount );
+}
+
+/*!
+@brief Write bytes given by a callback to a blob.
+
+@param [in] source Called for the bytes to write, in order.
+@param [in] start The index of the first byte in blob to write to.
+@param [in] count The number of bytes to write.
+@param [in] threadCount The number of threads to prepare the pages with.
+
+@details
+Writes the same bytes as BlobNode::write(uint8_t*, int64_t, size_t) would, but takes them from
+@a source about a megabyte at a time, so an image which is being encoded or read from somewhere
+else never has to be in memory all at once. @a source is called until it has given @a count bytes;
+it is an error for it to return 0 before then, or more bytes than it was asked for.
+
+@pre @a source is not empty
+@pre The same as BlobNode::write(uint8_t*, int64_t, size_t)
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorFileReadOnly
+@throw ::ErrorNodeUnattached
+@throw ::ErrorSeekFailed
+@throw ::ErrorReadFailed
+@throw ::ErrorWriteFailed
+@throw ::ErrorBadChecksum
+@throw ::ErrorInternal All objects in undocumented state
+
+@see BlobNode::write(uint8_t*, int64_t, size_t), BlobSource
+*/
+void BlobNode::write( const BlobSource &source, int64_t start, size_t count, unsigned threadCount )
+{
+   impl_->write( source, start, count, threadCount );
+}
+
+/*!
+@brief Write the contents of a file to a blob.
+
+@param [in] fileName The file whose bytes to write.
+@param [in] start The index of the first byte in blob to write to.
+@param [in] threadCount The number of threads to read the file and prepare the pages with.
+
+@details
+Writes the same bytes as reading the whole file into memory and calling
+BlobNode::write(uint8_t*, int64_t, size_t) would, but the file is read straight into the pages
+written to the ImageFile in large blocks, so its bytes are only copied once. Use this to embed
+images which are already in files, such as JPEGs from a camera.
+
+@pre The blob must have room for the whole file after @a start.
+@pre The same as BlobNode::write(uint8_t*, int64_t, size_t)
+
+@return The number of bytes written (the size of the file).
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorFileReadOnly
+@throw ::ErrorNodeUnattached
+@throw ::ErrorOpenFailed
+@throw ::ErrorSeekFailed
+@throw ::ErrorReadFailed
+@throw ::ErrorWriteFailed
+@throw ::ErrorBadChecksum
+@throw ::ErrorInternal All objects in undocumented state
+
+@see BlobNode::write(uint8_t*, int64_t, size_t)
+*/
+int64_t BlobNode::importFile( const ustring &fileName, int64_t start, unsigned threadCount )
+{
+   return impl_->importFile( fileName, start, threadCount );
+}
+
+/*!
+@brief Write part of an open file to a blob.
+
+@param [in] fd An open file descriptor to read from.
+@param [in] fileOffset The offset in the file of the first byte to write.
+@param [in] start The index of the first byte in blob to write to.
+@param [in] count The number of bytes to write.
+@param [in] threadCount The number of threads to read the file and prepare the pages with.
+
+@details
+Like BlobNode::importFile(const ustring &, int64_t, unsigned), but reads @a count bytes starting
+at @a fileOffset of a file which is already open. The file is read with positional reads, so its
+position is not used or changed. @a fd stays open.
+
+@pre @a fd is open for reading and has @a count bytes after @a fileOffset.
+@pre The same as BlobNode::write(uint8_t*, int64_t, size_t)
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorFileReadOnly
+@throw ::ErrorNodeUnattached
+@throw ::ErrorSeekFailed
+@throw ::ErrorReadFailed
+@throw ::ErrorWriteFailed
+@throw ::ErrorBadChecksum
+@throw ::ErrorInternal All objects in undocumented state
+
+@see BlobNode::importFile(const ustring &, int64_t, unsigned)
+*/
+void BlobNode::importFile( int fd, int64_t fileOffset, int64_t start, size_t count,
+                           unsigned threadCount )
+{
+   impl_->importFile( fd, fileOffset, start, count, threadCount );
+}
+
 /*!
 @brief Diagnostic function to print internal state of object to output stream in an indented format.
 @copydetails Node::dump()
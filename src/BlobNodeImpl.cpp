@@ -25,11 +25,15 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
+
 #include "BlobNodeImpl.h"
 #include "CheckedFile.h"
 #include "ImageFileImpl.h"
+#include "ReadSource.h"
 #include "SectionHeaders.h"
 #include "StringFunctions.h"
+#include "WorkerPool.h"
 
 namespace e57
 {
@@ -121,7 +125,7 @@ namespace e57
       return ( blobLogicalLength_ );
    }
 
-   void BlobNodeImpl::read( uint8_t *buf, int64_t start, size_t count )
+   void BlobNodeImpl::read( uint8_t *buf, int64_t start, size_t count, unsigned threadCount )
    {
       //??? check start not negative
 
@@ -134,13 +138,143 @@ namespace e57
                                   " length=" + toString( blobLogicalLength_ ) );
       }
 
+      // Read without moving the file position so blobs of a file opened for reading can be read
+      // on several threads at once
+      ImageFileImplSharedPtr imf( destImageFile_ );
+      const uint64_t logicalOffset =
+         binarySectionLogicalStart_ + sizeof( BlobSectionHeader ) + start;
+
+      if ( threadCount > 1 )
+      {
+         WorkerPool workers( threadCount, imf->executor() );
+
+         imf->file_->readAt( logicalOffset, reinterpret_cast<char *>( buf ), count, workers );
+      }
+      else
+      {
+         imf->file_->readAt( logicalOffset, reinterpret_cast<char *>( buf ), count );
+      }
+   }
+
+   void BlobNodeImpl::write( uint8_t *buf, int64_t start, size_t count, unsigned threadCount )
+   {
+      checkWritable( start, count );
+
       ImageFileImplSharedPtr imf( destImageFile_ );
       imf->file_->seek( binarySectionLogicalStart_ + sizeof( BlobSectionHeader ) + start );
-      imf->file_->read( reinterpret_cast<char *>( buf ),
-                        static_cast<size_t>( count ) ); //??? arg1 void* ?
+
+      if ( threadCount > 1 )
+      {
+         WorkerPool workers( threadCount, imf->executor() );
+
+         imf->file_->write( reinterpret_cast<char *>( buf ), count, &workers );
+      }
+      else
+      {
+         imf->file_->write( reinterpret_cast<char *>( buf ),
+                            static_cast<size_t>( count ) ); //??? arg1 void* ?
+      }
    }
 
-   void BlobNodeImpl::write( uint8_t *buf, int64_t start, size_t count )
+   void BlobNodeImpl::write( const BlobSource &source, int64_t start, size_t count,
+                             unsigned threadCount )
+   {
+      // Bytes taken from the source at a time
+      constexpr size_t cBlockSize = 1024 * CheckedFile::logicalPageSize;
+
+      checkWritable( start, count );
+
+      if ( !source )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "this->pathName=" + this->pathName() );
+      }
+
+      ImageFileImplSharedPtr imf( destImageFile_ );
+
+      std::unique_ptr<WorkerPool> workers;
+
+      if ( threadCount > 1 )
+      {
+         workers.reset( new WorkerPool( threadCount, imf->executor() ) );
+      }
+
+      uint64_t logicalOffset = binarySectionLogicalStart_ + sizeof( BlobSectionHeader ) + start;
+
+      // Only the first block may start partway through a page, so only the first and last pages
+      // of what is written have to be read back and merged
+      std::vector<uint8_t> block( std::min( count, cBlockSize ) );
+      size_t blockSize =
+         std::min( count, cBlockSize - logicalOffset % CheckedFile::logicalPageSize );
+
+      while ( count > 0 )
+      {
+         size_t filled = 0;
+
+         while ( filled < blockSize )
+         {
+            const size_t got = source( block.data() + filled, blockSize - filled );
+
+            if ( ( got == 0 ) || ( got > blockSize - filled ) )
+            {
+               throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                                     "this->pathName=" + this->pathName() + " got=" +
+                                        toString( got ) + " remaining=" +
+                                        toString( count - filled ) );
+            }
+
+            filled += got;
+         }
+
+         // The source may have used the file, so don't count on its position
+         imf->file_->seek( logicalOffset );
+         imf->file_->write( reinterpret_cast<char *>( block.data() ), blockSize, workers.get() );
+
+         logicalOffset += blockSize;
+         count -= blockSize;
+         blockSize = std::min( count, cBlockSize );
+      }
+   }
+
+   int64_t BlobNodeImpl::importFile( const ustring &fileName, int64_t start,
+                                     unsigned threadCount )
+   {
+      ReadOnlyFile file( fileName );
+
+      const auto count = static_cast<size_t>( file.size() );
+
+      importFile( file.fd(), 0, start, count, threadCount, fileName );
+
+      return static_cast<int64_t>( count );
+   }
+
+   void BlobNodeImpl::importFile( int fd, int64_t fileOffset, int64_t start, size_t count,
+                                  unsigned threadCount, const ustring &sourceName )
+   {
+      checkWritable( start, count );
+
+      if ( ( fd < 0 ) || ( fileOffset < 0 ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "this->pathName=" + this->pathName() +
+                                                       " fd=" + toString( fd ) +
+                                                       " fileOffset=" + toString( fileOffset ) );
+      }
+
+      ImageFileImplSharedPtr imf( destImageFile_ );
+      imf->file_->seek( binarySectionLogicalStart_ + sizeof( BlobSectionHeader ) + start );
+
+      std::unique_ptr<WorkerPool> workers;
+
+      if ( threadCount > 1 )
+      {
+         workers.reset( new WorkerPool( threadCount, imf->executor() ) );
+      }
+
+      imf->file_->writeFromFile( fd, static_cast<uint64_t>( fileOffset ), count,
+                                 sourceName.empty() ? "fd=" + toString( fd ) : sourceName,
+                                 workers.get() );
+   }
+
+   void BlobNodeImpl::checkWritable( int64_t start, size_t count )
    {
       //??? check start not negative
       checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
@@ -163,11 +297,6 @@ namespace e57
                                   " start=" + toString( start ) + " count=" + toString( count ) +
                                   " length=" + toString( blobLogicalLength_ ) );
       }
-
-      ImageFileImplSharedPtr imf( destImageFile_ );
-      imf->file_->seek( binarySectionLogicalStart_ + sizeof( BlobSectionHeader ) + start );
-      imf->file_->write( reinterpret_cast<char *>( buf ),
-                         static_cast<size_t>( count ) ); //??? arg1 void* ?
    }
 
    void BlobNodeImpl::checkLeavesInSet( const StringSet &pathNames, NodeImplSharedPtr origin )
@@ -194,7 +323,7 @@ namespace e57
       }
       else
       {
-         fieldName = elementName_;
+         fieldName = elementNameRef();
       }
 
       //??? need to implement
@@ -46,8 +46,12 @@ namespace e57
       bool isDefined( const ustring &pathName ) override;
 
       int64_t byteCount();
-      void read( uint8_t *buf, int64_t start, size_t count );
-      void write( uint8_t *buf, int64_t start, size_t count );
+      void read( uint8_t *buf, int64_t start, size_t count, unsigned threadCount = 1 );
+      void write( uint8_t *buf, int64_t start, size_t count, unsigned threadCount = 1 );
+      void write( const BlobSource &source, int64_t start, size_t count, unsigned threadCount );
+      int64_t importFile( const ustring &fileName, int64_t start, unsigned threadCount );
+      void importFile( int fd, int64_t fileOffset, int64_t start, size_t count,
+                       unsigned threadCount, const ustring &sourceName = "" );
 
       void checkLeavesInSet( const StringSet &pathNames, NodeImplSharedPtr origin ) override;
 
@@ -59,6 +63,9 @@ namespace e57
 #endif
 
    private:
+      /// Throw unless @a count bytes from @a start can be written now
+      void checkWritable( int64_t start, size_t count );
+
       uint64_t blobLogicalLength_;
       uint64_t binarySectionLogicalStart_;
       uint64_t binarySectionLogicalLength_;
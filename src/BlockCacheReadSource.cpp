@@ -0,0 +1,288 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+
+#include "CheckedFile.h"
+#include "Common.h"
+#include "StringFunctions.h"
+
+namespace e57
+{
+   // These extra definitions are required in C++11.
+   // In C++17, "static constexpr" is implicitly inline, so these are not required.
+   constexpr size_t BlockCacheReadSource::cDefaultBlockSize;
+   constexpr size_t BlockCacheReadSource::cDefaultMaxBlockCount;
+
+   class BlockCacheReadSourceImpl
+   {
+   public:
+      using Block = std::shared_ptr<const std::vector<char>>;
+
+      BlockCacheReadSourceImpl( const std::shared_ptr<ReadSource> &source, size_t blockSize,
+                                size_t maxBlockCount ) :
+         source_( source ), blockSize_( blockSize ), maxBlockCount_( maxBlockCount ),
+         size_( source->size() )
+      {
+      }
+
+      ustring name() const
+      {
+         return source_->name();
+      }
+
+      uint64_t size() const
+      {
+         return size_;
+      }
+
+      uint64_t fetchCount() const
+      {
+         return fetchCount_;
+      }
+
+      uint64_t bytesFetched() const
+      {
+         return bytesFetched_;
+      }
+
+      void readRanges( const std::vector<ReadSource::Range> &ranges );
+
+   private:
+      void fetchRuns( const std::vector<uint64_t> &missing, std::map<uint64_t, Block> &blocks );
+      void insert( uint64_t index, const Block &block );
+
+      const std::shared_ptr<ReadSource> source_;
+      const size_t blockSize_;
+      const size_t maxBlockCount_;
+      const uint64_t size_;
+
+      std::atomic<uint64_t> fetchCount_{ 0 };
+      std::atomic<uint64_t> bytesFetched_{ 0 };
+
+      // The cached blocks by index, and their indices from most to least recently used
+      std::mutex mutex_;
+      std::list<uint64_t> lru_;
+      std::unordered_map<uint64_t, std::pair<Block, std::list<uint64_t>::iterator>> blocks_;
+   };
+
+   void BlockCacheReadSourceImpl::readRanges( const std::vector<ReadSource::Range> &ranges )
+   {
+      // The blocks needed for all of the ranges, holding on to them so they can be copied from
+      // without the lock even if they are evicted
+      std::map<uint64_t, Block> blocks;
+
+      for ( const auto &range : ranges )
+      {
+         if ( ( range.offset > size_ ) || ( range.count > size_ - range.offset ) )
+         {
+            throw E57_EXCEPTION2( ErrorReadFailed, "name=" + name() +
+                                                      " offset=" + toString( range.offset ) +
+                                                      " count=" + toString( range.count ) +
+                                                      " size=" + toString( size_ ) );
+         }
+
+         if ( range.count == 0 )
+         {
+            continue;
+         }
+
+         const uint64_t first = range.offset / blockSize_;
+         const uint64_t last = ( range.offset + range.count - 1 ) / blockSize_;
+
+         for ( uint64_t index = first; index <= last; ++index )
+         {
+            blocks.emplace( index, nullptr );
+         }
+      }
+
+      std::vector<uint64_t> missing;
+      {
+         std::lock_guard<std::mutex> lock( mutex_ );
+
+         for ( auto &block : blocks )
+         {
+            const auto found = blocks_.find( block.first );
+
+            if ( found == blocks_.end() )
+            {
+               missing.push_back( block.first );
+               continue;
+            }
+
+            block.second = found->second.first;
+
+            lru_.splice( lru_.begin(), lru_, found->second.second );
+         }
+      }
+
+      if ( !missing.empty() )
+      {
+         fetchRuns( missing, blocks );
+      }
+
+      for ( const auto &range : ranges )
+      {
+         uint64_t offset = range.offset;
+         char *buffer = range.buffer;
+         size_t count = range.count;
+
+         while ( count > 0 )
+         {
+            const uint64_t index = offset / blockSize_;
+            const auto blockOffset = static_cast<size_t>( offset - index * blockSize_ );
+            const size_t n = std::min( count, blockSize_ - blockOffset );
+
+            memcpy( buffer, blocks[index]->data() + blockOffset, n );
+
+            offset += n;
+            buffer += n;
+            count -= n;
+         }
+      }
+   }
+
+   // Fetch the missing blocks (sorted by index), joining blocks next to each other into one read
+   void BlockCacheReadSourceImpl::fetchRuns( const std::vector<uint64_t> &missing,
+                                             std::map<uint64_t, Block> &blocks )
+   {
+      struct Run
+      {
+         uint64_t firstIndex;
+         size_t blockCount;
+         std::vector<char> data;
+      };
+
+      std::vector<Run> runs;
+
+      for ( const uint64_t index : missing )
+      {
+         if ( !runs.empty() && ( runs.back().firstIndex + runs.back().blockCount == index ) &&
+              ( runs.back().blockCount < maxBlockCount_ ) )
+         {
+            ++runs.back().blockCount;
+         }
+         else
+         {
+            runs.push_back( { index, 1, {} } );
+         }
+      }
+
+      std::vector<ReadSource::Range> reads;
+      reads.reserve( runs.size() );
+
+      for ( auto &run : runs )
+      {
+         const uint64_t offset = run.firstIndex * blockSize_;
+         const auto length = static_cast<size_t>(
+            std::min( uint64_t{ run.blockCount } * blockSize_, size_ - offset ) );
+
+         run.data.resize( length );
+
+         reads.push_back( { offset, run.data.data(), length } );
+
+         ++fetchCount_;
+         bytesFetched_ += length;
+      }
+
+      // The source can issue the runs together
+      if ( reads.size() == 1 )
+      {
+         source_->readAt( reads[0].offset, reads[0].buffer, reads[0].count );
+      }
+      else
+      {
+         source_->readRanges( reads );
+      }
+
+      for ( const auto &run : runs )
+      {
+         for ( size_t i = 0; i < run.blockCount; ++i )
+         {
+            const size_t start = i * blockSize_;
+            const size_t end = std::min( start + blockSize_, run.data.size() );
+
+            auto block = std::make_shared<const std::vector<char>>( run.data.begin() + start,
+                                                                    run.data.begin() + end );
+
+            blocks[run.firstIndex + i] = block;
+
+            insert( run.firstIndex + i, block );
+         }
+      }
+   }
+
+   void BlockCacheReadSourceImpl::insert( uint64_t index, const Block &block )
+   {
+      std::lock_guard<std::mutex> lock( mutex_ );
+
+      // Another thread may have fetched it at the same time
+      if ( blocks_.find( index ) != blocks_.end() )
+      {
+         return;
+      }
+
+      lru_.push_front( index );
+      blocks_[index] = { block, lru_.begin() };
+
+      while ( blocks_.size() > maxBlockCount_ )
+      {
+         blocks_.erase( lru_.back() );
+         lru_.pop_back();
+      }
+   }
+
+   BlockCacheReadSource::BlockCacheReadSource( const std::shared_ptr<ReadSource> &source,
+                                               size_t blockSize, size_t maxBlockCount )
+   {
+      if ( ( source == nullptr ) || ( blockSize == 0 ) || ( maxBlockCount == 0 ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "blockSize=" + toString( blockSize ) +
+                                                       " maxBlockCount=" +
+                                                       toString( maxBlockCount ) );
+      }
+
+      // Whole pages, so a page is never split between two blocks
+      constexpr size_t cPageSize = CheckedFile::physicalPageSize;
+
+      blockSize = ( blockSize + cPageSize - 1 ) / cPageSize * cPageSize;
+
+      impl_ = std::make_shared<BlockCacheReadSourceImpl>( source, blockSize, maxBlockCount );
+   }
+
+   ustring BlockCacheReadSource::name() const
+   {
+      return impl_->name();
+   }
+
+   uint64_t BlockCacheReadSource::size() const
+   {
+      return impl_->size();
+   }
+
+   void BlockCacheReadSource::readAt( uint64_t offset, char *buffer, size_t count )
+   {
+      impl_->readRanges( { { offset, buffer, count } } );
+   }
+
+   void BlockCacheReadSource::readRanges( const std::vector<Range> &ranges )
+   {
+      impl_->readRanges( ranges );
+   }
+
+   uint64_t BlockCacheReadSource::fetchCount() const
+   {
+      return impl_->fetchCount();
+   }
+
+   uint64_t BlockCacheReadSource::bytesFetched() const
+   {
+      return impl_->bytesFetched();
+   }
+}
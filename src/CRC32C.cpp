@@ -0,0 +1,278 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+
+// This is fixed in a newer version of CRCpp.
+//    https://github.com/d-bahr/CRCpp/issues/17
+// TODO: Remove when new CRCpp is released.
+#if defined( _MSC_VER )
+// Disable warning about "conditional expression is constant".
+#pragma warning( push )
+#pragma warning( disable : 4127 )
+#endif
+#include "CRC.h"
+#if defined( _MSC_VER )
+#pragma warning( pop )
+#endif
+
+#include "CRC32C.h"
+
+// Pick the hardware implementation (if any) available for this compiler & architecture.
+#if defined( _MSC_VER ) && !defined( __clang__ ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+#include <intrin.h>
+#include <nmmintrin.h>
+#define E57_CRC32C_SSE42
+#define E57_CRC32C_TARGET
+#elif ( defined( __GNUC__ ) || defined( __clang__ ) ) &&                                          \
+   ( defined( __x86_64__ ) || defined( __i386__ ) )
+#include <nmmintrin.h>
+#define E57_CRC32C_SSE42
+#define E57_CRC32C_TARGET __attribute__( ( target( "sse4.2" ) ) )
+#elif defined( _MSC_VER ) && defined( _M_ARM64 )
+// The CRC instructions are required by every version of Windows which runs on ARM64.
+#include <intrin.h>
+#define E57_CRC32C_ARM
+#define E57_CRC32C_TARGET
+#elif defined( __aarch64__ ) && defined( __ARM_FEATURE_CRC32 )
+// The compiler was told the CPU has them (e.g. Apple silicon), so no need to check.
+#include <arm_acle.h>
+#define E57_CRC32C_ARM
+#define E57_CRC32C_TARGET
+#elif defined( __aarch64__ ) && defined( __linux__ ) &&                                           \
+   ( defined( __clang__ ) || ( defined( __GNUC__ ) && __GNUC__ >= 10 ) )
+// Build them for the CRC extension and check for it at runtime.
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#define E57_CRC32C_ARM
+#define E57_CRC32C_ARM_RUNTIME_CHECK
+#if defined( __clang__ )
+#define E57_CRC32C_TARGET __attribute__( ( target( "crc" ) ) )
+#else
+#define E57_CRC32C_TARGET __attribute__( ( target( "+crc" ) ) )
+#endif
+#endif
+
+namespace
+{
+   using CRCFunction = uint32_t ( * )( const char *, size_t );
+   using CRCBlocksFunction = void ( * )( const char *, size_t, size_t, size_t, uint32_t * );
+
+   uint32_t crc32cTable( const char *buf, size_t size )
+   {
+      static const CRC::Parameters<crcpp_uint32, 32> sCRCParams{ 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF,
+                                                                 true, true };
+
+      static const CRC::Table<crcpp_uint32, 32> sCRCTable = sCRCParams.MakeTable();
+
+      return CRC::Calculate<crcpp_uint32, 32>( buf, size, sCRCTable );
+   }
+
+   void crc32cBlocksTable( const char *buf, size_t stride, size_t size, size_t count,
+                           uint32_t *crcs )
+   {
+      for ( size_t i = 0; i < count; ++i )
+      {
+         crcs[i] = crc32cTable( buf + i * stride, size );
+      }
+   }
+
+#if defined( E57_CRC32C_SSE42 )
+   E57_CRC32C_TARGET uint32_t crc32cHardware( const char *buf, size_t size )
+   {
+      uint32_t crc = 0xFFFFFFFF;
+
+#if defined( __x86_64__ ) || defined( _M_X64 )
+      uint64_t crc64 = crc;
+
+      for ( ; size >= sizeof( uint64_t ); size -= sizeof( uint64_t ), buf += sizeof( uint64_t ) )
+      {
+         uint64_t word;
+         memcpy( &word, buf, sizeof( word ) );
+
+         crc64 = _mm_crc32_u64( crc64, word );
+      }
+
+      crc = static_cast<uint32_t>( crc64 );
+#endif
+
+      for ( ; size >= sizeof( uint32_t ); size -= sizeof( uint32_t ), buf += sizeof( uint32_t ) )
+      {
+         uint32_t word;
+         memcpy( &word, buf, sizeof( word ) );
+
+         crc = _mm_crc32_u32( crc, word );
+      }
+
+      for ( ; size > 0; --size, ++buf )
+      {
+         crc = _mm_crc32_u8( crc, static_cast<uint8_t>( *buf ) );
+      }
+
+      return crc ^ 0xFFFFFFFF;
+   }
+
+   bool hasHardwareCRC()
+   {
+#if defined( _MSC_VER ) && !defined( __clang__ )
+      int info[4];
+      __cpuid( info, 1 );
+
+      return ( info[2] & ( 1 << 20 ) ) != 0;
+#else
+      return __builtin_cpu_supports( "sse4.2" );
+#endif
+   }
+#elif defined( E57_CRC32C_ARM )
+   E57_CRC32C_TARGET uint32_t crc32cHardware( const char *buf, size_t size )
+   {
+      uint32_t crc = 0xFFFFFFFF;
+
+      for ( ; size >= sizeof( uint64_t ); size -= sizeof( uint64_t ), buf += sizeof( uint64_t ) )
+      {
+         uint64_t word;
+         memcpy( &word, buf, sizeof( word ) );
+
+         crc = __crc32cd( crc, word );
+      }
+
+      for ( ; size > 0; --size, ++buf )
+      {
+         crc = __crc32cb( crc, static_cast<uint8_t>( *buf ) );
+      }
+
+      return crc ^ 0xFFFFFFFF;
+   }
+
+   bool hasHardwareCRC()
+   {
+#if defined( E57_CRC32C_ARM_RUNTIME_CHECK )
+      return ( getauxval( AT_HWCAP ) & HWCAP_CRC32 ) != 0;
+#else
+      return true;
+#endif
+   }
+#endif
+
+#if ( defined( E57_CRC32C_SSE42 ) && ( defined( __x86_64__ ) || defined( _M_X64 ) ) ) ||        \
+   defined( E57_CRC32C_ARM )
+   E57_CRC32C_TARGET inline uint32_t crc32cWord( uint32_t crc, uint64_t word )
+   {
+#if defined( E57_CRC32C_SSE42 )
+      return static_cast<uint32_t>( _mm_crc32_u64( crc, word ) );
+#else
+      return __crc32cd( crc, word );
+#endif
+   }
+
+   E57_CRC32C_TARGET inline uint32_t crc32cByte( uint32_t crc, char byte )
+   {
+#if defined( E57_CRC32C_SSE42 )
+      return _mm_crc32_u8( crc, static_cast<uint8_t>( byte ) );
+#else
+      return __crc32cb( crc, static_cast<uint8_t>( byte ) );
+#endif
+   }
+
+   E57_CRC32C_TARGET inline uint64_t loadWord( const char *p )
+   {
+      uint64_t word;
+      memcpy( &word, p, sizeof( word ) );
+
+      return word;
+   }
+
+   // Each CRC instruction has to wait for the one before it on the same block, but not for
+   // those of other blocks, so the CPU can work on four blocks at once. The CRCs are kept in
+   // separate variables so they stay in registers.
+   E57_CRC32C_TARGET void crc32cBlocksHardware( const char *buf, size_t stride, size_t size,
+                                                size_t count, uint32_t *crcs )
+   {
+      size_t i = 0;
+
+      for ( ; i + 4 <= count; i += 4 )
+      {
+         const char *p0 = buf + i * stride;
+         const char *p1 = p0 + stride;
+         const char *p2 = p1 + stride;
+         const char *p3 = p2 + stride;
+
+         uint32_t crc0 = 0xFFFFFFFF;
+         uint32_t crc1 = 0xFFFFFFFF;
+         uint32_t crc2 = 0xFFFFFFFF;
+         uint32_t crc3 = 0xFFFFFFFF;
+
+         size_t offset = 0;
+
+         for ( ; offset + sizeof( uint64_t ) <= size; offset += sizeof( uint64_t ) )
+         {
+            crc0 = crc32cWord( crc0, loadWord( p0 + offset ) );
+            crc1 = crc32cWord( crc1, loadWord( p1 + offset ) );
+            crc2 = crc32cWord( crc2, loadWord( p2 + offset ) );
+            crc3 = crc32cWord( crc3, loadWord( p3 + offset ) );
+         }
+
+         for ( ; offset < size; ++offset )
+         {
+            crc0 = crc32cByte( crc0, p0[offset] );
+            crc1 = crc32cByte( crc1, p1[offset] );
+            crc2 = crc32cByte( crc2, p2[offset] );
+            crc3 = crc32cByte( crc3, p3[offset] );
+         }
+
+         crcs[i] = crc0 ^ 0xFFFFFFFF;
+         crcs[i + 1] = crc1 ^ 0xFFFFFFFF;
+         crcs[i + 2] = crc2 ^ 0xFFFFFFFF;
+         crcs[i + 3] = crc3 ^ 0xFFFFFFFF;
+      }
+
+      for ( ; i < count; ++i )
+      {
+         crcs[i] = crc32cHardware( buf + i * stride, size );
+      }
+   }
+#define E57_CRC32C_BLOCKS
+#endif
+
+   CRCBlocksFunction selectCRCBlocksFunction()
+   {
+#if defined( E57_CRC32C_BLOCKS )
+      if ( hasHardwareCRC() )
+      {
+         return crc32cBlocksHardware;
+      }
+#endif
+
+      return crc32cBlocksTable;
+   }
+
+   CRCFunction selectCRCFunction()
+   {
+#if defined( E57_CRC32C_SSE42 ) || defined( E57_CRC32C_ARM )
+      if ( hasHardwareCRC() )
+      {
+         return crc32cHardware;
+      }
+#endif
+
+      return crc32cTable;
+   }
+}
+
+namespace e57
+{
+   uint32_t crc32c( const char *buf, size_t size )
+   {
+      static const CRCFunction sCRCFunction = selectCRCFunction();
+
+      return sCRCFunction( buf, size );
+   }
+
+   void crc32cBlocks( const char *buf, size_t stride, size_t size, size_t count, uint32_t *crcs )
+   {
+      static const CRCBlocksFunction sCRCBlocksFunction = selectCRCBlocksFunction();
+
+      sCRCBlocksFunction( buf, stride, size, count, crcs );
+   }
+}
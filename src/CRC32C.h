@@ -0,0 +1,24 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstddef>
+#include <cstdint>
+
+namespace e57
+{
+   /// Calculate the CRC-32C (Castagnoli) of buf.
+   ///
+   /// Uses the CPU's CRC-32C instructions (SSE 4.2 on x86, the CRC extension on ARMv8) if it has
+   /// them, and a table-driven version if not. Which one is decided once, the first time this is
+   /// called.
+   uint32_t crc32c( const char *buf, size_t size );
+
+   /// Calculate the CRC-32C of each of @a count blocks of @a size bytes into @a crcs. The first
+   /// block is at @a buf, and each one is @a stride bytes after the one before (e.g. the logical
+   /// part of consecutive physical pages).
+   ///
+   /// With the CPU's CRC-32C instructions, four blocks are done at a time with their instructions
+   /// interleaved, so each one doesn't wait for the result of the one before.
+   void crc32cBlocks( const char *buf, size_t stride, size_t size, size_t count, uint32_t *crcs );
+}
@@ -37,6 +37,7 @@
 #elif defined( __GNUC__ )
 #define _LARGEFILE64_SOURCE
 #define __LARGE64_FILES
+#include <io.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -60,26 +61,49 @@
 #error "no supported OS platform defined"
 #endif
 
+// Memory-mapping uses the Win32 API
+#if defined( _WIN32 )
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+// Memory-mapped reading (not on Emscripten, where mmap() is emulated by copying)
+#if defined( E57_ENABLE_MMAP ) && !defined( __EMSCRIPTEN__ )
+#if defined( _WIN32 )
+#define E57_MMAP_WINDOWS
+#else
+#include <sys/mman.h>
+#define E57_MMAP_POSIX
+#endif
+#endif
+
+// Source files are read straight into the logical part of each page with preadv() where it is
+// available (see CheckedFile::writeFromFile())
+#if ( defined( __linux__ ) && !defined( __EMSCRIPTEN__ ) ) || defined( __BSD )
+#include <climits>
+#include <sys/uio.h>
+#define E57_SCATTER_READ
+#endif
+
 #include <cmath>
 #include <cstdio>
 #include <cstring>
 #include <fcntl.h>
 
-// This is fixed in a newer version of CRCpp.
-//    https://github.com/d-bahr/CRCpp/issues/17
-// TODO: Remove when new CRCpp is released.
-#if defined( _MSC_VER )
-// Disable warning about "conditional expression is constant".
-#pragma warning( push )
-#pragma warning( disable : 4127 )
-#endif
-#include "CRC.h"
-#if defined( _MSC_VER )
-#pragma warning( pop )
-#endif
-
+#include "CRC32C.h"
 #include "CheckedFile.h"
+#include "DirectWriter.h"
+#include "ReadSource.h"
+#include "Statistics.h"
 #include "StringFunctions.h"
+#include "Tracing.h"
+#include "UringReadSource.h"
+#include "WorkerPool.h"
 
 // #define E57_CHECK_FILE_DEBUG
 #ifdef E57_CHECK_FILE_DEBUG
@@ -97,6 +121,14 @@ constexpr size_t CheckedFile::logicalPageSize;
 
 namespace
 {
+   // Most pages we read or write at once. Bigger transfers mean fewer system calls, but more
+   // memory for the temporary buffer.
+   constexpr size_t cMaxPagesPerTransfer = 64;
+
+   // Most transfers a read from a ReadSource which isn't in memory asks for at once (see
+   // ReadSource::readRanges()), so sources which can have many reads in flight keep busy.
+   constexpr size_t cMaxTransfersPerRead = 16;
+
    inline uint32_t swap_uint32( uint32_t val )
    {
       val = ( ( val << 8 ) & 0xFF00FF00 ) | ( ( val >> 8 ) & 0xFF00FF );
@@ -105,85 +137,126 @@ namespace
    }
 
    /// Calc CRC32C of given data
-   uint32_t checksum( char *buf, size_t size )
+   uint32_t checksum( const char *buf, size_t size )
    {
-      static const CRC::Parameters<crcpp_uint32, 32> sCRCParams{ 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF,
-                                                                 true, true };
-
-      static const CRC::Table<crcpp_uint32, 32> sCRCTable = sCRCParams.MakeTable();
-
-      auto crc = CRC::Calculate<crcpp_uint32, 32>( buf, size, sCRCTable );
+      auto crc = crc32c( buf, size );
 
       // (Andy) I don't understand why we need to swap bytes here
       crc = swap_uint32( crc );
 
       return crc;
    }
-}
 
-/// Tool class to read buffer efficiently without multiplying copy operations.
-///
-/// @warning Pointer input is handled by user!
-class e57::BufferView
-{
-public:
-   /// @param [in] input filled buffer owned by caller
-   /// @param [in] size size of input
-   BufferView( const char *input, uint64_t size ) : streamSize_( size ), stream_( input )
+   /// Put the checksum of the logical part of each of the @a count physical pages starting at
+   /// @a pages after it. They are calculated several pages at a time (see crc32cBlocks()).
+   void addChecksums( char *pages, size_t count )
    {
-   }
+      uint32_t crcs[cMaxPagesPerTransfer];
 
-   uint64_t pos() const
-   {
-      return cursorStream_;
+      for ( size_t first = 0; first < count; first += cMaxPagesPerTransfer )
+      {
+         const size_t batch = std::min( count - first, cMaxPagesPerTransfer );
+         char *batchPages = pages + first * CheckedFile::physicalPageSize;
+
+         crc32cBlocks( batchPages, CheckedFile::physicalPageSize, CheckedFile::logicalPageSize,
+                       batch, crcs );
+
+         for ( size_t i = 0; i < batch; ++i )
+         {
+            // (Andy) I don't understand why we need to swap bytes here
+            const uint32_t check_sum = swap_uint32( crcs[i] );
+
+            memcpy( batchPages + i * CheckedFile::physicalPageSize + CheckedFile::logicalPageSize,
+                    &check_sum, sizeof( check_sum ) ); //??? little endian dependency
+         }
+      }
    }
 
-   bool seek( uint64_t offset, int whence )
+   /// Copy @a count bytes from @a buf to the logical part of each page starting at @a pages
+   void copyToPages( char *pages, const char *buf, size_t count )
    {
-      if ( whence == SEEK_CUR )
+      for ( size_t done = 0; done < count; done += CheckedFile::logicalPageSize )
       {
-         cursorStream_ += offset;
-      }
-      else if ( whence == SEEK_SET )
-      {
-         cursorStream_ = offset;
-      }
-      else if ( whence == SEEK_END )
-      {
-         cursorStream_ = streamSize_ - offset;
+         const size_t page = done / CheckedFile::logicalPageSize;
+
+         memcpy( pages + page * CheckedFile::physicalPageSize, buf + done,
+                 std::min( count - done, CheckedFile::logicalPageSize ) );
       }
+   }
 
-      if ( cursorStream_ > streamSize_ )
+   /// Read @a count bytes at @a offset of the open file @a fd to the logical part of each page
+   /// starting at @a pages, without moving the file position
+   void readFileToPages( int fd, uint64_t offset, char *pages, size_t count,
+                         const ustring &fileName )
+   {
+#ifdef E57_SCATTER_READ
+#ifdef IOV_MAX
+      constexpr size_t cMaxIovecs = IOV_MAX;
+#else
+      constexpr size_t cMaxIovecs = 16;
+#endif
+
+      // Offsets past what off_t holds (32-bit builds without large file support) can't use it
+      if ( ( sizeof( off_t ) >= sizeof( uint64_t ) ) || ( offset + count <= INT32_MAX ) )
       {
-         cursorStream_ = streamSize_;
-         return false;
+         std::vector<iovec> iovecs;
+         size_t done = 0;
+
+         // The OS may return less than we asked for, so keep going until we have it all
+         while ( done < count )
+         {
+            iovecs.clear();
+
+            for ( size_t position = done; ( position < count ) && ( iovecs.size() < cMaxIovecs ); )
+            {
+               const size_t page = position / CheckedFile::logicalPageSize;
+               const size_t pageOffset = position % CheckedFile::logicalPageSize;
+               const size_t n =
+                  std::min( CheckedFile::logicalPageSize - pageOffset, count - position );
+
+               iovecs.push_back( { pages + page * CheckedFile::physicalPageSize + pageOffset, n } );
+               position += n;
+            }
+
+            const ssize_t result = ::preadv( fd, iovecs.data(), static_cast<int>( iovecs.size() ),
+                                             static_cast<off_t>( offset + done ) );
+
+            if ( result <= 0 )
+            {
+               throw E57_EXCEPTION2( ErrorReadFailed, "fileName=" + fileName +
+                                                         " result=" + toString( result ) +
+                                                         " offset=" + toString( offset + done ) );
+            }
+
+            done += static_cast<size_t>( result );
+         }
+
+         return;
       }
+#endif
 
-      return true;
-   }
+      // Read it all in one go, then move each page but the first up to where it belongs,
+      // starting from the last so none is overwritten before it is moved
+      readFileAt( fd, offset, pages, count, fileName );
 
-   void read( char *buffer, uint64_t count )
-   {
-      const uint64_t start = cursorStream_;
-      for ( uint64_t i = 0; i < count; ++i )
+      for ( size_t page = ( count - 1 ) / CheckedFile::logicalPageSize; page > 0; --page )
       {
-         buffer[i] = stream_[start + i];
-         ++cursorStream_;
+         memmove( pages + page * CheckedFile::physicalPageSize,
+                  pages + page * CheckedFile::logicalPageSize,
+                  std::min( count - page * CheckedFile::logicalPageSize,
+                            CheckedFile::logicalPageSize ) );
       }
    }
+}
 
-private:
-   const uint64_t streamSize_;
-   uint64_t cursorStream_ = 0;
-   const char *stream_;
-};
-
-CheckedFile::CheckedFile( const ustring &fileName, Mode mode, ReadChecksumPolicy policy ) :
+CheckedFile::CheckedFile( const ustring &fileName, Mode mode, ReadChecksumPolicy policy,
+                          bool directIo ) :
    fileName_( fileName ), checkSumPolicy_( policy )
 {
    switch ( mode )
    {
       case Read:
+      case ReadGrowing:
       {
 #if defined( _MSC_VER )
          constexpr int readFlags = O_RDONLY | O_BINARY;
@@ -193,11 +266,38 @@ CheckedFile::CheckedFile( const ustring &fileName, Mode mode, ReadChecksumPolicy
 
          fd_ = open64( fileName_, readFlags, 0 );
 
-         readOnly_ = true;
-
          physicalLength_ = lseek64( 0LL, SEEK_END );
          lseek64( 0, SEEK_SET );
 
+         // What is added to a growing file is beyond any mapping (or io_uring source) made now
+         growing_ = ( mode == ReadGrowing );
+
+         if ( !growing_ )
+         {
+#if defined( E57_ENABLE_IO_URING ) && defined( __linux__ )
+            // Reading with io_uring takes the place of mapping the file
+            auto uringSource =
+               std::make_shared<UringReadSource>( fd_, fileName_, physicalLength_ );
+
+            if ( uringSource->isAvailable() )
+            {
+               source_ = uringSource;
+            }
+            else
+#endif
+            {
+               mapFile();
+            }
+         }
+
+         if ( source_ == nullptr )
+         {
+            source_ = std::make_shared<FileReadSource>( fd_, fileName_, physicalLength_ );
+         }
+
+         readOnly_ = true;
+         sourceData_ = source_->data();
+
          logicalLength_ = physicalToLogical( physicalLength_ );
       }
       break;
@@ -215,21 +315,45 @@ CheckedFile::CheckedFile( const ustring &fileName, Mode mode, ReadChecksumPolicy
 #endif
 
          fd_ = open64( fileName_, writeFlags, writeMode );
+
+         if ( directIo )
+         {
+            directWriter_.reset( new DirectWriter( fileName_, fd_ ) );
+         }
+      }
+      break;
+
+      case ReadWrite:
+      {
+#if defined( _MSC_VER )
+         constexpr int readWriteFlags = O_RDWR | O_BINARY;
+#else
+         constexpr int readWriteFlags = O_RDWR;
+#endif
+
+         fd_ = open64( fileName_, readWriteFlags, 0 );
+
+         physicalLength_ = lseek64( 0LL, SEEK_END );
+         lseek64( 0, SEEK_SET );
+
+         logicalLength_ = physicalToLogical( physicalLength_ );
       }
       break;
    }
 }
 
-CheckedFile::CheckedFile( const char *input, uint64_t size, ReadChecksumPolicy policy ) :
-   fileName_( "<StreamBuffer>" ), checkSumPolicy_( policy )
+CheckedFile::CheckedFile( const std::shared_ptr<ReadSource> &source, ReadChecksumPolicy policy ) :
+   fileName_( source->name() ), checkSumPolicy_( policy ), readOnly_( true ), source_( source ),
+   sourceData_( source->data() )
 {
-   bufView_ = new BufferView( input, size );
-
-   readOnly_ = true;
-
-   physicalLength_ = lseek64( 0LL, SEEK_END );
-   lseek64( 0, SEEK_SET );
+   physicalLength_ = source_->size();
+   logicalLength_ = physicalToLogical( physicalLength_ );
+}
 
+CheckedFile::CheckedFile( const std::shared_ptr<WriteSink> &sink, ReadChecksumPolicy policy ) :
+   fileName_( sink->name() ), checkSumPolicy_( policy ), sink_( sink )
+{
+   physicalLength_ = sink_->size();
    logicalLength_ = physicalToLogical( physicalLength_ );
 }
 
@@ -287,11 +411,21 @@ CheckedFile::~CheckedFile()
 
 void CheckedFile::read( char *buf, size_t nRead, size_t /*bufSize*/ )
 {
-   //??? what if read past logical end?, or physical end?
-   //??? need to keep track of logical length?
    //??? check bufSize OK
 
-   const uint64_t end = position( Logical ) + nRead;
+   const uint64_t start = position( Logical );
+
+   readAt( start, buf, nRead );
+
+   // When done, leave cursor just past end of last byte read
+   seek( start + nRead, Logical );
+}
+
+void CheckedFile::readAt( uint64_t logicalOffset, char *buf, size_t nRead )
+{
+   flushText();
+
+   const uint64_t end = logicalOffset + nRead;
    const uint64_t logicalLength = length( Logical );
 
    if ( end > logicalLength )
@@ -300,58 +434,143 @@ void CheckedFile::read( char *buf, size_t nRead, size_t /*bufSize*/ )
                                               " length=" + toString( logicalLength ) );
    }
 
-   uint64_t page = 0;
-   size_t pageOffset = 0;
-
-   getCurrentPageAndOffset( page, pageOffset );
+   uint64_t page = logicalOffset / logicalPageSize;
+   size_t pageOffset = static_cast<size_t>( logicalOffset - page * logicalPageSize );
 
    size_t n = std::min( nRead, logicalPageSize - pageOffset );
 
-   // Allocate temp page buffer
-   std::vector<char> page_buffer_v( physicalPageSize );
+   const size_t maxPagesPerRead = ( readOnly_ && ( sourceData_ == nullptr ) )
+                                     ? cMaxPagesPerTransfer * cMaxTransfersPerRead
+                                     : cMaxPagesPerTransfer;
+
+   // Allocate temp buffer for as many pages as we will read at once
+   const size_t pagesToRead = ( pageOffset + nRead + logicalPageSize - 1 ) / logicalPageSize;
+   std::vector<char> page_buffer_v( physicalPageSize * std::min( pagesToRead, maxPagesPerRead ) );
    char *page_buffer = page_buffer_v.data();
 
+   // A page of a growing file which has to be read again (see verifiedPage())
+   std::vector<char> retry_page;
+
    while ( nRead > 0 )
    {
-      readPhysicalPage( page_buffer, page );
+      // Get as many of the remaining pages as we can in one go
+      const size_t pageCount = std::min(
+         ( pageOffset + nRead + logicalPageSize - 1 ) / logicalPageSize, maxPagesPerRead );
 
-      switch ( checkSumPolicy_ )
-      {
-         case ChecksumPolicy::ChecksumNone:
-            break;
+      const char *pages_data = physicalPages( page_buffer, page, pageCount );
 
-         case ChecksumPolicy::ChecksumAll:
-            verifyChecksum( page_buffer, page );
-            break;
+      for ( size_t i = 0; i < pageCount; ++i )
+      {
+         const char *page_data = pages_data + i * physicalPageSize;
 
-         default:
+         switch ( checkSumPolicy_ )
          {
-            const auto checksumMod =
-               static_cast<unsigned int>( std::nearbyint( 100.0 / checkSumPolicy_ ) );
+            case ChecksumPolicy::ChecksumNone:
+               break;
 
-            if ( !( page % checksumMod ) || ( nRead < physicalPageSize ) )
+            case ChecksumPolicy::ChecksumAll:
+               page_data = verifiedPage( page_data, page, retry_page );
+               break;
+
+            default:
             {
-               verifyChecksum( page_buffer, page );
+               const auto checksumMod =
+                  static_cast<unsigned int>( std::nearbyint( 100.0 / checkSumPolicy_ ) );
+
+               if ( !( page % checksumMod ) || ( nRead < physicalPageSize ) )
+               {
+                  page_data = verifiedPage( page_data, page, retry_page );
+               }
             }
+            break;
          }
-         break;
+
+         memcpy( buf, page_data + pageOffset, n );
+
+         buf += n;
+         nRead -= n;
+         pageOffset = 0;
+         ++page;
+
+         n = std::min( nRead, logicalPageSize );
       }
+   }
+}
 
-      memcpy( buf, page_buffer + pageOffset, n );
+void CheckedFile::readAt( uint64_t logicalOffset, char *buf, size_t nRead, WorkerPool &workers )
+{
+   // Files being written are read through the one file descriptor position
+   if ( !readOnly_ || ( workers.threadCount() < 2 ) )
+   {
+      readAt( logicalOffset, buf, nRead );
+      return;
+   }
 
-      buf += n;
-      nRead -= n;
-      pageOffset = 0;
-      ++page;
+   // Each thread reads as much as readAt() reads at once, starting on a page boundary so no page
+   // is read (and checked) twice
+   const uint64_t pieceSize =
+      logicalPageSize * ( ( sourceData_ == nullptr ) ? cMaxPagesPerTransfer * cMaxTransfersPerRead
+                                                     : cMaxPagesPerTransfer );
+   const uint64_t firstPageStart = logicalOffset - logicalOffset % logicalPageSize;
+   const uint64_t end = logicalOffset + nRead;
+   const auto pieceCount =
+      static_cast<size_t>( ( end - firstPageStart + pieceSize - 1 ) / pieceSize );
+
+   workers.parallelFor( pieceCount, [=]( size_t piece ) {
+      const uint64_t pieceStart = std::max( logicalOffset, firstPageStart + piece * pieceSize );
+      const uint64_t pieceEnd = std::min( end, firstPageStart + ( piece + 1 ) * pieceSize );
+
+      readAt( pieceStart, buf + ( pieceStart - logicalOffset ),
+              static_cast<size_t>( pieceEnd - pieceStart ) );
+   } );
+}
 
-      n = std::min( nRead, logicalPageSize );
+void CheckedFile::verifyChecksums( unsigned threadCount )
+{
+   // Only the pages which were in a file opened with ReadWrite are known to be written out
+   if ( !readOnly_ && ( length( Physical ) != physicalLength_ ) )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "fileName=" + fileName_ );
    }
 
-   // When done, leave cursor just past end of last byte read
-   seek( end, Logical );
+   // A partial page at the end of the file has no checksum, and read() can't reach it either
+   const uint64_t pageCount = physicalLength_ / physicalPageSize;
+   const auto chunkCount =
+      static_cast<size_t>( ( pageCount + cMaxPagesPerTransfer - 1 ) / cMaxPagesPerTransfer );
+
+   WorkerPool workers( threadCount, executor_ );
+
+   workers.parallelFor( chunkCount, [this, pageCount]( size_t chunk ) {
+      const uint64_t firstPage = uint64_t{ chunk } * cMaxPagesPerTransfer;
+      const auto chunkPages = static_cast<size_t>(
+         std::min( pageCount - firstPage, uint64_t{ cMaxPagesPerTransfer } ) );
+
+      std::vector<char> page_buffer( physicalPageSize * chunkPages );
+      const char *pages_data = physicalPages( page_buffer.data(), firstPage, chunkPages );
+
+      for ( size_t i = 0; i < chunkPages; ++i )
+      {
+         verifyChecksum( pages_data + i * physicalPageSize, firstPage + i );
+      }
+   } );
+}
+
+void CheckedFile::write( const char *buf, size_t nWrite, WorkerPool *workers )
+{
+   writePages( nWrite, workers, [buf]( uint64_t offset, char *pages, size_t count ) {
+      copyToPages( pages, buf + offset, count );
+   } );
+}
+
+void CheckedFile::writeFromFile( int fd, uint64_t fileOffset, size_t nWrite,
+                                 const ustring &sourceName, WorkerPool *workers )
+{
+   writePages( nWrite, workers, [=, &sourceName]( uint64_t offset, char *pages, size_t count ) {
+      readFileToPages( fd, fileOffset + offset, pages, count, sourceName );
+   } );
 }
 
-void CheckedFile::write( const char *buf, size_t nWrite )
+void CheckedFile::writePages( size_t nWrite, WorkerPool *workers, const PageFiller &fill )
 {
 #ifdef E57_VERBOSE
    // cout << "write nWrite=" << nWrite << " position()="<< position() << std::endl;
@@ -362,6 +581,8 @@ void CheckedFile::write( const char *buf, size_t nWrite )
       throw E57_EXCEPTION2( ErrorFileReadOnly, "fileName=" + fileName_ );
    }
 
+   flushText();
+
    uint64_t end = position( Logical ) + nWrite;
 
    uint64_t page = 0;
@@ -371,17 +592,67 @@ void CheckedFile::write( const char *buf, size_t nWrite )
 
    size_t n = std::min( nWrite, logicalPageSize - pageOffset );
 
-   // Allocate temp page buffer
-   std::vector<char> page_buffer_v( physicalPageSize );
+   // Bytes of the source already written
+   uint64_t done = 0;
+
+   // With workers, each of their threads fills a transfer's worth of every batch of pages
+   const bool parallel = ( workers != nullptr ) && ( workers->threadCount() > 1 );
+   const size_t maxPagesPerWrite =
+      parallel ? cMaxPagesPerTransfer * workers->threadCount() : cMaxPagesPerTransfer;
+
+   // Allocate temp buffer for as many pages as we will write at once
+   const size_t pagesToWrite = ( pageOffset + nWrite + logicalPageSize - 1 ) / logicalPageSize;
+   std::vector<char> page_buffer_v( physicalPageSize *
+                                    std::min( pagesToWrite, maxPagesPerWrite ) );
    char *page_buffer = page_buffer_v.data();
 
+   const uint64_t physicalLength = length( Physical );
+
    while ( nWrite > 0 )
    {
-      const uint64_t physicalLength = length( Physical );
+      // Whole pages replace what was there, so they don't need to be read first and can be
+      // written several at a time.
+      if ( ( pageOffset == 0 ) && ( nWrite >= logicalPageSize ) )
+      {
+         const size_t pageCount = std::min( nWrite / logicalPageSize, maxPagesPerWrite );
+
+         const auto fillPages = [page_buffer, done, &fill]( size_t first, size_t count ) {
+            fill( done + first * logicalPageSize, page_buffer + first * physicalPageSize,
+                  count * logicalPageSize );
+
+            addChecksums( page_buffer + first * physicalPageSize, count );
+         };
+
+         if ( parallel )
+         {
+            const size_t chunkCount =
+               ( pageCount + cMaxPagesPerTransfer - 1 ) / cMaxPagesPerTransfer;
+
+            workers->parallelFor( chunkCount, [&fillPages, pageCount]( size_t chunk ) {
+               const size_t first = chunk * cMaxPagesPerTransfer;
+
+               fillPages( first, std::min( pageCount - first, cMaxPagesPerTransfer ) );
+            } );
+         }
+         else
+         {
+            fillPages( 0, pageCount );
+         }
+
+         writePhysicalPages( page_buffer, page, pageCount, false );
+
+         done += pageCount * logicalPageSize;
+         nWrite -= pageCount * logicalPageSize;
+         page += pageCount;
+         n = std::min( nWrite, logicalPageSize );
+
+         continue;
+      }
 
+      // Partial page, so keep whatever is already in the rest of it
       if ( page * physicalPageSize < physicalLength )
       {
-         readPhysicalPage( page_buffer, page );
+         readPhysicalPages( page_buffer, page, 1 );
       }
 
 #ifdef E57_VERBOSE
@@ -390,13 +661,13 @@ void CheckedFile::write( const char *buf, size_t nWrite )
       // pageOffset << " buf='"; //??? for (size_t i=0; i < n; i++) cout <<
       // buf[i]; cout << "'" << std::endl;
 #endif
-      memcpy( page_buffer + pageOffset, buf, n );
-      writePhysicalPage( page_buffer, page );
+      fill( done, page_buffer + pageOffset, n );
+      writePhysicalPages( page_buffer, page, 1 );
 #ifdef E57_VERBOSE
       // cout << "  page_buffer[0] after write: '" << page_buffer[0] << "'" <<
       // std::endl; //???
 #endif
-      buf += n;
+      done += n;
       nWrite -= n;
       pageOffset = 0;
       page++;
@@ -414,22 +685,31 @@ void CheckedFile::write( const char *buf, size_t nWrite )
 
 CheckedFile &CheckedFile::operator<<( const ustring &s )
 {
-   write( s.c_str(), s.length() ); //??? should be times size of uchar?
+   constexpr size_t cTextBufferSize = 1024 * 1024;
+
+   if ( readOnly_ )
+   {
+      throw E57_EXCEPTION2( ErrorFileReadOnly, "fileName=" + fileName_ );
+   }
+
+   textBuffer_ += s; //??? should be times size of uchar?
+
+   if ( textBuffer_.size() >= cTextBufferSize )
+   {
+      flushText();
+   }
+
    return ( *this );
 }
 
 CheckedFile &CheckedFile::operator<<( int64_t i )
 {
-   std::stringstream ss;
-   ss << i;
-   return ( *this << ss.str() );
+   return ( *this << std::to_string( i ) );
 }
 
 CheckedFile &CheckedFile::operator<<( uint64_t i )
 {
-   std::stringstream ss;
-   ss << i;
-   return ( *this << ss.str() );
+   return ( *this << std::to_string( i ) );
 }
 
 CheckedFile &CheckedFile::operator<<( float f )
@@ -456,8 +736,27 @@ template <class FTYPE> CheckedFile &CheckedFile::writeFloatingPoint( FTYPE value
    return *this << floatingPointToStr( value, precision );
 }
 
+void CheckedFile::flushText()
+{
+   if ( textBuffer_.empty() )
+   {
+      return;
+   }
+
+   // write() flushes too, so take the text out first. Keep the buffer's memory for reuse.
+   std::string text;
+   text.swap( textBuffer_ );
+
+   write( text.data(), text.size() );
+
+   text.clear();
+   textBuffer_.swap( text );
+}
+
 void CheckedFile::seek( uint64_t offset, OffsetMode omode )
 {
+   flushText();
+
    //??? check for seek beyond logicalLength_
    const auto pos =
       static_cast<int64_t>( omode == Physical ? offset : logicalToPhysical( offset ) );
@@ -471,20 +770,41 @@ void CheckedFile::seek( uint64_t offset, OffsetMode omode )
 
 uint64_t CheckedFile::lseek64( int64_t offset, int whence )
 {
-   if ( ( fd_ < 0 ) && ( bufView_ != nullptr ) )
+   // Read-only files are read with positional reads, and sinks are written with positional
+   // writes, so their position is only kept here
+   if ( readOnly_ || ( sink_ != nullptr ) )
    {
-      const auto uoffset = static_cast<uint64_t>( offset );
+      const uint64_t length = readOnly_ ? physicalLength_ : sink_->size();
+      uint64_t position = static_cast<uint64_t>( offset );
+
+      if ( whence == SEEK_CUR )
+      {
+         position += readPosition_;
+      }
+      else if ( whence == SEEK_END )
+      {
+         position += length;
+      }
 
-      if ( bufView_->seek( uoffset, whence ) )
+      // Like a file, a sink may be written past its end
+      if ( readOnly_ && ( position > length ) )
       {
-         return bufView_->pos();
+         throw E57_EXCEPTION2( ErrorSeekFailed, "fileName=" + fileName_ +
+                                                   " offset=" + toString( offset ) +
+                                                   " whence=" + toString( whence ) );
       }
 
-      throw E57_EXCEPTION2( ErrorSeekFailed, "fileName=" + fileName_ +
-                                                " offset=" + toString( offset ) +
-                                                " whence=" + toString( whence ) );
+      readPosition_ = position;
+
+      return readPosition_;
    }
 
+   return seekDescriptor( offset, whence );
+}
+
+// Move the position of fd_, returning the new one
+uint64_t CheckedFile::seekDescriptor( int64_t offset, int whence )
+{
 #if defined( _WIN32 )
    __int64 result = _lseeki64( fd_, offset, whence );
 #elif defined( __linux__ ) || defined( __EMSCRIPTEN__ )
@@ -507,6 +827,8 @@ uint64_t CheckedFile::lseek64( int64_t offset, int whence )
 
 uint64_t CheckedFile::position( OffsetMode omode )
 {
+   flushText();
+
    // Get current file cursor position
    const uint64_t pos = lseek64( 0LL, SEEK_CUR );
 
@@ -520,6 +842,8 @@ uint64_t CheckedFile::position( OffsetMode omode )
 
 uint64_t CheckedFile::length( OffsetMode omode )
 {
+   flushText();
+
    if ( omode == Physical )
    {
       if ( readOnly_ )
@@ -527,12 +851,23 @@ uint64_t CheckedFile::length( OffsetMode omode )
          return physicalLength_;
       }
 
+      if ( sink_ != nullptr )
+      {
+         return sink_->size();
+      }
+
       // Current file position
       uint64_t original_pos = lseek64( 0LL, SEEK_CUR );
 
       // End file position
       uint64_t end_pos = lseek64( 0LL, SEEK_END );
 
+      // Pages which haven't been written out yet
+      if ( directWriter_ != nullptr )
+      {
+         end_pos = std::max( end_pos, directWriter_->length() );
+      }
+
       // Restore original position
       lseek64( original_pos, SEEK_SET );
 
@@ -544,6 +879,8 @@ uint64_t CheckedFile::length( OffsetMode omode )
 
 void CheckedFile::extend( uint64_t newLength, OffsetMode omode )
 {
+   flushText();
+
 #ifdef E57_VERBOSE
    // cout << "extend newLength=" << newLength << " omode="<< omode << std::endl;
    // //???
@@ -598,17 +935,36 @@ void CheckedFile::extend( uint64_t newLength, OffsetMode omode )
       n = logicalPageSize - pageOffset;
    }
 
-   // Allocate temp page buffer
-   std::vector<char> page_buffer_v( physicalPageSize );
+   // Allocate temp buffer for as many pages as we will write at once
+   const uint64_t pagesToWrite = ( pageOffset + nWrite + logicalPageSize - 1 ) / logicalPageSize;
+   std::vector<char> page_buffer_v(
+      physicalPageSize *
+      static_cast<size_t>( std::min( pagesToWrite, uint64_t{ cMaxPagesPerTransfer } ) ) );
    char *page_buffer = page_buffer_v.data();
 
+   const uint64_t physicalLength = length( Physical );
+
    while ( nWrite > 0 )
    {
-      const uint64_t physicalLength = length( Physical );
+      // Whole pages of zeros can be written several at a time
+      if ( ( pageOffset == 0 ) && ( nWrite >= logicalPageSize ) )
+      {
+         const auto pageCount = static_cast<size_t>(
+            std::min( nWrite / logicalPageSize, uint64_t{ cMaxPagesPerTransfer } ) );
+
+         memset( page_buffer, 0, pageCount * physicalPageSize );
+         writePhysicalPages( page_buffer, page, pageCount );
+
+         nWrite -= pageCount * logicalPageSize;
+         page += pageCount;
+         n = static_cast<size_t>( std::min( nWrite, uint64_t{ logicalPageSize } ) );
+
+         continue;
+      }
 
       if ( page * physicalPageSize < physicalLength )
       {
-         readPhysicalPage( page_buffer, page );
+         readPhysicalPages( page_buffer, page, 1 );
       }
 
 #ifdef E57_VERBOSE
@@ -617,7 +973,7 @@ void CheckedFile::extend( uint64_t newLength, OffsetMode omode )
       // //???
 #endif
       memset( page_buffer + pageOffset, 0, n );
-      writePhysicalPage( page_buffer, page );
+      writePhysicalPages( page_buffer, page, 1 );
 
       nWrite -= n;
       pageOffset = 0;
@@ -640,8 +996,133 @@ void CheckedFile::extend( uint64_t newLength, OffsetMode omode )
    seek( newLogicalLength, Logical );
 }
 
+void CheckedFile::reserve( uint64_t byteCount )
+{
+   if ( readOnly_ )
+   {
+      throw E57_EXCEPTION2( ErrorFileReadOnly, "fileName=" + fileName_ );
+   }
+
+   const uint64_t start = std::max( reservedLength_, length( Physical ) );
+   const uint64_t pageCount = ( byteCount + logicalPageSize - 1 ) / logicalPageSize;
+
+   // Sinks are never longer than what is written to them, so there's nothing to release
+   if ( sink_ != nullptr )
+   {
+      if ( pageCount > 0 )
+      {
+         sink_->reserve( start + pageCount * physicalPageSize );
+      }
+
+      return;
+   }
+
+   if ( ( pageCount > 0 ) && preallocate( start, pageCount * physicalPageSize ) )
+   {
+      reservedLength_ = start + pageCount * physicalPageSize;
+   }
+}
+
+// Allocate count bytes at offset without changing the length of the file. Returns false if the
+// file system can't.
+bool CheckedFile::preallocate( uint64_t offset, uint64_t count )
+{
+#if defined( _WIN32 )
+   const auto fileHandle = reinterpret_cast<HANDLE>( ::_get_osfhandle( fd_ ) );
+
+   FILE_ALLOCATION_INFO info = {};
+   info.AllocationSize.QuadPart = static_cast<LONGLONG>( offset + count );
+
+   return ::SetFileInformationByHandle( fileHandle, FileAllocationInfo, &info, sizeof( info ) ) !=
+          0;
+#elif defined( __linux__ ) && defined( FALLOC_FL_KEEP_SIZE )
+   return ::fallocate64( fd_, FALLOC_FL_KEEP_SIZE, static_cast<off64_t>( offset ),
+                         static_cast<off64_t>( count ) ) == 0;
+#elif defined( __APPLE__ )
+   // Space is allocated after the end of what is allocated already, so offset isn't needed. Try to
+   // get it in one piece first.
+   E57_UNUSED( offset );
+
+   fstore_t store = { F_ALLOCATECONTIG | F_ALLOCATEALL, F_PEOFPOSMODE, 0,
+                      static_cast<off_t>( count ), 0 };
+
+   if ( ::fcntl( fd_, F_PREALLOCATE, &store ) == 0 )
+   {
+      return true;
+   }
+
+   store.fst_flags = F_ALLOCATEALL;
+
+   return ::fcntl( fd_, F_PREALLOCATE, &store ) == 0;
+#else
+   E57_UNUSED( offset );
+   E57_UNUSED( count );
+
+   return false;
+#endif
+}
+
+// Set the length of the file, releasing any space allocated after it.
+void CheckedFile::truncate( uint64_t length )
+{
+#if defined( _WIN32 )
+   int result = ::_chsize_s( fd_, static_cast<__int64>( length ) );
+#elif defined( __linux__ ) || defined( __EMSCRIPTEN__ )
+   int result = ::ftruncate64( fd_, static_cast<off64_t>( length ) );
+#elif defined( __APPLE__ ) || defined( __BSD )
+   int result = ::ftruncate( fd_, static_cast<off_t>( length ) );
+#else
+#error "no supported OS platform defined"
+#endif
+
+   if ( result != 0 )
+   {
+      throw E57_EXCEPTION2( ErrorWriteFailed, "fileName=" + fileName_ +
+                                                 " result=" + toString( result ) +
+                                                 " length=" + toString( length ) );
+   }
+}
+
+void CheckedFile::refreshLength()
+{
+   if ( !growing_ )
+   {
+      return;
+   }
+
+   // lseek64() keeps the position of a read-only file itself, so ask the system for the end
+   physicalLength_ = seekDescriptor( 0LL, SEEK_END );
+   logicalLength_ = physicalToLogical( physicalLength_ );
+
+   source_ = std::make_shared<FileReadSource>( fd_, fileName_, physicalLength_ );
+}
+
 void CheckedFile::close()
 {
+   flushText();
+
+   if ( directWriter_ != nullptr )
+   {
+      // If this throws, the next close() (from the destructor) closes the file without it
+      std::unique_ptr<DirectWriter> directWriter( std::move( directWriter_ ) );
+
+      directWriter->flush();
+   }
+
+   // Release reserved space which wasn't used
+   if ( reservedLength_ > 0 )
+   {
+      const uint64_t reservedLength = reservedLength_;
+      reservedLength_ = 0;
+
+      const uint64_t fileLength = length( Physical );
+
+      if ( reservedLength > fileLength )
+      {
+         truncate( fileLength );
+      }
+   }
+
    if ( fd_ >= 0 )
    {
 #if defined( _MSC_VER )
@@ -660,20 +1141,104 @@ void CheckedFile::close()
       fd_ = -1;
    }
 
-   if ( bufView_ != nullptr )
+   // Sources and sinks from the user are theirs to clean up; ours don't own what they read
+   source_.reset();
+   sink_.reset();
+   sourceData_ = nullptr;
+
+   unmapFile();
+}
+
+// If we can, map the whole (read-only) file into memory and read it through a MemoryReadSource
+// instead of the file descriptor. If mapping fails for any reason, we just keep using fd_.
+void CheckedFile::mapFile()
+{
+#if defined( E57_MMAP_POSIX ) || defined( E57_MMAP_WINDOWS )
+   if ( ( physicalLength_ == 0 ) || ( physicalLength_ > SIZE_MAX ) )
    {
-      delete bufView_;
-      bufView_ = nullptr;
+      return;
+   }
+
+   const auto mapLength = static_cast<size_t>( physicalLength_ );
 
-      // WARNING: do NOT delete buffer of bufView_ because
-      // pointer is handled by user !!
+#if defined( E57_MMAP_POSIX )
+   void *data = ::mmap( nullptr, mapLength, PROT_READ, MAP_PRIVATE, fd_, 0 );
+
+   if ( data == MAP_FAILED )
+   {
+      return;
    }
+#else
+   const auto fileHandle = reinterpret_cast<HANDLE>( ::_get_osfhandle( fd_ ) );
+
+   if ( fileHandle == INVALID_HANDLE_VALUE )
+   {
+      return;
+   }
+
+   HANDLE mapping = ::CreateFileMappingW( fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr );
+
+   if ( mapping == nullptr )
+   {
+      return;
+   }
+
+   void *data = ::MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+
+   // The view keeps the mapping alive
+   ::CloseHandle( mapping );
+
+   if ( data == nullptr )
+   {
+      return;
+   }
+#endif
+
+   // The mapping stays valid after the file is closed
+   close();
+
+   mappedData_ = data;
+   mappedLength_ = mapLength;
+
+   source_ = std::make_shared<MemoryReadSource>( static_cast<const char *>( mappedData_ ),
+                                                 mappedLength_, fileName_ );
+#endif
+}
+
+void CheckedFile::unmapFile()
+{
+   if ( mappedData_ == nullptr )
+   {
+      return;
+   }
+
+#if defined( E57_MMAP_POSIX )
+   ::munmap( mappedData_, mappedLength_ );
+#elif defined( E57_MMAP_WINDOWS )
+   ::UnmapViewOfFile( mappedData_ );
+#endif
+
+   mappedData_ = nullptr;
+   mappedLength_ = 0;
 }
 
 void CheckedFile::unlink()
 {
+   // No point writing out text for a file being removed
+   textBuffer_.clear();
+   directWriter_.reset();
+   reservedLength_ = 0;
+
+   // What was written to a sink is up to its owner
+   const bool isSink = ( sink_ != nullptr );
+
    close();
 
+   if ( isSink )
+   {
+      return;
+   }
+
    // Try to remove the file, don't report a failure
    int result = std::remove( fileName_.c_str() ); //??? unicode support here
 #ifdef E57_VERBOSE
@@ -686,11 +1251,18 @@ void CheckedFile::unlink()
 #endif
 }
 
-void CheckedFile::verifyChecksum( char *page_buffer, uint64_t page )
+void CheckedFile::verifyChecksum( const char *page_buffer, uint64_t page )
 {
+#ifdef E57_ENABLE_STATISTICS
+   if ( statistics_ != nullptr )
+   {
+      Statistics::add( statistics_->checksumsVerified );
+   }
+#endif
+
    const uint32_t check_sum = checksum( page_buffer, logicalPageSize );
-   const uint32_t check_sum_in_page =
-      *reinterpret_cast<uint32_t *>( &page_buffer[logicalPageSize] );
+   uint32_t check_sum_in_page = 0;
+   memcpy( &check_sum_in_page, &page_buffer[logicalPageSize], sizeof( check_sum_in_page ) );
 
    if ( check_sum_in_page != check_sum )
    {
@@ -703,6 +1275,32 @@ void CheckedFile::verifyChecksum( char *page_buffer, uint64_t page )
    }
 }
 
+// Verify the checksum of a page read at page_data, returning where its good contents are. A writer
+// may be rewriting the last page of a growing file as it is read, so it is read once more (into
+// retry_page) before it is taken to be bad.
+const char *CheckedFile::verifiedPage( const char *page_data, uint64_t page,
+                                       std::vector<char> &retry_page )
+{
+   if ( growing_ )
+   {
+      try
+      {
+         verifyChecksum( page_data, page );
+         return page_data;
+      }
+      catch ( E57Exception & )
+      {
+         retry_page.resize( physicalPageSize );
+         readPhysicalPages( retry_page.data(), page, 1 );
+         page_data = retry_page.data();
+      }
+   }
+
+   verifyChecksum( page_data, page );
+
+   return page_data;
+}
+
 void CheckedFile::getCurrentPageAndOffset( uint64_t &page, size_t &pageOffset, OffsetMode omode )
 {
    const uint64_t pos = position( omode );
@@ -719,67 +1317,251 @@ void CheckedFile::getCurrentPageAndOffset( uint64_t &page, size_t &pageOffset, O
    }
 }
 
-void CheckedFile::readPhysicalPage( char *page_buffer, uint64_t page )
+// Get physical pages for reading. Pages of sources in memory (buffers and mapped files) are used
+// in place; otherwise they are read into page_buffer, which must have room for pageCount pages.
+const char *CheckedFile::physicalPages( char *page_buffer, uint64_t page, size_t pageCount )
+{
+   if ( sourceData_ != nullptr )
+   {
+      const uint64_t pagesEnd = ( page + pageCount ) * physicalPageSize;
+
+      if ( pagesEnd > physicalLength_ )
+      {
+         throw E57_EXCEPTION2( ErrorReadFailed,
+                               "fileName=" + fileName_ + " page=" + toString( page ) +
+                                  " pageCount=" + toString( pageCount ) +
+                                  " size=" + toString( physicalLength_ ) );
+      }
+
+#ifdef E57_ENABLE_STATISTICS
+      if ( statistics_ != nullptr )
+      {
+         Statistics::add( statistics_->pagesRead, pageCount );
+         Statistics::add( statistics_->bytesRead, pageCount * physicalPageSize );
+      }
+#endif
+
+      return sourceData_ + page * physicalPageSize;
+   }
+
+   readPhysicalPages( page_buffer, page, pageCount );
+
+   return page_buffer;
+}
+
+// Read pageCount consecutive physical pages starting at page using a single read.
+void CheckedFile::readPhysicalPages( char *page_buffer, uint64_t page, size_t pageCount )
 {
 #ifdef E57_VERBOSE
-   // cout << "readPhysicalPage, page:" << page << std::endl;
+   // cout << "readPhysicalPages, page:" << page << " pageCount:" << pageCount << std::endl;
 #endif
 
 #ifdef E57_CHECK_FILE_DEBUG
    const uint64_t physicalLength = length( Physical );
 
-   assert( page * physicalPageSize < physicalLength );
+   assert( ( page + pageCount ) * physicalPageSize <= physicalLength );
 #endif
 
-   // Seek to start of physical page
-   seek( page * physicalPageSize, Physical );
+   // Read at the page's offset without using the file position, so several threads can read a
+   // read-only file at once
+   const uint64_t physicalOffset = page * physicalPageSize;
+   const size_t nRead = pageCount * physicalPageSize;
 
-   if ( ( fd_ < 0 ) && ( bufView_ != nullptr ) )
+#ifdef E57_ENABLE_STATISTICS
+   if ( statistics_ != nullptr )
    {
-      bufView_->read( page_buffer, physicalPageSize );
+      Statistics::add( statistics_->pagesRead, pageCount );
+      Statistics::add( statistics_->bytesRead, nRead );
+   }
+#endif
+
+   if ( sourceData_ != nullptr )
+   {
+      if ( physicalOffset + nRead > physicalLength_ )
+      {
+         throw E57_EXCEPTION2( ErrorReadFailed,
+                               "fileName=" + fileName_ + " page=" + toString( page ) +
+                                  " pageCount=" + toString( pageCount ) +
+                                  " size=" + toString( physicalLength_ ) );
+      }
+
+      memcpy( page_buffer, sourceData_ + physicalOffset, nRead );
       return;
    }
 
-#if defined( _MSC_VER )
-   int result = ::_read( fd_, page_buffer, physicalPageSize );
-#elif defined( __GNUC__ )
-   ssize_t result = ::read( fd_, page_buffer, physicalPageSize );
-#else
-#error "no supported compiler defined"
+#ifdef E57_ENABLE_STATISTICS
+   StatisticsTimer timer( ( statistics_ != nullptr ) ? &statistics_->ioNanoseconds : nullptr );
 #endif
 
-   if ( result < 0 || static_cast<size_t>( result ) != physicalPageSize )
+#ifdef E57_ENABLE_TRACING
+   TraceScope trace( "CheckedFile::readPhysicalPages", nRead );
+#endif
+
+   if ( !readOnly_ )
+   {
+      if ( directWriter_ != nullptr )
+      {
+         directWriter_->read( page_buffer, page, pageCount );
+      }
+      else if ( sink_ != nullptr )
+      {
+         try
+         {
+            sink_->readAt( physicalOffset, page_buffer, nRead );
+         }
+         catch ( E57Exception & )
+         {
+            throw;
+         }
+         catch ( std::exception &ex )
+         {
+            throw E57_EXCEPTION2( ErrorReadFailed, "fileName=" + fileName_ + " page=" +
+                                                      toString( page ) + " what=" + ex.what() );
+         }
+         catch ( ... )
+         {
+            throw E57_EXCEPTION2( ErrorReadFailed,
+                                  "fileName=" + fileName_ + " page=" + toString( page ) );
+         }
+      }
+      else
+      {
+         readFileAt( fd_, physicalOffset, page_buffer, nRead, fileName_ );
+      }
+
+      return;
+   }
+
+   if ( source_ == nullptr )
+   {
+      throw E57_EXCEPTION2( ErrorReadFailed, "fileName=" + fileName_ + " closed" );
+   }
+
+   try
+   {
+      if ( pageCount <= cMaxPagesPerTransfer )
+      {
+         source_->readAt( physicalOffset, page_buffer, nRead );
+      }
+      else
+      {
+         std::vector<ReadSource::Range> ranges;
+
+         for ( size_t first = 0; first < pageCount; first += cMaxPagesPerTransfer )
+         {
+            const size_t count = std::min( pageCount - first, cMaxPagesPerTransfer );
+
+            ranges.push_back( { physicalOffset + first * physicalPageSize,
+                                page_buffer + first * physicalPageSize,
+                                count * physicalPageSize } );
+         }
+
+         source_->readRanges( ranges );
+      }
+   }
+   catch ( E57Exception & )
+   {
+      throw;
+   }
+   catch ( std::exception &ex )
+   {
+      throw E57_EXCEPTION2( ErrorReadFailed, "fileName=" + fileName_ + " page=" +
+                                                toString( page ) + " what=" + ex.what() );
+   }
+   catch ( ... )
    {
       throw E57_EXCEPTION2( ErrorReadFailed,
-                            "fileName=" + fileName_ + " result=" + toString( result ) );
+                            "fileName=" + fileName_ + " page=" + toString( page ) );
    }
 }
 
-void CheckedFile::writePhysicalPage( char *page_buffer, uint64_t page )
+// Add checksums to (unless the caller did), then write, pageCount consecutive physical pages
+// starting at page using a single seek.
+void CheckedFile::writePhysicalPages( char *page_buffer, uint64_t page, size_t pageCount,
+                                      bool addChecksums )
 {
 #ifdef E57_VERBOSE
-   // cout << "writePhysicalPage, page:" << page << std::endl;
+   // cout << "writePhysicalPages, page:" << page << " pageCount:" << pageCount << std::endl;
 #endif
 
-   // Append checksum
-   uint32_t check_sum = checksum( page_buffer, logicalPageSize );
-   *reinterpret_cast<uint32_t *>( &page_buffer[logicalPageSize] ) =
-      check_sum; //??? little endian dependency
+   // Append checksums
+   if ( addChecksums )
+   {
+      ::addChecksums( page_buffer, pageCount );
+   }
 
-   // Seek to start of physical page
+   // Seek to start of first physical page
    seek( page * physicalPageSize, Physical );
 
+   const size_t nWrite = pageCount * physicalPageSize;
+   size_t total = 0;
+
+#ifdef E57_ENABLE_STATISTICS
+   StatisticsTimer timer( ( statistics_ != nullptr ) ? &statistics_->ioNanoseconds : nullptr );
+
+   if ( statistics_ != nullptr )
+   {
+      Statistics::add( statistics_->pagesWritten, pageCount );
+      Statistics::add( statistics_->bytesWritten, nWrite );
+   }
+#endif
+
+#ifdef E57_ENABLE_TRACING
+   TraceScope trace( "CheckedFile::writePhysicalPages", nWrite );
+#endif
+
+   if ( directWriter_ != nullptr )
+   {
+      directWriter_->write( page_buffer, page, pageCount );
+
+      // Leave the position after the pages, as if they had been written
+      lseek64( static_cast<int64_t>( ( page + pageCount ) * physicalPageSize ), SEEK_SET );
+
+      return;
+   }
+
+   if ( sink_ != nullptr )
+   {
+      try
+      {
+         sink_->writeAt( page * physicalPageSize, page_buffer, nWrite );
+      }
+      catch ( E57Exception & )
+      {
+         throw;
+      }
+      catch ( std::exception &ex )
+      {
+         throw E57_EXCEPTION2( ErrorWriteFailed, "fileName=" + fileName_ + " page=" +
+                                                    toString( page ) + " what=" + ex.what() );
+      }
+      catch ( ... )
+      {
+         throw E57_EXCEPTION2( ErrorWriteFailed,
+                               "fileName=" + fileName_ + " page=" + toString( page ) );
+      }
+
+      lseek64( static_cast<int64_t>( ( page + pageCount ) * physicalPageSize ), SEEK_SET );
+
+      return;
+   }
+
+   while ( total < nWrite )
+   {
 #if defined( _MSC_VER )
-   int result = ::_write( fd_, page_buffer, physicalPageSize );
+      int result = ::_write( fd_, page_buffer + total, static_cast<unsigned>( nWrite - total ) );
 #elif defined( __GNUC__ )
-   ssize_t result = ::write( fd_, page_buffer, physicalPageSize );
+      ssize_t result = ::write( fd_, page_buffer + total, nWrite - total );
 #else
 #error "no supported compiler defined"
 #endif
 
-   if ( result < 0 )
-   {
-      throw E57_EXCEPTION2( ErrorWriteFailed,
-                            "fileName=" + fileName_ + " result=" + toString( result ) );
+      if ( result < 0 )
+      {
+         throw E57_EXCEPTION2( ErrorWriteFailed,
+                               "fileName=" + fileName_ + " result=" + toString( result ) );
+      }
+
+      total += static_cast<size_t>( result );
    }
 }
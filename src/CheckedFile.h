@@ -28,16 +28,16 @@
 #pragma once
 
 #include <algorithm>
+#include <functional>
+#include <memory>
 
 #include "Common.h"
 
 namespace e57
 {
-   // Tool class to read buffer efficiently without
-   // multiplying copy operations.
-   //
-   // WARNING: pointer input is handled by user!
-   class BufferView;
+   class DirectWriter;
+   class Statistics;
+   class WorkerPool;
 
    class CheckedFile
    {
@@ -53,6 +53,8 @@ namespace e57
       {
          Read,
          Write,
+         ReadWrite,   ///< Open an existing file to add to it, without truncating it
+         ReadGrowing, ///< Read a file which is still being written (see refreshLength())
       };
 
       enum OffsetMode
@@ -61,12 +63,41 @@ namespace e57
          Physical
       };
 
-      CheckedFile( const e57::ustring &fileName, Mode mode, ReadChecksumPolicy policy );
-      CheckedFile( const char *input, uint64_t size, ReadChecksumPolicy policy );
+      /// @param directIo When writing, write the file with direct I/O (see
+      /// ImageFileOptions::directIo). Ignored when reading or adding to a file.
+      CheckedFile( const e57::ustring &fileName, Mode mode, ReadChecksumPolicy policy,
+                   bool directIo = false );
+      CheckedFile( const std::shared_ptr<ReadSource> &source, ReadChecksumPolicy policy );
+
+      /// Write the file to @a sink instead of a local file
+      CheckedFile( const std::shared_ptr<WriteSink> &sink, ReadChecksumPolicy policy );
       ~CheckedFile();
 
       void read( char *buf, size_t nRead, size_t bufSize = 0 );
-      void write( const char *buf, size_t nWrite );
+
+      /// Read @a nRead bytes starting at @a logicalOffset without using or moving the file
+      /// position. On a read-only file, any number of threads may call this at the same time.
+      void readAt( uint64_t logicalOffset, char *buf, size_t nRead );
+
+      /// readAt(), with the pages (and their checksums) shared between the threads of
+      /// @a workers. Files which aren't read-only are read on the calling thread.
+      void readAt( uint64_t logicalOffset, char *buf, size_t nRead, WorkerPool &workers );
+
+      /// Verify the checksum of every page of a read-only file (or of a ReadWrite one before it is
+      /// written to), whatever the checksum policy, spreading the pages across @a threadCount
+      /// threads of executor(). Throws ErrorBadChecksum if any are bad.
+      void verifyChecksums( unsigned threadCount );
+
+      /// Write @a nWrite bytes at the current position. With @a workers, whole pages are copied
+      /// and their checksums computed on its threads, in batches of several transfers.
+      void write( const char *buf, size_t nWrite, WorkerPool *workers = nullptr );
+
+      /// Write @a nWrite bytes read from the open file @a fd starting at @a fileOffset, at the
+      /// current position. The bytes are read straight into the pages to write (with workers,
+      /// on its threads) without moving the position of @a fd. @a sourceName is only used in
+      /// error messages.
+      void writeFromFile( int fd, uint64_t fileOffset, size_t nWrite,
+                          const e57::ustring &sourceName, WorkerPool *workers = nullptr );
       CheckedFile &operator<<( const e57::ustring &s );
       CheckedFile &operator<<( int64_t i );
       CheckedFile &operator<<( uint64_t i );
@@ -77,28 +108,86 @@ namespace e57
       uint64_t length( OffsetMode omode = Logical );
       void extend( uint64_t newLength, OffsetMode omode = Logical );
 
+      /// Ask the file system to allocate space for @a byteCount more logical bytes after the end
+      /// of the file (or of what was reserved before) without changing its length. Whatever isn't
+      /// used is released by close().
+      void reserve( uint64_t byteCount );
+
       e57::ustring fileName() const
       {
          return fileName_;
       }
 
+      bool isReadOnly() const
+      {
+         return readOnly_;
+      }
+
+      /// Counters to update for ImageFile::statistics(), or nullptr
+      Statistics *statistics() const
+      {
+         return statistics_;
+      }
+
+      void setStatistics( Statistics *statistics )
+      {
+         statistics_ = statistics;
+      }
+
+      /// Where the file's parallel work runs (see ImageFileOptions::executor), or nullptr for
+      /// WorkStealingExecutor::defaultExecutor()
+      const std::shared_ptr<Executor> &executor() const
+      {
+         return executor_;
+      }
+
+      void setExecutor( const std::shared_ptr<Executor> &executor )
+      {
+         executor_ = executor;
+      }
+
+      /// Pick up what has been added to a file opened with ReadGrowing since it was opened (or
+      /// since the last call). Must not be called while other threads are reading.
+      void refreshLength();
+
       void close();
       void unlink();
 
+      /// Cut the file down to @a length physical bytes (e.g. to drop what was added to it).
+      void truncate( uint64_t length );
+
       static inline uint64_t logicalToPhysical( uint64_t logicalOffset );
       static inline uint64_t physicalToLogical( uint64_t physicalOffset );
 
    private:
-      void verifyChecksum( char *page_buffer, uint64_t page );
+      /// Puts the source's @a count bytes starting @a offset bytes into a write in the logical
+      /// part of each page starting at @a pages. Must be safe to call on several threads at once.
+      using PageFiller = std::function<void( uint64_t offset, char *pages, size_t count )>;
+
+      /// Write @a nWrite bytes given by @a fill at the current position (see write())
+      void writePages( size_t nWrite, WorkerPool *workers, const PageFiller &fill );
+
+      void verifyChecksum( const char *page_buffer, uint64_t page );
+      const char *verifiedPage( const char *page_data, uint64_t page,
+                                std::vector<char> &retry_page );
 
       template <class FTYPE> CheckedFile &writeFloatingPoint( FTYPE value, int precision );
 
+      /// Write out what operator<< has buffered in textBuffer_
+      void flushText();
+
       void getCurrentPageAndOffset( uint64_t &page, size_t &pageOffset,
                                     OffsetMode omode = Logical );
-      void readPhysicalPage( char *page_buffer, uint64_t page );
-      void writePhysicalPage( char *page_buffer, uint64_t page );
+      const char *physicalPages( char *page_buffer, uint64_t page, size_t pageCount );
+      void readPhysicalPages( char *page_buffer, uint64_t page, size_t pageCount );
+      void mapFile();
+      void unmapFile();
+      void writePhysicalPages( char *page_buffer, uint64_t page, size_t pageCount,
+                               bool addChecksums = true );
       int open64( const e57::ustring &fileName, int flags, int mode );
+      bool preallocate( uint64_t offset, uint64_t count );
       uint64_t lseek64( int64_t offset, int whence );
+      uint64_t seekDescriptor( int64_t offset, int whence );
 
       e57::ustring fileName_;
       uint64_t logicalLength_ = 0;
@@ -107,8 +196,37 @@ namespace e57
       ReadChecksumPolicy checkSumPolicy_ = ChecksumPolicy::ChecksumAll;
 
       int fd_ = -1;
-      BufferView *bufView_ = nullptr;
       bool readOnly_ = false;
+
+      // Opened with ReadGrowing: read with plain reads, and pages are read again before their
+      // checksums are taken to be bad, since the writer may be rewriting them.
+      bool growing_ = false;
+
+      // Physical length the file has space allocated for (see reserve())
+      uint64_t reservedLength_ = 0;
+
+      // Read-only files are read through source_. Local files are memory-mapped if possible (see
+      // E57_ENABLE_MMAP), and pages of sources in memory are used in place (sourceData_).
+      std::shared_ptr<ReadSource> source_;
+      const char *sourceData_ = nullptr;
+      uint64_t readPosition_ = 0;
+
+      // Files written to a WriteSink go through sink_, and keep their position in readPosition_
+      std::shared_ptr<WriteSink> sink_;
+
+      void *mappedData_ = nullptr;
+      size_t mappedLength_ = 0;
+
+      // Text written with operator<< (the XML section) is collected here and written out in
+      // large blocks. Everything else flushes it first, so it is never visible.
+      std::string textBuffer_;
+
+      // Pages waiting to be written with direct I/O (see ImageFileOptions::directIo)
+      std::unique_ptr<DirectWriter> directWriter_;
+
+      Statistics *statistics_ = nullptr;
+
+      std::shared_ptr<Executor> executor_;
    };
 
    inline uint64_t CheckedFile::logicalToPhysical( uint64_t logicalOffset )
@@ -74,6 +74,10 @@ namespace e57
    using NodeImplSharedPtr = std::shared_ptr<class NodeImpl>;
    using NodeImplWeakPtr = std::weak_ptr<class NodeImpl>;
 
+   /// Element name shared by all the nodes of an ImageFileImpl with that name (see
+   /// ImageFileImpl::internName())
+   using InternedName = std::shared_ptr<const std::string>;
+
    using StringList = std::vector<std::string>;
    using StringSet = std::set<std::string>;
 
@@ -141,6 +141,23 @@ parameters to tune. In the ASTM standard, if no codec is specified, the bitPackC
 specifying the @c codecs as an empty VectorNode is equivalent to requesting at all fields in the
 record be encoded with the bitPackCodec.
 
+This library also supports a delta codec extension (URI urn:libE57Format:E57_EXT_delta_codec) for
+Integer and ScaledInteger fields, which stores each value as the difference from the one before it.
+A codecs entry for it is a StructureNode with an @c inputs VectorNode of StringNodes naming the
+fields, and a @c dlt:deltaCodec StructureNode holding a @c dlt:resetInterval IntegerNode. The
+difference is taken from the field's minimum instead of the previous record for the first record and
+every record whose index is a multiple of the interval. With index packets (see
+CompressedVectorWriterOptions::writeIndexPackets) the interval must divide 64 so readers can seek.
+
+An XOR codec extension (URI urn:libE57Format:E57_EXT_xor_codec) stores Float fields losslessly as
+the XOR of their bits with those of the previous record. Its codecs entry holds a @c xor:xorCodec
+StructureNode with a @c xor:resetInterval IntegerNode, which works like the delta codec's.
+
+A zstd codec extension (URI urn:libE57Format:E57_EXT_zstd_codec) compresses the bytestreams of the
+fields named in its @c inputs with zstd after they have been encoded by their other codecs. Its
+codecs entry holds a @c zst:zstdCodec StructureNode with an optional @c zst:level IntegerNode. It
+is only available if the library is built with E57_ENABLE_ZSTD.
+
 Other than the @c prototype and @c codecs attributes, the only other state directly accessible is
 the number of children (records) in the CompressedVectorNode. The read/write access to the contents
 of the CompressedVectorNode is coordinated by two other Foundation API objects:
@@ -443,6 +460,46 @@ CompressedVectorWriter CompressedVectorNode::writer( std::vector<SourceDestBuffe
    return CompressedVectorWriter( impl_->writer( sbufs ) );
 }
 
+/*!
+@brief Create an iterator object for writing a series of blocks of data to a CompressedVectorNode,
+using the given options.
+
+@param [in] sbufs Vector of memory buffers that will hold data to be written to a
+CompressedVectorNode.
+@param [in] options Options controlling how the binary section is written.
+
+@details
+This is identical to CompressedVectorNode::writer(std::vector<SourceDestBuffer>&), except that
+@a options can be used to turn on optional parts of the binary section, such as index packets.
+
+With options.stageInMemory, the records are kept in memory and the binary section is written when
+the writer is closed. Any number of such writers may be open at once on the ImageFile, and each may
+be used and closed on its own thread. Nothing else may write to the file (e.g. a BlobNode) until
+they are all closed, and the tree itself must still be built on one thread.
+
+@return A smart CompressedVectorWriter handle referencing the underlying iterator object.
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorFileReadOnly
+@throw ::ErrorSetTwice
+@throw ::ErrorTooManyWriters
+@throw ::ErrorTooManyReaders
+@throw ::ErrorNodeUnattached
+@throw ::ErrorPathUndefined
+@throw ::ErrorBufferSizeMismatch
+@throw ::ErrorBufferDuplicatePathName
+@throw ::ErrorNoBufferForElement
+@throw ::ErrorInternal All objects in undocumented state
+
+@see CompressedVectorWriterOptions, CompressedVectorNode::writer(std::vector<SourceDestBuffer>&)
+*/
+CompressedVectorWriter CompressedVectorNode::writer( std::vector<SourceDestBuffer> &sbufs,
+                                                     const CompressedVectorWriterOptions &options )
+{
+   return CompressedVectorWriter( impl_->writer( sbufs, options ) );
+}
+
 /*!
 @brief Create an iterator object for reading a series of blocks of data from a CompressedVectorNode.
 
@@ -454,6 +511,12 @@ IntegerNode, ScaledIntegerNode, FloatNode, StringNode) in this CompressedVectorN
 is an error for two SourceDestBuffers in @a dbufs to identify the same terminal node in the
 prototype. It is not an error to create a CompressedVectorReader for an empty CompressedVectorNode.
 
+If the ImageFile was opened for reading, each CompressedVectorReader has its own handle on the
+file, so any number of them may be open at once, and readers (of the same or different
+CompressedVectorNodes) may be used on different threads at the same time. Each reader must only be
+used by one thread at a time. If the ImageFile was opened for writing, only one reader may be open
+at a time.
+
 @pre @a dbufs can't be empty
 @pre The destination ImageFile must be open (i.e. destImageFile().isOpen()).
 @pre The destination ImageFile can't have any writers open (destImageFile().writerCount()==0)
@@ -464,6 +527,7 @@ prototype. It is not an error to create a CompressedVectorReader for an empty Co
 @throw ::ErrorBadAPIArgument
 @throw ::ErrorImageFileNotOpen
 @throw ::ErrorTooManyWriters
+@throw ::ErrorTooManyReaders
 @throw ::ErrorNodeUnattached
 @throw ::ErrorPathUndefined
 @throw ::ErrorBufferSizeMismatch
@@ -478,3 +542,86 @@ CompressedVectorReader CompressedVectorNode::reader( const std::vector<SourceDes
 {
    return CompressedVectorReader( impl_->reader( dbufs ) );
 }
+
+/*!
+@brief Create an iterator object for reading a series of blocks of data from a CompressedVectorNode,
+using the given options.
+
+@param [in] dbufs Vector of memory buffers that will receive data read from a CompressedVectorNode.
+@param [in] options Options controlling how the binary section is read.
+
+@details
+This is identical to CompressedVectorNode::reader(const std::vector<SourceDestBuffer>&), except that
+@a options can be used to tune how the data is decoded, such as decoding the bytestreams on several
+threads.
+
+@return A smart CompressedVectorReader handle referencing the underlying iterator object.
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorTooManyWriters
+@throw ::ErrorTooManyReaders
+@throw ::ErrorNodeUnattached
+@throw ::ErrorPathUndefined
+@throw ::ErrorBufferSizeMismatch
+@throw ::ErrorBufferDuplicatePathName
+@throw ::ErrorBadCVHeader
+@throw ::ErrorInternal All objects in undocumented state
+
+@see CompressedVectorReaderOptions,
+CompressedVectorNode::reader(const std::vector<SourceDestBuffer>&)
+*/
+CompressedVectorReader CompressedVectorNode::reader( const std::vector<SourceDestBuffer> &dbufs,
+                                                     const CompressedVectorReaderOptions &options )
+{
+   return CompressedVectorReader( impl_->reader( dbufs, options ) );
+}
+
+/*!
+@brief Copy the records of another CompressedVectorNode into this one without decoding them.
+
+@param [in] source The CompressedVectorNode to copy the records of. It may be in another ImageFile.
+
+@details
+The binary section of @a source is copied packet by packet into the destination ImageFile. Only the
+offsets in its section header and index packets are changed, so this is much faster than reading
+the records and writing them again. It can be used to pull scans out of a file, or to merge the
+scans of several files into one.
+
+Since the records aren't decoded, this CompressedVectorNode must have been created with the same
+prototype and codecs as @a source: the same fields in the same order, with the same limits, and the
+same codec parameters. The metadata around the node (e.g. a Data3D's pose) isn't copied.
+
+If @a source has never been written, nothing is copied.
+
+@pre The destination ImageFile must be open (i.e. destImageFile().isOpen()).
+@pre The @a destImageFile must have been opened in write mode (i.e. destImageFile.isWritable()).
+@pre The destination ImageFile can't have any readers or writers open
+(destImageFile().readerCount()==0 && destImageFile().writerCount()==0)
+@pre The ImageFile of @a source must be open, and can't have any readers open if it is being
+written.
+@pre This CompressedVectorNode must be attached (i.e. isAttached()).
+@pre This CompressedVectorNode must not have been written.
+
+@post childCount() == source.childCount()
+
+@throw ::ErrorBadAPIArgument The prototypes or the codecs differ.
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorFileReadOnly
+@throw ::ErrorSetTwice
+@throw ::ErrorTooManyWriters
+@throw ::ErrorTooManyReaders
+@throw ::ErrorNodeUnattached
+@throw ::ErrorBadCVHeader
+@throw ::ErrorBadCVPacket
+@throw ::ErrorReadFailed
+@throw ::ErrorWriteFailed
+@throw ::ErrorSeekFailed
+@throw ::ErrorInternal All objects in undocumented state
+
+@see CompressedVectorNode::writer, CompressedVectorNode::prototype, CompressedVectorNode::codecs
+*/
+void CompressedVectorNode::copyFrom( const CompressedVectorNode &source )
+{
+   impl_->copyFrom( *source.impl_ );
+}
@@ -25,14 +25,108 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <vector>
+
 #include "CompressedVectorNodeImpl.h"
 #include "CheckedFile.h"
 #include "CompressedVectorReaderImpl.h"
 #include "CompressedVectorWriterImpl.h"
+#include "FloatNodeImpl.h"
 #include "ImageFileImpl.h"
+#include "IntegerNodeImpl.h"
+#include "Packet.h"
+#include "ScaledIntegerNodeImpl.h"
+#include "SectionHeaders.h"
 #include "StringFunctions.h"
+#include "StringNodeImpl.h"
 #include "VectorNodeImpl.h"
 
+namespace
+{
+   using namespace e57;
+
+   // Logical bytes copied at a time by copyFrom()
+   constexpr size_t cCopyBlockSize = 1024 * 1024;
+
+   // Are the trees @a a and @a b the same, child for child in the same order? This is stricter
+   // than isTypeEquivalent(), since the order of the fields gives the bytestream numbers. With
+   // @a compareValues, the values must match too, which matters for codec parameters.
+   bool sameTree( const NodeImplSharedPtr &a, const NodeImplSharedPtr &b, bool compareValues )
+   {
+      if ( a->type() != b->type() )
+      {
+         return false;
+      }
+
+      switch ( a->type() )
+      {
+         case TypeStructure:
+         case TypeVector:
+         {
+            const auto sa = std::static_pointer_cast<StructureNodeImpl>( a );
+            const auto sb = std::static_pointer_cast<StructureNodeImpl>( b );
+
+            if ( sa->childCount() != sb->childCount() )
+            {
+               return false;
+            }
+
+            for ( int64_t i = 0; i < sa->childCount(); ++i )
+            {
+               const NodeImplSharedPtr ca = sa->get( i );
+               const NodeImplSharedPtr cb = sb->get( i );
+
+               if ( ( ca->elementName() != cb->elementName() ) ||
+                    !sameTree( ca, cb, compareValues ) )
+               {
+                  return false;
+               }
+            }
+
+            return true;
+         }
+
+         case TypeInteger:
+         {
+            const auto ia = std::static_pointer_cast<IntegerNodeImpl>( a );
+            const auto ib = std::static_pointer_cast<IntegerNodeImpl>( b );
+
+            return ( ia->minimum() == ib->minimum() ) && ( ia->maximum() == ib->maximum() ) &&
+                   ( !compareValues || ( ia->value() == ib->value() ) );
+         }
+
+         case TypeScaledInteger:
+         {
+            const auto sa = std::static_pointer_cast<ScaledIntegerNodeImpl>( a );
+            const auto sb = std::static_pointer_cast<ScaledIntegerNodeImpl>( b );
+
+            return ( sa->minimum() == sb->minimum() ) && ( sa->maximum() == sb->maximum() ) &&
+                   ( sa->scale() == sb->scale() ) && ( sa->offset() == sb->offset() ) &&
+                   ( !compareValues || ( sa->rawValue() == sb->rawValue() ) );
+         }
+
+         case TypeFloat:
+         {
+            const auto fa = std::static_pointer_cast<FloatNodeImpl>( a );
+            const auto fb = std::static_pointer_cast<FloatNodeImpl>( b );
+
+            return ( fa->precision() == fb->precision() ) && ( fa->minimum() == fb->minimum() ) &&
+                   ( fa->maximum() == fb->maximum() ) &&
+                   ( !compareValues || ( fa->value() == fb->value() ) );
+         }
+
+         case TypeString:
+            return !compareValues || ( std::static_pointer_cast<StringNodeImpl>( a )->value() ==
+                                       std::static_pointer_cast<StringNodeImpl>( b )->value() );
+
+         default:
+            // Blobs and CompressedVectors can't be in prototypes or codecs
+            return false;
+      }
+   }
+}
+
 namespace e57
 {
    CompressedVectorNodeImpl::CompressedVectorNodeImpl( ImageFileImplWeakPtr destImageFile ) :
@@ -215,7 +309,7 @@ namespace e57
       }
       else
       {
-         fieldName = elementName_;
+         fieldName = elementNameRef();
       }
 
       uint64_t physicalStart = cf.logicalToPhysical( binarySectionLogicalStart_ );
@@ -266,20 +360,14 @@ namespace e57
 #endif
 
    std::shared_ptr<CompressedVectorWriterImpl> CompressedVectorNodeImpl::writer(
-      std::vector<SourceDestBuffer> sbufs )
+      std::vector<SourceDestBuffer> sbufs, const CompressedVectorWriterOptions &options )
    {
       checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
 
       ImageFileImplSharedPtr destImageFile( destImageFile_ );
 
-      // Check don't have any writers/readers open for this ImageFile
-      if ( destImageFile->writerCount() > 0 )
-      {
-         throw E57_EXCEPTION2( ErrorTooManyWriters,
-                               "fileName=" + destImageFile->fileName() +
-                                  " writerCount=" + toString( destImageFile->writerCount() ) +
-                                  " readerCount=" + toString( destImageFile->readerCount() ) );
-      }
+      // Check don't have any readers open for this ImageFile (writers are checked below, as
+      // this one is counted)
       if ( destImageFile->readerCount() > 0 )
       {
          throw E57_EXCEPTION2( ErrorTooManyReaders,
@@ -311,14 +399,216 @@ namespace e57
       std::shared_ptr<CompressedVectorNodeImpl> cai(
          std::static_pointer_cast<CompressedVectorNodeImpl>( ni ) );
 
-      // Return a shared_ptr to new object
-      std::shared_ptr<CompressedVectorWriterImpl> cvwi(
-         new CompressedVectorWriterImpl( cai, sbufs ) );
-      return ( cvwi );
+      // Count the writer before making it, so no other can be opened in the meantime. It's
+      // uncounted again when it closes.
+      if ( !destImageFile->tryAddWriter( options.stageInMemory ) )
+      {
+         throw E57_EXCEPTION2( ErrorTooManyWriters,
+                               "fileName=" + destImageFile->fileName() +
+                                  " writerCount=" + toString( destImageFile->writerCount() ) +
+                                  " readerCount=" + toString( destImageFile->readerCount() ) );
+      }
+
+      try
+      {
+         // Return a shared_ptr to new object
+         std::shared_ptr<CompressedVectorWriterImpl> cvwi(
+            new CompressedVectorWriterImpl( cai, sbufs, options ) );
+         return ( cvwi );
+      }
+      catch ( ... )
+      {
+         destImageFile->decrWriterCount( options.stageInMemory );
+         throw;
+      }
+   }
+
+   void CompressedVectorNodeImpl::copyFrom( const CompressedVectorNodeImpl &source )
+   {
+      checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+      source.checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+
+      ImageFileImplSharedPtr destImageFile( destImageFile_ );
+      ImageFileImplSharedPtr sourceImageFile( source.destImageFile_ );
+
+      // Nothing else may be using the file we write to, as for writer()
+      if ( destImageFile->writerCount() > 0 )
+      {
+         throw E57_EXCEPTION2( ErrorTooManyWriters,
+                               "fileName=" + destImageFile->fileName() +
+                                  " writerCount=" + toString( destImageFile->writerCount() ) +
+                                  " readerCount=" + toString( destImageFile->readerCount() ) );
+      }
+      if ( destImageFile->readerCount() > 0 )
+      {
+         throw E57_EXCEPTION2( ErrorTooManyReaders,
+                               "fileName=" + destImageFile->fileName() +
+                                  " writerCount=" + toString( destImageFile->writerCount() ) +
+                                  " readerCount=" + toString( destImageFile->readerCount() ) );
+      }
+
+      // A file being written has one handle, so it can't be copied from while a reader uses it
+      if ( sourceImageFile->isWriter() && ( sourceImageFile->readerCount() > 0 ) )
+      {
+         throw E57_EXCEPTION2( ErrorTooManyReaders,
+                               "fileName=" + sourceImageFile->fileName() +
+                                  " writerCount=" + toString( sourceImageFile->writerCount() ) +
+                                  " readerCount=" + toString( sourceImageFile->readerCount() ) );
+      }
+
+      if ( !destImageFile->isWriter() )
+      {
+         throw E57_EXCEPTION2( ErrorFileReadOnly, "fileName=" + destImageFile->fileName() );
+      }
+
+      if ( !isAttached() )
+      {
+         throw E57_EXCEPTION2( ErrorNodeUnattached, "fileName=" + destImageFile->fileName() );
+      }
+
+      if ( binarySectionLogicalStart_ != 0 )
+      {
+         throw E57_EXCEPTION2( ErrorSetTwice, "this->pathName=" + this->pathName() );
+      }
+
+      // The records are copied as they are, so they must mean the same thing here
+      if ( !sameTree( prototype_, source.prototype_, false ) ||
+           !sameTree( codecs_, source.codecs_, true ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "this->pathName=" + this->pathName() +
+                                                       " sourcePathName=" + source.pathName() );
+      }
+
+      // A CompressedVectorNode which was never written has no section to copy
+      if ( source.binarySectionLogicalStart_ == 0 )
+      {
+         return;
+      }
+
+      CheckedFile *sourceFile = sourceImageFile->file_;
+      CheckedFile *destFile = destImageFile->file_;
+
+      const uint64_t sourceStart = source.binarySectionLogicalStart_;
+
+      CompressedVectorSectionHeader header;
+      sourceFile->readAt( sourceStart, reinterpret_cast<char *>( &header ), sizeof( header ) );
+
+      header.verify( sourceFile->length( CheckedFile::Physical ) );
+
+      const uint64_t sourceEnd = sourceStart + header.sectionLogicalLength;
+      const uint64_t destStart = destImageFile->allocateSpace( header.sectionLogicalLength, false );
+
+      // Where a physical offset in the source section ends up in the copy
+      auto destPhysical = [&]( uint64_t sourcePhysical ) {
+         const uint64_t logical = CheckedFile::physicalToLogical( sourcePhysical );
+
+         if ( ( logical < sourceStart + sizeof( header ) ) || ( logical >= sourceEnd ) )
+         {
+            throw E57_EXCEPTION2( ErrorBadCVHeader,
+                                  "physicalOffset=" + toString( sourcePhysical ) +
+                                     " sectionLogicalStart=" + toString( sourceStart ) +
+                                     " sectionLogicalLength=" +
+                                     toString( header.sectionLogicalLength ) );
+         }
+
+         return CheckedFile::logicalToPhysical( destStart + ( logical - sourceStart ) );
+      };
+
+      // Copy the packets as they are. The checksums of the pages they land on are worked out
+      // as they are written.
+      {
+         std::vector<char> block( cCopyBlockSize );
+
+         for ( uint64_t offset = sizeof( header ); offset < header.sectionLogicalLength; )
+         {
+            const auto count = static_cast<size_t>(
+               std::min<uint64_t>( block.size(), header.sectionLogicalLength - offset ) );
+
+            sourceFile->readAt( sourceStart + offset, block.data(), count );
+
+            destFile->seek( destStart + offset );
+            destFile->write( block.data(), count );
+
+            offset += count;
+         }
+      }
+
+      // Index packets hold the physical offsets of the packets they index, so they have to be
+      // rewritten. Walk down the index tree from the top one.
+      if ( header.indexPhysicalOffset != 0 )
+      {
+         std::vector<uint64_t> pending{ header.indexPhysicalOffset };
+         size_t visited = 0;
+
+         IndexPacket packet;
+
+         while ( !pending.empty() )
+         {
+            const uint64_t sourcePhysical = pending.back();
+            pending.pop_back();
+
+            // Each index packet is at least a header long, so this many can't be a tree
+            if ( ++visited > header.sectionLogicalLength / sizeof( IndexPacketHeader ) )
+            {
+               throw E57_EXCEPTION2( ErrorBadCVPacket, "indexPacketCount=" + toString( visited ) );
+            }
+
+            const uint64_t packetPhysical = destPhysical( sourcePhysical );
+            const uint64_t packetLogical = CheckedFile::physicalToLogical( sourcePhysical );
+
+            sourceFile->readAt( packetLogical, reinterpret_cast<char *>( &packet.header ),
+                                sizeof( packet.header ) );
+
+            const unsigned packetLength = packet.header.packetLogicalLengthMinus1 + 1U;
+
+            if ( ( packet.header.packetType != INDEX_PACKET ) ||
+                 ( packetLength > sizeof( packet ) ) ||
+                 ( packetLogical + packetLength > sourceEnd ) )
+            {
+               throw E57_EXCEPTION2( ErrorBadCVPacket,
+                                     "packetType=" + toString( packet.header.packetType ) +
+                                        " packetLength=" + toString( packetLength ) );
+            }
+
+            sourceFile->readAt( packetLogical, reinterpret_cast<char *>( &packet ), packetLength );
+
+            packet.verify( packetLength, static_cast<uint64_t>( source.recordCount_ ) );
+
+            for ( unsigned i = 0; i < packet.header.entryCount; ++i )
+            {
+               if ( packet.header.indexLevel > 0 )
+               {
+                  pending.push_back( packet.entries[i].chunkPhysicalOffset );
+               }
+
+               packet.entries[i].chunkPhysicalOffset =
+                  destPhysical( packet.entries[i].chunkPhysicalOffset );
+            }
+
+            destFile->seek( CheckedFile::physicalToLogical( packetPhysical ) );
+            destFile->write( reinterpret_cast<const char *>( &packet ), packetLength );
+         }
+      }
+
+      // The section starts at a different place in this file
+      if ( header.dataPhysicalOffset != 0 )
+      {
+         header.dataPhysicalOffset = destPhysical( header.dataPhysicalOffset );
+      }
+      if ( header.indexPhysicalOffset != 0 )
+      {
+         header.indexPhysicalOffset = destPhysical( header.indexPhysicalOffset );
+      }
+
+      destFile->seek( destStart );
+      destFile->write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+
+      recordCount_ = source.recordCount_;
+      binarySectionLogicalStart_ = destStart;
    }
 
    std::shared_ptr<CompressedVectorReaderImpl> CompressedVectorNodeImpl::reader(
-      std::vector<SourceDestBuffer> dbufs )
+      std::vector<SourceDestBuffer> dbufs, const CompressedVectorReaderOptions &options )
    {
       checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
 
@@ -332,7 +622,11 @@ namespace e57
                                   " writerCount=" + toString( destImageFile->writerCount() ) +
                                   " readerCount=" + toString( destImageFile->readerCount() ) );
       }
-      if ( destImageFile->readerCount() > 0 )
+
+      // Readers of a file opened for reading each have their own file handle, so any number of
+      // them can be open (and used on different threads) at once. A file being written has
+      // only one handle, so only one reader can use it at a time.
+      if ( destImageFile->isWriter() && ( destImageFile->readerCount() > 0 ) )
       {
          throw E57_EXCEPTION2( ErrorTooManyReaders,
                                "fileName=" + destImageFile->fileName() +
@@ -368,7 +662,7 @@ namespace e57
 #endif
       // Return a shared_ptr to new object
       std::shared_ptr<CompressedVectorReaderImpl> cvri(
-         new CompressedVectorReaderImpl( cai, dbufs ) );
+         new CompressedVectorReaderImpl( cai, dbufs, options ) );
       return ( cvri );
    }
 }
@@ -58,8 +58,13 @@ namespace e57
                      const char *forcedFieldName = nullptr ) override;
 
       /// Iterator constructors
-      std::shared_ptr<CompressedVectorWriterImpl> writer( std::vector<SourceDestBuffer> sbufs );
-      std::shared_ptr<CompressedVectorReaderImpl> reader( std::vector<SourceDestBuffer> dbufs );
+      std::shared_ptr<CompressedVectorWriterImpl> writer(
+         std::vector<SourceDestBuffer> sbufs, const CompressedVectorWriterOptions &options = {} );
+      std::shared_ptr<CompressedVectorReaderImpl> reader(
+         std::vector<SourceDestBuffer> dbufs, const CompressedVectorReaderOptions &options = {} );
+
+      /// Copy the binary section of @a source into this one's file without decoding it.
+      void copyFrom( const CompressedVectorNodeImpl &source );
 
       int64_t getRecordCount() const
       {
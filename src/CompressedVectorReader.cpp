@@ -254,6 +254,70 @@ unsigned CompressedVectorReader::read( std::vector<SourceDestBuffer> &dbufs )
    return impl_->read( dbufs );
 }
 
+/*!
+@brief Start reading the next block of records into the current buffers on a background thread.
+
+@details
+Does what CompressedVectorReader::read() does on one of the library's background threads, so the
+caller can carry on (for example processing the records of another reader) while the records are
+read and decoded. The returned future holds the number of records read, or the exception read()
+would have thrown.
+
+Any number of reads may be started before the first one finishes. They run one after another in
+the order they were started, so each one continues where the one before it stopped. Reads of
+different readers run at the same time. The buffers must not be used until their read is done.
+
+Calling read(), seek(), or close() first waits for the reads already started to finish.
+
+@pre The associated ImageFile must be open.
+@pre This CompressedVectorReader must be open (i.e isOpen())
+
+@return A future which becomes ready when the read is done.
+
+@see CompressedVectorReader::read(), CompressedVectorReader::readAsync(const ReadCompletion &)
+*/
+std::future<unsigned> CompressedVectorReader::readAsync()
+{
+   return impl_->readAsync( {} );
+}
+
+/*!
+@brief Start reading the next block of records into new buffers on a background thread.
+
+@param [in] dbufs Vector of memory buffers that will receive data read from a CompressedVectorNode.
+
+@details
+Like CompressedVectorReader::readAsync(), but first designates @a dbufs the way
+CompressedVectorReader::read(std::vector<SourceDestBuffer>&) does. Problems with @a dbufs are
+reported through the future.
+
+@return A future which becomes ready when the read is done.
+
+@see CompressedVectorReader::read(std::vector<SourceDestBuffer>&),
+CompressedVectorReader::readAsync()
+*/
+std::future<unsigned> CompressedVectorReader::readAsync(
+   const std::vector<SourceDestBuffer> &dbufs )
+{
+   return impl_->readAsync( dbufs );
+}
+
+/*!
+@brief Start reading the next block of records on a background thread, calling a function when done.
+
+@param [in] done Called with the number of records read, or the exception the read threw.
+
+@details
+Like CompressedVectorReader::readAsync(), but calls @a done on the background thread instead of
+returning a future. @a done may start the next read.
+
+@see CompressedVectorReader::readAsync(), ReadCompletion
+*/
+void CompressedVectorReader::readAsync( const ReadCompletion &done )
+{
+   impl_->readAsync( {}, done );
+}
+
 /*!
 @brief Set record number of CompressedVectorNode where next read will start.
 
@@ -265,6 +329,12 @@ This function may be called at any time (as long as ImageFile and CompressedVect
 The next read will start at the given recordNumber. It is not an error to seek to recordNumber =
 childCount() (i.e. to one record past end of CompressedVectorNode).
 
+If the binary section has index packets, they are used to find the chunk containing
+@a recordNumber. Otherwise the first seek reads the header of every data packet in the section to
+build a directory which is reused by later seeks. Bytestreams of fixed-width values are entered
+directly at the requested record; string bytestreams are decoded forward from the start of the
+chunk (or section).
+
 @pre @a recordNumber <= childCount() of CompressedVectorNode.
 @pre The associated ImageFile must be open.
 @pre This CompressedVectorReader must be open (i.e isOpen())
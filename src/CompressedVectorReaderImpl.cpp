@@ -25,20 +25,30 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <type_traits>
+
 #include "CompressedVectorReaderImpl.h"
+#include "BitpackKernels.h"
 #include "CheckedFile.h"
 #include "CompressedVectorNodeImpl.h"
 #include "ImageFileImpl.h"
 #include "Packet.h"
 #include "SectionHeaders.h"
 #include "SourceDestBufferImpl.h"
+#include "Statistics.h"
 #include "StringFunctions.h"
+#include "TaskQueue.h"
+#include "Tracing.h"
+#include "WorkerPool.h"
 
 namespace e57
 {
    CompressedVectorReaderImpl::CompressedVectorReaderImpl(
-      std::shared_ptr<CompressedVectorNodeImpl> cvi,
-      std::vector<SourceDestBuffer> &dbufs ) :
+      std::shared_ptr<CompressedVectorNodeImpl> cvi, std::vector<SourceDestBuffer> &dbufs,
+      const CompressedVectorReaderOptions &options ) :
       isOpen_( false ), // set to true when succeed below
       cVector_( cvi )
    {
@@ -67,27 +77,38 @@ namespace e57
       // Check dbufs well formed (matches proto exactly)
       setBuffers( dbufs );
 
+      // Add any buffers the filter needs before the decoders are made
+      setUpRecordFilter( options.recordFilter );
+
       // For each dbuf, create an appropriate Decoder based on the cVector_
       // attributes
       for ( unsigned i = 0; i < dbufs_.size(); i++ )
       {
          std::vector<SourceDestBuffer> theDbuf;
-         theDbuf.push_back( dbufs.at( i ) );
+         theDbuf.push_back( dbufs_.at( i ) );
 
          std::shared_ptr<Decoder> decoder =
             Decoder::DecoderFactory( i, cVector_.get(), theDbuf, ustring() );
 
          // Calc which stream the given path belongs to.  This depends on position
          // of the node in the proto tree.
-         NodeImplSharedPtr readNode = proto_->get( dbufs.at( i ).pathName() );
+         NodeImplSharedPtr readNode = proto_->get( dbufs_.at( i ).pathName() );
          uint64_t bytestreamNumber = 0;
          if ( !proto_->findTerminalPosition( readNode, bytestreamNumber ) )
          {
             throw E57_EXCEPTION2( ErrorInternal, "dbufIndex=" + toString( i ) );
          }
 
-         channels_.emplace_back( dbufs.at( i ), decoder, static_cast<unsigned>( bytestreamNumber ),
+         channels_.emplace_back( dbufs_.at( i ), decoder,
+                                 static_cast<unsigned>( bytestreamNumber ),
                                  cVector_->childCount() );
+
+#ifdef E57_ENABLE_STATISTICS
+         ChannelStatistics channelStatistics;
+         channelStatistics.pathName = cVector_->pathName() + "/" + dbufs_.at( i ).pathName();
+
+         channelStatistics_.push_back( channelStatistics );
+#endif
       }
 
       recordCount_ = 0;
@@ -97,6 +118,8 @@ namespace e57
 
       ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
 
+      file_ = imf->file_;
+
       // Check the file offset of this vector - it must be positive
       uint64_t sectionLogicalStart = cVector_->getBinarySectionLogicalStart();
       if ( sectionLogicalStart == 0 )
@@ -118,11 +141,10 @@ namespace e57
 
       // Read CompressedVector section header
       CompressedVectorSectionHeader sectionHeader;
-      imf->file_->seek( sectionLogicalStart, CheckedFile::Logical );
-      imf->file_->read( reinterpret_cast<char *>( &sectionHeader ), sizeof( sectionHeader ) );
+      imf->readSectionHeader( sectionLogicalStart, sectionHeader );
 
 #if VALIDATE_BASIC
-      sectionHeader.verify( imf->file_->length( CheckedFile::Physical ) );
+      sectionHeader.verify( file_->length( CheckedFile::Physical ) );
 #endif
 
       // Pre-calc end of section, so can tell when we are out of packets.
@@ -130,39 +152,116 @@ namespace e57
 
       // Convert physical offset to first data packet to logical
       uint64_t dataLogicalOffset =
-         imf->file_->physicalToLogical( sectionHeader.dataPhysicalOffset );
+         file_->physicalToLogical( sectionHeader.dataPhysicalOffset );
+
+      dataLogicalOffset_ = dataLogicalOffset;
+
+      // Index packets are optional. Remember where the top one is so seek() can use it.
+      indexLogicalOffset_ = 0;
+      if ( sectionHeader.indexPhysicalOffset != 0 )
+      {
+         indexLogicalOffset_ = file_->physicalToLogical( sectionHeader.indexPhysicalOffset );
+      }
+
+      if ( options.recordStride == 0 )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "recordStride=0 imageFileName=" +
+                                                       cVector_->imageFileName() +
+                                                       " cvPathName=" + cVector_->pathName() );
+      }
+
+      for ( auto &channel : channels_ )
+      {
+         channel.decoder->setRecordStride( options.recordStride );
+      }
+
+      if ( options.packetCacheSize == 0 )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "packetCacheSize=0 imageFileName=" +
+                                                       cVector_->imageFileName() +
+                                                       " cvPathName=" + cVector_->pathName() );
+      }
+
+      if ( options.progressPacketInterval == 0 )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "progressPacketInterval=0 imageFileName=" +
+                                                       cVector_->imageFileName() +
+                                                       " cvPathName=" + cVector_->pathName() );
+      }
+
+      progress_ = options.progress;
+      progressPacketInterval_ = options.progressPacketInterval;
+      cancellation_ = options.cancellation;
 
       //??? what if fault in this constructor?
-      cache_ = new PacketReadCache( imf->file_, 32 );
+      cache_ = new PacketReadCache( file_, options.packetCacheSize, imf->memoryAccount(),
+                                    imf->sharedPacketCache() );
 
-      // Verify that packet given by dataPhysicalOffset is actually a data packet,
-      // init channels
+      // The section of a file being followed grows, and other sections are read while it does
+      if ( !imf->isFollowing() )
       {
-         char *anyPacket = nullptr;
-         std::unique_ptr<PacketLock> packetLock = cache_->lock( dataLogicalOffset, anyPacket );
+         cache_->enableReadAhead( options.readAheadPacketCount, sectionEndLogicalOffset_ );
+      }
+
+      // There is no point in having more threads than channels
+      const auto decodeThreadCount =
+         std::min( options.decodeThreadCount, static_cast<unsigned>( channels_.size() ) );
+      if ( decodeThreadCount > 1 )
+      {
+         workers_.reset( new WorkerPool( decodeThreadCount, imf->executor() ) );
+      }
 
-         auto dpkt = reinterpret_cast<DataPacket *>( anyPacket );
+      decodeTileSize_ = options.decodeTileSize;
 
-         // Double check that have a data packet
-         if ( dpkt->header.packetType != DATA_PACKET )
+      convertSpherical_ = findPointDbufs( options.sphericalFields, sphericalDbufs_ );
+
+      transform_ = findPointDbufs( options.transformFields, transformDbufs_ );
+      transformMatrix_ = options.transformMatrix;
+
+      for ( const auto &reduction : options.reductions )
+      {
+         if ( !reduction )
          {
-            throw E57_EXCEPTION2( ErrorBadCVPacket,
-                                  "packetType=" + toString( dpkt->header.packetType ) );
+            throw E57_EXCEPTION2( ErrorBadAPIArgument, "reduction=nullptr imageFileName=" +
+                                                          cVector_->imageFileName() +
+                                                          " cvPathName=" + cVector_->pathName() );
+         }
+      }
+
+      reductions_ = options.reductions;
+
+      // Verify that packet given by dataPhysicalOffset is actually a data packet
+      {
+         uint8_t packetType = 0;
+         std::vector<uint16_t> bytestreamLengths;
+
+         readPacketHeader( dataLogicalOffset_, packetType, bytestreamLengths );
+
+         if ( packetType != DATA_PACKET )
+         {
+            throw E57_EXCEPTION2( ErrorBadCVPacket, "packetType=" + toString( packetType ) );
          }
+      }
+
+      buildPacketDirectory();
 
-         // Have good packet, initialize channels if we have records
-         if ( maxRecordCount_ > 0 )
+      // Start each channel at the first packet with data for it, if we have records
+      if ( maxRecordCount_ > 0 )
+      {
+         for ( size_t i = 0; i < channels_.size(); ++i )
          {
-            for ( auto &channel : channels_ )
+            setChannelPacket( i, 0 );
+
+            if ( channels_[i].currentBytestreamBufferLength == 0 )
             {
-               channel.currentPacketLogicalOffset = dataLogicalOffset;
-               channel.currentBytestreamBufferIndex = 0;
-               channel.currentBytestreamBufferLength =
-                  dpkt->getBytestreamBufferLength( channel.bytestreamNumber );
+               skipToPacketWithData( i );
             }
          }
       }
 
+      decoderCharge_ = MemoryCharge( imf->memoryAccount(), MemoryAccount::Decoders );
+      chargeDecoders();
+
       // Just before return (and can't throw) increment reader count  ??? safer
       // way to assure don't miss close?
       imf->incrReaderCount();
@@ -178,6 +277,9 @@ namespace e57
                                                                         // dump(4);
 #endif
 
+      // The reads still running use everything below
+      asyncReads_.reset();
+
       if ( isOpen_ )
       {
          try
@@ -220,6 +322,16 @@ namespace e57
       }
 
       dbufs_ = dbufs;
+
+      // The decoders write to the buffers they were made with, so hand them the new ones. The
+      // constructor calls this before there are any.
+      for ( size_t i = 0; i < channels_.size(); ++i )
+      {
+         std::vector<SourceDestBuffer> theDbuf{ dbufs_[i] };
+
+         channels_[i].dbuf = dbufs_[i];
+         channels_[i].decoder->destBufferSetNew( theDbuf );
+      }
    }
 
    unsigned CompressedVectorReaderImpl::read( std::vector<SourceDestBuffer> &dbufs )
@@ -227,10 +339,15 @@ namespace e57
       // don't checkImageFileOpen(__FILE__, __LINE__, __FUNCTION__), read() will
       // do it
 
+      waitForAsyncReads();
+
       checkReaderOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
 
-      // Check compatible with current dbufs
-      setBuffers( dbufs );
+      // Check compatible with current dbufs. The filter's own buffers stay the same.
+      std::vector<SourceDestBuffer> allDbufs = dbufs;
+      allDbufs.insert( allDbufs.end(), filterDbufs_.begin(), filterDbufs_.end() );
+
+      setBuffers( allDbufs );
 
       return ( read() );
    }
@@ -240,8 +357,17 @@ namespace e57
 #ifdef E57_VERBOSE
       std::cout << "CompressedVectorReaderImpl::read() called" << std::endl; //???
 #endif
+
+#ifdef E57_ENABLE_TRACING
+      TraceScope trace( "CompressedVectorReaderImpl::read" );
+#endif
+      waitForAsyncReads();
+
       checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
       checkReaderOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+      checkCancelled();
+
+      extendIfGrown();
 
       // Rewind all dbufs so start writing to them at beginning
       for ( auto &dbuf : dbufs_ )
@@ -249,31 +375,55 @@ namespace e57
          dbuf.impl()->rewind();
       }
 
-      // Allow decoders to use data they already have in their queue to fill newly
-      // empty dbufs This helps to keep decoder input queues smaller, which
-      // reduces backtracking in the packet cache.
-      for ( auto &channel : channels_ )
-      {
-         channel.decoder->inputProcess( nullptr, 0 );
-      }
+      makePartials();
 
-      // Loop until every dbuf is full or we have reached end of the binary
-      // section.
-      while ( true )
+      if ( ( ( decodeTileSize_ == 0 ) || ( channels_.size() < 2 ) ) && filters_.empty() )
       {
-         // Find the earliest packet position for channels that are still hungry
-         // It's important to call inputProcess of the decoders before this call,
-         // so current hungriness level is reflected.
-         uint64_t earliestPacketLogicalOffset = earliestPacketNeededForInput();
+         decodeRecords();
 
-         // If nobody's hungry, we are done with the read
-         if ( earliestPacketLogicalOffset == UINT64_MAX )
+         transformRecords( 0, channels_.front().dbuf.impl()->nextIndex() );
+         reduceRecords( 0 );
+      }
+      else
+      {
+         // Fill the dbufs a tile at a time so that all the fields of each record are written
+         // while it is still in the cache. Each tile is decoded just like a read() into dbufs of
+         // the tile size would be. Filtered records are dropped from each tile before the next
+         // one is decoded after the ones kept.
+         const size_t capacity = dbufs_.front().impl()->capacity();
+         const size_t tileSize =
+            ( ( decodeTileSize_ == 0 ) || ( channels_.size() < 2 ) ) ? capacity : decodeTileSize_;
+
+         for ( size_t tileBegin = 0;; )
          {
-            break;
+            const size_t limit = std::min( tileBegin + tileSize, capacity );
+
+            for ( auto &dbuf : dbufs_ )
+            {
+               dbuf.impl()->setLimit( limit );
+            }
+
+            decodeRecords();
+
+            const size_t decoded = channels_.front().dbuf.impl()->nextIndex();
+
+            transformRecords( tileBegin, decoded );
+            filterRecords( tileBegin );
+            reduceRecords( tileBegin );
+
+            tileBegin = channels_.front().dbuf.impl()->nextIndex();
+
+            // Stop at the end of the dbufs, or if we ran out of records
+            if ( ( tileBegin == capacity ) || ( decoded < limit ) )
+            {
+               break;
+            }
          }
 
-         // Feed packet to the hungry decoders
-         feedPacketToDecoders( earliestPacketLogicalOffset );
+         for ( auto &dbuf : dbufs_ )
+         {
+            dbuf.impl()->setLimit( SIZE_MAX );
+         }
       }
 
       // Verify that each channel produced the same number of records
@@ -296,261 +446,1097 @@ namespace e57
          }
       }
 
-      // Return number of records transferred to each dbuf.
-      return outputCount;
-   }
+#ifdef E57_ENABLE_STATISTICS
+      for ( auto &channelStatistics : channelStatistics_ )
+      {
+         channelStatistics.recordsRead += outputCount;
+      }
 
-   uint64_t CompressedVectorReaderImpl::earliestPacketNeededForInput() const
-   {
-      uint64_t earliestPacketLogicalOffset = UINT64_MAX;
-#ifdef E57_VERBOSE
-      unsigned earliestChannel = 0;
+      file_->statistics()->addChannels( channelStatistics_ );
 #endif
 
-      for ( unsigned i = 0; i < channels_.size(); i++ )
-      {
-         const DecodeChannel *chan = &channels_[i];
+      chargeDecoders();
 
-         // Test if channel needs more input.
-         // Important to call inputProcess just before this, so these tests work.
-         if ( !chan->isOutputBlocked() && !chan->inputFinished )
-         {
-            // Check if earliest so far
-            if ( chan->currentPacketLogicalOffset < earliestPacketLogicalOffset )
-            {
-               earliestPacketLogicalOffset = chan->currentPacketLogicalOffset;
-#ifdef E57_VERBOSE
-               earliestChannel = i;
-#endif
-            }
-         }
-      }
-#ifdef E57_VERBOSE
-      if ( earliestPacketLogicalOffset == UINT64_MAX )
-      {
-         std::cout << "earliestPacketNeededForInput returning none found" << std::endl;
-      }
-      else
+      combinePartials();
+
+      if ( progress_ )
       {
-         std::cout << "earliestPacketNeededForInput returning " << earliestPacketLogicalOffset
-                   << " for channel[" << earliestChannel << "]" << std::endl;
+         packetsSinceProgress_ = 0;
+         reportProgress();
       }
-#endif
-      return earliestPacketLogicalOffset;
+
+      // Return number of records transferred to each dbuf.
+      return outputCount;
    }
 
-   DataPacket *CompressedVectorReaderImpl::dataPacket( uint64_t inLogicalOffset ) const
+   void CompressedVectorReaderImpl::chargeDecoders()
    {
-      char *packet = nullptr;
+      uint64_t bytes = 0;
 
-      std::unique_ptr<PacketLock> packetLock = cache_->lock( inLogicalOffset, packet );
+      for ( const auto &channel : channels_ )
+      {
+         bytes += channel.decoder->bufferSize();
+      }
 
-      return reinterpret_cast<DataPacket *>( packet );
+      decoderCharge_.set( bytes );
    }
 
-   inline bool _alreadyReadPacket( const DecodeChannel &channel,
-                                   uint64_t currentPacketLogicalOffset )
+   void CompressedVectorReaderImpl::checkCancelled() const
    {
-      return ( ( channel.currentPacketLogicalOffset != currentPacketLogicalOffset ) ||
-               channel.isOutputBlocked() );
+      if ( cancellation_ && cancellation_->isCancelled() )
+      {
+         throw E57_EXCEPTION2( ErrorCancelled, "imageFileName=" + cVector_->imageFileName() +
+                                                  " cvPathName=" + cVector_->pathName() );
+      }
    }
 
-   void CompressedVectorReaderImpl::feedPacketToDecoders( uint64_t currentPacketLogicalOffset )
+   // Every packet before the earliest one a channel still needs has been decoded, so the bytes
+   // done are up to where that packet starts.
+   void CompressedVectorReaderImpl::reportProgress()
    {
-      // Get packet at currentPacketLogicalOffset into memory.
-      auto dpkt = dataPacket( currentPacketLogicalOffset );
+      CompressedVectorProgress progress;
+      progress.recordCount = maxRecordCount_;
+      progress.recordsDone = maxRecordCount_;
 
-      // Double check that have a data packet.  Should have already determined this.
-      if ( dpkt->header.packetType != DATA_PACKET )
+      const std::vector<uint64_t> &offsets = packetDirectory_.packetLogicalOffsets;
+      if ( !offsets.empty() )
       {
-         throw E57_EXCEPTION2( ErrorInternal, "packetType=" + toString( dpkt->header.packetType ) );
+         progress.byteCount =
+            offsets.back() + packetDirectory_.packetLengths.back() - dataLogicalOffset_;
       }
+      progress.bytesDone = progress.byteCount;
 
-      // Read earliest packet into cache and send data to decoders with unblocked output
-
-      bool anyChannelHasExhaustedPacket = false;
-      uint64_t nextPacketLogicalOffset = UINT64_MAX;
-
-      // Feed bytestreams to channels with unblocked output that are reading from this packet
-      for ( DecodeChannel &channel : channels_ )
+      for ( auto &channel : channels_ )
       {
-         // Skip channels that have already read this packet.
-         if ( _alreadyReadPacket( channel, currentPacketLogicalOffset ) )
-         {
-            continue;
-         }
+         const uint64_t recordsCompleted = channel.decoder->totalRecordsCompleted();
 
-         // Get bytestream buffer for this channel from packet
-         unsigned int bsbLength = 0;
-         const char *bsbStart = dpkt->getBytestream( channel.bytestreamNumber, bsbLength );
+         progress.recordsDone = std::min( progress.recordsDone, recordsCompleted );
 
-         // Double check we are not off end of buffer
-         if ( channel.currentBytestreamBufferIndex > bsbLength )
+         // A channel with every record decoded needs no more packets
+         if ( !channel.inputFinished && ( recordsCompleted < maxRecordCount_ ) &&
+              ( channel.currentPacketIndex < offsets.size() ) )
          {
-            throw E57_EXCEPTION2(
-               ErrorInternal,
-               "currentBytestreamBufferIndex =" + toString( channel.currentBytestreamBufferIndex ) +
-                  " bsbLength=" + toString( bsbLength ) );
+            const uint64_t packetStart = offsets[channel.currentPacketIndex] - dataLogicalOffset_;
+
+            progress.bytesDone = std::min( progress.bytesDone, packetStart );
          }
+      }
 
-         // Calc where we are in the buffer
-         const char *uneatenStart = &bsbStart[channel.currentBytestreamBufferIndex];
-         const size_t uneatenLength = bsbLength - channel.currentBytestreamBufferIndex;
+      progress_( progress );
+   }
 
-         if ( &uneatenStart[uneatenLength] > &bsbStart[bsbLength] )
-         {
-            throw E57_EXCEPTION2( ErrorInternal, "uneatenLength=" + toString( uneatenLength ) +
-                                                    " bsbLength=" + toString( bsbLength ) );
-         }
+   // Find the dbufs of the point coordinates named by names (see
+   // CompressedVectorReaderOptions::transformFields). Returns false if the names are empty.
+   bool CompressedVectorReaderImpl::findPointDbufs( const std::array<ustring, 3> &names,
+                                                    std::array<size_t, 3> &dbufIndices ) const
+   {
+      if ( names[0].empty() && names[1].empty() && names[2].empty() )
+      {
+         return false;
+      }
 
-         // Feed into decoder
-         const size_t bytesProcessed = channel.decoder->inputProcess( uneatenStart, uneatenLength );
+      MemoryRepresentation representation = Real64;
+      size_t stride = 0;
 
-#ifdef E57_VERBOSE
-         std::cout << "  stream[" << channel.bytestreamNumber << "]: feeding decoder "
-                   << uneatenLength << " bytes" << std::endl;
+      for ( size_t i = 0; i < names.size(); ++i )
+      {
+         const auto dbuf =
+            std::find_if( dbufs_.begin(), dbufs_.end(), [&]( const SourceDestBuffer &buffer ) {
+               return buffer.pathName() == names[i];
+            } );
 
-         if ( uneatenLength == 0 )
+         if ( dbuf == dbufs_.end() )
          {
-            channel.dump( 8 );
+            throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                                  "pointField=" + names[i] +
+                                     " isn't read; cvPathName=" + cVector_->pathName() );
          }
 
-         std::cout << "  stream[" << channel.bytestreamNumber
-                   << "]: bytesProcessed=" << bytesProcessed << std::endl;
-#endif
-
-         // Adjust counts of bytestream location
-         channel.currentBytestreamBufferIndex += bytesProcessed;
+         // The kernels take three buffers of one type and stride, holding whole coordinates
+         const MemoryRepresentation dbufRepresentation = dbuf->memoryRepresentation();
+         const size_t dbufStride = dbuf->impl()->stride();
 
-         // Check if this channel has exhausted its bytestream buffer in this
-         // packet
-         if ( channel.isInputBlocked() )
+         if ( ( ( dbufRepresentation != Real32 ) && ( dbufRepresentation != Real64 ) ) ||
+              ( ( i > 0 ) && ( ( dbufRepresentation != representation ) ||
+                               ( dbufStride != stride ) ) ) ||
+              ( dbuf->origin() != 0.0 ) )
          {
-#ifdef E57_VERBOSE
-            std::cout << "  stream[" << channel.bytestreamNumber
-                      << "] has exhausted its input in current packet" << std::endl;
-#endif
-            anyChannelHasExhaustedPacket = true;
-            nextPacketLogicalOffset =
-               currentPacketLogicalOffset + dpkt->header.packetLogicalLengthMinus1 + 1;
+            throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                                  "pointField=" + names[i] + " memoryRepresentation=" +
+                                     toString( dbufRepresentation ) +
+                                     " stride=" + toString( dbufStride ) +
+                                     " origin=" + toString( dbuf->origin() ) +
+                                     " cvPathName=" + cVector_->pathName() );
          }
+
+         representation = dbufRepresentation;
+         stride = dbufStride;
+         dbufIndices[i] = static_cast<size_t>( dbuf - dbufs_.begin() );
       }
 
-      // Skip over any index or empty packets to next data packet.
-      nextPacketLogicalOffset = findNextDataPacket( nextPacketLogicalOffset );
+      return true;
+   }
 
-      // If no channel is exhausted, we're done
-      if ( !anyChannelHasExhaustedPacket )
+   // Convert and transform the points of records [begin, end) of the dbufs, if asked to
+   void CompressedVectorReaderImpl::transformRecords( size_t begin, size_t end )
+   {
+      if ( begin >= end )
       {
          return;
       }
 
-      // Some channel has exhausted this packet, so find next data packet and
-      // update currentPacketLogicalOffset for all interested channels.
+      const auto points = [&]( const std::array<size_t, 3> &dbufIndices, auto *type ) {
+         using T = typename std::remove_pointer<decltype( type )>::type;
 
-      if ( nextPacketLogicalOffset < UINT64_MAX )
-      { //??? huh?
-         // Get packet at nextPacketLogicalOffset into memory.
-         dpkt = dataPacket( nextPacketLogicalOffset );
+         std::array<T *, 3> result;
 
-         // Got a data packet, update the channels with exhausted input
-         for ( DecodeChannel &channel : channels_ )
+         for ( size_t i = 0; i < 3; ++i )
          {
-            // Skip channels that have already read this packet.
-            if ( _alreadyReadPacket( channel, currentPacketLogicalOffset ) )
-            {
-               continue;
-            }
+            const SourceDestBufferImpl *dbuf = dbufs_[dbufIndices[i]].impl().get();
 
-            channel.currentPacketLogicalOffset = nextPacketLogicalOffset;
-            channel.currentBytestreamBufferIndex = 0;
+            result[i] = reinterpret_cast<T *>( static_cast<char *>( dbuf->base() ) +
+                                               begin * dbuf->stride() );
+         }
 
-            // It is OK if the next packet doesn't contain any data for this
-            // channel, will skip packet on next iter of loop
-            channel.currentBytestreamBufferLength =
-               dpkt->getBytestreamBufferLength( channel.bytestreamNumber );
+         return result;
+      };
 
-#ifdef E57_VERBOSE
-            std::cout << "  set new stream buffer for channel[" << channel.bytestreamNumber
-                      << "], length=" << channel.currentBytestreamBufferLength << std::endl;
-#endif
-            // ??? perform flush if new packet flag set?
+      if ( convertSpherical_ )
+      {
+         const SourceDestBufferImpl *range = dbufs_[sphericalDbufs_[0]].impl().get();
+
+         if ( range->memoryRepresentation() == Real32 )
+         {
+            const auto p = points( sphericalDbufs_, static_cast<float *>( nullptr ) );
+
+            sphericalToCartesian( end - begin, range->stride(), p[0], p[1], p[2] );
+         }
+         else
+         {
+            const auto p = points( sphericalDbufs_, static_cast<double *>( nullptr ) );
+
+            sphericalToCartesian( end - begin, range->stride(), p[0], p[1], p[2] );
          }
       }
-      else
+
+      if ( transform_ )
       {
-         // Reached end without finding data packet, mark exhausted channels as
-         // finished
-#ifdef E57_VERBOSE
-         std::cout << "  at end of data packets" << std::endl;
-#endif
-         if ( nextPacketLogicalOffset >= sectionEndLogicalOffset_ )
+         const SourceDestBufferImpl *x = dbufs_[transformDbufs_[0]].impl().get();
+
+         if ( x->memoryRepresentation() == Real32 )
          {
-            for ( DecodeChannel &channel : channels_ )
-            {
-               // Skip channels that have already read this packet.
-               if ( _alreadyReadPacket( channel, currentPacketLogicalOffset ) )
-               {
-                  continue;
-               }
+            const auto p = points( transformDbufs_, static_cast<float *>( nullptr ) );
 
-#ifdef E57_VERBOSE
-               std::cout << "  Marking channel[" << channel.bytestreamNumber << "] as finished"
-                         << std::endl;
-#endif
-               channel.inputFinished = true;
-            }
+            transformPoints( transformMatrix_.data(), end - begin, x->stride(), p[0], p[1], p[2] );
+         }
+         else
+         {
+            const auto p = points( transformDbufs_, static_cast<double *>( nullptr ) );
+
+            transformPoints( transformMatrix_.data(), end - begin, x->stride(), p[0], p[1], p[2] );
          }
       }
    }
 
-   uint64_t CompressedVectorReaderImpl::findNextDataPacket( uint64_t nextPacketLogicalOffset )
+   // Find (or make) the dbufs of the fields of recordFilter
+   void CompressedVectorReaderImpl::setUpRecordFilter(
+      const std::vector<RecordFieldRange> &recordFilter )
    {
-#ifdef E57_VERBOSE
-      std::cout << "  searching for next data packet, nextPacketLogicalOffset="
-                << nextPacketLogicalOffset
-                << " sectionEndLogicalOffset=" << sectionEndLogicalOffset_ << std::endl;
-#endif
+      if ( recordFilter.empty() )
+      {
+         return;
+      }
 
-      // Starting at nextPacketLogicalOffset, search for next data packet until
-      // hit end of binary section.
-      while ( nextPacketLogicalOffset < sectionEndLogicalOffset_ )
+      const size_t capacity = dbufs_.front().impl()->capacity();
+
+      for ( const auto &range : recordFilter )
       {
-         char *anyPacket = nullptr;
+         if ( !proto_->isDefined( range.fieldName ) )
+         {
+            throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                                  "filterField=" + range.fieldName +
+                                     " isn't defined; cvPathName=" + cVector_->pathName() );
+         }
 
-         std::unique_ptr<PacketLock> packetLock =
-            cache_->lock( nextPacketLogicalOffset, anyPacket );
+         const NodeType type = proto_->get( range.fieldName )->type();
 
-         // Guess it's a data packet, if not continue to next packet
-         auto dpkt = reinterpret_cast<const DataPacket *>( anyPacket );
+         if ( ( type != TypeInteger ) && ( type != TypeScaledInteger ) && ( type != TypeFloat ) )
+         {
+            throw E57_EXCEPTION2( ErrorExpectingNumeric,
+                                  "filterField=" + range.fieldName + " nodeType=" +
+                                     toString( type ) + " cvPathName=" + cVector_->pathName() );
+         }
 
-         if ( dpkt->header.packetType == DATA_PACKET )
+         const auto dbuf =
+            std::find_if( dbufs_.begin(), dbufs_.end(), [&]( const SourceDestBuffer &buffer ) {
+               return buffer.pathName() == range.fieldName;
+            } );
+
+         if ( dbuf != dbufs_.end() )
          {
-#ifdef E57_VERBOSE
-            std::cout << "  Found next data packet at nextPacketLogicalOffset="
-                      << nextPacketLogicalOffset << std::endl;
-#endif
-            return nextPacketLogicalOffset;
+            filters_.push_back(
+               { static_cast<size_t>( dbuf - dbufs_.begin() ), range.minimum, range.maximum } );
+            continue;
          }
 
-         // All packets have length in same place, so can use the field to skip to
-         // next packet.
-         nextPacketLogicalOffset += dpkt->header.packetLogicalLengthMinus1 + 1;
-      }
+         // Scaled integers are tested as the values they stand for
+         filterValues_.emplace_back( capacity );
+         filterDbufs_.emplace_back( Node( cVector_ ).destImageFile(), range.fieldName,
+                                    filterValues_.back().data(), capacity, true, true );
 
-      // Ran off end of section, so return failure code.
-      return UINT64_MAX;
-   }
+         filters_.push_back( { dbufs_.size(), range.minimum, range.maximum } );
 
-   void CompressedVectorReaderImpl::seek( uint64_t /*recordNumber*/ )
-   {
-      checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+         dbufs_.push_back( filterDbufs_.back() );
+      }
 
-      // !!! implement
-      throw E57_EXCEPTION1( ErrorNotImplemented );
+      // Check the whole set again, e.g. for a field filtered twice
+      proto_->checkBuffers( dbufs_, true );
    }
 
-   bool CompressedVectorReaderImpl::isOpen() const
+   // Drop the records from begin up to the end of the dbufs which aren't kept by filters_
+   void CompressedVectorReaderImpl::filterRecords( size_t begin )
+   {
+      const size_t end = dbufs_.front().impl()->nextIndex();
+
+      if ( filters_.empty() || ( begin >= end ) )
+      {
+         return;
+      }
+
+      keep_.assign( end - begin, 1 );
+
+      for ( const auto &filter : filters_ )
+      {
+         dbufs_[filter.dbufIndex].impl()->keepInRange( begin, end - begin, filter.minimum,
+                                                       filter.maximum, keep_.data() );
+      }
+
+      // Every record may be kept
+      if ( std::find( keep_.begin(), keep_.end(), 0 ) == keep_.end() )
+      {
+         return;
+      }
+
+      for ( auto &dbuf : dbufs_ )
+      {
+         dbuf.impl()->keepElements( begin, keep_.data() );
+      }
+   }
+
+   // Start each of reductions_ on a new partial for each share of the blocks
+   void CompressedVectorReaderImpl::makePartials()
+   {
+      const size_t shareCount = workers_ ? workers_->threadCount() : 1;
+
+      partials_.resize( reductions_.size() );
+
+      for ( size_t i = 0; i < reductions_.size(); ++i )
+      {
+         partials_[i].clear();
+
+         for ( size_t share = 0; share < shareCount; ++share )
+         {
+            partials_[i].push_back( reductions_[i]->makePartial() );
+         }
+      }
+   }
+
+   // Give the records from begin up to the end of the dbufs to the partials of reductions_,
+   // splitting them into a share for each decode thread
+   void CompressedVectorReaderImpl::reduceRecords( size_t begin )
+   {
+      const size_t end = dbufs_.front().impl()->nextIndex();
+
+      if ( reductions_.empty() || ( begin >= end ) )
+      {
+         return;
+      }
+
+      const size_t shareCount = partials_.front().size();
+      const size_t recordCount = end - begin;
+
+      // The filter's own buffers aren't given
+      const size_t fieldCount = dbufs_.size() - filterDbufs_.size();
+
+      forEachChannel( shareCount, [&]( size_t share ) {
+         const size_t shareBegin = begin + recordCount * share / shareCount;
+         const size_t shareEnd = begin + recordCount * ( share + 1 ) / shareCount;
+
+         if ( shareBegin == shareEnd )
+         {
+            return;
+         }
+
+         RecordBlock block;
+         block.recordCount = shareEnd - shareBegin;
+         block.fields.resize( fieldCount );
+
+         for ( size_t i = 0; i < fieldCount; ++i )
+         {
+            const SourceDestBufferImpl *dbuf = dbufs_[i].impl().get();
+            RecordBlockField &field = block.fields[i];
+
+            field.pathName = dbuf->pathName();
+            field.representation = dbuf->memoryRepresentation();
+            field.stride = dbuf->stride();
+            field.origin = dbuf->origin();
+
+            if ( ( field.representation != UString ) && ( field.representation != Bits ) )
+            {
+               field.data = static_cast<const char *>( dbuf->base() ) + shareBegin * field.stride;
+            }
+         }
+
+         for ( auto &partials : partials_ )
+         {
+            partials[share]->reduce( block );
+         }
+      } );
+   }
+
+   // Add the partials of the read to reductions_, in order
+   void CompressedVectorReaderImpl::combinePartials()
+   {
+      for ( size_t i = 0; i < reductions_.size(); ++i )
+      {
+         for ( const auto &partial : partials_[i] )
+         {
+            reductions_[i]->combine( *partial );
+         }
+
+         partials_[i].clear();
+      }
+   }
+
+   void CompressedVectorReaderImpl::decodeRecords()
+   {
+      // Allow decoders to use data they already have in their queue to fill newly
+      // empty dbufs This helps to keep decoder input queues smaller, which
+      // reduces backtracking in the packet cache.
+      {
+#ifdef E57_ENABLE_STATISTICS
+         StatisticsTimer timer( &file_->statistics()->decodeNanoseconds );
+#endif
+
+         forEachChannel( channels_.size(), [this]( size_t i ) {
+            channels_[i].decoder->inputProcess( nullptr, 0 );
+         } );
+      }
+
+      // Loop until every dbuf is full or we have reached end of the binary
+      // section.
+      while ( true )
+      {
+         // Find the earliest packet position for channels that are still hungry
+         // It's important to call inputProcess of the decoders before this call,
+         // so current hungriness level is reflected.
+         uint64_t earliestPacketLogicalOffset = earliestPacketNeededForInput();
+
+         // If nobody's hungry, we are done with the read
+         if ( earliestPacketLogicalOffset == UINT64_MAX )
+         {
+            break;
+         }
+
+         // Feed packet to the hungry decoders
+         feedPacketToDecoders( earliestPacketLogicalOffset );
+      }
+   }
+
+   uint64_t CompressedVectorReaderImpl::earliestPacketNeededForInput() const
+   {
+      uint64_t earliestPacketLogicalOffset = UINT64_MAX;
+#ifdef E57_VERBOSE
+      unsigned earliestChannel = 0;
+#endif
+
+      for ( unsigned i = 0; i < channels_.size(); i++ )
+      {
+         const DecodeChannel *chan = &channels_[i];
+
+         // Test if channel needs more input.
+         // Important to call inputProcess just before this, so these tests work.
+         if ( !chan->isOutputBlocked() && !chan->inputFinished )
+         {
+            // Check if earliest so far
+            if ( chan->currentPacketLogicalOffset < earliestPacketLogicalOffset )
+            {
+               earliestPacketLogicalOffset = chan->currentPacketLogicalOffset;
+#ifdef E57_VERBOSE
+               earliestChannel = i;
+#endif
+            }
+         }
+      }
+#ifdef E57_VERBOSE
+      if ( earliestPacketLogicalOffset == UINT64_MAX )
+      {
+         std::cout << "earliestPacketNeededForInput returning none found" << std::endl;
+      }
+      else
+      {
+         std::cout << "earliestPacketNeededForInput returning " << earliestPacketLogicalOffset
+                   << " for channel[" << earliestChannel << "]" << std::endl;
+      }
+#endif
+      return earliestPacketLogicalOffset;
+   }
+
+   DataPacket *CompressedVectorReaderImpl::dataPacket( uint64_t inLogicalOffset ) const
+   {
+      char *packet = nullptr;
+
+      std::unique_ptr<PacketLock> packetLock = cache_->lock( inLogicalOffset, packet );
+
+      return reinterpret_cast<DataPacket *>( packet );
+   }
+
+   inline bool _alreadyReadPacket( const DecodeChannel &channel,
+                                   uint64_t currentPacketLogicalOffset )
+   {
+      return ( ( channel.currentPacketLogicalOffset != currentPacketLogicalOffset ) ||
+               channel.isOutputBlocked() );
+   }
+
+   void CompressedVectorReaderImpl::feedPacketToDecoders( uint64_t currentPacketLogicalOffset )
+   {
+#ifdef E57_ENABLE_TRACING
+      TraceScope trace( "CompressedVectorReaderImpl::feedPacketToDecoders" );
+#endif
+
+      checkCancelled();
+
+      // Get packet at currentPacketLogicalOffset into memory.
+      auto dpkt = dataPacket( currentPacketLogicalOffset );
+
+      // Double check that have a data packet.  Should have already determined this.
+      if ( dpkt->header.packetType != DATA_PACKET )
+      {
+         throw E57_EXCEPTION2( ErrorInternal, "packetType=" + toString( dpkt->header.packetType ) );
+      }
+
+      // Read earliest packet into cache and send data to decoders with unblocked output
+
+      // Find channels with unblocked output that are reading from this packet
+      std::vector<DecodeChannel *> channelsToFeed;
+      for ( DecodeChannel &channel : channels_ )
+      {
+         // Skip channels that have already read this packet.
+         if ( !_alreadyReadPacket( channel, currentPacketLogicalOffset ) )
+         {
+            channelsToFeed.push_back( &channel );
+         }
+      }
+
+#ifdef E57_ENABLE_STATISTICS
+      StatisticsTimer decodeTimer( &file_->statistics()->decodeNanoseconds );
+#endif
+
+      // Feed them their bytestreams. Each channel has its own decoder and dbuf, so they can be
+      // fed concurrently.
+      forEachChannel( channelsToFeed.size(), [&]( size_t i ) {
+#ifdef E57_ENABLE_TRACING
+         TraceScope channelTrace( "DecodeChannel::inputProcess" );
+#endif
+
+         DecodeChannel &channel = *channelsToFeed[i];
+
+         // Get bytestream buffer for this channel from packet
+         unsigned int bsbLength = 0;
+         const char *bsbStart = dpkt->getBytestream( channel.bytestreamNumber, bsbLength );
+
+         // Double check we are not off end of buffer
+         if ( channel.currentBytestreamBufferIndex > bsbLength )
+         {
+            throw E57_EXCEPTION2(
+               ErrorInternal,
+               "currentBytestreamBufferIndex =" + toString( channel.currentBytestreamBufferIndex ) +
+                  " bsbLength=" + toString( bsbLength ) );
+         }
+
+         // Calc where we are in the buffer
+         const char *uneatenStart = &bsbStart[channel.currentBytestreamBufferIndex];
+         const size_t uneatenLength = bsbLength - channel.currentBytestreamBufferIndex;
+
+         if ( &uneatenStart[uneatenLength] > &bsbStart[bsbLength] )
+         {
+            throw E57_EXCEPTION2( ErrorInternal, "uneatenLength=" + toString( uneatenLength ) +
+                                                    " bsbLength=" + toString( bsbLength ) );
+         }
+
+         // Feed into decoder
+         const size_t bytesProcessed = channel.decoder->inputProcess( uneatenStart, uneatenLength );
+
+#ifdef E57_VERBOSE
+         std::cout << "  stream[" << channel.bytestreamNumber << "]: feeding decoder "
+                   << uneatenLength << " bytes" << std::endl;
+
+         if ( uneatenLength == 0 )
+         {
+            channel.dump( 8 );
+         }
+
+         std::cout << "  stream[" << channel.bytestreamNumber
+                   << "]: bytesProcessed=" << bytesProcessed << std::endl;
+#endif
+
+         // Adjust counts of bytestream location
+         channel.currentBytestreamBufferIndex += bytesProcessed;
+      } );
+
+      for ( const DecodeChannel *channel : channelsToFeed )
+      {
+         // Check if this channel has exhausted its bytestream buffer in this
+         // packet
+         if ( channel->isInputBlocked() && !channel->inputFinished )
+         {
+#ifdef E57_ENABLE_STATISTICS
+            ++channelStatistics_[channel - channels_.data()].packetsDecoded;
+#endif
+
+#ifdef E57_VERBOSE
+            std::cout << "  stream[" << channel->bytestreamNumber
+                      << "] has exhausted its input in current packet" << std::endl;
+#endif
+            const auto channelIndex = static_cast<size_t>( channel - channels_.data() );
+            const uint64_t skipCount = channel->decoder->skipCount();
+
+            // Move it to the next packet it has data in, without reading the ones in between. If
+            // it is skipping fixed-width records (see CompressedVectorReaderOptions::recordStride)
+            // go straight to the next one it wants instead.
+            if ( ( skipCount > 0 ) && ( channel->decoder->bitsPerRecord() > 0 ) )
+            {
+               seekChannel( channelIndex, channel->decoder->totalRecordsCompleted() + skipCount );
+            }
+            else
+            {
+               skipToPacketWithData( channelIndex );
+            }
+         }
+      }
+
+      if ( progress_ && ( ++packetsSinceProgress_ >= progressPacketInterval_ ) )
+      {
+         packetsSinceProgress_ = 0;
+         reportProgress();
+      }
+   }
+
+   void CompressedVectorReaderImpl::forEachChannel( size_t count,
+                                                    const std::function<void( size_t )> &task )
+   {
+      if ( workers_ )
+      {
+         workers_->parallelFor( count, task );
+         return;
+      }
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         task( i );
+      }
+   }
+
+   void CompressedVectorReaderImpl::seek( uint64_t recordNumber )
+   {
+      waitForAsyncReads();
+
+      checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+      checkReaderOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+
+      extendIfGrown();
+
+      if ( recordNumber > maxRecordCount_ )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                               "recordNumber=" + toString( recordNumber ) +
+                                  " maxRecordCount=" + toString( maxRecordCount_ ) +
+                                  " imageFileName=" + cVector_->imageFileName() +
+                                  " cvPathName=" + cVector_->pathName() );
+      }
+
+      for ( size_t i = 0; i < channels_.size(); ++i )
+      {
+         seekChannel( i, recordNumber );
+      }
+   }
+
+   // Position one channel so the next record its decoder produces is recordNumber.
+   void CompressedVectorReaderImpl::seekChannel( size_t channelIndex, uint64_t recordNumber )
+   {
+      DecodeChannel &channel = channels_[channelIndex];
+
+      // Seeking to the end is allowed, there is just nothing left to read. The channel is left
+      // after the last packet, which is where any records added later start (see extend()).
+      if ( recordNumber >= maxRecordCount_ )
+      {
+         const size_t packetCount = packetDirectory_.packetLogicalOffsets.size();
+
+         if ( packetCount > 0 )
+         {
+            setChannelPacket( channelIndex, packetCount - 1 );
+            channel.currentBytestreamBufferIndex = channel.currentBytestreamBufferLength;
+         }
+
+         channel.decoder->seek( maxRecordCount_, 0, 0 );
+         channel.inputFinished = true;
+         return;
+      }
+
+      // Find a packet at which every bytestream starts with the same record. Without an index the
+      // only such packet we know of is the first one.
+      uint64_t startRecordNumber = 0;
+      size_t startPacketIndex = 0;
+
+      if ( !packetDirectory_.chunkPacketIndices.empty() )
+      {
+         startPacketIndex = findChunk( recordNumber, startRecordNumber );
+      }
+
+      if ( packetDirectory_.packetLogicalOffsets.empty() )
+      {
+         throw E57_EXCEPTION2( ErrorBadCVPacket, "recordNumber=" + toString( recordNumber ) +
+                                                    " cvPathName=" + cVector_->pathName() );
+      }
+
+      const std::vector<uint64_t> &starts = packetDirectory_.bytestreamStarts[channelIndex];
+
+      // Fixed-width bytestreams can be entered at an exact byte, rounded down to a 64-bit boundary
+      // from the start of the chunk so it is also on a word boundary for every decoder.
+      // Variable-width and constant ones must be read (or skipped) from the start.
+      const uint64_t bitsPerRecord = channel.decoder->bitsPerRecord();
+      const uint64_t targetBit = ( recordNumber - startRecordNumber ) * bitsPerRecord;
+      const uint64_t targetByte = starts[startPacketIndex] + ( targetBit / 64 ) * 8;
+      const auto targetBitOffset = static_cast<size_t>( targetBit % 64 );
+
+      // The last packet whose data starts at or before the target byte holds it.
+      size_t packetIndex = startPacketIndex;
+      if ( targetByte > starts[startPacketIndex] )
+      {
+         if ( targetByte >= starts.back() )
+         {
+            throw E57_EXCEPTION2( ErrorBadCVPacket,
+                                  "recordNumber=" + toString( recordNumber ) +
+                                     " bytestreamNumber=" + toString( channel.bytestreamNumber ) +
+                                     " targetByte=" + toString( targetByte ) +
+                                     " bytestreamLength=" + toString( starts.back() ) );
+         }
+
+         const auto found =
+            std::upper_bound( starts.begin() + startPacketIndex, starts.end() - 1, targetByte );
+         packetIndex = static_cast<size_t>( found - starts.begin() ) - 1;
+      }
+
+      setChannelPacket( channelIndex, packetIndex );
+      channel.currentBytestreamBufferIndex =
+         static_cast<size_t>( targetByte - starts[packetIndex] );
+      channel.inputFinished = false;
+
+      if ( bitsPerRecord > 0 )
+      {
+         channel.decoder->seek( recordNumber, targetBitOffset, 0 );
+      }
+      else
+      {
+         channel.decoder->seek( startRecordNumber, 0, recordNumber - startRecordNumber );
+      }
+
+      if ( channel.currentBytestreamBufferLength == 0 )
+      {
+         skipToPacketWithData( channelIndex );
+      }
+   }
+
+   // Put a channel at the start of its data in one of the packets in the directory.
+   void CompressedVectorReaderImpl::setChannelPacket( size_t channelIndex, size_t packetIndex )
+   {
+      DecodeChannel &channel = channels_[channelIndex];
+      const std::vector<uint64_t> &starts = packetDirectory_.bytestreamStarts[channelIndex];
+
+      channel.currentPacketIndex = packetIndex;
+      channel.currentPacketLogicalOffset = packetDirectory_.packetLogicalOffsets[packetIndex];
+      channel.currentBytestreamBufferIndex = 0;
+      channel.currentBytestreamBufferLength =
+         static_cast<size_t>( starts[packetIndex + 1] - starts[packetIndex] );
+   }
+
+   // Move a channel which has used up its data in its current packet to the next packet with data
+   // for it, or mark its input finished if there isn't one.
+   void CompressedVectorReaderImpl::skipToPacketWithData( size_t channelIndex )
+   {
+      DecodeChannel &channel = channels_[channelIndex];
+
+      const size_t packetCount = packetDirectory_.packetLogicalOffsets.size();
+      const std::vector<uint64_t> &starts = packetDirectory_.bytestreamStarts[channelIndex];
+
+      for ( size_t next = channel.currentPacketIndex + 1; next < packetCount; ++next )
+      {
+         if ( starts[next + 1] > starts[next] )
+         {
+            setChannelPacket( channelIndex, next );
+            return;
+         }
+      }
+
+#ifdef E57_VERBOSE
+      std::cout << "  Marking channel[" << channel.bytestreamNumber << "] as finished"
+                << std::endl;
+#endif
+      channel.inputFinished = true;
+   }
+
+   // Carry on into the records written since the reader opened, if the file is being followed and
+   // ImageFile::refresh() found some.
+   void CompressedVectorReaderImpl::extendIfGrown()
+   {
+      if ( static_cast<uint64_t>( cVector_->childCount() ) > maxRecordCount_ )
+      {
+         extend();
+      }
+   }
+
+   void CompressedVectorReaderImpl::extend()
+   {
+      ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
+
+      const uint64_t sectionLogicalStart = cVector_->getBinarySectionLogicalStart();
+
+      CompressedVectorSectionHeader sectionHeader;
+      imf->readSectionHeader( sectionLogicalStart, sectionHeader );
+
+#if VALIDATE_BASIC
+      sectionHeader.verify( file_->length( CheckedFile::Physical ) );
+#endif
+
+      // Only the packets after the ones already in the directory need to be looked at
+      const std::vector<uint64_t> &offsets = packetDirectory_.packetLogicalOffsets;
+      const size_t oldPacketCount = offsets.size();
+      const uint64_t scanLogicalOffset =
+         ( oldPacketCount > 0 ) ? offsets.back() + packetDirectory_.packetLengths.back()
+                                : dataLogicalOffset_;
+
+      sectionEndLogicalOffset_ = sectionLogicalStart + sectionHeader.sectionLogicalLength;
+
+      indexLogicalOffset_ = 0;
+      if ( sectionHeader.indexPhysicalOffset != 0 )
+      {
+         indexLogicalOffset_ = file_->physicalToLogical( sectionHeader.indexPhysicalOffset );
+      }
+
+      scanDataPackets( scanLogicalOffset, packetDirectory_ );
+      readChunkIndex();
+
+      const uint64_t oldMaxRecordCount = maxRecordCount_;
+
+      maxRecordCount_ = cVector_->childCount();
+
+      for ( size_t i = 0; i < channels_.size(); ++i )
+      {
+         DecodeChannel &channel = channels_[i];
+
+         channel.maxRecordCount = maxRecordCount_;
+         channel.decoder->setMaxRecordCount( maxRecordCount_ );
+
+         if ( oldMaxRecordCount == 0 )
+         {
+            // The constructor had no records to start the channels at
+            setChannelPacket( i, 0 );
+            channel.inputFinished = false;
+
+            if ( channel.currentBytestreamBufferLength == 0 )
+            {
+               skipToPacketWithData( i );
+            }
+         }
+         else if ( channel.inputFinished )
+         {
+            // Carry on in the packets after the last one it read
+            channel.inputFinished = false;
+            skipToPacketWithData( i );
+         }
+      }
+   }
+
+   // Find the packets of the section and what each holds from their headers, and the chunks from
+   // the index packets (if there are any).
+   void CompressedVectorReaderImpl::buildPacketDirectory()
+   {
+      packetDirectory_.packetLogicalOffsets.clear();
+      packetDirectory_.packetLengths.clear();
+      packetDirectory_.bytestreamStarts.assign( channels_.size(), {} );
+
+      scanDataPackets( dataLogicalOffset_, packetDirectory_ );
+      readChunkIndex();
+   }
+
+   // Fill in the chunks of the directory from the index packets (if there are any).
+   void CompressedVectorReaderImpl::readChunkIndex()
+   {
+      packetDirectory_.chunkPacketIndices.clear();
+      packetDirectory_.chunkRecordNumbers.clear();
+
+      if ( indexLogicalOffset_ != 0 )
+      {
+         readIndexPacket( indexLogicalOffset_, UINT_MAX );
+
+         const std::vector<uint64_t> &records = packetDirectory_.chunkRecordNumbers;
+
+         if ( !std::is_sorted( records.begin(), records.end() ) )
+         {
+            throw E57_EXCEPTION2( ErrorBadCVPacket,
+                                  "chunkCount=" + toString( records.size() ) +
+                                     " indexLogicalOffset=" + toString( indexLogicalOffset_ ) );
+         }
+      }
+   }
+
+   // Add the chunks listed by an index packet and (for higher levels) the ones below it to the
+   // directory.
+   void CompressedVectorReaderImpl::readIndexPacket( uint64_t packetLogicalOffset,
+                                                     unsigned parentLevel )
+   {
+      unsigned indexLevel = 0;
+      std::vector<IndexPacket::IndexPacketEntry> entries;
+
+      {
+         char *anyPacket = nullptr;
+         std::unique_ptr<PacketLock> packetLock = cache_->lock( packetLogicalOffset, anyPacket );
+
+         auto ipkt = reinterpret_cast<const IndexPacket *>( anyPacket );
+
+         if ( ( ipkt->header.packetType != INDEX_PACKET ) || ( ipkt->header.entryCount == 0 ) ||
+              ( ipkt->header.indexLevel >= parentLevel ) )
+         {
+            throw E57_EXCEPTION2( ErrorBadCVPacket,
+                                  "packetType=" + toString( ipkt->header.packetType ) +
+                                     " entryCount=" + toString( ipkt->header.entryCount ) +
+                                     " indexLevel=" + toString( ipkt->header.indexLevel ) +
+                                     " packetLogicalOffset=" + toString( packetLogicalOffset ) );
+         }
+
+         indexLevel = ipkt->header.indexLevel;
+         entries.assign( &ipkt->entries[0], &ipkt->entries[ipkt->header.entryCount] );
+      }
+
+      const std::vector<uint64_t> &offsets = packetDirectory_.packetLogicalOffsets;
+
+      for ( const auto &entry : entries )
+      {
+         const uint64_t chunkLogicalOffset =
+            file_->physicalToLogical( entry.chunkPhysicalOffset );
+
+         if ( chunkLogicalOffset >= sectionEndLogicalOffset_ )
+         {
+            throw E57_EXCEPTION2( ErrorBadCVPacket,
+                                  "chunkPhysicalOffset=" + toString( entry.chunkPhysicalOffset ) +
+                                     " sectionEndLogicalOffset=" +
+                                     toString( sectionEndLogicalOffset_ ) );
+         }
+
+         if ( indexLevel > 0 )
+         {
+            readIndexPacket( chunkLogicalOffset, indexLevel );
+            continue;
+         }
+
+         // Entries in level 0 packets point at data packets
+         const auto packet = std::lower_bound( offsets.begin(), offsets.end(), chunkLogicalOffset );
+
+         if ( ( packet == offsets.end() ) || ( *packet != chunkLogicalOffset ) )
+         {
+            throw E57_EXCEPTION2( ErrorBadCVPacket,
+                                  "chunkPhysicalOffset=" + toString( entry.chunkPhysicalOffset ) +
+                                     " chunkRecordNumber=" + toString( entry.chunkRecordNumber ) );
+         }
+
+         packetDirectory_.chunkPacketIndices.push_back(
+            static_cast<size_t>( packet - offsets.begin() ) );
+         packetDirectory_.chunkRecordNumbers.push_back( entry.chunkRecordNumber );
+      }
+   }
+
+   // Find the last chunk which starts at or before recordNumber, returning the index of its first
+   // packet in the directory.
+   size_t CompressedVectorReaderImpl::findChunk( uint64_t recordNumber,
+                                                 uint64_t &chunkRecordNumber ) const
+   {
+      const std::vector<uint64_t> &records = packetDirectory_.chunkRecordNumbers;
+
+      const auto chunk = std::upper_bound( records.begin(), records.end(), recordNumber );
+
+      // The first packet always starts a chunk
+      if ( chunk == records.begin() )
+      {
+         chunkRecordNumber = 0;
+         return 0;
+      }
+
+      const auto chunkIndex = static_cast<size_t>( chunk - records.begin() ) - 1;
+
+      chunkRecordNumber = records[chunkIndex];
+
+      return packetDirectory_.chunkPacketIndices[chunkIndex];
+   }
+
+   unsigned CompressedVectorReaderImpl::readPacketHeader(
+      uint64_t packetLogicalOffset, uint8_t &packetType,
+      std::vector<uint16_t> &bytestreamLengths ) const
+   {
+      // Only the header and bytestream lengths are read, not the whole packet. Use
+      // DataPacketHeader since its first fields are common to all packets. Guess that there are
+      // as many bytestreams as in the last packet, so they are (usually) read with the header.
+      DataPacketHeader header;
+
+      const uint64_t guessedLength =
+         sizeof( header ) + bytestreamLengths.size() * sizeof( uint16_t );
+      const size_t readLength = static_cast<size_t>(
+         std::min( guessedLength, sectionEndLogicalOffset_ - packetLogicalOffset ) );
+
+      std::vector<char> buffer( std::max( readLength, sizeof( header ) ) );
+
+      file_->readAt( packetLogicalOffset, buffer.data(), readLength );
+      std::memcpy( reinterpret_cast<char *>( &header ), buffer.data(), sizeof( header ) );
+
+      packetType = header.packetType;
+      bytestreamLengths.clear();
+
+      const unsigned packetLength = header.packetLogicalLengthMinus1 + 1U;
+
+      if ( packetType == DATA_PACKET )
+      {
+         header.verify();
+
+         bytestreamLengths.resize( header.bytestreamCount );
+
+         const size_t lengthsSize = header.bytestreamCount * sizeof( uint16_t );
+
+         if ( sizeof( header ) + lengthsSize <= readLength )
+         {
+            std::memcpy( bytestreamLengths.data(), &buffer[sizeof( header )], lengthsSize );
+         }
+         else if ( header.bytestreamCount > 0 )
+         {
+            file_->readAt( packetLogicalOffset + sizeof( header ),
+                           reinterpret_cast<char *>( bytestreamLengths.data() ), lengthsSize );
+         }
+      }
+
+      return packetLength;
+   }
+
+   // Add the data packets from packetLogicalOffset to the end of the section to the directory.
+   void CompressedVectorReaderImpl::scanDataPackets( uint64_t packetLogicalOffset,
+                                                     PacketDirectory &directory ) const
+   {
+      const size_t channelCount = channels_.size();
+
+      // Carry on from the total lengths at the end of what the directory has already
+      std::vector<uint64_t> bytestreamLength( channelCount, 0 );
+      std::vector<uint16_t> bytestreamLengths;
+
+      for ( size_t i = 0; i < channelCount; ++i )
+      {
+         std::vector<uint64_t> &starts = directory.bytestreamStarts[i];
+
+         if ( !starts.empty() )
+         {
+            bytestreamLength[i] = starts.back();
+            starts.pop_back();
+         }
+      }
+
+      while ( packetLogicalOffset < sectionEndLogicalOffset_ )
+      {
+         uint8_t packetType = 0;
+         const unsigned packetLength =
+            readPacketHeader( packetLogicalOffset, packetType, bytestreamLengths );
+
+         if ( packetType == DATA_PACKET )
+         {
+            directory.packetLogicalOffsets.push_back( packetLogicalOffset );
+            directory.packetLengths.push_back( packetLength );
+
+            for ( size_t i = 0; i < channelCount; ++i )
+            {
+               directory.bytestreamStarts[i].push_back( bytestreamLength[i] );
+
+               const unsigned bytestreamNumber = channels_[i].bytestreamNumber;
+               if ( bytestreamNumber < bytestreamLengths.size() )
+               {
+                  bytestreamLength[i] += bytestreamLengths[bytestreamNumber];
+               }
+            }
+         }
+
+         packetLogicalOffset += packetLength;
+      }
+
+      for ( size_t i = 0; i < channelCount; ++i )
+      {
+         directory.bytestreamStarts[i].push_back( bytestreamLength[i] );
+      }
+   }
+
+   std::future<unsigned> CompressedVectorReaderImpl::readAsync(
+      const std::vector<SourceDestBuffer> &dbufs )
+   {
+      auto promise = std::make_shared<std::promise<unsigned>>();
+
+      readAsync( dbufs, [promise]( unsigned recordCount, std::exception_ptr error ) {
+         if ( error )
+         {
+            promise->set_exception( error );
+         }
+         else
+         {
+            promise->set_value( recordCount );
+         }
+      } );
+
+      return promise->get_future();
+   }
+
+   void CompressedVectorReaderImpl::readAsync( const std::vector<SourceDestBuffer> &dbufs,
+                                               const ReadCompletion &done )
+   {
+      if ( asyncReads_ == nullptr )
+      {
+         asyncReads_.reset( new TaskQueue( file_->executor() ) );
+      }
+
+      asyncReads_->post( [this, buffers = dbufs, done]() mutable {
+         unsigned recordCount = 0;
+         std::exception_ptr error;
+
+         try
+         {
+            recordCount = buffers.empty() ? read() : read( buffers );
+         }
+         catch ( ... )
+         {
+            error = std::current_exception();
+         }
+
+         try
+         {
+            done( recordCount, error );
+         }
+         catch ( ... )
+         {
+            // Nowhere to report it
+         }
+      } );
+   }
+
+   void CompressedVectorReaderImpl::waitForAsyncReads()
+   {
+      if ( asyncReads_ != nullptr )
+      {
+         asyncReads_->wait();
+      }
+   }
+
+   bool CompressedVectorReaderImpl::isOpen() const
    {
       // don't checkImageFileOpen(__FILE__, __LINE__, __FUNCTION__), or
       // checkReaderOpen()
@@ -565,6 +1551,8 @@ namespace e57
 
    void CompressedVectorReaderImpl::close()
    {
+      waitForAsyncReads();
+
       // Before anything that can throw, decrement reader count
       ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
       imf->decrReaderCount();
@@ -577,12 +1565,16 @@ namespace e57
          return;
       }
 
-      // Destroy decoders
+      // Stop decode threads, then destroy decoders
+      workers_.reset();
       channels_.clear();
+      decoderCharge_.set( 0 );
 
       delete cache_;
       cache_ = nullptr;
 
+      file_ = nullptr;
+
       isOpen_ = false;
    }
 
@@ -633,6 +1625,8 @@ namespace e57
       os << space( indent ) << "recordCount:             " << recordCount_ << std::endl;
       os << space( indent ) << "maxRecordCount:          " << maxRecordCount_ << std::endl;
       os << space( indent ) << "sectionEndLogicalOffset: " << sectionEndLogicalOffset_ << std::endl;
+      os << space( indent ) << "dataLogicalOffset:       " << dataLogicalOffset_ << std::endl;
+      os << space( indent ) << "indexLogicalOffset:      " << indexLogicalOffset_ << std::endl;
    }
 #endif
 
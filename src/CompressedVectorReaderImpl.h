@@ -26,22 +26,35 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <functional>
+#include <memory>
+
 #include "DecodeChannel.h"
+#include "MemoryAccount.h"
 
 namespace e57
 {
+   class CheckedFile;
    class DataPacket;
    class PacketReadCache;
+   class TaskQueue;
+   class WorkerPool;
 
    class CompressedVectorReaderImpl
    {
    public:
       CompressedVectorReaderImpl( std::shared_ptr<CompressedVectorNodeImpl> cvi,
-                                  std::vector<SourceDestBuffer> &dbufs );
+                                  std::vector<SourceDestBuffer> &dbufs,
+                                  const CompressedVectorReaderOptions &options = {} );
       ~CompressedVectorReaderImpl();
 
       unsigned read();
       unsigned read( std::vector<SourceDestBuffer> &dbufs );
+
+      /// Run read() (or read( @a dbufs ), unless they are empty) in turn on a background thread
+      std::future<unsigned> readAsync( const std::vector<SourceDestBuffer> &dbufs );
+      void readAsync( const std::vector<SourceDestBuffer> &dbufs, const ReadCompletion &done );
+
       void seek( uint64_t recordNumber );
       bool isOpen() const;
       std::shared_ptr<CompressedVectorNodeImpl> compressedVectorNode() const;
@@ -52,16 +65,67 @@ namespace e57
 #endif
 
    private:
+      /// Wait for the reads started by readAsync() to finish
+      void waitForAsyncReads();
+
       void checkImageFileOpen( const char *srcFileName, int srcLineNumber,
                                const char *srcFunctionName ) const;
       void checkReaderOpen( const char *srcFileName, int srcLineNumber,
                             const char *srcFunctionName ) const;
       void setBuffers( std::vector<SourceDestBuffer> &dbufs ); //???needed?
       uint64_t earliestPacketNeededForInput() const;
+      void decodeRecords();
+      bool findPointDbufs( const std::array<ustring, 3> &names,
+                           std::array<size_t, 3> &dbufIndices ) const;
+      void transformRecords( size_t begin, size_t end );
+      void setUpRecordFilter( const std::vector<RecordFieldRange> &recordFilter );
+      void filterRecords( size_t begin );
+      void makePartials();
+      void reduceRecords( size_t begin );
+      void combinePartials();
 
       DataPacket *dataPacket( uint64_t inLogicalOffset ) const;
       void feedPacketToDecoders( uint64_t currentPacketLogicalOffset );
-      uint64_t findNextDataPacket( uint64_t nextPacketLogicalOffset );
+      void forEachChannel( size_t count, const std::function<void( size_t )> &task );
+
+      /// Where the data packets of the section are and what each of them holds. Built when the
+      /// reader opens, so channels go straight to the packets they need and seek() is a lookup.
+      struct PacketDirectory
+      {
+         std::vector<uint64_t> packetLogicalOffsets;
+         std::vector<unsigned> packetLengths;
+
+         /// Offset within each channel's bytestream at which each packet's data begins. Indexed
+         /// [channel][packet], with one extra entry at the end holding the total length.
+         std::vector<std::vector<uint64_t>> bytestreamStarts;
+
+         /// From the index packets (if any): the packet each chunk starts at, and the number of
+         /// records of every bytestream before it.
+         std::vector<size_t> chunkPacketIndices;
+         std::vector<uint64_t> chunkRecordNumbers;
+      };
+
+      void extendIfGrown();
+      void extend();
+      void buildPacketDirectory();
+      void readChunkIndex();
+      void readIndexPacket( uint64_t packetLogicalOffset, unsigned parentLevel );
+      size_t findChunk( uint64_t recordNumber, uint64_t &chunkRecordNumber ) const;
+      unsigned readPacketHeader( uint64_t packetLogicalOffset, uint8_t &packetType,
+                                 std::vector<uint16_t> &bytestreamLengths ) const;
+      void scanDataPackets( uint64_t packetLogicalOffset, PacketDirectory &directory ) const;
+      void seekChannel( size_t channelIndex, uint64_t recordNumber );
+      void setChannelPacket( size_t channelIndex, size_t packetIndex );
+      void skipToPacketWithData( size_t channelIndex );
+
+      /// Count the decoders' buffers in the ImageFile's memory usage, since they grow as needed
+      void chargeDecoders();
+
+      /// Throw ErrorCancelled if the reader's CancellationToken has been cancelled
+      void checkCancelled() const;
+
+      /// Tell progress_ how far the reader has got
+      void reportProgress();
 
       //??? no default ctor, copy, assignment?
 
@@ -72,8 +136,75 @@ namespace e57
       std::vector<DecodeChannel> channels_;
       PacketReadCache *cache_;
 
+      /// Counts for each of channels_ not yet added to the ImageFile's statistics
+      std::vector<ChannelStatistics> channelStatistics_;
+
+      /// The ImageFile's handle. Everything is read with CheckedFile::readAt(), so readers of a
+      /// file opened for reading can share it and be used on different threads.
+      CheckedFile *file_ = nullptr;
+
+      /// Decodes channels concurrently (only if asked for more than one decode thread)
+      std::unique_ptr<WorkerPool> workers_;
+
+      /// Runs the reads started by readAsync(), one after another. Made by the first one.
+      std::unique_ptr<TaskQueue> asyncReads_;
+
+      /// The decoders' buffers in ImageFileMemoryUsage::decoders
+      MemoryCharge decoderCharge_;
+
+      /// See CompressedVectorReaderOptions::progress, progressPacketInterval, and cancellation
+      ProgressCallback progress_;
+      unsigned progressPacketInterval_ = 1;
+      unsigned packetsSinceProgress_ = 0;
+      std::shared_ptr<CancellationToken> cancellation_;
+
+      /// Records to decode for every channel at a time (see
+      /// CompressedVectorReaderOptions::decodeTileSize), or 0 to fill each dbuf in turn
+      unsigned decodeTileSize_ = 0;
+
+      /// Whether to convert points from spherical coordinates as they are read (see
+      /// CompressedVectorReaderOptions::sphericalFields), and the index in dbufs_ of their range,
+      /// azimuth, and elevation
+      bool convertSpherical_ = false;
+      std::array<size_t, 3> sphericalDbufs_ = {};
+
+      /// Whether to transform points as they are read (see
+      /// CompressedVectorReaderOptions::transformFields), the index in dbufs_ of their x, y, and
+      /// z, and the transform
+      bool transform_ = false;
+      std::array<size_t, 3> transformDbufs_ = {};
+      std::array<double, 12> transformMatrix_ = {};
+
+      /// A range of values of one of dbufs_ which records must have to be kept (see
+      /// CompressedVectorReaderOptions::recordFilter)
+      struct FieldFilter
+      {
+         size_t dbufIndex;
+         double minimum;
+         double maximum;
+      };
+
+      std::vector<FieldFilter> filters_;
+
+      /// Buffers for the filtered fields which weren't in the dbufs given. They are at the end of
+      /// dbufs_.
+      std::vector<std::vector<double>> filterValues_;
+      std::vector<SourceDestBuffer> filterDbufs_;
+
+      /// Whether each record of the block being filtered is kept
+      std::vector<uint8_t> keep_;
+
+      /// See CompressedVectorReaderOptions::reductions, and the partials of each of them for the
+      /// share of every block reduced by each decode thread, indexed [reduction][share]
+      std::vector<std::shared_ptr<CompressedVectorReduction>> reductions_;
+      std::vector<std::vector<std::unique_ptr<CompressedVectorReduction>>> partials_;
+
       uint64_t recordCount_; /// number of records written so far
       uint64_t maxRecordCount_;
       uint64_t sectionEndLogicalOffset_;
+      uint64_t dataLogicalOffset_;  /// first data packet
+      uint64_t indexLogicalOffset_; /// top index packet, or 0 if the section has no index
+
+      PacketDirectory packetDirectory_;
    };
 }
@@ -253,6 +253,37 @@ void CompressedVectorWriter::write( std::vector<SourceDestBuffer> &sbufs, const
    impl_->write( sbufs, recordCount );
 }
 
+/*!
+@brief Write the records written so far to the file.
+
+@details
+Everything the writer holds is written to the file in data packets, without waiting for them to be
+full, so that another process reading the file as it grows can see the records (see
+CompressedVectorWriterOptions::maxPacketLatencyMs to do this as records are written). Flushing
+often makes the file bigger, as each packet has its own header.
+
+Bit-packed integer fields are written in whole words of up to 64 bits, so the last few values of
+such a field may stay in the writer until more records are written or it is closed. Nothing is
+written until the writer is closed when using CompressedVectorWriterOptions::stageInMemory.
+
+@pre The associated ImageFile must be open.
+@pre This CompressedVectorWriter must be open (i.e isOpen())
+
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorWriterNotOpen
+@throw ::ErrorSeekFailed This CompressedVectorWriter, associated ImageFile in undocumented state
+@throw ::ErrorReadFailed This CompressedVectorWriter, associated ImageFile in undocumented state
+@throw ::ErrorWriteFailed This CompressedVectorWriter, associated ImageFile in undocumented state
+@throw ::ErrorBadChecksum This CompressedVectorWriter, associated ImageFile in undocumented state
+@throw ::ErrorInternal All objects in undocumented state
+
+@see CompressedVectorWriter::write(unsigned), CompressedVectorWriterOptions::maxPacketRecords
+*/
+void CompressedVectorWriter::flush()
+{
+   impl_->flush();
+}
+
 /*!
 @brief End the write operation.
 
@@ -315,6 +346,30 @@ CompressedVectorNode CompressedVectorWriter::compressedVectorNode() const
    return impl_->compressedVectorNode();
 }
 
+/*!
+@brief Get the smallest and largest values written to a field so far.
+
+@param [in] pathName The pathName of the field's SourceDestBuffer (e.g. "cartesianX").
+@param [out] minimum The smallest value written.
+@param [out] maximum The largest value written.
+
+@details
+The values are collected only if the writer was created with
+CompressedVectorWriterOptions::collectFieldLimits. They are the values as they were in the
+SourceDestBuffer (i.e. before any scaling or conversion), and NaNs are ignored. This may be called
+after the writer is closed.
+
+@return True if any values were written to the field, false if not (or they weren't collected, or
+it is a string field).
+
+@see CompressedVectorWriterOptions
+*/
+bool CompressedVectorWriter::fieldLimits( const ustring &pathName, double &minimum,
+                                          double &maximum ) const
+{
+   return impl_->fieldLimits( pathName, minimum, maximum );
+}
+
 /*!
 @brief Diagnostic function to print internal state of object to output stream in an indented format.
 @copydetails Node::dump()
@@ -25,16 +25,25 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <cmath>
+#include <mutex>
 #include <numeric>
 
+#include "BackgroundWriter.h"
 #include "CheckedFile.h"
 #include "CompressedVectorNodeImpl.h"
 #include "CompressedVectorWriterImpl.h"
+#include "FloatNodeImpl.h"
 #include "ImageFileImpl.h"
+#include "IntegerNodeImpl.h"
+#include "ScaledIntegerNodeImpl.h"
 #include "SectionHeaders.h"
 #include "SourceDestBufferImpl.h"
+#include "Statistics.h"
 #include "StringFunctions.h"
+#include "Tracing.h"
+#include "WorkerPool.h"
 
 namespace e57
 {
@@ -47,12 +56,53 @@ namespace e57
       }
    };
 
+   // When writing index packets, chunks start on multiples of this many records. Every bytestream
+   // is then on a whole 64-bit boundary, so no encoder is left holding a partial word and the
+   // bytestreams are identical to those written without an index.
+   constexpr uint64_t cChunkRecordAlignment = 64;
+
+   // Most records each bytestream encodes in one step of write()
+   constexpr uint64_t cMaxStepRecordCount = 50;
+
+   // With columnar runs, a bytestream's output is put in a packet of its own once it has this
+   // many bytes
+   constexpr size_t cColumnPacketSize = DATA_PACKET_MAX * 3 / 4;
+
    CompressedVectorWriterImpl::CompressedVectorWriterImpl(
-      std::shared_ptr<CompressedVectorNodeImpl> ni, std::vector<SourceDestBuffer> &sbufs ) :
-      cVector_( ni ), isOpen_( false ) // set to true when succeed below
+      std::shared_ptr<CompressedVectorNodeImpl> ni, std::vector<SourceDestBuffer> &sbufs,
+      const CompressedVectorWriterOptions &options ) :
+      options_( options ), cVector_( ni ), isOpen_( false ), // set to true when succeed below
+      isStaging_( options.stageInMemory )
    {
       //???  check if cvector already been written (can't write twice)
 
+      // Chunks need every bytestream to start in the same packet
+      if ( ( options_.columnarRunPackets > 0 ) && options_.writeIndexPackets )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                               "columnarRunPackets=" + toString( options_.columnarRunPackets ) +
+                                  " writeIndexPackets=1 imageFileName=" +
+                                  cVector_->imageFileName() + " cvPathName=" +
+                                  cVector_->pathName() );
+      }
+
+      // Column packets hold the records of a single bytestream
+      if ( ( options_.columnarRunPackets > 0 ) && ( options_.maxPacketRecords > 0 ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                               "columnarRunPackets=" + toString( options_.columnarRunPackets ) +
+                                  " maxPacketRecords=" + toString( options_.maxPacketRecords ) +
+                                  " imageFileName=" + cVector_->imageFileName() +
+                                  " cvPathName=" + cVector_->pathName() );
+      }
+
+      if ( options_.progressPacketInterval == 0 )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "progressPacketInterval=0 imageFileName=" +
+                                                       cVector_->imageFileName() +
+                                                       " cvPathName=" + cVector_->pathName() );
+      }
+
       // Empty sbufs is an error
       if ( sbufs.empty() )
       {
@@ -90,11 +140,22 @@ namespace e57
          // prototype
          bytestreams_.push_back( Encoder::EncoderFactory( static_cast<unsigned>( bytestreamNumber ),
                                                           cVector_, vTemp, codecPath ) );
+
+         // write() checks all the values before they are encoded
+         if ( options_.validatePerWrite )
+         {
+            bytestreams_.back()->skipValueChecks();
+         }
       }
 
       // The bytestreams_ vector must be ordered by bytestreamNumber, not by order
       // called specified sbufs, so sort it.
       sort( bytestreams_.begin(), bytestreams_.end(), SortByBytestreamNumber() );
+
+      if ( options_.columnarRunPackets > 0 )
+      {
+         columnRuns_.resize( bytestreams_.size() );
+      }
 #if ( E57_VALIDATION_LEVEL == VALIDATION_DEEP )
       // Double check that all bytestreams are specified
       for ( unsigned i = 0; i < bytestreams_.size(); i++ )
@@ -108,13 +169,53 @@ namespace e57
       }
 #endif
 
+      // There is no point in having more threads than bytestreams
+      const auto encodeThreadCount =
+         std::min( options_.encodeThreadCount, static_cast<unsigned>( bytestreams_.size() ) );
       ImageFileImplSharedPtr imf( ni->destImageFile_ );
 
-      // Reserve space for CompressedVector binary section header, record location
-      // so can save to when writer closes. Request that file be extended with
-      // zeros since we will write to it at a later time (when writer closes).
-      sectionHeaderLogicalStart_ =
-         imf->allocateSpace( sizeof( CompressedVectorSectionHeader ), true );
+      if ( encodeThreadCount > 1 )
+      {
+         workers_.reset( new WorkerPool( encodeThreadCount, imf->executor() ) );
+      }
+
+      if ( isStaging_ )
+      {
+         // The section is built in stagedSection_ and written to the file when the writer
+         // closes. Leave room for its header at the start.
+         stagedSection_.resize( sizeof( CompressedVectorSectionHeader ), 0 );
+         sectionHeaderLogicalStart_ = 0;
+      }
+      else
+      {
+         // Reserve space for CompressedVector binary section header, record location
+         // so can save to when writer closes. Request that file be extended with
+         // zeros since we will write to it at a later time (when writer closes).
+         sectionHeaderLogicalStart_ =
+            imf->allocateSpace( sizeof( CompressedVectorSectionHeader ), true );
+
+         // Write-behind is left out if the memory budget has no room for it
+         const auto writeBehindPacketCount =
+            static_cast<unsigned>( imf->memoryAccount()->reserveUpTo(
+               MemoryAccount::WriteBuffers, DATA_PACKET_MAX, options_.writeBehindPacketCount, 0 ) );
+
+         writeBehindCharge_ = MemoryCharge( imf->memoryAccount(), MemoryAccount::WriteBuffers );
+         writeBehindCharge_.adopt( uint64_t{ writeBehindPacketCount } * DATA_PACKET_MAX );
+
+         if ( writeBehindPacketCount > 0 )
+         {
+            backgroundWriter_.reset( new BackgroundWriter( imf->file_, writeBehindPacketCount ) );
+         }
+      }
+
+      // Journals need every record before them to be in packets in the file
+      journalInterval_ = ( isStaging_ || ( options_.columnarRunPackets > 0 ) )
+                            ? 0
+                            : imf->journalInterval();
+      journalPacketsCount_ = 0;
+      chunked_ = options_.writeIndexPackets || ( journalInterval_ > 0 );
+
+      targetPacketSize_ = targetPacketSize();
 
       sectionLogicalLength_ = 0;
       dataPhysicalOffset_ = 0;
@@ -122,10 +223,16 @@ namespace e57
       recordCount_ = 0;
       dataPacketsCount_ = 0;
       indexPacketsCount_ = 0;
+      chunkStartPending_ = true;
+      chunkRecordNumber_ = 0;
+      packetRecordStart_ = 0;
+      recordsPending_ = false;
+
+      encoderCharge_ = MemoryCharge( imf->memoryAccount(), MemoryAccount::Encoders );
+      writeBufferCharge_ = MemoryCharge( imf->memoryAccount(), MemoryAccount::WriteBuffers );
+      chargeBuffers();
 
-      // Just before return (and can't throw) increment writer count  ??? safer
-      // way to assure don't miss close?
-      imf->incrWriterCount();
+      // The writer was counted by CompressedVectorNodeImpl::writer() before it was made
 
       // If get here, the writer is open
       isOpen_ = true;
@@ -158,7 +265,7 @@ namespace e57
       ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
 
       // Before anything that can throw, decrement writer count
-      imf->decrWriterCount();
+      imf->decrWriterCount( options_.stageInMemory );
 
       checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
       // don't call checkWriterOpen();
@@ -172,17 +279,83 @@ namespace e57
       // try to close again.
       isOpen_ = false;
 
+      // A cancelled writer leaves its section unfinished, and the ImageFile should be cancelled
+      if ( cancelled_ || ( options_.cancellation && options_.cancellation->isCancelled() ) )
+      {
+         cancelled_ = true;
+
+         backgroundWriter_.reset();
+
+         writeBehindCharge_.set( 0 );
+         writeBufferCharge_.set( 0 );
+         encoderCharge_.set( 0 );
+
+         workers_.reset();
+         bytestreams_.clear();
+         return;
+      }
+
       // If have any data, write packet
       // Write all remaining ioBuffers and internal encoder register cache into
       // file. Know we are done when totalOutputAvailable() returns 0 after a
-      // flush().
-      flush();
-      while ( totalOutputAvailable() > 0 )
+      // flushRegisters().
+      flushRegisters();
+      if ( options_.columnarRunPackets > 0 )
       {
-         packetWrite();
-         flush();
+         while ( totalOutputAvailable() > 0 )
+         {
+            for ( size_t i = 0; i < bytestreams_.size(); ++i )
+            {
+               if ( bytestreams_[i]->outputAvailable() > 0 )
+               {
+                  columnPacketWrite( i );
+               }
+            }
+            flushRegisters();
+         }
+
+         for ( size_t i = 0; i < bytestreams_.size(); ++i )
+         {
+            columnRunWrite( i );
+         }
+      }
+      else
+      {
+         while ( totalOutputAvailable() > 0 )
+         {
+            packetWrite();
+            flushRegisters();
+         }
       }
 
+      // Other staged writers may be closing on other threads, so only one at a time gets to
+      // write to the file.
+      std::unique_lock<std::mutex> stagedWriteLock;
+
+      if ( isStaging_ )
+      {
+         stagedWriteLock = std::unique_lock<std::mutex>( imf->stagedWriteMutex_ );
+
+         writeStagedSection();
+      }
+
+      // Index packets go after all the data packets they refer to
+      if ( options_.writeIndexPackets && !chunkIndex_.empty() )
+      {
+         indexWrite();
+      }
+
+      // Everything after this writes to the file directly
+      if ( backgroundWriter_ )
+      {
+         backgroundWriter_->wait();
+         backgroundWriter_.reset();
+      }
+
+      writeBehindCharge_.set( 0 );
+      writeBufferCharge_.set( 0 );
+      encoderCharge_.set( 0 );
+
       // Compute length of whole section we just wrote (from section start to
       // current start of free space).
       sectionLogicalLength_ = imf->unusedLogicalStart_ - sectionHeaderLogicalStart_;
@@ -216,7 +389,14 @@ namespace e57
       cVector_->setRecordCount( recordCount_ );
       cVector_->setBinarySectionLogicalStart( sectionHeaderLogicalStart_ );
 
-      // Free channels
+      // The whole section is in the file now
+      if ( imf->journalInterval() > 0 )
+      {
+         imf->writeJournal();
+      }
+
+      // Stop encode threads, then free channels
+      workers_.reset();
       bytestreams_.clear();
 
 #ifdef E57_VERBOSE
@@ -225,6 +405,146 @@ namespace e57
 #endif
    }
 
+   bool CompressedVectorWriterImpl::fieldLimits( const ustring &pathName, double &minimum,
+                                                 double &maximum ) const
+   {
+      const auto found = fieldLimits_.find( pathName );
+
+      if ( found == fieldLimits_.end() )
+      {
+         return false;
+      }
+
+      minimum = found->second.first;
+      maximum = found->second.second;
+
+      return true;
+   }
+
+   void CompressedVectorWriterImpl::updateFieldLimits( size_t recordCount )
+   {
+      for ( const auto &sbuf : sbufs_ )
+      {
+         double minimum = 0.0;
+         double maximum = 0.0;
+
+         if ( !sbuf.impl()->valueRange( recordCount, minimum, maximum ) )
+         {
+            continue;
+         }
+
+         const auto inserted =
+            fieldLimits_.emplace( sbuf.pathName(), std::make_pair( minimum, maximum ) );
+
+         if ( !inserted.second )
+         {
+            auto &limits = inserted.first->second;
+
+            limits.first = std::min( limits.first, minimum );
+            limits.second = std::max( limits.second, maximum );
+         }
+      }
+   }
+
+   // Check that the first recordCount values of each sbuf can be written to its field, using
+   // the smallest and largest of them (see CompressedVectorWriterOptions::validatePerWrite). The
+   // raw value of an integer is a monotonic function of the value in memory, so if the extremes
+   // are in range, they all are.
+   void CompressedVectorWriterImpl::checkValueRanges( size_t recordCount ) const
+   {
+      for ( const auto &sbuf : sbufs_ )
+      {
+         const SourceDestBufferImpl &buffer = *sbuf.impl();
+
+         double minimum = 0.0;
+         double maximum = 0.0;
+
+         // Strings have no range, and NaNs are skipped
+         if ( !buffer.valueRange( recordCount, minimum, maximum ) )
+         {
+            continue;
+         }
+
+         const NodeImplSharedPtr node = proto_->get( buffer.pathName() );
+
+         int64_t fieldMinimum = 0;
+         int64_t fieldMaximum = 0;
+
+         switch ( node->type() )
+         {
+            case TypeInteger:
+            {
+               const auto integer = std::static_pointer_cast<IntegerNodeImpl>( node );
+
+               fieldMinimum = integer->minimum();
+               fieldMaximum = integer->maximum();
+
+               // Floating point values are truncated
+               minimum = std::trunc( minimum );
+               maximum = std::trunc( maximum );
+               break;
+            }
+
+            case TypeScaledInteger:
+            {
+               const auto scaledInteger = std::static_pointer_cast<ScaledIntegerNodeImpl>( node );
+
+               fieldMinimum = scaledInteger->minimum();
+               fieldMaximum = scaledInteger->maximum();
+
+               if ( buffer.doScaling() )
+               {
+                  const double scale = scaledInteger->scale();
+                  const double offset = scaledInteger->offset();
+
+                  // Unscaled the same way as SourceDestBufferImpl::getNextInt64s()
+                  const double rawMinimum = std::floor( ( minimum - offset ) / scale + 0.5 );
+                  const double rawMaximum = std::floor( ( maximum - offset ) / scale + 0.5 );
+
+                  minimum = std::min( rawMinimum, rawMaximum );
+                  maximum = std::max( rawMinimum, rawMaximum );
+               }
+               else
+               {
+                  minimum = std::trunc( minimum );
+                  maximum = std::trunc( maximum );
+               }
+               break;
+            }
+
+            case TypeFloat:
+            {
+               const auto floatNode = std::static_pointer_cast<FloatNodeImpl>( node );
+
+               // Only doubles written as single precision are checked as they are encoded
+               if ( ( floatNode->precision() == PrecisionSingle ) &&
+                    ( ( minimum < DOUBLE_MIN ) || ( DOUBLE_MAX < maximum ) ) )
+               {
+                  throw E57_EXCEPTION2( ErrorReal64TooLarge,
+                                        "pathName=" + buffer.pathName() +
+                                           " minimum=" + toString( minimum ) +
+                                           " maximum=" + toString( maximum ) );
+               }
+               continue;
+            }
+
+            default:
+               continue;
+         }
+
+         if ( !( static_cast<double>( fieldMinimum ) <= minimum ) ||
+              !( maximum <= static_cast<double>( fieldMaximum ) ) )
+         {
+            throw E57_EXCEPTION2( ErrorValueOutOfBounds,
+                                  "pathName=" + buffer.pathName() +
+                                     " minimum=" + toString( minimum ) +
+                                     " maximum=" + toString( maximum ) +
+                                     " fieldMinimum=" + toString( fieldMinimum ) +
+                                     " fieldMaximum=" + toString( fieldMaximum ) );
+         }
+      }
+   }
+
    bool CompressedVectorWriterImpl::isOpen() const
    {
       // don't checkImageFileOpen(__FILE__, __LINE__, __FUNCTION__), or
@@ -269,6 +589,23 @@ namespace e57
       proto_->checkBuffers( sbufs, false );
 
       sbufs_ = sbufs;
+
+      // The encoders read from the buffers they were made with, so hand them the new ones. The
+      // constructor calls this before there are any.
+      for ( size_t i = 0; ( i < sbufs_.size() ) && !bytestreams_.empty(); ++i )
+      {
+         const SourceDestBuffer &sbuf = sbufs_[i];
+         NodeImplSharedPtr node = proto_->get( sbuf.pathName() );
+         uint64_t bytestreamNumber = 0;
+
+         if ( !proto_->findTerminalPosition( node, bytestreamNumber ) )
+         {
+            throw E57_EXCEPTION2( ErrorInternal, "sbufIndex=" + toString( i ) );
+         }
+
+         std::vector<SourceDestBuffer> vTemp{ sbuf };
+         bytestreams_.at( bytestreamNumber )->sourceBufferSetNew( vTemp );
+      }
    }
 
    void CompressedVectorWriterImpl::write( std::vector<SourceDestBuffer> &sbufs,
@@ -288,10 +625,15 @@ namespace e57
 #endif
       checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
       checkWriterOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+      checkCancelled();
 
+      // A section needs at least one data packet, but more empty ones are only overhead
       if ( requestedRecordCount == 0 )
       {
-         packetWriteZeroRecords();
+         if ( ( dataPacketsCount_ == 0 ) && ( recordCount_ == 0 ) )
+         {
+            packetWriteZeroRecords();
+         }
          return;
       }
 
@@ -311,8 +653,47 @@ namespace e57
          sbuf.impl()->rewind();
       }
 
+      if ( options_.validatePerWrite )
+      {
+         checkValueRanges( requestedRecordCount );
+      }
+
+      if ( options_.collectFieldLimits )
+      {
+         updateFieldLimits( requestedRecordCount );
+      }
+
+      if ( !recordsPending_ )
+      {
+         recordsPending_ = true;
+         pendingSince_ = std::chrono::steady_clock::now();
+      }
+
+      // Write whatever is held once the oldest records have waited long enough
+      const auto flushIfLate = [this]() {
+         if ( ( options_.maxPacketLatencyMs > 0 ) &&
+              ( std::chrono::steady_clock::now() - pendingSince_ >=
+                std::chrono::milliseconds( options_.maxPacketLatencyMs ) ) )
+         {
+            flushPackets();
+         }
+      };
+
       // Loop until all channels have completed requestedRecordCount transfers
       uint64_t endRecordIndex = recordCount_ + requestedRecordCount;
+
+      if ( options_.columnarRunPackets > 0 )
+      {
+         columnarWrite( endRecordIndex );
+
+         recordCount_ += requestedRecordCount;
+
+         flushIfLate();
+
+         reportProgress( recordCount_ );
+         return;
+      }
+
       while ( true )
       {
          // Calc remaining record counts for all channels
@@ -346,14 +727,44 @@ namespace e57
 
 #ifdef E57_WRITE_CRAZY_PACKET_MODE
          //??? depends on number of streams
-         constexpr size_t E57_TARGET_PACKET_SIZE = 500;
+         const size_t E57_TARGET_PACKET_SIZE = 500;
 #else
-         constexpr size_t E57_TARGET_PACKET_SIZE = ( DATA_PACKET_MAX * 3 / 4 );
+         const size_t E57_TARGET_PACKET_SIZE = targetPacketSize_;
 #endif
-         // If have more than target fraction of packet, send it now
-         if ( currentPacketSize() >= E57_TARGET_PACKET_SIZE )
+         // Records are only encoded up to the end of the packet when packets have a record limit
+         uint64_t stepEndRecordIndex = endRecordIndex;
+
+         if ( options_.maxPacketRecords > 0 )
+         {
+            stepEndRecordIndex =
+               std::min( endRecordIndex, packetRecordStart_ + options_.maxPacketRecords );
+         }
+
+         // If have more than target fraction of packet, or enough records, send it now
+         if ( ( currentPacketSize() >= E57_TARGET_PACKET_SIZE ) ||
+              ( ( options_.maxPacketRecords > 0 ) &&
+                ( encodedRecordCount() - packetRecordStart_ >= options_.maxPacketRecords ) ) )
          { //???
-            packetWrite();
+            // If we are indexing and can start a new chunk here, write everything so far so
+            // the next packet is the start of the chunk.
+            if ( chunked_ && isAtChunkBoundary() )
+            {
+               chunkWrite();
+
+               if ( ( journalInterval_ > 0 ) &&
+                    ( dataPacketsCount_ - journalPacketsCount_ >= journalInterval_ ) )
+               {
+                  journalWrite();
+               }
+            }
+            else
+            {
+               packetWrite();
+            }
+
+            // Even if the records are all still in encoder registers, so the limit doesn't stop
+            // us from encoding more
+            packetRecordStart_ = encodedRecordCount();
             continue; // restart loop so recalc statistics (packet size may not be
                       // zero after write, if have too much data)
          }
@@ -379,25 +790,306 @@ namespace e57
 
          // !!!! For now just process one record per loop until packet is full
          // enough, or completed request
-         for ( auto &bytestream : bytestreams_ )
+         if ( workers_ )
          {
-            if ( bytestream->currentRecordIndex() < endRecordIndex )
+            encodeSteps( stepEndRecordIndex, E57_TARGET_PACKET_SIZE );
+         }
+         else
+         {
+            for ( auto &bytestream : bytestreams_ )
             {
-               // !!! For now, process up to 50 records at a time
-               uint64_t recordCount = endRecordIndex - bytestream->currentRecordIndex();
-               recordCount =
-                  ( recordCount < 50ULL ) ? recordCount : 50ULL; // min(recordCount, 50ULL);
-               bytestream->processRecords( static_cast<unsigned>( recordCount ) );
+               encodeStep( *bytestream, stepEndRecordIndex );
             }
          }
       }
 
       recordCount_ += requestedRecordCount;
 
+      flushIfLate();
+
+      chargeBuffers();
+
+      reportProgress( recordCount_ );
+
       // When we leave this function, will likely still have data in channel
       // ioBuffers as well as partial words in Encoder registers.
    }
 
+   // The size at which write() sends a packet. One more step of every bytestream whose output
+   // size is bounded must still fit in a packet, so packets are sent as full as that allows
+   // without splitting them unevenly (bytestreams of strings may still overflow the packet, and
+   // are split by packetWrite()). With many wide fields a step can take a large part of a packet,
+   // so never go below 3/4 full.
+   size_t CompressedVectorWriterImpl::targetPacketSize() const
+   {
+      const uint64_t cStepRecordCount = chunked_ ? cChunkRecordAlignment : cMaxStepRecordCount;
+
+      size_t stepGrowth = 0;
+
+      for ( const auto &bytestream : bytestreams_ )
+      {
+         const size_t cMaxGrowth = bytestream->maxOutputForRecords( cStepRecordCount );
+
+         if ( cMaxGrowth != SIZE_MAX )
+         {
+            stepGrowth += cMaxGrowth;
+         }
+      }
+
+      const size_t cMinimumSize = DATA_PACKET_MAX * 3 / 4;
+
+      if ( stepGrowth >= DATA_PACKET_MAX - cMinimumSize )
+      {
+         return cMinimumSize;
+      }
+
+      return DATA_PACKET_MAX - stepGrowth;
+   }
+
+   // Process the next few records of one bytestream.
+   void CompressedVectorWriterImpl::encodeStep( Encoder &bytestream,
+                                                uint64_t endRecordIndex ) const
+   {
+      if ( bytestream.currentRecordIndex() >= endRecordIndex )
+      {
+         return;
+      }
+
+      // !!! For now, process up to 50 records at a time
+      uint64_t recordCount =
+         std::min( endRecordIndex - bytestream.currentRecordIndex(), cMaxStepRecordCount );
+
+      // When indexing, stop each bytestream at the next possible chunk boundary so they
+      // all arrive there together.
+      if ( chunked_ )
+      {
+         const uint64_t toBoundary =
+            cChunkRecordAlignment - ( bytestream.currentRecordIndex() % cChunkRecordAlignment );
+         recordCount = std::min( endRecordIndex - bytestream.currentRecordIndex(), toBoundary );
+      }
+
+      bytestream.processRecords( static_cast<unsigned>( recordCount ) );
+   }
+
+   // Run as many steps of the write() loop as we can without the packet reaching
+   // targetPacketSize in between, encoding the bytestreams concurrently.
+   //
+   // Bytestreams only affect each other through the packet size check, so as long as that check
+   // would have failed after every step but the last, each bytestream sees exactly the same
+   // sequence of processRecords() calls as the serial loop and the file is byte-for-byte the
+   // same. Bytestreams whose output depends on the data (strings) are stepped here on the calling
+   // thread so we know their exact size; the others use maxOutputForRecords() as an upper limit.
+   void CompressedVectorWriterImpl::encodeSteps( uint64_t endRecordIndex,
+                                                 size_t targetPacketSize )
+   {
+      const size_t cStepRecordCount =
+         chunked_ ? cChunkRecordAlignment : cMaxStepRecordCount;
+
+      std::vector<Encoder *> bounded;
+      std::vector<Encoder *> unbounded;
+      size_t boundedSize = sizeof( DataPacketHeader ) + bytestreams_.size() * sizeof( uint16_t );
+      size_t boundedGrowthPerStep = 0;
+      uint64_t boundedRecordsRemaining = 0;
+
+      for ( auto &bytestream : bytestreams_ )
+      {
+         const size_t cMaxGrowth = bytestream->maxOutputForRecords( cStepRecordCount );
+
+         if ( cMaxGrowth == SIZE_MAX )
+         {
+            unbounded.push_back( bytestream.get() );
+         }
+         else
+         {
+            bounded.push_back( bytestream.get() );
+            boundedSize += bytestream->outputAvailable();
+            boundedGrowthPerStep += cMaxGrowth;
+            boundedRecordsRemaining = std::max( boundedRecordsRemaining,
+                                                endRecordIndex - bytestream->currentRecordIndex() );
+         }
+      }
+
+      uint64_t stepCount = 0;
+      while ( true )
+      {
+         for ( auto *bytestream : unbounded )
+         {
+            encodeStep( *bytestream, endRecordIndex );
+         }
+
+         ++stepCount;
+         boundedSize += boundedGrowthPerStep;
+
+         // Stop where the serial loop might find the packet full enough to write...
+         size_t maxPacketSize = boundedSize;
+         for ( const auto *bytestream : unbounded )
+         {
+            maxPacketSize += bytestream->outputAvailable();
+         }
+
+         if ( maxPacketSize >= targetPacketSize )
+         {
+            break;
+         }
+
+         // ...or once there is nothing left to do.
+         const bool cUnboundedDone =
+            std::all_of( unbounded.begin(), unbounded.end(), [=]( Encoder *bytestream ) {
+               return bytestream->currentRecordIndex() >= endRecordIndex;
+            } );
+
+         if ( cUnboundedDone && ( stepCount * cStepRecordCount >= boundedRecordsRemaining ) )
+         {
+            break;
+         }
+      }
+
+      workers_->parallelFor( bounded.size(), [&]( size_t i ) {
+         for ( size_t step = 0; step < stepCount; ++step )
+         {
+            encodeStep( *bounded[i], endRecordIndex );
+         }
+      } );
+   }
+
+   // Encode up to endRecordIndex with each bytestream written in packets of its own (see
+   // CompressedVectorWriterOptions::columnarRunPackets).
+   //
+   // Each bytestream is encoded until it has enough output for a packet, which is then added to
+   // its run. The bytestreams don't depend on each other at all, so they can be encoded
+   // concurrently and the file is the same whatever the number of threads.
+   void CompressedVectorWriterImpl::columnarWrite( uint64_t endRecordIndex )
+   {
+      const auto fill = [this, endRecordIndex]( size_t i ) {
+         Encoder &bytestream = *bytestreams_[i];
+
+         while ( ( bytestream.currentRecordIndex() < endRecordIndex ) &&
+                 ( bytestream.outputAvailable() < cColumnPacketSize ) )
+         {
+            encodeStep( bytestream, endRecordIndex );
+         }
+      };
+
+      while ( true )
+      {
+         if ( workers_ )
+         {
+            workers_->parallelFor( bytestreams_.size(), fill );
+         }
+         else
+         {
+            for ( size_t i = 0; i < bytestreams_.size(); ++i )
+            {
+               fill( i );
+            }
+         }
+
+         // Each bytestream either has a packet's worth of output, or all its records
+         bool wrotePacket = false;
+
+         for ( size_t i = 0; i < bytestreams_.size(); ++i )
+         {
+            if ( bytestreams_[i]->outputAvailable() >= cColumnPacketSize )
+            {
+               columnPacketWrite( i );
+               wrotePacket = true;
+            }
+         }
+
+         if ( !wrotePacket )
+         {
+            break;
+         }
+      }
+   }
+
+   // Add a packet holding only the output of one bytestream to its run, and write the run if it
+   // is long enough.
+   void CompressedVectorWriterImpl::columnPacketWrite( size_t bytestreamIndex )
+   {
+      const size_t cPacketMaxPayloadBytes =
+         DATA_PACKET_MAX - sizeof( DataPacketHeader ) - bytestreams_.size() * sizeof( uint16_t );
+
+      std::vector<size_t> count( bytestreams_.size(), 0 );
+      count[bytestreamIndex] =
+         std::min( bytestreams_[bytestreamIndex]->outputAvailable(), cPacketMaxPayloadBytes );
+
+      const unsigned packetLength = packetBuild( count );
+      const auto packet = reinterpret_cast<const char *>( &dataPacket_ );
+
+      ColumnRun &run = columnRuns_[bytestreamIndex];
+      run.packets.insert( run.packets.end(), packet, packet + packetLength );
+      run.packetLengths.push_back( packetLength );
+
+      if ( run.packetLengths.size() >= options_.columnarRunPackets )
+      {
+         columnRunWrite( bytestreamIndex );
+      }
+   }
+
+   // Write the packets waiting in a bytestream's run one after the other.
+   void CompressedVectorWriterImpl::columnRunWrite( size_t bytestreamIndex )
+   {
+      ColumnRun &run = columnRuns_[bytestreamIndex];
+      const char *packet = run.packets.data();
+
+      for ( const unsigned packetLength : run.packetLengths )
+      {
+         dataPacketAppend( packet, packetLength );
+         packet += packetLength;
+      }
+
+      run.packets.clear();
+      run.packetLengths.clear();
+   }
+
+   void CompressedVectorWriterImpl::chargeBuffers()
+   {
+      // The packet being built counts as the encoders' output too
+      uint64_t encoderBytes = sizeof( dataPacket_ );
+
+      for ( const auto &bytestream : bytestreams_ )
+      {
+         encoderBytes += bytestream->bufferSize();
+      }
+
+      encoderCharge_.set( encoderBytes );
+
+      uint64_t bufferBytes = stagedSection_.capacity();
+
+      for ( const auto &run : columnRuns_ )
+      {
+         bufferBytes += run.packets.capacity();
+      }
+
+      writeBufferCharge_.set( bufferBytes );
+   }
+
+   void CompressedVectorWriterImpl::checkCancelled()
+   {
+      if ( cancelled_ || ( options_.cancellation && options_.cancellation->isCancelled() ) )
+      {
+         cancelled_ = true;
+
+         throw E57_EXCEPTION2( ErrorCancelled, "imageFileName=" + cVector_->imageFileName() +
+                                                  " cvPathName=" + cVector_->pathName() );
+      }
+   }
+
+   void CompressedVectorWriterImpl::reportProgress( uint64_t recordsDone ) const
+   {
+      if ( !options_.progress )
+      {
+         return;
+      }
+
+      CompressedVectorProgress progress;
+      progress.recordsDone = recordsDone;
+      progress.bytesDone = dataBytesWritten_;
+
+      options_.progress( progress );
+   }
+
    size_t CompressedVectorWriterImpl::totalOutputAvailable() const
    {
       size_t total = 0;
@@ -417,12 +1109,29 @@ namespace e57
                totalOutputAvailable() );
    }
 
+   // Number of records every bytestream has encoded
+   uint64_t CompressedVectorWriterImpl::encodedRecordCount() const
+   {
+      uint64_t count = UINT64_MAX;
+
+      for ( const auto &bytestream : bytestreams_ )
+      {
+         count = std::min( count, bytestream->currentRecordIndex() );
+      }
+
+      return count;
+   }
+
    uint64_t CompressedVectorWriterImpl::packetWrite()
    {
 #ifdef E57_VERBOSE
       std::cout << "CompressedVectorWriterImpl::packetWrite() called" << std::endl; //???
 #endif
 
+#ifdef E57_ENABLE_TRACING
+      TraceScope trace( "CompressedVectorWriterImpl::packetWrite" );
+#endif
+
       // Double check that we have work to do
       const size_t cTotalOutput = totalOutputAvailable();
       if ( cTotalOutput == 0 )
@@ -478,7 +1187,23 @@ namespace e57
       }
 #endif
 
+      const unsigned packetLength = packetBuild( count );
+
+      return dataPacketAppend( reinterpret_cast<char *>( &dataPacket_ ), packetLength );
+   }
+
+   // Build a data packet in dataPacket_ holding the next count[i] bytes of each bytestream, and
+   // return its length.
+   unsigned CompressedVectorWriterImpl::packetBuild( const std::vector<size_t> &count )
+   {
+      // const bytestreams_ so it's clear it isn't modified in this function
+      const auto &cStreams = bytestreams_;
+      const auto cNumByteStreams = cStreams.size();
+
 #if VALIDATE_BASIC
+      const size_t cPacketMaxPayloadBytes =
+         DATA_PACKET_MAX - sizeof( DataPacketHeader ) - cNumByteStreams * sizeof( uint16_t );
+
       // Double check sum of count is <= packetMaxPayloadBytes
       const size_t cTotalByteCount =
          std::accumulate( count.begin(), count.end(), static_cast<size_t>( 0 ) );
@@ -491,9 +1216,6 @@ namespace e57
       }
 #endif
 
-      // Get smart pointer to ImageFileImpl from associated CompressedVector
-      ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
-
       // Use temp buf in object (is 64KBytes long) instead of allocating each time here
       char *packet = reinterpret_cast<char *>( &dataPacket_ );
 
@@ -564,7 +1286,7 @@ namespace e57
       {
          // Double check we aren't accidentally going to write off end of
          // vector<char>
-         if ( p >= &packet[DATA_PACKET_MAX - 1] )
+         if ( p >= &packet[DATA_PACKET_MAX] )
          {
             throw E57_EXCEPTION1( ErrorInternal );
          }
@@ -585,12 +1307,16 @@ namespace e57
       // Double check that data packet is well formed
       dataPacket_.verify( packetLength );
 
+      return packetLength;
+   }
+
+   uint64_t CompressedVectorWriterImpl::dataPacketAppend( const char *packet,
+                                                          size_t packetLength )
+   {
+      checkCancelled();
+
       // Write whole data packet at beginning of free space in file
-      uint64_t packetLogicalOffset = imf->allocateSpace( packetLength, false );
-      uint64_t packetPhysicalOffset = imf->file_->logicalToPhysical( packetLogicalOffset );
-      imf->file_->seek( packetLogicalOffset ); //??? have seekLogical and seekPhysical instead?
-                                               // more explicit
-      imf->file_->write( packet, packetLength );
+      const uint64_t packetPhysicalOffset = appendPacket( packet, packetLength );
 
 #ifdef E57_VERBOSE
 //  std::cout << "data packet:" << std::endl;
@@ -609,7 +1335,28 @@ namespace e57
       }
       dataPacketsCount_++;
 
-      // !!! update seekIndex here? if started new chunk?
+      // If this packet starts a chunk, add it to the index
+      if ( options_.writeIndexPackets && chunkStartPending_ )
+      {
+         IndexPacket::IndexPacketEntry entry;
+         entry.chunkRecordNumber = chunkRecordNumber_;
+         entry.chunkPhysicalOffset = packetPhysicalOffset;
+
+         chunkIndex_.push_back( entry );
+         chunkStartPending_ = false;
+      }
+
+      dataBytesWritten_ += packetLength;
+
+#ifdef E57_ENABLE_STATISTICS
+      countDataPacket( packetLength );
+#endif
+
+      if ( ++packetsSinceProgress_ >= options_.progressPacketInterval )
+      {
+         packetsSinceProgress_ = 0;
+         reportProgress( encodedRecordCount() );
+      }
 
       // Return physical offset of data packet for potential use in seekIndex
       return ( packetPhysicalOffset ); //??? needed
@@ -619,8 +1366,6 @@ namespace e57
    // Code is a simplified version of packetWrite().
    void CompressedVectorWriterImpl::packetWriteZeroRecords()
    {
-      ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
-
       dataPacket_.header.reset();
 
       // Use temp buf in object (is 64KBytes long) instead of allocating each time here
@@ -644,11 +1389,7 @@ namespace e57
       dataPacket_.verify( packetLength );
 
       // Write packet at beginning of free space in file
-      uint64_t packetLogicalOffset = imf->allocateSpace( packetLength, false );
-      uint64_t packetPhysicalOffset = imf->file_->logicalToPhysical( packetLogicalOffset );
-
-      imf->file_->seek( packetLogicalOffset );
-      imf->file_->write( packet, packetLength );
+      const uint64_t packetPhysicalOffset = appendPacket( packet, packetLength );
 
       // If first data packet written for this CompressedVector binary section,
       // save address to put in section header
@@ -658,9 +1399,211 @@ namespace e57
       }
 
       dataPacketsCount_++;
+
+#ifdef E57_ENABLE_STATISTICS
+      countDataPacket( packetLength );
+#endif
    }
 
-   void CompressedVectorWriterImpl::flush()
+#ifdef E57_ENABLE_STATISTICS
+   void CompressedVectorWriterImpl::countDataPacket( size_t packetLength ) const
+   {
+      ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
+
+      if ( Statistics *statistics = imf->file_->statistics() )
+      {
+         Statistics::add( statistics->dataPacketsWritten );
+         Statistics::add( statistics->dataPacketBytesWritten, packetLength );
+      }
+   }
+#endif
+
+   bool CompressedVectorWriterImpl::isAtChunkBoundary() const
+   {
+      // Every bytestream must have completed exactly the same records, ending on an aligned
+      // record number, so that they all start together in the next packet.
+      const uint64_t recordIndex = bytestreams_.front()->currentRecordIndex();
+
+      if ( ( recordIndex % cChunkRecordAlignment ) != 0 )
+      {
+         return false;
+      }
+
+      if ( recordIndex <= chunkRecordNumber_ )
+      {
+         return false;
+      }
+
+      for ( const auto &bytestream : bytestreams_ )
+      {
+         if ( bytestream->currentRecordIndex() != recordIndex )
+         {
+            return false;
+         }
+      }
+
+      return true;
+   }
+
+   void CompressedVectorWriterImpl::chunkWrite()
+   {
+      const uint64_t recordIndex = bytestreams_.front()->currentRecordIndex();
+
+      for ( auto &bytestream : bytestreams_ )
+      {
+         bytestream->finishChunk();
+      }
+
+      // Finish the current chunk. It may need more than one packet if we have lots of output.
+      while ( totalOutputAvailable() > 0 )
+      {
+         packetWrite();
+      }
+
+      chunkStartPending_ = true;
+      chunkRecordNumber_ = recordIndex;
+   }
+
+   void CompressedVectorWriterImpl::journalWrite()
+   {
+      // The journal can only describe packets which are in the file
+      if ( backgroundWriter_ )
+      {
+         backgroundWriter_->wait();
+      }
+
+      ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
+
+      imf->writeJournal( cVector_.get(), sectionHeaderLogicalStart_, dataPhysicalOffset_,
+                         chunkRecordNumber_ );
+
+      journalPacketsCount_ = dataPacketsCount_;
+   }
+
+   void CompressedVectorWriterImpl::indexWrite()
+   {
+      // IndexPacket is ~32k, so don't put it on the stack
+      std::unique_ptr<IndexPacket> packet( new IndexPacket );
+
+      std::vector<IndexPacket::IndexPacketEntry> entries = chunkIndex_;
+      uint8_t indexLevel = 0;
+
+      // Write one level of the tree at a time. Each packet written becomes an entry in the level
+      // above, until everything fits in a single top level packet.
+      while ( true )
+      {
+         const size_t packetCount =
+            ( entries.size() + IndexPacket::MAX_ENTRIES - 1 ) / IndexPacket::MAX_ENTRIES;
+
+         std::vector<IndexPacket::IndexPacketEntry> parentEntries;
+
+         // Spread the entries evenly so a packet above level 0 never ends up with only one.
+         size_t first = 0;
+         for ( size_t i = 0; i < packetCount; ++i )
+         {
+            const size_t end = ( entries.size() * ( i + 1 ) ) / packetCount;
+            const size_t entryCount = end - first;
+
+            std::copy( entries.begin() + static_cast<std::ptrdiff_t>( first ),
+                       entries.begin() + static_cast<std::ptrdiff_t>( end ), packet->entries );
+
+            const auto packetLength = static_cast<unsigned>(
+               sizeof( IndexPacketHeader ) + entryCount * sizeof( IndexPacket::IndexPacketEntry ) );
+
+            packet->header.packetLogicalLengthMinus1 = static_cast<uint16_t>( packetLength - 1 );
+            packet->header.entryCount = static_cast<uint16_t>( entryCount );
+            packet->header.indexLevel = indexLevel;
+
+            // Double check that index packet is well formed
+            packet->verify( packetLength );
+
+            const uint64_t packetPhysicalOffset =
+               appendPacket( reinterpret_cast<char *>( packet.get() ), packetLength );
+
+            indexPacketsCount_++;
+
+            IndexPacket::IndexPacketEntry parentEntry;
+            parentEntry.chunkRecordNumber = entries[first].chunkRecordNumber;
+            parentEntry.chunkPhysicalOffset = packetPhysicalOffset;
+
+            parentEntries.push_back( parentEntry );
+
+            first = end;
+         }
+
+         if ( packetCount == 1 )
+         {
+            topIndexPhysicalOffset_ = parentEntries.front().chunkPhysicalOffset;
+            return;
+         }
+
+         entries.swap( parentEntries );
+         indexLevel++;
+      }
+   }
+
+   uint64_t CompressedVectorWriterImpl::appendPacket( const char *packet, size_t packetLength )
+   {
+      // While staging, packets are added to stagedSection_, and their offset in the section is
+      // returned instead. writeStagedSection() converts these once it knows where the section is.
+      if ( isStaging_ )
+      {
+         const uint64_t sectionOffset = stagedSection_.size();
+
+         stagedSection_.insert( stagedSection_.end(), packet, packet + packetLength );
+
+         return sectionOffset;
+      }
+
+      ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
+
+      const uint64_t packetLogicalOffset = imf->allocateSpace( packetLength, false );
+
+      if ( backgroundWriter_ )
+      {
+         backgroundWriter_->write( packetLogicalOffset, packet, packetLength );
+      }
+      else
+      {
+         imf->file_->seek( packetLogicalOffset );
+         imf->file_->write( packet, packetLength );
+      }
+
+      return imf->file_->logicalToPhysical( packetLogicalOffset );
+   }
+
+   void CompressedVectorWriterImpl::writeStagedSection()
+   {
+      ImageFileImplSharedPtr imf( cVector_->destImageFile_ );
+
+      // Put the section at the beginning of free space in the file, all in one write. The header
+      // is written again (properly) by close().
+      sectionHeaderLogicalStart_ = imf->allocateSpace( stagedSection_.size(), false );
+
+      imf->file_->seek( sectionHeaderLogicalStart_ );
+      imf->file_->write( stagedSection_.data(), stagedSection_.size() );
+
+      // Now we know where the packets are, convert their offsets within the section
+      const auto toPhysical = [this]( uint64_t sectionOffset ) {
+         return CheckedFile::logicalToPhysical( sectionHeaderLogicalStart_ + sectionOffset );
+      };
+
+      if ( dataPacketsCount_ > 0 )
+      {
+         dataPhysicalOffset_ = toPhysical( dataPhysicalOffset_ );
+      }
+
+      for ( auto &entry : chunkIndex_ )
+      {
+         entry.chunkPhysicalOffset = toPhysical( entry.chunkPhysicalOffset );
+      }
+
+      // Anything else (index packets) goes straight to the file
+      std::vector<char>().swap( stagedSection_ );
+      isStaging_ = false;
+   }
+
+   void CompressedVectorWriterImpl::flushRegisters()
    {
       for ( auto &bytestream : bytestreams_ )
       {
@@ -668,6 +1611,61 @@ namespace e57
       }
    }
 
+   void CompressedVectorWriterImpl::flush()
+   {
+      checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+      checkWriterOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+      checkCancelled();
+
+      flushPackets();
+   }
+
+   // Write everything the bytestreams have output to the file, in as many packets as it takes.
+   // Partial words can't be written without ending the bytestream, so they wait for the next
+   // records (or close()).
+   void CompressedVectorWriterImpl::flushPackets()
+   {
+      recordsPending_ = false;
+
+      // Nothing goes in the file until the writer closes
+      if ( isStaging_ )
+      {
+         return;
+      }
+
+      for ( auto &bytestream : bytestreams_ )
+      {
+         bytestream->flushOutput();
+      }
+
+      if ( options_.columnarRunPackets > 0 )
+      {
+         for ( size_t i = 0; i < bytestreams_.size(); ++i )
+         {
+            while ( bytestreams_[i]->outputAvailable() > 0 )
+            {
+               columnPacketWrite( i );
+            }
+
+            columnRunWrite( i );
+         }
+      }
+      else
+      {
+         while ( totalOutputAvailable() > 0 )
+         {
+            packetWrite();
+         }
+
+         packetRecordStart_ = encodedRecordCount();
+      }
+
+      if ( backgroundWriter_ )
+      {
+         backgroundWriter_->wait();
+      }
+   }
+
    void CompressedVectorWriterImpl::checkImageFileOpen( const char *srcFileName, int srcLineNumber,
                                                         const char *srcFunctionName ) const
    {
@@ -26,23 +26,33 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <chrono>
+#include <map>
+
 #include "Encoder.h"
+#include "MemoryAccount.h"
 #include "Packet.h"
 
 namespace e57
 {
+   class BackgroundWriter;
+   class WorkerPool;
+
    class CompressedVectorWriterImpl
    {
    public:
       CompressedVectorWriterImpl( std::shared_ptr<CompressedVectorNodeImpl> ni,
-                                  std::vector<SourceDestBuffer> &sbufs );
+                                  std::vector<SourceDestBuffer> &sbufs,
+                                  const CompressedVectorWriterOptions &options = {} );
       ~CompressedVectorWriterImpl();
 
       void write( size_t requestedRecordCount );
       void write( std::vector<SourceDestBuffer> &sbufs, size_t requestedRecordCount );
+      void flush();
       bool isOpen() const;
       std::shared_ptr<CompressedVectorNodeImpl> compressedVectorNode() const;
       void close();
+      bool fieldLimits( const ustring &pathName, double &minimum, double &maximum ) const;
 
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout );
@@ -56,10 +66,46 @@ namespace e57
       void setBuffers( std::vector<SourceDestBuffer> &sbufs ); //???needed?
       size_t totalOutputAvailable() const;
       size_t currentPacketSize() const;
+      size_t targetPacketSize() const;
+      uint64_t encodedRecordCount() const;
       uint64_t packetWrite();
+      unsigned packetBuild( const std::vector<size_t> &count );
+      uint64_t dataPacketAppend( const char *packet, size_t packetLength );
       void packetWriteZeroRecords();
+      void columnarWrite( uint64_t endRecordIndex );
+      void columnPacketWrite( size_t bytestreamIndex );
+      void columnRunWrite( size_t bytestreamIndex );
+      bool isAtChunkBoundary() const;
+      void chunkWrite();
+      void indexWrite();
+      void journalWrite();
+      uint64_t appendPacket( const char *packet, size_t packetLength );
+      void writeStagedSection();
+      void encodeStep( Encoder &bytestream, uint64_t endRecordIndex ) const;
+      void encodeSteps( uint64_t endRecordIndex, size_t targetPacketSize );
+      void updateFieldLimits( size_t recordCount );
+      void checkValueRanges( size_t recordCount ) const;
 
-      void flush();
+      void flushRegisters();
+      void flushPackets();
+
+      /// Count the encoders' buffers and the packets waiting to be written in the ImageFile's
+      /// memory usage, since they grow as needed
+      void chargeBuffers();
+
+      /// Throw ErrorCancelled if the writer's CancellationToken has been cancelled, and from then
+      /// on leave the section unfinished
+      void checkCancelled();
+
+      /// Tell options_.progress how far the writer has got
+      void reportProgress( uint64_t recordsDone ) const;
+
+#ifdef E57_ENABLE_STATISTICS
+      /// Add a data packet of packetLength bytes to the ImageFile's statistics
+      void countDataPacket( size_t packetLength ) const;
+#endif
+
+      const CompressedVectorWriterOptions options_;
 
       std::vector<SourceDestBuffer> sbufs_;
       std::shared_ptr<CompressedVectorNodeImpl> cVector_;
@@ -68,6 +114,12 @@ namespace e57
       std::vector<std::shared_ptr<Encoder>> bytestreams_;
       DataPacket dataPacket_;
 
+      /// Encodes bytestreams concurrently (only if options_.encodeThreadCount > 1)
+      std::unique_ptr<WorkerPool> workers_;
+
+      /// Writes packets while the next ones are encoded (only if options_.writeBehindPacketCount)
+      std::unique_ptr<BackgroundWriter> backgroundWriter_;
+
       bool isOpen_;
       uint64_t sectionHeaderLogicalStart_; /// start of CompressedVector binary section
       uint64_t sectionLogicalLength_;      /// total length of CompressedVector binary section
@@ -76,5 +128,59 @@ namespace e57
       uint64_t recordCount_;               /// number of records written so far
       uint64_t dataPacketsCount_;          /// number of data packets written so far
       uint64_t indexPacketsCount_;         /// number of index packets written so far
+
+      /// Level 0 index entries, one per chunk (only if options_.writeIndexPackets)
+      std::vector<IndexPacket::IndexPacketEntry> chunkIndex_;
+      bool chunkStartPending_;      /// next data packet written starts a new chunk
+      uint64_t chunkRecordNumber_;  /// first record of the pending chunk
+
+      /// Data packets between journals (see ImageFileOptions::journalInterval), or 0 if this
+      /// writer isn't journaled until it closes
+      unsigned journalInterval_;
+      uint64_t journalPacketsCount_; /// dataPacketsCount_ when the last journal was written
+
+      /// Bytestreams end at chunk boundaries, for index packets or journals
+      bool chunked_;
+
+      /// currentPacketSize() at which write() sends a packet (see targetPacketSize())
+      size_t targetPacketSize_ = 0;
+
+      /// encodedRecordCount() when the last data packet was written (see
+      /// options_.maxPacketRecords)
+      uint64_t packetRecordStart_;
+
+      /// When the oldest records not yet flushed were written (see options_.maxPacketLatencyMs)
+      bool recordsPending_;
+      std::chrono::steady_clock::time_point pendingSince_;
+
+      /// With options_.stageInMemory, the section is built here until the writer closes. While
+      /// isStaging_, dataPhysicalOffset_ and chunkIndex_ hold offsets within it.
+      bool isStaging_;
+      std::vector<char> stagedSection_;
+
+      /// With options_.columnarRunPackets, the packets of each bytestream waiting to be written
+      struct ColumnRun
+      {
+         std::vector<char> packets;
+         std::vector<unsigned> packetLengths;
+      };
+      std::vector<ColumnRun> columnRuns_;
+
+      /// Bytes of data packets written so far, and since options_.progress was last called
+      uint64_t dataBytesWritten_ = 0;
+      unsigned packetsSinceProgress_ = 0;
+
+      /// Whether options_.cancellation has stopped the writer
+      bool cancelled_ = false;
+
+      /// Smallest and largest values written to each field (only if options_.collectFieldLimits)
+      std::map<ustring, std::pair<double, double>> fieldLimits_;
+
+      /// The encoders' buffers in ImageFileMemoryUsage::encoders, and stagedSection_ and
+      /// columnRuns_, and the room taken for backgroundWriter_, in
+      /// ImageFileMemoryUsage::writeBuffers
+      MemoryCharge encoderCharge_;
+      MemoryCharge writeBufferCharge_;
+      MemoryCharge writeBehindCharge_;
    };
 }
@@ -0,0 +1,339 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cctype>
+
+#if defined( _WIN32 )
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "DatasetReaderImpl.h"
+#include "Common.h"
+#include "StringFunctions.h"
+#include "WorkerPool.h"
+
+namespace e57
+{
+   /// Whether @a name ends with @a extension, ignoring the case of ASCII letters
+   static bool _hasExtension( const ustring &name, const ustring &extension )
+   {
+      if ( name.size() <= extension.size() )
+      {
+         return false;
+      }
+
+      return std::equal( extension.begin(), extension.end(),
+                         name.end() - static_cast<std::ptrdiff_t>( extension.size() ),
+                         []( char a, char b ) {
+                            return std::tolower( static_cast<unsigned char>( a ) ) ==
+                                   std::tolower( static_cast<unsigned char>( b ) );
+                         } );
+   }
+
+   DatasetReaderImpl::DatasetReaderImpl( const std::vector<ustring> &filePaths,
+                                         const DatasetReaderOptions &options ) :
+      readerOptions_( options.readerOptions ), threadCount_( options.threadCount )
+   {
+      if ( threadCount_ == 0 )
+      {
+         const std::shared_ptr<Executor> executor = readerOptions_.executor
+                                                       ? readerOptions_.executor
+                                                       : WorkStealingExecutor::defaultExecutor();
+
+         threadCount_ = executor->concurrency();
+      }
+
+      files_.reserve( filePaths.size() );
+
+      for ( const auto &path : filePaths )
+      {
+         files_.emplace_back( new File );
+         files_.back()->path = path;
+      }
+
+      // Each file is opened (or has its summary read) by one task, and they share Xerces and its
+      // parsers (see XmlReaderPool)
+      const bool useMetadataSummaries = options.useMetadataSummaries;
+
+      forEachFile( [this, useMetadataSummaries]( size_t i ) {
+         File &file = *files_[i];
+
+         if ( useMetadataSummaries )
+         {
+            if ( !Reader::ReadMetadataSummary( file.path, file.summary, readerOptions_ ) )
+            {
+               throw E57_EXCEPTION2( ErrorInternal, "fileName=" + file.path );
+            }
+         }
+         else if ( !openFile( file ).GetMetadataSummary( file.summary ) )
+         {
+            throw E57_EXCEPTION2( ErrorInternal, "fileName=" + file.path );
+         }
+      } );
+
+      firstData3D_.push_back( 0 );
+      firstImage2D_.push_back( 0 );
+
+      for ( const auto &file : files_ )
+      {
+         firstData3D_.push_back( firstData3D_.back() +
+                                 static_cast<int64_t>( file->summary.data3D.size() ) );
+         firstImage2D_.push_back( firstImage2D_.back() +
+                                  static_cast<int64_t>( file->summary.images2D.size() ) );
+      }
+   }
+
+   std::vector<ustring> DatasetReaderImpl::FindFiles( const ustring &directoryPath,
+                                                      const ustring &extension )
+   {
+      std::vector<ustring> names;
+
+#if defined( _WIN32 )
+      //??? unicode support here
+      WIN32_FIND_DATAA found;
+      HANDLE search = ::FindFirstFileA( ( directoryPath + "\\*" ).c_str(), &found );
+
+      if ( search == INVALID_HANDLE_VALUE )
+      {
+         throw E57_EXCEPTION2( ErrorOpenFailed, "directoryPath=" + directoryPath );
+      }
+
+      do
+      {
+         if ( ( found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) == 0 )
+         {
+            names.emplace_back( found.cFileName );
+         }
+      } while ( ::FindNextFileA( search, &found ) );
+
+      ::FindClose( search );
+#else
+      DIR *directory = ::opendir( directoryPath.c_str() );
+
+      if ( directory == nullptr )
+      {
+         throw E57_EXCEPTION2( ErrorOpenFailed, "directoryPath=" + directoryPath );
+      }
+
+      while ( const dirent *entry = ::readdir( directory ) )
+      {
+         const ustring name = entry->d_name;
+         struct stat status = {};
+
+         if ( ( ::stat( ( directoryPath + "/" + name ).c_str(), &status ) == 0 ) &&
+              S_ISREG( status.st_mode ) )
+         {
+            names.push_back( name );
+         }
+      }
+
+      ::closedir( directory );
+#endif
+
+      names.erase( std::remove_if( names.begin(), names.end(),
+                                   [&extension]( const ustring &name ) {
+                                      return !_hasExtension( name, extension );
+                                   } ),
+                   names.end() );
+
+      std::sort( names.begin(), names.end() );
+
+      std::vector<ustring> paths;
+      paths.reserve( names.size() );
+
+      for ( const auto &name : names )
+      {
+         paths.push_back( directoryPath + "/" + name );
+      }
+
+      return paths;
+   }
+
+   void DatasetReaderImpl::Close()
+   {
+      for ( const auto &file : files_ )
+      {
+         std::lock_guard<std::mutex> lock( file->mutex );
+
+         if ( file->reader )
+         {
+            file->reader->Close();
+            file->reader.reset();
+         }
+      }
+   }
+
+   size_t DatasetReaderImpl::GetFileCount() const
+   {
+      return files_.size();
+   }
+
+   ustring DatasetReaderImpl::GetFilePath( size_t fileIndex ) const
+   {
+      if ( fileIndex >= files_.size() )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "fileIndex=" + toString( fileIndex ) );
+      }
+
+      return files_[fileIndex]->path;
+   }
+
+   bool DatasetReaderImpl::GetMetadataSummary( size_t fileIndex, MetadataSummary &summary ) const
+   {
+      if ( fileIndex >= files_.size() )
+      {
+         return false;
+      }
+
+      summary = files_[fileIndex]->summary;
+
+      return true;
+   }
+
+   Reader DatasetReaderImpl::GetReader( size_t fileIndex ) const
+   {
+      if ( fileIndex >= files_.size() )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "fileIndex=" + toString( fileIndex ) );
+      }
+
+      return openFile( *files_[fileIndex] );
+   }
+
+   int64_t DatasetReaderImpl::GetData3DCount() const
+   {
+      return firstData3D_.back();
+   }
+
+   DatasetLocation DatasetReaderImpl::GetData3DLocation( int64_t dataIndex ) const
+   {
+      return locate( firstData3D_, dataIndex, "dataIndex=" );
+   }
+
+   bool DatasetReaderImpl::GetData3DSummary( int64_t dataIndex, Data3DSummary &summary ) const
+   {
+      if ( ( dataIndex < 0 ) || ( dataIndex >= GetData3DCount() ) )
+      {
+         return false;
+      }
+
+      const DatasetLocation location = GetData3DLocation( dataIndex );
+
+      summary = files_[location.fileIndex]->summary.data3D[static_cast<size_t>( location.index )];
+
+      return true;
+   }
+
+   bool DatasetReaderImpl::ReadData3D( int64_t dataIndex, Data3D &data3DHeader ) const
+   {
+      if ( ( dataIndex < 0 ) || ( dataIndex >= GetData3DCount() ) )
+      {
+         return false;
+      }
+
+      const DatasetLocation location = GetData3DLocation( dataIndex );
+
+      return openFile( *files_[location.fileIndex] ).ReadData3D( location.index, data3DHeader );
+   }
+
+   void DatasetReaderImpl::ForEachData3D( const DatasetData3DTask &task ) const
+   {
+      forEachFile( [this, &task]( size_t i ) {
+         const int64_t count = firstData3D_[i + 1] - firstData3D_[i];
+
+         // Files without any Data3D aren't opened
+         if ( count == 0 )
+         {
+            return;
+         }
+
+         Reader &reader = openFile( *files_[i] );
+
+         for ( int64_t fileDataIndex = 0; fileDataIndex < count; ++fileDataIndex )
+         {
+            task( firstData3D_[i] + fileDataIndex, reader, fileDataIndex );
+         }
+      } );
+   }
+
+   int64_t DatasetReaderImpl::GetImage2DCount() const
+   {
+      return firstImage2D_.back();
+   }
+
+   DatasetLocation DatasetReaderImpl::GetImage2DLocation( int64_t imageIndex ) const
+   {
+      return locate( firstImage2D_, imageIndex, "imageIndex=" );
+   }
+
+   bool DatasetReaderImpl::GetImage2DSummary( int64_t imageIndex, Image2DSummary &summary ) const
+   {
+      if ( ( imageIndex < 0 ) || ( imageIndex >= GetImage2DCount() ) )
+      {
+         return false;
+      }
+
+      const DatasetLocation location = GetImage2DLocation( imageIndex );
+
+      summary =
+         files_[location.fileIndex]->summary.images2D[static_cast<size_t>( location.index )];
+
+      return true;
+   }
+
+   bool DatasetReaderImpl::ReadImage2D( int64_t imageIndex, Image2D &image2DHeader ) const
+   {
+      if ( ( imageIndex < 0 ) || ( imageIndex >= GetImage2DCount() ) )
+      {
+         return false;
+      }
+
+      const DatasetLocation location = GetImage2DLocation( imageIndex );
+
+      return openFile( *files_[location.fileIndex] ).ReadImage2D( location.index, image2DHeader );
+   }
+
+   Reader &DatasetReaderImpl::openFile( File &file ) const
+   {
+      std::lock_guard<std::mutex> lock( file.mutex );
+
+      if ( !file.reader )
+      {
+         file.reader.reset( new Reader( file.path, readerOptions_ ) );
+      }
+
+      return *file.reader;
+   }
+
+   DatasetLocation DatasetReaderImpl::locate( const std::vector<int64_t> &firstItems,
+                                              int64_t index, const char *what )
+   {
+      if ( ( index < 0 ) || ( index >= firstItems.back() ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, what + toString( index ) );
+      }
+
+      // The last file whose first item is at or before index, skipping files without any
+      const auto found = std::upper_bound( firstItems.begin(), firstItems.end(), index );
+
+      DatasetLocation location;
+      location.fileIndex = static_cast<size_t>( found - firstItems.begin() ) - 1;
+      location.index = index - firstItems[location.fileIndex];
+
+      return location;
+   }
+
+   void DatasetReaderImpl::forEachFile( const std::function<void( size_t )> &task ) const
+   {
+      WorkerPool workers( threadCount_, readerOptions_.executor );
+
+      workers.parallelFor( files_.size(), task );
+   }
+}
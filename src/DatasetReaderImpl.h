@@ -0,0 +1,74 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "E57DatasetReader.h"
+
+namespace e57
+{
+   class DatasetReaderImpl
+   {
+   public:
+      DatasetReaderImpl( const std::vector<ustring> &filePaths,
+                         const DatasetReaderOptions &options );
+
+      DatasetReaderImpl( const DatasetReaderImpl & ) = delete;
+      DatasetReaderImpl &operator=( const DatasetReaderImpl & ) = delete;
+
+      static std::vector<ustring> FindFiles( const ustring &directoryPath,
+                                             const ustring &extension );
+
+      void Close();
+
+      size_t GetFileCount() const;
+      ustring GetFilePath( size_t fileIndex ) const;
+      bool GetMetadataSummary( size_t fileIndex, MetadataSummary &summary ) const;
+      Reader GetReader( size_t fileIndex ) const;
+
+      int64_t GetData3DCount() const;
+      DatasetLocation GetData3DLocation( int64_t dataIndex ) const;
+      bool GetData3DSummary( int64_t dataIndex, Data3DSummary &summary ) const;
+      bool ReadData3D( int64_t dataIndex, Data3D &data3DHeader ) const;
+      void ForEachData3D( const DatasetData3DTask &task ) const;
+
+      int64_t GetImage2DCount() const;
+      DatasetLocation GetImage2DLocation( int64_t imageIndex ) const;
+      bool GetImage2DSummary( int64_t imageIndex, Image2DSummary &summary ) const;
+      bool ReadImage2D( int64_t imageIndex, Image2D &image2DHeader ) const;
+
+   private:
+      /// One file of the dataset. Its Reader is made when the file is first opened, which may be
+      /// on any thread.
+      struct File
+      {
+         ustring path;
+         MetadataSummary summary;
+
+         std::mutex mutex; // protects reader
+         std::unique_ptr<Reader> reader;
+      };
+
+      /// The Reader of @a file, opening it if it hasn't been
+      Reader &openFile( File &file ) const;
+
+      /// The file holding item @a index of the dataset, where @a firstItems holds the index of
+      /// the first Data3D (or Image2D) of each file, and one past the last
+      static DatasetLocation locate( const std::vector<int64_t> &firstItems, int64_t index,
+                                     const char *what );
+
+      /// Run @a task( i ) for every file i, several at a time
+      void forEachFile( const std::function<void( size_t )> &task ) const;
+
+      ReaderOptions readerOptions_;
+      unsigned threadCount_;
+
+      std::vector<std::unique_ptr<File>> files_;
+
+      std::vector<int64_t> firstData3D_;
+      std::vector<int64_t> firstImage2D_;
+   };
+}
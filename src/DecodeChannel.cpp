@@ -37,6 +37,7 @@ namespace e57
    {
       maxRecordCount = maxRecordCount_arg;
       currentPacketLogicalOffset = 0;
+      currentPacketIndex = 0;
       currentBytestreamBufferIndex = 0;
       currentBytestreamBufferLength = 0;
       inputFinished = false;
@@ -50,8 +51,8 @@ namespace e57
          return ( true );
       }
 
-      // If we have filled the dest buffer, we are blocked
-      return ( dbuf.impl()->nextIndex() == dbuf.impl()->capacity() );
+      // If we have filled the dest buffer (or the current tile of it), we are blocked
+      return ( dbuf.impl()->nextIndex() >= dbuf.impl()->limit() );
    }
 
    bool DecodeChannel::isInputBlocked() const
@@ -79,6 +80,8 @@ namespace e57
       os << space( indent ) << "maxRecordCount:                " << maxRecordCount << std::endl;
       os << space( indent ) << "currentPacketLogicalOffset:    " << currentPacketLogicalOffset
          << std::endl;
+      os << space( indent ) << "currentPacketIndex:            " << currentPacketIndex
+         << std::endl;
       os << space( indent ) << "currentBytestreamBufferIndex:  " << currentBytestreamBufferIndex
          << std::endl;
       os << space( indent ) << "currentBytestreamBufferLength: " << currentBytestreamBufferLength
@@ -39,6 +39,7 @@ namespace e57
       unsigned bytestreamNumber;
       uint64_t maxRecordCount;
       uint64_t currentPacketLogicalOffset;
+      size_t currentPacketIndex; /// of currentPacketLogicalOffset in the reader's packet directory
       size_t currentBytestreamBufferIndex;
       size_t currentBytestreamBufferLength;
       bool inputFinished;
@@ -27,22 +27,145 @@
 
 #include <algorithm>
 #include <cstring>
+#include <limits>
+#include <type_traits>
 
+#include "BitpackKernels.h"
 #include "CompressedVectorNodeImpl.h"
 #include "Decoder.h"
+#include "DeltaCodec.h"
 #include "FloatNodeImpl.h"
 #include "ImageFileImpl.h"
 #include "IntegerNodeImpl.h"
 #include "ScaledIntegerNodeImpl.h"
 #include "SourceDestBufferImpl.h"
 #include "StringFunctions.h"
+#include "XorCodec.h"
+#include "ZstdCodec.h"
 
 using namespace e57;
 
-std::shared_ptr<Decoder> Decoder::DecoderFactory( unsigned bytestreamNumber, //!!! name ok?
-                                                  const CompressedVectorNodeImpl *cVector,
-                                                  std::vector<SourceDestBuffer> &dbufs,
-                                                  const ustring & /*codecPath*/ )
+namespace
+{
+   // Number of values BitpackIntegerDecoder unpacks at a time when it can't unpack them straight
+   // into the destination buffer.
+   constexpr size_t cUnpackBlockSize = 256;
+
+   // Read the LEB128 varint at in[pos] into value and move pos past it. If it doesn't all fit
+   // before in[available], leave pos alone and return false.
+   bool readVarint( const uint8_t *in, size_t &pos, size_t available, uint64_t recordIndex,
+                    uint64_t &value )
+   {
+      value = 0;
+      unsigned shift = 0;
+
+      for ( size_t end = pos; end < available; )
+      {
+         const uint8_t byte = in[end++];
+
+         if ( shift > 63 )
+         {
+            throw E57_EXCEPTION2( ErrorBadCVPacket, "recordIndex=" + toString( recordIndex ) );
+         }
+
+         value |= static_cast<uint64_t>( byte & 0x7F ) << shift;
+         shift += 7;
+
+         if ( ( byte & 0x80 ) == 0 )
+         {
+            pos = end;
+            return true;
+         }
+      }
+
+      return false;
+   }
+
+   // If the destination is a plain array of T, and every value which could be decoded fits in T,
+   // unpack the records straight into it. Otherwise the values have to go through setNextInt64s()
+   // to be converted or range checked.
+   template <typename T>
+   bool unpackInto( SourceDestBufferImpl &dbuf, const char *inbuf, size_t inbufSize,
+                    size_t firstBit, const BitUnpacker &unpacker, int64_t minimum,
+                    size_t recordCount )
+   {
+      const unsigned bitsPerRecord = unpacker.bitsPerRecord();
+
+      if ( dbuf.stride() != sizeof( T ) )
+      {
+         return false;
+      }
+
+      // int64_t holds anything (wrapping exactly as setNextInt64() does), otherwise check that
+      // the largest value we could decode fits.
+      if ( !std::is_same<T, int64_t>::value )
+      {
+         if ( ( bitsPerRecord > 32 ) || ( minimum < std::numeric_limits<T>::min() ) ||
+              ( minimum > std::numeric_limits<T>::max() ) )
+         {
+            return false;
+         }
+
+         const uint64_t largestRaw = ( uint64_t{ 1 } << bitsPerRecord ) - 1;
+         const auto headroom = static_cast<uint64_t>(
+            static_cast<int64_t>( std::numeric_limits<T>::max() ) - minimum );
+
+         if ( largestRaw > headroom )
+         {
+            return false;
+         }
+      }
+
+      T *out = reinterpret_cast<T *>( dbuf.nextElements( recordCount ) );
+
+      unpacker.unpack( inbuf, inbufSize, firstBit, minimum, recordCount, out );
+
+      return true;
+   }
+
+   // If the destination is a PackedBits buffer whose values have as many bits as they take in the
+   // bytestream, and nothing is added to them, copy the bits straight into it.
+   bool copyBitsInto( SourceDestBufferImpl &dbuf, const char *inbuf, size_t firstBit,
+                      unsigned bitsPerRecord, int64_t minimum, size_t recordCount )
+   {
+      if ( ( minimum != 0 ) || ( dbuf.stride() != bitsPerRecord ) )
+      {
+         return false;
+      }
+
+      const size_t first = dbuf.nextIndex();
+
+      dbuf.skipNext( recordCount );
+
+      copyBits( inbuf, firstBit, static_cast<char *>( dbuf.base() ), first * bitsPerRecord,
+                recordCount * bitsPerRecord );
+
+      return true;
+   }
+
+   // If the destination is a plain array of T (float or double) with no origin, the values in the
+   // bytestream are already in its representation, so copy them straight into it. Otherwise they
+   // have to go through setNextFloats()/setNextDoubles() to be converted.
+   template <typename T>
+   bool copyInto( SourceDestBufferImpl &dbuf, const char *inbuf, size_t recordCount )
+   {
+      const MemoryRepresentation representation = std::is_same<T, float>::value ? Real32 : Real64;
+
+      if ( ( dbuf.memoryRepresentation() != representation ) || ( dbuf.stride() != sizeof( T ) ) ||
+           ( dbuf.origin() != 0.0 ) )
+      {
+         return false;
+      }
+
+      memcpy( dbuf.nextElements( recordCount ), inbuf, recordCount * sizeof( T ) );
+
+      return true;
+   }
+}
+
+std::shared_ptr<Decoder> Decoder::fieldDecoder( unsigned bytestreamNumber,
+                                               const CompressedVectorNodeImpl *cVector,
+                                               std::vector<SourceDestBuffer> &dbufs )
 {
    // !!! verify single dbuf
 
@@ -58,6 +181,26 @@ std::shared_ptr<Decoder> Decoder::DecoderFactory( unsigned bytestreamNumber, //!
 
    uint64_t maxRecordCount = cVector->childCount();
 
+   uint64_t deltaResetInterval = 0;
+   const bool isDelta = findDeltaCodec( *cVector, path, deltaResetInterval );
+
+   // The delta codec only handles integers
+   if ( isDelta && decodeNode->type() != TypeInteger && decodeNode->type() != TypeScaledInteger )
+   {
+      throw E57_EXCEPTION2( ErrorBadCodecs,
+                            "pathName=" + path + " nodeType=" + toString( decodeNode->type() ) );
+   }
+
+   uint64_t xorResetInterval = 0;
+   const bool isXor = findXorCodec( *cVector, path, xorResetInterval );
+
+   // ...and the XOR codec only floats
+   if ( isXor && decodeNode->type() != TypeFloat )
+   {
+      throw E57_EXCEPTION2( ErrorBadCodecs,
+                            "pathName=" + path + " nodeType=" + toString( decodeNode->type() ) );
+   }
+
    switch ( decodeNode->type() )
    {
       case TypeInteger:
@@ -83,6 +226,14 @@ std::shared_ptr<Decoder> Decoder::DecoderFactory( unsigned bytestreamNumber, //!
             return decoder;
          }
 
+         if ( isDelta )
+         {
+            std::shared_ptr<Decoder> decoder( new DeltaIntegerDecoder(
+               false, bytestreamNumber, dbufs.at( 0 ), ini->minimum(), ini->maximum(), 1.0, 0.0,
+               maxRecordCount, deltaResetInterval ) );
+            return decoder;
+         }
+
          if ( bitsPerRecord <= 8 )
          {
             std::shared_ptr<Decoder> decoder( new BitpackIntegerDecoder<uint8_t>(
@@ -138,6 +289,14 @@ std::shared_ptr<Decoder> Decoder::DecoderFactory( unsigned bytestreamNumber, //!
             return decoder;
          }
 
+         if ( isDelta )
+         {
+            std::shared_ptr<Decoder> decoder( new DeltaIntegerDecoder(
+               true, bytestreamNumber, dbufs.at( 0 ), sini->minimum(), sini->maximum(),
+               sini->scale(), sini->offset(), maxRecordCount, deltaResetInterval ) );
+            return decoder;
+         }
+
          if ( bitsPerRecord <= 8 )
          {
             std::shared_ptr<Decoder> decoder( new BitpackIntegerDecoder<uint8_t>(
@@ -173,6 +332,14 @@ std::shared_ptr<Decoder> Decoder::DecoderFactory( unsigned bytestreamNumber, //!
          std::shared_ptr<FloatNodeImpl> fni =
             std::static_pointer_cast<FloatNodeImpl>( decodeNode ); // downcast to correct type
 
+         if ( isXor )
+         {
+            std::shared_ptr<Decoder> decoder(
+               new XorFloatDecoder( bytestreamNumber, dbufs.at( 0 ), fni->precision(),
+                                    maxRecordCount, xorResetInterval ) );
+            return decoder;
+         }
+
          std::shared_ptr<Decoder> decoder( new BitpackFloatDecoder(
             bytestreamNumber, dbufs.at( 0 ), fni->precision(), maxRecordCount ) );
          return decoder;
@@ -193,6 +360,22 @@ std::shared_ptr<Decoder> Decoder::DecoderFactory( unsigned bytestreamNumber, //!
    }
 }
 
+std::shared_ptr<Decoder> Decoder::DecoderFactory( unsigned bytestreamNumber, //!!! name ok?
+                                                  const CompressedVectorNodeImpl *cVector,
+                                                  std::vector<SourceDestBuffer> &dbufs,
+                                                  const ustring & /*codecPath*/ )
+{
+   std::shared_ptr<Decoder> decoder = fieldDecoder( bytestreamNumber, cVector, dbufs );
+
+   int zstdLevel = 0;
+   if ( findZstdCodec( *cVector, dbufs.at( 0 ).pathName(), zstdLevel ) )
+   {
+      return zstdDecoder( decoder );
+   }
+
+   return decoder;
+}
+
 Decoder::Decoder( unsigned bytestreamNumber ) : bytestreamNumber_( bytestreamNumber )
 {
 }
@@ -226,6 +409,31 @@ size_t BitpackDecoder::inputProcess( const char *source, const size_t availableB
    size_t bitsEaten = 0;
    do
    {
+      // When nothing is carried over from earlier input, decode straight from the caller's bytes.
+      // Only what's left of a record continuing in the next packet (or what doesn't fit in the
+      // dest buffer) is copied into inBuffer_ below.
+      if ( ( inBufferEndByte_ == 0 ) && ( inBufferFirstBit_ < 8 ) && ( bytesUnsaved > 0 ) &&
+           ( source != nullptr ) && canDecodeFrom( source ) )
+      {
+#ifdef E57_VERBOSE
+         std::cout << "  feeding decoder " << bytesUnsaved * 8 - inBufferFirstBit_
+                   << " bits straight from source." << std::endl;
+#endif
+         bitsEaten = decodeBits( source, inBufferFirstBit_, bytesUnsaved * 8 );
+
+         const size_t endBit = inBufferFirstBit_ + bitsEaten;
+
+         source += endBit / 8;
+         bytesUnsaved -= endBit / 8;
+         inBufferFirstBit_ = endBit % 8;
+
+         if ( bitsEaten > 0 )
+         {
+            continue;
+         }
+      }
+
+      size_t carriedBytes = inBufferEndByte_;
       size_t byteCount =
          std::min( bytesUnsaved, inBuffer_.size() - static_cast<size_t>( inBufferEndByte_ ) );
 
@@ -241,6 +449,10 @@ size_t BitpackDecoder::inputProcess( const char *source, const size_t availableB
          bytesUnsaved -= byteCount;
          source += byteCount;
       }
+      else
+      {
+         byteCount = 0;
+      }
 #ifdef E57_VERBOSE
       {
          unsigned i;
@@ -268,12 +480,18 @@ size_t BitpackDecoder::inputProcess( const char *source, const size_t availableB
       size_t firstWord = inBufferFirstBit_ / bitsPerWord_;
       size_t firstNaturalBit = firstWord * bitsPerWord_;
       size_t endBit = inBufferEndByte_ * 8;
+
+      // After a seek() the first bit may lie beyond the bytes received so far.
+      if ( endBit <= inBufferFirstBit_ )
+      {
+         bitsEaten = 0;
+         continue;
+      }
 #ifdef E57_VERBOSE
       std::cout << "  feeding aligned decoder " << endBit - inBufferFirstBit_ << " bits."
                 << std::endl;
 #endif
-      bitsEaten =
-         inputProcessAligned( &inBuffer_[firstWord * bytesPerWord_],
+      bitsEaten = decodeBits( &inBuffer_[firstWord * bytesPerWord_],
                               inBufferFirstBit_ - firstNaturalBit, endBit - firstNaturalBit );
 #ifdef E57_VERBOSE
       std::cout << "  bitsEaten=" << bitsEaten << " firstWord=" << firstWord
@@ -290,22 +508,93 @@ size_t BitpackDecoder::inputProcess( const char *source, const size_t availableB
 #endif
       inBufferFirstBit_ += bitsEaten;
 
+      // Once the carried over bytes have all been eaten, go back to decoding from the caller's
+      // bytes, giving back the ones just copied which haven't been eaten yet.
+      if ( ( bitsEaten > 0 ) && ( byteCount > 0 ) && ( inBufferFirstBit_ >= carriedBytes * 8 ) )
+      {
+         const size_t bitsIntoCopy = inBufferFirstBit_ - carriedBytes * 8;
+         const char *resumeAt = source - byteCount + bitsIntoCopy / 8;
+
+         if ( canDecodeFrom( resumeAt ) )
+         {
+            bytesUnsaved += static_cast<size_t>( source - resumeAt );
+            source = resumeAt;
+
+            inBufferFirstBit_ = bitsIntoCopy % 8;
+            inBufferEndByte_ = 0;
+            continue;
+         }
+      }
+
       // Shift uneaten data to beginning of inBuffer_, keep on natural word
       // boundaries.
       inBufferShiftDown();
 
       // If the lower level processing didn't eat anything on this iteration,
-      // stop looping and tell caller how much we ate or stored.
-   } while ( bytesUnsaved > 0 && bitsEaten > 0 );
+      // stop looping and tell caller how much we ate or stored. With a stride, keep going through
+      // what we have even if there is no more input.
+   } while ( ( bytesUnsaved > 0 || recordStride_ > 1 ) && bitsEaten > 0 );
 
    // Return the number of bytes we ate/saved.
    return ( availableByteCount - bytesUnsaved );
 }
 
+size_t BitpackDecoder::decodeBits( const char *inbuf, size_t firstBit, size_t endBit )
+{
+   const unsigned recordBits = bitsPerRecord();
+
+   if ( ( skipCount_ > 0 ) && ( recordBits > 0 ) )
+   {
+      // Fixed-width records being skipped don't need decoding, just stepping over
+      const uint64_t skipped =
+         std::min( { skipCount_, maxRecordCount_ - currentRecordIndex_,
+                     static_cast<uint64_t>( ( endBit - firstBit ) / recordBits ) } );
+
+      skipCount_ -= skipped;
+      currentRecordIndex_ += skipped;
+
+      return static_cast<size_t>( skipped * recordBits );
+   }
+
+   const size_t bitsEaten = inputProcessAligned( inbuf, firstBit, endBit );
+
+   // With a stride, fixed-width records are stored one at a time (see outputSpace())
+   if ( ( recordStride_ > 1 ) && ( recordBits > 0 ) && ( bitsEaten > 0 ) )
+   {
+      skipCount_ = recordStride_ - 1;
+   }
+
+   return bitsEaten;
+}
+
+bool BitpackDecoder::canDecodeFrom( const char *source ) const
+{
+   return !inputMustBeAligned() || ( reinterpret_cast<uintptr_t>( source ) % bytesPerWord_ == 0 );
+}
+
 void BitpackDecoder::stateReset()
 {
    inBufferFirstBit_ = 0;
    inBufferEndByte_ = 0;
+   skipCount_ = 0;
+}
+
+void BitpackDecoder::seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount )
+{
+   // Fixed-width records are usually positioned exactly, but when the bytestream is compressed
+   // (see ZstdCodec.h) the reader can only start from a chunk and skip records from there.
+   if ( recordIndex + skipCount > maxRecordCount_ || firstBit >= inBuffer_.size() * 8 )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "recordIndex=" + toString( recordIndex ) +
+                                              " firstBit=" + toString( firstBit ) +
+                                              " skipCount=" + toString( skipCount ) );
+   }
+
+   stateReset();
+
+   currentRecordIndex_ = recordIndex;
+   inBufferFirstBit_ = firstBit;
+   skipCount_ = skipCount;
 }
 
 void BitpackDecoder::inBufferShiftDown()
@@ -335,6 +624,15 @@ void BitpackDecoder::inBufferShiftDown()
    inBufferFirstBit_ = inBufferFirstBit_ % bitsPerWord_;
 }
 
+// Number of records inputProcessAligned() may store in the dest buffer. With a stride it is one,
+// so inputProcess() can skip the records which follow it.
+size_t BitpackDecoder::outputSpace() const
+{
+   const size_t space = destBuffer_->limit() - destBuffer_->nextIndex();
+
+   return ( recordStride_ > 1 ) ? std::min( space, static_cast<size_t>( 1 ) ) : space;
+}
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
 void BitpackDecoder::dump( int indent, std::ostream &os )
 {
@@ -385,7 +683,7 @@ size_t BitpackFloatDecoder::inputProcessAligned( const char *inbuf, const size_t
    // Read from inbuf, decode, store in destBuffer
    // Repeat until have filled destBuffer, or completed all records
 
-   size_t n = destBuffer_->capacity() - destBuffer_->nextIndex();
+   size_t n = outputSpace();
 
    size_t typeSize = ( precision_ == PrecisionSingle ) ? sizeof( float ) : sizeof( double );
 
@@ -430,16 +728,17 @@ size_t BitpackFloatDecoder::inputProcessAligned( const char *inbuf, const size_t
       // Form the starting address for first data location in inBuffer
       auto inp = reinterpret_cast<const float *>( inbuf );
 
-      // Copy floats from inbuf to destBuffer_
+#ifdef E57_VERBOSE
       for ( unsigned i = 0; i < n; i++ )
       {
-         float value = *inp;
-
-#ifdef E57_VERBOSE
-         std::cout << "  got float value=" << value << std::endl;
+         std::cout << "  got float value=" << inp[i] << std::endl;
+      }
 #endif
-         destBuffer_->setNextFloat( value );
-         inp++;
+
+      // Copy floats from inbuf to destBuffer_
+      if ( !copyInto<float>( *destBuffer_, inbuf, n ) )
+      {
+         destBuffer_->setNextFloats( inp, n );
       }
    }
    else
@@ -447,16 +746,17 @@ size_t BitpackFloatDecoder::inputProcessAligned( const char *inbuf, const size_t
       // Form the starting address for first data location in inBuffer
       auto inp = reinterpret_cast<const double *>( inbuf );
 
-      // Copy doubles from inbuf to destBuffer_
+#ifdef E57_VERBOSE
       for ( unsigned i = 0; i < n; i++ )
       {
-         double value = *inp;
-
-#ifdef E57_VERBOSE
-         std::cout << "  got double value=" << value << std::endl;
+         std::cout << "  got double value=" << inp[i] << std::endl;
+      }
 #endif
-         destBuffer_->setNextDouble( value );
-         inp++;
+
+      // Copy doubles from inbuf to destBuffer_
+      if ( !copyInto<double>( *destBuffer_, inbuf, n ) )
+      {
+         destBuffer_->setNextDoubles( inp, n );
       }
    }
 
@@ -512,9 +812,10 @@ size_t BitpackStringDecoder::inputProcessAligned( const char *inbuf, const size_
    size_t nBytesAvailable = ( endBit - firstBit ) >> 3;
    size_t nBytesRead = 0;
 
-   // Loop until we've finished all the records, or ran out of input currently
-   // available
-   while ( currentRecordIndex_ < maxRecordCount_ && nBytesRead < nBytesAvailable )
+   // Loop until we've finished all the records, ran out of input currently
+   // available, or filled the dest buffer
+   while ( currentRecordIndex_ < maxRecordCount_ && nBytesRead < nBytesAvailable &&
+           ( skipCount_ > 0 || destBuffer_->nextIndex() < destBuffer_->limit() ) )
    {
 #ifdef E57_VERBOSE
       std::cout << "read string loop1: readingPrefix=" << readingPrefix_
@@ -582,8 +883,13 @@ size_t BitpackStringDecoder::inputProcessAligned( const char *inbuf, const size_
             prefixLength_ = 1;
             memset( prefixBytes_, 0, sizeof( prefixBytes_ ) );
             nBytesPrefixRead_ = 0;
-            currentString_ = "";
             nBytesStringRead_ = 0;
+
+            // Strings which are kept are decoded straight into the dest buffer
+            if ( skipCount_ == 0 )
+            {
+               destBuffer_->beginNextString();
+            }
          }
 #ifdef E57_VERBOSE
          std::cout << "read string loop3: readingPrefix=" << readingPrefix_
@@ -606,8 +912,11 @@ size_t BitpackStringDecoder::inputProcessAligned( const char *inbuf, const size_
             nBytesProcess = static_cast<unsigned>( nBytesNeeded );
          }
 
-         // Append to current string and update counts
-         currentString_ += ustring( inbuf, nBytesProcess );
+         // Append to current string (unless it is being skipped) and update counts
+         if ( skipCount_ == 0 )
+         {
+            destBuffer_->appendNextString( inbuf, nBytesProcess );
+         }
          inbuf += nBytesProcess;
          nBytesRead += nBytesProcess;
          nBytesStringRead_ += nBytesProcess;
@@ -615,8 +924,17 @@ size_t BitpackStringDecoder::inputProcessAligned( const char *inbuf, const size_
          // Check if completed reading the string contents
          if ( nBytesStringRead_ == stringLength_ )
          {
-            // Save accumulated string to dest buffer
-            destBuffer_->setNextString( currentString_ );
+            // Save accumulated string to dest buffer, unless we are still skipping records to
+            // reach a seek() target
+            if ( skipCount_ > 0 )
+            {
+               skipCount_--;
+            }
+            else
+            {
+               destBuffer_->endNextString();
+               skipCount_ = recordStride_ - 1;
+            }
             currentRecordIndex_++;
 
             // Get ready to read next prefix
@@ -625,7 +943,6 @@ size_t BitpackStringDecoder::inputProcessAligned( const char *inbuf, const size_
             memset( prefixBytes_, 0, sizeof( prefixBytes_ ) );
             nBytesPrefixRead_ = 0;
             stringLength_ = 0;
-            currentString_ = "";
             nBytesStringRead_ = 0;
          }
       }
@@ -635,6 +952,35 @@ size_t BitpackStringDecoder::inputProcessAligned( const char *inbuf, const size_
    return ( nBytesRead * 8 );
 }
 
+void BitpackStringDecoder::stateReset()
+{
+   BitpackDecoder::stateReset();
+
+   readingPrefix_ = true;
+   prefixLength_ = 1;
+   memset( prefixBytes_, 0, sizeof( prefixBytes_ ) );
+   nBytesPrefixRead_ = 0;
+   stringLength_ = 0;
+   nBytesStringRead_ = 0;
+}
+
+void BitpackStringDecoder::seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount )
+{
+   // Strings are variable length, so they can only be found by reading forwards from the start of
+   // a chunk.
+   if ( firstBit != 0 || recordIndex + skipCount > maxRecordCount_ )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "recordIndex=" + toString( recordIndex ) +
+                                              " firstBit=" + toString( firstBit ) +
+                                              " skipCount=" + toString( skipCount ) );
+   }
+
+   stateReset();
+
+   currentRecordIndex_ = recordIndex;
+   skipCount_ = skipCount;
+}
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
 void BitpackStringDecoder::dump( int indent, std::ostream &os )
 {
@@ -649,14 +995,8 @@ void BitpackStringDecoder::dump( int indent, std::ostream &os )
       << " " << static_cast<unsigned>( prefixBytes_[7] ) << std::endl;
    os << space( indent ) << "nBytesPrefixRead:   " << nBytesPrefixRead_ << std::endl;
    os << space( indent ) << "stringLength:       " << stringLength_ << std::endl;
-   os << space( indent )
-      << "currentString:      "
-         ""
-      << currentString_
-      << ""
-         ""
-      << std::endl;
    os << space( indent ) << "nBytesStringRead:   " << nBytesStringRead_ << std::endl;
+   os << space( indent ) << "skipCount:          " << skipCount_ << std::endl;
 }
 #endif
 
@@ -677,6 +1017,7 @@ BitpackIntegerDecoder<RegisterT>::BitpackIntegerDecoder( bool isScaledInteger,
                                                                // imf->parentFile()  --> ImageFile?
 
    bitsPerRecord_ = imf->bitsNeeded( minimum_, maximum_ );
+   unpacker_ = BitUnpacker( bitsPerRecord_ );
    destBitMask_ =
       ( bitsPerRecord_ == 64 ) ? ~0 : static_cast<RegisterT>( 1ULL << bitsPerRecord_ ) - 1;
 }
@@ -708,7 +1049,7 @@ size_t BitpackIntegerDecoder<RegisterT>::inputProcessAligned( const char *inbuf,
    }
 #endif
 
-   size_t destRecords = destBuffer_->capacity() - destBuffer_->nextIndex();
+   size_t destRecords = outputSpace();
 
    // Precalculate exact number of full records that are in inbuf
    // We can handle the case where don't have a full word at end of inbuf, but
@@ -730,122 +1071,407 @@ size_t BitpackIntegerDecoder<RegisterT>::inputProcessAligned( const char *inbuf,
    std::cout << "  recordCount=" << recordCount << std::endl;
 #endif
 
-   auto inp = reinterpret_cast<const RegisterT *>( inbuf );
-   unsigned wordPosition = 0; // The index in inbuf of the word we are currently working on.
+   // endBit always falls on a byte boundary
+   const size_t inbufSize = endBit / 8;
 
-   // clang-format off
-   // For example on little endian machine:
-   // Assume: registerT=uint32_t, bitOffset=20, destBitMask=0x00007fff (for a 15 bit value).
-   // inp[wordPosition]                    LLLLLLLL LLLLXXXX XXXXXXXX XXXXXXXX   Note LSB of value is at bit20
-   // inp(wordPosition+1]                  XXXXXXXX XXXXXXXX XXXXXXXX XXXXXHHH   H=high bits of value, X=uninteresting bits
-   // low = inp[i] >> bitOffset            00000000 00000000 0000LLLL LLLLLLLL   L=low bits of value, X=uninteresting bits
-   // high = inp[i+1] << (32-bitOffset)    XXXXXXXX XXXXXXXX XHHH0000 00000000
-   // w = high | low                       XXXXXXXX XXXXXXXX XHHHLLLL LLLLLLLL
-   // destBitmask                          00000000 00000000 01111111 11111111
-   // w & mask                             00000000 00000000 0HHHLLLL LLLLLLLL
-   // clang-format on
+   // The most common case is a plain integer array we can unpack straight into
+   if ( !unpackDirect( inbuf, inbufSize, firstBit, recordCount ) )
+   {
+      int64_t values[cUnpackBlockSize];
+
+      for ( size_t done = 0; done < recordCount; done += cUnpackBlockSize )
+      {
+         const size_t n = std::min( cUnpackBlockSize, recordCount - done );
 
-   size_t bitOffset = firstBit;
+         unpacker_.unpack( inbuf, inbufSize, firstBit + done * bitsPerRecord_, minimum_, n,
+                           values );
+
+#ifdef E57_VERBOSE
+         for ( size_t i = 0; i < n; ++i )
+         {
+            std::cout << "  Storing value=" << values[i] << std::endl;
+         }
+#endif
+         // The parameter isScaledInteger_ determines which version of
+         // setNextInt64s gets called
+         if ( isScaledInteger_ )
+         {
+            destBuffer_->setNextInt64s( values, n, scale_, offset_ );
+         }
+         else
+         {
+            destBuffer_->setNextInt64s( values, n );
+         }
+      }
+   }
 
-   for ( size_t i = 0; i < recordCount; i++ )
+   // Update counts of records processed
+   currentRecordIndex_ += recordCount;
+
+   // Return number of bits processed.
+   return ( recordCount * bitsPerRecord_ );
+}
+
+template <typename RegisterT>
+bool BitpackIntegerDecoder<RegisterT>::unpackDirect( const char *inbuf, size_t inbufSize,
+                                                     size_t firstBit, size_t recordCount )
+{
+   SourceDestBufferImpl &dbuf = *destBuffer_;
+
+   // Scaling has to be done one value at a time
+   if ( isScaledInteger_ && dbuf.doScaling() )
+   {
+      return false;
+   }
+
+   switch ( dbuf.memoryRepresentation() )
    {
-      // Get lower word (contains at least the LSbit of the value),
-      RegisterT low = inp[wordPosition];
+      case Int8:
+         return unpackInto<int8_t>( dbuf, inbuf, inbufSize, firstBit, unpacker_, minimum_,
+                                    recordCount );
+      case UInt8:
+         return unpackInto<uint8_t>( dbuf, inbuf, inbufSize, firstBit, unpacker_, minimum_,
+                                     recordCount );
+      case Int16:
+         return unpackInto<int16_t>( dbuf, inbuf, inbufSize, firstBit, unpacker_, minimum_,
+                                     recordCount );
+      case UInt16:
+         return unpackInto<uint16_t>( dbuf, inbuf, inbufSize, firstBit, unpacker_, minimum_,
+                                      recordCount );
+      case Int32:
+         return unpackInto<int32_t>( dbuf, inbuf, inbufSize, firstBit, unpacker_, minimum_,
+                                     recordCount );
+      case UInt32:
+         return unpackInto<uint32_t>( dbuf, inbuf, inbufSize, firstBit, unpacker_, minimum_,
+                                      recordCount );
+      case Int64:
+         return unpackInto<int64_t>( dbuf, inbuf, inbufSize, firstBit, unpacker_, minimum_,
+                                     recordCount );
+      case Bits:
+         return copyBitsInto( dbuf, inbuf, firstBit, unpacker_.bitsPerRecord(), minimum_,
+                              recordCount );
+      default:
+         // Bool and the floating point types need converting
+         return false;
+   }
+}
 
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+template <typename RegisterT>
+void BitpackIntegerDecoder<RegisterT>::dump( int indent, std::ostream &os )
+{
+   BitpackDecoder::dump( indent, os );
+   os << space( indent ) << "isScaledInteger:  " << isScaledInteger_ << std::endl;
+   os << space( indent ) << "minimum:          " << minimum_ << std::endl;
+   os << space( indent ) << "maximum:          " << maximum_ << std::endl;
+   os << space( indent ) << "scale:            " << scale_ << std::endl;
+   os << space( indent ) << "offset:           " << offset_ << std::endl;
+   os << space( indent ) << "bitsPerRecord:    " << bitsPerRecord_ << std::endl;
+   os << space( indent ) << "destBitMask:      " << binaryString( destBitMask_ ) << " = "
+      << hexString( destBitMask_ ) << std::endl;
+}
+#endif
+
+//================================================================
+
+DeltaIntegerDecoder::DeltaIntegerDecoder( bool isScaledInteger, unsigned bytestreamNumber,
+                                          SourceDestBuffer &dbuf, int64_t minimum, int64_t maximum,
+                                          double scale, double offset, uint64_t maxRecordCount,
+                                          uint64_t resetInterval ) :
+   BitpackDecoder( bytestreamNumber, dbuf, sizeof( char ), maxRecordCount ),
+   isScaledInteger_( isScaledInteger ), minimum_( minimum ), maximum_( maximum ), scale_( scale ),
+   offset_( offset ), resetInterval_( resetInterval )
+{
+}
+
+size_t DeltaIntegerDecoder::inputProcessAligned( const char *inbuf, const size_t firstBit,
+                                                 const size_t endBit )
+{
 #ifdef E57_VERBOSE
-      std::cout << "  bitOffset: " << bitOffset << std::endl;
-      std::cout << "  low: " << binaryString( low ) << std::endl;
+   std::cout << "DeltaIntegerDecoder::inputProcessAligned() called, inbuf=" << (void *)( inbuf )
+             << " firstBit=" << firstBit << " endBit=" << endBit << std::endl;
+#endif
+
+#if VALIDATE_BASIC
+   // Verify first bit is zero (always byte-aligned)
+   if ( firstBit != 0 )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "firstBit=" + toString( firstBit ) );
+   }
 #endif
 
-      RegisterT w;
-      if ( bitOffset == 0 )
+   const auto *in = reinterpret_cast<const uint8_t *>( inbuf );
+   const size_t nBytesAvailable = ( endBit - firstBit ) >> 3;
+   const auto range = static_cast<uint64_t>( maximum_ ) - static_cast<uint64_t>( minimum_ );
+   size_t nBytesRead = 0;
+
+   int64_t values[cUnpackBlockSize];
+   size_t valueCount = 0;
+
+   // Values are passed to the dest buffer a block at a time
+   auto flushValues = [&]() {
+      if ( isScaledInteger_ )
       {
-         // The left shift (used below) is not defined if shift is >= size of
-         // word
-         w = low;
+         destBuffer_->setNextInt64s( values, valueCount, scale_, offset_ );
       }
-      // Avoid reading the next word, unless it is needed
-      // If the last record finishes on the last bit of input, avoid UMR
-      else if ( bitOffset + bitsPerRecord_ <= RegisterBits )
+      else
       {
-         w = low >> bitOffset;
+         destBuffer_->setNextInt64s( values, valueCount );
       }
-      else
+
+      valueCount = 0;
+   };
+
+   // Stop when we've finished all the records, run out of complete varints, or filled the dest
+   // buffer
+   while ( currentRecordIndex_ < maxRecordCount_ &&
+           ( skipCount_ > 0 || destBuffer_->nextIndex() + valueCount < destBuffer_->limit() ) )
+   {
+      uint64_t zigzag = 0;
+
+      // Leave a partial varint for next time
+      if ( !readVarint( in, nBytesRead, nBytesAvailable, currentRecordIndex_, zigzag ) )
       {
-         // Get upper word (may or may not contain interesting bits),
-         RegisterT high = inp[wordPosition + 1];
+         break;
+      }
 
-#ifdef E57_VERBOSE
-         std::cout << "  high:" << binaryString( high ) << std::endl;
-#endif
+      if ( currentRecordIndex_ % resetInterval_ == 0 )
+      {
+         previous_ = 0;
+      }
+
+      previous_ += ( zigzag >> 1 ) ^ ( ~( zigzag & 1 ) + 1 );
 
-         // Shift high to just above the lower bits, shift low LSBit to bit0,
-         // OR together. Note shifts are logical (not arithmetic) because using
-         // unsigned variables.
-         w = ( high << ( RegisterBits - bitOffset ) ) | ( low >> bitOffset );
+      if ( previous_ > range )
+      {
+         throw E57_EXCEPTION2( ErrorBadCVPacket, "recordIndex=" + toString( currentRecordIndex_ ) +
+                                                    " rawValue=" + toString( previous_ ) );
       }
 
-#ifdef E57_VERBOSE
-      std::cout << "  w:   " << binaryString( w ) << std::endl;
+      if ( skipCount_ > 0 )
+      {
+         skipCount_--;
+      }
+      else
+      {
+         values[valueCount++] =
+            static_cast<int64_t>( previous_ + static_cast<uint64_t>( minimum_ ) );
+         skipCount_ = recordStride_ - 1;
+
+         if ( valueCount == cUnpackBlockSize )
+         {
+            flushValues();
+         }
+      }
+
+      currentRecordIndex_++;
+   }
+
+   if ( valueCount > 0 )
+   {
+      flushValues();
+   }
+
+   // Returned number of bits processed (always a multiple of alignment size).
+   return ( nBytesRead * 8 );
+}
+
+void DeltaIntegerDecoder::stateReset()
+{
+   BitpackDecoder::stateReset();
+
+   previous_ = 0;
+}
+
+void DeltaIntegerDecoder::seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount )
+{
+   if ( firstBit != 0 || recordIndex + skipCount > maxRecordCount_ )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "recordIndex=" + toString( recordIndex ) +
+                                              " firstBit=" + toString( firstBit ) +
+                                              " skipCount=" + toString( skipCount ) );
+   }
+
+   // Decoding can only start where the predictor was reset (or at the end, where there is
+   // nothing to decode).
+   if ( recordIndex % resetInterval_ != 0 && recordIndex != maxRecordCount_ )
+   {
+      throw E57_EXCEPTION2( ErrorBadCodecs, "recordIndex=" + toString( recordIndex ) +
+                                               " resetInterval=" + toString( resetInterval_ ) );
+   }
+
+   stateReset();
+
+   currentRecordIndex_ = recordIndex;
+   skipCount_ = skipCount;
+}
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+void DeltaIntegerDecoder::dump( int indent, std::ostream &os )
+{
+   BitpackDecoder::dump( indent, os );
+   os << space( indent ) << "isScaledInteger:  " << isScaledInteger_ << std::endl;
+   os << space( indent ) << "minimum:          " << minimum_ << std::endl;
+   os << space( indent ) << "maximum:          " << maximum_ << std::endl;
+   os << space( indent ) << "scale:            " << scale_ << std::endl;
+   os << space( indent ) << "offset:           " << offset_ << std::endl;
+   os << space( indent ) << "resetInterval:    " << resetInterval_ << std::endl;
+   os << space( indent ) << "previous:         " << previous_ << std::endl;
+   os << space( indent ) << "skipCount:        " << skipCount_ << std::endl;
+}
 #endif
 
-      // Mask off uninteresting bits
-      w &= destBitMask_;
+//================================================================
 
-      // Add minimum_ to value to get back what writer originally sent
-      int64_t value = minimum_ + static_cast<uint64_t>( w );
+XorFloatDecoder::XorFloatDecoder( unsigned bytestreamNumber, SourceDestBuffer &dbuf,
+                                  FloatPrecision precision, uint64_t maxRecordCount,
+                                  uint64_t resetInterval ) :
+   BitpackDecoder( bytestreamNumber, dbuf, sizeof( char ), maxRecordCount ),
+   precision_( precision ), resetInterval_( resetInterval )
+{
+}
 
+size_t XorFloatDecoder::inputProcessAligned( const char *inbuf, const size_t firstBit,
+                                             const size_t endBit )
+{
 #ifdef E57_VERBOSE
-      std::cout << "  Storing value=" << value << std::endl;
+   std::cout << "XorFloatDecoder::inputProcessAligned() called, inbuf=" << (void *)( inbuf )
+             << " firstBit=" << firstBit << " endBit=" << endBit << std::endl;
 #endif
 
-      // The parameter isScaledInteger_ determines which version of
-      // setNextInt64 gets called
-      if ( isScaledInteger_ )
+#if VALIDATE_BASIC
+   // Verify first bit is zero (always byte-aligned)
+   if ( firstBit != 0 )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "firstBit=" + toString( firstBit ) );
+   }
+#endif
+
+   const auto *in = reinterpret_cast<const uint8_t *>( inbuf );
+   const size_t nBytesAvailable = ( endBit - firstBit ) >> 3;
+   const bool isSingle = ( precision_ == PrecisionSingle );
+   size_t nBytesRead = 0;
+
+   uint64_t bits[cUnpackBlockSize];
+   size_t valueCount = 0;
+
+   // Values are passed to the dest buffer a block at a time
+   auto flushValues = [&]() {
+      if ( isSingle )
       {
-         destBuffer_->setNextInt64( value, scale_, offset_ );
+         float values[cUnpackBlockSize];
+
+         for ( size_t i = 0; i < valueCount; ++i )
+         {
+            const auto word = static_cast<uint32_t>( bits[i] );
+            memcpy( &values[i], &word, sizeof( word ) );
+         }
+
+         destBuffer_->setNextFloats( values, valueCount );
       }
       else
       {
-         destBuffer_->setNextInt64( value );
+         double values[cUnpackBlockSize];
+         memcpy( values, bits, valueCount * sizeof( double ) );
+
+         destBuffer_->setNextDoubles( values, valueCount );
       }
 
-      // Store the result in next available position in the user's dest buffer
+      valueCount = 0;
+   };
 
-      // Calc next bit alignment and which word it starts in
-      bitOffset += bitsPerRecord_;
-      if ( bitOffset >= 8 * sizeof( RegisterT ) )
+   // Stop when we've finished all the records, run out of complete varints, or filled the dest
+   // buffer
+   while ( currentRecordIndex_ < maxRecordCount_ &&
+           ( skipCount_ > 0 || destBuffer_->nextIndex() + valueCount < destBuffer_->limit() ) )
+   {
+      uint64_t difference = 0;
+
+      // Leave a partial varint for next time
+      if ( !readVarint( in, nBytesRead, nBytesAvailable, currentRecordIndex_, difference ) )
       {
-         bitOffset -= 8 * sizeof( RegisterT );
-         wordPosition++;
+         break;
       }
-#ifdef E57_VERBOSE
-      std::cout << "  Processed " << i + 1 << " records, wordPosition=" << wordPosition
-                << " decoder:" << std::endl;
-      dump( 4 );
-#endif
+
+      if ( currentRecordIndex_ % resetInterval_ == 0 )
+      {
+         previous_ = 0;
+      }
+
+      previous_ ^= difference;
+
+      if ( isSingle && ( previous_ > UINT32_MAX ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadCVPacket, "recordIndex=" + toString( currentRecordIndex_ ) +
+                                                    " bits=" + toString( previous_ ) );
+      }
+
+      if ( skipCount_ > 0 )
+      {
+         skipCount_--;
+      }
+      else
+      {
+         bits[valueCount++] = previous_;
+         skipCount_ = recordStride_ - 1;
+
+         if ( valueCount == cUnpackBlockSize )
+         {
+            flushValues();
+         }
+      }
+
+      currentRecordIndex_++;
    }
 
-   // Update counts of records processed
-   currentRecordIndex_ += recordCount;
+   if ( valueCount > 0 )
+   {
+      flushValues();
+   }
 
-   // Return number of bits processed.
-   return ( recordCount * bitsPerRecord_ );
+   // Returned number of bits processed (always a multiple of alignment size).
+   return ( nBytesRead * 8 );
+}
+
+void XorFloatDecoder::stateReset()
+{
+   BitpackDecoder::stateReset();
+
+   previous_ = 0;
+}
+
+void XorFloatDecoder::seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount )
+{
+   if ( firstBit != 0 || recordIndex + skipCount > maxRecordCount_ )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "recordIndex=" + toString( recordIndex ) +
+                                              " firstBit=" + toString( firstBit ) +
+                                              " skipCount=" + toString( skipCount ) );
+   }
+
+   // Decoding can only start where the predictor was reset (or at the end, where there is
+   // nothing to decode).
+   if ( recordIndex % resetInterval_ != 0 && recordIndex != maxRecordCount_ )
+   {
+      throw E57_EXCEPTION2( ErrorBadCodecs, "recordIndex=" + toString( recordIndex ) +
+                                               " resetInterval=" + toString( resetInterval_ ) );
+   }
+
+   stateReset();
+
+   currentRecordIndex_ = recordIndex;
+   skipCount_ = skipCount;
 }
 
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
-template <typename RegisterT>
-void BitpackIntegerDecoder<RegisterT>::dump( int indent, std::ostream &os )
+void XorFloatDecoder::dump( int indent, std::ostream &os )
 {
    BitpackDecoder::dump( indent, os );
-   os << space( indent ) << "isScaledInteger:  " << isScaledInteger_ << std::endl;
-   os << space( indent ) << "minimum:          " << minimum_ << std::endl;
-   os << space( indent ) << "maximum:          " << maximum_ << std::endl;
-   os << space( indent ) << "scale:            " << scale_ << std::endl;
-   os << space( indent ) << "offset:           " << offset_ << std::endl;
-   os << space( indent ) << "bitsPerRecord:    " << bitsPerRecord_ << std::endl;
-   os << space( indent ) << "destBitMask:      " << binaryString( destBitMask_ ) << " = "
-      << hexString( destBitMask_ ) << std::endl;
+   os << space( indent ) << "precision:        "
+      << ( ( precision_ == PrecisionSingle ) ? "Single" : "Double" ) << std::endl;
+   os << space( indent ) << "resetInterval:    " << resetInterval_ << std::endl;
+   os << space( indent ) << "previous:         " << hexString( previous_ ) << std::endl;
+   os << space( indent ) << "skipCount:        " << skipCount_ << std::endl;
 }
 #endif
 
@@ -883,29 +1509,25 @@ size_t ConstantIntegerDecoder::inputProcess( const char *source, const size_t av
    // We don't need any input bytes to produce output, so ignore source and
    // availableByteCount.
 
-   // Fill dest buffer unless get to maxRecordCount
-   size_t count = destBuffer_->capacity() - destBuffer_->nextIndex();
-   uint64_t remainingRecordCount = maxRecordCount_ - currentRecordIndex_;
+   // Fill dest buffer unless get to maxRecordCount (counting only the records kept with a stride)
+   size_t count = destBuffer_->limit() - destBuffer_->nextIndex();
+   uint64_t remainingRecordCount =
+      ( maxRecordCount_ - currentRecordIndex_ + recordStride_ - 1 ) / recordStride_;
    if ( static_cast<uint64_t>( count ) > remainingRecordCount )
    {
       count = static_cast<unsigned>( remainingRecordCount );
    }
 
+   // Every record has the same value, so it is converted once and copied to the whole span
    if ( isScaledInteger_ )
    {
-      for ( size_t i = 0; i < count; i++ )
-      {
-         destBuffer_->setNextInt64( minimum_, scale_, offset_ );
-      }
+      destBuffer_->fillNextInt64( minimum_, count, scale_, offset_ );
    }
    else
    {
-      for ( size_t i = 0; i < count; i++ )
-      {
-         destBuffer_->setNextInt64( minimum_ );
-      }
+      destBuffer_->fillNextInt64( minimum_, count );
    }
-   currentRecordIndex_ += count;
+   currentRecordIndex_ = std::min( currentRecordIndex_ + count * recordStride_, maxRecordCount_ );
    return ( count );
 }
 
@@ -913,6 +1535,12 @@ void ConstantIntegerDecoder::stateReset()
 {
 }
 
+void ConstantIntegerDecoder::seek( uint64_t recordIndex, size_t /*firstBit*/, uint64_t skipCount )
+{
+   // Nothing is stored, so skipping records is free.
+   currentRecordIndex_ = std::min( recordIndex + skipCount, maxRecordCount_ );
+}
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
 void ConstantIntegerDecoder::dump( int indent, std::ostream &os )
 {
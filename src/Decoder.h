@@ -27,6 +27,9 @@
 
 #pragma once
 
+#include <algorithm>
+
+#include "BitpackKernels.h"
 #include "Common.h"
 
 namespace e57
@@ -46,6 +49,38 @@ namespace e57
       virtual size_t inputProcess( const char *source, size_t count ) = 0;
       virtual void stateReset() = 0;
 
+      /// Number of bits each record occupies in the bytestream, or 0 if records are variable
+      /// length (strings) or not stored at all (constants).
+      virtual unsigned bitsPerRecord() const = 0;
+
+      /// Reposition the decoder so the next record it produces is recordIndex + skipCount. Input
+      /// will resume at bit firstBit of the first byte subsequently passed to inputProcess(), and
+      /// the first skipCount records decoded from there are discarded.
+      virtual void seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount ) = 0;
+
+      /// Let the decoder produce up to @a maxRecordCount records, which is more than it was made
+      /// for, since more were written to a file being followed (see ImageFile::refresh).
+      virtual void setMaxRecordCount( uint64_t maxRecordCount ) = 0;
+
+      /// Number of records to discard before the next one is produced.
+      virtual uint64_t skipCount() const
+      {
+         return 0;
+      }
+
+      /// Bytes of the buffers the decoder holds (see ImageFileMemoryUsage::decoders).
+      virtual size_t bufferSize() const
+      {
+         return 0;
+      }
+
+      /// Only produce every stride'th record: the next one, then the one stride records after it,
+      /// and so on. The records in between never reach the dest buffer.
+      void setRecordStride( uint64_t stride )
+      {
+         recordStride_ = std::max( stride, static_cast<uint64_t>( 1 ) );
+      }
+
       unsigned bytestreamNumber() const
       {
          return bytestreamNumber_;
@@ -59,6 +94,13 @@ namespace e57
       explicit Decoder( unsigned bytestreamNumber );
 
       unsigned int bytestreamNumber_;
+      uint64_t recordStride_ = 1;
+
+   private:
+      /// The decoder for the field of @a dbufs, after any decompression (see ZstdCodec.h)
+      static std::shared_ptr<Decoder> fieldDecoder( unsigned bytestreamNumber,
+                                                    const CompressedVectorNodeImpl *cVector,
+                                                    std::vector<SourceDestBuffer> &dbufs );
    };
 
    class BitpackDecoder : public Decoder
@@ -76,6 +118,23 @@ namespace e57
 
       void stateReset() override;
 
+      void seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount ) override;
+
+      void setMaxRecordCount( uint64_t maxRecordCount ) override
+      {
+         maxRecordCount_ = maxRecordCount;
+      }
+
+      uint64_t skipCount() const override
+      {
+         return skipCount_;
+      }
+
+      size_t bufferSize() const override
+      {
+         return inBuffer_.capacity();
+      }
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) override;
 #endif
@@ -85,6 +144,21 @@ namespace e57
                       uint64_t maxRecordCount );
 
       void inBufferShiftDown();
+      size_t outputSpace() const;
+
+      /// Decode from bits [firstBit, endBit) of inbuf, stepping over any records being skipped.
+      /// Returns the number of bits eaten.
+      size_t decodeBits( const char *inbuf, size_t firstBit, size_t endBit );
+
+      /// Whether inputProcessAligned() reads whole words through pointers, so can only be given
+      /// memory aligned to the word size. Otherwise it can decode any bytes passed to
+      /// inputProcess() without copying them into inBuffer_ first.
+      virtual bool inputMustBeAligned() const
+      {
+         return false;
+      }
+
+      bool canDecodeFrom( const char *source ) const;
 
       uint64_t currentRecordIndex_ = 0;
       uint64_t maxRecordCount_ = 0;
@@ -97,6 +171,10 @@ namespace e57
       unsigned int inBufferAlignmentSize_;
       unsigned int bitsPerWord_;
       unsigned int bytesPerWord_;
+
+      /// Records still to be discarded after a seek(), or before the next one wanted with a
+      /// stride
+      uint64_t skipCount_ = 0;
    };
 
    class BitpackFloatDecoder : public BitpackDecoder
@@ -107,11 +185,22 @@ namespace e57
 
       size_t inputProcessAligned( const char *inbuf, size_t firstBit, size_t endBit ) override;
 
+      unsigned bitsPerRecord() const override
+      {
+         return bitsPerWord_;
+      }
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) override;
 #endif
 
    protected:
+      // Floats are read from inbuf through float and double pointers
+      bool inputMustBeAligned() const override
+      {
+         return true;
+      }
+
       FloatPrecision precision_ = PrecisionSingle;
    };
 
@@ -123,6 +212,15 @@ namespace e57
 
       size_t inputProcessAligned( const char *inbuf, size_t firstBit, size_t endBit ) override;
 
+      void stateReset() override;
+
+      unsigned bitsPerRecord() const override
+      {
+         return 0;
+      }
+
+      void seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount ) override;
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) override;
 #endif
@@ -133,7 +231,6 @@ namespace e57
       uint8_t prefixBytes_[8] = {};
       int nBytesPrefixRead_ = 0;
       uint64_t stringLength_ = 0;
-      ustring currentString_;
       uint64_t nBytesStringRead_ = 0;
    };
 
@@ -146,21 +243,95 @@ namespace e57
 
       size_t inputProcessAligned( const char *inbuf, size_t firstBit, size_t endBit ) override;
 
+      unsigned bitsPerRecord() const override
+      {
+         return bitsPerRecord_;
+      }
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) override;
 #endif
 
    protected:
+      bool unpackDirect( const char *inbuf, size_t inbufSize, size_t firstBit,
+                         size_t recordCount );
+
       bool isScaledInteger_;
       int64_t minimum_;
       int64_t maximum_;
       double scale_;
       double offset_;
       unsigned bitsPerRecord_;
+      BitUnpacker unpacker_;
       RegisterT destBitMask_;
       static constexpr size_t RegisterBits = sizeof( RegisterT ) * 8;
    };
 
+   /// Decodes integers written by DeltaIntegerEncoder (see DeltaCodec.h).
+   class DeltaIntegerDecoder : public BitpackDecoder
+   {
+   public:
+      DeltaIntegerDecoder( bool isScaledInteger, unsigned bytestreamNumber, SourceDestBuffer &dbuf,
+                           int64_t minimum, int64_t maximum, double scale, double offset,
+                           uint64_t maxRecordCount, uint64_t resetInterval );
+
+      size_t inputProcessAligned( const char *inbuf, size_t firstBit, size_t endBit ) override;
+
+      void stateReset() override;
+
+      unsigned bitsPerRecord() const override
+      {
+         return 0;
+      }
+
+      void seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount ) override;
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+      void dump( int indent = 0, std::ostream &os = std::cout ) override;
+#endif
+
+   protected:
+      bool isScaledInteger_;
+      int64_t minimum_;
+      int64_t maximum_;
+      double scale_;
+      double offset_;
+      uint64_t resetInterval_;
+
+      /// Previous value, less the minimum
+      uint64_t previous_ = 0;
+   };
+
+   /// Decodes floats written by XorFloatEncoder (see XorCodec.h).
+   class XorFloatDecoder : public BitpackDecoder
+   {
+   public:
+      XorFloatDecoder( unsigned bytestreamNumber, SourceDestBuffer &dbuf, FloatPrecision precision,
+                       uint64_t maxRecordCount, uint64_t resetInterval );
+
+      size_t inputProcessAligned( const char *inbuf, size_t firstBit, size_t endBit ) override;
+
+      void stateReset() override;
+
+      unsigned bitsPerRecord() const override
+      {
+         return 0;
+      }
+
+      void seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount ) override;
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+      void dump( int indent = 0, std::ostream &os = std::cout ) override;
+#endif
+
+   protected:
+      FloatPrecision precision_;
+      uint64_t resetInterval_;
+
+      /// Bits of the previous value
+      uint64_t previous_ = 0;
+   };
+
    class ConstantIntegerDecoder : public Decoder
    {
    public:
@@ -177,6 +348,18 @@ namespace e57
       size_t inputProcess( const char *source, size_t availableByteCount ) override;
       void stateReset() override;
 
+      unsigned bitsPerRecord() const override
+      {
+         return 0;
+      }
+
+      void seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount ) override;
+
+      void setMaxRecordCount( uint64_t maxRecordCount ) override
+      {
+         maxRecordCount_ = maxRecordCount;
+      }
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) override;
 #endif
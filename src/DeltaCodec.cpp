@@ -0,0 +1,140 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "DeltaCodec.h"
+#include "CompressedVectorNodeImpl.h"
+#include "ImageFileImpl.h"
+#include "IntegerNodeImpl.h"
+#include "StringFunctions.h"
+#include "StringNodeImpl.h"
+#include "VectorNodeImpl.h"
+
+namespace
+{
+   constexpr char cPrefix[] = "dlt";
+   constexpr char cURI[] = "urn:libE57Format:E57_EXT_delta_codec";
+   constexpr char cCodecName[] = "deltaCodec";
+   constexpr char cResetIntervalName[] = "resetInterval";
+}
+
+namespace e57
+{
+   NodeImplSharedPtr findCodecParameters( const CompressedVectorNodeImpl &cVector,
+                                          const ustring &pathName, const char *uri,
+                                          const char *codecName, ustring &prefix )
+   {
+      const std::shared_ptr<VectorNodeImpl> codecs = cVector.getCodecs();
+      if ( !codecs || codecs->childCount() == 0 )
+      {
+         return nullptr;
+      }
+
+      const NodeImplSharedPtr prototype = cVector.getPrototype();
+      const ImageFileImplSharedPtr imf( prototype->destImageFile() );
+
+      // The file may have declared the extension with a different prefix
+      if ( !imf->extensionsLookupUri( uri, prefix ) )
+      {
+         return nullptr;
+      }
+
+      const ustring qualifiedName = prefix + ":" + codecName;
+      const NodeImplSharedPtr field = prototype->get( pathName );
+
+      for ( int64_t i = 0; i < codecs->childCount(); ++i )
+      {
+         const NodeImplSharedPtr codec = codecs->get( i );
+
+         if ( codec->type() != TypeStructure || !codec->isDefined( "inputs" ) ||
+              !codec->isDefined( qualifiedName ) )
+         {
+            continue;
+         }
+
+         const NodeImplSharedPtr inputs = codec->get( "inputs" );
+         if ( inputs->type() != TypeVector )
+         {
+            throw E57_EXCEPTION2( ErrorBadCodecs, "inputsType=" + toString( inputs->type() ) );
+         }
+
+         const auto inputsVector = std::static_pointer_cast<VectorNodeImpl>( inputs );
+
+         for ( int64_t j = 0; j < inputsVector->childCount(); ++j )
+         {
+            const NodeImplSharedPtr input = inputsVector->get( j );
+            if ( input->type() != TypeString )
+            {
+               throw E57_EXCEPTION2( ErrorBadCodecs, "inputType=" + toString( input->type() ) );
+            }
+
+            const ustring inputPath = std::static_pointer_cast<StringNodeImpl>( input )->value();
+
+            if ( prototype->isDefined( inputPath ) && ( prototype->get( inputPath ) == field ) )
+            {
+               return codec->get( qualifiedName );
+            }
+         }
+      }
+
+      return nullptr;
+   }
+
+   bool findDeltaCodec( const CompressedVectorNodeImpl &cVector, const ustring &pathName,
+                        uint64_t &resetInterval )
+   {
+      ustring prefix;
+      const NodeImplSharedPtr parameters =
+         findCodecParameters( cVector, pathName, cURI, cCodecName, prefix );
+
+      if ( !parameters )
+      {
+         return false;
+      }
+
+      const ustring intervalName = prefix + ":" + cResetIntervalName;
+
+      if ( !parameters->isDefined( intervalName ) ||
+           parameters->get( intervalName )->type() != TypeInteger )
+      {
+         throw E57_EXCEPTION2( ErrorBadCodecs, "pathName=" + pathName );
+      }
+
+      const int64_t interval =
+         std::static_pointer_cast<IntegerNodeImpl>( parameters->get( intervalName ) )->value();
+
+      if ( interval <= 0 )
+      {
+         throw E57_EXCEPTION2( ErrorBadCodecs,
+                               "pathName=" + pathName + " resetInterval=" + toString( interval ) );
+      }
+
+      resetInterval = static_cast<uint64_t>( interval );
+      return true;
+   }
+
+   void addDeltaCodec( ImageFile imf, VectorNode &codecs, const std::vector<ustring> &pathNames )
+   {
+      ustring prefix;
+      if ( !imf.extensionsLookupUri( cURI, prefix ) )
+      {
+         prefix = cPrefix;
+         imf.extensionsAdd( prefix, cURI );
+      }
+
+      VectorNode inputs( imf, false );
+      for ( const auto &pathName : pathNames )
+      {
+         inputs.append( StringNode( imf, pathName ) );
+      }
+
+      StructureNode parameters( imf );
+      parameters.set( prefix + ":" + cResetIntervalName,
+                      IntegerNode( imf, cDeltaCodecResetInterval, 1, INT64_MAX ) );
+
+      StructureNode codec( imf );
+      codec.set( "inputs", inputs );
+      codec.set( prefix + ":" + cCodecName, parameters );
+
+      codecs.append( codec );
+   }
+}
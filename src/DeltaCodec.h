@@ -0,0 +1,54 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for the delta codec extension. An entry in a CompressedVectorNode's codecs like this:
+//
+//    <codecs type="Vector" allowHeterogeneousChildren="1">
+//       <vectorChild type="Structure">
+//          <inputs type="Vector" allowHeterogeneousChildren="0">
+//             <vectorChild type="String"><![CDATA[cartesianX]]></vectorChild>
+//          </inputs>
+//          <dlt:deltaCodec type="Structure">
+//             <dlt:resetInterval type="Integer" minimum="1">64</dlt:resetInterval>
+//          </dlt:deltaCodec>
+//       </vectorChild>
+//    </codecs>
+//
+// says the Integer or ScaledInteger fields listed in inputs are stored as the difference from the
+// previous record instead of bit-packed. Each record is a zigzag encoded LEB128 varint of
+// ( value - previous ), where previous is the minimum of the field for the first record and for
+// every record whose index is a multiple of resetInterval. Fields with only one possible value
+// are still not stored at all.
+//
+// resetInterval must divide the first record of every chunk the index packets point to, so a
+// reader can start decoding there.
+
+#include <vector>
+
+#include "Common.h"
+#include "E57Format.h"
+
+namespace e57
+{
+   /// Interval at which the predictor is reset in the files we write. This is the alignment of
+   /// the chunks the CompressedVectorWriter writes index packets for.
+   constexpr int64_t cDeltaCodecResetInterval = 64;
+
+   /// The parameters (the child called @a codecName) of the first entry in @a cVector's codecs
+   /// which has one and lists @a pathName in its inputs, or nullptr if there isn't one. The codec
+   /// belongs to the extension @a uri, whose prefix in the file is put in @a prefix. Shared by
+   /// the codec extensions.
+   NodeImplSharedPtr findCodecParameters( const CompressedVectorNodeImpl &cVector,
+                                          const ustring &pathName, const char *uri,
+                                          const char *codecName, ustring &prefix );
+
+   /// If @a cVector's codecs say @a pathName is delta encoded, set @a resetInterval and return
+   /// true.
+   bool findDeltaCodec( const CompressedVectorNodeImpl &cVector, const ustring &pathName,
+                        uint64_t &resetInterval );
+
+   /// Add an entry to @a codecs (declaring the extension if needed) to delta encode the
+   /// prototype fields @a pathNames.
+   void addDeltaCodec( ImageFile imf, VectorNode &codecs, const std::vector<ustring> &pathNames );
+}
@@ -0,0 +1,298 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// convenience helper for all the BSDs
+#if defined( __FreeBSD__ ) || defined( __NetBSD__ ) || defined( __OpenBSD__ )
+#define __BSD
+#endif
+
+#if defined( _WIN32 )
+#if defined( _MSC_VER )
+#include <codecvt>
+#endif
+#include <io.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined( __linux__ ) || defined( __EMSCRIPTEN__ )
+#define _LARGEFILE64_SOURCE
+#define __LARGE64_FILES
+#include <sys/types.h>
+#include <unistd.h>
+#elif defined( __APPLE__ ) || defined( __BSD )
+#include <sys/types.h>
+#include <unistd.h>
+#else
+#error "no supported OS platform defined"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+
+#include "CheckedFile.h"
+#include "DirectWriter.h"
+#include "ReadSource.h"
+#include "StringFunctions.h"
+
+namespace e57
+{
+   // These extra definitions are required in C++11.
+   // In C++17, "static constexpr" is implicitly inline, so these are not required.
+   constexpr size_t DirectWriter::cAlignment;
+   constexpr size_t DirectWriter::cBufferSize;
+
+   namespace
+   {
+      constexpr size_t cPageSize = CheckedFile::physicalPageSize;
+      constexpr size_t cPagesPerBlock = DirectWriter::cAlignment / cPageSize;
+      constexpr size_t cBufferPages = DirectWriter::cBufferSize / cPageSize;
+
+      static_assert( DirectWriter::cAlignment % cPageSize == 0,
+                     "aligned blocks must hold whole pages" );
+      static_assert( DirectWriter::cBufferSize % DirectWriter::cAlignment == 0,
+                     "the buffer must hold whole aligned blocks" );
+
+      // Write some of @a count bytes at @a offset, returning how many were written or -1 with
+      // errno set.
+#if defined( _WIN32 )
+      int64_t writeSome( HANDLE handle, uint64_t offset, const char *data, size_t count )
+      {
+         OVERLAPPED overlapped = {};
+         overlapped.Offset = static_cast<DWORD>( offset & 0xFFFFFFFF );
+         overlapped.OffsetHigh = static_cast<DWORD>( offset >> 32 );
+
+         DWORD bytesWritten = 0;
+
+         if ( !::WriteFile( handle, data, static_cast<DWORD>( count ), &bytesWritten,
+                            &overlapped ) )
+         {
+            errno = ( ::GetLastError() == ERROR_INVALID_PARAMETER ) ? EINVAL : EIO;
+            return -1;
+         }
+
+         return bytesWritten;
+      }
+#else
+      int64_t writeSome( int fd, uint64_t offset, const char *data, size_t count )
+      {
+#if defined( __linux__ ) || defined( __EMSCRIPTEN__ )
+         return ::pwrite64( fd, data, count, static_cast<off64_t>( offset ) );
+#else
+         return ::pwrite( fd, data, count, static_cast<off_t>( offset ) );
+#endif
+      }
+#endif
+   }
+
+   DirectWriter::DirectWriter( const ustring &fileName, int fd ) :
+      fileName_( fileName ), fd_( fd ), storage_( cBufferSize + cAlignment )
+   {
+      // std::vector doesn't allocate aligned memory, so use an aligned part of it
+      const auto address = reinterpret_cast<uintptr_t>( storage_.data() );
+
+      buffer_ = storage_.data() + ( cAlignment - address % cAlignment ) % cAlignment;
+
+      // Open a second handle for the direct writes. If we can't, everything is written through
+      // fd_.
+#if defined( _WIN32 )
+#if defined( _MSC_VER )
+      std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+      std::wstring widePath = converter.from_bytes( fileName_ );
+
+      HANDLE handle = ::CreateFileW( widePath.c_str(), GENERIC_WRITE,
+                                     FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                                     FILE_FLAG_NO_BUFFERING, nullptr );
+#else
+      HANDLE handle =
+         ::CreateFileA( fileName_.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                        nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr );
+#endif
+
+      if ( handle != INVALID_HANDLE_VALUE )
+      {
+         directHandle_ = handle;
+      }
+#elif defined( __APPLE__ )
+      directFd_ = ::open( fileName_.c_str(), O_WRONLY );
+
+      if ( ( directFd_ >= 0 ) && ( ::fcntl( directFd_, F_NOCACHE, 1 ) < 0 ) )
+      {
+         closeDirect();
+      }
+#elif defined( O_DIRECT ) && !defined( __EMSCRIPTEN__ )
+      directFd_ = ::open( fileName_.c_str(), O_WRONLY | O_DIRECT );
+#endif
+   }
+
+   DirectWriter::~DirectWriter()
+   {
+      closeDirect();
+   }
+
+   bool DirectWriter::isDirect() const
+   {
+#if defined( _WIN32 )
+      return directHandle_ != nullptr;
+#else
+      return directFd_ >= 0;
+#endif
+   }
+
+   void DirectWriter::write( const char *pages, uint64_t page, size_t pageCount )
+   {
+      while ( pageCount > 0 )
+      {
+         const bool followsOn = ( firstPage_ != endPage_ ) && ( page >= firstPage_ ) &&
+                                ( page <= endPage_ ) && ( page < basePage_ + cBufferPages );
+
+         if ( !followsOn )
+         {
+            flush();
+
+            basePage_ = page - page % cPagesPerBlock;
+            firstPage_ = page;
+            endPage_ = page;
+         }
+
+         const auto count = static_cast<size_t>(
+            std::min( uint64_t{ pageCount }, basePage_ + cBufferPages - page ) );
+
+         memcpy( buffer_ + ( page - basePage_ ) * cPageSize, pages, count * cPageSize );
+
+         endPage_ = std::max( endPage_, page + count );
+
+         pages += count * cPageSize;
+         page += count;
+         pageCount -= count;
+      }
+   }
+
+   void DirectWriter::read( char *pages, uint64_t page, size_t pageCount )
+   {
+      const uint64_t end = page + pageCount;
+
+      // The pages before and after the ones in the buffer are read from the file
+      const uint64_t bufferedFirst = std::min( std::max( page, firstPage_ ), end );
+      const uint64_t bufferedEnd = std::max( std::min( end, endPage_ ), bufferedFirst );
+
+      if ( bufferedFirst > page )
+      {
+         readFileAt( fd_, page * cPageSize, pages,
+                     static_cast<size_t>( bufferedFirst - page ) * cPageSize, fileName_ );
+      }
+
+      if ( bufferedEnd > bufferedFirst )
+      {
+         memcpy( pages + ( bufferedFirst - page ) * cPageSize,
+                 buffer_ + ( bufferedFirst - basePage_ ) * cPageSize,
+                 static_cast<size_t>( bufferedEnd - bufferedFirst ) * cPageSize );
+      }
+
+      if ( end > bufferedEnd )
+      {
+         readFileAt( fd_, bufferedEnd * cPageSize, pages + ( bufferedEnd - page ) * cPageSize,
+                     static_cast<size_t>( end - bufferedEnd ) * cPageSize, fileName_ );
+      }
+   }
+
+   uint64_t DirectWriter::length() const
+   {
+      return endPage_ * cPageSize;
+   }
+
+   void DirectWriter::flush()
+   {
+      if ( firstPage_ == endPage_ )
+      {
+         return;
+      }
+
+      // The whole aligned blocks in the buffer
+      uint64_t alignedFirst = ( firstPage_ + cPagesPerBlock - 1 ) / cPagesPerBlock * cPagesPerBlock;
+      uint64_t alignedEnd = endPage_ / cPagesPerBlock * cPagesPerBlock;
+
+      if ( alignedFirst >= alignedEnd )
+      {
+         alignedFirst = endPage_;
+         alignedEnd = endPage_;
+      }
+
+      const auto writePages = [this]( uint64_t first, uint64_t end, bool direct ) {
+         if ( end > first )
+         {
+            writeAt( first * cPageSize, buffer_ + ( first - basePage_ ) * cPageSize,
+                     static_cast<size_t>( end - first ) * cPageSize, direct );
+         }
+      };
+
+      writePages( firstPage_, alignedFirst, false );
+      writePages( alignedFirst, alignedEnd, true );
+      writePages( alignedEnd, endPage_, false );
+
+      basePage_ = 0;
+      firstPage_ = 0;
+      endPage_ = 0;
+   }
+
+   void DirectWriter::writeAt( uint64_t offset, const char *data, size_t count, bool direct )
+   {
+#if defined( _WIN32 )
+      const auto fileHandle = reinterpret_cast<HANDLE>( ::_get_osfhandle( fd_ ) );
+      const auto directHandle = static_cast<HANDLE>( directHandle_ );
+#else
+      const int fileHandle = fd_;
+      const int directHandle = directFd_;
+#endif
+
+      size_t total = 0;
+
+      while ( total < count )
+      {
+         // Once a direct write comes up short its offset isn't aligned any more, so the rest goes
+         // through fd_
+         const bool useDirect = direct && isDirect() && ( total == 0 );
+
+         const int64_t result = writeSome( useDirect ? directHandle : fileHandle, offset + total,
+                                           data + total, count - total );
+
+         if ( ( result < 0 ) && useDirect && ( errno == EINVAL ) )
+         {
+            // The file system doesn't allow direct I/O (or this alignment), so stop using it
+            closeDirect();
+            continue;
+         }
+
+         if ( result <= 0 )
+         {
+            throw E57_EXCEPTION2( ErrorWriteFailed, "fileName=" + fileName_ +
+                                                       " result=" + toString( result ) +
+                                                       " offset=" + toString( offset + total ) );
+         }
+
+         total += static_cast<size_t>( result );
+      }
+   }
+
+   void DirectWriter::closeDirect()
+   {
+#if defined( _WIN32 )
+      if ( directHandle_ != nullptr )
+      {
+         ::CloseHandle( static_cast<HANDLE>( directHandle_ ) );
+         directHandle_ = nullptr;
+      }
+#else
+      if ( directFd_ >= 0 )
+      {
+         ::close( directFd_ );
+         directFd_ = -1;
+      }
+#endif
+   }
+}
@@ -0,0 +1,78 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for ImageFileOptions::directIo.
+
+#include <vector>
+
+#include "Common.h"
+
+namespace e57
+{
+   /// Collects the pages CheckedFile writes in a large aligned buffer, and writes them out with
+   /// direct I/O (O_DIRECT, F_NOCACHE, or FILE_FLAG_NO_BUFFERING) so writing a large file doesn't
+   /// fill the OS page cache.
+   ///
+   /// Pages are collected as long as each write follows on from (or overwrites) the ones already
+   /// in the buffer. Writing anywhere else writes the buffer out first. Only whole aligned blocks
+   /// are written directly; the pages at either end of the buffer which don't fill one are
+   /// written through the file's own descriptor, as is everything if the file system doesn't
+   /// allow direct I/O.
+   class DirectWriter
+   {
+   public:
+      /// Alignment of the buffer, and of the offsets and sizes of direct writes
+      static constexpr size_t cAlignment = 4096;
+
+      /// Size of the buffer
+      static constexpr size_t cBufferSize = 8 * 1024 * 1024;
+
+      /// @param fileName Name of the file, which must exist.
+      /// @param fd The file opened for reading and writing by CheckedFile. It isn't owned.
+      DirectWriter( const ustring &fileName, int fd );
+
+      /// Closes the direct handle without writing out the buffer (see flush()).
+      ~DirectWriter();
+
+      DirectWriter( const DirectWriter & ) = delete;
+      DirectWriter &operator=( const DirectWriter & ) = delete;
+
+      /// True if the file could be opened for direct I/O
+      bool isDirect() const;
+
+      /// Copy @a pageCount physical pages (with their checksums) to be written at @a page.
+      void write( const char *pages, uint64_t page, size_t pageCount );
+
+      /// Read @a pageCount physical pages at @a page, from the buffer if they are in it.
+      void read( char *pages, uint64_t page, size_t pageCount );
+
+      /// Physical length of the file once the buffer is written out, or 0 if it is empty
+      uint64_t length() const;
+
+      /// Write out the buffer
+      void flush();
+
+   private:
+      void writeAt( uint64_t offset, const char *data, size_t count, bool direct );
+      void closeDirect();
+
+      const ustring fileName_;
+      const int fd_;
+
+#if defined( _WIN32 )
+      void *directHandle_ = nullptr;
+#else
+      int directFd_ = -1;
+#endif
+
+      std::vector<char> storage_;
+      char *buffer_ = nullptr; // aligned start of storage_
+
+      // The buffer holds pages [firstPage_, endPage_). basePage_ is at the start of the buffer,
+      // and is a multiple of the pages in an aligned block so file and buffer alignment match.
+      uint64_t basePage_ = 0;
+      uint64_t firstPage_ = 0;
+      uint64_t endPage_ = 0;
+   };
+}
@@ -0,0 +1,90 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "E57DatasetReader.h"
+#include "DatasetReaderImpl.h"
+
+namespace e57
+{
+   DatasetReader::DatasetReader( const std::vector<ustring> &filePaths,
+                                 const DatasetReaderOptions &options ) :
+      impl_( new DatasetReaderImpl( filePaths, options ) )
+   {
+   }
+
+   std::vector<ustring> DatasetReader::FindFiles( const ustring &directoryPath,
+                                                  const ustring &extension )
+   {
+      return DatasetReaderImpl::FindFiles( directoryPath, extension );
+   }
+
+   void DatasetReader::Close()
+   {
+      impl_->Close();
+   }
+
+   size_t DatasetReader::GetFileCount() const
+   {
+      return impl_->GetFileCount();
+   }
+
+   ustring DatasetReader::GetFilePath( size_t fileIndex ) const
+   {
+      return impl_->GetFilePath( fileIndex );
+   }
+
+   bool DatasetReader::GetMetadataSummary( size_t fileIndex, MetadataSummary &summary ) const
+   {
+      return impl_->GetMetadataSummary( fileIndex, summary );
+   }
+
+   Reader DatasetReader::GetReader( size_t fileIndex ) const
+   {
+      return impl_->GetReader( fileIndex );
+   }
+
+   int64_t DatasetReader::GetData3DCount() const
+   {
+      return impl_->GetData3DCount();
+   }
+
+   DatasetLocation DatasetReader::GetData3DLocation( int64_t dataIndex ) const
+   {
+      return impl_->GetData3DLocation( dataIndex );
+   }
+
+   bool DatasetReader::GetData3DSummary( int64_t dataIndex, Data3DSummary &summary ) const
+   {
+      return impl_->GetData3DSummary( dataIndex, summary );
+   }
+
+   bool DatasetReader::ReadData3D( int64_t dataIndex, Data3D &data3DHeader ) const
+   {
+      return impl_->ReadData3D( dataIndex, data3DHeader );
+   }
+
+   void DatasetReader::ForEachData3D( const DatasetData3DTask &task ) const
+   {
+      impl_->ForEachData3D( task );
+   }
+
+   int64_t DatasetReader::GetImage2DCount() const
+   {
+      return impl_->GetImage2DCount();
+   }
+
+   DatasetLocation DatasetReader::GetImage2DLocation( int64_t imageIndex ) const
+   {
+      return impl_->GetImage2DLocation( imageIndex );
+   }
+
+   bool DatasetReader::GetImage2DSummary( int64_t imageIndex, Image2DSummary &summary ) const
+   {
+      return impl_->GetImage2DSummary( imageIndex, summary );
+   }
+
+   bool DatasetReader::ReadImage2D( int64_t imageIndex, Image2D &image2DHeader ) const
+   {
+      return impl_->ReadImage2D( imageIndex, image2DHeader );
+   }
+}
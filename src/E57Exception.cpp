@@ -361,6 +361,8 @@ namespace e57
          case ErrorData3DReadInvalidZeroRecords:
             return "trying to read an invalid Data3D with zero records - check for zero records "
                    "before trying to read this Data3D section (ErrorInvalidZeroRecordsData3D)";
+         case ErrorCancelled:
+            return "a read or write was stopped by a CancellationToken (ErrorCancelled)";
 
          default:
             return "unknown error (" + std::to_string( ecode ) + ")";
@@ -8,11 +8,44 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 
+#include <algorithm>
+
 #include "E57SimpleData.h"
 
 #include "Common.h"
 #include "StringFunctions.h"
 
+namespace
+{
+   constexpr size_t cAlignment = e57::Data3DPointsData_t<double>::cAlignment;
+
+   /// Round @a size up to a multiple of cAlignment, so the next buffer is aligned too
+   size_t alignedSize( size_t size )
+   {
+      return ( size + cAlignment - 1 ) & ~( cAlignment - 1 );
+   }
+
+   /// Allocate @a size bytes aligned to cAlignment. The offset from the start of the allocation
+   /// (1 to cAlignment bytes) is kept in the byte before the memory returned.
+   void *alignedAllocate( size_t size )
+   {
+      auto *raw = static_cast<unsigned char *>( ::operator new( size + cAlignment ) );
+      auto *aligned = reinterpret_cast<unsigned char *>(
+         ( reinterpret_cast<uintptr_t>( raw ) + cAlignment ) & ~( cAlignment - 1 ) );
+
+      aligned[-1] = static_cast<unsigned char>( aligned - raw );
+
+      return aligned;
+   }
+
+   void alignedFree( void *memory )
+   {
+      auto *aligned = static_cast<unsigned char *>( memory );
+
+      ::operator delete( aligned - aligned[-1] );
+   }
+}
+
 namespace e57
 {
    /// @private
@@ -45,7 +78,9 @@ namespace e57
    }
 
    template <typename COORDTYPE>
-   Data3DPointsData_t<COORDTYPE>::Data3DPointsData_t( Data3D &data3D ) : _selfAllocated( true )
+   Data3DPointsData_t<COORDTYPE>::Data3DPointsData_t( Data3D &data3D,
+                                                   Data3DPointsAllocator *allocator,
+                                                   bool packInvalidStates )
    {
       static_assert( std::is_floating_point<COORDTYPE>::value, "Floating point type required." );
 
@@ -81,165 +116,277 @@ namespace e57
       }
 
       const auto cPointCount = data3D.pointCount;
+      const auto &cFields = data3D.pointFields;
 
-      if ( data3D.pointFields.cartesianXField )
-      {
-         cartesianX = new COORDTYPE[cPointCount];
-      }
+      // Lay the buffers out one after another in a single block, each one aligned. The first
+      // pass works out the size and the second one points the buffers into the block.
+      char *base = nullptr;
+      size_t size = 0;
 
-      if ( data3D.pointFields.cartesianYField )
-      {
-         cartesianY = new COORDTYPE[cPointCount];
-      }
+      auto place = [&]( auto *&buffer, bool used ) {
+         using T = typename std::remove_reference<decltype( *buffer )>::type;
 
-      if ( data3D.pointFields.cartesianZField )
-      {
-         cartesianZ = new COORDTYPE[cPointCount];
-      }
+         if ( !used )
+         {
+            buffer = nullptr;
+            return;
+         }
 
-      if ( data3D.pointFields.cartesianInvalidStateField )
-      {
-         cartesianInvalidState = new int8_t[cPointCount];
-      }
+         // The fields used get a buffer even with no points, so they can still be written
+         const auto capacity = std::max<size_t>( static_cast<size_t>( cPointCount ), 1 );
 
-      if ( data3D.pointFields.intensityField )
-      {
-         intensity = new double[cPointCount];
-      }
+         buffer = ( base != nullptr ) ? reinterpret_cast<T *>( base + size ) : nullptr;
+         size += alignedSize( capacity * sizeof( T ) );
+      };
 
-      if ( data3D.pointFields.isIntensityInvalidField )
-      {
-         isIntensityInvalid = new int8_t[cPointCount];
-      }
+      // An invalid state field gets either an int8_t buffer or a packed one
+      auto placeBits = [&]( int8_t *&buffer, PackedBits &bits, bool used ) {
+         place( buffer, used && !packInvalidStates );
 
-      if ( data3D.pointFields.colorRedField )
-      {
-         colorRed = new uint16_t[cPointCount];
-      }
+         if ( !used || !packInvalidStates )
+         {
+            bits.data = nullptr;
+            return;
+         }
 
-      if ( data3D.pointFields.colorGreenField )
-      {
-         colorGreen = new uint16_t[cPointCount];
-      }
+         const auto capacity = std::max<size_t>( static_cast<size_t>( cPointCount ), 1 );
 
-      if ( data3D.pointFields.colorBlueField )
-      {
-         colorBlue = new uint16_t[cPointCount];
-      }
+         bits.data = ( base != nullptr ) ? reinterpret_cast<uint8_t *>( base + size ) : nullptr;
+         size += alignedSize( PackedBits::byteCount( capacity, bits.bitsPerValue ) );
+      };
 
-      if ( data3D.pointFields.isColorInvalidField )
-      {
-         isColorInvalid = new int8_t[cPointCount];
-      }
+      auto placeAll = [&] {
+         place( cartesianX, cFields.cartesianXField );
+         place( cartesianY, cFields.cartesianYField );
+         place( cartesianZ, cFields.cartesianZField );
+         placeBits( cartesianInvalidState, cartesianInvalidStateBits,
+                    cFields.cartesianInvalidStateField );
 
-      if ( data3D.pointFields.sphericalRangeField )
-      {
-         sphericalRange = new COORDTYPE[cPointCount];
-      }
+         place( intensity, cFields.intensityField );
+         placeBits( isIntensityInvalid, isIntensityInvalidBits, cFields.isIntensityInvalidField );
 
-      if ( data3D.pointFields.sphericalAzimuthField )
-      {
-         sphericalAzimuth = new COORDTYPE[cPointCount];
-      }
+         place( colorRed, cFields.colorRedField );
+         place( colorGreen, cFields.colorGreenField );
+         place( colorBlue, cFields.colorBlueField );
+         placeBits( isColorInvalid, isColorInvalidBits, cFields.isColorInvalidField );
 
-      if ( data3D.pointFields.sphericalElevationField )
-      {
-         sphericalElevation = new COORDTYPE[cPointCount];
-      }
+         place( sphericalRange, cFields.sphericalRangeField );
+         place( sphericalAzimuth, cFields.sphericalAzimuthField );
+         place( sphericalElevation, cFields.sphericalElevationField );
+         placeBits( sphericalInvalidState, sphericalInvalidStateBits,
+                    cFields.sphericalInvalidStateField );
 
-      if ( data3D.pointFields.sphericalInvalidStateField )
-      {
-         sphericalInvalidState = new int8_t[cPointCount];
-      }
+         place( rowIndex, cFields.rowIndexField );
+         place( columnIndex, cFields.columnIndexField );
 
-      if ( data3D.pointFields.rowIndexField )
-      {
-         rowIndex = new int32_t[cPointCount];
-      }
+         place( returnIndex, cFields.returnIndexField );
+         place( returnCount, cFields.returnCountField );
 
-      if ( data3D.pointFields.columnIndexField )
-      {
-         columnIndex = new int32_t[cPointCount];
-      }
+         place( timeStamp, cFields.timeStampField );
+         placeBits( isTimeStampInvalid, isTimeStampInvalidBits, cFields.isTimeStampInvalidField );
 
-      if ( data3D.pointFields.returnIndexField )
-      {
-         returnIndex = new int8_t[cPointCount];
-      }
+         place( normalX, cFields.normalXField );
+         place( normalY, cFields.normalYField );
+         place( normalZ, cFields.normalZField );
+      };
+
+      placeAll();
 
-      if ( data3D.pointFields.returnCountField )
+      if ( size == 0 )
       {
-         returnCount = new int8_t[cPointCount];
+         return;
       }
 
-      if ( data3D.pointFields.timeStampField )
+      _memory = allocator ? allocator->allocate( size ) : alignedAllocate( size );
+      _memorySize = size;
+      _allocator = allocator;
+
+      base = static_cast<char *>( _memory );
+      size = 0;
+
+      placeAll();
+   }
+
+   template <typename COORDTYPE> Data3DPointsData_t<COORDTYPE>::~Data3DPointsData_t()
+   {
+      static_assert( std::is_floating_point<COORDTYPE>::value, "Floating point type required." );
+
+      _free();
+   }
+
+   template <typename COORDTYPE>
+   Data3DPointsData_t<COORDTYPE>::Data3DPointsData_t( Data3DPointsData_t &&other ) noexcept
+   {
+      *this = std::move( other );
+   }
+
+   template <typename COORDTYPE>
+   Data3DPointsData_t<COORDTYPE> &Data3DPointsData_t<COORDTYPE>::operator=(
+      Data3DPointsData_t &&other ) noexcept
+   {
+      if ( &other == this )
       {
-         timeStamp = new double[cPointCount];
+         return *this;
       }
 
-      if ( data3D.pointFields.isTimeStampInvalidField )
+      _free();
+
+      _forEachBuffer( *this, other, []( auto *&mine, auto *&theirs ) {
+         mine = theirs;
+         theirs = nullptr;
+      } );
+
+      _memory = other._memory;
+      _memorySize = other._memorySize;
+      _allocator = other._allocator;
+
+      other._memory = nullptr;
+      other._memorySize = 0;
+      other._allocator = nullptr;
+
+      return *this;
+   }
+
+   template <typename COORDTYPE>
+   template <typename Function>
+   void Data3DPointsData_t<COORDTYPE>::_forEachBuffer( Data3DPointsData_t &a,
+                                                       Data3DPointsData_t &b, Function function )
+   {
+      function( a.cartesianX, b.cartesianX );
+      function( a.cartesianY, b.cartesianY );
+      function( a.cartesianZ, b.cartesianZ );
+      function( a.cartesianInvalidState, b.cartesianInvalidState );
+
+      function( a.intensity, b.intensity );
+      function( a.isIntensityInvalid, b.isIntensityInvalid );
+
+      function( a.colorRed, b.colorRed );
+      function( a.colorGreen, b.colorGreen );
+      function( a.colorBlue, b.colorBlue );
+      function( a.isColorInvalid, b.isColorInvalid );
+
+      function( a.sphericalRange, b.sphericalRange );
+      function( a.sphericalAzimuth, b.sphericalAzimuth );
+      function( a.sphericalElevation, b.sphericalElevation );
+      function( a.sphericalInvalidState, b.sphericalInvalidState );
+
+      function( a.rowIndex, b.rowIndex );
+      function( a.columnIndex, b.columnIndex );
+
+      function( a.returnIndex, b.returnIndex );
+      function( a.returnCount, b.returnCount );
+
+      function( a.timeStamp, b.timeStamp );
+      function( a.isTimeStampInvalid, b.isTimeStampInvalid );
+
+      function( a.normalX, b.normalX );
+      function( a.normalY, b.normalY );
+      function( a.normalZ, b.normalZ );
+
+      function( a.cartesianInvalidStateBits.data, b.cartesianInvalidStateBits.data );
+      function( a.isIntensityInvalidBits.data, b.isIntensityInvalidBits.data );
+      function( a.isColorInvalidBits.data, b.isColorInvalidBits.data );
+      function( a.sphericalInvalidStateBits.data, b.sphericalInvalidStateBits.data );
+      function( a.isTimeStampInvalidBits.data, b.isTimeStampInvalidBits.data );
+   }
+
+   template <typename COORDTYPE> void Data3DPointsData_t<COORDTYPE>::_free()
+   {
+      if ( _memory == nullptr )
       {
-         isTimeStampInvalid = new int8_t[cPointCount];
+         return;
       }
 
-      if ( data3D.pointFields.normalXField )
+      if ( _allocator != nullptr )
       {
-         normalX = new float[cPointCount];
+         _allocator->deallocate( _memory, _memorySize );
       }
-
-      if ( data3D.pointFields.normalYField )
+      else
       {
-         normalY = new float[cPointCount];
+         alignedFree( _memory );
       }
 
-      if ( data3D.pointFields.normalZField )
+      _memory = nullptr;
+      _memorySize = 0;
+      _allocator = nullptr;
+
+      // The buffers were all in _memory
+      Data3DPointsData_t empty;
+      _forEachBuffer( *this, empty, []( auto *&mine, auto *& ) { mine = nullptr; } );
+   }
+
+   Data3DPointsBufferPool::~Data3DPointsBufferPool()
+   {
+      release();
+   }
+
+   void *Data3DPointsBufferPool::allocate( size_t size )
+   {
       {
-         normalZ = new float[cPointCount];
+         std::lock_guard<std::mutex> lock( mutex_ );
+
+         // The smallest cached block which is big enough
+         const auto cFound = free_.lower_bound( size );
+
+         if ( cFound != free_.end() )
+         {
+            void *memory = cFound->second;
+
+            used_.emplace( memory, cFound->first );
+            free_.erase( cFound );
+
+            return memory;
+         }
       }
+
+      void *memory = alignedAllocate( size );
+
+      std::lock_guard<std::mutex> lock( mutex_ );
+
+      used_.emplace( memory, size );
+
+      return memory;
    }
 
-   template <typename COORDTYPE> Data3DPointsData_t<COORDTYPE>::~Data3DPointsData_t()
+   void Data3DPointsBufferPool::deallocate( void *memory, size_t )
    {
-      static_assert( std::is_floating_point<COORDTYPE>::value, "Floating point type required." );
+      std::lock_guard<std::mutex> lock( mutex_ );
 
-      if ( !_selfAllocated )
+      const auto cFound = used_.find( memory );
+
+      if ( cFound == used_.end() )
       {
-         return;
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "memory wasn't allocated by this pool" );
       }
 
-      delete[] cartesianX;
-      delete[] cartesianY;
-      delete[] cartesianZ;
-      delete[] cartesianInvalidState;
-
-      delete[] intensity;
-      delete[] isIntensityInvalid;
+      free_.emplace( cFound->second, memory );
+      used_.erase( cFound );
+   }
 
-      delete[] colorRed;
-      delete[] colorGreen;
-      delete[] colorBlue;
-      delete[] isColorInvalid;
+   void Data3DPointsBufferPool::release()
+   {
+      std::lock_guard<std::mutex> lock( mutex_ );
 
-      delete[] sphericalRange;
-      delete[] sphericalAzimuth;
-      delete[] sphericalElevation;
-      delete[] sphericalInvalidState;
+      for ( const auto &block : free_ )
+      {
+         alignedFree( block.second );
+      }
 
-      delete[] rowIndex;
-      delete[] columnIndex;
+      free_.clear();
+   }
 
-      delete[] returnIndex;
-      delete[] returnCount;
+   size_t Data3DPointsBufferPool::cachedSize() const
+   {
+      std::lock_guard<std::mutex> lock( mutex_ );
 
-      delete[] timeStamp;
-      delete[] isTimeStampInvalid;
+      size_t size = 0;
 
-      delete[] normalX;
-      delete[] normalY;
-      delete[] normalZ;
+      for ( const auto &block : free_ )
+      {
+         size += block.first;
+      }
 
-      // Set them all to nullptr.
-      *this = Data3DPointsData_t<COORDTYPE>();
+      return size;
    }
 
 #if defined( _MSC_VER )
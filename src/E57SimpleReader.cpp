@@ -36,6 +36,11 @@ namespace e57
    {
    }
 
+   Reader::Reader( const std::shared_ptr<ReadSource> &source, const ReaderOptions &options ) :
+      impl_( new ReaderImpl( source, options ) )
+   {
+   }
+
    // Note that this constructor is deprecated (see header).
    Reader::Reader( const ustring &filePath ) : Reader( filePath, {} )
    {
@@ -51,11 +56,32 @@ namespace e57
       return impl_->Close();
    }
 
+   bool Reader::Refresh()
+   {
+      return impl_->Refresh();
+   }
+
    bool Reader::GetE57Root( E57Root &fileHeader ) const
    {
       return impl_->GetE57Root( fileHeader );
    }
 
+   bool Reader::GetMetadataSummary( MetadataSummary &summary ) const
+   {
+      return impl_->GetMetadataSummary( summary );
+   }
+
+   bool Reader::ReadMetadataSummary( const ustring &filePath, MetadataSummary &summary,
+                                     const ReaderOptions &options, bool writeSidecar )
+   {
+      return ReaderImpl::ReadMetadataSummary( filePath, summary, options, writeSidecar );
+   }
+
+   ustring Reader::MetadataSummarySidecarPath( const ustring &filePath )
+   {
+      return ReaderImpl::MetadataSummarySidecarPath( filePath );
+   }
+
    int64_t Reader::GetImage2DCount() const
    {
       return impl_->GetImage2DCount();
@@ -144,4 +170,99 @@ namespace e57
    {
       return impl_->SetUpData3DPointsData( dataIndex, pointCount, buffers );
    }
+
+   CompressedVectorReader Reader::SetUpData3DPointsData(
+      int64_t dataIndex, size_t pointCount, const Data3DPointsInterleaved &points ) const
+   {
+      return impl_->SetUpData3DPointsData( dataIndex, pointCount, points );
+   }
+
+   bool Reader::GetData3DLevelOfDetail( int64_t dataIndex, int64_t pointBudget, int64_t &level,
+                                        int64_t &pointCount ) const
+   {
+      return impl_->GetData3DLevelOfDetail( dataIndex, pointBudget, level, pointCount );
+   }
+
+   CompressedVectorReader Reader::SetUpData3DLevelOfDetailData(
+      int64_t dataIndex, int64_t level, size_t pointCount, const Data3DPointsFloat &buffers ) const
+   {
+      return impl_->SetUpData3DLevelOfDetailData( dataIndex, level, pointCount, buffers );
+   }
+
+   CompressedVectorReader Reader::SetUpData3DLevelOfDetailData(
+      int64_t dataIndex, int64_t level, size_t pointCount, const Data3DPointsDouble &buffers ) const
+   {
+      return impl_->SetUpData3DLevelOfDetailData( dataIndex, level, pointCount, buffers );
+   }
+
+   CompressedVectorReader Reader::SetUpData3DLevelOfDetailData(
+      int64_t dataIndex, int64_t level, size_t pointCount,
+      const Data3DPointsInterleaved &points ) const
+   {
+      return impl_->SetUpData3DLevelOfDetailData( dataIndex, level, pointCount, points );
+   }
+
+   int64_t Reader::ReadData3DPointsChunked( int64_t dataIndex, size_t chunkSize,
+                                            const Data3DPointsCallback<float> &callback ) const
+   {
+      return impl_->ReadData3DPointsChunked( dataIndex, chunkSize, callback );
+   }
+
+   int64_t Reader::ReadData3DPointsChunked( int64_t dataIndex, size_t chunkSize,
+                                            const Data3DPointsCallback<double> &callback ) const
+   {
+      return impl_->ReadData3DPointsChunked( dataIndex, chunkSize, callback );
+   }
+
+   int64_t Reader::ReadData3DPointsInBox( int64_t dataIndex, const CartesianBounds &box,
+                                          size_t chunkSize,
+                                          const Data3DPointsCallback<float> &callback ) const
+   {
+      return impl_->ReadData3DPointsInBox( dataIndex, box, chunkSize, callback );
+   }
+
+   int64_t Reader::ReadData3DPointsInBox( int64_t dataIndex, const CartesianBounds &box,
+                                          size_t chunkSize,
+                                          const Data3DPointsCallback<double> &callback ) const
+   {
+      return impl_->ReadData3DPointsInBox( dataIndex, box, chunkSize, callback );
+   }
+
+   int64_t Reader::ReadData3DLines( int64_t dataIndex, const std::vector<int64_t> &lines,
+                                    unsigned threadCount,
+                                    const Data3DLineCallback<float> &callback ) const
+   {
+      return impl_->ReadData3DLines( dataIndex, lines, threadCount, callback );
+   }
+
+   int64_t Reader::ReadData3DLines( int64_t dataIndex, const std::vector<int64_t> &lines,
+                                    unsigned threadCount,
+                                    const Data3DLineCallback<double> &callback ) const
+   {
+      return impl_->ReadData3DLines( dataIndex, lines, threadCount, callback );
+   }
+
+   int64_t Reader::ReadData3DGrid( int64_t dataIndex, const Data3DPointsFloat &grid,
+                                   unsigned threadCount ) const
+   {
+      return impl_->ReadData3DGrid( dataIndex, grid, threadCount );
+   }
+
+   int64_t Reader::ReadData3DGrid( int64_t dataIndex, const Data3DPointsDouble &grid,
+                                   unsigned threadCount ) const
+   {
+      return impl_->ReadData3DGrid( dataIndex, grid, threadCount );
+   }
+
+   int64_t Reader::ReadData3DGridRows( int64_t dataIndex, int64_t firstRow, int64_t rowCount,
+                                       const Data3DPointsFloat &grid, unsigned threadCount ) const
+   {
+      return impl_->ReadData3DGridRows( dataIndex, firstRow, rowCount, grid, threadCount );
+   }
+
+   int64_t Reader::ReadData3DGridRows( int64_t dataIndex, int64_t firstRow, int64_t rowCount,
+                                       const Data3DPointsDouble &grid, unsigned threadCount ) const
+   {
+      return impl_->ReadData3DGridRows( dataIndex, firstRow, rowCount, grid, threadCount );
+   }
 } // end namespace e57
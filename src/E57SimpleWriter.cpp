@@ -221,17 +221,32 @@ namespace e57
       return static_cast<int64_t>( written );
    }
 
+   int64_t Writer::WriteImage2DData( int64_t imageIndex, Image2DType imageType,
+                                     Image2DProjection imageProjection, const BlobSource &source,
+                                     int64_t start, int64_t count )
+   {
+      const auto size = static_cast<size_t>( count );
+
+      const size_t written =
+         impl_->WriteImage2DData( imageIndex, imageType, imageProjection, source, start, size );
+
+      return static_cast<int64_t>( written );
+   }
+
+   int64_t Writer::WriteImage2DFile( int64_t imageIndex, Image2DType imageType,
+                                     Image2DProjection imageProjection, const ustring &fileName )
+   {
+      return impl_->WriteImage2DFile( imageIndex, imageType, imageProjection, fileName );
+   }
+
    int64_t Writer::WriteData3DData( Data3D &data3DHeader, const Data3DPointsFloat &buffers )
    {
       _fillMinMaxData( data3DHeader, buffers );
 
       const int64_t scanIndex = impl_->NewData3D( data3DHeader );
 
-      e57::CompressedVectorWriter dataWriter =
-         impl_->SetUpData3DPointsData( scanIndex, data3DHeader.pointCount, buffers );
-
-      dataWriter.write( data3DHeader.pointCount );
-      dataWriter.close();
+      impl_->WriteData3DPoints( scanIndex, data3DHeader.pointCount, buffers );
+      impl_->WriteData3DLevelsOfDetail( scanIndex, data3DHeader.pointCount, buffers );
 
       return scanIndex;
    }
@@ -242,11 +257,18 @@ namespace e57
 
       const int64_t scanIndex = impl_->NewData3D( data3DHeader );
 
-      e57::CompressedVectorWriter dataWriter =
-         impl_->SetUpData3DPointsData( scanIndex, data3DHeader.pointCount, buffers );
+      impl_->WriteData3DPoints( scanIndex, data3DHeader.pointCount, buffers );
+      impl_->WriteData3DLevelsOfDetail( scanIndex, data3DHeader.pointCount, buffers );
+
+      return scanIndex;
+   }
+
+   int64_t Writer::WriteData3DData( Data3D &data3DHeader, const Data3DPointsInterleaved &points )
+   {
+      const int64_t scanIndex = impl_->NewData3D( data3DHeader );
 
-      dataWriter.write( data3DHeader.pointCount );
-      dataWriter.close();
+      impl_->WriteData3DPoints( scanIndex, data3DHeader.pointCount, points );
+      impl_->WriteData3DLevelsOfDetail( scanIndex, data3DHeader.pointCount, points );
 
       return scanIndex;
    }
@@ -268,6 +290,12 @@ namespace e57
       return impl_->SetUpData3DPointsData( dataIndex, pointCount, buffers );
    }
 
+   CompressedVectorWriter Writer::SetUpData3DPointsData( int64_t dataIndex, size_t pointCount,
+                                                         const Data3DPointsInterleaved &points )
+   {
+      return impl_->SetUpData3DPointsData( dataIndex, pointCount, points );
+   }
+
    bool Writer::WriteData3DGroupsData( int64_t dataIndex, size_t groupCount,
                                        int64_t *idElementValue, int64_t *startPointIndex,
                                        int64_t *pointCount )
@@ -0,0 +1,621 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <map>
+
+#include "E57Transcode.h"
+#include "Common.h"
+#include "DeltaCodec.h"
+#include "StringFunctions.h"
+#include "XorCodec.h"
+#include "ZstdCodec.h"
+
+namespace e57
+{
+   namespace
+   {
+      /// One terminal field of a prototype, and how its values are held between the reader and
+      /// the writer
+      struct Field
+      {
+         ustring pathName; ///< relative to the prototype
+         NodeType type;    ///< in the source
+         bool converted;   ///< read and written as scaled doubles
+      };
+
+      /// The buffers one block of records is decoded into and encoded from
+      class Block
+      {
+      public:
+         Block( const ImageFile &source, const ImageFile &dest, const std::vector<Field> &fields,
+                size_t recordCount )
+         {
+            size_t integerCount = 0;
+            size_t realCount = 0;
+            size_t stringCount = 0;
+
+            for ( const auto &field : fields )
+            {
+               if ( field.type == TypeString )
+               {
+                  ++stringCount;
+               }
+               else if ( field.converted || ( field.type == TypeFloat ) )
+               {
+                  ++realCount;
+               }
+               else
+               {
+                  ++integerCount;
+               }
+            }
+
+            // Allocated up front, since the buffers point into them
+            integers_.assign( integerCount, std::vector<int64_t>( recordCount ) );
+            reals_.assign( realCount, std::vector<double>( recordCount ) );
+            strings_.assign( stringCount, std::vector<ustring>( recordCount ) );
+
+            auto integer = integers_.begin();
+            auto real = reals_.begin();
+            auto string = strings_.begin();
+
+            for ( const auto &field : fields )
+            {
+               if ( field.type == TypeString )
+               {
+                  dbufs.emplace_back( source, field.pathName, &*string );
+                  sbufs.emplace_back( dest, field.pathName, &*string );
+                  ++string;
+               }
+               else if ( field.converted || ( field.type == TypeFloat ) )
+               {
+                  // Converted fields go through their scaled values, and the others are only
+                  // widened (Float fields of single precision are exact as doubles)
+                  const bool doScaling = field.converted;
+
+                  dbufs.emplace_back( source, field.pathName, real->data(), recordCount, true,
+                                      doScaling );
+                  sbufs.emplace_back( dest, field.pathName, real->data(), recordCount, true,
+                                      doScaling );
+                  ++real;
+               }
+               else
+               {
+                  // Raw values, so ScaledInteger fields are copied exactly
+                  dbufs.emplace_back( source, field.pathName, integer->data(), recordCount );
+                  sbufs.emplace_back( dest, field.pathName, integer->data(), recordCount );
+                  ++integer;
+               }
+            }
+         }
+
+         std::vector<SourceDestBuffer> dbufs; ///< to read the block into
+         std::vector<SourceDestBuffer> sbufs; ///< to write it from
+
+      private:
+         std::vector<std::vector<int64_t>> integers_;
+         std::vector<std::vector<double>> reals_;
+         std::vector<std::vector<ustring>> strings_;
+      };
+
+      /// Copies the nodes of a source file into a dest file, and then their binary sections
+      class Transcoder
+      {
+      public:
+         Transcoder( const ImageFile &source, ImageFile &dest, const TranscodeOptions &options );
+
+         void run();
+
+      private:
+         /// A CompressedVectorNode copied into dest, whose records are still to be copied
+         struct Section
+         {
+            CompressedVectorNode source;
+            CompressedVectorNode dest;
+            std::vector<Field> fields;
+            bool reencode;
+         };
+
+         /// A copy of @a node in dest, which isn't attached
+         Node copyNode( const Node &node );
+
+         /// A copy of the prototype (or one of its children at @a pathName) of a
+         /// CompressedVector, with its fields converted
+         Node copyPrototype( const Node &node, const ustring &pathName,
+                             std::vector<Field> &fields );
+
+         /// The conversion of @a node (a field of a prototype) to @a conversion
+         Node convertField( const Node &node, const TranscodeFieldConversion &conversion ) const;
+
+         CompressedVectorNode copyCompressedVector( const CompressedVectorNode &node );
+
+         /// Codecs for @a prototype chosen by the options
+         VectorNode makeCodecs( const StructureNode &prototype );
+
+         void copyRecords( const Section &section ) const;
+
+         void copyBlob( BlobNode source, BlobNode dest ) const;
+
+         ImageFile source_;
+         ImageFile dest_;
+         const TranscodeOptions &options_;
+
+         std::map<ustring, const TranscodeFieldConversion *> conversions_;
+
+         std::vector<Section> sections_;
+         std::vector<std::pair<BlobNode, BlobNode>> blobs_;
+      };
+
+      Transcoder::Transcoder( const ImageFile &source, ImageFile &dest,
+                              const TranscodeOptions &options ) :
+         source_( source ), dest_( dest ), options_( options )
+      {
+         if ( options.blockRecordCount == 0 )
+         {
+            throw E57_EXCEPTION2( ErrorBadAPIArgument, "blockRecordCount=0" );
+         }
+
+         for ( const auto &conversion : options.conversions )
+         {
+            if ( ( conversion.type != TypeFloat ) && ( conversion.type != TypeScaledInteger ) )
+            {
+               throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                                     "fieldName=" + conversion.fieldName +
+                                        " type=" + toString( conversion.type ) );
+            }
+
+            if ( !conversions_.emplace( conversion.fieldName, &conversion ).second )
+            {
+               throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                                     "duplicate fieldName=" + conversion.fieldName );
+            }
+         }
+      }
+
+      void Transcoder::run()
+      {
+         for ( size_t i = 0; i < source_.extensionsCount(); ++i )
+         {
+            const ustring prefix = source_.extensionsPrefix( i );
+
+            if ( !dest_.extensionsLookupPrefix( prefix ) )
+            {
+               dest_.extensionsAdd( prefix, source_.extensionsUri( i ) );
+            }
+         }
+
+         const StructureNode sourceRoot = source_.root();
+         StructureNode destRoot = dest_.root();
+
+         for ( int64_t i = 0; i < sourceRoot.childCount(); ++i )
+         {
+            const Node child = sourceRoot.get( i );
+
+            destRoot.set( child.elementName(), copyNode( child ) );
+         }
+
+         // The binary sections can only be written once their nodes are attached
+         for ( const auto &blob : blobs_ )
+         {
+            copyBlob( blob.first, blob.second );
+         }
+
+         for ( const auto &section : sections_ )
+         {
+            if ( section.reencode )
+            {
+               copyRecords( section );
+            }
+            else
+            {
+               CompressedVectorNode dest = section.dest;
+
+               dest.copyFrom( section.source );
+            }
+         }
+      }
+
+      Node Transcoder::copyNode( const Node &node )
+      {
+         switch ( node.type() )
+         {
+            case TypeStructure:
+            {
+               const StructureNode structure( node );
+               StructureNode copy( dest_ );
+
+               for ( int64_t i = 0; i < structure.childCount(); ++i )
+               {
+                  const Node child = structure.get( i );
+
+                  copy.set( child.elementName(), copyNode( child ) );
+               }
+
+               return copy;
+            }
+
+            case TypeVector:
+            {
+               const VectorNode vector( node );
+               VectorNode copy( dest_, vector.allowHeteroChildren() );
+
+               for ( int64_t i = 0; i < vector.childCount(); ++i )
+               {
+                  copy.append( copyNode( vector.get( i ) ) );
+               }
+
+               return copy;
+            }
+
+            case TypeCompressedVector:
+               return copyCompressedVector( CompressedVectorNode( node ) );
+
+            case TypeInteger:
+            {
+               const IntegerNode integer( node );
+
+               return IntegerNode( dest_, integer.value(), integer.minimum(), integer.maximum() );
+            }
+
+            case TypeScaledInteger:
+            {
+               const ScaledIntegerNode scaled( node );
+
+               return ScaledIntegerNode( dest_, scaled.rawValue(), scaled.minimum(),
+                                         scaled.maximum(), scaled.scale(), scaled.offset() );
+            }
+
+            case TypeFloat:
+            {
+               const FloatNode real( node );
+
+               return FloatNode( dest_, real.value(), real.precision(), real.minimum(),
+                                 real.maximum() );
+            }
+
+            case TypeString:
+               return StringNode( dest_, StringNode( node ).value() );
+
+            case TypeBlob:
+            {
+               const BlobNode blob( node );
+               const BlobNode copy( dest_, blob.byteCount() );
+
+               blobs_.emplace_back( blob, copy );
+
+               return copy;
+            }
+
+            default:
+               throw E57_EXCEPTION2( ErrorInternal, "pathName=" + node.pathName() );
+         }
+      }
+
+      Node Transcoder::copyPrototype( const Node &node, const ustring &pathName,
+                                      std::vector<Field> &fields )
+      {
+         const auto childPath = [&pathName]( const ustring &name ) {
+            return pathName.empty() ? name : pathName + "/" + name;
+         };
+
+         switch ( node.type() )
+         {
+            case TypeStructure:
+            {
+               const StructureNode structure( node );
+               StructureNode copy( dest_ );
+
+               for ( int64_t i = 0; i < structure.childCount(); ++i )
+               {
+                  const Node child = structure.get( i );
+
+                  copy.set( child.elementName(),
+                            copyPrototype( child, childPath( child.elementName() ), fields ) );
+               }
+
+               return copy;
+            }
+
+            case TypeVector:
+            {
+               const VectorNode vector( node );
+               VectorNode copy( dest_, vector.allowHeteroChildren() );
+
+               for ( int64_t i = 0; i < vector.childCount(); ++i )
+               {
+                  copy.append( copyPrototype( vector.get( i ), childPath( toString( i ) ),
+                                              fields ) );
+               }
+
+               return copy;
+            }
+
+            case TypeInteger:
+            case TypeScaledInteger:
+            case TypeFloat:
+            {
+               const auto found = conversions_.find( pathName );
+               const bool converted = ( found != conversions_.end() );
+
+               fields.push_back( { pathName, node.type(), converted } );
+
+               return converted ? convertField( node, *found->second ) : copyNode( node );
+            }
+
+            case TypeString:
+               fields.push_back( { pathName, TypeString, false } );
+
+               return copyNode( node );
+
+            default:
+               throw E57_EXCEPTION2( ErrorBadPrototype, "pathName=" + node.pathName() );
+         }
+      }
+
+      Node Transcoder::convertField( const Node &node,
+                                     const TranscodeFieldConversion &conversion ) const
+      {
+         double minimum = conversion.minimum;
+         double maximum = conversion.maximum;
+
+         // The limits of the source field, for those which weren't given
+         double sourceMinimum = 0.0;
+         double sourceMaximum = 0.0;
+
+         switch ( node.type() )
+         {
+            case TypeInteger:
+               sourceMinimum = static_cast<double>( IntegerNode( node ).minimum() );
+               sourceMaximum = static_cast<double>( IntegerNode( node ).maximum() );
+               break;
+
+            case TypeScaledInteger:
+               sourceMinimum = ScaledIntegerNode( node ).scaledMinimum();
+               sourceMaximum = ScaledIntegerNode( node ).scaledMaximum();
+               break;
+
+            default:
+               sourceMinimum = FloatNode( node ).minimum();
+               sourceMaximum = FloatNode( node ).maximum();
+               break;
+         }
+
+         if ( std::isnan( minimum ) )
+         {
+            minimum = sourceMinimum;
+         }
+
+         if ( std::isnan( maximum ) )
+         {
+            maximum = sourceMaximum;
+         }
+
+         const ustring context = "fieldName=" + conversion.fieldName +
+                                 " minimum=" + toString( minimum ) +
+                                 " maximum=" + toString( maximum );
+
+         if ( !( minimum <= maximum ) )
+         {
+            throw E57_EXCEPTION2( ErrorBadAPIArgument, context );
+         }
+
+         if ( conversion.type == TypeFloat )
+         {
+            if ( conversion.precision == PrecisionSingle )
+            {
+               minimum = std::max( minimum, static_cast<double>( FLOAT_MIN ) );
+               maximum = std::min( maximum, static_cast<double>( FLOAT_MAX ) );
+            }
+
+            return FloatNode( dest_, std::min( std::max( 0.0, minimum ), maximum ),
+                              conversion.precision, minimum, maximum );
+         }
+
+         // Raw values must fit in an int64_t, which doubles up to 2^63 do
+         constexpr double cRawLimit = 9.2e18;
+
+         const double rawMinimum = std::floor( ( minimum - conversion.offset ) / conversion.scale );
+         const double rawMaximum = std::ceil( ( maximum - conversion.offset ) / conversion.scale );
+
+         if ( !( conversion.scale > 0.0 ) || !std::isfinite( conversion.offset ) ||
+              !( rawMinimum >= -cRawLimit ) || !( rawMaximum <= cRawLimit ) )
+         {
+            throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                                  context + " scale=" + toString( conversion.scale ) +
+                                     " offset=" + toString( conversion.offset ) );
+         }
+
+         const auto rawMin = static_cast<int64_t>( rawMinimum );
+         const auto rawMax = static_cast<int64_t>( rawMaximum );
+
+         return ScaledIntegerNode( dest_, std::min( std::max( int64_t{ 0 }, rawMin ), rawMax ),
+                                   rawMin, rawMax, conversion.scale, conversion.offset );
+      }
+
+      CompressedVectorNode Transcoder::copyCompressedVector( const CompressedVectorNode &node )
+      {
+         Section section{ node, node, {}, options_.reencode };
+
+         const Node prototype = copyPrototype( node.prototype(), {}, section.fields );
+
+         const bool converted =
+            std::any_of( section.fields.begin(), section.fields.end(),
+                         []( const Field &field ) { return field.converted; } );
+
+         section.reencode = section.reencode || converted;
+
+         VectorNode codecs =
+            ( converted || ( section.reencode && options_.replaceCodecs ) )
+               ? makeCodecs( StructureNode( prototype ) )
+               : VectorNode( copyNode( node.codecs() ) );
+
+         section.dest = CompressedVectorNode( dest_, prototype, codecs );
+
+         sections_.push_back( section );
+
+         return section.dest;
+      }
+
+      VectorNode Transcoder::makeCodecs( const StructureNode &prototype )
+      {
+         VectorNode codecs( dest_, true );
+
+         std::vector<ustring> deltaFields;
+
+         for ( const auto &name : options_.deltaFields )
+         {
+            if ( prototype.isDefined( name ) )
+            {
+               const NodeType type = prototype.get( name ).type();
+
+               if ( ( type == TypeInteger ) || ( type == TypeScaledInteger ) )
+               {
+                  deltaFields.push_back( name );
+               }
+            }
+         }
+
+         if ( !deltaFields.empty() )
+         {
+            addDeltaCodec( dest_, codecs, deltaFields );
+         }
+
+         if ( options_.xorEncodeFloats )
+         {
+            std::vector<ustring> xorFields;
+
+            for ( int64_t i = 0; i < prototype.childCount(); ++i )
+            {
+               const Node field = prototype.get( i );
+
+               if ( field.type() == TypeFloat )
+               {
+                  xorFields.push_back( field.elementName() );
+               }
+            }
+
+            if ( !xorFields.empty() )
+            {
+               addXorCodec( dest_, codecs, xorFields );
+            }
+         }
+
+         if ( options_.zstdLevel != 0 )
+         {
+            std::vector<ustring> zstdFields;
+
+            for ( int64_t i = 0; i < prototype.childCount(); ++i )
+            {
+               zstdFields.push_back( prototype.get( i ).elementName() );
+            }
+
+            addZstdCodec( dest_, codecs, zstdFields, options_.zstdLevel );
+         }
+
+         return codecs;
+      }
+
+      void Transcoder::copyRecords( const Section &section ) const
+      {
+         CompressedVectorReaderOptions readerOptions;
+         readerOptions.decodeThreadCount = options_.readerOptions.decodeThreadCount;
+         readerOptions.readAheadPacketCount = options_.readerOptions.readAheadPacketCount;
+         readerOptions.packetCacheSize = options_.readerOptions.packetCacheSize;
+         readerOptions.progress = options_.readerOptions.progress;
+         readerOptions.progressPacketInterval = options_.readerOptions.progressPacketInterval;
+         readerOptions.cancellation = options_.readerOptions.cancellation;
+
+         CompressedVectorWriterOptions writerOptions = options_.writerOptions;
+         writerOptions.stageInMemory = false;
+
+         const size_t blockRecordCount = static_cast<size_t>(
+            std::min( static_cast<uint64_t>( options_.blockRecordCount ),
+                      std::max( static_cast<uint64_t>( section.source.childCount() ),
+                                uint64_t{ 1 } ) ) );
+
+         Block blocks[2] = { Block( source_, dest_, section.fields, blockRecordCount ),
+                             Block( source_, dest_, section.fields, blockRecordCount ) };
+
+         CompressedVectorNode source = section.source;
+         CompressedVectorNode dest = section.dest;
+
+         CompressedVectorReader reader = source.reader( blocks[0].dbufs, readerOptions );
+         CompressedVectorWriter writer = dest.writer( blocks[0].sbufs, writerOptions );
+
+         std::future<unsigned> pending = reader.readAsync();
+
+         try
+         {
+            for ( size_t current = 0;; current = 1 - current )
+            {
+               const unsigned recordCount = pending.get();
+
+               if ( recordCount == 0 )
+               {
+                  break;
+               }
+
+               // Decode the next block on a background thread while this one is encoded
+               pending = reader.readAsync( blocks[1 - current].dbufs );
+
+               writer.write( blocks[current].sbufs, recordCount );
+            }
+         }
+         catch ( ... )
+         {
+            // The buffers must outlive the read
+            if ( pending.valid() )
+            {
+               pending.wait();
+            }
+
+            throw;
+         }
+
+         writer.close();
+         reader.close();
+      }
+
+      void Transcoder::copyBlob( BlobNode source, BlobNode dest ) const
+      {
+         const unsigned threadCount = options_.blobThreadCount;
+         int64_t start = 0;
+
+         dest.write(
+            [&source, &start, threadCount]( uint8_t *buffer, size_t count ) {
+               source.read( buffer, start, count, threadCount );
+               start += static_cast<int64_t>( count );
+
+               return count;
+            },
+            0, static_cast<size_t>( source.byteCount() ), threadCount );
+      }
+   }
+
+   void transcode( const ImageFile &source, ImageFile &dest, const TranscodeOptions &options )
+   {
+      Transcoder( source, dest, options ).run();
+   }
+
+   void transcode( const ustring &sourcePath, const ustring &destPath,
+                   const TranscodeOptions &options, const ImageFileOptions &fileOptions )
+   {
+      const ImageFile source( sourcePath, "r", fileOptions );
+      ImageFile dest( destPath, "w", fileOptions );
+
+      try
+      {
+         transcode( source, dest, options );
+
+         dest.close();
+      }
+      catch ( ... )
+      {
+         dest.cancel();
+         throw;
+      }
+   }
+}
@@ -0,0 +1,109 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <limits>
+
+#include "Common.h"
+#include "E57TypedReader.h"
+#include "StringFunctions.h"
+
+namespace
+{
+   template <typename T> bool holds( int64_t minimum, int64_t maximum )
+   {
+      using Limits = std::numeric_limits<T>;
+
+      return ( minimum >= static_cast<int64_t>( Limits::min() ) ) &&
+             ( static_cast<uint64_t>( maximum ) <= static_cast<uint64_t>( Limits::max() ) );
+   }
+
+   // Can all the integers in [minimum, maximum] be stored in memory of this type?
+   bool holds( e57::MemoryRepresentation type, int64_t minimum, int64_t maximum )
+   {
+      if ( maximum < 0 )
+      {
+         // Only the minimum needs checking, and the unsigned test in holds<T>() doesn't work
+         maximum = 0;
+      }
+
+      switch ( type )
+      {
+         case e57::Int8:
+            return holds<int8_t>( minimum, maximum );
+         case e57::UInt8:
+            return holds<uint8_t>( minimum, maximum );
+         case e57::Int16:
+            return holds<int16_t>( minimum, maximum );
+         case e57::UInt16:
+            return holds<uint16_t>( minimum, maximum );
+         case e57::Int32:
+            return holds<int32_t>( minimum, maximum );
+         case e57::UInt32:
+            return holds<uint32_t>( minimum, maximum );
+         case e57::Int64:
+            return true;
+         case e57::Bool:
+            return ( minimum >= 0 ) && ( maximum <= 1 );
+         case e57::Real32:
+         case e57::Real64:
+            return true;
+         default:
+            return false;
+      }
+   }
+}
+
+namespace e57
+{
+   NodeType checkTypedField( const CompressedVectorNode &cv, const ustring &name,
+                             MemoryRepresentation type )
+   {
+      const StructureNode proto( cv.prototype() );
+
+      if ( !proto.isDefined( name ) )
+      {
+         throw E57_EXCEPTION2( ErrorPathUndefined,
+                               "cvPathName=" + cv.pathName() + " fieldName=" + name );
+      }
+
+      const Node node = proto.get( name );
+      const bool floatingPoint = ( type == Real32 ) || ( type == Real64 );
+
+      bool ok = false;
+
+      switch ( node.type() )
+      {
+         case TypeInteger:
+         {
+            const IntegerNode integer( node );
+
+            ok = holds( type, integer.minimum(), integer.maximum() );
+            break;
+         }
+
+         case TypeScaledInteger:
+            ok = floatingPoint;
+            break;
+
+         case TypeFloat:
+            ok = ( type == Real64 ) ||
+                 ( ( type == Real32 ) && ( FloatNode( node ).precision() == PrecisionSingle ) );
+            break;
+
+         default:
+            throw E57_EXCEPTION2( ErrorExpectingNumeric,
+                                  "cvPathName=" + cv.pathName() + " fieldName=" + name +
+                                     " nodeType=" + toString( node.type() ) );
+      }
+
+      if ( !ok )
+      {
+         throw E57_EXCEPTION2( ErrorConversionRequired,
+                               "cvPathName=" + cv.pathName() + " fieldName=" + name +
+                                  " nodeType=" + toString( node.type() ) +
+                                  " memoryRepresentation=" + toString( type ) );
+      }
+
+      return node.type();
+   }
+}
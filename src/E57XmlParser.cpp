@@ -29,6 +29,7 @@
 #include <locale>
 #include <sstream>
 
+#include <xercesc/framework/MemBufInputSource.hpp>
 #include <xercesc/sax2/Attributes.hpp>
 #include <xercesc/sax2/XMLReaderFactory.hpp>
 
@@ -42,10 +43,14 @@
 #include "FloatNodeImpl.h"
 #include "ImageFileImpl.h"
 #include "IntegerNodeImpl.h"
+#include "LazyXml.h"
+#include "NodeArena.h"
 #include "ScaledIntegerNodeImpl.h"
 #include "StringFunctions.h"
 #include "StringNodeImpl.h"
+#include "Tracing.h"
 #include "VectorNodeImpl.h"
+#include "XmlReaderPool.h"
 
 using namespace e57;
 using namespace XERCES_CPP_NAMESPACE;
@@ -76,6 +81,9 @@ static const XMLCh att_length[] = { chLatin_l, chLatin_e, chLatin_n, chLatin_g,
 static const XMLCh att_recordCount[] = { chLatin_r, chLatin_e, chLatin_c, chLatin_o,
                                          chLatin_r, chLatin_d, chLatin_C, chLatin_o,
                                          chLatin_u, chLatin_n, chLatin_t, chNull };
+static const XMLCh att_deferred[] = { chLatin_l, chLatin_i, chLatin_b, chLatin_E, chDigit_5,
+                                      chDigit_7, chLatin_D, chLatin_e, chLatin_f, chLatin_e,
+                                      chLatin_r, chLatin_r, chLatin_e, chLatin_d, chNull };
 
 static_assert( std::is_same<size_t, XMLSize_t>::value,
                "size_t and XMLSize_t should be the same type" );
@@ -205,8 +213,7 @@ XMLSize_t E57FileInputStream::readBytes( XMLByte *const toFill, const XMLSize_t
 
    size_t readCount = std::min( maxToRead_size, available_size );
 
-   cf_->seek( logicalPosition_ );
-   cf_->read( reinterpret_cast<char *>( toFill ), readCount ); //??? cast ok?
+   cf_->readAt( logicalPosition_, reinterpret_cast<char *>( toFill ), readCount ); //??? cast ok?
    logicalPosition_ += readCount;
    return ( readCount );
 }
@@ -267,49 +274,44 @@ void E57XmlParser::ParseInfo::dump( int indent, std::ostream &os ) const
 //=============================================================================
 // E57XmlParser
 
-E57XmlParser::E57XmlParser( ImageFileImplSharedPtr imf ) : imf_( imf ), xmlReader( nullptr )
+template <typename T, typename... Args>
+std::shared_ptr<T> E57XmlParser::makeNode( Args &&...args )
 {
+   if ( imf_->nodeArena_ )
+   {
+      return std::allocate_shared<T>( NodeArenaAllocator<T>( imf_->nodeArena_ ), imf_,
+                                      std::forward<Args>( args )... );
+   }
+
+   return std::allocate_shared<T>(
+      MemoryAccountAllocator<T>( imf_->memoryAccount(), MemoryAccount::Nodes ), imf_,
+      std::forward<Args>( args )... );
 }
 
-E57XmlParser::~E57XmlParser()
+E57XmlParser::E57XmlParser( ImageFileImplSharedPtr imf ) :
+   imf_( imf ), deferredXml_( nullptr ), xmlReader( nullptr )
 {
-   delete xmlReader;
-
-   xmlReader = nullptr;
+}
 
-   XMLPlatformUtils::Terminate();
+E57XmlParser::E57XmlParser( ImageFileImplSharedPtr imf,
+                            std::shared_ptr<StructureNodeImpl> fragmentRoot ) :
+   imf_( imf ), fragmentRoot_( fragmentRoot ), deferredXml_( nullptr ), xmlReader( nullptr )
+{
 }
 
-void E57XmlParser::init()
+E57XmlParser::~E57XmlParser()
 {
-   // Initialize the XML4C2 system
-   try
-   {
-      // NOTE: This is not thread safe for multiple simulaneous E57 readers.
-      //       Ideally we'd do this once, not once per reader
-      XMLPlatformUtils::Initialize();
-   }
-   catch ( const XMLException &ex )
-   {
-      // Turn parser exception into E57Exception
-      throw E57_EXCEPTION2( ErrorXMLParserInit,
-                            "parserMessage=" + ustring( XMLString::transcode( ex.getMessage() ) ) );
-   }
+   XmlReaderPool::release( xmlReader, validate_, readerReusable_ );
 
-   xmlReader = XMLReaderFactory::createXMLReader(); //??? auto_ptr?
+   xmlReader = nullptr;
+}
 
-   if ( xmlReader == nullptr )
-   {
-      throw E57_EXCEPTION2( ErrorXMLParserInit, "could not create the xml reader" );
-   }
+void E57XmlParser::init( bool validate )
+{
+   validate_ = validate;
 
-   //??? check these are right
-   xmlReader->setFeature( XMLUni::fgSAX2CoreValidation, true );
-   xmlReader->setFeature( XMLUni::fgXercesDynamic, true );
-   xmlReader->setFeature( XMLUni::fgSAX2CoreNameSpaces, true );
-   xmlReader->setFeature( XMLUni::fgXercesSchema, true );
-   xmlReader->setFeature( XMLUni::fgXercesSchemaFullChecking, true );
-   xmlReader->setFeature( XMLUni::fgSAX2CoreNameSpacePrefixes, true );
+   xmlReader = XmlReaderPool::acquire( validate );
+   readerReusable_ = true;
 
    xmlReader->setContentHandler( this );
    xmlReader->setErrorHandler( this );
@@ -317,7 +319,38 @@ void E57XmlParser::init()
 
 void E57XmlParser::parse( InputSource &inputSource )
 {
+#ifdef E57_ENABLE_TRACING
+   TraceScope trace( "E57XmlParser::parse" );
+#endif
+
+   // A reader stopped partway through by an exception isn't trusted with another file
+   readerReusable_ = false;
+
    xmlReader->parse( inputSource );
+
+   readerReusable_ = true;
+}
+
+void E57XmlParser::parse( const std::string &xml )
+{
+#ifdef E57_ENABLE_TRACING
+   TraceScope trace( "E57XmlParser::parse", xml.size() );
+#endif
+
+   MemBufInputSource inputSource( reinterpret_cast<const XMLByte *>( xml.data() ), xml.size(),
+                                  "E57File" );
+
+   // A reader stopped partway through by an exception isn't trusted with another file
+   readerReusable_ = false;
+
+   xmlReader->parse( inputSource );
+
+   readerReusable_ = true;
+}
+
+void E57XmlParser::setDeferredXml( std::vector<std::string> &fragments )
+{
+   deferredXml_ = &fragments;
 }
 
 void E57XmlParser::startElement( const XMLCh *const uri, const XMLCh *const localName,
@@ -587,10 +620,33 @@ void E57XmlParser::startElement( const XMLCh *const uri, const XMLCh *const loca
          }
       }
 
-      // Create container now, so can hold children
-      std::shared_ptr<StructureNodeImpl> s_ni( new StructureNodeImpl( imf_ ) );
+      // Create container now, so can hold children. The top element of a fragment stands for
+      // the structure it was cut out of.
+      std::shared_ptr<StructureNodeImpl> s_ni;
+      if ( stack_.empty() && fragmentRoot_ )
+      {
+         s_ni = fragmentRoot_;
+      }
+      else
+      {
+         s_ni = makeNode<StructureNodeImpl>();
+      }
       pi.container_ni = s_ni;
 
+      // If the children were cut out of the document, hand them to the structure to parse later
+      if ( ( deferredXml_ != nullptr ) && isAttributeDefined( attributes, att_deferred ) )
+      {
+         const int64_t index = convertStrToLL( lookupAttribute( attributes, att_deferred ) );
+
+         if ( ( index < 0 ) || ( index >= static_cast<int64_t>( deferredXml_->size() ) ) )
+         {
+            throw E57_EXCEPTION2( ErrorInternal, "deferredIndex=" + toString( index ) +
+                                                    " fileName=" + imf_->fileName() );
+         }
+
+         s_ni->setDeferredXml( std::move( deferredXml_->at( static_cast<size_t>( index ) ) ) );
+      }
+
       // After have Structure, check again if E57Root, if so mark attached so all children will be
       // attached when added
       if ( toUString( localName ) == "e57Root" )
@@ -637,8 +693,8 @@ void E57XmlParser::startElement( const XMLCh *const uri, const XMLCh *const loca
       }
 
       // Create container now, so can hold children
-      std::shared_ptr<VectorNodeImpl> v_ni(
-         new VectorNodeImpl( imf_, pi.allowHeterogeneousChildren ) );
+      std::shared_ptr<VectorNodeImpl> v_ni =
+         makeNode<VectorNodeImpl>( pi.allowHeterogeneousChildren );
       pi.container_ni = v_ni;
 
       stack_.push( pi );
@@ -661,7 +717,7 @@ void E57XmlParser::startElement( const XMLCh *const uri, const XMLCh *const loca
       pi.recordCount = convertStrToLL( recordCount_str );
 
       // Create container now, so can hold children
-      std::shared_ptr<CompressedVectorNodeImpl> cv_ni( new CompressedVectorNodeImpl( imf_ ) );
+      std::shared_ptr<CompressedVectorNodeImpl> cv_ni = makeNode<CompressedVectorNodeImpl>();
       cv_ni->setRecordCount( pi.recordCount );
       cv_ni->setBinarySectionLogicalStart(
          imf_->file_->physicalToLogical( pi.fileOffset ) ); //??? what if file_ is NULL?
@@ -723,8 +779,8 @@ void E57XmlParser::endElement( const XMLCh *const uri, const XMLCh *const localN
             foundValue = true;
          }
 
-         std::shared_ptr<IntegerNodeImpl> i_ni(
-            new IntegerNodeImpl( imf_, intValue, pi.minimum, pi.maximum ) );
+         std::shared_ptr<IntegerNodeImpl> i_ni =
+            makeNode<IntegerNodeImpl>( intValue, pi.minimum, pi.maximum );
 
          if ( foundValue )
          {
@@ -746,8 +802,8 @@ void E57XmlParser::endElement( const XMLCh *const uri, const XMLCh *const localN
             foundValue = true;
          }
 
-         std::shared_ptr<ScaledIntegerNodeImpl> si_ni( new ScaledIntegerNodeImpl(
-            imf_, intValue, pi.minimum, pi.maximum, pi.scale, pi.offset ) );
+         std::shared_ptr<ScaledIntegerNodeImpl> si_ni = makeNode<ScaledIntegerNodeImpl>(
+            intValue, pi.minimum, pi.maximum, pi.scale, pi.offset );
 
          if ( foundValue )
          {
@@ -769,8 +825,8 @@ void E57XmlParser::endElement( const XMLCh *const uri, const XMLCh *const localN
             foundValue = true;
          }
 
-         std::shared_ptr<FloatNodeImpl> f_ni(
-            new FloatNodeImpl( imf_, floatValue, pi.precision, pi.floatMinimum, pi.floatMaximum ) );
+         std::shared_ptr<FloatNodeImpl> f_ni = makeNode<FloatNodeImpl>(
+            floatValue, pi.precision, pi.floatMinimum, pi.floatMaximum );
 
          if ( foundValue )
          {
@@ -782,13 +838,13 @@ void E57XmlParser::endElement( const XMLCh *const uri, const XMLCh *const localN
       break;
       case TypeString:
       {
-         std::shared_ptr<StringNodeImpl> s_ni( new StringNodeImpl( imf_, pi.childText ) );
+         std::shared_ptr<StringNodeImpl> s_ni = makeNode<StringNodeImpl>( pi.childText );
          current_ni = s_ni;
       }
       break;
       case TypeBlob:
       {
-         std::shared_ptr<BlobNodeImpl> b_ni( new BlobNodeImpl( imf_, pi.fileOffset, pi.length ) );
+         std::shared_ptr<BlobNodeImpl> b_ni = makeNode<BlobNodeImpl>( pi.fileOffset, pi.length );
          current_ni = b_ni;
       }
       break;
@@ -814,7 +870,11 @@ void E57XmlParser::endElement( const XMLCh *const uri, const XMLCh *const localN
                                                      " localName=" + toUString( localName ) +
                                                      " qName=" + toUString( qName ) );
       }
-      imf_->root_ = std::static_pointer_cast<StructureNodeImpl>( current_ni );
+      // A fragment's children have already been added to the structure it belongs to
+      if ( !fragmentRoot_ )
+      {
+         imf_->root_ = std::static_pointer_cast<StructureNodeImpl>( current_ni );
+      }
       return;
    }
 
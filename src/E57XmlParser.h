@@ -44,16 +44,28 @@ namespace XERCES_CPP_NAMESPACE
 namespace e57
 {
    class CheckedFile;
+   class StructureNodeImpl;
 
    class E57XmlParser : public DefaultHandler
    {
    public:
       explicit E57XmlParser( ImageFileImplSharedPtr imf );
+
+      /// Parse the children of @a fragmentRoot, which were cut out of the XML section by
+      /// pruneXml(). The top element of the document is taken to be fragmentRoot.
+      E57XmlParser( ImageFileImplSharedPtr imf, std::shared_ptr<StructureNodeImpl> fragmentRoot );
+
       ~E57XmlParser() override;
 
-      void init();
+      /// Take a SAX2 reader from the XmlReaderPool. @a validate turns on the parser's validation
+      /// and schema processing (see ImageFileOptions::validateXml).
+      void init( bool validate = true );
 
       void parse( InputSource &inputSource );
+      void parse( const std::string &xml );
+
+      /// Give the XML pruneXml() cut out of the document to the structures it came from.
+      void setDeferredXml( std::vector<std::string> &fragments );
 
    private:
       /// SAX interface
@@ -67,8 +79,14 @@ namespace e57
       void error( const SAXParseException &ex ) override;
       void fatalError( const SAXParseException &ex ) override;
 
+      /// Create a node, from the image file's NodeArena if it has one
+      template <typename T, typename... Args> std::shared_ptr<T> makeNode( Args &&...args );
+
       ImageFileImplSharedPtr imf_; /// Image file we are reading
 
+      std::shared_ptr<StructureNodeImpl> fragmentRoot_; /// Set if parsing deferred XML
+      std::vector<std::string> *deferredXml_;           /// Set if the document was pruned
+
       struct ParseInfo
       {
          // All the fields need to remember while parsing the XML
@@ -100,6 +118,8 @@ namespace e57
       std::stack<ParseInfo> stack_; /// Stores the current path in tree we are reading
 
       SAX2XMLReader *xmlReader;
+      bool validate_ = true;
+      bool readerReusable_ = false; /// Whether xmlReader can go back to the XmlReaderPool
    };
 
    class E57XmlFileInputSource : public InputSource
@@ -26,9 +26,12 @@
  */
 
 #include <algorithm>
+#include <cstdint>
 #include <cstring>
 
+#include "BitpackKernels.h"
 #include "CompressedVectorNodeImpl.h"
+#include "DeltaCodec.h"
 #include "Encoder.h"
 #include "FloatNodeImpl.h"
 #include "ImageFileImpl.h"
@@ -37,13 +40,208 @@
 #include "ScaledIntegerNodeImpl.h"
 #include "SourceDestBufferImpl.h"
 #include "StringFunctions.h"
+#include "XorCodec.h"
+#include "ZstdCodec.h"
 
 using namespace e57;
 
-std::shared_ptr<Encoder> Encoder::EncoderFactory( unsigned bytestreamNumber,
-                                                  std::shared_ptr<CompressedVectorNodeImpl> cVector,
-                                                  std::vector<SourceDestBuffer> &sbufs,
-                                                  ustring & /*codecPath*/ )
+namespace
+{
+   // Number of values BitpackIntegerEncoder packs at a time.
+   constexpr size_t cPackBlockSize = 256;
+
+   // Most bytes a 64-bit value takes as a LEB128 varint
+   constexpr size_t cMaxVarintSize = 10;
+
+   // Write value as a LEB128 varint at outp, and move outp past it
+   inline void writeVarint( uint8_t *&outp, uint64_t value )
+   {
+      while ( value >= 0x80 )
+      {
+         *outp++ = static_cast<uint8_t>( value | 0x80 );
+         value >>= 7;
+      }
+      *outp++ = static_cast<uint8_t>( value );
+   }
+
+   // Fields whose limits are inside +/- this can be checked exactly with the double precision
+   // range of their values, so only their values can skip being checked as they are encoded.
+   constexpr int64_t cExactDoubleLimit = int64_t{ 1 } << 53;
+
+   bool exactInDouble( int64_t minimum, int64_t maximum )
+   {
+      return ( -cExactDoubleLimit <= minimum ) && ( maximum <= cExactDoubleLimit );
+   }
+
+   // Enforce min/max specification on values (unless they have already been checked), and
+   // subtract the minimum to get what is packed.
+   template <typename T, typename RawT>
+   void subtractMinimum( const T *values, size_t count, int64_t minimum, int64_t maximum,
+                         bool checkBounds, RawT *raw )
+   {
+      if ( !checkBounds )
+      {
+         for ( size_t i = 0; i < count; ++i )
+         {
+            raw[i] = static_cast<RawT>( static_cast<uint64_t>( values[i] ) -
+                                        static_cast<uint64_t>( minimum ) );
+         }
+
+         return;
+      }
+
+      bool inBounds = true;
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         const auto value = static_cast<int64_t>( values[i] );
+
+         inBounds &= ( minimum <= value ) && ( value <= maximum );
+
+         raw[i] =
+            static_cast<RawT>( static_cast<uint64_t>( value ) - static_cast<uint64_t>( minimum ) );
+      }
+
+      if ( inBounds )
+      {
+         return;
+      }
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         const auto value = static_cast<int64_t>( values[i] );
+
+         if ( value < minimum || maximum < value )
+         {
+            throw E57_EXCEPTION2( ErrorValueOutOfBounds, "rawValue=" + toString( value ) +
+                                                            " minimum=" + toString( minimum ) +
+                                                            " maximum=" + toString( maximum ) );
+         }
+      }
+   }
+
+   // If the source is a plain array of T, read the values straight from it.
+   template <typename T, typename RawT>
+   bool readDirect( SourceDestBufferImpl &sbuf, size_t count, int64_t minimum, int64_t maximum,
+                    bool checkBounds, RawT *raw )
+   {
+      if ( sbuf.stride() != sizeof( T ) )
+      {
+         return false;
+      }
+
+      const T *values = reinterpret_cast<const T *>( sbuf.nextElements( count ) );
+
+      subtractMinimum( values, count, minimum, maximum, checkBounds, raw );
+
+      return true;
+   }
+
+   // If the source is a PackedBits buffer whose values have as many bits as they are stored with,
+   // and nothing is subtracted from them, copy the bits of the next count values straight to
+   // bit firstBit of out instead of packing them again.
+   bool copyBitsDirect( SourceDestBufferImpl &sbuf, bool isScaledInteger, int64_t minimum,
+                        int64_t maximum, bool checkBounds, unsigned bitsPerRecord, size_t count,
+                        size_t firstBit, char *out )
+   {
+      if ( ( sbuf.memoryRepresentation() != Bits ) || ( isScaledInteger && sbuf.doScaling() ) ||
+           ( minimum != 0 ) || ( sbuf.stride() != bitsPerRecord ) )
+      {
+         return false;
+      }
+
+      const size_t first = sbuf.nextIndex();
+      const PackedBits bits = sbuf.packedBits();
+
+      // Values above maximum (e.g. 3 in a 2 bit field from 0 to 2) still fit in the bits
+      if ( checkBounds && ( maximum < bits.maximum() ) )
+      {
+         for ( size_t i = 0; i < count; ++i )
+         {
+            const int64_t value = bits.get( first + i );
+
+            if ( value > maximum )
+            {
+               throw E57_EXCEPTION2( ErrorValueOutOfBounds, "rawValue=" + toString( value ) +
+                                                               " minimum=" + toString( minimum ) +
+                                                               " maximum=" + toString( maximum ) );
+            }
+         }
+      }
+
+      sbuf.skipNext( count );
+
+      copyBits( reinterpret_cast<const char *>( bits.data ), first * bitsPerRecord, out, firstBit,
+                count * bitsPerRecord );
+
+      return true;
+   }
+
+   // Get the next count (<= cPackBlockSize) values from sbuf ready for packing.
+   template <typename RawT>
+   void readRawValues( SourceDestBufferImpl &sbuf, bool isScaledInteger, double scale,
+                       double offset, int64_t minimum, int64_t maximum, bool checkBounds,
+                       size_t count, RawT *raw )
+   {
+      // Integer arrays which don't need scaling can be read without going through
+      // getNextInt64() for each value.
+      if ( !isScaledInteger || !sbuf.doScaling() )
+      {
+         bool done = false;
+
+         switch ( sbuf.memoryRepresentation() )
+         {
+            case Int8:
+               done = readDirect<int8_t>( sbuf, count, minimum, maximum, checkBounds, raw );
+               break;
+            case UInt8:
+               done = readDirect<uint8_t>( sbuf, count, minimum, maximum, checkBounds, raw );
+               break;
+            case Int16:
+               done = readDirect<int16_t>( sbuf, count, minimum, maximum, checkBounds, raw );
+               break;
+            case UInt16:
+               done = readDirect<uint16_t>( sbuf, count, minimum, maximum, checkBounds, raw );
+               break;
+            case Int32:
+               done = readDirect<int32_t>( sbuf, count, minimum, maximum, checkBounds, raw );
+               break;
+            case UInt32:
+               done = readDirect<uint32_t>( sbuf, count, minimum, maximum, checkBounds, raw );
+               break;
+            case Int64:
+               done = readDirect<int64_t>( sbuf, count, minimum, maximum, checkBounds, raw );
+               break;
+            default:
+               // Bool and the floating point types need converting
+               break;
+         }
+
+         if ( done )
+         {
+            return;
+         }
+      }
+
+      int64_t values[cPackBlockSize];
+
+      // The parameter isScaledInteger determines which version of getNextInt64s gets called
+      if ( isScaledInteger )
+      {
+         sbuf.getNextInt64s( values, count, scale, offset );
+      }
+      else
+      {
+         sbuf.getNextInt64s( values, count );
+      }
+
+      subtractMinimum( values, count, minimum, maximum, checkBounds, raw );
+   }
+}
+
+std::shared_ptr<Encoder> Encoder::fieldEncoder(
+   unsigned bytestreamNumber, const std::shared_ptr<CompressedVectorNodeImpl> &cVector,
+   std::vector<SourceDestBuffer> &sbufs )
 {
    //??? For now, only handle one input
    if ( sbufs.size() != 1 )
@@ -62,6 +260,27 @@ std::shared_ptr<Encoder> Encoder::EncoderFactory( unsigned bytestreamNumber,
    std::cout << "Node to encode:" << std::endl; //???
    encodeNode->dump( 2 );
 #endif
+
+   uint64_t deltaResetInterval = 0;
+   const bool isDelta = findDeltaCodec( *cVector, path, deltaResetInterval );
+
+   // The delta codec only handles integers
+   if ( isDelta && encodeNode->type() != TypeInteger && encodeNode->type() != TypeScaledInteger )
+   {
+      throw E57_EXCEPTION2( ErrorBadCodecs,
+                            "pathName=" + path + " nodeType=" + toString( encodeNode->type() ) );
+   }
+
+   uint64_t xorResetInterval = 0;
+   const bool isXor = findXorCodec( *cVector, path, xorResetInterval );
+
+   // ...and the XOR codec only floats
+   if ( isXor && encodeNode->type() != TypeFloat )
+   {
+      throw E57_EXCEPTION2( ErrorBadCodecs,
+                            "pathName=" + path + " nodeType=" + toString( encodeNode->type() ) );
+   }
+
    switch ( encodeNode->type() )
    {
       case TypeInteger:
@@ -88,6 +307,14 @@ std::shared_ptr<Encoder> Encoder::EncoderFactory( unsigned bytestreamNumber,
             return encoder;
          }
 
+         if ( isDelta )
+         {
+            std::shared_ptr<Encoder> encoder( new DeltaIntegerEncoder(
+               false, bytestreamNumber, sbuf, DATA_PACKET_MAX /*!!!*/, ini->minimum(),
+               ini->maximum(), 1.0, 0.0, deltaResetInterval ) );
+            return encoder;
+         }
+
          if ( bitsPerRecord <= 8 )
          {
             std::shared_ptr<Encoder> encoder( new BitpackIntegerEncoder<uint8_t>(
@@ -143,6 +370,14 @@ std::shared_ptr<Encoder> Encoder::EncoderFactory( unsigned bytestreamNumber,
             return encoder;
          }
 
+         if ( isDelta )
+         {
+            std::shared_ptr<Encoder> encoder( new DeltaIntegerEncoder(
+               true, bytestreamNumber, sbuf, DATA_PACKET_MAX /*!!!*/, sini->minimum(),
+               sini->maximum(), sini->scale(), sini->offset(), deltaResetInterval ) );
+            return encoder;
+         }
+
          if ( bitsPerRecord <= 8 )
          {
             std::shared_ptr<Encoder> encoder( new BitpackIntegerEncoder<uint8_t>(
@@ -178,6 +413,14 @@ std::shared_ptr<Encoder> Encoder::EncoderFactory( unsigned bytestreamNumber,
          std::shared_ptr<FloatNodeImpl> fni =
             std::static_pointer_cast<FloatNodeImpl>( encodeNode ); // downcast to correct type
 
+         if ( isXor )
+         {
+            std::shared_ptr<Encoder> encoder( new XorFloatEncoder(
+               bytestreamNumber, sbuf, DATA_PACKET_MAX /*!!!*/, fni->precision(),
+               xorResetInterval ) );
+            return encoder;
+         }
+
          // !!! need to pick smarter channel buffer sizes, here and elsewhere
          std::shared_ptr<Encoder> encoder( new BitpackFloatEncoder(
             bytestreamNumber, sbuf, DATA_PACKET_MAX /*!!!*/, fni->precision() ) );
@@ -199,6 +442,22 @@ std::shared_ptr<Encoder> Encoder::EncoderFactory( unsigned bytestreamNumber,
    }
 }
 
+std::shared_ptr<Encoder> Encoder::EncoderFactory( unsigned bytestreamNumber,
+                                                  std::shared_ptr<CompressedVectorNodeImpl> cVector,
+                                                  std::vector<SourceDestBuffer> &sbufs,
+                                                  ustring & /*codecPath*/ )
+{
+   std::shared_ptr<Encoder> encoder = fieldEncoder( bytestreamNumber, cVector, sbufs );
+
+   int zstdLevel = 0;
+   if ( findZstdCodec( *cVector, sbufs.at( 0 ).pathName(), zstdLevel ) )
+   {
+      return zstdEncoder( encoder, zstdLevel );
+   }
+
+   return encoder;
+}
+
 Encoder::Encoder( unsigned bytestreamNumber ) : bytestreamNumber_( bytestreamNumber )
 {
 }
@@ -324,6 +583,13 @@ void BitpackEncoder::outBufferShiftDown()
       return;
    }
 
+   // Only move the data once it reaches into the back half of outBuffer_, so most calls don't
+   // move anything. outBufferEnd_ is already on a natural boundary.
+   if ( outBuffer_.size() - outBufferEnd_ >= outBuffer_.size() / 2 )
+   {
+      return;
+   }
+
    // Round newEnd up to nearest multiple of outBufferAlignmentSize_.
    size_t newEnd = outputAvailable();
    size_t remainder = newEnd % outBufferAlignmentSize_;
@@ -433,13 +699,14 @@ uint64_t BitpackFloatEncoder::processRecords( size_t recordCount )
       auto outp = reinterpret_cast<float *>( &outBuffer_[outBufferEnd_] );
 
       // Copy floats from sourceBuffer_ to outBuffer_
+      sourceBuffer_->getNextFloats( outp, recordCount, checkValues_ );
+
+#ifdef E57_VERBOSE
       for ( unsigned i = 0; i < recordCount; i++ )
       {
-         outp[i] = sourceBuffer_->getNextFloat();
-#ifdef E57_VERBOSE
          std::cout << "encoding float: " << outp[i] << std::endl;
-#endif
       }
+#endif
    }
    else
    {
@@ -448,13 +715,14 @@ uint64_t BitpackFloatEncoder::processRecords( size_t recordCount )
       auto outp = reinterpret_cast<double *>( &outBuffer_[outBufferEnd_] );
 
       // Copy doubles from sourceBuffer_ to outBuffer_
+      sourceBuffer_->getNextDoubles( outp, recordCount );
+
+#ifdef E57_VERBOSE
       for ( unsigned i = 0; i < recordCount; i++ )
       {
-         outp[i] = sourceBuffer_->getNextDouble();
-#ifdef E57_VERBOSE
          std::cout << "encoding double: " << outp[i] << std::endl;
-#endif
       }
+#endif
    }
 
    // Update end of outBuffer
@@ -477,6 +745,16 @@ float BitpackFloatEncoder::bitsPerRecord()
    return ( ( precision_ == PrecisionSingle ) ? 32.0F : 64.0F );
 }
 
+size_t BitpackFloatEncoder::maxOutputForRecords( size_t recordCount ) const
+{
+   return recordCount * ( ( precision_ == PrecisionSingle ) ? sizeof( float ) : sizeof( double ) );
+}
+
+void BitpackFloatEncoder::skipValueChecks()
+{
+   checkValues_ = false;
+}
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
 void BitpackFloatEncoder::dump( int indent, std::ostream &os ) const
 {
@@ -497,7 +775,8 @@ void BitpackFloatEncoder::dump( int indent, std::ostream &os ) const
 BitpackStringEncoder::BitpackStringEncoder( unsigned bytestreamNumber, SourceDestBuffer &sbuf,
                                             unsigned outputMaxSize ) :
    BitpackEncoder( bytestreamNumber, sbuf, outputMaxSize, 1 ), totalBytesProcessed_( 0 ),
-   isStringActive_( false ), prefixComplete_( false ), currentCharPosition_( 0 )
+   isStringActive_( false ), prefixComplete_( false ), currentString_( nullptr ),
+   currentStringLength_( 0 ), currentCharPosition_( 0 )
 {
 }
 
@@ -525,14 +804,14 @@ uint64_t BitpackStringEncoder::processRecords( size_t recordCount )
       if ( isStringActive_ && !prefixComplete_ )
       {
          // Calc the length prefix, either 1 byte or 8 bytes
-         size_t len = currentString_.length();
+         size_t len = currentStringLength_;
          if ( len <= 127 )
          {
 #ifdef E57_VERBOSE
             std::cout << "encoding short string: (len=" << len
                       << ") "
                          ""
-                      << currentString_
+                      << ustring( currentString_, currentStringLength_ )
                       << ""
                          ""
                       << std::endl;
@@ -555,7 +834,7 @@ uint64_t BitpackStringEncoder::processRecords( size_t recordCount )
             std::cout << "encoding long string: (len=" << len
                       << ") "
                          ""
-                      << currentString_
+                      << ustring( currentString_, currentStringLength_ )
                       << ""
                          ""
                       << std::endl;
@@ -580,19 +859,17 @@ uint64_t BitpackStringEncoder::processRecords( size_t recordCount )
       {
          // Copy as much string as will fit in outBuffer
          size_t bytesToProcess =
-            std::min( currentString_.length() - currentCharPosition_, bytesFree );
+            std::min( currentStringLength_ - currentCharPosition_, bytesFree );
 
-         for ( size_t i = 0; i < bytesToProcess; i++ )
-         {
-            *outp++ = currentString_[currentCharPosition_ + i];
-         }
+         memcpy( outp, currentString_ + currentCharPosition_, bytesToProcess );
+         outp += bytesToProcess;
 
          currentCharPosition_ += bytesToProcess;
          totalBytesProcessed_ += bytesToProcess;
          bytesFree -= bytesToProcess;
 
          // Check if finished string
-         if ( currentCharPosition_ == currentString_.length() )
+         if ( currentCharPosition_ == currentStringLength_ )
          {
             isStringActive_ = false;
             recordsProcessed++;
@@ -600,13 +877,14 @@ uint64_t BitpackStringEncoder::processRecords( size_t recordCount )
       }
       if ( !isStringActive_ && recordsProcessed < recordCount )
       {
-         // Get next string from sourceBuffer
-         currentString_ = sourceBuffer_->getNextString();
+         // Get next string from sourceBuffer. It isn't copied: its characters stay put until
+         // the write() which uses them returns, and this string is finished by then.
+         currentString_ = sourceBuffer_->getNextString( currentStringLength_ );
          isStringActive_ = true;
          prefixComplete_ = false;
          currentCharPosition_ = 0;
 #ifdef E57_VERBOSE
-         std::cout << "getting next string, length=" << currentString_.length() << std::endl;
+         std::cout << "getting next string, length=" << currentStringLength_ << std::endl;
 #endif
       }
    }
@@ -638,6 +916,12 @@ float BitpackStringEncoder::bitsPerRecord()
    return 100 * 8.0f;
 }
 
+size_t BitpackStringEncoder::maxOutputForRecords( size_t /*recordCount*/ ) const
+{
+   // Depends on the lengths of the strings
+   return SIZE_MAX;
+}
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
 void BitpackStringEncoder::dump( int indent, std::ostream &os ) const
 {
@@ -645,7 +929,9 @@ void BitpackStringEncoder::dump( int indent, std::ostream &os ) const
    os << space( indent ) << "totalBytesProcessed:    " << totalBytesProcessed_ << std::endl;
    os << space( indent ) << "isStringActive:         " << isStringActive_ << std::endl;
    os << space( indent ) << "prefixComplete:         " << prefixComplete_ << std::endl;
-   os << space( indent ) << "currentString:          " << currentString_ << std::endl;
+   os << space( indent ) << "currentString:          "
+      << ( currentString_ ? ustring( currentString_, currentStringLength_ ) : ustring() )
+      << std::endl;
    os << space( indent ) << "currentCharPosition:    " << currentCharPosition_ << std::endl;
 }
 #endif
@@ -667,6 +953,7 @@ BitpackIntegerEncoder<RegisterT>::BitpackIntegerEncoder(
    scale_ = scale;
    offset_ = offset;
    bitsPerRecord_ = imf->bitsNeeded( minimum_, maximum_ );
+   packer_ = BitPacker( bitsPerRecord_ );
    sourceBitMask_ = ( bitsPerRecord_ == 64 ) ? ~0 : ( 1ULL << bitsPerRecord_ ) - 1;
    registerBitsUsed_ = 0;
    register_ = 0;
@@ -720,107 +1007,69 @@ uint64_t BitpackIntegerEncoder<RegisterT>::processRecords( size_t recordCount )
 #endif
 
    // Form the starting address for next available location in outBuffer
-   auto outp = reinterpret_cast<RegisterT *>( &outBuffer_[outBufferEnd_] );
-   unsigned outTransferred = 0;
+   char *outp = &outBuffer_[outBufferEnd_];
+   size_t outTransferred = 0;
 
-   // Copy bits from sourceBuffer_ to outBuffer_
-   for ( unsigned i = 0; i < recordCount; i++ )
+   // Values are packed a block at a time after whatever is left in register_, then the whole
+   // registers are copied to outBuffer_ and the rest goes back in register_.
+   char packed[sizeof( RegisterT ) + cPackBlockSize * sizeof( uint64_t ) + 16];
+
+   for ( size_t done = 0; done < recordCount; done += cPackBlockSize )
    {
-      int64_t rawValue;
+      const size_t n = std::min( cPackBlockSize, recordCount - done );
+
+      memcpy( packed, &register_, sizeof( RegisterT ) );
 
-      // The parameter isScaledInteger_ determines which version of getNextInt64 gets called
-      if ( isScaledInteger_ )
+      if ( copyBitsDirect( *sourceBuffer_, isScaledInteger_, minimum_, maximum_, checkValues_,
+                           bitsPerRecord_, n, registerBitsUsed_, packed ) )
       {
-         rawValue = sourceBuffer_->getNextInt64( scale_, offset_ );
+         // The values were already packed
       }
-      else
+      else if ( bitsPerRecord_ <= 32 )
       {
-         rawValue = sourceBuffer_->getNextInt64();
-      }
+         uint32_t raw[cPackBlockSize];
 
-      // Enforce min/max specification on value
-      if ( rawValue < minimum_ || maximum_ < rawValue )
+         readRawValues( *sourceBuffer_, isScaledInteger_, scale_, offset_, minimum_, maximum_,
+                        checkValues_, n, raw );
+         packer_.pack( raw, n, registerBitsUsed_, packed );
+      }
+      else
       {
-         throw E57_EXCEPTION2( ErrorValueOutOfBounds, "rawValue=" + toString( rawValue ) +
-                                                         " minimum=" + toString( minimum_ ) +
-                                                         " maximum=" + toString( maximum_ ) );
+         uint64_t raw[cPackBlockSize];
+
+         readRawValues( *sourceBuffer_, isScaledInteger_, scale_, offset_, minimum_, maximum_,
+                        checkValues_, n, raw );
+         packer_.pack( raw, n, registerBitsUsed_, packed );
       }
 
-      auto uValue = static_cast<uint64_t>( rawValue - minimum_ );
+      const size_t bitCount = registerBitsUsed_ + n * bitsPerRecord_;
+      const size_t registerCount = bitCount / ( 8 * sizeof( RegisterT ) );
 
-#ifdef E57_VERBOSE
-      std::cout << "encoding integer rawValue=" << binaryString( rawValue ) << " = "
-                << hexString( rawValue ) << std::endl;
-      std::cout << "                 uValue  =" << binaryString( uValue ) << " = "
-                << hexString( uValue ) << std::endl;
-#endif
 #ifdef VALIDATE_BASIC
-      // Double check that no bits outside of the mask are set
-      if ( uValue & ~static_cast<uint64_t>( sourceBitMask_ ) )
+      // Before transfer, double check address within bounds
+      if ( outTransferred + registerCount > transferMax )
       {
-         throw E57_EXCEPTION2( ErrorInternal, "uValue=" + toString( uValue ) );
+         throw E57_EXCEPTION2( ErrorInternal, "outTransferred=" + toString( outTransferred ) +
+                                                 " registerCount=" + toString( registerCount ) +
+                                                 " transferMax" + toString( transferMax ) );
       }
 #endif
-      // Mask off upper bits (just in case)
-      uValue &= static_cast<uint64_t>( sourceBitMask_ );
-
-      // See if uValue bits will fit in register
-      unsigned newRegisterBitsUsed = registerBitsUsed_ + bitsPerRecord_;
-#ifdef E57_VERBOSE
-      std::cout << "  registerBitsUsed=" << registerBitsUsed_
-                << "  newRegisterBitsUsed=" << newRegisterBitsUsed << std::endl;
-#endif
-      if ( newRegisterBitsUsed > 8 * sizeof( RegisterT ) )
-      {
-         // Have more than one registers worth, fill register, transfer, then fill some more
-         register_ |= static_cast<RegisterT>( uValue ) << registerBitsUsed_;
-#ifdef VALIDATE_BASIC
-         // Before transfer, double check address within bounds
-         if ( outTransferred >= transferMax )
-         {
-            throw E57_EXCEPTION2( ErrorInternal, "outTransferred=" + toString( outTransferred ) +
-                                                    " transferMax" + toString( transferMax ) );
-         }
-#endif
-         outp[outTransferred] = register_;
-
-         outTransferred++;
+      memcpy( outp + outTransferred * sizeof( RegisterT ), packed,
+              registerCount * sizeof( RegisterT ) );
 
-         register_ =
-            static_cast<RegisterT>( uValue ) >> ( 8 * sizeof( RegisterT ) - registerBitsUsed_ );
-         registerBitsUsed_ = newRegisterBitsUsed - 8 * sizeof( RegisterT );
-      }
-      else if ( newRegisterBitsUsed == 8 * sizeof( RegisterT ) )
-      {
-         // Input will exactly fill register, insert value, then transfer
-         register_ |= static_cast<RegisterT>( uValue ) << registerBitsUsed_;
-#ifdef VALIDATE_BASIC
-         // Before transfer, double check address within bounds
-         if ( outTransferred >= transferMax )
-         {
-            throw E57_EXCEPTION2( ErrorInternal, "outTransferred=" + toString( outTransferred ) +
-                                                    " transferMax" + toString( transferMax ) );
-         }
-#endif
-         outp[outTransferred] = register_;
+      outTransferred += registerCount;
 
-         outTransferred++;
+      registerBitsUsed_ = static_cast<unsigned>( bitCount % ( 8 * sizeof( RegisterT ) ) );
+      register_ = 0;
+      memcpy( &register_, packed + registerCount * sizeof( RegisterT ),
+              ( registerBitsUsed_ + 7 ) / 8 );
+   }
 
-         register_ = 0;
-         registerBitsUsed_ = 0;
-      }
-      else
-      {
-         // There is extra room in register, insert value, but don't do transfer yet
-         register_ |= static_cast<RegisterT>( uValue ) << registerBitsUsed_;
-         registerBitsUsed_ = newRegisterBitsUsed;
-      }
 #ifdef E57_VERBOSE
-      std::cout << "  After " << outTransferred << " transfers and " << i + 1
-                << " records, encoder:" << std::endl;
-      dump( 4 );
+   std::cout << "  After " << outTransferred << " transfers and " << recordCount
+             << " records, encoder:" << std::endl;
+   dump( 4 );
 #endif
-   }
 
    // Update tail of output buffer
    outBufferEnd_ += outTransferred * sizeof( RegisterT );
@@ -872,6 +1121,18 @@ template <typename RegisterT> float BitpackIntegerEncoder<RegisterT>::bitsPerRec
    return ( static_cast<float>( bitsPerRecord_ ) );
 }
 
+template <typename RegisterT>
+size_t BitpackIntegerEncoder<RegisterT>::maxOutputForRecords( size_t recordCount ) const
+{
+   // Whole registers only, plus the one which may already be partly full
+   return ( recordCount * bitsPerRecord_ + 7 ) / 8 + sizeof( RegisterT );
+}
+
+template <typename RegisterT> void BitpackIntegerEncoder<RegisterT>::skipValueChecks()
+{
+   checkValues_ = !exactInDouble( minimum_, maximum_ );
+}
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
 template <typename RegisterT>
 void BitpackIntegerEncoder<RegisterT>::dump( int indent, std::ostream &os ) const
@@ -893,6 +1154,226 @@ void BitpackIntegerEncoder<RegisterT>::dump( int indent, std::ostream &os ) cons
 
 //================================================================
 
+DeltaIntegerEncoder::DeltaIntegerEncoder( bool isScaledInteger, unsigned bytestreamNumber,
+                                          SourceDestBuffer &sbuf, unsigned outputMaxSize,
+                                          int64_t minimum, int64_t maximum, double scale,
+                                          double offset, uint64_t resetInterval ) :
+   BitpackEncoder( bytestreamNumber, sbuf, outputMaxSize, 1 ), isScaledInteger_( isScaledInteger ),
+   minimum_( minimum ), maximum_( maximum ), scale_( scale ), offset_( offset ),
+   resetInterval_( resetInterval )
+{
+}
+
+uint64_t DeltaIntegerEncoder::processRecords( size_t recordCount )
+{
+#ifdef E57_VERBOSE
+   std::cout << "DeltaIntegerEncoder::processRecords() called, recordCount=" << recordCount
+             << std::endl;
+#endif
+
+   // Before we add any more, try to shift current contents of outBuffer_ down to beginning of
+   // buffer.
+   outBufferShiftDown();
+
+   // Only take as many records as will fit in the worst case
+   recordCount = std::min( recordCount, ( outBuffer_.size() - outBufferEnd_ ) / cMaxVarintSize );
+
+   auto *outp = reinterpret_cast<uint8_t *>( &outBuffer_[outBufferEnd_] );
+   const uint8_t *outStart = outp;
+
+   for ( size_t done = 0; done < recordCount; done += cPackBlockSize )
+   {
+      const size_t n = std::min( cPackBlockSize, recordCount - done );
+
+      uint64_t raw[cPackBlockSize];
+      readRawValues( *sourceBuffer_, isScaledInteger_, scale_, offset_, minimum_, maximum_,
+                     checkValues_, n, raw );
+
+      for ( size_t i = 0; i < n; ++i )
+      {
+         if ( ( currentRecordIndex_ + done + i ) % resetInterval_ == 0 )
+         {
+            previous_ = 0;
+         }
+
+         // Zigzag encode the (wrapping) difference so small steps either way are small numbers
+         const auto delta = static_cast<int64_t>( raw[i] - previous_ );
+         const uint64_t zigzag =
+            ( static_cast<uint64_t>( delta ) << 1 ) ^ static_cast<uint64_t>( delta >> 63 );
+
+         writeVarint( outp, zigzag );
+
+         previous_ = raw[i];
+      }
+   }
+
+   const auto byteCount = static_cast<size_t>( outp - outStart );
+
+   outBufferEnd_ += byteCount;
+   totalBytesProcessed_ += byteCount;
+   currentRecordIndex_ += recordCount;
+
+   return ( currentRecordIndex_ );
+}
+
+bool DeltaIntegerEncoder::registerFlushToOutput()
+{
+   // Whole bytes are written for each record, so there is nothing to flush
+   return ( true );
+}
+
+float DeltaIntegerEncoder::bitsPerRecord()
+{
+   if ( currentRecordIndex_ > 0 )
+   {
+      return ( 8.0f * totalBytesProcessed_ ) / currentRecordIndex_;
+   }
+
+   // We haven't completed a record yet, so guess 2 bytes per record
+   return 2 * 8.0f;
+}
+
+size_t DeltaIntegerEncoder::maxOutputForRecords( size_t recordCount ) const
+{
+   return recordCount * cMaxVarintSize;
+}
+
+void DeltaIntegerEncoder::skipValueChecks()
+{
+   checkValues_ = !exactInDouble( minimum_, maximum_ );
+}
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+void DeltaIntegerEncoder::dump( int indent, std::ostream &os ) const
+{
+   BitpackEncoder::dump( indent, os );
+   os << space( indent ) << "isScaledInteger:     " << isScaledInteger_ << std::endl;
+   os << space( indent ) << "minimum:             " << minimum_ << std::endl;
+   os << space( indent ) << "maximum:             " << maximum_ << std::endl;
+   os << space( indent ) << "scale:               " << scale_ << std::endl;
+   os << space( indent ) << "offset:              " << offset_ << std::endl;
+   os << space( indent ) << "resetInterval:       " << resetInterval_ << std::endl;
+   os << space( indent ) << "previous:            " << previous_ << std::endl;
+   os << space( indent ) << "totalBytesProcessed: " << totalBytesProcessed_ << std::endl;
+}
+#endif
+
+//================================================================
+
+XorFloatEncoder::XorFloatEncoder( unsigned bytestreamNumber, SourceDestBuffer &sbuf,
+                                  unsigned outputMaxSize, FloatPrecision precision,
+                                  uint64_t resetInterval ) :
+   BitpackEncoder( bytestreamNumber, sbuf, outputMaxSize, 1 ), precision_( precision ),
+   resetInterval_( resetInterval )
+{
+}
+
+uint64_t XorFloatEncoder::processRecords( size_t recordCount )
+{
+#ifdef E57_VERBOSE
+   std::cout << "XorFloatEncoder::processRecords() called, recordCount=" << recordCount
+             << std::endl;
+#endif
+
+   // Before we add any more, try to shift current contents of outBuffer_ down to beginning of
+   // buffer.
+   outBufferShiftDown();
+
+   // Only take as many records as will fit in the worst case
+   recordCount = std::min( recordCount, ( outBuffer_.size() - outBufferEnd_ ) / cMaxVarintSize );
+
+   auto *outp = reinterpret_cast<uint8_t *>( &outBuffer_[outBufferEnd_] );
+   const uint8_t *outStart = outp;
+
+   for ( size_t done = 0; done < recordCount; done += cPackBlockSize )
+   {
+      const size_t n = std::min( cPackBlockSize, recordCount - done );
+
+      uint64_t bits[cPackBlockSize];
+
+      if ( precision_ == PrecisionSingle )
+      {
+         float values[cPackBlockSize];
+         sourceBuffer_->getNextFloats( values, n, checkValues_ );
+
+         for ( size_t i = 0; i < n; ++i )
+         {
+            uint32_t word;
+            memcpy( &word, &values[i], sizeof( word ) );
+            bits[i] = word;
+         }
+      }
+      else
+      {
+         double values[cPackBlockSize];
+         sourceBuffer_->getNextDoubles( values, n );
+
+         memcpy( bits, values, n * sizeof( double ) );
+      }
+
+      for ( size_t i = 0; i < n; ++i )
+      {
+         if ( ( currentRecordIndex_ + done + i ) % resetInterval_ == 0 )
+         {
+            previous_ = 0;
+         }
+
+         writeVarint( outp, bits[i] ^ previous_ );
+
+         previous_ = bits[i];
+      }
+   }
+
+   const auto byteCount = static_cast<size_t>( outp - outStart );
+
+   outBufferEnd_ += byteCount;
+   totalBytesProcessed_ += byteCount;
+   currentRecordIndex_ += recordCount;
+
+   return ( currentRecordIndex_ );
+}
+
+bool XorFloatEncoder::registerFlushToOutput()
+{
+   // Whole bytes are written for each record, so there is nothing to flush
+   return ( true );
+}
+
+float XorFloatEncoder::bitsPerRecord()
+{
+   if ( currentRecordIndex_ > 0 )
+   {
+      return ( 8.0f * totalBytesProcessed_ ) / currentRecordIndex_;
+   }
+
+   // We haven't completed a record yet, so guess half the size of the value
+   return ( precision_ == PrecisionSingle ) ? 16.0f : 32.0f;
+}
+
+size_t XorFloatEncoder::maxOutputForRecords( size_t recordCount ) const
+{
+   return recordCount * ( ( precision_ == PrecisionSingle ) ? 5 : cMaxVarintSize );
+}
+
+void XorFloatEncoder::skipValueChecks()
+{
+   checkValues_ = false;
+}
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+void XorFloatEncoder::dump( int indent, std::ostream &os ) const
+{
+   BitpackEncoder::dump( indent, os );
+   os << space( indent ) << "precision:           "
+      << ( ( precision_ == PrecisionSingle ) ? "Single" : "Double" ) << std::endl;
+   os << space( indent ) << "resetInterval:       " << resetInterval_ << std::endl;
+   os << space( indent ) << "previous:            " << hexString( previous_ ) << std::endl;
+   os << space( indent ) << "totalBytesProcessed: " << totalBytesProcessed_ << std::endl;
+}
+#endif
+
+//================================================================
+
 ConstantIntegerEncoder::ConstantIntegerEncoder( unsigned bytestreamNumber, SourceDestBuffer &sbuf,
                                                 int64_t minimum ) :
    Encoder( bytestreamNumber ), sourceBuffer_( sbuf.impl() ), currentRecordIndex_( 0 ),
@@ -908,16 +1389,40 @@ uint64_t ConstantIntegerEncoder::processRecords( size_t recordCount )
    dump( 4 );
 #endif
 
-   // Check that all source values are == minimum_
-   for ( unsigned i = 0; i < recordCount; i++ )
+#if VALIDATE_BASIC
+   // Values already checked by the writer (see skipValueChecks()) needn't be looked at again
+   const bool checkValues = checkValues_;
+#else
+   // Nothing is written, so without validation there is no need to look at the values
+   const bool checkValues = false;
+#endif
+
+   if ( checkValues )
    {
-      int64_t nextInt64 = sourceBuffer_->getNextInt64();
-      if ( nextInt64 != minimum_ )
+      // Check that all source values are == minimum_
+      int64_t values[cPackBlockSize];
+
+      for ( size_t done = 0; done < recordCount; done += cPackBlockSize )
       {
-         throw E57_EXCEPTION2( ErrorValueOutOfBounds, "nextInt64=" + toString( nextInt64 ) +
-                                                         " minimum=" + toString( minimum_ ) );
+         const size_t n = std::min( cPackBlockSize, recordCount - done );
+
+         sourceBuffer_->getNextInt64s( values, n );
+
+         for ( size_t i = 0; i < n; ++i )
+         {
+            if ( values[i] != minimum_ )
+            {
+               throw E57_EXCEPTION2( ErrorValueOutOfBounds,
+                                     "nextInt64=" + toString( values[i] ) +
+                                        " minimum=" + toString( minimum_ ) );
+            }
+         }
       }
    }
+   else
+   {
+      sourceBuffer_->skipNext( recordCount );
+   }
 
    // Update counts of records processed
    currentRecordIndex_ += recordCount;
@@ -941,6 +1446,11 @@ float ConstantIntegerEncoder::bitsPerRecord()
    return ( 0.0 );
 }
 
+size_t ConstantIntegerEncoder::maxOutputForRecords( size_t /*recordCount*/ ) const
+{
+   return 0;
+}
+
 bool ConstantIntegerEncoder::registerFlushToOutput()
 {
    return ( true );
@@ -987,6 +1497,11 @@ void ConstantIntegerEncoder::outputSetMaxSize( unsigned /*byteCount*/ )
    // Ignore, since don't produce any output
 }
 
+void ConstantIntegerEncoder::skipValueChecks()
+{
+   checkValues_ = !exactInDouble( minimum_, minimum_ );
+}
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
 void ConstantIntegerEncoder::dump( int indent, std::ostream &os ) const
 {
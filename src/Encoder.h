@@ -27,6 +27,7 @@
 
 #pragma once
 
+#include "BitpackKernels.h"
 #include "Common.h"
 
 namespace e57
@@ -46,6 +47,10 @@ namespace e57
       virtual float bitsPerRecord() = 0;
       virtual bool registerFlushToOutput() = 0;
 
+      /// Upper limit on how much outputAvailable() can grow by processing recordCount records,
+      /// or SIZE_MAX if it depends on the data.
+      virtual size_t maxOutputForRecords( size_t recordCount ) const = 0;
+
       virtual size_t outputAvailable() const = 0; /// number of bytes that can be read
       virtual void outputRead( char *dest, size_t byteCount ) = 0; /// get data from encoder
       virtual void outputClear() = 0;
@@ -54,6 +59,32 @@ namespace e57
       virtual size_t outputGetMaxSize() = 0;
       virtual void outputSetMaxSize( unsigned byteCount ) = 0;
 
+      /// The values written have already been checked against the field (see
+      /// CompressedVectorWriterOptions::validatePerWrite), so they needn't be checked one at a
+      /// time as they are encoded.
+      virtual void skipValueChecks()
+      {
+      }
+
+      /// The writer is ending a chunk the index packets point to once this bytestream's output
+      /// so far is written. Whatever is output after this must be decodable without it.
+      virtual void finishChunk()
+      {
+      }
+
+      /// The writer is flushing (see CompressedVectorWriter::flush), so make everything encoded
+      /// so far available from outputAvailable() without ending the bytestream. Partial words
+      /// still in a register stay there.
+      virtual void flushOutput()
+      {
+      }
+
+      /// Bytes of the buffers the encoder holds (see ImageFileMemoryUsage::encoders).
+      virtual size_t bufferSize() const
+      {
+         return 0;
+      }
+
       unsigned bytestreamNumber() const
       {
          return bytestreamNumber_;
@@ -67,6 +98,12 @@ namespace e57
       explicit Encoder( unsigned bytestreamNumber );
 
       unsigned bytestreamNumber_;
+
+   private:
+      /// The encoder for the field of @a sbufs, before any compression (see ZstdCodec.h)
+      static std::shared_ptr<Encoder> fieldEncoder(
+         unsigned bytestreamNumber, const std::shared_ptr<CompressedVectorNodeImpl> &cVector,
+         std::vector<SourceDestBuffer> &sbufs );
    };
 
    class BitpackEncoder : public Encoder
@@ -77,6 +114,7 @@ namespace e57
       uint64_t currentRecordIndex() override;
       float bitsPerRecord() override = 0;
       bool registerFlushToOutput() override = 0;
+      size_t maxOutputForRecords( size_t recordCount ) const override = 0;
 
       size_t outputAvailable() const override;                  /// number of bytes that can be read
       void outputRead( char *dest, size_t byteCount ) override; /// get data from encoder
@@ -86,6 +124,11 @@ namespace e57
       size_t outputGetMaxSize() override;
       void outputSetMaxSize( unsigned byteCount ) override;
 
+      size_t bufferSize() const override
+      {
+         return outBuffer_.capacity();
+      }
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) const override;
 #endif
@@ -115,6 +158,8 @@ namespace e57
       uint64_t processRecords( size_t recordCount ) override;
       bool registerFlushToOutput() override;
       float bitsPerRecord() override;
+      size_t maxOutputForRecords( size_t recordCount ) const override;
+      void skipValueChecks() override;
 
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) const override;
@@ -122,6 +167,7 @@ namespace e57
 
    protected:
       FloatPrecision precision_;
+      bool checkValues_ = true;
    };
 
    class BitpackStringEncoder : public BitpackEncoder
@@ -133,6 +179,7 @@ namespace e57
       uint64_t processRecords( size_t recordCount ) override;
       bool registerFlushToOutput() override;
       float bitsPerRecord() override;
+      size_t maxOutputForRecords( size_t recordCount ) const override;
 
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) const override;
@@ -142,7 +189,8 @@ namespace e57
       uint64_t totalBytesProcessed_;
       bool isStringActive_;
       bool prefixComplete_;
-      ustring currentString_;
+      const char *currentString_;
+      size_t currentStringLength_;
       size_t currentCharPosition_;
    };
 
@@ -156,6 +204,8 @@ namespace e57
       uint64_t processRecords( size_t recordCount ) override;
       bool registerFlushToOutput() override;
       float bitsPerRecord() override;
+      size_t maxOutputForRecords( size_t recordCount ) const override;
+      void skipValueChecks() override;
 
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) const override;
@@ -168,9 +218,72 @@ namespace e57
       double scale_;
       double offset_;
       unsigned bitsPerRecord_;
+      BitPacker packer_;
       uint64_t sourceBitMask_;
       unsigned registerBitsUsed_;
       RegisterT register_;
+      bool checkValues_ = true;
+   };
+
+   /// Encodes each integer as the zigzag varint difference from the previous one, for the delta
+   /// codec extension (see DeltaCodec.h).
+   class DeltaIntegerEncoder : public BitpackEncoder
+   {
+   public:
+      DeltaIntegerEncoder( bool isScaledInteger, unsigned bytestreamNumber, SourceDestBuffer &sbuf,
+                           unsigned outputMaxSize, int64_t minimum, int64_t maximum, double scale,
+                           double offset, uint64_t resetInterval );
+
+      uint64_t processRecords( size_t recordCount ) override;
+      bool registerFlushToOutput() override;
+      float bitsPerRecord() override;
+      size_t maxOutputForRecords( size_t recordCount ) const override;
+      void skipValueChecks() override;
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+      void dump( int indent = 0, std::ostream &os = std::cout ) const override;
+#endif
+
+   protected:
+      bool isScaledInteger_;
+      int64_t minimum_;
+      int64_t maximum_;
+      double scale_;
+      double offset_;
+      uint64_t resetInterval_;
+
+      /// Previous value, less the minimum
+      uint64_t previous_ = 0;
+      uint64_t totalBytesProcessed_ = 0;
+      bool checkValues_ = true;
+   };
+
+   /// Encodes each float as the varint XOR of its bits with the previous one's, for the XOR codec
+   /// extension (see XorCodec.h).
+   class XorFloatEncoder : public BitpackEncoder
+   {
+   public:
+      XorFloatEncoder( unsigned bytestreamNumber, SourceDestBuffer &sbuf, unsigned outputMaxSize,
+                       FloatPrecision precision, uint64_t resetInterval );
+
+      uint64_t processRecords( size_t recordCount ) override;
+      bool registerFlushToOutput() override;
+      float bitsPerRecord() override;
+      size_t maxOutputForRecords( size_t recordCount ) const override;
+      void skipValueChecks() override;
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+      void dump( int indent = 0, std::ostream &os = std::cout ) const override;
+#endif
+
+   protected:
+      FloatPrecision precision_;
+      uint64_t resetInterval_;
+
+      /// Bits of the previous value
+      uint64_t previous_ = 0;
+      uint64_t totalBytesProcessed_ = 0;
+      bool checkValues_ = true;
    };
 
    class ConstantIntegerEncoder : public Encoder
@@ -182,6 +295,7 @@ namespace e57
       uint64_t currentRecordIndex() override;
       float bitsPerRecord() override;
       bool registerFlushToOutput() override;
+      size_t maxOutputForRecords( size_t recordCount ) const override;
 
       size_t outputAvailable() const override;                  /// number of bytes that can be read
       void outputRead( char *dest, size_t byteCount ) override; /// get data from encoder
@@ -190,6 +304,7 @@ namespace e57
       void sourceBufferSetNew( std::vector<SourceDestBuffer> &sbufs ) override;
       size_t outputGetMaxSize() override;
       void outputSetMaxSize( unsigned byteCount ) override;
+      void skipValueChecks() override;
 
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout ) const override;
@@ -199,5 +314,6 @@ namespace e57
       std::shared_ptr<SourceDestBufferImpl> sourceBuffer_;
       uint64_t currentRecordIndex_;
       int64_t minimum_;
+      bool checkValues_ = true;
    };
 }
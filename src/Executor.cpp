@@ -0,0 +1,193 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include "Common.h"
+
+namespace e57
+{
+   class WorkStealingExecutorImpl
+   {
+   public:
+      explicit WorkStealingExecutorImpl( unsigned threadCount )
+      {
+         if ( threadCount == 0 )
+         {
+            threadCount = std::max( std::thread::hardware_concurrency(), 2U );
+         }
+
+         for ( unsigned i = 0; i < threadCount; ++i )
+         {
+            queues_.emplace_back( new Queue );
+         }
+
+         for ( unsigned i = 0; i < threadCount; ++i )
+         {
+            threads_.emplace_back( &WorkStealingExecutorImpl::threadLoop, this, i );
+         }
+      }
+
+      ~WorkStealingExecutorImpl()
+      {
+         {
+            std::lock_guard<std::mutex> lock( sleepMutex_ );
+            stopping_ = true;
+         }
+
+         wake_.notify_all();
+
+         for ( auto &thread : threads_ )
+         {
+            thread.join();
+         }
+      }
+
+      void execute( std::function<void()> task )
+      {
+         // Our own threads keep what they give on their own queue, where it is likely to find
+         // what it needs still in the cache. Others share theirs out in turn.
+         size_t index = 0;
+
+         if ( tCurrent == this )
+         {
+            index = tQueueIndex;
+         }
+         else
+         {
+            index = nextQueue_++ % queues_.size();
+         }
+
+         {
+            std::lock_guard<std::mutex> lock( queues_[index]->mutex );
+            queues_[index]->tasks.push_back( std::move( task ) );
+         }
+
+         {
+            std::lock_guard<std::mutex> lock( sleepMutex_ );
+            ++queuedCount_;
+         }
+
+         wake_.notify_one();
+      }
+
+      unsigned concurrency() const
+      {
+         return static_cast<unsigned>( threads_.size() );
+      }
+
+   private:
+      struct Queue
+      {
+         std::mutex mutex; // protects tasks
+         std::deque<std::function<void()>> tasks;
+      };
+
+      /// Take the newest task of our own queue, or else the oldest of another one
+      bool takeTask( size_t index, std::function<void()> &task )
+      {
+         for ( size_t i = 0; i < queues_.size(); ++i )
+         {
+            Queue &queue = *queues_[( index + i ) % queues_.size()];
+
+            std::lock_guard<std::mutex> lock( queue.mutex );
+
+            if ( queue.tasks.empty() )
+            {
+               continue;
+            }
+
+            if ( i == 0 )
+            {
+               task = std::move( queue.tasks.back() );
+               queue.tasks.pop_back();
+            }
+            else
+            {
+               task = std::move( queue.tasks.front() );
+               queue.tasks.pop_front();
+            }
+
+            return true;
+         }
+
+         return false;
+      }
+
+      void threadLoop( size_t index )
+      {
+         tCurrent = this;
+         tQueueIndex = index;
+
+         for ( ;; )
+         {
+            std::function<void()> task;
+
+            if ( takeTask( index, task ) )
+            {
+               {
+                  std::lock_guard<std::mutex> lock( sleepMutex_ );
+                  --queuedCount_;
+               }
+
+               task();
+               continue;
+            }
+
+            std::unique_lock<std::mutex> lock( sleepMutex_ );
+
+            // Finish whatever is queued before stopping
+            wake_.wait( lock, [this] { return ( queuedCount_ > 0 ) || stopping_; } );
+
+            if ( ( queuedCount_ == 0 ) && stopping_ )
+            {
+               return;
+            }
+         }
+      }
+
+      static thread_local WorkStealingExecutorImpl *tCurrent;
+      static thread_local size_t tQueueIndex;
+
+      std::vector<std::unique_ptr<Queue>> queues_;
+      std::vector<std::thread> threads_;
+      std::atomic<size_t> nextQueue_{ 0 };
+
+      std::mutex sleepMutex_; // protects everything below
+      std::condition_variable wake_;
+      size_t queuedCount_ = 0;
+      bool stopping_ = false;
+   };
+
+   thread_local WorkStealingExecutorImpl *WorkStealingExecutorImpl::tCurrent = nullptr;
+   thread_local size_t WorkStealingExecutorImpl::tQueueIndex = 0;
+
+   WorkStealingExecutor::WorkStealingExecutor( unsigned threadCount ) :
+      impl_( new WorkStealingExecutorImpl( threadCount ) )
+   {
+   }
+
+   WorkStealingExecutor::~WorkStealingExecutor() = default;
+
+   void WorkStealingExecutor::execute( std::function<void()> task )
+   {
+      impl_->execute( std::move( task ) );
+   }
+
+   unsigned WorkStealingExecutor::concurrency() const
+   {
+      return impl_->concurrency();
+   }
+
+   std::shared_ptr<Executor> WorkStealingExecutor::defaultExecutor()
+   {
+      static std::shared_ptr<Executor> executor = std::make_shared<WorkStealingExecutor>();
+
+      return executor;
+   }
+}
@@ -156,7 +156,7 @@ namespace e57
       }
       else
       {
-         fieldName = elementName_;
+         fieldName = elementNameRef();
       }
 
       cf << space( indent ) << "<" << fieldName << " type=\"Float\"";
@@ -246,7 +246,7 @@ that files that meet all of the requirements for a legal ASTM E57 file format us
 ".e57". It is recommended that files that utilize the low-level E57 element data types, but do not
 have all the required element names required by ASTM E57 file format standard use the file extension
 @c "._e57".
-@param [in] mode Either "w" for writing or "r" for reading.
+@param [in] mode Either "w" for writing, "r" for reading, or "a" for appending.
 @param [in] checksumPolicy The percentage of checksums we compute and verify as an int. Clamped to
 0-100.
 
@@ -261,7 +261,15 @@ API operations are legal for an ImageFile opened in write mode.
 @par Read Mode
 Read mode files may be shared.
 Write API operations are not legal for an ImageFile opened in read mode (i.e. the ImageFile is
-read-only). There is no API support for appending data onto an existing E57 data file.
+read-only).
+
+@par Append Mode
+In append mode, the existing file given by @a fname is read as in read mode, and can then be added
+to as in write mode (isWritable() is true). New binary sections (e.g. the points of a new Data3D)
+are written after everything already in the file, which is left as it is, so the cost depends only
+on what is added. When the ImageFile is closed, the XML section is written again after the new
+data and the file header is updated to point to it. Until then, readers of the file on the disk
+still see it as it was. Calling cancel() drops what was added.
 
 @post Resulting ImageFile is in @c open state if constructor succeeds (no exception thrown).
 
@@ -285,18 +293,82 @@ CompressedVectorNode, E57Exception, E57Utilities::E57Utilities
 */
 ImageFile::ImageFile( const ustring &fname, const ustring &mode,
                       ReadChecksumPolicy checksumPolicy ) :
-   impl_( new ImageFileImpl( checksumPolicy ) )
+   ImageFile( fname, mode, ImageFileOptions{ checksumPolicy } )
+{
+}
+
+/*!
+@brief Open an ASTM E57 imaging data file for reading/writing.
+
+@param [in] fname File name to open.
+@param [in] mode Either "w" for writing, "r" for reading, or "a" for appending.
+@param [in] options Options used to read the file (see ImageFileOptions).
+
+Otherwise the same as ImageFile(const ustring &, const ustring &, ReadChecksumPolicy).
+*/
+ImageFile::ImageFile( const ustring &fname, const ustring &mode,
+                      const ImageFileOptions &options ) :
+   impl_( new ImageFileImpl( options ) )
 {
    // Do second phase of construction, now that ImageFile object is complete.
    impl_->construct2( fname, mode );
 }
 
 ImageFile::ImageFile( const char *input, const uint64_t size, ReadChecksumPolicy checksumPolicy ) :
-   impl_( new ImageFileImpl( checksumPolicy ) )
+   ImageFile( input, size, ImageFileOptions{ checksumPolicy } )
+{
+}
+
+ImageFile::ImageFile( const char *input, const uint64_t size, const ImageFileOptions &options ) :
+   impl_( new ImageFileImpl( options ) )
 {
    impl_->construct2( input, size );
 }
 
+/*!
+@brief Open E57 imaging data for reading from a ReadSource.
+
+@param [in] source Where to read the data from. It is kept until the ImageFile is closed.
+@param [in] options Options used to read the data (see ImageFileOptions).
+
+@details This reads from anything which implements ReadSource, such as an object store, without
+copying all of it first. fileName() returns ReadSource::name().
+
+Otherwise the same as ImageFile(const ustring &, const ustring &, ReadChecksumPolicy) in read mode.
+
+@throw ::ErrorBadAPIArgument if @a source is null
+*/
+ImageFile::ImageFile( const std::shared_ptr<ReadSource> &source, const ImageFileOptions &options ) :
+   impl_( new ImageFileImpl( options ) )
+{
+   impl_->construct2( source );
+}
+
+/*!
+@brief Create E57 imaging data which is written to a WriteSink.
+
+@param [in] sink Where to write the data. It is kept until the ImageFile is closed or cancelled.
+@param [in] options Options used to write the data (see ImageFileOptions).
+
+@details This writes the file straight to memory (see MemoryWriteSink) or to anything else which
+implements WriteSink, so it doesn't have to be written to the disk and read back. Pages are
+written where they go in the file and some are written more than once, so the sink must allow
+writes anywhere. fileName() returns WriteSink::name().
+
+ImageFileOptions::journalInterval and ImageFileOptions::directIo are ignored. cancel() leaves
+what was written in the sink.
+
+Otherwise the same as ImageFile(const ustring &, const ustring &, ReadChecksumPolicy) in write
+mode.
+
+@throw ::ErrorBadAPIArgument if @a sink is null
+*/
+ImageFile::ImageFile( const std::shared_ptr<WriteSink> &sink, const ImageFileOptions &options ) :
+   impl_( new ImageFileImpl( options ) )
+{
+   impl_->construct2( sink );
+}
+
 /*!
 @brief Get the pre-established root StructureNode of the E57 ImageFile.
 
@@ -358,7 +430,8 @@ void ImageFile::close()
 
 @details
 If the ImageFile is write mode, the associated file on the disk is closed and deleted, and the
-ImageFile goes to the closed state. If the ImageFile is read mode, the behavior is same as calling
+ImageFile goes to the closed state. In append mode, the file is cut back to what it was when it was
+opened instead. If the ImageFile is read mode, the behavior is same as calling
 ImageFile::close, but no exceptions are thrown. It is not an error if ImageFile is already closed.
 
 @post ImageFile is in @c closed state.
@@ -372,6 +445,40 @@ void ImageFile::cancel()
    impl_->cancel();
 }
 
+/*!
+@brief Rebuild a valid E57 file from one whose writer stopped before closing it.
+
+@param [in] fname Name of the file, which was written with ImageFileOptions::journalInterval.
+
+@details
+The file is completed from the last journal written next to it: the binary section of the
+CompressedVectorWriter which was open then is finished with the records it had written, everything
+after that is dropped, and the XML section and file header are written. The journal is then
+removed. Records written after the journal are lost, as are the contents of any BlobNode which
+hadn't been written yet.
+
+If the file turns out to have been closed after all, only the journal is removed.
+
+@pre The file isn't open, in this process or any other.
+
+@post The file can be opened in read mode.
+
+@throw ::ErrorOpenFailed The file or its journal can't be opened.
+@throw ::ErrorBadFileSignature The journal isn't one.
+@throw ::ErrorBadFileLength The file is shorter than the journal says.
+@throw ::ErrorBadChecksum The journal was only partly written.
+@throw ::ErrorReadFailed
+@throw ::ErrorWriteFailed
+@throw ::ErrorSeekFailed
+@throw ::ErrorInternal All objects in undocumented state
+
+@see ImageFileOptions::journalInterval
+*/
+void ImageFile::recover( const ustring &fname )
+{
+   ImageFileImpl::recover( fname );
+}
+
 /*!
 @brief Test whether ImageFile is still open for accessing.
 
@@ -393,7 +500,7 @@ bool ImageFile::isOpen() const
 
 @post No visible state is modified.
 
-@return true if ImageFile was opened in write mode.
+@return true if ImageFile was opened in write mode or append mode.
 
 @throw No E57Exceptions.
 
@@ -464,6 +571,177 @@ int ImageFile::readerCount() const
    return impl_->readerCount();
 }
 
+/*!
+@brief Verify the checksum of every page of an ImageFile opened for reading.
+
+@param [in] threadCount Number of threads to share the work, including the calling thread.
+
+@details
+Whatever checksum policy the file was opened with, every page of the file is read and its checksum
+checked. The pages are spread across @a threadCount threads, so checking a large file scales with
+the number of cores instead of running one page at a time. Use this to validate a whole file before
+trusting it, for example when ingesting it.
+
+@pre This ImageFile must be open (i.e. isOpen()).
+@pre This ImageFile must have been opened for reading (i.e. !isWritable()).
+@post No visible state is modified.
+
+@throw ::ErrorBadAPIArgument This ImageFile is being written.
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorReadFailed
+@throw ::ErrorBadChecksum
+@throw ::ErrorInternal All objects in undocumented state
+
+@see ImageFileOptions::verifyChecksumThreadCount
+*/
+void ImageFile::verifyChecksums( unsigned threadCount ) const
+{
+   impl_->verifyChecksums( threadCount );
+}
+
+/*!
+@brief Catch up with the writer of a file opened with ImageFileOptions::follow.
+
+@details
+The journal of the file is read again, and every CompressedVectorNode of the tree gets the records
+written since the last call (or since the file was opened). Readers of those nodes carry on into
+the new records from where they are, decoding only the packets which were added. Once the writer
+has closed the file, its final XML section is read instead, and the file is no longer followed.
+
+Only nodes which were in the tree when the file was opened are updated. Nodes added by the writer
+later are seen by opening the file again.
+
+This must not be called while CompressedVectorReader::read() or CompressedVectorReader::seek() is
+running on another thread.
+
+@pre This ImageFile must be open (i.e. isOpen()).
+@post The file's nodes describe what the writer had written at the time.
+
+@return true if anything was added, or the writer closed the file. false if nothing changed, or
+the file isn't being followed.
+
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorBadFileSignature The writer cancelled the file.
+@throw ::ErrorBadFileLength The file is shorter than its journal says.
+@throw ::ErrorBadChecksum
+@throw ::ErrorReadFailed
+@throw ::ErrorInternal All objects in undocumented state
+
+@see ImageFileOptions::follow, ImageFileOptions::journalInterval
+*/
+bool ImageFile::refresh()
+{
+   return impl_->refresh();
+}
+
+/*!
+@brief Reserve disk space for data about to be written to an ImageFile.
+
+@param [in] byteCount Number of (logical) bytes of data to reserve space for.
+
+@details
+Growing a file a little at a time as its sections are written can leave it in many pieces on disk,
+which makes reading it back slower. If the size of what is about to be written is roughly known
+(such as the points of a Data3D), reserving space for it first lets the file system allocate it in
+one go. The length of the file doesn't change. Successive calls reserve space after what was
+reserved before, and any which isn't used is released when the file is closed.
+
+This uses fallocate() on Linux, F_PREALLOCATE on macOS, and the file's allocation size on Windows.
+On other systems, or if the file system doesn't support it, it does nothing.
+
+@pre This ImageFile must be open (i.e. isOpen()).
+@pre This ImageFile must have been opened for writing (i.e. isWritable()).
+
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorFileReadOnly
+@throw ::ErrorInternal All objects in undocumented state
+
+@see WriterOptions::reserveSpace
+*/
+void ImageFile::reserveSpace( uint64_t byteCount )
+{
+   impl_->reserveSpace( byteCount );
+}
+
+/*!
+@brief Get the performance counters of an ImageFile.
+
+@details
+The counters cover the ImageFile's file I/O, checksums, XML parsing, and the packets, records, and
+decoding time of its CompressedVectorReader objects, from when it was opened (or
+resetStatistics() was last called). They can tell whether reading a file is bound by I/O,
+checksums, or decoding.
+
+Statistics are only collected if the library was built with the cmake option
+E57_ENABLE_STATISTICS. Otherwise ImageFileStatistics::enabled is false and everything is zero.
+
+The ImageFile may be open or closed.
+
+@post No visible state is modified.
+
+@return A copy of the counters.
+
+@see ImageFileStatistics, resetStatistics()
+*/
+ImageFileStatistics ImageFile::statistics() const
+{
+   return impl_->statistics();
+}
+
+/*!
+@brief Set all of the performance counters of an ImageFile to zero.
+
+@details
+Use this to measure one part of working with a file, such as reading one Data3D.
+
+@post All of the counters returned by statistics() are zero.
+
+@see statistics()
+*/
+void ImageFile::resetStatistics()
+{
+   impl_->resetStatistics();
+}
+
+/*!
+@brief Get the bytes of memory held by each part of an ImageFile.
+
+@details
+Use this to find out which part of reading or writing a file uses the memory, and how close it is
+to the budget (see ImageFileOptions::memoryBudget and setMemoryBudget()).
+
+The ImageFile may be open or closed.
+
+@post No visible state is modified.
+
+@return A copy of the counts.
+
+@see ImageFileMemoryUsage
+*/
+ImageFileMemoryUsage ImageFile::memoryUsage() const
+{
+   return impl_->memoryUsage();
+}
+
+/*!
+@brief Change the most bytes of memory an ImageFile may hold.
+
+@param [in] byteCount The budget, or 0 for no limit.
+
+@details
+The budget applies to the caches and buffers CompressedVectorReader and CompressedVectorWriter
+objects set up after this is called. Those already open keep what they have. See
+ImageFileOptions::memoryBudget for what it limits.
+
+@post memoryUsage() returns the new budget.
+
+@see memoryUsage()
+*/
+void ImageFile::setMemoryBudget( uint64_t byteCount )
+{
+   impl_->setMemoryBudget( byteCount );
+}
+
 /*!
 @brief Declare the use of an E57 extension in an ImageFile being written.
 
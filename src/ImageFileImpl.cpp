@@ -25,10 +25,31 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <cstdio>
+
+#if defined( _WIN32 )
+#if defined( _MSC_VER )
+#include <codecvt>
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
 #include "ImageFileImpl.h"
 #include "ASTMVersion.h"
 #include "CheckedFile.h"
+#include "CompressedVectorNodeImpl.h"
 #include "E57XmlParser.h"
+#include "LazyXml.h"
+#include "NodeArena.h"
+#include "ReadSource.h"
+#include "SectionHeaders.h"
+#include "SharedPacketCache.h"
 #include "StringFunctions.h"
 #include "StructureNodeImpl.h"
 
@@ -74,13 +95,53 @@ namespace e57
    }
 #endif
 
-   ImageFileImpl::ImageFileImpl( ReadChecksumPolicy policy ) :
-      isWriter_( false ), writerCount_( 0 ), readerCount_( 0 ),
-      checksumPolicy( std::max( 0, std::min( policy, 100 ) ) ), file_( nullptr ),
-      xmlLogicalOffset_( 0 ), xmlLogicalLength_( 0 ), unusedLogicalStart_( 0 )
+   // Name of the journal kept next to a file written with ImageFileOptions::journalInterval
+   static ustring journalFileName( const ustring &fileName )
+   {
+      return fileName + ".journal";
+   }
+
+   // Start of a journal. It is followed by the XML section the file would get if it were closed
+   // at the time. The journal is a checksummed file like an E57 file, so a journal which was only
+   // partly written is caught.
+   struct JournalHeader
+   {
+      char signature[8] = { 'E', '5', '7', 'J', 'R', 'N', 'L', '1' };
+      uint64_t unusedLogicalStart = 0;   ///< end of what the journal covers in the file
+      uint64_t xmlLogicalLength = 0;     ///< length of the XML section following this header
+      uint64_t sectionLogicalStart = 0;  ///< section header of the open writer, or 0 if none
+      uint64_t sectionLogicalLength = 0; ///< length of that section up to unusedLogicalStart
+      uint64_t dataPhysicalOffset = 0;   ///< first data packet of that section
+   };
+
+   ImageFileImpl::ImageFileImpl( const ImageFileOptions &options ) :
+      isWriter_( false ), writerCount_( 0 ), stagedWriterCount_( 0 ), readerCount_( 0 ),
+      checksumPolicy( std::max( 0, std::min( options.checksumPolicy, 100 ) ) ),
+      verifyChecksumThreadCount_( options.verifyChecksumThreadCount ),
+      lazyLoadXml_( options.lazyLoadXml ), validateXml_( options.validateXml ),
+      directIo_( options.directIo ), journalInterval_( options.journalInterval ),
+      follow_( options.follow ),
+      executor_( ( options.executor != nullptr ) ? options.executor
+                                                 : WorkStealingExecutor::defaultExecutor() ),
+      sharedPacketCacheSize_( options.sharedPacketCacheSize ),
+      file_( nullptr ),
+      memoryAccount_( std::make_shared<MemoryAccount>( options.memoryBudget ) ),
+      xmlLogicalOffset_( 0 ),
+      xmlLogicalLength_( 0 ), unusedLogicalStart_( 0 ), appendPhysicalLength_( 0 )
    {
       // First phase of construction, can't do much until have the ImageFile object. See
       // ImageFileImpl::construct2() for second phase.
+
+      if ( options.useNodeArena )
+      {
+         nodeArena_ = std::make_shared<NodeArena>( memoryAccount_ );
+      }
+
+      // Everything is checked when the file is opened, so there's no need to check it again
+      if ( verifyChecksumThreadCount_ > 0 )
+      {
+         checksumPolicy = ChecksumNone;
+      }
    }
 
    void ImageFileImpl::construct2( const ustring &fileName, const ustring &mode )
@@ -96,23 +157,34 @@ namespace e57
       // Get shared_ptr to this object
       ImageFileImplSharedPtr imf = shared_from_this();
 
-      // Accept "w" or "r" modes
+      // Accept "w", "r", or "a" modes
       isWriter_ = ( mode == "w" );
 
-      if ( !isWriter_ && ( mode != "r" ) )
+      if ( !isWriter_ && ( mode != "r" ) && ( mode != "a" ) )
       {
          throw E57_EXCEPTION2( ErrorBadAPIArgument, "mode=" + ustring( mode ) );
       }
 
       file_ = nullptr;
 
+      // Appending
+      if ( mode == "a" )
+      {
+         constructAppend();
+         return;
+      }
+
       // Writing
       if ( isWriter_ )
       {
          try
          {
-            // Open file for writing, truncate if already exists.
-            file_ = new CheckedFile( fileName_, CheckedFile::Write, checksumPolicy );
+            // Open file for writing, truncate if already exists. Journals describe what is in
+            // the file, so pages can't be held back for direct I/O.
+            file_ = new CheckedFile( fileName_, CheckedFile::Write, checksumPolicy,
+                                     directIo_ && ( journalInterval_ == 0 ) );
+            file_->setStatistics( &statistics_ );
+            file_->setExecutor( executor_ );
 
             std::shared_ptr<StructureNodeImpl> root( new StructureNodeImpl( imf ) );
             root_ = root;
@@ -133,11 +205,24 @@ namespace e57
          return;
       }
 
+      // Reading a file which may still be being written
+      if ( follow_ && constructFollow() )
+      {
+         return;
+      }
+
       // Reading
       try
       {
          // Open file for reading.
          file_ = new CheckedFile( fileName_, CheckedFile::Read, checksumPolicy );
+         file_->setStatistics( &statistics_ );
+         file_->setExecutor( executor_ );
+
+         if ( verifyChecksumThreadCount_ > 0 )
+         {
+            file_->verifyChecksums( verifyChecksumThreadCount_ );
+         }
 
          std::shared_ptr<StructureNodeImpl> root( new StructureNodeImpl( imf ) );
          root_ = root;
@@ -159,18 +244,102 @@ namespace e57
 
       try
       {
-         // Create parser state, attach its event handers to the SAX2 reader
-         E57XmlParser parser( imf );
+         parseXmlSection();
+      }
+      catch ( ... )
+      {
+         delete file_;
+         file_ = nullptr;
 
-         parser.init();
+         throw;
+      }
+   }
 
-         // Create input source (XML section of E57 file turned into a stream).
-         E57XmlFileInputSource xmlSection( file_, xmlLogicalOffset_, xmlLogicalLength_ );
+   void ImageFileImpl::constructAppend()
+   {
+      // Read the existing file in full, then write new binary sections after everything in it.
+      // The old XML section is left where it is, and only stops being used when close() writes
+      // a new one and points the header at it. Until then the file on the disk is unchanged
+      // apart from what is past its end.
+      ImageFileImplSharedPtr imf = shared_from_this();
 
-         unusedLogicalStart_ = sizeof( E57FileHeader );
+      try
+      {
+         file_ = new CheckedFile( fileName_, CheckedFile::ReadWrite, checksumPolicy );
+         file_->setStatistics( &statistics_ );
+         file_->setExecutor( executor_ );
 
-         // Do the parse, building up the node tree
-         parser.parse( xmlSection );
+         if ( verifyChecksumThreadCount_ > 0 )
+         {
+            file_->verifyChecksums( verifyChecksumThreadCount_ );
+         }
+
+         std::shared_ptr<StructureNodeImpl> root( new StructureNodeImpl( imf ) );
+         root_ = root;
+         root_->setAttachedRecursive();
+
+         E57FileHeader header;
+         readFileHeader( file_, header );
+
+         xmlLogicalOffset_ = file_->physicalToLogical( header.xmlPhysicalOffset );
+         xmlLogicalLength_ = header.xmlLogicalLength;
+
+         // The whole tree is written out again by close(), so none of it can be left unparsed
+         lazyLoadXml_ = false;
+
+         parseXmlSection();
+
+         appendPhysicalLength_ = header.filePhysicalLength;
+         unusedLogicalStart_ = file_->length( CheckedFile::Logical );
+         isWriter_ = true;
+      }
+      catch ( ... )
+      {
+         delete file_;
+         file_ = nullptr;
+
+         throw;
+      }
+   }
+
+   bool ImageFileImpl::constructFollow()
+   {
+      // Without a journal the file is complete (or was never journaled), and is read as usual
+      JournalHeader journalHeader;
+      std::string xml;
+
+      if ( !readJournal( fileName_, journalHeader, xml ) )
+      {
+         return false;
+      }
+
+      ImageFileImplSharedPtr imf = shared_from_this();
+
+      try
+      {
+         // Opened after the journal was read, so the file holds at least what it describes
+         file_ = new CheckedFile( fileName_, CheckedFile::ReadGrowing, checksumPolicy );
+         file_->setStatistics( &statistics_ );
+         file_->setExecutor( executor_ );
+
+         std::shared_ptr<StructureNodeImpl> root( new StructureNodeImpl( imf ) );
+         root_ = root;
+         root_->setAttachedRecursive();
+
+         following_ = true;
+         followJournal( journalHeader );
+
+         // refresh() goes through the whole tree, so none of it can be left unparsed
+         lazyLoadXml_ = false;
+
+#ifdef E57_ENABLE_STATISTICS
+         StatisticsTimer timer( &statistics_.xmlParseNanoseconds );
+#endif
+
+         E57XmlParser parser( imf );
+
+         parser.init( validateXml_ );
+         parser.parse( xml );
       }
       catch ( ... )
       {
@@ -179,17 +348,206 @@ namespace e57
 
          throw;
       }
+
+      return true;
+   }
+
+   void ImageFileImpl::followJournal( const JournalHeader &journalHeader )
+   {
+      if ( journalHeader.unusedLogicalStart > file_->length( CheckedFile::Logical ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadFileLength,
+                               "fileName=" + fileName_ + " journalLength=" +
+                                  toString( journalHeader.unusedLogicalStart ) );
+      }
+
+      followedSectionLogicalStart_ = journalHeader.sectionLogicalStart;
+      followedSectionLogicalLength_ = journalHeader.sectionLogicalLength;
+      followedDataPhysicalOffset_ = journalHeader.dataPhysicalOffset;
+   }
+
+   bool ImageFileImpl::refresh()
+   {
+      checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+
+      if ( !following_ )
+      {
+         return false;
+      }
+
+      JournalHeader journalHeader;
+      std::string xml;
+
+      const bool journaled = readJournal( fileName_, journalHeader, xml );
+
+      // The journal only describes what is already in the file, so look at the file after it
+      file_->refreshLength();
+
+      if ( journaled )
+      {
+         followJournal( journalHeader );
+
+         return refreshNodes( xml );
+      }
+
+      // The journal is removed once the writer has closed the file, so it is complete now
+      E57FileHeader header;
+
+      file_->seek( 0 );
+      readFileHeader( file_, header );
+
+      xmlLogicalOffset_ = file_->physicalToLogical( header.xmlPhysicalOffset );
+      xmlLogicalLength_ = header.xmlLogicalLength;
+
+      xml.resize( static_cast<size_t>( xmlLogicalLength_ ) );
+      file_->readAt( xmlLogicalOffset_, &xml[0], xml.size() );
+
+      following_ = false;
+      followedSectionLogicalStart_ = 0;
+
+      refreshNodes( xml );
+
+      return true;
+   }
+
+   // Give the CompressedVectorNodes under node the records of the ones in the same place under
+   // latest, returning whether any of them changed. Nodes which are only under latest are left
+   // out.
+   static bool refreshNode( const NodeImplSharedPtr &node, const NodeImplSharedPtr &latest )
+   {
+      if ( node->type() != latest->type() )
+      {
+         return false;
+      }
+
+      switch ( node->type() )
+      {
+         case TypeStructure:
+         case TypeVector:
+         {
+            const auto structure = std::static_pointer_cast<StructureNodeImpl>( node );
+            const auto latestStructure = std::static_pointer_cast<StructureNodeImpl>( latest );
+            const int64_t childCount =
+               std::min( structure->childCount(), latestStructure->childCount() );
+
+            bool changed = false;
+
+            for ( int64_t i = 0; i < childCount; ++i )
+            {
+               const NodeImplSharedPtr child = structure->get( i );
+               const NodeImplSharedPtr latestChild = latestStructure->get( i );
+
+               if ( ( child->elementName() == latestChild->elementName() ) &&
+                    refreshNode( child, latestChild ) )
+               {
+                  changed = true;
+               }
+            }
+
+            return changed;
+         }
+
+         case TypeCompressedVector:
+         {
+            const auto cv = std::static_pointer_cast<CompressedVectorNodeImpl>( node );
+            const auto latestCv = std::static_pointer_cast<CompressedVectorNodeImpl>( latest );
+
+            if ( ( cv->getRecordCount() == latestCv->getRecordCount() ) &&
+                 ( cv->getBinarySectionLogicalStart() ==
+                   latestCv->getBinarySectionLogicalStart() ) )
+            {
+               return false;
+            }
+
+            cv->setRecordCount( latestCv->getRecordCount() );
+            cv->setBinarySectionLogicalStart( latestCv->getBinarySectionLogicalStart() );
+
+            return true;
+         }
+
+         default:
+            return false;
+      }
+   }
+
+   bool ImageFileImpl::refreshNodes( const std::string &xml )
+   {
+      // Build the tree the XML describes in a file of its own, then copy the records over
+      ImageFileOptions options;
+      options.validateXml = validateXml_;
+      options.executor = executor_;
+
+      auto latest = std::make_shared<ImageFileImpl>( options );
+
+      // The nodes can only be used while their file is open, so lend it ours
+      latest->fileName_ = fileName_;
+      latest->file_ = file_;
+
+      bool changed = false;
+
+      try
+      {
+         std::shared_ptr<StructureNodeImpl> root( new StructureNodeImpl( latest ) );
+         latest->root_ = root;
+         latest->root_->setAttachedRecursive();
+
+         {
+#ifdef E57_ENABLE_STATISTICS
+            StatisticsTimer timer( &statistics_.xmlParseNanoseconds );
+#endif
+
+            E57XmlParser parser( latest );
+
+            parser.init( validateXml_ );
+            parser.parse( xml );
+         }
+
+         changed = refreshNode( root_, latest->root_ );
+      }
+      catch ( ... )
+      {
+         latest->file_ = nullptr;
+         throw;
+      }
+
+      latest->file_ = nullptr;
+
+      return changed;
+   }
+
+   void ImageFileImpl::readSectionHeader( uint64_t sectionLogicalStart,
+                                          CompressedVectorSectionHeader &header ) const
+   {
+      if ( following_ && ( sectionLogicalStart == followedSectionLogicalStart_ ) )
+      {
+         header.sectionLogicalLength = followedSectionLogicalLength_;
+         header.dataPhysicalOffset = followedDataPhysicalOffset_;
+         header.indexPhysicalOffset = 0;
+         return;
+      }
+
+      file_->readAt( sectionLogicalStart, reinterpret_cast<char *>( &header ), sizeof( header ) );
    }
 
    void ImageFileImpl::construct2( const char *input, const uint64_t size )
+   {
+      construct2( std::make_shared<MemoryReadSource>( input, size, "<StreamBuffer>" ) );
+   }
+
+   void ImageFileImpl::construct2( const std::shared_ptr<ReadSource> &source )
    {
       // Second phase of construction, now we have a well-formed ImageFile object.
 
+      if ( source == nullptr )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "source=nullptr" );
+      }
+
 #ifdef E57_VERBOSE
-      std::cout << "ImageFileImpl() called, fileName=<StreamBuffer> mode=r" << std::endl;
+      std::cout << "ImageFileImpl() called, fileName=" << source->name() << " mode=r" << std::endl;
 #endif
       unusedLogicalStart_ = sizeof( E57FileHeader );
-      fileName_ = "<StreamBuffer>";
+      fileName_ = source->name();
 
       // Get shared_ptr to this object
       ImageFileImplSharedPtr imf = shared_from_this();
@@ -200,7 +558,14 @@ namespace e57
       try
       {
          // Open file for reading.
-         file_ = new CheckedFile( input, size, checksumPolicy );
+         file_ = new CheckedFile( source, checksumPolicy );
+         file_->setStatistics( &statistics_ );
+         file_->setExecutor( executor_ );
+
+         if ( verifyChecksumThreadCount_ > 0 )
+         {
+            file_->verifyChecksums( verifyChecksumThreadCount_ );
+         }
 
          std::shared_ptr<StructureNodeImpl> root( new StructureNodeImpl( imf ) );
          root_ = root;
@@ -222,18 +587,53 @@ namespace e57
 
       try
       {
-         // Create parser state, attach its event handers to the SAX2 reader
-         E57XmlParser parser( imf );
+         parseXmlSection();
+      }
+      catch ( ... )
+      {
+         delete file_;
+         file_ = nullptr;
+
+         throw;
+      }
+   }
 
-         parser.init();
+   void ImageFileImpl::construct2( const std::shared_ptr<WriteSink> &sink )
+   {
+      // Second phase of construction, now we have a well-formed ImageFile object.
 
-         // Create input source (XML section of E57 file turned into a stream).
-         E57XmlFileInputSource xmlSection( file_, xmlLogicalOffset_, xmlLogicalLength_ );
+      if ( sink == nullptr )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "sink=nullptr" );
+      }
 
-         unusedLogicalStart_ = sizeof( E57FileHeader );
+#ifdef E57_VERBOSE
+      std::cout << "ImageFileImpl() called, fileName=" << sink->name() << " mode=w" << std::endl;
+#endif
+      unusedLogicalStart_ = sizeof( E57FileHeader );
+      fileName_ = sink->name();
 
-         // Do the parse, building up the node tree
-         parser.parse( xmlSection );
+      // Get shared_ptr to this object
+      ImageFileImplSharedPtr imf = shared_from_this();
+
+      isWriter_ = true;
+      file_ = nullptr;
+
+      // Journals are files next to the one written, which a sink doesn't have
+      journalInterval_ = 0;
+
+      try
+      {
+         file_ = new CheckedFile( sink, checksumPolicy );
+         file_->setStatistics( &statistics_ );
+         file_->setExecutor( executor_ );
+
+         std::shared_ptr<StructureNodeImpl> root( new StructureNodeImpl( imf ) );
+         root_ = root;
+         root_->setAttachedRecursive();
+
+         xmlLogicalOffset_ = 0;
+         xmlLogicalLength_ = 0;
       }
       catch ( ... )
       {
@@ -244,6 +644,86 @@ namespace e57
       }
    }
 
+   void ImageFileImpl::parseXmlSection()
+   {
+#ifdef E57_ENABLE_STATISTICS
+      StatisticsTimer timer( &statistics_.xmlParseNanoseconds );
+#endif
+
+      // Create parser state, attach its event handers to the SAX2 reader
+      E57XmlParser parser( shared_from_this() );
+
+      parser.init( validateXml_ );
+
+      unusedLogicalStart_ = sizeof( E57FileHeader );
+
+      if ( !lazyLoadXml_ )
+      {
+         // Create input source (XML section of E57 file turned into a stream).
+         E57XmlFileInputSource xmlSection( file_, xmlLogicalOffset_, xmlLogicalLength_ );
+
+         // Do the parse, building up the node tree
+         parser.parse( xmlSection );
+         return;
+      }
+
+      // Cut the content of the Data3D and Image2D structures out of the XML section, so only
+      // what is left is parsed now.
+      std::string pruned;
+      std::vector<std::string> fragments;
+
+      // Held until the pruned XML is parsed; the fragments are counted by their structures
+      MemoryCharge xmlCharge( memoryAccount_, MemoryAccount::Xml, 2 * xmlLogicalLength_ );
+
+      {
+         std::string xml( static_cast<size_t>( xmlLogicalLength_ ), '\0' );
+
+         file_->readAt( xmlLogicalOffset_, &xml[0], xml.size() );
+
+         if ( !pruneXml( xml, pruned, fragments ) )
+         {
+            // Let the parser report what is wrong with it
+            pruned = std::move( xml );
+         }
+      }
+
+      parser.setDeferredXml( fragments );
+      parser.parse( pruned );
+   }
+
+   void ImageFileImpl::loadDeferredXml( const std::shared_ptr<StructureNodeImpl> &target,
+                                        const std::string &xml )
+   {
+      // Wrap the XML in an element declaring the namespaces, which are only declared on the
+      // root in the file.
+      ustring document = "<libE57Fragment type=\"Structure\"";
+
+      for ( const auto &nameSpace : nameSpaces_ )
+      {
+         if ( nameSpace.prefix.empty() )
+         {
+            document += " xmlns=\"";
+         }
+         else
+         {
+            document += " xmlns:" + nameSpace.prefix + "=\"";
+         }
+
+         document += nameSpace.uri + "\"";
+      }
+
+      document += ">" + xml + "</libE57Fragment>";
+
+#ifdef E57_ENABLE_STATISTICS
+      StatisticsTimer timer( &statistics_.xmlParseNanoseconds );
+#endif
+
+      E57XmlParser parser( shared_from_this(), target );
+
+      parser.init( validateXml_ );
+      parser.parse( document );
+   }
+
    std::shared_ptr<StructureNodeImpl> ImageFileImpl::root()
    {
       checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
@@ -263,21 +743,9 @@ namespace e57
       {
          // Go to end of file, note physical position
          xmlLogicalOffset_ = unusedLogicalStart_;
-         file_->seek( xmlLogicalOffset_, CheckedFile::Logical );
-         uint64_t xmlPhysicalOffset = file_->position( CheckedFile::Physical );
-         *file_ << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+         uint64_t xmlPhysicalOffset = CheckedFile::logicalToPhysical( xmlLogicalOffset_ );
 
-         //??? need to add name space attributes to e57Root
-         root_->writeXml( shared_from_this(), *file_, 0, "e57Root" );
-
-         // Pad XML section so length is multiple of 4
-         while ( ( file_->position( CheckedFile::Logical ) - xmlLogicalOffset_ ) % 4 != 0 )
-         {
-            *file_ << " ";
-         }
-
-         // Note logical length
-         xmlLogicalLength_ = file_->position( CheckedFile::Logical ) - xmlLogicalOffset_;
+         xmlLogicalLength_ = writeXmlSection( *file_, xmlLogicalOffset_ );
 
          // Init header contents
          E57FileHeader header;
@@ -299,10 +767,246 @@ namespace e57
          file_->write( reinterpret_cast<char *>( &header ), sizeof( header ) );
 
          file_->close();
+
+         // The file is complete, so the journal isn't needed any more
+         if ( journalInterval_ > 0 )
+         {
+            std::remove( journalFileName( fileName_ ).c_str() );
+         }
       }
 
       delete file_;
       file_ = nullptr;
+
+      // Give back the shared packets' memory
+      std::lock_guard<std::mutex> lock( sharedPacketCacheMutex_ );
+      sharedPacketCache_.reset();
+   }
+
+   uint64_t ImageFileImpl::writeXmlSection( CheckedFile &cf, uint64_t logicalOffset )
+   {
+      cf.seek( logicalOffset, CheckedFile::Logical );
+      cf << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+
+      //??? need to add name space attributes to e57Root
+      root_->writeXml( shared_from_this(), cf, 0, "e57Root" );
+
+      // Pad XML section so length is multiple of 4
+      while ( ( cf.position( CheckedFile::Logical ) - logicalOffset ) % 4 != 0 )
+      {
+         cf << " ";
+      }
+
+      // Note logical length
+      return cf.position( CheckedFile::Logical ) - logicalOffset;
+   }
+
+   void ImageFileImpl::writeJournal( CompressedVectorNodeImpl *openNode,
+                                     uint64_t sectionLogicalStart, uint64_t dataPhysicalOffset,
+                                     uint64_t recordCount )
+   {
+      JournalHeader header;
+      header.unusedLogicalStart = unusedLogicalStart_;
+
+      if ( openNode != nullptr )
+      {
+         header.sectionLogicalStart = sectionLogicalStart;
+         header.sectionLogicalLength = unusedLogicalStart_ - sectionLogicalStart;
+         header.dataPhysicalOffset = dataPhysicalOffset;
+      }
+
+      // Write the journal beside the old one, then replace it, so there is always a whole one
+      const ustring journalName = journalFileName( fileName_ );
+      const ustring newJournalName = journalName + ".new";
+
+      CheckedFile journal( newJournalName, CheckedFile::Write, ChecksumAll );
+
+      try
+      {
+         // The open writer's node is described as if it were closed after its records so far
+         if ( openNode != nullptr )
+         {
+            const int64_t savedRecordCount = openNode->getRecordCount();
+            const uint64_t savedLogicalStart = openNode->getBinarySectionLogicalStart();
+
+            openNode->setRecordCount( static_cast<int64_t>( recordCount ) );
+            openNode->setBinarySectionLogicalStart( sectionLogicalStart );
+
+            try
+            {
+               header.xmlLogicalLength = writeXmlSection( journal, sizeof( header ) );
+            }
+            catch ( ... )
+            {
+               openNode->setRecordCount( savedRecordCount );
+               openNode->setBinarySectionLogicalStart( savedLogicalStart );
+               throw;
+            }
+
+            openNode->setRecordCount( savedRecordCount );
+            openNode->setBinarySectionLogicalStart( savedLogicalStart );
+         }
+         else
+         {
+            header.xmlLogicalLength = writeXmlSection( journal, sizeof( header ) );
+         }
+
+         journal.seek( 0 );
+         journal.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+         journal.close();
+      }
+      catch ( ... )
+      {
+         journal.unlink();
+         throw;
+      }
+
+#if defined( _WIN32 )
+      // rename() doesn't replace files on Windows, and removing the old journal first would
+      // leave a moment with none
+#if defined( _MSC_VER )
+      std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+
+      const bool renamed =
+         ::MoveFileExW( converter.from_bytes( newJournalName ).c_str(),
+                        converter.from_bytes( journalName ).c_str(),
+                        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+      const bool renamed =
+         ::MoveFileExA( newJournalName.c_str(), journalName.c_str(),
+                        MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#endif
+#else
+      const bool renamed = ( std::rename( newJournalName.c_str(), journalName.c_str() ) == 0 );
+#endif
+
+      if ( !renamed )
+      {
+         throw E57_EXCEPTION2( ErrorWriteFailed, "fileName=" + journalName );
+      }
+   }
+
+   bool ImageFileImpl::readJournal( const ustring &fileName, JournalHeader &journalHeader,
+                                    std::string &xml )
+   {
+      const ustring journalName = journalFileName( fileName );
+
+      std::unique_ptr<CheckedFile> journal;
+
+      try
+      {
+         journal.reset( new CheckedFile( journalName, CheckedFile::Read, ChecksumAll ) );
+      }
+      catch ( E57Exception &ex )
+      {
+         if ( ex.errorCode() == ErrorOpenFailed )
+         {
+            return false;
+         }
+
+         throw;
+      }
+
+      if ( journal->length( CheckedFile::Logical ) < sizeof( journalHeader ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadFileLength, "fileName=" + journalName );
+      }
+
+      journal->readAt( 0, reinterpret_cast<char *>( &journalHeader ), sizeof( journalHeader ) );
+
+      const JournalHeader expected;
+      const uint64_t xmlSpace = journal->length( CheckedFile::Logical ) - sizeof( journalHeader );
+
+      if ( ( memcmp( journalHeader.signature, expected.signature, 8 ) != 0 ) ||
+           ( journalHeader.xmlLogicalLength > xmlSpace ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadFileSignature, "fileName=" + journalName );
+      }
+
+      xml.resize( static_cast<size_t>( journalHeader.xmlLogicalLength ) );
+      journal->readAt( sizeof( journalHeader ), &xml[0], xml.size() );
+
+      journal->close();
+
+      return true;
+   }
+
+   void ImageFileImpl::recover( const ustring &fileName )
+   {
+      const ustring journalName = journalFileName( fileName );
+
+      JournalHeader journalHeader;
+      std::string xml;
+
+      if ( !readJournal( fileName, journalHeader, xml ) )
+      {
+         throw E57_EXCEPTION2( ErrorOpenFailed, "fileName=" + journalName );
+      }
+
+      // Pages after the ones the journal covers may have been only partly written, and are
+      // overwritten below, so checksums aren't checked when reading them back.
+      CheckedFile file( fileName, CheckedFile::ReadWrite, ChecksumNone );
+
+      E57FileHeader header;
+
+      if ( file.length( CheckedFile::Logical ) >= sizeof( header ) )
+      {
+         file.readAt( 0, reinterpret_cast<char *>( &header ), sizeof( header ) );
+      }
+
+      // If the file was closed after the journal was written, it is already complete
+      if ( ( strncmp( header.fileSignature, "ASTM-E57", 8 ) == 0 ) &&
+           ( header.filePhysicalLength == file.length( CheckedFile::Physical ) ) )
+      {
+         file.close();
+         std::remove( journalName.c_str() );
+         return;
+      }
+
+      if ( journalHeader.unusedLogicalStart > file.length( CheckedFile::Logical ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadFileLength,
+                               "fileName=" + fileName + " journalLength=" +
+                                  toString( journalHeader.unusedLogicalStart ) );
+      }
+
+      // Finish the section of the writer which was open, without its index packets
+      if ( journalHeader.sectionLogicalStart != 0 )
+      {
+         CompressedVectorSectionHeader sectionHeader;
+         sectionHeader.sectionLogicalLength = journalHeader.sectionLogicalLength;
+         sectionHeader.dataPhysicalOffset = journalHeader.dataPhysicalOffset;
+         sectionHeader.indexPhysicalOffset = 0;
+
+         file.seek( journalHeader.sectionLogicalStart );
+         file.write( reinterpret_cast<const char *>( &sectionHeader ), sizeof( sectionHeader ) );
+      }
+
+      // Put the XML section after what the journal covers, and drop everything after it
+      file.seek( journalHeader.unusedLogicalStart );
+      file.write( xml.data(), xml.size() );
+
+      const uint64_t xmlLogicalEnd = journalHeader.unusedLogicalStart + xml.size();
+      const uint64_t pageCount =
+         ( xmlLogicalEnd + CheckedFile::logicalPageSize - 1 ) / CheckedFile::logicalPageSize;
+
+      file.truncate( pageCount * CheckedFile::physicalPageSize );
+
+      memcpy( &header.fileSignature, "ASTM-E57", 8 );
+
+      header.majorVersion = E57_FORMAT_MAJOR;
+      header.minorVersion = E57_FORMAT_MINOR;
+      header.filePhysicalLength = file.length( CheckedFile::Physical );
+      header.xmlPhysicalOffset = CheckedFile::logicalToPhysical( journalHeader.unusedLogicalStart );
+      header.xmlLogicalLength = xml.size();
+      header.pageSize = CheckedFile::physicalPageSize;
+
+      file.seek( 0 );
+      file.write( reinterpret_cast<const char *>( &header ), sizeof( header ) );
+
+      file.close();
+
+      std::remove( journalName.c_str() );
    }
 
    void ImageFileImpl::cancel()
@@ -315,10 +1019,28 @@ namespace e57
 
       // Close the file and ulink (delete) it.
       // It is legal to cancel a read file, but file isn't deleted.
-      if ( isWriter_ )
+      // A file being appended to goes back to what it was.
+      if ( appendPhysicalLength_ > 0 )
+      {
+         try
+         {
+            file_->truncate( appendPhysicalLength_ );
+            file_->close();
+         }
+         catch ( ... )
+         {
+            // cancel() doesn't throw
+         }
+      }
+      else if ( isWriter_ )
       {
          file_->unlink();
       }
+
+      if ( isWriter_ && ( journalInterval_ > 0 ) )
+      {
+         std::remove( journalFileName( fileName_ ).c_str() );
+      }
       else
       {
          file_->close();
@@ -348,6 +1070,70 @@ namespace e57
       return readerCount_;
    }
 
+   void ImageFileImpl::verifyChecksums( unsigned threadCount )
+   {
+      checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+
+      if ( isWriter_ )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "fileName=" + fileName_ );
+      }
+
+      file_->verifyChecksums( threadCount );
+   }
+
+   void ImageFileImpl::reserveSpace( uint64_t byteCount )
+   {
+      checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+
+      if ( !isWriter_ )
+      {
+         throw E57_EXCEPTION2( ErrorFileReadOnly, "fileName=" + fileName_ );
+      }
+
+      file_->reserve( byteCount );
+   }
+
+   ImageFileStatistics ImageFileImpl::statistics() const
+   {
+      return statistics_.snapshot();
+   }
+
+   void ImageFileImpl::resetStatistics()
+   {
+      statistics_.reset();
+   }
+
+   std::shared_ptr<SharedPacketCache> ImageFileImpl::sharedPacketCache()
+   {
+      std::lock_guard<std::mutex> lock( sharedPacketCacheMutex_ );
+
+      // Packets of a file which is being written (or followed) may still change
+      if ( ( sharedPacketCacheSize_ == 0 ) || isWriter_ || following_ ||
+           ( file_ == nullptr ) || !file_->isReadOnly() )
+      {
+         return nullptr;
+      }
+
+      if ( sharedPacketCache_ == nullptr )
+      {
+         sharedPacketCache_ =
+            std::make_shared<SharedPacketCache>( sharedPacketCacheSize_, memoryAccount_ );
+      }
+
+      return sharedPacketCache_;
+   }
+
+   ImageFileMemoryUsage ImageFileImpl::memoryUsage() const
+   {
+      return memoryAccount_->snapshot();
+   }
+
+   void ImageFileImpl::setMemoryBudget( uint64_t byteCount )
+   {
+      memoryAccount_->setBudget( byteCount );
+   }
+
    ImageFileImpl::~ImageFileImpl()
    {
       // Try to cancel if not already closed, but don't allow any exceptions to propagate to caller
@@ -477,6 +1263,23 @@ namespace e57
       return nameSpaces_[index].uri; //??? throw e57 exception here if out of bounds?
    }
 
+   InternedName ImageFileImpl::internName( const ustring &name )
+   {
+      // Nodes may be added while another thread is parsing deferred XML
+      std::lock_guard<std::mutex> lock( internedNamesMutex_ );
+
+      const auto found = internedNames_.find( std::cref( name ) );
+      if ( found != internedNames_.end() )
+      {
+         return found->second;
+      }
+
+      auto interned = std::make_shared<const ustring>( name );
+      internedNames_.emplace( std::cref( *interned ), interned );
+
+      return interned;
+   }
+
    bool ImageFileImpl::isElementNameExtended( const ustring &elementName )
    {
       // don't checkImageFileOpen
@@ -662,21 +1465,47 @@ namespace e57
 #endif
    }
 
-   void ImageFileImpl::incrWriterCount()
+   bool ImageFileImpl::tryAddWriter( bool staged )
    {
+      std::lock_guard<std::mutex> lock( writerCountMutex_ );
+
+      // Writers which stage their section in memory only use the file when they close, so any
+      // number of them can be open at once (but not alongside one writing straight to the file).
+      const bool onlyStagedWriters = staged && ( stagedWriterCount_ == writerCount_ );
+
+      if ( ( writerCount_ > 0 ) && !onlyStagedWriters )
+      {
+         return false;
+      }
+
       writerCount_++;
+
+      if ( staged )
+      {
+         stagedWriterCount_++;
+      }
+
+      return true;
    }
 
-   void ImageFileImpl::decrWriterCount()
+   void ImageFileImpl::decrWriterCount( bool staged )
    {
+      std::lock_guard<std::mutex> lock( writerCountMutex_ );
+
       writerCount_--;
 
+      if ( staged )
+      {
+         stagedWriterCount_--;
+      }
+
 #if ( E57_VALIDATION_LEVEL == VALIDATION_DEEP )
       if ( writerCount_ < 0 )
       {
-         throw E57_EXCEPTION2( ErrorInternal, "fileName=" + fileName_ +
-                                                 " writerCount=" + toString( writerCount_ ) +
-                                                 " readerCount=" + toString( readerCount_ ) );
+         throw E57_EXCEPTION2( ErrorInternal,
+                               "fileName=" + fileName_ +
+                                  " writerCount=" + toString( writerCount_.load() ) +
+                                  " readerCount=" + toString( readerCount_.load() ) );
       }
 #endif
    }
@@ -693,9 +1522,10 @@ namespace e57
 #if ( E57_VALIDATION_LEVEL == VALIDATION_DEEP )
       if ( readerCount_ < 0 )
       {
-         throw E57_EXCEPTION2( ErrorInternal, "fileName=" + fileName_ +
-                                                 " writerCount=" + toString( writerCount_ ) +
-                                                 " readerCount=" + toString( readerCount_ ) );
+         throw E57_EXCEPTION2( ErrorInternal,
+                               "fileName=" + fileName_ +
+                                  " writerCount=" + toString( writerCount_.load() ) +
+                                  " readerCount=" + toString( readerCount_.load() ) );
       }
 #endif
    }
@@ -813,7 +1643,9 @@ namespace e57
       // position of the first 1 (from left) in the binary form of stateCountMinus1.
       //??? move to E57Utility?
 
-      uint64_t stateCountMinus1 = maximum - minimum;
+      // Subtract as unsigned so the full int64_t range doesn't overflow
+      uint64_t stateCountMinus1 =
+         static_cast<uint64_t>( maximum ) - static_cast<uint64_t>( minimum );
 
       unsigned log2 = 0;
 
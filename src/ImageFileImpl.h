@@ -27,33 +27,53 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "Common.h"
+#include "MemoryAccount.h"
+#include "Statistics.h"
 
 namespace e57
 {
    class CheckedFile;
 
+   class NodeArena;
+   class SharedPacketCache;
+   struct CompressedVectorSectionHeader;
    struct E57FileHeader;
+   struct JournalHeader;
    struct NameSpace;
 
    class ImageFileImpl : public std::enable_shared_from_this<ImageFileImpl>
    {
    public:
-      explicit ImageFileImpl( ReadChecksumPolicy policy );
+      explicit ImageFileImpl( const ImageFileOptions &options );
 
       void construct2( const ustring &fileName, const ustring &mode );
       void construct2( const char *input, uint64_t size );
+      void construct2( const std::shared_ptr<ReadSource> &source );
+      void construct2( const std::shared_ptr<WriteSink> &sink );
 
       std::shared_ptr<StructureNodeImpl> root();
 
       void close();
       void cancel();
+      static void recover( const ustring &fileName );
+      bool refresh();
       bool isOpen() const;
       bool isWriter() const;
       int writerCount() const;
       int readerCount() const;
+      void verifyChecksums( unsigned threadCount );
+      void reserveSpace( uint64_t byteCount );
+      ImageFileStatistics statistics() const;
+      void resetStatistics();
+      ImageFileMemoryUsage memoryUsage() const;
+      void setMemoryBudget( uint64_t byteCount );
       ~ImageFileImpl();
 
       uint64_t allocateSpace( uint64_t byteCount, bool doExtendNow );
@@ -68,6 +88,10 @@ namespace e57
       ustring extensionsPrefix( size_t index ) const;
       ustring extensionsUri( size_t index ) const;
 
+      /// Return the shared copy of @a name, so nodes with the same element name don't each
+      /// allocate their own.
+      InternedName internName( const ustring &name );
+
       /// Utility functions:
       bool isElementNameExtended( const ustring &elementName );
       bool isElementNameLegal( const ustring &elementName, bool allowNumber = true );
@@ -77,8 +101,53 @@ namespace e57
       void pathNameCheckWellFormed( const ustring &pathName );
       void pathNameParse( const ustring &pathName, bool &isRelative, StringList &fields );
 
-      void incrWriterCount();
-      void decrWriterCount();
+      /// Number of data packets between journals (see ImageFileOptions::journalInterval)
+      unsigned journalInterval() const
+      {
+         return journalInterval_;
+      }
+
+      /// Where the file's parallel work runs (see ImageFileOptions::executor)
+      const std::shared_ptr<Executor> &executor() const
+      {
+         return executor_;
+      }
+
+      /// What the file's memory is counted in (see ImageFile::memoryUsage())
+      const std::shared_ptr<MemoryAccount> &memoryAccount() const
+      {
+         return memoryAccount_;
+      }
+
+      /// The packets shared by the file's readers (see ImageFileOptions::sharedPacketCacheSize),
+      /// made the first time it is asked for, or nullptr if they don't share any
+      std::shared_ptr<SharedPacketCache> sharedPacketCache();
+
+      /// Whether the file is being read while it is written (see ImageFileOptions::follow)
+      bool isFollowing() const
+      {
+         return following_;
+      }
+
+      /// Read the header of the binary section at @a sectionLogicalStart. The section being
+      /// written in a followed file only has its header once its writer closes, so until then
+      /// the header is made from the journal.
+      void readSectionHeader( uint64_t sectionLogicalStart,
+                              CompressedVectorSectionHeader &header ) const;
+
+      /// Write the journal of what the file holds so far. If a CompressedVectorWriter is open on
+      /// @a openNode, its first @a recordCount records are in the packets from
+      /// @a dataPhysicalOffset to the end of the file, after its section header at
+      /// @a sectionLogicalStart.
+      void writeJournal( CompressedVectorNodeImpl *openNode = nullptr,
+                         uint64_t sectionLogicalStart = 0, uint64_t dataPhysicalOffset = 0,
+                         uint64_t recordCount = 0 );
+
+      /// Count a new writer, staged if it uses stageInMemory, unless the ones already open
+      /// don't allow it. The check and the count are done together, so two writers opened at
+      /// once on different threads can't both pass the check.
+      bool tryAddWriter( bool staged );
+      void decrWriterCount( bool staged = false );
       void incrReaderCount();
       void decrReaderCount();
 
@@ -96,23 +165,96 @@ namespace e57
    private:
       friend class E57XmlParser;
       friend class BlobNodeImpl;
+      friend class CompressedVectorNodeImpl;
       friend class CompressedVectorWriterImpl;
       friend class CompressedVectorReaderImpl;
+      friend class StructureNodeImpl;
 
       static void readFileHeader( CheckedFile *file, E57FileHeader &header );
 
+      /// Second phase of construction for append mode ("a")
+      void constructAppend();
+
+      /// Second phase of construction for following a file through its journal (see
+      /// ImageFileOptions::follow). Returns false if it has no journal, so is complete.
+      bool constructFollow();
+
+      /// Read the journal of @a fileName, returning false if it has none
+      static bool readJournal( const ustring &fileName, JournalHeader &journalHeader,
+                               std::string &xml );
+
+      /// Take the state of the file from its journal
+      void followJournal( const JournalHeader &journalHeader );
+
+      /// Bring the CompressedVectorNodes of the tree up to date with @a xml, returning whether
+      /// any of them changed
+      bool refreshNodes( const std::string &xml );
+
+      /// Write the XML section at @a logicalOffset in @a cf, returning its logical length
+      uint64_t writeXmlSection( CheckedFile &cf, uint64_t logicalOffset );
+
+      void parseXmlSection();
+
+      /// Parse deferred XML into the children of @a target (see ImageFileOptions::lazyLoadXml)
+      void loadDeferredXml( const std::shared_ptr<StructureNodeImpl> &target,
+                            const std::string &xml );
+
       void checkImageFileOpen( const char *srcFileName, int srcLineNumber,
                                const char *srcFunctionName ) const;
 
       ustring fileName_;
       bool isWriter_;
-      int writerCount_;
-      int readerCount_;
+
+      /// Atomic because readers of a file opened for reading, and writers which stage their
+      /// section in memory, may be opened and closed on different threads. The writer counts
+      /// are only changed with writerCountMutex_ held.
+      std::atomic<int> writerCount_;
+      /// Writers using stageInMemory (included in writerCount_)
+      std::atomic<int> stagedWriterCount_;
+      std::atomic<int> readerCount_;
+      std::mutex writerCountMutex_;
+
+      /// Held by staged writers while they write their section to the file
+      std::mutex stagedWriteMutex_;
 
       ReadChecksumPolicy checksumPolicy;
+      unsigned verifyChecksumThreadCount_;
+      bool lazyLoadXml_;
+      bool validateXml_;
+      bool directIo_;
+      unsigned journalInterval_;
+      bool follow_;
+
+      /// Where the file's parallel work runs (see ImageFileOptions::executor)
+      std::shared_ptr<Executor> executor_;
+
+      /// See ImageFileOptions::sharedPacketCacheSize, and sharedPacketCache()
+      unsigned sharedPacketCacheSize_;
+      std::shared_ptr<SharedPacketCache> sharedPacketCache_;
+      std::mutex sharedPacketCacheMutex_;
+
+      /// Whether the file is being read through its journal (see ImageFileOptions::follow), and
+      /// the section of its open writer (if any) as the journal describes it
+      bool following_ = false;
+      uint64_t followedSectionLogicalStart_ = 0;
+      uint64_t followedSectionLogicalLength_ = 0;
+      uint64_t followedDataPhysicalOffset_ = 0;
+
+      /// Memory for the nodes built from the XML section if using ImageFileOptions::useNodeArena
+      std::shared_ptr<NodeArena> nodeArena_;
+
+      /// Held while a structure's deferred XML is parsed. Recursive since the parser adds the
+      /// children through the same functions which trigger parsing.
+      std::recursive_mutex deferredXmlMutex_;
 
       CheckedFile *file_;
 
+      /// Counters for ImageFile::statistics()
+      Statistics statistics_;
+
+      /// Counts for ImageFile::memoryUsage()
+      std::shared_ptr<MemoryAccount> memoryAccount_;
+
       // Read file attributes
       uint64_t xmlLogicalOffset_;
       uint64_t xmlLogicalLength_;
@@ -120,9 +262,18 @@ namespace e57
       // Write file attributes
       uint64_t unusedLogicalStart_;
 
+      /// Physical length of the file before anything was added to it in append mode ("a"), or 0
+      uint64_t appendPhysicalLength_;
+
       /// Bidirectional map from namespace prefix to uri
       std::vector<NameSpace> nameSpaces_;
 
+      /// Element names used by the nodes, keyed by the names they hold
+      std::unordered_map<std::reference_wrapper<const ustring>, InternedName, std::hash<ustring>,
+                         std::equal_to<ustring>>
+         internedNames_;
+      std::mutex internedNamesMutex_;
+
       /// Smart pointer to metadata tree
       std::shared_ptr<StructureNodeImpl> root_;
    };
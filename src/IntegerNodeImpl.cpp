@@ -129,7 +129,7 @@ namespace e57
       }
       else
       {
-         fieldName = elementName_;
+         fieldName = elementNameRef();
       }
 
       cf << space( indent ) << "<" << fieldName << " type=\"Integer\"";
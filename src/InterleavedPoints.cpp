@@ -0,0 +1,244 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+
+#include "Common.h"
+#include "InterleavedPoints.h"
+#include "SourceDestBufferImpl.h"
+#include "StringFunctions.h"
+
+namespace
+{
+   // Size of a value of the memory type, or 0 if it isn't one we can use
+   size_t typeSize( e57::MemoryRepresentation type )
+   {
+      switch ( type )
+      {
+         case e57::Int8:
+         case e57::UInt8:
+            return 1;
+         case e57::Int16:
+         case e57::UInt16:
+            return 2;
+         case e57::Int32:
+         case e57::UInt32:
+         case e57::Real32:
+            return 4;
+         case e57::Int64:
+         case e57::Real64:
+            return 8;
+         case e57::Bool:
+            return sizeof( bool );
+         default:
+            return 0;
+      }
+   }
+
+   template <typename T> double valueAt( const char *data )
+   {
+      T value;
+      memcpy( &value, data, sizeof( T ) );
+
+      return static_cast<double>( value );
+   }
+
+   template <typename T>
+   e57::SourceDestBuffer offsetBuffer( const e57::ImageFile &imf,
+                                       const e57::SourceDestBuffer &buffer, size_t firstRecord,
+                                       size_t capacity )
+   {
+      char *base = static_cast<char *>( buffer.impl()->base() ) + firstRecord * buffer.stride();
+
+      e57::SourceDestBuffer result( imf, buffer.pathName(), reinterpret_cast<T *>( base ),
+                                    capacity, buffer.doConversion(), buffer.doScaling(),
+                                    buffer.stride() );
+      result.setOrigin( buffer.origin() );
+
+      return result;
+   }
+}
+
+namespace e57
+{
+   std::vector<SourceDestBuffer> interleavedBuffers( const ImageFile &imf,
+                                                     const Data3DPointsInterleaved &points,
+                                                     size_t pointCount )
+   {
+      if ( ( points.base == nullptr ) || ( points.stride == 0 ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "stride=" + toString( points.stride ) );
+      }
+
+      std::vector<SourceDestBuffer> buffers;
+      buffers.reserve( points.fields.size() );
+
+      for ( const auto &field : points.fields )
+      {
+         const size_t size = typeSize( field.type );
+
+         if ( ( size == 0 ) || ( points.stride < size ) || ( field.offset > points.stride - size ) )
+         {
+            throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                                  "name=" + field.name + " type=" + toString( field.type ) +
+                                     " offset=" + toString( field.offset ) +
+                                     " stride=" + toString( points.stride ) );
+         }
+
+         char *data = static_cast<char *>( points.base ) + field.offset;
+         const size_t stride = points.stride;
+
+         switch ( field.type )
+         {
+            case Int8:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<int8_t *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            case UInt8:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<uint8_t *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            case Int16:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<int16_t *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            case UInt16:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<uint16_t *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            case Int32:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<int32_t *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            case UInt32:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<uint32_t *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            case Int64:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<int64_t *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            case Bool:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<bool *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            case Real32:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<float *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            case Real64:
+               buffers.emplace_back( imf, field.name, reinterpret_cast<double *>( data ),
+                                     pointCount, true, true, stride );
+               break;
+            default:
+               break;
+         }
+      }
+
+      return buffers;
+   }
+
+   const Data3DPointField *findField( const Data3DPointsInterleaved &points, const ustring &name )
+   {
+      for ( const auto &field : points.fields )
+      {
+         if ( field.name == name )
+         {
+            return &field;
+         }
+      }
+
+      return nullptr;
+   }
+
+   double fieldValue( const Data3DPointsInterleaved &points, const Data3DPointField &field,
+                      size_t index )
+   {
+      const char *data =
+         static_cast<const char *>( points.base ) + index * points.stride + field.offset;
+
+      switch ( field.type )
+      {
+         case Int8:
+            return valueAt<int8_t>( data );
+         case UInt8:
+            return valueAt<uint8_t>( data );
+         case Int16:
+            return valueAt<int16_t>( data );
+         case UInt16:
+            return valueAt<uint16_t>( data );
+         case Int32:
+            return valueAt<int32_t>( data );
+         case UInt32:
+            return valueAt<uint32_t>( data );
+         case Int64:
+            return valueAt<int64_t>( data );
+         case Bool:
+            return valueAt<bool>( data );
+         case Real32:
+            return valueAt<float>( data );
+         case Real64:
+            return valueAt<double>( data );
+         default:
+            return 0.0;
+      }
+   }
+
+   SourceDestBuffer offsetBuffer( const ImageFile &imf, const SourceDestBuffer &buffer,
+                                  size_t firstRecord, size_t capacity )
+   {
+      switch ( buffer.memoryRepresentation() )
+      {
+         case Int8:
+            return ::offsetBuffer<int8_t>( imf, buffer, firstRecord, capacity );
+         case UInt8:
+            return ::offsetBuffer<uint8_t>( imf, buffer, firstRecord, capacity );
+         case Int16:
+            return ::offsetBuffer<int16_t>( imf, buffer, firstRecord, capacity );
+         case UInt16:
+            return ::offsetBuffer<uint16_t>( imf, buffer, firstRecord, capacity );
+         case Int32:
+            return ::offsetBuffer<int32_t>( imf, buffer, firstRecord, capacity );
+         case UInt32:
+            return ::offsetBuffer<uint32_t>( imf, buffer, firstRecord, capacity );
+         case Int64:
+            return ::offsetBuffer<int64_t>( imf, buffer, firstRecord, capacity );
+         case Bool:
+            return ::offsetBuffer<bool>( imf, buffer, firstRecord, capacity );
+         case Real32:
+            return ::offsetBuffer<float>( imf, buffer, firstRecord, capacity );
+         case Real64:
+            return ::offsetBuffer<double>( imf, buffer, firstRecord, capacity );
+         case Real16:
+            return ::offsetBuffer<Float16>( imf, buffer, firstRecord, capacity );
+         case Bits:
+         {
+            // Only whole bytes can be offset
+            const PackedBits bits = buffer.impl()->packedBits();
+
+            if ( ( firstRecord * bits.bitsPerValue ) % 8 == 0 )
+            {
+               return SourceDestBuffer(
+                  imf, buffer.pathName(),
+                  PackedBits{ bits.data + firstRecord * bits.bitsPerValue / 8, bits.bitsPerValue },
+                  capacity, buffer.doConversion(), buffer.doScaling() );
+            }
+
+            throw E57_EXCEPTION2( ErrorNotImplemented, "pathName=" + buffer.pathName() +
+                                                          " firstRecord=" +
+                                                          toString( firstRecord ) );
+         }
+         default:
+            // Strings have no stride
+            throw E57_EXCEPTION2( ErrorNotImplemented,
+                                  "pathName=" + buffer.pathName() + " memoryRepresentation=" +
+                                     toString( buffer.memoryRepresentation() ) );
+      }
+   }
+
+   bool bufferRange( const SourceDestBuffer &buffer, size_t count, double &minimum,
+                     double &maximum )
+   {
+      return buffer.impl()->valueRange( count, minimum, maximum );
+   }
+}
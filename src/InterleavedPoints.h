@@ -0,0 +1,38 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for reading and writing Data3DPointsInterleaved in the Simple API.
+
+#include <vector>
+
+#include "E57Format.h"
+#include "E57SimpleData.h"
+
+namespace e57
+{
+   /// Make a SourceDestBuffer for each field of @a points which reads or writes it in place.
+   /// Throws ErrorBadAPIArgument if @a points has no base or stride, or a field doesn't fit in the
+   /// stride or has a type which can't be used.
+   std::vector<SourceDestBuffer> interleavedBuffers( const ImageFile &imf,
+                                                     const Data3DPointsInterleaved &points,
+                                                     size_t pointCount );
+
+   /// The field of @a points called @a name, or nullptr if there isn't one.
+   const Data3DPointField *findField( const Data3DPointsInterleaved &points, const ustring &name );
+
+   /// The value of @a field of point @a index of @a points.
+   double fieldValue( const Data3DPointsInterleaved &points, const Data3DPointField &field,
+                      size_t index );
+
+   /// A buffer for @a capacity records of @a buffer starting at record @a firstRecord, in place.
+   /// Throws ErrorNotImplemented for a buffer of strings, or of packed bits when firstRecord
+   /// isn't at the start of a byte.
+   SourceDestBuffer offsetBuffer( const ImageFile &imf, const SourceDestBuffer &buffer,
+                                  size_t firstRecord, size_t capacity );
+
+   /// The lowest and highest of the first @a count values of @a buffer, skipping NaNs. Returns
+   /// false if there aren't any (or it holds strings).
+   bool bufferRange( const SourceDestBuffer &buffer, size_t count, double &minimum,
+                     double &maximum );
+}
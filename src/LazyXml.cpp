@@ -0,0 +1,292 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+
+#include "LazyXml.h"
+
+namespace
+{
+   struct Element
+   {
+      std::string name;
+      std::string type;
+      bool deferChildren = false; // heterogeneous /data3D or /images2D
+      bool isDeferred = false;    // content is being cut out
+      size_t contentStart = 0;
+   };
+
+   bool isSpace( char c )
+   {
+      return ( c == ' ' ) || ( c == '\t' ) || ( c == '\n' ) || ( c == '\r' );
+   }
+
+   bool startsWith( const std::string &xml, size_t pos, const char *prefix )
+   {
+      return xml.compare( pos, std::strlen( prefix ), prefix ) == 0;
+   }
+
+   /// Parse the start tag at @a pos (which is on the '<'). Sets @a tagEnd to the position of the
+   /// closing '>'. Only the attributes needed to decide what to defer are kept.
+   bool parseStartTag( const std::string &xml, size_t pos, Element &element,
+                       std::string &allowHetero, bool &isEmpty, size_t &tagEnd )
+   {
+      const size_t size = xml.size();
+
+      size_t i = pos + 1;
+      while ( i < size && !isSpace( xml[i] ) && xml[i] != '/' && xml[i] != '>' )
+      {
+         ++i;
+      }
+
+      element.name = xml.substr( pos + 1, i - pos - 1 );
+      if ( element.name.empty() )
+      {
+         return false;
+      }
+
+      while ( true )
+      {
+         while ( i < size && isSpace( xml[i] ) )
+         {
+            ++i;
+         }
+
+         if ( i >= size )
+         {
+            return false;
+         }
+
+         if ( xml[i] == '>' )
+         {
+            isEmpty = false;
+            tagEnd = i;
+            return true;
+         }
+
+         if ( xml[i] == '/' )
+         {
+            if ( i + 1 >= size || xml[i + 1] != '>' )
+            {
+               return false;
+            }
+
+            isEmpty = true;
+            tagEnd = i + 1;
+            return true;
+         }
+
+         const size_t nameStart = i;
+         while ( i < size && !isSpace( xml[i] ) && xml[i] != '=' && xml[i] != '>' )
+         {
+            ++i;
+         }
+
+         const std::string attributeName = xml.substr( nameStart, i - nameStart );
+
+         while ( i < size && isSpace( xml[i] ) )
+         {
+            ++i;
+         }
+
+         if ( i >= size || xml[i] != '=' )
+         {
+            return false;
+         }
+         ++i;
+
+         while ( i < size && isSpace( xml[i] ) )
+         {
+            ++i;
+         }
+
+         if ( i >= size || ( xml[i] != '"' && xml[i] != '\'' ) )
+         {
+            return false;
+         }
+
+         const size_t valueEnd = xml.find( xml[i], i + 1 );
+         if ( valueEnd == std::string::npos )
+         {
+            return false;
+         }
+
+         const std::string value = xml.substr( i + 1, valueEnd - i - 1 );
+
+         if ( attributeName == "type" )
+         {
+            element.type = value;
+         }
+         else if ( attributeName == "allowHeterogeneousChildren" )
+         {
+            allowHetero = value;
+         }
+
+         i = valueEnd + 1;
+      }
+   }
+
+   bool prune( const std::string &xml, std::string &pruned, std::vector<std::string> &fragments )
+   {
+      std::vector<Element> stack;
+      size_t copied = 0;
+      size_t pos = 0;
+
+      while ( ( pos = xml.find( '<', pos ) ) != std::string::npos )
+      {
+         // Skip over the parts of the document which aren't elements
+         const char *skipUntil = nullptr;
+
+         if ( startsWith( xml, pos, "<!--" ) )
+         {
+            skipUntil = "-->";
+         }
+         else if ( startsWith( xml, pos, "<![CDATA[" ) )
+         {
+            skipUntil = "]]>";
+         }
+         else if ( startsWith( xml, pos, "<?" ) )
+         {
+            skipUntil = "?>";
+         }
+
+         if ( skipUntil != nullptr )
+         {
+            const size_t end = xml.find( skipUntil, pos + 2 );
+            if ( end == std::string::npos )
+            {
+               return false;
+            }
+
+            pos = end + std::strlen( skipUntil );
+            continue;
+         }
+
+         if ( startsWith( xml, pos, "<!" ) )
+         {
+            // DOCTYPE, which may have an internal subset in brackets
+            int depth = 0;
+            size_t i = pos + 2;
+            for ( ; i < xml.size(); ++i )
+            {
+               if ( xml[i] == '[' )
+               {
+                  ++depth;
+               }
+               else if ( xml[i] == ']' )
+               {
+                  --depth;
+               }
+               else if ( xml[i] == '>' && depth == 0 )
+               {
+                  break;
+               }
+            }
+
+            if ( i >= xml.size() )
+            {
+               return false;
+            }
+
+            pos = i + 1;
+            continue;
+         }
+
+         if ( startsWith( xml, pos, "</" ) )
+         {
+            const size_t end = xml.find( '>', pos );
+            if ( end == std::string::npos || stack.empty() )
+            {
+               return false;
+            }
+
+            size_t nameEnd = end;
+            while ( nameEnd > pos + 2 && isSpace( xml[nameEnd - 1] ) )
+            {
+               --nameEnd;
+            }
+
+            if ( xml.compare( pos + 2, nameEnd - pos - 2, stack.back().name ) != 0 )
+            {
+               return false;
+            }
+
+            if ( stack.back().isDeferred )
+            {
+               const size_t contentStart = stack.back().contentStart;
+
+               fragments.push_back( xml.substr( contentStart, pos - contentStart ) );
+               copied = pos;
+            }
+
+            stack.pop_back();
+            pos = end + 1;
+            continue;
+         }
+
+         Element element;
+         std::string allowHetero;
+         bool isEmpty = false;
+         size_t tagEnd = 0;
+
+         if ( !parseStartTag( xml, pos, element, allowHetero, isEmpty, tagEnd ) )
+         {
+            return false;
+         }
+
+         if ( stack.size() == 1 && ( element.name == "data3D" || element.name == "images2D" ) &&
+              element.type == "Vector" && allowHetero == "1" )
+         {
+            element.deferChildren = true;
+         }
+         else if ( !stack.empty() && stack.back().deferChildren && element.type == "Structure" &&
+                   !isEmpty )
+         {
+            pruned.append( xml, copied, tagEnd - copied );
+            pruned += " ";
+            pruned += e57::cDeferredXmlAttribute;
+            pruned += "=\"" + std::to_string( fragments.size() ) + "\">";
+
+            copied = tagEnd + 1;
+
+            element.isDeferred = true;
+            element.contentStart = tagEnd + 1;
+         }
+
+         if ( !isEmpty )
+         {
+            stack.push_back( element );
+         }
+
+         pos = tagEnd + 1;
+      }
+
+      if ( !stack.empty() )
+      {
+         return false;
+      }
+
+      pruned.append( xml, copied, std::string::npos );
+      return true;
+   }
+}
+
+namespace e57
+{
+   bool pruneXml( const std::string &xml, std::string &pruned,
+                  std::vector<std::string> &fragments )
+   {
+      pruned.clear();
+      fragments.clear();
+
+      if ( !prune( xml, pruned, fragments ) )
+      {
+         pruned.clear();
+         fragments.clear();
+
+         return false;
+      }
+
+      return true;
+   }
+}
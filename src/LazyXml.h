@@ -0,0 +1,33 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for ImageFileOptions::lazyLoadXml. Before the XML section is given to the parser, the
+// content of each Structure child of the heterogeneous /data3D and /images2D vectors is cut out:
+//
+//    <data3D type="Vector" allowHeterogeneousChildren="1">
+//       <vectorChild type="Structure" libE57Deferred="0"></vectorChild>
+//       <vectorChild type="Structure" libE57Deferred="1"></vectorChild>
+//    </data3D>
+//
+// The parser hands each piece to the StructureNodeImpl it belongs to, which parses it the first
+// time its children are needed. Scanning for the elements is much cheaper than building nodes for
+// them, so opening a file costs little more than reading its XML.
+
+#include <string>
+#include <vector>
+
+namespace e57
+{
+   /// Attribute added to the start tag of each Structure whose content was cut out. Its value is
+   /// the index of the content in the fragments returned by pruneXml().
+   constexpr char cDeferredXmlAttribute[] = "libE57Deferred";
+
+   /// Copy @a xml to @a pruned with the content of the /data3D and /images2D structures cut out
+   /// (see above), and put the pieces in @a fragments in document order.
+   ///
+   /// Returns false, leaving both outputs empty, if xml is not well-formed enough to do this
+   /// safely. The whole section should then be parsed as is so the parser can report the error.
+   bool pruneXml( const std::string &xml, std::string &pruned,
+                  std::vector<std::string> &fragments );
+}
@@ -0,0 +1,204 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "Common.h"
+#include "LevelsOfDetail.h"
+#include "SourceDestBufferImpl.h"
+#include "StringFunctions.h"
+
+namespace
+{
+   constexpr char cPrefix[] = "lod";
+   constexpr char cURI[] = "urn:libE57Format:E57_EXT_levels_of_detail";
+   constexpr char cNodeName[] = "lod:levels";
+
+   // A copy of prototype node for another CompressedVectorNode (nodes can only have one parent).
+   e57::Node copyPrototype( e57::ImageFile imf, const e57::Node &node )
+   {
+      using namespace e57;
+
+      switch ( node.type() )
+      {
+         case TypeStructure:
+         {
+            const StructureNode structure( node );
+            StructureNode copy( imf );
+
+            for ( int64_t i = 0; i < structure.childCount(); ++i )
+            {
+               const Node child = structure.get( i );
+
+               copy.set( child.elementName(), copyPrototype( imf, child ) );
+            }
+
+            return copy;
+         }
+
+         case TypeInteger:
+         {
+            const IntegerNode integer( node );
+
+            return IntegerNode( imf, integer.value(), integer.minimum(), integer.maximum() );
+         }
+
+         case TypeScaledInteger:
+         {
+            const ScaledIntegerNode scaled( node );
+
+            return ScaledIntegerNode( imf, scaled.rawValue(), scaled.minimum(), scaled.maximum(),
+                                      scaled.scale(), scaled.offset() );
+         }
+
+         case TypeFloat:
+         {
+            const FloatNode real( node );
+
+            return FloatNode( imf, real.value(), real.precision(), real.minimum(),
+                              real.maximum() );
+         }
+
+         case TypeString:
+            return StringNode( imf, StringNode( node ).value() );
+
+         default:
+            throw E57_EXCEPTION2( ErrorBadPrototype, "pathName=" + node.pathName() +
+                                                        " nodeType=" + toString( node.type() ) );
+      }
+   }
+
+   template <typename T>
+   e57::SourceDestBuffer steppedBuffer( e57::ImageFile imf, const e57::SourceDestBuffer &buffer,
+                                        size_t capacity, size_t step )
+   {
+      auto *base = static_cast<T *>( buffer.impl()->base() );
+
+      e57::SourceDestBuffer result( imf, buffer.pathName(), base, capacity, buffer.doConversion(),
+                                    buffer.doScaling(), buffer.stride() * step );
+      result.setOrigin( buffer.origin() );
+
+      return result;
+   }
+
+   // A buffer which reads every step'th element of buffer, in place.
+   e57::SourceDestBuffer steppedBuffer( e57::ImageFile imf, const e57::SourceDestBuffer &buffer,
+                                        size_t capacity, size_t step )
+   {
+      using namespace e57;
+
+      switch ( buffer.memoryRepresentation() )
+      {
+         case Int8:
+            return steppedBuffer<int8_t>( imf, buffer, capacity, step );
+         case UInt8:
+            return steppedBuffer<uint8_t>( imf, buffer, capacity, step );
+         case Int16:
+            return steppedBuffer<int16_t>( imf, buffer, capacity, step );
+         case UInt16:
+            return steppedBuffer<uint16_t>( imf, buffer, capacity, step );
+         case Int32:
+            return steppedBuffer<int32_t>( imf, buffer, capacity, step );
+         case UInt32:
+            return steppedBuffer<uint32_t>( imf, buffer, capacity, step );
+         case Int64:
+            return steppedBuffer<int64_t>( imf, buffer, capacity, step );
+         case Bool:
+            return steppedBuffer<bool>( imf, buffer, capacity, step );
+         case Real32:
+            return steppedBuffer<float>( imf, buffer, capacity, step );
+         case Real64:
+            return steppedBuffer<double>( imf, buffer, capacity, step );
+         case Real16:
+            return steppedBuffer<Float16>( imf, buffer, capacity, step );
+         default:
+            // Strings have no stride
+            throw E57_EXCEPTION2( ErrorNotImplemented,
+                                  "pathName=" + buffer.pathName() + " memoryRepresentation=" +
+                                     toString( buffer.memoryRepresentation() ) );
+      }
+   }
+}
+
+namespace e57
+{
+   void writeLevelsOfDetail( ImageFile imf, StructureNode &scan,
+                             const std::vector<SourceDestBuffer> &sourceBuffers,
+                             size_t pointCount, size_t levelCount,
+                             const CompressedVectorWriterOptions &options )
+   {
+      if ( ( levelCount == 0 ) || ( pointCount <= 1 ) || sourceBuffers.empty() )
+      {
+         return;
+      }
+
+      if ( !imf.extensionsLookupPrefix( cPrefix ) )
+      {
+         imf.extensionsAdd( cPrefix, cURI );
+      }
+
+      const Node pointsProto = CompressedVectorNode( scan.get( "points" ) ).prototype();
+
+      // The levels must be in the tree before their points can be written
+      // Heterogeneous, as the levels have different numbers of points
+      VectorNode levels( imf, true );
+      scan.set( cNodeName, levels );
+
+      size_t step = 1;
+
+      for ( size_t level = 1; ( level <= levelCount ) && ( step < pointCount ); ++level )
+      {
+         step *= cLevelOfDetailRatio;
+
+         const size_t cCount = ( pointCount + step - 1 ) / step;
+
+         StructureNode levelNode( imf );
+         levelNode.set( "lod:pointStep", IntegerNode( imf, static_cast<int64_t>( step ), 1 ) );
+
+         VectorNode codecs( imf, true );
+         CompressedVectorNode points( imf, copyPrototype( imf, pointsProto ), codecs );
+         levelNode.set( "lod:points", points );
+
+         levels.append( levelNode );
+
+         std::vector<SourceDestBuffer> levelBuffers;
+         levelBuffers.reserve( sourceBuffers.size() );
+
+         for ( const auto &buffer : sourceBuffers )
+         {
+            levelBuffers.push_back( steppedBuffer( imf, buffer, cCount, step ) );
+         }
+
+         CompressedVectorWriter writer = points.writer( levelBuffers, options );
+
+         writer.write( cCount );
+         writer.close();
+      }
+   }
+
+   int64_t levelOfDetailCount( const StructureNode &scan )
+   {
+      if ( !scan.isDefined( cNodeName ) )
+      {
+         return 0;
+      }
+
+      return VectorNode( scan.get( cNodeName ) ).childCount();
+   }
+
+   CompressedVectorNode levelOfDetailPoints( const StructureNode &scan, int64_t level )
+   {
+      if ( level == 0 )
+      {
+         return CompressedVectorNode( scan.get( "points" ) );
+      }
+
+      if ( ( level < 0 ) || ( level > levelOfDetailCount( scan ) ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "level=" + toString( level ) );
+      }
+
+      const VectorNode levels( scan.get( cNodeName ) );
+      const StructureNode levelNode( levels.get( level - 1 ) );
+
+      return CompressedVectorNode( levelNode.get( "lod:points" ) );
+   }
+}
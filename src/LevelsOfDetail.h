@@ -0,0 +1,32 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for the levels of detail extension used by the Simple API. A Data3D may have a
+// "lod:levels" VectorNode of coarser copies of its points, each one holding every pointStep'th
+// point, so viewers can show a preview without reading the whole scan.
+
+#include <vector>
+
+#include "E57Format.h"
+
+namespace e57
+{
+   /// Each level holds one in this many of the points of the one before it.
+   constexpr int64_t cLevelOfDetailRatio = 8;
+
+   /// Add up to @a levelCount levels of detail to @a scan (declaring the extension if needed) and
+   /// write them from @a sourceBuffers, which must be the buffers the @a pointCount points were
+   /// written from. Levels which would hold the same points as the one before are left out.
+   void writeLevelsOfDetail( ImageFile imf, StructureNode &scan,
+                             const std::vector<SourceDestBuffer> &sourceBuffers,
+                             size_t pointCount, size_t levelCount,
+                             const CompressedVectorWriterOptions &options );
+
+   /// The number of levels of detail of @a scan, not counting its points.
+   int64_t levelOfDetailCount( const StructureNode &scan );
+
+   /// The points of level @a level of @a scan. Level 0 is the points themselves.
+   /// Throws ErrorBadAPIArgument if @a scan doesn't have this level.
+   CompressedVectorNode levelOfDetailPoints( const StructureNode &scan, int64_t level );
+}
@@ -0,0 +1,92 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "MemoryAccount.h"
+
+namespace e57
+{
+   MemoryAccount::MemoryAccount( uint64_t budget ) : budget_( budget )
+   {
+      for ( auto &bytes : bytes_ )
+      {
+         bytes.store( 0, std::memory_order_relaxed );
+      }
+   }
+
+   void MemoryAccount::add( Category category, uint64_t bytes )
+   {
+      bytes_[category].fetch_add( bytes, std::memory_order_relaxed );
+
+      raisePeak( total_.fetch_add( bytes, std::memory_order_relaxed ) + bytes );
+   }
+
+   void MemoryAccount::release( Category category, uint64_t bytes )
+   {
+      bytes_[category].fetch_sub( bytes, std::memory_order_relaxed );
+      total_.fetch_sub( bytes, std::memory_order_relaxed );
+   }
+
+   size_t MemoryAccount::reserveUpTo( Category category, size_t pieceSize, size_t count,
+                                      size_t minimum )
+   {
+      const uint64_t budget = budget_.load( std::memory_order_relaxed );
+
+      size_t granted = count;
+
+      if ( ( budget > 0 ) && ( pieceSize > 0 ) )
+      {
+         // Take what fits from the total, so two readers opening at once can't both take the
+         // same room
+         uint64_t total = total_.load( std::memory_order_relaxed );
+
+         do
+         {
+            const uint64_t room = ( total < budget ) ? budget - total : 0;
+
+            granted = static_cast<size_t>(
+               std::max<uint64_t>( std::min<uint64_t>( count, room / pieceSize ), minimum ) );
+         } while ( !total_.compare_exchange_weak( total, total + granted * pieceSize,
+                                                  std::memory_order_relaxed ) );
+
+         bytes_[category].fetch_add( granted * pieceSize, std::memory_order_relaxed );
+         raisePeak( total + granted * pieceSize );
+
+         return granted;
+      }
+
+      add( category, uint64_t{ granted } * pieceSize );
+
+      return granted;
+   }
+
+   void MemoryAccount::raisePeak( uint64_t total )
+   {
+      uint64_t peak = peak_.load( std::memory_order_relaxed );
+
+      while ( ( total > peak ) &&
+              !peak_.compare_exchange_weak( peak, total, std::memory_order_relaxed ) )
+      {
+      }
+   }
+
+   ImageFileMemoryUsage MemoryAccount::snapshot() const
+   {
+      ImageFileMemoryUsage usage;
+
+      usage.packetCache = bytes_[PacketCache].load( std::memory_order_relaxed );
+      usage.readAhead = bytes_[ReadAhead].load( std::memory_order_relaxed );
+      usage.decoders = bytes_[Decoders].load( std::memory_order_relaxed );
+      usage.encoders = bytes_[Encoders].load( std::memory_order_relaxed );
+      usage.writeBuffers = bytes_[WriteBuffers].load( std::memory_order_relaxed );
+      usage.nodes = bytes_[Nodes].load( std::memory_order_relaxed );
+      usage.xml = bytes_[Xml].load( std::memory_order_relaxed );
+
+      usage.total = total_.load( std::memory_order_relaxed );
+      usage.peak = peak_.load( std::memory_order_relaxed );
+      usage.budget = budget_.load( std::memory_order_relaxed );
+
+      return usage;
+   }
+}
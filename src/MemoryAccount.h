@@ -0,0 +1,208 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for ImageFile::memoryUsage() and ImageFileOptions::memoryBudget.
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "E57Format.h"
+
+namespace e57
+{
+   /// The bytes held by each part of one ImageFile, and its budget. Any thread may update it.
+   ///
+   /// It is held by shared pointer, since nodes (and their arena) may outlive the ImageFile.
+   class MemoryAccount
+   {
+   public:
+      enum Category
+      {
+         PacketCache,
+         ReadAhead,
+         Decoders,
+         Encoders,
+         WriteBuffers,
+         Nodes,
+         Xml,
+         CategoryCount
+      };
+
+      /// @param budget Most bytes to hold (see ImageFileOptions::memoryBudget), or 0 for no limit
+      explicit MemoryAccount( uint64_t budget = 0 );
+
+      MemoryAccount( const MemoryAccount & ) = delete;
+      MemoryAccount &operator=( const MemoryAccount & ) = delete;
+
+      /// Count @a bytes which are needed whatever the budget.
+      void add( Category category, uint64_t bytes );
+
+      void release( Category category, uint64_t bytes );
+
+      /// Count as many of @a count pieces of @a pieceSize bytes as fit in the budget, but at
+      /// least @a minimum even if they don't. Returns the number counted.
+      size_t reserveUpTo( Category category, size_t pieceSize, size_t count, size_t minimum );
+
+      void setBudget( uint64_t budget )
+      {
+         budget_.store( budget, std::memory_order_relaxed );
+      }
+
+      ImageFileMemoryUsage snapshot() const;
+
+   private:
+      void raisePeak( uint64_t total );
+
+      std::atomic<uint64_t> bytes_[CategoryCount];
+      std::atomic<uint64_t> total_{ 0 };
+      std::atomic<uint64_t> peak_{ 0 };
+      std::atomic<uint64_t> budget_;
+   };
+
+   /// Bytes counted in one category of a MemoryAccount for as long as it lives. set() changes
+   /// them, e.g. as a buffer grows.
+   class MemoryCharge
+   {
+   public:
+      MemoryCharge() = default;
+
+      MemoryCharge( std::shared_ptr<MemoryAccount> account, MemoryAccount::Category category,
+                    uint64_t bytes = 0 ) :
+         account_( std::move( account ) ), category_( category )
+      {
+         set( bytes );
+      }
+
+      ~MemoryCharge()
+      {
+         set( 0 );
+      }
+
+      MemoryCharge( MemoryCharge &&other ) noexcept :
+         account_( std::move( other.account_ ) ), category_( other.category_ ),
+         bytes_( other.bytes_ )
+      {
+         other.bytes_ = 0;
+      }
+
+      MemoryCharge &operator=( MemoryCharge &&other ) noexcept
+      {
+         if ( this != &other )
+         {
+            set( 0 );
+
+            account_ = std::move( other.account_ );
+            category_ = other.category_;
+            bytes_ = other.bytes_;
+
+            other.bytes_ = 0;
+         }
+
+         return *this;
+      }
+
+      MemoryCharge( const MemoryCharge & ) = delete;
+      MemoryCharge &operator=( const MemoryCharge & ) = delete;
+
+      /// Count @a bytes instead of what was counted before. Bytes already counted (by
+      /// MemoryAccount::reserveUpTo()) may be handed over with adopt().
+      void set( uint64_t bytes )
+      {
+         if ( account_ == nullptr )
+         {
+            return;
+         }
+
+         if ( bytes > bytes_ )
+         {
+            account_->add( category_, bytes - bytes_ );
+         }
+         else if ( bytes < bytes_ )
+         {
+            account_->release( category_, bytes_ - bytes );
+         }
+
+         bytes_ = bytes;
+      }
+
+      /// Take over @a bytes which have already been counted, to release them when done.
+      void adopt( uint64_t bytes )
+      {
+         bytes_ += bytes;
+      }
+
+      uint64_t bytes() const
+      {
+         return bytes_;
+      }
+
+   private:
+      std::shared_ptr<MemoryAccount> account_;
+      MemoryAccount::Category category_ = MemoryAccount::PacketCache;
+      uint64_t bytes_ = 0;
+   };
+
+   /// Standard allocator for std::allocate_shared() which counts what it allocates in a
+   /// MemoryAccount.
+   template <typename T> class MemoryAccountAllocator
+   {
+   public:
+      using value_type = T;
+
+      MemoryAccountAllocator( std::shared_ptr<MemoryAccount> account,
+                              MemoryAccount::Category category ) :
+         account_( std::move( account ) ), category_( category )
+      {
+      }
+
+      template <typename U>
+      MemoryAccountAllocator( const MemoryAccountAllocator<U> &other ) :
+         account_( other.account() ), category_( other.category() )
+      {
+      }
+
+      T *allocate( size_t n )
+      {
+         T *p = std::allocator<T>().allocate( n );
+
+         account_->add( category_, n * sizeof( T ) );
+
+         return p;
+      }
+
+      void deallocate( T *p, size_t n )
+      {
+         account_->release( category_, n * sizeof( T ) );
+
+         std::allocator<T>().deallocate( p, n );
+      }
+
+      const std::shared_ptr<MemoryAccount> &account() const
+      {
+         return account_;
+      }
+
+      MemoryAccount::Category category() const
+      {
+         return category_;
+      }
+
+   private:
+      std::shared_ptr<MemoryAccount> account_;
+      MemoryAccount::Category category_;
+   };
+
+   template <typename T, typename U>
+   bool operator==( const MemoryAccountAllocator<T> &lhs, const MemoryAccountAllocator<U> &rhs )
+   {
+      return lhs.account() == rhs.account();
+   }
+
+   template <typename T, typename U>
+   bool operator!=( const MemoryAccountAllocator<T> &lhs, const MemoryAccountAllocator<U> &rhs )
+   {
+      return !( lhs == rhs );
+   }
+}
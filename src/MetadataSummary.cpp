@@ -0,0 +1,313 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <iterator>
+
+#include "E57SimpleData.h"
+
+namespace e57
+{
+   namespace
+   {
+      constexpr char cSummaryMagic[8] = { 'E', '5', '7', 'S', 'U', 'M', 'R', 'Y' };
+      constexpr uint32_t cSummaryVersion = 1;
+
+      /// Appends values to a serialized summary. Numbers are stored as they are in memory, which
+      /// is little-endian like the rest of the file format.
+      class SummaryWriter
+      {
+      public:
+         explicit SummaryWriter( std::vector<char> &data ) : data_( data )
+         {
+         }
+
+         template <typename T> void put( T value )
+         {
+            const auto *bytes = reinterpret_cast<const char *>( &value );
+
+            data_.insert( data_.end(), bytes, bytes + sizeof( T ) );
+         }
+
+         void put( const ustring &value )
+         {
+            put( static_cast<uint64_t>( value.size() ) );
+
+            data_.insert( data_.end(), value.begin(), value.end() );
+         }
+
+         void put( const RigidBodyTransform &pose )
+         {
+            put( pose.rotation.w );
+            put( pose.rotation.x );
+            put( pose.rotation.y );
+            put( pose.rotation.z );
+            put( pose.translation.x );
+            put( pose.translation.y );
+            put( pose.translation.z );
+         }
+
+      private:
+         std::vector<char> &data_;
+      };
+
+      /// Takes values out of a serialized summary. Reading past the end sets failed() instead of
+      /// throwing, since a bad or truncated summary only means it isn't used.
+      class SummaryReader
+      {
+      public:
+         explicit SummaryReader( const std::vector<char> &data ) : data_( data )
+         {
+         }
+
+         bool failed() const
+         {
+            return failed_;
+         }
+
+         bool atEnd() const
+         {
+            return position_ == data_.size();
+         }
+
+         bool take( void *value, size_t count )
+         {
+            if ( failed_ || ( count > data_.size() - position_ ) )
+            {
+               failed_ = true;
+               return false;
+            }
+
+            memcpy( value, data_.data() + position_, count );
+            position_ += count;
+
+            return true;
+         }
+
+         template <typename T> void get( T &value )
+         {
+            if ( !take( &value, sizeof( T ) ) )
+            {
+               value = {};
+            }
+         }
+
+         void get( ustring &value )
+         {
+            uint64_t size = 0;
+            get( size );
+
+            if ( failed_ || ( size > data_.size() - position_ ) )
+            {
+               failed_ = true;
+               return;
+            }
+
+            value.assign( data_.data() + position_, static_cast<size_t>( size ) );
+            position_ += static_cast<size_t>( size );
+         }
+
+         void get( RigidBodyTransform &pose )
+         {
+            get( pose.rotation.w );
+            get( pose.rotation.x );
+            get( pose.rotation.y );
+            get( pose.rotation.z );
+            get( pose.translation.x );
+            get( pose.translation.y );
+            get( pose.translation.z );
+         }
+
+         /// Read a count of things which each take at least @a minimumSize bytes, failing if
+         /// there isn't room left for them
+         size_t getCount( size_t minimumSize )
+         {
+            uint64_t count = 0;
+            get( count );
+
+            if ( failed_ || ( count > ( data_.size() - position_ ) / minimumSize ) )
+            {
+               failed_ = true;
+               return 0;
+            }
+
+            return static_cast<size_t>( count );
+         }
+
+      private:
+         const std::vector<char> &data_;
+         size_t position_ = 0;
+         bool failed_ = false;
+      };
+
+      // Fixed parts of each entry, for checking counts
+      constexpr size_t cMinimumData3DSize = 3 * sizeof( uint64_t ) + 7 * sizeof( double ) +
+                                            6 * sizeof( int64_t ) + 12 * sizeof( double ) +
+                                            sizeof( int64_t ) + 4 * sizeof( uint8_t );
+      constexpr size_t cMinimumImage2DSize = 4 * sizeof( uint64_t ) + 7 * sizeof( double ) +
+                                             sizeof( int32_t ) + 2 * sizeof( int64_t );
+   }
+
+   std::vector<char> MetadataSummary::serialize() const
+   {
+      std::vector<char> data( std::begin( cSummaryMagic ), std::end( cSummaryMagic ) );
+      SummaryWriter writer( data );
+
+      writer.put( cSummaryVersion );
+      writer.put( fileSize );
+      writer.put( fileModified );
+      writer.put( guid );
+      writer.put( coordinateMetadata );
+
+      writer.put( static_cast<uint64_t>( data3D.size() ) );
+
+      for ( const Data3DSummary &scan : data3D )
+      {
+         writer.put( scan.name );
+         writer.put( scan.guid );
+         writer.put( scan.description );
+         writer.put( scan.pose );
+
+         writer.put( scan.indexBounds.rowMinimum );
+         writer.put( scan.indexBounds.rowMaximum );
+         writer.put( scan.indexBounds.columnMinimum );
+         writer.put( scan.indexBounds.columnMaximum );
+         writer.put( scan.indexBounds.returnMinimum );
+         writer.put( scan.indexBounds.returnMaximum );
+
+         writer.put( scan.cartesianBounds.xMinimum );
+         writer.put( scan.cartesianBounds.xMaximum );
+         writer.put( scan.cartesianBounds.yMinimum );
+         writer.put( scan.cartesianBounds.yMaximum );
+         writer.put( scan.cartesianBounds.zMinimum );
+         writer.put( scan.cartesianBounds.zMaximum );
+
+         writer.put( scan.sphericalBounds.rangeMinimum );
+         writer.put( scan.sphericalBounds.rangeMaximum );
+         writer.put( scan.sphericalBounds.elevationMinimum );
+         writer.put( scan.sphericalBounds.elevationMaximum );
+         writer.put( scan.sphericalBounds.azimuthStart );
+         writer.put( scan.sphericalBounds.azimuthEnd );
+
+         writer.put( scan.pointCount );
+
+         writer.put( static_cast<uint8_t>( scan.hasCartesian ) );
+         writer.put( static_cast<uint8_t>( scan.hasSpherical ) );
+         writer.put( static_cast<uint8_t>( scan.hasIntensity ) );
+         writer.put( static_cast<uint8_t>( scan.hasColor ) );
+      }
+
+      writer.put( static_cast<uint64_t>( images2D.size() ) );
+
+      for ( const Image2DSummary &image : images2D )
+      {
+         writer.put( image.name );
+         writer.put( image.guid );
+         writer.put( image.description );
+         writer.put( image.associatedData3DGuid );
+         writer.put( image.pose );
+         writer.put( static_cast<int32_t>( image.projection ) );
+         writer.put( image.width );
+         writer.put( image.height );
+      }
+
+      return data;
+   }
+
+   bool MetadataSummary::deserialize( const std::vector<char> &data )
+   {
+      SummaryReader reader( data );
+
+      char magic[sizeof( cSummaryMagic )] = {};
+      uint32_t version = 0;
+
+      reader.take( magic, sizeof( magic ) );
+      reader.get( version );
+
+      if ( reader.failed() || ( memcmp( magic, cSummaryMagic, sizeof( magic ) ) != 0 ) ||
+           ( version != cSummaryVersion ) )
+      {
+         return false;
+      }
+
+      MetadataSummary summary;
+
+      reader.get( summary.fileSize );
+      reader.get( summary.fileModified );
+      reader.get( summary.guid );
+      reader.get( summary.coordinateMetadata );
+
+      summary.data3D.resize( reader.getCount( cMinimumData3DSize ) );
+
+      for ( Data3DSummary &scan : summary.data3D )
+      {
+         reader.get( scan.name );
+         reader.get( scan.guid );
+         reader.get( scan.description );
+         reader.get( scan.pose );
+
+         reader.get( scan.indexBounds.rowMinimum );
+         reader.get( scan.indexBounds.rowMaximum );
+         reader.get( scan.indexBounds.columnMinimum );
+         reader.get( scan.indexBounds.columnMaximum );
+         reader.get( scan.indexBounds.returnMinimum );
+         reader.get( scan.indexBounds.returnMaximum );
+
+         reader.get( scan.cartesianBounds.xMinimum );
+         reader.get( scan.cartesianBounds.xMaximum );
+         reader.get( scan.cartesianBounds.yMinimum );
+         reader.get( scan.cartesianBounds.yMaximum );
+         reader.get( scan.cartesianBounds.zMinimum );
+         reader.get( scan.cartesianBounds.zMaximum );
+
+         reader.get( scan.sphericalBounds.rangeMinimum );
+         reader.get( scan.sphericalBounds.rangeMaximum );
+         reader.get( scan.sphericalBounds.elevationMinimum );
+         reader.get( scan.sphericalBounds.elevationMaximum );
+         reader.get( scan.sphericalBounds.azimuthStart );
+         reader.get( scan.sphericalBounds.azimuthEnd );
+
+         reader.get( scan.pointCount );
+
+         uint8_t flags[4] = {};
+         reader.take( flags, sizeof( flags ) );
+
+         scan.hasCartesian = ( flags[0] != 0 );
+         scan.hasSpherical = ( flags[1] != 0 );
+         scan.hasIntensity = ( flags[2] != 0 );
+         scan.hasColor = ( flags[3] != 0 );
+      }
+
+      summary.images2D.resize( reader.getCount( cMinimumImage2DSize ) );
+
+      for ( Image2DSummary &image : summary.images2D )
+      {
+         int32_t projection = 0;
+
+         reader.get( image.name );
+         reader.get( image.guid );
+         reader.get( image.description );
+         reader.get( image.associatedData3DGuid );
+         reader.get( image.pose );
+         reader.get( projection );
+         reader.get( image.width );
+         reader.get( image.height );
+
+         if ( ( projection < ProjectionNone ) || ( projection > ProjectionCylindrical ) )
+         {
+            return false;
+         }
+
+         image.projection = static_cast<Image2DProjection>( projection );
+      }
+
+      if ( reader.failed() || !reader.atEnd() )
+      {
+         return false;
+      }
+
+      *this = std::move( summary );
+
+      return true;
+   }
+}
@@ -0,0 +1,41 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "NodeArena.h"
+
+namespace e57
+{
+   void *NodeArena::allocate( size_t size )
+   {
+      constexpr size_t cAlignment = alignof( std::max_align_t );
+
+      size = ( size + cAlignment - 1 ) & ~( cAlignment - 1 );
+
+      std::lock_guard<std::mutex> lock( mutex_ );
+
+      // Anything too big to share a block gets its own, before the current one so the rest of
+      // that can still be used
+      if ( size > cBlockSize / 4 )
+      {
+         std::unique_ptr<char[]> block( new char[size] );
+         char *memory = block.get();
+
+         blocks_.insert( blocks_.empty() ? blocks_.end() : blocks_.end() - 1, std::move( block ) );
+         charge_.set( charge_.bytes() + size );
+
+         return memory;
+      }
+
+      if ( blockUsed_ + size > cBlockSize )
+      {
+         blocks_.emplace_back( new char[cBlockSize] );
+         blockUsed_ = 0;
+         charge_.set( charge_.bytes() + cBlockSize );
+      }
+
+      char *memory = blocks_.back().get() + blockUsed_;
+      blockUsed_ += size;
+
+      return memory;
+   }
+}
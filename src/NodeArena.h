@@ -0,0 +1,88 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "MemoryAccount.h"
+
+namespace e57
+{
+   /// Memory for the nodes of a file being read (see ImageFileOptions::useNodeArena).
+   ///
+   /// Memory is handed out from large blocks and never given back one piece at a time. It is all
+   /// released together when the arena is destroyed, which happens once the ImageFile and every
+   /// node allocated from it are gone (each node's NodeArenaAllocator holds a reference).
+   class NodeArena
+   {
+   public:
+      /// @param account Where the blocks are counted (as MemoryAccount::Nodes), if anywhere
+      explicit NodeArena( std::shared_ptr<MemoryAccount> account = nullptr ) :
+         charge_( std::move( account ), MemoryAccount::Nodes )
+      {
+      }
+
+      NodeArena( const NodeArena & ) = delete;
+      NodeArena &operator=( const NodeArena & ) = delete;
+
+      /// Allocate @a size bytes, aligned for any type. Safe to call from several threads.
+      void *allocate( size_t size );
+
+   private:
+      static constexpr size_t cBlockSize = 64 * 1024;
+
+      std::mutex mutex_;
+      std::vector<std::unique_ptr<char[]>> blocks_;
+      size_t blockUsed_ = cBlockSize; /// bytes used in the last of blocks_
+      MemoryCharge charge_;           /// bytes of all of blocks_
+   };
+
+   /// Standard allocator for std::allocate_shared() which uses a NodeArena.
+   template <typename T> class NodeArenaAllocator
+   {
+   public:
+      using value_type = T;
+
+      explicit NodeArenaAllocator( std::shared_ptr<NodeArena> arena ) : arena_( std::move( arena ) )
+      {
+      }
+
+      template <typename U>
+      NodeArenaAllocator( const NodeArenaAllocator<U> &other ) : arena_( other.arena() )
+      {
+      }
+
+      T *allocate( size_t n )
+      {
+         return static_cast<T *>( arena_->allocate( n * sizeof( T ) ) );
+      }
+
+      void deallocate( T * /*p*/, size_t /*n*/ )
+      {
+         // Released with the arena
+      }
+
+      const std::shared_ptr<NodeArena> &arena() const
+      {
+         return arena_;
+      }
+
+   private:
+      std::shared_ptr<NodeArena> arena_;
+   };
+
+   template <typename T, typename U>
+   bool operator==( const NodeArenaAllocator<T> &lhs, const NodeArenaAllocator<U> &rhs )
+   {
+      return lhs.arena() == rhs.arena();
+   }
+
+   template <typename T, typename U>
+   bool operator!=( const NodeArenaAllocator<T> &lhs, const NodeArenaAllocator<U> &rhs )
+   {
+      return !( lhs == rhs );
+   }
+}
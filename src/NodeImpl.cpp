@@ -88,10 +88,10 @@ ustring NodeImpl::pathName() const
 
    if ( p->isRoot() )
    {
-      return ( "/" + elementName_ );
+      return ( "/" + elementNameRef() );
    }
 
-   return ( p->pathName() + "/" + elementName_ );
+   return ( p->pathName() + "/" + elementNameRef() );
 }
 
 ustring NodeImpl::relativePathName( const NodeImplSharedPtr &origin, ustring childPathName ) const
@@ -114,17 +114,31 @@ ustring NodeImpl::relativePathName( const NodeImplSharedPtr &origin, ustring chi
 
    if ( childPathName.empty() )
    {
-      return p->relativePathName( origin, elementName_ );
+      return p->relativePathName( origin, elementNameRef() );
    }
 
-   return p->relativePathName( origin, elementName_ + "/" + childPathName );
+   return p->relativePathName( origin, elementNameRef() + "/" + childPathName );
 }
 
 ustring NodeImpl::elementName() const
 {
    checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
 
-   return elementName_;
+   return elementNameRef();
+}
+
+const ustring &NodeImpl::elementNameRef() const
+{
+   // don't checkImageFileOpen
+   static const ustring cNoName;
+
+   return elementName_ ? *elementName_ : cNoName;
+}
+
+bool NodeImpl::hasSameElementName( const NodeImpl &ni ) const
+{
+   // don't checkImageFileOpen
+   return ( elementName_ == ni.elementName_ ) || ( elementNameRef() == ni.elementNameRef() );
 }
 
 ImageFileImplSharedPtr NodeImpl::destImageFile()
@@ -176,7 +190,7 @@ void NodeImpl::setParent( NodeImplSharedPtr parent, const ustring &elementName )
    }
 
    parent_ = parent;
-   elementName_ = elementName;
+   elementName_ = ImageFileImplSharedPtr( destImageFile_ )->internName( elementName );
 
    // If parent is attached then we are attached (and all of our children)
    if ( parent->isAttached() )
@@ -385,7 +399,7 @@ bool NodeImpl::findTerminalPosition( const NodeImplSharedPtr &target, uint64_t &
 void NodeImpl::dump( int indent, std::ostream &os ) const
 {
    // don't checkImageFileOpen
-   os << space( indent ) << "elementName: " << elementName_ << std::endl;
+   os << space( indent ) << "elementName: " << elementNameRef() << std::endl;
    os << space( indent ) << "isAttached:  " << isAttached_ << std::endl;
    os << space( indent ) << "path:        " << pathName() << std::endl;
 }
@@ -47,6 +47,12 @@ namespace e57
       ustring relativePathName( const NodeImplSharedPtr &origin,
                                 ustring childPathName = ustring() ) const;
       ustring elementName() const;
+
+      /// Our element name, without checking the ImageFile is open or copying it. Nodes of the
+      /// same ImageFile with the same name return the same string (see
+      /// ImageFileImpl::internName()).
+      const ustring &elementNameRef() const;
+
       ImageFileImplSharedPtr destImageFile();
 
       ustring imageFileName() const;
@@ -98,9 +104,13 @@ namespace e57
 
       NodeImplSharedPtr getRoot();
 
+      /// True if we have the same element name as @a ni. Names from the same ImageFileImpl are
+      /// compared by pointer.
+      bool hasSameElementName( const NodeImpl &ni ) const;
+
       ImageFileImplWeakPtr destImageFile_;
       NodeImplWeakPtr parent_;
-      ustring elementName_;
+      InternedName elementName_; /// null until the node has a parent
       bool isAttached_;
    };
 }
@@ -25,69 +25,102 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <climits>
 #include <cstring>
 
 #include "CheckedFile.h"
 #include "Packet.h"
+#include "SharedPacketCache.h"
+#include "Statistics.h"
 #include "StringFunctions.h"
+#include "Tracing.h"
 
 using namespace e57;
 
-struct IndexPacketHeader
+//=============================================================================
+// PacketReadCache
+
+PacketReadCache::PacketReadCache( CheckedFile *cFile, unsigned packetCount,
+                                  std::shared_ptr<MemoryAccount> account,
+                                  std::shared_ptr<SharedPacketCache> shared ) :
+   cFile_( cFile ), account_( std::move( account ) ), shared_( std::move( shared ) )
 {
-   const uint8_t packetType = INDEX_PACKET;
+   if ( packetCount == 0 )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "packetCount=" + toString( packetCount ) );
+   }
 
-   uint8_t packetFlags = 0; // flag bitfields
-   uint16_t packetLogicalLengthMinus1 = 0;
-   uint16_t entryCount = 0;
-   uint8_t indexLevel = 0;
-   uint8_t reserved1[9] = {}; // must be zero
-};
+   if ( account_ != nullptr )
+   {
+      packetCount = static_cast<unsigned>( account_->reserveUpTo(
+         MemoryAccount::PacketCache, sizeof( CacheEntry ), packetCount, 1 ) );
 
-struct IndexPacket
-{
-   IndexPacketHeader header;
+      entriesCharge_ = MemoryCharge( account_, MemoryAccount::PacketCache );
+      entriesCharge_.adopt( uint64_t{ packetCount } * sizeof( CacheEntry ) );
+   }
 
-   static constexpr unsigned MAX_ENTRIES = 2048;
+   entries_.resize( packetCount );
 
-   struct IndexPacketEntry
+   for ( unsigned i = 0; i < packetCount; ++i )
    {
-      uint64_t chunkRecordNumber = 0;
-      uint64_t chunkPhysicalOffset = 0;
-   } entries[MAX_ENTRIES];
+      entries_[i].lruPosition_ = lru_.insert( lru_.end(), i );
+   }
 
-   void verify( unsigned bufferLength = 0, uint64_t totalRecordCount = 0,
-                uint64_t fileSize = 0 ) const;
+   entryIndex_.reserve( packetCount );
+}
 
-#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
-   void dump( int indent = 0, std::ostream &os = std::cout ) const;
-#endif
-};
+PacketReadCache::~PacketReadCache()
+{
+   if ( readAheadJob_ != nullptr )
+   {
+      {
+         std::lock_guard<std::mutex> guard( readAheadMutex_ );
+         readAheadStopping_ = true;
+      }
+
+      // Wait for a read-ahead task which has started, and stop one which hasn't
+      std::lock_guard<std::mutex> guard( readAheadJob_->mutex );
+      readAheadJob_->cache = nullptr;
+   }
+}
 
-struct EmptyPacketHeader
+void PacketReadCache::enableReadAhead( unsigned packetCount, uint64_t endLogicalOffset )
 {
-   const uint8_t packetType = EMPTY_PACKET;
+   if ( ( packetCount == 0 ) || ( readAheadJob_ != nullptr ) )
+   {
+      return;
+   }
 
-   uint8_t reserved1 = 0; // must be zero
-   uint16_t packetLogicalLengthMinus1 = 0;
+   // Read-ahead reads cFile_ at the same time as lock(), which is only safe for read-only files.
+   if ( !cFile_->isReadOnly() )
+   {
+      return;
+   }
 
-   void verify( unsigned bufferLength = 0 ) const; //???use
+   if ( account_ != nullptr )
+   {
+      packetCount = static_cast<unsigned>(
+         account_->reserveUpTo( MemoryAccount::ReadAhead, DATA_PACKET_MAX, packetCount, 0 ) );
 
-#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
-   void dump( int indent = 0, std::ostream &os = std::cout ) const;
-#endif
-};
+      if ( packetCount == 0 )
+      {
+         return;
+      }
 
-//=============================================================================
-// PacketReadCache
+      readAheadCharge_ = MemoryCharge( account_, MemoryAccount::ReadAhead );
+      readAheadCharge_.adopt( uint64_t{ packetCount } * DATA_PACKET_MAX );
+   }
 
-PacketReadCache::PacketReadCache( CheckedFile *cFile, unsigned packetCount ) :
-   cFile_( cFile ), entries_( packetCount )
-{
-   if ( packetCount == 0 )
+   readAheadSlots_.resize( packetCount );
+   for ( auto &slot : readAheadSlots_ )
    {
-      throw E57_EXCEPTION2( ErrorInternal, "packetCount=" + toString( packetCount ) );
+      slot.buffer_.resize( DATA_PACKET_MAX );
    }
+
+   readAheadEnd_ = endLogicalOffset;
+
+   readAheadJob_ = std::make_shared<ReadAheadJob>();
+   readAheadJob_->cache = this;
 }
 
 std::unique_ptr<PacketLock> PacketReadCache::lock( uint64_t packetLogicalOffset, char *&pkt )
@@ -110,53 +143,103 @@ std::unique_ptr<PacketLock> PacketReadCache::lock( uint64_t packetLogicalOffset,
                             "packetLogicalOffset=" + toString( packetLogicalOffset ) );
    }
 
-   // Linear scan for matching packet offset in cache
-   for ( unsigned i = 0; i < entries_.size(); ++i )
+   // Keep the read-ahead task (if any) away from entries_ while we change them.
+   std::unique_lock<std::mutex> readAheadLock( readAheadMutex_ );
+
+   // Look for matching packet offset in cache
+   const auto found = entryIndex_.find( packetLogicalOffset );
+   if ( found != entryIndex_.end() )
    {
-      auto &entry = entries_[i];
+      const unsigned i = found->second;
 
-      if ( packetLogicalOffset == entry.logicalOffset_ )
-      {
-         // Found a match, so don't have to read anything
+      // Found a match, so don't have to read anything
 #ifdef E57_VERBOSE
-         std::cout << "  Found matching cache entry, index=" << i << std::endl;
+      std::cout << "  Found matching cache entry, index=" << i << std::endl;
 #endif
-         // Mark entry with current useCount (keeps track of age of entry).
-         entry.lastUsed_ = ++useCount_;
+#ifdef E57_ENABLE_STATISTICS
+      if ( cFile_->statistics() != nullptr )
+      {
+         Statistics::add( cFile_->statistics()->packetCacheHits );
+      }
+#endif
+      markUsed( i );
 
-         // Publish buffer address to caller
-         pkt = entry.buffer_;
+      if ( requestReadAhead( packetLogicalOffset, entries_[i].buffer_ ) )
+      {
+         readAheadLock.unlock();
+         startReadAhead();
+      }
 
-         // Create lock so we are sure that we will be unlocked when use is finished.
-         std::unique_ptr<PacketLock> plock( new PacketLock( this, i ) );
+      // Publish buffer address to caller
+      pkt = entries_[i].buffer_;
 
-         // Increment cache lock just before return
-         ++lockCount_;
+      // Create lock so we are sure that we will be unlocked when use is finished.
+      std::unique_ptr<PacketLock> plock( new PacketLock( this, i ) );
 
-         return plock;
-      }
+      // Increment cache lock just before return
+      ++lockCount_;
+
+      return plock;
    }
    // Get here if didn't find a match already in cache.
 
-   // Find least recently used (LRU) packet buffer
-   unsigned oldestEntry = 0;
-   unsigned oldestUsed = entries_.at( 0 ).lastUsed_;
-
-   for ( unsigned i = 0; i < entries_.size(); ++i )
+   if ( ( lockedShared_ != nullptr ) && ( lockedSharedOffset_ == packetLogicalOffset ) )
    {
-      const auto &entry = entries_[i];
-
-      if ( entry.lastUsed_ < oldestUsed )
+#ifdef E57_ENABLE_STATISTICS
+      if ( cFile_->statistics() != nullptr )
       {
-         oldestEntry = i;
-         oldestUsed = entry.lastUsed_;
+         Statistics::add( cFile_->statistics()->packetCacheHits );
       }
+#endif
+      return lockShared( readAheadLock, pkt );
+   }
+
+#ifdef E57_ENABLE_STATISTICS
+   if ( cFile_->statistics() != nullptr )
+   {
+      Statistics::add( cFile_->statistics()->packetCacheMisses );
    }
+#endif
+
+   // Reuse the least recently used (LRU) packet buffer
+   const unsigned oldestEntry = lru_.back();
+
 #ifdef E57_VERBOSE
-   std::cout << "  Oldest entry=" << oldestEntry << " lastUsed=" << oldestUsed << std::endl;
+   std::cout << "  Oldest entry=" << oldestEntry << std::endl;
+#endif
+
+   // Wait for the read-ahead task if it is reading this packet right now.
+   readAheadDone_.wait( readAheadLock,
+                        [&] { return readAheadBusy_ != packetLogicalOffset; } );
+
+   if ( !takeReadAhead( oldestEntry, packetLogicalOffset ) )
+   {
+      // A packet another reader has read is used where it is, instead of being copied
+      if ( shared_ != nullptr )
+      {
+         if ( SharedPacketCache::Packet packet = shared_->find( packetLogicalOffset ) )
+         {
+#ifdef E57_ENABLE_STATISTICS
+            if ( cFile_->statistics() != nullptr )
+            {
+               Statistics::add( cFile_->statistics()->sharedPacketCacheHits );
+            }
 #endif
+            lockedShared_ = std::move( packet );
+            lockedSharedOffset_ = packetLogicalOffset;
+
+            return lockShared( readAheadLock, pkt );
+         }
+      }
+
+      readPacket( oldestEntry, packetLogicalOffset );
+   }
 
-   readPacket( oldestEntry, packetLogicalOffset );
+   if ( requestReadAhead( packetLogicalOffset, entries_[oldestEntry].buffer_ ) )
+   {
+      readAheadLock.unlock();
+      startReadAhead();
+   }
 
    // Publish buffer address to caller
    pkt = entries_[oldestEntry].buffer_;
@@ -170,6 +253,27 @@ std::unique_ptr<PacketLock> PacketReadCache::lock( uint64_t packetLogicalOffset,
    return plock;
 }
 
+// Lock lockedShared_, which isn't in entries_, so the lock has no entry index. Called with
+// readAheadMutex_ locked, which may be unlocked.
+std::unique_ptr<PacketLock> PacketReadCache::lockShared(
+   std::unique_lock<std::mutex> &readAheadLock, char *&pkt )
+{
+   if ( requestReadAhead( lockedSharedOffset_, lockedShared_->data() ) )
+   {
+      readAheadLock.unlock();
+      startReadAhead();
+   }
+
+   // Nobody writes to locked packets, though pkt isn't const
+   pkt = const_cast<char *>( lockedShared_->data() );
+
+   std::unique_ptr<PacketLock> plock( new PacketLock( this, UINT_MAX ) );
+
+   ++lockCount_;
+
+   return plock;
+}
+
 void PacketReadCache::unlock( unsigned cacheIndex )
 {
    //??? why lockedEntry not used?
@@ -194,12 +298,84 @@ void PacketReadCache::readPacket( unsigned oldestEntry, uint64_t packetLogicalOf
              << " packetLogicalOffset=" << packetLogicalOffset << std::endl;
 #endif
 
+#ifdef E57_ENABLE_TRACING
+   TraceScope trace( "PacketReadCache::readPacket" );
+#endif
+
+   // Forget the old contents first so a failed read doesn't leave a bad entry behind.
+   forget( oldestEntry );
+
+   readOrShare( packetLogicalOffset, entries_.at( oldestEntry ).buffer_ );
+
+   remember( oldestEntry, packetLogicalOffset );
+}
+
+// Copy the packet from shared_ if it has it, or read & verify it and give it to shared_. Returns
+// the packet's length.
+unsigned PacketReadCache::readOrShare( uint64_t packetLogicalOffset, char *buffer )
+{
+   if ( shared_ == nullptr )
+   {
+      return readAndVerify( cFile_, packetLogicalOffset, buffer );
+   }
+
+   if ( const SharedPacketCache::Packet packet = shared_->find( packetLogicalOffset ) )
+   {
+#ifdef E57_ENABLE_STATISTICS
+      if ( cFile_->statistics() != nullptr )
+      {
+         Statistics::add( cFile_->statistics()->sharedPacketCacheHits );
+      }
+#endif
+      memcpy( buffer, packet->data(), packet->size() );
+
+      return static_cast<unsigned>( packet->size() );
+   }
+
+   const unsigned length = readAndVerify( cFile_, packetLogicalOffset, buffer );
+
+   shared_->insert( packetLogicalOffset, buffer, length );
+
+   return length;
+}
+
+// Move entries_[entryIndex] to the front of the LRU list.
+void PacketReadCache::markUsed( unsigned entryIndex )
+{
+   lru_.splice( lru_.begin(), lru_, entries_[entryIndex].lruPosition_ );
+}
+
+// Remove the packet in entries_[entryIndex] (if any) from the cache.
+void PacketReadCache::forget( unsigned entryIndex )
+{
+   auto &entry = entries_.at( entryIndex );
+
+   if ( entry.logicalOffset_ != 0 )
+   {
+      entryIndex_.erase( entry.logicalOffset_ );
+      entry.logicalOffset_ = 0;
+   }
+}
+
+// Record that entries_[entryIndex] now holds the packet at packetLogicalOffset.
+void PacketReadCache::remember( unsigned entryIndex, uint64_t packetLogicalOffset )
+{
+   entries_.at( entryIndex ).logicalOffset_ = packetLogicalOffset;
+   entryIndex_[packetLogicalOffset] = entryIndex;
+
+   markUsed( entryIndex );
+}
+
+// Read a whole packet into buffer (which must hold DATA_PACKET_MAX bytes) & verify it.
+// Returns the packet's length.
+unsigned PacketReadCache::readAndVerify( CheckedFile *file, uint64_t packetLogicalOffset,
+                                         char *buffer )
+{
    // Read header of packet first to get length.  Use EmptyPacketHeader since  it has the fields
    // common to all packets.
    EmptyPacketHeader header;
 
-   cFile_->seek( packetLogicalOffset, CheckedFile::Logical );
-   cFile_->read( reinterpret_cast<char *>( &header ), sizeof( header ) );
+   file->readAt( packetLogicalOffset, reinterpret_cast<char *>( &header ), sizeof( header ) );
 
    // Can't verify packet header here, because it is not really an EmptyPacketHeader.
    unsigned packetLength = header.packetLogicalLengthMinus1 + 1;
@@ -210,18 +386,15 @@ void PacketReadCache::readPacket( unsigned oldestEntry, uint64_t packetLogicalOf
       throw E57_EXCEPTION2( ErrorBadCVPacket, "packetLength=" + toString( packetLength ) );
    }
 
-   auto &entry = entries_.at( oldestEntry );
-
-   // Now read in whole packet into preallocated buffer_.  Note buffer is
-   cFile_->seek( packetLogicalOffset, CheckedFile::Logical );
-   cFile_->read( entry.buffer_, packetLength );
+   // Now read in whole packet into preallocated buffer.
+   file->readAt( packetLogicalOffset, buffer, packetLength );
 
    // Verify that packet is good.
    switch ( header.packetType )
    {
       case DATA_PACKET:
       {
-         auto dpkt = reinterpret_cast<DataPacket *>( entry.buffer_ );
+         auto dpkt = reinterpret_cast<DataPacket *>( buffer );
 
          dpkt->verify( packetLength );
 #ifdef E57_VERBOSE
@@ -232,7 +405,7 @@ void PacketReadCache::readPacket( unsigned oldestEntry, uint64_t packetLogicalOf
       break;
       case INDEX_PACKET:
       {
-         auto ipkt = reinterpret_cast<IndexPacket *>( entry.buffer_ );
+         auto ipkt = reinterpret_cast<IndexPacket *>( buffer );
 
          ipkt->verify( packetLength );
 #ifdef E57_VERBOSE
@@ -243,7 +416,7 @@ void PacketReadCache::readPacket( unsigned oldestEntry, uint64_t packetLogicalOf
       break;
       case EMPTY_PACKET:
       {
-         auto hp = reinterpret_cast<EmptyPacketHeader *>( entry.buffer_ );
+         auto hp = reinterpret_cast<EmptyPacketHeader *>( buffer );
 
          hp->verify( packetLength );
 #ifdef E57_VERBOSE
@@ -256,24 +429,229 @@ void PacketReadCache::readPacket( unsigned oldestEntry, uint64_t packetLogicalOf
          throw E57_EXCEPTION2( ErrorInternal, "packetType=" + toString( header.packetType ) );
    }
 
-   entry.logicalOffset_ = packetLogicalOffset;
+   return packetLength;
+}
+
+// If the read-ahead task has already read packetLogicalOffset, move it into
+// entries_[entryIndex]. Called with readAheadMutex_ locked.
+bool PacketReadCache::takeReadAhead( unsigned entryIndex, uint64_t packetLogicalOffset )
+{
+   for ( auto &slot : readAheadSlots_ )
+   {
+      if ( slot.logicalOffset_ == packetLogicalOffset )
+      {
+         forget( entryIndex );
+
+         memcpy( entries_.at( entryIndex ).buffer_, slot.buffer_.data(), slot.length_ );
+
+         remember( entryIndex, packetLogicalOffset );
+
+         slot.logicalOffset_ = 0;
+
+         return true;
+      }
+   }
+
+   return false;
+}
+
+// Ask read-ahead to start from the packet after the one at packetLogicalOffset, held in packet.
+// Returns true if a task has to be started for it with startReadAhead() (after unlocking, since
+// an executor may run it straight away). Called with readAheadMutex_ locked.
+bool PacketReadCache::requestReadAhead( uint64_t packetLogicalOffset, const char *packet )
+{
+   if ( readAheadJob_ == nullptr )
+   {
+      return false;
+   }
+
+   const auto header = reinterpret_cast<const EmptyPacketHeader *>( packet );
+
+   readAheadFrom_ = packetLogicalOffset + header->packetLogicalLengthMinus1 + 1;
+
+   if ( readAheadRunning_ || readAheadStopping_ )
+   {
+      return false;
+   }
+
+   uint64_t workLogicalOffset = 0;
+   unsigned slotIndex = 0;
+
+   if ( !findReadAheadWork( workLogicalOffset, slotIndex ) )
+   {
+      return false;
+   }
+
+   readAheadRunning_ = true;
+
+   return true;
+}
+
+// Give the executor a task to read ahead until there is nothing left to read.
+void PacketReadCache::startReadAhead()
+{
+   const std::shared_ptr<ReadAheadJob> job = readAheadJob_;
+
+   const auto &executor = cFile_->executor();
+
+   ( executor != nullptr ? executor : WorkStealingExecutor::defaultExecutor() )
+      ->execute( [job] {
+         std::lock_guard<std::mutex> guard( job->mutex );
+
+         if ( job->cache != nullptr )
+         {
+            job->cache->readAheadLoop();
+         }
+      } );
+}
+
+// Length of a packet we already have, either in entries_ or in a read-ahead slot, or 0 if we
+// don't have it. Called with readAheadMutex_ locked.
+unsigned PacketReadCache::knownPacketLength( uint64_t packetLogicalOffset ) const
+{
+   for ( const auto &slot : readAheadSlots_ )
+   {
+      if ( slot.logicalOffset_ == packetLogicalOffset )
+      {
+         return slot.length_;
+      }
+   }
+
+   const auto found = entryIndex_.find( packetLogicalOffset );
+   if ( found != entryIndex_.end() )
+   {
+      const auto header =
+         reinterpret_cast<const EmptyPacketHeader *>( entries_[found->second].buffer_ );
+
+      return header->packetLogicalLengthMinus1 + 1u;
+   }
 
-   // Mark entry with current useCount (keeps track of age of entry).
-   // This is a cache, so a small hiccup when useCount_ overflows won't hurt.
-   entry.lastUsed_ = ++useCount_;
+   if ( ( lockedShared_ != nullptr ) && ( lockedSharedOffset_ == packetLogicalOffset ) )
+   {
+      return static_cast<unsigned>( lockedShared_->size() );
+   }
+
+   return 0;
+}
+
+// Walk the packets after readAheadFrom_ to find the first one we don't have yet, and a slot
+// to read it into which doesn't hold one of the packets before it. Called with
+// readAheadMutex_ locked.
+bool PacketReadCache::findReadAheadWork( uint64_t &packetLogicalOffset, unsigned &slotIndex )
+{
+   std::vector<bool> slotInUse( readAheadSlots_.size(), false );
+
+   uint64_t offset = readAheadFrom_;
+
+   for ( size_t i = 0; ( i < readAheadSlots_.size() ) && ( offset != 0 ) &&
+                       ( offset < readAheadEnd_ ) && ( offset != readAheadFailed_ );
+         ++i )
+   {
+      const unsigned length = knownPacketLength( offset );
+
+      if ( length == 0 )
+      {
+         // There are fewer packets before this one than slots, so there is always a free one.
+         // Prefer empty slots and ones holding packets we have already gone past.
+         slotIndex = 0;
+         for ( unsigned s = 0; s < readAheadSlots_.size(); ++s )
+         {
+            if ( !slotInUse[s] )
+            {
+               slotIndex = s;
+
+               if ( readAheadSlots_[s].logicalOffset_ < readAheadFrom_ )
+               {
+                  break;
+               }
+            }
+         }
+
+         packetLogicalOffset = offset;
+
+         return true;
+      }
+
+      for ( unsigned s = 0; s < readAheadSlots_.size(); ++s )
+      {
+         if ( readAheadSlots_[s].logicalOffset_ == offset )
+         {
+            slotInUse[s] = true;
+         }
+      }
+
+      offset += length;
+   }
+
+   return false;
+}
+
+void PacketReadCache::readAheadLoop()
+{
+   std::unique_lock<std::mutex> lock( readAheadMutex_ );
+
+   while ( true )
+   {
+      uint64_t packetLogicalOffset = 0;
+      unsigned slotIndex = 0;
+
+      // Stop when there is nothing to read. requestReadAhead() starts another task when there is.
+      if ( readAheadStopping_ || !findReadAheadWork( packetLogicalOffset, slotIndex ) )
+      {
+         readAheadRunning_ = false;
+         return;
+      }
+
+      auto &slot = readAheadSlots_[slotIndex];
+
+      slot.logicalOffset_ = 0;
+      readAheadBusy_ = packetLogicalOffset;
+
+      lock.unlock();
+
+      unsigned length = 0;
+      try
+      {
+#ifdef E57_ENABLE_TRACING
+         TraceScope trace( "PacketReadCache::readAhead" );
+#endif
+
+         length = readOrShare( packetLogicalOffset, slot.buffer_.data() );
+      }
+      catch ( ... )
+      {
+         // Leave it for lock() to read again, which will report the error properly.
+      }
+
+      lock.lock();
+
+      if ( length > 0 )
+      {
+         slot.logicalOffset_ = packetLogicalOffset;
+         slot.length_ = length;
+      }
+      else
+      {
+         readAheadFailed_ = packetLogicalOffset;
+      }
+
+      readAheadBusy_ = 0;
+
+      readAheadDone_.notify_all();
+   }
 }
 
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
 void PacketReadCache::dump( int indent, std::ostream &os )
 {
    os << space( indent ) << "lockCount: " << lockCount_ << std::endl;
-   os << space( indent ) << "useCount:  " << useCount_ << std::endl;
    os << space( indent ) << "entries:" << std::endl;
    for ( unsigned i = 0; i < entries_.size(); i++ )
    {
       os << space( indent ) << "entry[" << i << "]:" << std::endl;
       os << space( indent + 4 ) << "logicalOffset:  " << entries_[i].logicalOffset_ << std::endl;
-      os << space( indent + 4 ) << "lastUsed:        " << entries_[i].lastUsed_ << std::endl;
+      os << space( indent + 4 ) << "lruRank:        "
+         << std::distance( lru_.begin(), entries_[i].lruPosition_ ) << std::endl;
       if ( entries_[i].logicalOffset_ != 0 )
       {
          os << space( indent + 4 ) << "packet:" << std::endl;
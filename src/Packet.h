@@ -27,15 +27,22 @@
 
 #pragma once
 
+#include <condition_variable>
 #include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 #include "Common.h"
+#include "MemoryAccount.h"
 
 namespace e57
 {
    class CheckedFile;
    class PacketLock;
+   class SharedPacketCache;
 
    // Packet types (in a compressed vector section)
    enum
@@ -51,11 +58,26 @@ namespace e57
    class PacketReadCache
    {
    public:
-      PacketReadCache( CheckedFile *cFile, unsigned packetCount );
+      /// @param account Where the cache and read-ahead are counted, if anywhere. If it has a
+      /// budget, fewer than @a packetCount packets (but at least one) may be cached.
+      /// @param shared Where packets are looked for before they are read from the file, and put
+      /// once they have been, if anywhere.
+      PacketReadCache( CheckedFile *cFile, unsigned packetCount,
+                       std::shared_ptr<MemoryAccount> account = nullptr,
+                       std::shared_ptr<SharedPacketCache> shared = nullptr );
+      ~PacketReadCache();
+
+      PacketReadCache( const PacketReadCache & ) = delete;
+      PacketReadCache &operator=( const PacketReadCache & ) = delete;
 
       std::unique_ptr<PacketLock> lock( uint64_t packetLogicalOffset,
                                         char *&pkt ); //??? pkt could be const
 
+      /// Read up to packetCount packets following each locked packet on the file's executor,
+      /// stopping at endLogicalOffset, so file reads overlap with decoding. Does nothing on a file
+      /// being written, or if the memory budget has no room.
+      void enableReadAhead( unsigned packetCount, uint64_t endLogicalOffset );
+
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
       void dump( int indent = 0, std::ostream &os = std::cout );
 #endif
@@ -67,19 +89,76 @@ namespace e57
       void unlock( unsigned cacheIndex );
 
       void readPacket( unsigned oldestEntry, uint64_t packetLogicalOffset );
+      std::unique_ptr<PacketLock> lockShared( std::unique_lock<std::mutex> &readAheadLock,
+                                              char *&pkt );
+      void markUsed( unsigned entryIndex );
+      void forget( unsigned entryIndex );
+      void remember( unsigned entryIndex, uint64_t packetLogicalOffset );
+      bool takeReadAhead( unsigned entryIndex, uint64_t packetLogicalOffset );
+      bool requestReadAhead( uint64_t packetLogicalOffset, const char *packet );
+      void startReadAhead();
+      void readAheadLoop();
+      bool findReadAheadWork( uint64_t &packetLogicalOffset, unsigned &slotIndex );
+      unsigned knownPacketLength( uint64_t packetLogicalOffset ) const;
+
+      static unsigned readAndVerify( CheckedFile *file, uint64_t packetLogicalOffset,
+                                     char *buffer );
+
+      unsigned readOrShare( uint64_t packetLogicalOffset, char *buffer );
 
       struct CacheEntry
       {
          uint64_t logicalOffset_ = 0;
          char buffer_[DATA_PACKET_MAX]; // No need to init since it's a data buffer
-         unsigned lastUsed_ = 0;
+         std::list<unsigned>::iterator lruPosition_;
+      };
+
+      /// Packet read ahead, waiting to be moved into entries_
+      struct ReadAheadSlot
+      {
+         uint64_t logicalOffset_ = 0; // 0 if empty or not finished reading
+         unsigned length_ = 0;
+         std::vector<char> buffer_;
       };
 
       unsigned lockCount_ = 0;
-      unsigned useCount_ = 0;
       CheckedFile *cFile_ = nullptr;
 
       std::vector<CacheEntry> entries_;
+      std::list<unsigned> lru_; // indices into entries_, most recently used first
+      std::unordered_map<uint64_t, unsigned> entryIndex_; // packet logical offset -> entries_ index
+
+      /// The packet lock() last handed out straight from shared_ rather than copying it into
+      /// entries_. It is held until another one replaces it, so it stays valid after its lock is
+      /// released just as an entry does.
+      std::shared_ptr<const std::vector<char>> lockedShared_;
+      uint64_t lockedSharedOffset_ = 0;
+
+      std::shared_ptr<MemoryAccount> account_;
+      std::shared_ptr<SharedPacketCache> shared_;
+      MemoryCharge entriesCharge_;
+      MemoryCharge readAheadCharge_;
+
+      /// What the executor's read-ahead task uses, so it can outlive the cache. The task holds
+      /// mutex while it runs, and does nothing once cache is nullptr.
+      struct ReadAheadJob
+      {
+         std::mutex mutex;
+         PacketReadCache *cache = nullptr;
+      };
+
+      // Read-ahead (only if enableReadAhead() was called). readAheadMutex_ protects entries_ and
+      // everything below.
+      std::shared_ptr<ReadAheadJob> readAheadJob_;
+      std::mutex readAheadMutex_;
+      std::condition_variable readAheadDone_;
+      std::vector<ReadAheadSlot> readAheadSlots_;
+      uint64_t readAheadFrom_ = 0;      // first packet wanted (the one after the last locked)
+      uint64_t readAheadEnd_ = 0;       // end of the section
+      uint64_t readAheadBusy_ = 0;      // packet being read right now
+      uint64_t readAheadFailed_ = 0;    // packet which could not be read, so don't try again
+      bool readAheadRunning_ = false;   // the read-ahead task has been given to the executor
+      bool readAheadStopping_ = false;
    };
 
    class PacketLock
@@ -147,4 +226,49 @@ namespace e57
 
       uint8_t payload[PayloadSize]; // No need to init since it's a data buffer
    };
+
+   struct IndexPacketHeader
+   {
+      const uint8_t packetType = INDEX_PACKET;
+
+      uint8_t packetFlags = 0; // flag bitfields
+      uint16_t packetLogicalLengthMinus1 = 0;
+      uint16_t entryCount = 0;
+      uint8_t indexLevel = 0;
+      uint8_t reserved1[9] = {}; // must be zero
+   };
+
+   struct IndexPacket
+   {
+      IndexPacketHeader header;
+
+      static constexpr unsigned MAX_ENTRIES = 2048;
+
+      struct IndexPacketEntry
+      {
+         uint64_t chunkRecordNumber = 0;
+         uint64_t chunkPhysicalOffset = 0;
+      } entries[MAX_ENTRIES];
+
+      void verify( unsigned bufferLength = 0, uint64_t totalRecordCount = 0,
+                   uint64_t fileSize = 0 ) const;
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+      void dump( int indent = 0, std::ostream &os = std::cout ) const;
+#endif
+   };
+
+   struct EmptyPacketHeader
+   {
+      const uint8_t packetType = EMPTY_PACKET;
+
+      uint8_t reserved1 = 0; // must be zero
+      uint16_t packetLogicalLengthMinus1 = 0;
+
+      void verify( unsigned bufferLength = 0 ) const; //???use
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+      void dump( int indent = 0, std::ostream &os = std::cout ) const;
+#endif
+   };
 }
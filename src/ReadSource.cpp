@@ -0,0 +1,232 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// convenience helper for all the BSDs
+#if defined( __FreeBSD__ ) || defined( __NetBSD__ ) || defined( __OpenBSD__ )
+#define __BSD
+#endif
+
+#if defined( _WIN32 )
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#if defined( _MSC_VER )
+#include <codecvt>
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined( __linux__ ) || defined( __EMSCRIPTEN__ )
+#define _LARGEFILE64_SOURCE
+#define __LARGE64_FILES
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#elif defined( __APPLE__ ) || defined( __BSD )
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#else
+#error "no supported OS platform defined"
+#endif
+
+#include <cerrno>
+#include <cstring>
+
+#include "ReadSource.h"
+#include "StringFunctions.h"
+
+namespace e57
+{
+   ustring ReadSource::name() const
+   {
+      return "<ReadSource>";
+   }
+
+   void ReadSource::readRanges( const std::vector<Range> &ranges )
+   {
+      for ( const auto &range : ranges )
+      {
+         readAt( range.offset, range.buffer, range.count );
+      }
+   }
+
+   std::future<void> ReadSource::readAtAsync( uint64_t offset, char *buffer, size_t count )
+   {
+      std::promise<void> promise;
+
+      try
+      {
+         readAt( offset, buffer, count );
+         promise.set_value();
+      }
+      catch ( ... )
+      {
+         promise.set_exception( std::current_exception() );
+      }
+
+      return promise.get_future();
+   }
+
+   const char *ReadSource::data() const
+   {
+      return nullptr;
+   }
+
+   void readFileAt( int fd, uint64_t offset, char *buffer, size_t count, const ustring &fileName )
+   {
+      // The OS may return less than we asked for, so keep going until we have it all
+      size_t total = 0;
+
+      while ( total < count )
+      {
+         const uint64_t position = offset + total;
+
+#if defined( _WIN32 )
+         const auto fileHandle = reinterpret_cast<HANDLE>( ::_get_osfhandle( fd ) );
+
+         OVERLAPPED overlapped = {};
+         overlapped.Offset = static_cast<DWORD>( position & 0xFFFFFFFF );
+         overlapped.OffsetHigh = static_cast<DWORD>( position >> 32 );
+
+         DWORD bytesRead = 0;
+         int64_t result = -1;
+
+         if ( ::ReadFile( fileHandle, buffer + total, static_cast<DWORD>( count - total ),
+                          &bytesRead, &overlapped ) )
+         {
+            result = bytesRead;
+         }
+#elif defined( __linux__ ) || defined( __EMSCRIPTEN__ )
+         ssize_t result =
+            ::pread64( fd, buffer + total, count - total, static_cast<off64_t>( position ) );
+#elif defined( __APPLE__ ) || defined( __BSD )
+         ssize_t result =
+            ::pread( fd, buffer + total, count - total, static_cast<off_t>( position ) );
+#endif
+
+         if ( result <= 0 )
+         {
+            throw E57_EXCEPTION2( ErrorReadFailed, "fileName=" + fileName +
+                                                      " result=" + toString( result ) +
+                                                      " offset=" + toString( position ) );
+         }
+
+         total += static_cast<size_t>( result );
+      }
+   }
+
+   ReadOnlyFile::ReadOnlyFile( const ustring &fileName )
+   {
+#if defined( _MSC_VER )
+      // Handle UTF-8 file names - Windows requires conversion to UTF-16
+      std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+      std::wstring widePath = converter.from_bytes( fileName );
+
+      if ( _wsopen_s( &fd_, widePath.c_str(), O_RDONLY | O_BINARY, _SH_DENYNO, _S_IREAD ) != 0 )
+      {
+         fd_ = -1;
+      }
+#elif defined( _WIN32 )
+      fd_ = ::open( fileName.c_str(), O_RDONLY | O_BINARY );
+#else
+      fd_ = ::open( fileName.c_str(), O_RDONLY );
+#endif
+
+      if ( fd_ < 0 )
+      {
+         throw E57_EXCEPTION2( ErrorOpenFailed,
+                               "errno=" + toString( errno ) + " fileName=" + fileName );
+      }
+
+#if defined( _WIN32 )
+      const int64_t size = _lseeki64( fd_, 0, SEEK_END );
+#elif defined( __linux__ ) || defined( __EMSCRIPTEN__ )
+      const int64_t size = ::lseek64( fd_, 0, SEEK_END );
+#else
+      const int64_t size = ::lseek( fd_, 0, SEEK_END );
+#endif
+
+      if ( size < 0 )
+      {
+         const int error = errno;
+
+#if defined( _WIN32 )
+         ::_close( fd_ );
+#else
+         ::close( fd_ );
+#endif
+
+         throw E57_EXCEPTION2( ErrorOpenFailed,
+                               "errno=" + toString( error ) + " fileName=" + fileName );
+      }
+
+      size_ = static_cast<uint64_t>( size );
+   }
+
+   ReadOnlyFile::~ReadOnlyFile()
+   {
+#if defined( _WIN32 )
+      ::_close( fd_ );
+#else
+      ::close( fd_ );
+#endif
+   }
+
+   FileReadSource::FileReadSource( int fd, const ustring &fileName, uint64_t size ) :
+      fd_( fd ), fileName_( fileName ), size_( size )
+   {
+   }
+
+   ustring FileReadSource::name() const
+   {
+      return fileName_;
+   }
+
+   uint64_t FileReadSource::size() const
+   {
+      return size_;
+   }
+
+   void FileReadSource::readAt( uint64_t offset, char *buffer, size_t count )
+   {
+      readFileAt( fd_, offset, buffer, count, fileName_ );
+   }
+
+   MemoryReadSource::MemoryReadSource( const char *data, uint64_t size, const ustring &name ) :
+      data_( data ), size_( size ), name_( name )
+   {
+   }
+
+   ustring MemoryReadSource::name() const
+   {
+      return name_;
+   }
+
+   uint64_t MemoryReadSource::size() const
+   {
+      return size_;
+   }
+
+   void MemoryReadSource::readAt( uint64_t offset, char *buffer, size_t count )
+   {
+      if ( ( offset > size_ ) || ( count > size_ - offset ) )
+      {
+         throw E57_EXCEPTION2( ErrorReadFailed, "name=" + name_ + " offset=" + toString( offset ) +
+                                                   " count=" + toString( count ) +
+                                                   " size=" + toString( size_ ) );
+      }
+
+      memcpy( buffer, data_ + offset, count );
+   }
+
+   const char *MemoryReadSource::data() const
+   {
+      return data_;
+   }
+}
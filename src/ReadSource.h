@@ -0,0 +1,75 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// The ReadSources used by CheckedFile for local files and buffers in memory.
+
+#include "Common.h"
+
+namespace e57
+{
+   /// Read exactly @a count bytes at @a offset of the open file @a fd without using or moving
+   /// the file position. @a fileName is only used in error messages.
+   void readFileAt( int fd, uint64_t offset, char *buffer, size_t count, const ustring &fileName );
+
+   /// A local file opened for reading, which is closed when this is destroyed
+   class ReadOnlyFile
+   {
+   public:
+      /// @throw ErrorOpenFailed
+      explicit ReadOnlyFile( const ustring &fileName );
+      ~ReadOnlyFile();
+
+      ReadOnlyFile( const ReadOnlyFile & ) = delete;
+      ReadOnlyFile &operator=( const ReadOnlyFile & ) = delete;
+
+      int fd() const
+      {
+         return fd_;
+      }
+
+      uint64_t size() const
+      {
+         return size_;
+      }
+
+   private:
+      int fd_ = -1;
+      uint64_t size_ = 0;
+   };
+
+   /// Reads an open file with positional reads, so several threads can read it at once. The
+   /// file descriptor isn't owned, and must stay open for as long as the source is used.
+   class FileReadSource : public ReadSource
+   {
+   public:
+      FileReadSource( int fd, const ustring &fileName, uint64_t size );
+
+      ustring name() const override;
+      uint64_t size() const override;
+      void readAt( uint64_t offset, char *buffer, size_t count ) override;
+
+   private:
+      const int fd_;
+      const ustring fileName_;
+      const uint64_t size_;
+   };
+
+   /// Reads a buffer in memory (a user's buffer or a mapped file). The buffer isn't owned, and
+   /// must stay valid for as long as the source is used.
+   class MemoryReadSource : public ReadSource
+   {
+   public:
+      MemoryReadSource( const char *data, uint64_t size, const ustring &name );
+
+      ustring name() const override;
+      uint64_t size() const override;
+      void readAt( uint64_t offset, char *buffer, size_t count ) override;
+      const char *data() const override;
+
+   private:
+      const char *data_;
+      const uint64_t size_;
+      const ustring name_;
+   };
+}
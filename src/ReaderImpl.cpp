@@ -26,9 +26,35 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#if defined( _WIN32 )
+#if defined( _MSC_VER )
+#include <codecvt>
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
 #include "ReaderImpl.h"
 #include "Common.h"
+#include "InterleavedPoints.h"
+#include "LevelsOfDetail.h"
+#include "SpatialIndex.h"
 #include "StringFunctions.h"
+#include "WorkerPool.h"
 
 namespace e57
 {
@@ -41,10 +67,12 @@ namespace e57
    @param [out] start position in the block to start reading
    @param [out] count size of desired chunk or buffer size
 
+   @param [in] threadCount number of threads to read with
+
    @return number of bytes read
    */
    size_t _readImage2DNode( const StructureNode &image, Image2DType imageType, uint8_t *pBuffer,
-                            int64_t start, size_t count )
+                            int64_t start, size_t count, unsigned threadCount )
    {
       size_t transferred = 0;
 
@@ -57,7 +85,7 @@ namespace e57
             if ( image.isDefined( "jpegImage" ) )
             {
                BlobNode jpegImage( image.get( "jpegImage" ) );
-               jpegImage.read( pBuffer, start, count );
+               jpegImage.read( pBuffer, start, count, threadCount );
                transferred = count;
             }
             break;
@@ -66,7 +94,7 @@ namespace e57
             if ( image.isDefined( "pngImage" ) )
             {
                BlobNode pngImage( image.get( "pngImage" ) );
-               pngImage.read( pBuffer, start, count );
+               pngImage.read( pBuffer, start, count, threadCount );
                transferred = count;
             }
             break;
@@ -75,7 +103,7 @@ namespace e57
             if ( image.isDefined( "imageMask" ) )
             {
                BlobNode imageMask( image.get( "imageMask" ) );
-               imageMask.read( pBuffer, start, count );
+               imageMask.read( pBuffer, start, count, threadCount );
                transferred = count;
             }
             break;
@@ -188,11 +216,268 @@ namespace e57
       }
    }
 
+   // Number of points ReadData3DGridRows() decodes at a time on each thread
+   constexpr size_t cGridBlockSize = 65'536;
+
+   // Turn off the fields which @a points has no buffers for
+   template <typename COORDTYPE>
+   static void _restrictPointFields( PointStandardizedFieldsAvailable &fields,
+                                     const Data3DPointsData_t<COORDTYPE> &points )
+   {
+      fields.cartesianXField &= ( points.cartesianX != nullptr );
+      fields.cartesianYField &= ( points.cartesianY != nullptr );
+      fields.cartesianZField &= ( points.cartesianZ != nullptr );
+      fields.cartesianInvalidStateField &=
+         ( points.cartesianInvalidState != nullptr ) ||
+         ( points.cartesianInvalidStateBits.data != nullptr );
+      fields.sphericalRangeField &= ( points.sphericalRange != nullptr );
+      fields.sphericalAzimuthField &= ( points.sphericalAzimuth != nullptr );
+      fields.sphericalElevationField &= ( points.sphericalElevation != nullptr );
+      fields.sphericalInvalidStateField &=
+         ( points.sphericalInvalidState != nullptr ) ||
+         ( points.sphericalInvalidStateBits.data != nullptr );
+      fields.rowIndexField &= ( points.rowIndex != nullptr );
+      fields.columnIndexField &= ( points.columnIndex != nullptr );
+      fields.returnIndexField &= ( points.returnIndex != nullptr );
+      fields.returnCountField &= ( points.returnCount != nullptr );
+      fields.timeStampField &= ( points.timeStamp != nullptr );
+      fields.isTimeStampInvalidField &=
+         ( points.isTimeStampInvalid != nullptr ) ||
+         ( points.isTimeStampInvalidBits.data != nullptr );
+      fields.intensityField &= ( points.intensity != nullptr );
+      fields.isIntensityInvalidField &=
+         ( points.isIntensityInvalid != nullptr ) ||
+         ( points.isIntensityInvalidBits.data != nullptr );
+      fields.colorRedField &= ( points.colorRed != nullptr );
+      fields.colorGreenField &= ( points.colorGreen != nullptr );
+      fields.colorBlueField &= ( points.colorBlue != nullptr );
+      fields.isColorInvalidField &=
+         ( points.isColorInvalid != nullptr ) || ( points.isColorInvalidBits.data != nullptr );
+      fields.normalXField &= ( points.normalX != nullptr );
+      fields.normalYField &= ( points.normalY != nullptr );
+      fields.normalZField &= ( points.normalZ != nullptr );
+   }
+
+   // Copy point @a fromIndex of @a from to @a toIndex of @a to, for the fields both have
+   template <typename COORDTYPE>
+   static void _copyPoint( const Data3DPointsData_t<COORDTYPE> &to, size_t toIndex,
+                           const Data3DPointsData_t<COORDTYPE> &from, size_t fromIndex )
+   {
+      const auto copy = [=]( auto *toField, const auto *fromField ) {
+         if ( ( toField != nullptr ) && ( fromField != nullptr ) )
+         {
+            toField[toIndex] = fromField[fromIndex];
+         }
+      };
+
+      copy( to.cartesianX, from.cartesianX );
+      copy( to.cartesianY, from.cartesianY );
+      copy( to.cartesianZ, from.cartesianZ );
+      copy( to.cartesianInvalidState, from.cartesianInvalidState );
+      copy( to.sphericalRange, from.sphericalRange );
+      copy( to.sphericalAzimuth, from.sphericalAzimuth );
+      copy( to.sphericalElevation, from.sphericalElevation );
+      copy( to.sphericalInvalidState, from.sphericalInvalidState );
+      copy( to.rowIndex, from.rowIndex );
+      copy( to.columnIndex, from.columnIndex );
+      copy( to.returnIndex, from.returnIndex );
+      copy( to.returnCount, from.returnCount );
+      copy( to.timeStamp, from.timeStamp );
+      copy( to.isTimeStampInvalid, from.isTimeStampInvalid );
+      copy( to.intensity, from.intensity );
+      copy( to.isIntensityInvalid, from.isIntensityInvalid );
+      copy( to.colorRed, from.colorRed );
+      copy( to.colorGreen, from.colorGreen );
+      copy( to.colorBlue, from.colorBlue );
+      copy( to.isColorInvalid, from.isColorInvalid );
+      copy( to.normalX, from.normalX );
+      copy( to.normalY, from.normalY );
+      copy( to.normalZ, from.normalZ );
+
+      // @a from has int8_t invalid states, which may be packed in @a to
+      const auto copyBits = [=]( const PackedBits &toField, const int8_t *fromField ) {
+         if ( ( toField.data != nullptr ) && ( fromField != nullptr ) )
+         {
+            toField.set( toIndex, static_cast<unsigned>( fromField[fromIndex] ) );
+         }
+      };
+
+      copyBits( to.cartesianInvalidStateBits, from.cartesianInvalidState );
+      copyBits( to.sphericalInvalidStateBits, from.sphericalInvalidState );
+      copyBits( to.isTimeStampInvalidBits, from.isTimeStampInvalid );
+      copyBits( to.isIntensityInvalidBits, from.isIntensityInvalid );
+      copyBits( to.isColorInvalidBits, from.isColorInvalid );
+   }
+
+   // The row-major 3×4 matrix of the pose of Data3D @a scan
+   static std::array<double, 12> _poseMatrix( const StructureNode &scan )
+   {
+      Quaternion q;
+      Translation t;
+
+      if ( scan.isDefined( "pose" ) )
+      {
+         const StructureNode pose( scan.get( "pose" ) );
+
+         if ( pose.isDefined( "rotation" ) )
+         {
+            const StructureNode rotation( pose.get( "rotation" ) );
+
+            q.w = FloatNode( rotation.get( "w" ) ).value();
+            q.x = FloatNode( rotation.get( "x" ) ).value();
+            q.y = FloatNode( rotation.get( "y" ) ).value();
+            q.z = FloatNode( rotation.get( "z" ) ).value();
+         }
+
+         if ( pose.isDefined( "translation" ) )
+         {
+            const StructureNode translation( pose.get( "translation" ) );
+
+            t.x = FloatNode( translation.get( "x" ) ).value();
+            t.y = FloatNode( translation.get( "y" ) ).value();
+            t.z = FloatNode( translation.get( "z" ) ).value();
+         }
+      }
+
+      // The rotation of a unit quaternion
+      return { { 1.0 - 2.0 * ( q.y * q.y + q.z * q.z ), 2.0 * ( q.x * q.y - q.z * q.w ),
+                 2.0 * ( q.x * q.z + q.y * q.w ), t.x,
+
+                 2.0 * ( q.x * q.y + q.z * q.w ), 1.0 - 2.0 * ( q.x * q.x + q.z * q.z ),
+                 2.0 * ( q.y * q.z - q.x * q.w ), t.y,
+
+                 2.0 * ( q.x * q.z - q.y * q.w ), 2.0 * ( q.y * q.z + q.x * q.w ),
+                 1.0 - 2.0 * ( q.x * q.x + q.y * q.y ), t.z } };
+   }
+
+   // The bounding box of @a bounds after it is transformed by @a matrix
+   static CartesianBounds _transformBounds( const std::array<double, 12> &matrix,
+                                            const CartesianBounds &bounds )
+   {
+      CartesianBounds result;
+      double *extents[3][2] = { { &result.xMinimum, &result.xMaximum },
+                                { &result.yMinimum, &result.yMaximum },
+                                { &result.zMinimum, &result.zMaximum } };
+
+      const double minimums[3] = { bounds.xMinimum, bounds.yMinimum, bounds.zMinimum };
+      const double maximums[3] = { bounds.xMaximum, bounds.yMaximum, bounds.zMaximum };
+
+      // Each row's smallest and largest values come from the smallest and largest terms
+      for ( size_t row = 0; row < 3; ++row )
+      {
+         double low = matrix[row * 4 + 3];
+         double high = low;
+
+         for ( size_t column = 0; column < 3; ++column )
+         {
+            const double a = matrix[row * 4 + column] * minimums[column];
+            const double b = matrix[row * 4 + column] * maximums[column];
+
+            low += std::min( a, b );
+            high += std::max( a, b );
+         }
+
+         *extents[row][0] = low;
+         *extents[row][1] = high;
+      }
+
+      return result;
+   }
+
+   /// The size and modification time (in nanoseconds since the epoch) of the file at @a path,
+   /// which tell whether a MetadataSummary made from it is up to date
+   static bool _fileSizeAndModified( const ustring &path, uint64_t &size, int64_t &modified )
+   {
+#if defined( _WIN32 )
+      struct _stat64 status = {};
+
+      //??? unicode support here
+      if ( ::_stat64( path.c_str(), &status ) != 0 )
+      {
+         return false;
+      }
+
+      const int64_t nanoseconds = 0;
+#else
+      struct stat status = {};
+
+      if ( ::stat( path.c_str(), &status ) != 0 )
+      {
+         return false;
+      }
+
+#if defined( __APPLE__ )
+      const int64_t nanoseconds = status.st_mtimespec.tv_nsec;
+#elif defined( __linux__ ) || defined( __EMSCRIPTEN__ )
+      const int64_t nanoseconds = status.st_mtim.tv_nsec;
+#else
+      const int64_t nanoseconds = 0;
+#endif
+#endif
+
+      size = static_cast<uint64_t>( status.st_size );
+      modified = static_cast<int64_t>( status.st_mtime ) * 1000000000 + nanoseconds;
+
+      return true;
+   }
+
+   /// The ImageFileOptions part of @a options
+   static ImageFileOptions imageFileOptions( const ReaderOptions &options )
+   {
+      ImageFileOptions imageOptions{ options.checksumPolicy, options.lazyLoadXml,
+                                     options.validateXml, options.useNodeArena,
+                                     options.verifyChecksumThreadCount };
+      imageOptions.follow = options.follow;
+      imageOptions.executor = options.executor;
+      imageOptions.memoryBudget = options.memoryBudget;
+
+      return imageOptions;
+   }
+
    ReaderImpl::ReaderImpl( const ustring &filePath, const ReaderOptions &options ) :
-      imf_( filePath, "r", options.checksumPolicy ), root_( imf_.root() ),
+      ReaderImpl( ImageFile( filePath, "r", imageFileOptions( options ) ), options )
+   {
+      filePath_ = filePath;
+   }
+
+   ReaderImpl::ReaderImpl( const std::shared_ptr<ReadSource> &source,
+                           const ReaderOptions &options ) :
+      ReaderImpl( ImageFile( source, imageFileOptions( options ) ), options )
+   {
+   }
+
+   ReaderImpl::ReaderImpl( const ImageFile &imf, const ReaderOptions &options ) :
+      imf_( imf ), root_( imf_.root() ),
       data3D_( root_.isDefined( "/data3D" ) ? root_.get( "/data3D" ) : VectorNode( imf_ ) ),
       images2D_( root_.isDefined( "/images2D" ) ? root_.get( "/images2D" ) : VectorNode( imf_ ) )
    {
+      pointsReaderOptions_.decodeThreadCount = options.decodeThreadCount;
+      pointsReaderOptions_.readAheadPacketCount = options.readAheadPacketCount;
+      pointsReaderOptions_.packetCacheSize = options.packetCacheSize;
+      pointsReaderOptions_.decodeTileSize = options.decodeTileSize;
+      pointsReaderOptions_.recordStride = options.recordStride;
+      pointsReaderOptions_.progress = options.progress;
+      pointsReaderOptions_.cancellation = options.cancellation;
+
+      imageThreadCount_ = options.imageThreadCount;
+      executor_ = options.executor;
+
+      const auto &m = options.transform;
+
+      if ( ( m[12] != 0.0 ) || ( m[13] != 0.0 ) || ( m[14] != 0.0 ) || ( m[15] != 1.0 ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                               "transform isn't affine; last row=" + toString( m[12] ) + " " +
+                                  toString( m[13] ) + " " + toString( m[14] ) + " " +
+                                  toString( m[15] ) );
+      }
+
+      sphericalToCartesian_ = options.sphericalToCartesian;
+      skipInvalidPoints_ = options.skipInvalidPoints;
+      pointFilter_ = options.pointFilter;
+      pointsAllocator_ = options.pointsAllocator;
+      applyPose_ = options.applyPose;
+      std::copy_n( m.begin(), transform_.size(), transform_.begin() );
    }
 
    ReaderImpl::~ReaderImpl()
@@ -219,6 +504,11 @@ namespace e57
       return true;
    }
 
+   bool ReaderImpl::Refresh()
+   {
+      return imf_.refresh();
+   }
+
    // Returns the file header information in fileHeader
    bool ReaderImpl::GetE57Root( E57Root &fileHeader ) const
    {
@@ -265,6 +555,184 @@ namespace e57
       return true;
    }
 
+   bool ReaderImpl::GetMetadataSummary( MetadataSummary &summary ) const
+   {
+      E57Root fileHeader;
+
+      if ( !GetE57Root( fileHeader ) )
+      {
+         return false;
+      }
+
+      MetadataSummary result;
+
+      result.guid = fileHeader.guid;
+      result.coordinateMetadata = fileHeader.coordinateMetadata;
+
+      if ( !filePath_.empty() )
+      {
+         _fileSizeAndModified( filePath_, result.fileSize, result.fileModified );
+      }
+
+      result.data3D.resize( static_cast<size_t>( data3D_.childCount() ) );
+
+      for ( size_t i = 0; i < result.data3D.size(); ++i )
+      {
+         Data3D header;
+         ReadData3D( static_cast<int64_t>( i ), header );
+
+         Data3DSummary &scan = result.data3D[i];
+
+         scan.name = header.name;
+         scan.guid = header.guid;
+         scan.description = header.description;
+         scan.pose = header.pose;
+         scan.indexBounds = header.indexBounds;
+         scan.cartesianBounds = header.cartesianBounds;
+         scan.sphericalBounds = header.sphericalBounds;
+         scan.pointCount = static_cast<int64_t>( header.pointCount );
+
+         // Taken from the prototype, so they don't depend on ReaderOptions::sphericalToCartesian
+         const StructureNode scanNode( data3D_.get( static_cast<int64_t>( i ) ) );
+         const StructureNode proto(
+            CompressedVectorNode( scanNode.get( "points" ) ).prototype() );
+
+         scan.hasCartesian = proto.isDefined( "cartesianX" ) && proto.isDefined( "cartesianY" ) &&
+                             proto.isDefined( "cartesianZ" );
+         scan.hasSpherical = proto.isDefined( "sphericalRange" ) &&
+                             proto.isDefined( "sphericalAzimuth" ) &&
+                             proto.isDefined( "sphericalElevation" );
+         scan.hasIntensity = proto.isDefined( "intensity" );
+         scan.hasColor = proto.isDefined( "colorRed" ) && proto.isDefined( "colorGreen" ) &&
+                         proto.isDefined( "colorBlue" );
+      }
+
+      result.images2D.resize( static_cast<size_t>( images2D_.childCount() ) );
+
+      for ( size_t i = 0; i < result.images2D.size(); ++i )
+      {
+         Image2D header;
+         ReadImage2D( static_cast<int64_t>( i ), header );
+
+         Image2DSummary &image = result.images2D[i];
+
+         image.name = header.name;
+         image.guid = header.guid;
+         image.description = header.description;
+         image.associatedData3DGuid = header.associatedData3DGuid;
+         image.pose = header.pose;
+
+         Image2DType imageType = ImageNone;
+         Image2DType maskType = ImageNone;
+         Image2DType visualType = ImageNone;
+         int64_t imageSize = 0;
+
+         GetImage2DSizes( static_cast<int64_t>( i ), image.projection, imageType, image.width,
+                          image.height, imageSize, maskType, visualType );
+      }
+
+      summary = std::move( result );
+
+      return true;
+   }
+
+   bool ReaderImpl::ReadMetadataSummary( const ustring &filePath, MetadataSummary &summary,
+                                         const ReaderOptions &options, bool writeSidecar )
+   {
+      const ustring sidecarPath = MetadataSummarySidecarPath( filePath );
+
+      // Checked before the file is opened, so a file changed in between gets a new summary next
+      // time instead of being taken as up to date
+      uint64_t fileSize = 0;
+      int64_t fileModified = 0;
+      const bool haveFileStatus = _fileSizeAndModified( filePath, fileSize, fileModified );
+
+      if ( haveFileStatus )
+      {
+         std::ifstream sidecar( sidecarPath, std::ifstream::binary );
+
+         if ( sidecar )
+         {
+            const std::vector<char> data{ std::istreambuf_iterator<char>( sidecar ),
+                                          std::istreambuf_iterator<char>() };
+            MetadataSummary saved;
+
+            if ( saved.deserialize( data ) && ( saved.fileSize == fileSize ) &&
+                 ( saved.fileModified == fileModified ) )
+            {
+               summary = std::move( saved );
+
+               return true;
+            }
+         }
+      }
+
+      ReaderImpl reader( filePath, options );
+
+      if ( !reader.GetMetadataSummary( summary ) )
+      {
+         return false;
+      }
+
+      if ( !haveFileStatus )
+      {
+         return true;
+      }
+
+      summary.fileSize = fileSize;
+      summary.fileModified = fileModified;
+
+      if ( writeSidecar )
+      {
+         // Written next to the sidecar and renamed, so nobody reads half of one
+         const ustring newSidecarPath = sidecarPath + ".new";
+         const std::vector<char> data = summary.serialize();
+
+         bool written = false;
+
+         {
+            std::ofstream sidecar( newSidecarPath, std::ofstream::binary | std::ofstream::trunc );
+
+            sidecar.write( data.data(), static_cast<std::streamsize>( data.size() ) );
+            sidecar.close();
+
+            written = !sidecar.fail();
+         }
+
+         // rename() doesn't replace files on Windows, and removing the old sidecar first would
+         // leave a moment with none
+         if ( written )
+         {
+#if defined( _WIN32 )
+#if defined( _MSC_VER )
+            std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
+
+            written = ::MoveFileExW( converter.from_bytes( newSidecarPath ).c_str(),
+                                     converter.from_bytes( sidecarPath ).c_str(),
+                                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+            written = ::MoveFileExA( newSidecarPath.c_str(), sidecarPath.c_str(),
+                                     MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#endif
+#else
+            written = ( std::rename( newSidecarPath.c_str(), sidecarPath.c_str() ) == 0 );
+#endif
+         }
+
+         if ( !written )
+         {
+            std::remove( newSidecarPath.c_str() );
+         }
+      }
+
+      return true;
+   }
+
+   ustring ReaderImpl::MetadataSummarySidecarPath( const ustring &filePath )
+   {
+      return filePath + ".summary";
+   }
+
    int64_t ReaderImpl::GetImage2DCount() const
    {
       return images2D_.childCount();
@@ -575,7 +1043,7 @@ namespace e57
                   image.get( "visualReferenceRepresentation" ) );
 
                return _readImage2DNode( visualReferenceRepresentation, imageType, pBuffer, start,
-                                        count );
+                                        count, imageThreadCount_ );
             }
             break;
 
@@ -584,7 +1052,8 @@ namespace e57
             {
                const StructureNode pinholeRepresentation( image.get( "pinholeRepresentation" ) );
 
-               return _readImage2DNode( pinholeRepresentation, imageType, pBuffer, start, count );
+               return _readImage2DNode( pinholeRepresentation, imageType, pBuffer, start, count,
+                                        imageThreadCount_ );
             }
             break;
 
@@ -594,7 +1063,8 @@ namespace e57
                const StructureNode sphericalRepresentation(
                   image.get( "sphericalRepresentation" ) );
 
-               return _readImage2DNode( sphericalRepresentation, imageType, pBuffer, start, count );
+               return _readImage2DNode( sphericalRepresentation, imageType, pBuffer, start, count,
+                                        imageThreadCount_ );
             }
             break;
 
@@ -605,7 +1075,7 @@ namespace e57
                   image.get( "cylindricalRepresentation" ) );
 
                return _readImage2DNode( cylindricalRepresentation, imageType, pBuffer, start,
-                                        count );
+                                        count, imageThreadCount_ );
             }
             break;
       }
@@ -1375,6 +1845,23 @@ namespace e57
          data3DHeader.pointFields.normalZField = proto.isDefined( "nor:normalZ" );
       }
 
+      // The spherical coordinates are read as cartesian ones (see
+      // ReaderOptions::sphericalToCartesian), so buffers allocated from the header match.
+      if ( convertsSpherical( proto ) )
+      {
+         PointStandardizedFieldsAvailable &fields = data3DHeader.pointFields;
+
+         fields.cartesianXField = true;
+         fields.cartesianYField = true;
+         fields.cartesianZField = true;
+         fields.cartesianInvalidStateField = fields.sphericalInvalidStateField;
+
+         fields.sphericalRangeField = false;
+         fields.sphericalAzimuthField = false;
+         fields.sphericalElevationField = false;
+         fields.sphericalInvalidStateField = false;
+      }
+
       return true;
    }
 
@@ -1558,18 +2045,187 @@ namespace e57
       return true;
    }
 
+   bool ReaderImpl::pointsTransform( const StructureNode &scan,
+                                     std::array<double, 12> &matrix ) const
+   {
+      matrix = transform_;
+
+      if ( applyPose_ )
+      {
+         const std::array<double, 12> pose = _poseMatrix( scan );
+
+         // transform_ × pose, with the implied last rows of 0 0 0 1
+         for ( size_t row = 0; row < 3; ++row )
+         {
+            for ( size_t column = 0; column < 4; ++column )
+            {
+               double sum = ( column == 3 ) ? transform_[row * 4 + 3] : 0.0;
+
+               for ( size_t k = 0; k < 3; ++k )
+               {
+                  sum += transform_[row * 4 + k] * pose[k * 4 + column];
+               }
+
+               matrix[row * 4 + column] = sum;
+            }
+         }
+      }
+
+      const std::array<double, 12> identity = { { 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0,
+                                                  0.0, 1.0, 0.0 } };
+
+      return matrix != identity;
+   }
+
+   bool ReaderImpl::convertsSpherical( const StructureNode &proto ) const
+   {
+      return sphericalToCartesian_ && proto.isDefined( "sphericalRange" ) &&
+             proto.isDefined( "sphericalAzimuth" ) && proto.isDefined( "sphericalElevation" ) &&
+             !proto.isDefined( "cartesianX" ) && !proto.isDefined( "cartesianY" ) &&
+             !proto.isDefined( "cartesianZ" );
+   }
+
+   CompressedVectorReaderOptions ReaderImpl::pointsReaderOptions(
+      const StructureNode &scan, const std::vector<SourceDestBuffer> &destBuffers,
+      bool filterPoints ) const
+   {
+      CompressedVectorReaderOptions options = pointsReaderOptions_;
+
+      // Points without coordinates are left as they are, but converting or transforming only
+      // some of them would be wrong.
+      const auto allRead = [&]( const std::array<ustring, 3> &names ) {
+         size_t found = 0;
+
+         for ( const auto &name : names )
+         {
+            found += static_cast<size_t>( std::count_if(
+               destBuffers.begin(), destBuffers.end(),
+               [&]( const SourceDestBuffer &buffer ) { return buffer.pathName() == name; } ) );
+         }
+
+         if ( ( found != 0 ) && ( found != names.size() ) )
+         {
+            throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                                  "points need all of " + names[0] + ", " + names[1] + ", and " +
+                                     names[2] + "; scanPathName=" + scan.pathName() );
+         }
+
+         return found != 0;
+      };
+
+      std::array<ustring, 3> cartesianNames = { { "cartesianX", "cartesianY", "cartesianZ" } };
+
+      const StructureNode proto( CompressedVectorNode( scan.get( "points" ) ).prototype() );
+
+      if ( convertsSpherical( proto ) )
+      {
+         const std::array<ustring, 3> sphericalNames = { { "sphericalRange", "sphericalAzimuth",
+                                                           "sphericalElevation" } };
+
+         if ( allRead( sphericalNames ) )
+         {
+            options.sphericalFields = sphericalNames;
+
+            // ...which then hold x, y, and z
+            cartesianNames = sphericalNames;
+         }
+      }
+
+      std::array<double, 12> matrix;
+
+      if ( pointsTransform( scan, matrix ) && allRead( cartesianNames ) )
+      {
+         options.transformFields = cartesianNames;
+         options.transformMatrix = matrix;
+      }
+
+      if ( filterPoints )
+      {
+         const bool convert = convertsSpherical( proto );
+
+         for ( auto range : pointFilter_ )
+         {
+            // Converted coordinates are read into the spherical fields
+            if ( convert )
+            {
+               const std::array<ustring, 3> cartesianFields = { { "cartesianX", "cartesianY",
+                                                                  "cartesianZ" } };
+
+               for ( size_t i = 0; i < cartesianFields.size(); ++i )
+               {
+                  if ( range.fieldName == cartesianFields[i] )
+                  {
+                     range.fieldName = cartesianNames[i];
+                  }
+               }
+
+               if ( range.fieldName == "cartesianInvalidState" )
+               {
+                  range.fieldName = "sphericalInvalidState";
+               }
+            }
+
+            if ( proto.isDefined( range.fieldName ) )
+            {
+               options.recordFilter.push_back( range );
+            }
+         }
+
+         if ( skipInvalidPoints_ )
+         {
+            const ustring invalidState = proto.isDefined( "cartesianInvalidState" )
+                                            ? "cartesianInvalidState"
+                                            : "sphericalInvalidState";
+
+            if ( proto.isDefined( invalidState ) )
+            {
+               options.recordFilter.push_back( { invalidState, 0.0, 0.0 } );
+            }
+         }
+      }
+
+      return options;
+   }
+
    template <typename COORDTYPE>
    CompressedVectorReader ReaderImpl::SetUpData3DPointsData(
       int64_t dataIndex, size_t count, const Data3DPointsData_t<COORDTYPE> &buffers ) const
+   {
+      return SetUpData3DLevelOfDetailData( dataIndex, 0, count, buffers );
+   }
+
+   template <typename COORDTYPE>
+   CompressedVectorReader ReaderImpl::SetUpData3DLevelOfDetailData(
+      int64_t dataIndex, int64_t level, size_t count,
+      const Data3DPointsData_t<COORDTYPE> &buffers ) const
+   {
+      return setUpPointsReader( dataIndex, level, count, buffers, true );
+   }
+
+   template <typename COORDTYPE>
+   CompressedVectorReader ReaderImpl::setUpPointsReader(
+      int64_t dataIndex, int64_t level, size_t count, const Data3DPointsData_t<COORDTYPE> &buffers,
+      bool filterPoints ) const
    {
       static_assert( std::is_floating_point<COORDTYPE>::value, "Floating point type required." );
 
       const StructureNode scan( data3D_.get( dataIndex ) );
-      CompressedVectorNode points( scan.get( "points" ) );
+      CompressedVectorNode points = levelOfDetailPoints( scan, level );
       const StructureNode proto( points.prototype() );
       const int64_t protoCount = proto.childCount();
       std::vector<SourceDestBuffer> destBuffers;
 
+      // Spherical coordinates converted to cartesian ones are read into the cartesian buffers
+      const bool convert = convertsSpherical( proto );
+
+      COORDTYPE *range = convert ? buffers.cartesianX : buffers.sphericalRange;
+      COORDTYPE *azimuth = convert ? buffers.cartesianY : buffers.sphericalAzimuth;
+      COORDTYPE *elevation = convert ? buffers.cartesianZ : buffers.sphericalElevation;
+      int8_t *sphericalInvalidState =
+         convert ? buffers.cartesianInvalidState : buffers.sphericalInvalidState;
+      const PackedBits sphericalInvalidStateBits =
+         convert ? buffers.cartesianInvalidStateBits : buffers.sphericalInvalidStateBits;
+
       for ( int64_t protoIndex = 0; protoIndex < protoCount; protoIndex++ )
       {
          const ustring name = proto.get( protoIndex ).elementName();
@@ -1602,29 +2258,40 @@ namespace e57
             destBuffers.emplace_back( imf_, "cartesianInvalidState", buffers.cartesianInvalidState,
                                       count, true );
          }
+         else if ( ( name == "cartesianInvalidState" ) &&
+                   proto.isDefined( "cartesianInvalidState" ) &&
+                   ( buffers.cartesianInvalidStateBits.data != nullptr ) )
+         {
+            destBuffers.emplace_back( imf_, "cartesianInvalidState",
+                                      buffers.cartesianInvalidStateBits, count, true );
+         }
          else if ( ( name == "sphericalRange" ) && proto.isDefined( "sphericalRange" ) &&
-                   ( buffers.sphericalRange != nullptr ) )
+                   ( range != nullptr ) )
          {
-            destBuffers.emplace_back( imf_, "sphericalRange", buffers.sphericalRange, count, true,
-                                      scaled );
+            destBuffers.emplace_back( imf_, "sphericalRange", range, count, true, scaled );
          }
          else if ( ( name == "sphericalAzimuth" ) && proto.isDefined( "sphericalAzimuth" ) &&
-                   ( buffers.sphericalAzimuth != nullptr ) )
+                   ( azimuth != nullptr ) )
          {
-            destBuffers.emplace_back( imf_, "sphericalAzimuth", buffers.sphericalAzimuth, count,
-                                      true, scaled );
+            destBuffers.emplace_back( imf_, "sphericalAzimuth", azimuth, count, true, scaled );
          }
          else if ( ( name == "sphericalElevation" ) && proto.isDefined( "sphericalElevation" ) &&
-                   ( buffers.sphericalElevation != nullptr ) )
+                   ( elevation != nullptr ) )
          {
-            destBuffers.emplace_back( imf_, "sphericalElevation", buffers.sphericalElevation, count,
-                                      true, scaled );
+            destBuffers.emplace_back( imf_, "sphericalElevation", elevation, count, true, scaled );
          }
          else if ( ( name == "sphericalInvalidState" ) &&
                    proto.isDefined( "sphericalInvalidState" ) &&
-                   ( buffers.sphericalInvalidState != nullptr ) )
+                   ( sphericalInvalidState != nullptr ) )
          {
-            destBuffers.emplace_back( imf_, "sphericalInvalidState", buffers.sphericalInvalidState,
+            destBuffers.emplace_back( imf_, "sphericalInvalidState", sphericalInvalidState, count,
+                                      true );
+         }
+         else if ( ( name == "sphericalInvalidState" ) &&
+                   proto.isDefined( "sphericalInvalidState" ) &&
+                   ( sphericalInvalidStateBits.data != nullptr ) )
+         {
+            destBuffers.emplace_back( imf_, "sphericalInvalidState", sphericalInvalidStateBits,
                                       count, true );
          }
          else if ( ( name == "rowIndex" ) && proto.isDefined( "rowIndex" ) &&
@@ -1658,6 +2325,12 @@ namespace e57
             destBuffers.emplace_back( imf_, "isTimeStampInvalid", buffers.isTimeStampInvalid, count,
                                       true );
          }
+         else if ( ( name == "isTimeStampInvalid" ) && proto.isDefined( "isTimeStampInvalid" ) &&
+                   ( buffers.isTimeStampInvalidBits.data != nullptr ) )
+         {
+            destBuffers.emplace_back( imf_, "isTimeStampInvalid", buffers.isTimeStampInvalidBits,
+                                      count, true );
+         }
          else if ( ( name == "intensity" ) && proto.isDefined( "intensity" ) &&
                    ( buffers.intensity != nullptr ) )
          {
@@ -1669,6 +2342,12 @@ namespace e57
             destBuffers.emplace_back( imf_, "isIntensityInvalid", buffers.isIntensityInvalid, count,
                                       true );
          }
+         else if ( ( name == "isIntensityInvalid" ) && proto.isDefined( "isIntensityInvalid" ) &&
+                   ( buffers.isIntensityInvalidBits.data != nullptr ) )
+         {
+            destBuffers.emplace_back( imf_, "isIntensityInvalid", buffers.isIntensityInvalidBits,
+                                      count, true );
+         }
          else if ( ( name == "colorRed" ) && proto.isDefined( "colorRed" ) &&
                    ( buffers.colorRed != nullptr ) )
          {
@@ -1689,6 +2368,12 @@ namespace e57
          {
             destBuffers.emplace_back( imf_, "isColorInvalid", buffers.isColorInvalid, count, true );
          }
+         else if ( ( name == "isColorInvalid" ) && proto.isDefined( "isColorInvalid" ) &&
+                   ( buffers.isColorInvalidBits.data != nullptr ) )
+         {
+            destBuffers.emplace_back( imf_, "isColorInvalid", buffers.isColorInvalidBits, count,
+                                      true );
+         }
          else if ( haveNormalsExt && ( name == "nor:normalX" ) &&
                    proto.isDefined( "nor:normalX" ) && ( buffers.normalX != nullptr ) )
          {
@@ -1706,11 +2391,662 @@ namespace e57
          }
       }
 
-      CompressedVectorReader reader = points.reader( destBuffers );
+      CompressedVectorReader reader =
+         points.reader( destBuffers, pointsReaderOptions( scan, destBuffers, filterPoints ) );
 
       return reader;
    }
 
+   CompressedVectorReader ReaderImpl::SetUpData3DPointsData(
+      int64_t dataIndex, size_t count, const Data3DPointsInterleaved &points ) const
+   {
+      return SetUpData3DLevelOfDetailData( dataIndex, 0, count, points );
+   }
+
+   CompressedVectorReader ReaderImpl::SetUpData3DLevelOfDetailData(
+      int64_t dataIndex, int64_t level, size_t count, const Data3DPointsInterleaved &points ) const
+   {
+      const StructureNode scan( data3D_.get( dataIndex ) );
+      CompressedVectorNode pointsNode = levelOfDetailPoints( scan, level );
+      const StructureNode proto( pointsNode.prototype() );
+
+      // Only read the fields this Data3D has. Spherical coordinates converted to cartesian ones
+      // are read into the cartesian fields.
+      const bool convert = convertsSpherical( proto );
+
+      const std::pair<const char *, const char *> convertedNames[] = {
+         { "cartesianX", "sphericalRange" },
+         { "cartesianY", "sphericalAzimuth" },
+         { "cartesianZ", "sphericalElevation" },
+         { "cartesianInvalidState", "sphericalInvalidState" },
+      };
+
+      Data3DPointsInterleaved defined = points;
+      defined.fields.clear();
+
+      for ( auto field : points.fields )
+      {
+         if ( convert )
+         {
+            for ( const auto &names : convertedNames )
+            {
+               if ( field.name == names.first )
+               {
+                  field.name = names.second;
+                  break;
+               }
+
+               if ( field.name == names.second )
+               {
+                  // Its values are read into the cartesian field instead
+                  field.name.clear();
+                  break;
+               }
+            }
+         }
+
+         if ( !field.name.empty() && proto.isDefined( field.name ) )
+         {
+            defined.fields.push_back( field );
+         }
+      }
+
+      std::vector<SourceDestBuffer> destBuffers = interleavedBuffers( imf_, defined, count );
+
+      return pointsNode.reader( destBuffers, pointsReaderOptions( scan, destBuffers, true ) );
+   }
+
+   bool ReaderImpl::GetData3DLevelOfDetail( int64_t dataIndex, int64_t pointBudget,
+                                            int64_t &level, int64_t &pointCount ) const
+   {
+      level = 0;
+      pointCount = 0;
+
+      if ( !IsOpen() || ( dataIndex < 0 ) || ( dataIndex >= data3D_.childCount() ) )
+      {
+         return false;
+      }
+
+      const StructureNode scan( data3D_.get( dataIndex ) );
+      const int64_t cLevelCount = levelOfDetailCount( scan );
+
+      // Levels get smaller, so the first one in the budget has the most points. If none are,
+      // use the smallest.
+      for ( level = 0; level <= cLevelCount; ++level )
+      {
+         pointCount = levelOfDetailPoints( scan, level ).childCount();
+
+         if ( ( pointCount <= pointBudget ) || ( level == cLevelCount ) )
+         {
+            break;
+         }
+      }
+
+      return true;
+   }
+
+   template <typename COORDTYPE>
+   int64_t ReaderImpl::ReadData3DPointsChunked(
+      int64_t dataIndex, size_t chunkSize, const Data3DPointsCallback<COORDTYPE> &callback ) const
+   {
+      if ( chunkSize == 0 )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "chunkSize=0" );
+      }
+
+      Data3D data3DHeader;
+
+      if ( !ReadData3D( dataIndex, data3DHeader ) || ( data3DHeader.pointCount == 0 ) )
+      {
+         return 0;
+      }
+
+      // Only allocate what one block needs.
+      const size_t cBufferSize = std::min( chunkSize, data3DHeader.pointCount );
+
+      data3DHeader.pointCount = cBufferSize;
+
+      const Data3DPointsData_t<COORDTYPE> buffers( data3DHeader, pointsAllocator_ );
+
+      CompressedVectorReader reader = SetUpData3DPointsData( dataIndex, cBufferSize, buffers );
+
+      int64_t totalRead = 0;
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         totalRead += count;
+
+         if ( !callback( buffers, count ) )
+         {
+            break;
+         }
+      }
+
+      reader.close();
+
+      return totalRead;
+   }
+
+   namespace
+   {
+      // Move the points in the first count elements of buffers which have valid cartesian
+      // coordinates inside box to the front, and return how many there are.
+      template <typename COORDTYPE>
+      size_t keepPointsInBox( const Data3DPointsData_t<COORDTYPE> &buffers, size_t count,
+                              const CartesianBounds &box, std::vector<size_t> &kept )
+      {
+         kept.clear();
+
+         for ( size_t i = 0; i < count; ++i )
+         {
+            if ( ( buffers.cartesianInvalidState != nullptr ) &&
+                 ( buffers.cartesianInvalidState[i] != 0 ) )
+            {
+               continue;
+            }
+
+            if ( ( buffers.cartesianInvalidStateBits.data != nullptr ) &&
+                 ( buffers.cartesianInvalidStateBits.get( i ) != 0 ) )
+            {
+               continue;
+            }
+
+            const double x = buffers.cartesianX[i];
+            const double y = buffers.cartesianY[i];
+            const double z = buffers.cartesianZ[i];
+
+            if ( ( x >= box.xMinimum ) && ( x <= box.xMaximum ) && ( y >= box.yMinimum ) &&
+                 ( y <= box.yMaximum ) && ( z >= box.zMinimum ) && ( z <= box.zMaximum ) )
+            {
+               kept.push_back( i );
+            }
+         }
+
+         if ( kept.size() == count )
+         {
+            return count;
+         }
+
+         // kept is in increasing order, so this never overwrites a point still to be moved
+         const auto compact = [&kept]( auto *field ) {
+            if ( field != nullptr )
+            {
+               for ( size_t j = 0; j < kept.size(); ++j )
+               {
+                  field[j] = field[kept[j]];
+               }
+            }
+         };
+
+         compact( buffers.cartesianX );
+         compact( buffers.cartesianY );
+         compact( buffers.cartesianZ );
+         compact( buffers.cartesianInvalidState );
+         compact( buffers.intensity );
+         compact( buffers.isIntensityInvalid );
+         compact( buffers.colorRed );
+         compact( buffers.colorGreen );
+         compact( buffers.colorBlue );
+         compact( buffers.isColorInvalid );
+         compact( buffers.sphericalRange );
+         compact( buffers.sphericalAzimuth );
+         compact( buffers.sphericalElevation );
+         compact( buffers.sphericalInvalidState );
+         compact( buffers.rowIndex );
+         compact( buffers.columnIndex );
+         compact( buffers.returnIndex );
+         compact( buffers.returnCount );
+         compact( buffers.timeStamp );
+         compact( buffers.isTimeStampInvalid );
+         compact( buffers.normalX );
+         compact( buffers.normalY );
+         compact( buffers.normalZ );
+
+         const auto compactBits = [&kept]( const PackedBits &field ) {
+            if ( field.data != nullptr )
+            {
+               for ( size_t j = 0; j < kept.size(); ++j )
+               {
+                  field.set( j, field.get( kept[j] ) );
+               }
+            }
+         };
+
+         compactBits( buffers.cartesianInvalidStateBits );
+         compactBits( buffers.isIntensityInvalidBits );
+         compactBits( buffers.isColorInvalidBits );
+         compactBits( buffers.sphericalInvalidStateBits );
+         compactBits( buffers.isTimeStampInvalidBits );
+
+         return kept.size();
+      }
+   }
+
+   template <typename COORDTYPE>
+   int64_t ReaderImpl::ReadData3DPointsInBox(
+      int64_t dataIndex, const CartesianBounds &box, size_t chunkSize,
+      const Data3DPointsCallback<COORDTYPE> &callback ) const
+   {
+      if ( chunkSize == 0 )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "chunkSize=0" );
+      }
+
+      Data3D data3DHeader;
+
+      if ( !ReadData3D( dataIndex, data3DHeader ) || ( data3DHeader.pointCount == 0 ) )
+      {
+         return 0;
+      }
+
+      const PointStandardizedFieldsAvailable &fields = data3DHeader.pointFields;
+
+      if ( !fields.cartesianXField || !fields.cartesianYField || !fields.cartesianZField )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                               "no cartesian coordinates dataIndex=" + toString( dataIndex ) );
+      }
+
+      // Work out which runs of records need to be read. Without chunk bounds, that's all of them.
+      std::vector<RecordRange> ranges;
+      std::vector<ChunkBounds> chunks;
+
+      const StructureNode scan( data3D_.get( dataIndex ) );
+
+      if ( readChunkBounds( imf_, scan, chunks ) )
+      {
+         // The chunk bounds are in the Data3D's own coordinates, and the points may not be
+         std::array<double, 12> matrix;
+         const bool transformed = pointsTransform( scan, matrix );
+
+         for ( const auto &chunk : chunks )
+         {
+            const CartesianBounds bounds =
+               transformed ? _transformBounds( matrix, chunk.bounds ) : chunk.bounds;
+
+            if ( !boundsIntersect( bounds, box ) )
+            {
+               continue;
+            }
+
+            // Merge neighbouring chunks so they are read without seeking
+            if ( !ranges.empty() &&
+                 ( ranges.back().start + ranges.back().count == chunk.startRecord ) )
+            {
+               ranges.back().count += chunk.recordCount;
+            }
+            else
+            {
+               ranges.push_back( { chunk.startRecord, chunk.recordCount } );
+            }
+         }
+      }
+      else
+      {
+         ranges.push_back( { 0, static_cast<int64_t>( data3DHeader.pointCount ) } );
+      }
+
+      if ( ranges.empty() )
+      {
+         return 0;
+      }
+
+      // Only allocate what one block needs.
+      const size_t cBufferSize = std::min( chunkSize, data3DHeader.pointCount );
+
+      data3DHeader.pointCount = cBufferSize;
+
+      const Data3DPointsData_t<COORDTYPE> buffers( data3DHeader, pointsAllocator_ );
+
+      // Every record is needed to follow the ranges
+      CompressedVectorReader reader =
+         setUpPointsReader( dataIndex, 0, cBufferSize, buffers, false );
+
+      std::vector<size_t> kept;
+      kept.reserve( cBufferSize );
+
+      int64_t totalKept = 0;
+      bool keepReading = true;
+
+      for ( auto range = ranges.begin(); keepReading && ( range != ranges.end() ); ++range )
+      {
+         reader.seek( range->start );
+
+         int64_t remaining = range->count;
+
+         while ( keepReading && ( remaining > 0 ) )
+         {
+            const unsigned cRead = reader.read();
+
+            if ( cRead == 0 )
+            {
+               break;
+            }
+
+            // The last read of a range may go past its end
+            const auto cCount =
+               static_cast<size_t>( std::min( static_cast<int64_t>( cRead ), remaining ) );
+
+            remaining -= static_cast<int64_t>( cCount );
+
+            const size_t cKeptCount = keepPointsInBox( buffers, cCount, box, kept );
+
+            if ( cKeptCount > 0 )
+            {
+               totalKept += static_cast<int64_t>( cKeptCount );
+
+               keepReading = callback( buffers, cKeptCount );
+            }
+         }
+      }
+
+      reader.close();
+
+      return totalKept;
+   }
+
+   bool ReaderImpl::lineRanges( int64_t dataIndex, ustring &idElementName,
+                                std::vector<int64_t> &lines,
+                                std::vector<RecordRange> &ranges ) const
+   {
+      lines.clear();
+      ranges.clear();
+
+      Data3D header;
+
+      if ( !ReadData3D( dataIndex, header ) )
+      {
+         return false;
+      }
+
+      const GroupingByLine &grouping = header.pointGroupingSchemes.groupingByLine;
+
+      if ( grouping.idElementName.empty() || ( grouping.groupsSize <= 0 ) )
+      {
+         return false;
+      }
+
+      const auto cGroupCount = static_cast<size_t>( grouping.groupsSize );
+
+      std::vector<int64_t> startPointIndex( cGroupCount );
+      std::vector<int64_t> pointCount( cGroupCount );
+
+      lines.resize( cGroupCount );
+
+      if ( !ReadData3DGroupsData( dataIndex, cGroupCount, lines.data(), startPointIndex.data(),
+                                  pointCount.data() ) )
+      {
+         lines.clear();
+         return false;
+      }
+
+      idElementName = grouping.idElementName;
+
+      ranges.reserve( cGroupCount );
+
+      for ( size_t i = 0; i < cGroupCount; ++i )
+      {
+         ranges.push_back( { startPointIndex[i], pointCount[i] } );
+      }
+
+      return true;
+   }
+
+   template <typename COORDTYPE>
+   void ReaderImpl::readRecordRanges( int64_t dataIndex, const Data3D &blockHeader,
+                                      size_t blockSize, const std::vector<RecordRange> &ranges,
+                                      unsigned threadCount,
+                                      const RecordRangeVisitor<COORDTYPE> &visit ) const
+   {
+      int64_t longest = 0;
+
+      for ( const auto &range : ranges )
+      {
+         longest = std::max( longest, range.count );
+      }
+
+      if ( longest <= 0 )
+      {
+         return;
+      }
+
+      const size_t cBlockSize = std::min( blockSize, static_cast<size_t>( longest ) );
+
+      // Each thread has its own reader and buffers, and takes the next range when it is done
+      std::atomic<size_t> nextRange{ 0 };
+
+      WorkerPool pool(
+         static_cast<unsigned>(
+            std::min( static_cast<size_t>( std::max( threadCount, 1U ) ), ranges.size() ) ),
+         executor_ );
+
+      pool.parallelFor( pool.threadCount(), [&]( size_t ) {
+         // The constructor changes the header, so use a copy
+         Data3D header = blockHeader;
+         header.pointCount = static_cast<int64_t>( cBlockSize );
+
+         const Data3DPointsData_t<COORDTYPE> buffers( header, pointsAllocator_ );
+
+         CompressedVectorReader reader =
+            setUpPointsReader( dataIndex, 0, cBlockSize, buffers, false );
+
+         for ( size_t index = nextRange++; index < ranges.size(); index = nextRange++ )
+         {
+            const RecordRange &range = ranges[index];
+
+            if ( range.count <= 0 )
+            {
+               continue;
+            }
+
+            reader.seek( range.start );
+
+            int64_t remaining = range.count;
+
+            while ( remaining > 0 )
+            {
+               const unsigned cRead = reader.read();
+
+               if ( cRead == 0 )
+               {
+                  break;
+               }
+
+               const auto cCount =
+                  static_cast<size_t>( std::min( static_cast<int64_t>( cRead ), remaining ) );
+
+               visit( buffers, cCount, index );
+
+               remaining -= static_cast<int64_t>( cCount );
+            }
+         }
+
+         reader.close();
+      } );
+   }
+
+   template <typename COORDTYPE>
+   int64_t ReaderImpl::ReadData3DGrid( int64_t dataIndex, const Data3DPointsData_t<COORDTYPE> &grid,
+                                       unsigned threadCount ) const
+   {
+      Data3D header;
+
+      if ( !ReadData3D( dataIndex, header ) )
+      {
+         return 0;
+      }
+
+      const IndexBounds &bounds = header.indexBounds;
+
+      return ReadData3DGridRows( dataIndex, bounds.rowMinimum,
+                                 bounds.rowMaximum - bounds.rowMinimum + 1, grid, threadCount );
+   }
+
+   template <typename COORDTYPE>
+   int64_t ReaderImpl::ReadData3DGridRows( int64_t dataIndex, int64_t firstRow, int64_t rowCount,
+                                           const Data3DPointsData_t<COORDTYPE> &grid,
+                                           unsigned threadCount ) const
+   {
+      Data3D header;
+
+      if ( !ReadData3D( dataIndex, header ) || ( header.pointCount == 0 ) || ( rowCount <= 0 ) )
+      {
+         return 0;
+      }
+
+      if ( !header.pointFields.rowIndexField || !header.pointFields.columnIndexField )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                               "no rowIndex or columnIndex dataIndex=" + toString( dataIndex ) );
+      }
+
+      const int64_t cColumnMinimum = header.indexBounds.columnMinimum;
+      const int64_t cColumnCount = header.indexBounds.columnMaximum - cColumnMinimum + 1;
+
+      // Only decode the fields the grid wants, and where each point goes
+      Data3D blockHeader = header;
+      _restrictPointFields( blockHeader.pointFields, grid );
+
+      blockHeader.pointFields.rowIndexField = true;
+      blockHeader.pointFields.columnIndexField = true;
+
+      // Points placed by different threads could share a byte of a packed buffer
+      if ( ( grid.cartesianInvalidStateBits.data != nullptr ) ||
+           ( grid.sphericalInvalidStateBits.data != nullptr ) ||
+           ( grid.isTimeStampInvalidBits.data != nullptr ) ||
+           ( grid.isIntensityInvalidBits.data != nullptr ) ||
+           ( grid.isColorInvalidBits.data != nullptr ) )
+      {
+         threadCount = 1;
+      }
+
+      // If the points are grouped by row, only the lines of the rows which are wanted are read.
+      // Otherwise the points are split into runs for the threads to share, and filtered.
+      ustring idElementName;
+      std::vector<int64_t> lines;
+      std::vector<RecordRange> ranges;
+
+      if ( lineRanges( dataIndex, idElementName, lines, ranges ) &&
+           ( idElementName == "rowIndex" ) )
+      {
+         std::vector<RecordRange> rowRanges;
+
+         for ( size_t i = 0; i < lines.size(); ++i )
+         {
+            if ( ( lines[i] >= firstRow ) && ( lines[i] - firstRow < rowCount ) )
+            {
+               rowRanges.push_back( ranges[i] );
+            }
+         }
+
+         ranges.swap( rowRanges );
+      }
+      else
+      {
+         ranges.clear();
+
+         const auto cPointCount = static_cast<int64_t>( header.pointCount );
+         const int64_t cRunCount = std::max( threadCount, 1U ) * 4;
+         const int64_t cRunSize = ( cPointCount + cRunCount - 1 ) / cRunCount;
+
+         for ( int64_t start = 0; start < cPointCount; start += cRunSize )
+         {
+            ranges.push_back( { start, std::min( cRunSize, cPointCount - start ) } );
+         }
+      }
+
+      std::atomic<int64_t> totalPlaced{ 0 };
+
+      readRecordRanges<COORDTYPE>(
+         dataIndex, blockHeader, cGridBlockSize, ranges, threadCount,
+         [&]( const Data3DPointsData_t<COORDTYPE> &points, size_t count, size_t ) {
+            int64_t placed = 0;
+
+            for ( size_t i = 0; i < count; ++i )
+            {
+               const int64_t row = points.rowIndex[i] - firstRow;
+               const int64_t column = points.columnIndex[i] - cColumnMinimum;
+
+               if ( ( row < 0 ) || ( row >= rowCount ) || ( column < 0 ) ||
+                    ( column >= cColumnCount ) )
+               {
+                  continue;
+               }
+
+               _copyPoint( grid, static_cast<size_t>( row * cColumnCount + column ), points, i );
+
+               ++placed;
+            }
+
+            totalPlaced += placed;
+         } );
+
+      return totalPlaced;
+   }
+
+   template <typename COORDTYPE>
+   int64_t ReaderImpl::ReadData3DLines( int64_t dataIndex, const std::vector<int64_t> &lines,
+                                        unsigned threadCount,
+                                        const Data3DLineCallback<COORDTYPE> &callback ) const
+   {
+      Data3D header;
+
+      if ( !ReadData3D( dataIndex, header ) )
+      {
+         return 0;
+      }
+
+      ustring idElementName;
+      std::vector<int64_t> groupLines;
+      std::vector<RecordRange> groupRanges;
+
+      if ( !lineRanges( dataIndex, idElementName, groupLines, groupRanges ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                               "no line groups dataIndex=" + toString( dataIndex ) );
+      }
+
+      // Find each line's group
+      std::vector<std::pair<int64_t, size_t>> groups;
+      groups.reserve( groupLines.size() );
+
+      for ( size_t i = 0; i < groupLines.size(); ++i )
+      {
+         groups.emplace_back( groupLines[i], i );
+      }
+
+      std::sort( groups.begin(), groups.end() );
+
+      std::vector<int64_t> rangeLines;
+      std::vector<RecordRange> ranges;
+
+      for ( const int64_t line : lines )
+      {
+         const auto group = std::lower_bound( groups.begin(), groups.end(),
+                                              std::make_pair( line, size_t{ 0 } ) );
+
+         if ( ( group != groups.end() ) && ( group->first == line ) )
+         {
+            rangeLines.push_back( line );
+            ranges.push_back( groupRanges[group->second] );
+         }
+      }
+
+      std::atomic<int64_t> totalRead{ 0 };
+
+      // The blocks hold the longest line, so each line is passed on in one go
+      readRecordRanges<COORDTYPE>(
+         dataIndex, header, SIZE_MAX, ranges, threadCount,
+         [&]( const Data3DPointsData_t<COORDTYPE> &points, size_t count, size_t rangeIndex ) {
+            callback( rangeLines[rangeIndex], points, count );
+
+            totalRead += static_cast<int64_t>( count );
+         } );
+
+      return totalRead;
+   }
+
    int64_t ReaderImpl::GetData3DCount() const
    {
       return data3D_.childCount();
@@ -1743,4 +3079,54 @@ namespace e57
    template CompressedVectorReader ReaderImpl::SetUpData3DPointsData(
       int64_t dataIndex, size_t pointCount, const Data3DPointsData_t<double> &buffers ) const;
 
+   template CompressedVectorReader ReaderImpl::SetUpData3DLevelOfDetailData(
+      int64_t dataIndex, int64_t level, size_t pointCount,
+      const Data3DPointsData_t<float> &buffers ) const;
+
+   template CompressedVectorReader ReaderImpl::SetUpData3DLevelOfDetailData(
+      int64_t dataIndex, int64_t level, size_t pointCount,
+      const Data3DPointsData_t<double> &buffers ) const;
+
+   template int64_t ReaderImpl::ReadData3DPointsChunked(
+      int64_t dataIndex, size_t chunkSize, const Data3DPointsCallback<float> &callback ) const;
+
+   template int64_t ReaderImpl::ReadData3DPointsChunked(
+      int64_t dataIndex, size_t chunkSize, const Data3DPointsCallback<double> &callback ) const;
+
+   template int64_t ReaderImpl::ReadData3DPointsInBox(
+      int64_t dataIndex, const CartesianBounds &box, size_t chunkSize,
+      const Data3DPointsCallback<float> &callback ) const;
+
+   template int64_t ReaderImpl::ReadData3DPointsInBox(
+      int64_t dataIndex, const CartesianBounds &box, size_t chunkSize,
+      const Data3DPointsCallback<double> &callback ) const;
+
+   template int64_t ReaderImpl::ReadData3DLines( int64_t dataIndex,
+                                                 const std::vector<int64_t> &lines,
+                                                 unsigned threadCount,
+                                                 const Data3DLineCallback<float> &callback ) const;
+
+   template int64_t ReaderImpl::ReadData3DLines( int64_t dataIndex,
+                                                 const std::vector<int64_t> &lines,
+                                                 unsigned threadCount,
+                                                 const Data3DLineCallback<double> &callback ) const;
+
+   template int64_t ReaderImpl::ReadData3DGrid( int64_t dataIndex,
+                                                const Data3DPointsData_t<float> &grid,
+                                                unsigned threadCount ) const;
+
+   template int64_t ReaderImpl::ReadData3DGrid( int64_t dataIndex,
+                                                const Data3DPointsData_t<double> &grid,
+                                                unsigned threadCount ) const;
+
+   template int64_t ReaderImpl::ReadData3DGridRows( int64_t dataIndex, int64_t firstRow,
+                                                    int64_t rowCount,
+                                                    const Data3DPointsData_t<float> &grid,
+                                                    unsigned threadCount ) const;
+
+   template int64_t ReaderImpl::ReadData3DGridRows( int64_t dataIndex, int64_t firstRow,
+                                                    int64_t rowCount,
+                                                    const Data3DPointsData_t<double> &grid,
+                                                    unsigned threadCount ) const;
+
 } // end namespace e57
@@ -28,6 +28,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include "E57SimpleData.h"
 #include "E57SimpleReader.h"
 
@@ -37,6 +39,7 @@ namespace e57
    {
    public:
       ReaderImpl( const ustring &filePath, const ReaderOptions &options );
+      ReaderImpl( const std::shared_ptr<ReadSource> &source, const ReaderOptions &options );
       ~ReaderImpl();
 
       // disallow copying a ReaderImpl
@@ -49,8 +52,17 @@ namespace e57
 
       bool Close();
 
+      bool Refresh();
+
       bool GetE57Root( E57Root &fileHeader ) const;
 
+      bool GetMetadataSummary( MetadataSummary &summary ) const;
+
+      static bool ReadMetadataSummary( const ustring &filePath, MetadataSummary &summary,
+                                       const ReaderOptions &options, bool writeSidecar );
+
+      static ustring MetadataSummarySidecarPath( const ustring &filePath );
+
       int64_t GetImage2DCount() const;
 
       bool ReadImage2D( int64_t imageIndex, Image2D &Image2DHeader ) const;
@@ -79,6 +91,44 @@ namespace e57
       CompressedVectorReader SetUpData3DPointsData(
          int64_t dataIndex, size_t pointCount, const Data3DPointsData_t<COORDTYPE> &buffers ) const;
 
+      CompressedVectorReader SetUpData3DPointsData( int64_t dataIndex, size_t pointCount,
+                                                    const Data3DPointsInterleaved &points ) const;
+
+      bool GetData3DLevelOfDetail( int64_t dataIndex, int64_t pointBudget, int64_t &level,
+                                   int64_t &pointCount ) const;
+
+      template <typename COORDTYPE>
+      CompressedVectorReader SetUpData3DLevelOfDetailData(
+         int64_t dataIndex, int64_t level, size_t pointCount,
+         const Data3DPointsData_t<COORDTYPE> &buffers ) const;
+
+      CompressedVectorReader SetUpData3DLevelOfDetailData(
+         int64_t dataIndex, int64_t level, size_t pointCount,
+         const Data3DPointsInterleaved &points ) const;
+
+      template <typename COORDTYPE>
+      int64_t ReadData3DPointsChunked( int64_t dataIndex, size_t chunkSize,
+                                       const Data3DPointsCallback<COORDTYPE> &callback ) const;
+
+      template <typename COORDTYPE>
+      int64_t ReadData3DPointsInBox( int64_t dataIndex, const CartesianBounds &box,
+                                     size_t chunkSize,
+                                     const Data3DPointsCallback<COORDTYPE> &callback ) const;
+
+      template <typename COORDTYPE>
+      int64_t ReadData3DLines( int64_t dataIndex, const std::vector<int64_t> &lines,
+                               unsigned threadCount,
+                               const Data3DLineCallback<COORDTYPE> &callback ) const;
+
+      template <typename COORDTYPE>
+      int64_t ReadData3DGrid( int64_t dataIndex, const Data3DPointsData_t<COORDTYPE> &grid,
+                              unsigned threadCount ) const;
+
+      template <typename COORDTYPE>
+      int64_t ReadData3DGridRows( int64_t dataIndex, int64_t firstRow, int64_t rowCount,
+                                  const Data3DPointsData_t<COORDTYPE> &grid,
+                                  unsigned threadCount ) const;
+
       StructureNode GetRawE57Root() const;
 
       VectorNode GetRawData3D() const;
@@ -88,9 +138,81 @@ namespace e57
       ImageFile GetRawIMF() const;
 
    private:
+      /// A run of records of a Data3D's points
+      struct RecordRange
+      {
+         int64_t start;
+         int64_t count;
+      };
+
+      /// Called by readRecordRanges() with each block of points and the index of its range
+      template <typename COORDTYPE>
+      using RecordRangeVisitor = std::function<void( const Data3DPointsData_t<COORDTYPE> &points,
+                                                     size_t count, size_t rangeIndex )>;
+
+      ReaderImpl( const ImageFile &imf, const ReaderOptions &options );
+
+      /// The transform to apply to the cartesian coordinates of the points of Data3D @a scan
+      /// (see ReaderOptions::applyPose and ReaderOptions::transform). Returns false if it's the
+      /// identity.
+      bool pointsTransform( const StructureNode &scan, std::array<double, 12> &matrix ) const;
+
+      /// Whether points with prototype @a proto are converted from spherical to cartesian
+      /// coordinates (see ReaderOptions::sphericalToCartesian)
+      bool convertsSpherical( const StructureNode &proto ) const;
+
+      /// The options for reading the points of Data3D @a scan into @a destBuffers, with
+      /// ReaderOptions::pointFilter if @a filterPoints
+      CompressedVectorReaderOptions pointsReaderOptions(
+         const StructureNode &scan, const std::vector<SourceDestBuffer> &destBuffers,
+         bool filterPoints ) const;
+
+      /// SetUpData3DLevelOfDetailData(), without the point filter unless @a filterPoints. Readers
+      /// which read runs of records need every record.
+      template <typename COORDTYPE>
+      CompressedVectorReader setUpPointsReader( int64_t dataIndex, int64_t level, size_t count,
+                                                const Data3DPointsData_t<COORDTYPE> &buffers,
+                                                bool filterPoints ) const;
+
+      /// The line groups of Data3D @a dataIndex: the line number (idElementValue) and records of
+      /// each. Returns false if it has none.
+      bool lineRanges( int64_t dataIndex, ustring &idElementName, std::vector<int64_t> &lines,
+                       std::vector<RecordRange> &ranges ) const;
+
+      /// Read each of @a ranges of the points of Data3D @a dataIndex, sharing them between
+      /// @a threadCount threads. Each thread reads blocks of up to @a blockSize points of the
+      /// fields in @a blockHeader, passing them to @a visit in order. @a visit may be called
+      /// from several threads at once.
+      template <typename COORDTYPE>
+      void readRecordRanges( int64_t dataIndex, const Data3D &blockHeader, size_t blockSize,
+                             const std::vector<RecordRange> &ranges, unsigned threadCount,
+                             const RecordRangeVisitor<COORDTYPE> &visit ) const;
+
+      /// Path of the file if the Reader was opened from one, for GetMetadataSummary()
+      ustring filePath_;
+
       ImageFile imf_;
       StructureNode root_;
 
+      CompressedVectorReaderOptions pointsReaderOptions_;
+
+      bool sphericalToCartesian_ = false;
+
+      bool skipInvalidPoints_ = false;
+      std::vector<RecordFieldRange> pointFilter_;
+
+      Data3DPointsAllocator *pointsAllocator_ = nullptr;
+
+      unsigned imageThreadCount_ = 1;
+
+      /// Where readRecordRanges() runs its threads (see ReaderOptions::executor)
+      std::shared_ptr<Executor> executor_;
+
+      /// Whether to apply each Data3D's pose, and the transform applied after it (the top three
+      /// rows of ReaderOptions::transform)
+      bool applyPose_ = false;
+      std::array<double, 12> transform_ = {};
+
       VectorNode data3D_;
 
       VectorNode images2D_;
@@ -0,0 +1,93 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "Packet.h"
+#include "SharedPacketCache.h"
+
+namespace
+{
+   // Enough shards that a few reading threads rarely share one
+   constexpr unsigned cMaxShardCount = 16;
+}
+
+namespace e57
+{
+   SharedPacketCache::SharedPacketCache( unsigned packetCount,
+                                         std::shared_ptr<MemoryAccount> account )
+   {
+      const unsigned shardCount = std::max( 1u, std::min( packetCount, cMaxShardCount ) );
+
+      if ( account != nullptr )
+      {
+         packetCount = static_cast<unsigned>( account->reserveUpTo(
+            MemoryAccount::PacketCache, DATA_PACKET_MAX, packetCount, shardCount ) );
+
+         charge_ = MemoryCharge( account, MemoryAccount::PacketCache );
+         charge_.adopt( uint64_t{ packetCount } * DATA_PACKET_MAX );
+      }
+
+      shards_.reserve( shardCount );
+
+      for ( unsigned i = 0; i < shardCount; ++i )
+      {
+         shards_.emplace_back( new Shard );
+
+         // Share the packets out as evenly as possible
+         shards_.back()->capacity = packetCount / shardCount + ( i < packetCount % shardCount );
+         shards_.back()->index.reserve( shards_.back()->capacity );
+      }
+   }
+
+   SharedPacketCache::Packet SharedPacketCache::find( uint64_t packetLogicalOffset )
+   {
+      Shard &shard = shardFor( packetLogicalOffset );
+
+      std::lock_guard<std::mutex> lock( shard.mutex );
+
+      const auto found = shard.index.find( packetLogicalOffset );
+      if ( found == shard.index.end() )
+      {
+         return nullptr;
+      }
+
+      shard.lru.splice( shard.lru.begin(), shard.lru, found->second );
+
+      return found->second->second;
+   }
+
+   void SharedPacketCache::insert( uint64_t packetLogicalOffset, const char *packet,
+                                   unsigned length )
+   {
+      // Copy it before taking the lock
+      Packet copy = std::make_shared<const std::vector<char>>( packet, packet + length );
+
+      Shard &shard = shardFor( packetLogicalOffset );
+
+      std::lock_guard<std::mutex> lock( shard.mutex );
+
+      // Another reader may have got there first
+      if ( shard.index.find( packetLogicalOffset ) != shard.index.end() )
+      {
+         return;
+      }
+
+      if ( shard.lru.size() >= shard.capacity )
+      {
+         shard.index.erase( shard.lru.back().first );
+         shard.lru.pop_back();
+      }
+
+      shard.lru.emplace_front( packetLogicalOffset, std::move( copy ) );
+      shard.index[packetLogicalOffset] = shard.lru.begin();
+   }
+
+   SharedPacketCache::Shard &SharedPacketCache::shardFor( uint64_t packetLogicalOffset )
+   {
+      // Packets are at multiples of 4, and consecutive ones should land in different shards
+      const uint64_t hash = ( packetLogicalOffset >> 2 ) * 0x9E3779B97F4A7C15ULL;
+
+      return *shards_[( hash >> 32 ) % shards_.size()];
+   }
+}
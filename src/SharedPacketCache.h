@@ -0,0 +1,63 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "MemoryAccount.h"
+
+namespace e57
+{
+   /// Packets read and verified by any of the CompressedVectorReaders of one ImageFile (see
+   /// ImageFileOptions::sharedPacketCacheSize), so readers of the same section on different
+   /// threads read and check each packet once. Any thread may use it.
+   ///
+   /// The packets are spread over shards by their offset, each with its own mutex and LRU list,
+   /// so threads looking up different packets rarely wait for each other. The packets are held
+   /// by shared pointer, so one which is evicted stays valid for as long as a reader is copying
+   /// it.
+   class SharedPacketCache
+   {
+   public:
+      using Packet = std::shared_ptr<const std::vector<char>>;
+
+      /// @param packetCount Most packets to hold. If @a account has a budget, fewer may be held
+      /// (but at least one per shard).
+      /// @param account Where the packets are counted, if anywhere.
+      SharedPacketCache( unsigned packetCount, std::shared_ptr<MemoryAccount> account = nullptr );
+
+      SharedPacketCache( const SharedPacketCache & ) = delete;
+      SharedPacketCache &operator=( const SharedPacketCache & ) = delete;
+
+      /// The whole packet at @a packetLogicalOffset, or nullptr if it isn't held.
+      Packet find( uint64_t packetLogicalOffset );
+
+      /// Hold a copy of the @a length bytes of the packet at @a packetLogicalOffset, which has
+      /// been verified, evicting the least recently used packet of its shard if it is full.
+      void insert( uint64_t packetLogicalOffset, const char *packet, unsigned length );
+
+   private:
+      struct Shard
+      {
+         std::mutex mutex; // protects everything below
+
+         /// Packets and their offsets, most recently used first
+         std::list<std::pair<uint64_t, Packet>> lru;
+         std::unordered_map<uint64_t, std::list<std::pair<uint64_t, Packet>>::iterator> index;
+
+         unsigned capacity = 0;
+      };
+
+      Shard &shardFor( uint64_t packetLogicalOffset );
+
+      std::vector<std::unique_ptr<Shard>> shards_;
+
+      /// Room for every packet which may be held, in MemoryAccount::PacketCache
+      MemoryCharge charge_;
+   };
+}
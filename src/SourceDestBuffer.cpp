@@ -29,6 +29,7 @@
 
 /// @file SourceDestBuffer.cpp
 
+#include "BitpackKernels.h"
 #include "SourceDestBufferImpl.h"
 
 using namespace e57;
@@ -48,6 +49,7 @@ void SourceDestBuffer::checkInvariant( bool /*doRecurse*/ ) const
 
          case Int16:
          case UInt16:
+         case Real16:
             return 2;
 
          case Int32:
@@ -258,6 +260,31 @@ SourceDestBuffer::SourceDestBuffer( const ImageFile &destImageFile, const ustrin
    impl_->setTypeInfo<double>( b, stride );
 }
 
+/*!
+@overload
+
+@details
+The memory representation is ::Real16. Values are rounded to the nearest half precision value when
+they are read, and reading one larger than Float16::maximum() in magnitude throws
+::ErrorValueNotRepresentable (or ::ErrorScaledValueNotRepresentable for a scaled ScaledInteger).
+Half precision has only 11 significant bits, so coordinates are usually read relative to a nearby
+origin (see SourceDestBuffer::setOrigin()).
+
+Scaled ScaledInteger values are scaled in double precision and rounded to half precision once, as
+they are stored, so the full precision array is never made.
+
+Buffers of this kind can't be spatially ordered, or be the point fields of
+CompressedVectorReaderOptions::transformFields or sphericalFields.
+*/
+SourceDestBuffer::SourceDestBuffer( const ImageFile &destImageFile, const ustring &pathName,
+                                    Float16 *b, const size_t capacity, bool doConversion,
+                                    bool doScaling, size_t stride ) :
+   impl_( new SourceDestBufferImpl( destImageFile.impl(), pathName, capacity, doConversion,
+                                    doScaling ) )
+{
+   impl_->setTypeInfo<Float16>( b, stride );
+}
+
 /*!
 @brief Designate vector of strings to transfer data to/from a CompressedVector as a block.
 
@@ -302,6 +329,85 @@ SourceDestBuffer::SourceDestBuffer( const ImageFile &destImageFile, const ustrin
 {
 }
 
+/*!
+@brief Designate a StringArena to transfer strings to/from a CompressedVector as a block.
+
+@param [in] destImageFile The ImageFile where the new node will eventually be stored.
+@param [in] pathName The pathname of the field in CompressedVectorNode that will transfer data
+to/from.
+@param [in] b The caller created arena of strings to transfer from/to.
+@param [in] capacity The maximum number of strings transferred at a time.
+
+@details
+This works the same way as the std::vector<ustring> form of the constructor, but the strings are
+kept back to back in one array of characters instead of each having its own allocation.
+
+When reading, the arena is cleared at the start of each block of records and the strings which are
+read are appended to it, so after CompressedVectorReader::read() returns n, @a b holds n strings.
+Its memory is kept from one block to the next. When writing, the first strings of @a b are written,
+and it must hold at least as many strings as are written at a time.
+
+@pre capacity must be > 0.
+@pre The @a destImageFile must be open (i.e. destImageFile.isOpen() must be true).
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorBadPathName
+@throw ::ErrorBadBuffer
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorInternal All objects in undocumented state
+*/
+SourceDestBuffer::SourceDestBuffer( const ImageFile &destImageFile, const ustring &pathName,
+                                    StringArena *b, size_t capacity ) :
+   impl_( new SourceDestBufferImpl( destImageFile.impl(), pathName, b, capacity ) )
+{
+}
+
+/*!
+@brief Designate packed bits to transfer small unsigned integers to/from a CompressedVector as a
+block.
+
+@param [in] destImageFile The ImageFile where the new node will eventually be stored.
+@param [in] pathName The pathname of the field in CompressedVectorNode that will transfer data
+to/from.
+@param [in] b The caller allocated bytes holding the values, and the number of bits in each.
+@param [in] capacity The total number of values in @a b, which must have at least
+PackedBits::byteCount( capacity, b.bitsPerValue ) bytes.
+@param [in] doConversion Will a conversion be attempted between memory and ImageFile
+representations.
+@param [in] doScaling In a ScaledInteger field, do memory elements hold scaled values, if false they
+hold raw values.
+
+@details
+This works the same way as the integer forms of the constructor, with each value taking
+b.bitsPerValue bits of @a b (see PackedBits), so a one bit field such as "isColorInvalid" needs an
+eighth of the memory of an array of int8_t. The memory representation is ::Bits, and
+SourceDestBuffer::stride returns the number of bits in each value.
+
+Reading an IntegerNode whose minimum is 0, and whose values take exactly b.bitsPerValue bits in the
+file, copies the bits straight from the file into @a b, and writing one copies them straight from
+@a b. Any other values are converted one at a time, and reading one which doesn't fit in
+b.bitsPerValue bits throws ::ErrorValueNotRepresentable.
+
+Buffers of this kind can't be spatially ordered or read a level of detail at a time.
+
+@pre b.bitsPerValue must be 1, 2, 4, or 8.
+@pre The @a destImageFile must be open (i.e. destImageFile.isOpen() must be true).
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorBadPathName
+@throw ::ErrorBadBuffer
+@throw ::ErrorImageFileNotOpen
+@throw ::ErrorInternal All objects in undocumented state
+*/
+SourceDestBuffer::SourceDestBuffer( const ImageFile &destImageFile, const ustring &pathName,
+                                    PackedBits b, size_t capacity, bool doConversion,
+                                    bool doScaling ) :
+   impl_( new SourceDestBufferImpl( destImageFile.impl(), pathName, capacity, doConversion,
+                                    doScaling ) )
+{
+   impl_->setBitsInfo( b );
+}
+
 /*!
 @brief Get path name in prototype that this SourceDestBuffer will transfer data to/from.
 
@@ -451,6 +557,8 @@ intervals. This allows a value to be picked out of an array of C++ structures (t
 the size of the structure). In the case that the element values are stored consecutively in memory,
 the stride equals the size of the memory representation of the element.
 
+For a ::Bits buffer (see PackedBits) it is the number of bits in each value instead.
+
 @post No visible state is modified.
 
 @return Number of bytes between consecutive memory elements in buffer
@@ -460,6 +568,71 @@ size_t SourceDestBuffer::stride() const
    return impl_->stride();
 }
 
+/*!
+@brief Get the value subtracted from each value as it is read into the buffer (and added back as
+it is written from it).
+
+@post No visible state is modified.
+
+@return The origin set by setOrigin(), or 0.
+
+@see SourceDestBuffer::setOrigin
+*/
+double SourceDestBuffer::origin() const
+{
+   return impl_->origin();
+}
+
+/*!
+@brief Set a value to subtract from each value as it is read into the buffer, and to add back to
+each value as it is written from it.
+
+@param [in] origin The value of the field which is stored as 0 in the buffer (e.g. the X
+coordinate of a local origin).
+
+@details
+Buffers of single or half precision floats can't hold coordinates far from zero precisely. With an
+origin, the buffer holds each value minus the origin instead, which is computed in double precision
+before the value is rounded to the buffer's precision. For a scaled ScaledInteger the buffer gets
+( rawValue * scale + offset ) - origin, so coordinates can be read straight into a ::Real32 or
+::Real16 buffer relative to a local origin without another pass over the points.
+
+Record filters (see CompressedVectorReaderOptions::recordFilter) compare the values with the origin
+added back, so their limits are in the file's coordinates. The values given to a
+CompressedVectorReduction are those in the buffer (see RecordBlockField::origin).
+
+Values which are copied straight between the file and the buffer when there is no origin are
+converted one block at a time instead.
+
+@pre Unless @a origin is 0, the buffer's memory representation must be ::Real16, ::Real32, or
+::Real64.
+@pre @a origin must be finite.
+
+@throw ::ErrorBadAPIArgument
+@throw ::ErrorInternal All objects in undocumented state
+
+@see SourceDestBuffer::origin
+*/
+void SourceDestBuffer::setOrigin( double origin )
+{
+   impl_->setOrigin( origin );
+}
+
+/*!
+@brief Convert a double to the nearest half precision value (ties to even).
+*/
+Float16::Float16( double value ) : bits( toFloat16Bits( value ) )
+{
+}
+
+/*!
+@brief Convert to a double, which is exact.
+*/
+Float16::operator double() const
+{
+   return fromFloat16Bits( bits );
+}
+
 /*!
 @brief Diagnostic function to print internal state of object to output stream in an indented format.
 @copydetails Node::dump()
@@ -25,14 +25,208 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <limits>
 
+#include "BitpackKernels.h"
 #include "ImageFileImpl.h"
 #include "SourceDestBufferImpl.h"
 #include "StringFunctions.h"
 
 using namespace e57;
 
+namespace
+{
+   /// True if value (an integer or floating point number) is inside the range of T. Like the
+   /// comparisons this replaces, NaN counts as inside.
+   template <typename T, typename V> bool inRangeOf( V value )
+   {
+      return !( value < static_cast<V>( std::numeric_limits<T>::lowest() ) ||
+                static_cast<V>( std::numeric_limits<T>::max() ) < value );
+   }
+
+   /// Find the smallest and largest of count elements of type T, stride bytes apart, starting at
+   /// base. NaNs are skipped, so returns false if there are only NaNs. Contiguous elements use
+   /// four independent accumulators so compilers can turn the loop into SIMD min/max
+   /// instructions.
+   template <typename T>
+   bool rangeOf( const char *base, size_t stride, size_t count, double &minimum, double &maximum )
+   {
+      T lo[4];
+      T hi[4];
+
+      for ( size_t lane = 0; lane < 4; ++lane )
+      {
+         lo[lane] = std::numeric_limits<T>::max();
+         hi[lane] = std::numeric_limits<T>::lowest();
+      }
+
+      size_t i = 0;
+
+      if ( stride == sizeof( T ) )
+      {
+         const auto *values = reinterpret_cast<const T *>( base );
+
+         for ( ; i + 4 <= count; i += 4 )
+         {
+            for ( size_t lane = 0; lane < 4; ++lane )
+            {
+               const T value = values[i + lane];
+
+               lo[lane] = ( value < lo[lane] ) ? value : lo[lane];
+               hi[lane] = ( value > hi[lane] ) ? value : hi[lane];
+            }
+         }
+      }
+
+      for ( ; i < count; ++i )
+      {
+         T value;
+         memcpy( &value, base + i * stride, sizeof( T ) );
+
+         lo[0] = ( value < lo[0] ) ? value : lo[0];
+         hi[0] = ( value > hi[0] ) ? value : hi[0];
+      }
+
+      for ( size_t lane = 1; lane < 4; ++lane )
+      {
+         lo[0] = ( lo[lane] < lo[0] ) ? lo[lane] : lo[0];
+         hi[0] = ( hi[lane] > hi[0] ) ? hi[lane] : hi[0];
+      }
+
+      if ( hi[0] < lo[0] )
+      {
+         return false;
+      }
+
+      minimum = static_cast<double>( lo[0] );
+      maximum = static_cast<double>( hi[0] );
+
+      return true;
+   }
+
+   /// The Float16 version of rangeOf()
+   bool rangeOfFloat16( const char *base, size_t stride, size_t count, double &minimum,
+                        double &maximum )
+   {
+      double lo = std::numeric_limits<double>::max();
+      double hi = std::numeric_limits<double>::lowest();
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         Float16 value;
+         memcpy( &value, base + i * stride, sizeof( value ) );
+
+         const auto cValue = static_cast<double>( value );
+
+         lo = ( cValue < lo ) ? cValue : lo;
+         hi = ( cValue > hi ) ? cValue : hi;
+      }
+
+      if ( hi < lo )
+      {
+         return false;
+      }
+
+      minimum = lo;
+      maximum = hi;
+
+      return true;
+   }
+
+   /// Clear keep[i] for each of the count values from base which isn't in [minimum, maximum]
+   /// once origin is added to it. Comparisons with NaN are false, so NaN values are never kept.
+   template <typename T>
+   void keepInRange( const char *base, size_t stride, size_t count, double minimum,
+                     double maximum, uint8_t *keep, double origin = 0.0 )
+   {
+      for ( size_t i = 0; i < count; ++i )
+      {
+         T value;
+         memcpy( &value, base + i * stride, sizeof( T ) );
+
+         const auto cValue = static_cast<double>( value ) + origin;
+
+         keep[i] &= static_cast<uint8_t>( ( cValue >= minimum ) && ( cValue <= maximum ) );
+      }
+   }
+
+   /// Move the elements from base for which keep is set down to base, in order. Returns how
+   /// many there are.
+   template <typename T>
+   size_t keepElements( char *base, size_t stride, size_t count, const uint8_t *keep )
+   {
+      size_t kept = 0;
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         if ( keep[i] != 0 )
+         {
+            if ( kept != i )
+            {
+               memcpy( base + kept * stride, base + i * stride, sizeof( T ) );
+            }
+
+            ++kept;
+         }
+      }
+
+      return kept;
+   }
+
+   /// The PackedBits versions of rangeOf(), keepInRange(), and keepElements(), for the count
+   /// values from index begin of bits.
+   void rangeOfBits( PackedBits bits, size_t count, double &minimum, double &maximum )
+   {
+      unsigned lo = bits.maximum();
+      unsigned hi = 0;
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         const unsigned value = bits.get( i );
+
+         lo = std::min( lo, value );
+         hi = std::max( hi, value );
+      }
+
+      minimum = lo;
+      maximum = hi;
+   }
+
+   void keepBitsInRange( PackedBits bits, size_t begin, size_t count, double minimum,
+                         double maximum, uint8_t *keep )
+   {
+      for ( size_t i = 0; i < count; ++i )
+      {
+         const auto cValue = static_cast<double>( bits.get( begin + i ) );
+
+         keep[i] &= static_cast<uint8_t>( ( cValue >= minimum ) && ( cValue <= maximum ) );
+      }
+   }
+
+   size_t keepBits( PackedBits bits, size_t begin, size_t count, const uint8_t *keep )
+   {
+      size_t kept = 0;
+
+      for ( size_t i = 0; i < count; ++i )
+      {
+         if ( keep[i] != 0 )
+         {
+            if ( kept != i )
+            {
+               bits.set( begin + kept, bits.get( begin + i ) );
+            }
+
+            ++kept;
+         }
+      }
+
+      return kept;
+   }
+}
+
 SourceDestBufferImpl::SourceDestBufferImpl( ImageFileImplWeakPtr destImageFile,
                                             const ustring &pathName, const size_t capacity,
                                             bool doConversion, bool doScaling ) :
@@ -43,7 +237,8 @@ SourceDestBufferImpl::SourceDestBufferImpl( ImageFileImplWeakPtr destImageFile,
 
 template <typename T> void SourceDestBufferImpl::setTypeInfo( T *base, size_t stride )
 {
-   static_assert( std::is_integral<T>::value || std::is_floating_point<T>::value,
+   static_assert( std::is_integral<T>::value || std::is_floating_point<T>::value ||
+                     std::is_same<T, Float16>::value,
                   "Integral or floating point required." );
 
    base_ = reinterpret_cast<char *>( base );
@@ -91,6 +286,10 @@ template <typename T> void SourceDestBufferImpl::setTypeInfo( T *base, size_t st
    {
       memoryRepresentation_ = Real64;
    }
+   else if ( std::is_same<T, Float16>::value )
+   {
+      memoryRepresentation_ = Real16;
+   }
 
    checkState_();
 }
@@ -105,6 +304,35 @@ template void SourceDestBufferImpl::setTypeInfo<int64_t>( int64_t *base, size_t
 template void SourceDestBufferImpl::setTypeInfo<bool>( bool *base, size_t stride );
 template void SourceDestBufferImpl::setTypeInfo<float>( float *base, size_t stride );
 template void SourceDestBufferImpl::setTypeInfo<double>( double *base, size_t stride );
+template void SourceDestBufferImpl::setTypeInfo<Float16>( Float16 *base, size_t stride );
+
+void SourceDestBufferImpl::setBitsInfo( PackedBits bits )
+{
+   base_ = reinterpret_cast<char *>( bits.data );
+   stride_ = bits.bitsPerValue;
+   memoryRepresentation_ = Bits;
+
+   checkState_();
+}
+
+void SourceDestBufferImpl::setOrigin( double origin )
+{
+   if ( ( origin != 0.0 ) && ( memoryRepresentation_ != Real16 ) &&
+        ( memoryRepresentation_ != Real32 ) && ( memoryRepresentation_ != Real64 ) )
+   {
+      throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                            "pathName=" + pathName_ + " memoryRepresentation=" +
+                               toString( memoryRepresentation_ ) );
+   }
+
+   if ( !std::isfinite( origin ) )
+   {
+      throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                            "pathName=" + pathName_ + " origin=" + toString( origin ) );
+   }
+
+   origin_ = origin;
+}
 
 SourceDestBufferImpl::SourceDestBufferImpl( ImageFileImplWeakPtr destImageFile,
                                             const ustring &pathName, std::vector<ustring> *b ) :
@@ -128,155 +356,18 @@ SourceDestBufferImpl::SourceDestBufferImpl( ImageFileImplWeakPtr destImageFile,
    /// stored in it.
 }
 
-template <typename T> void SourceDestBufferImpl::_setNextReal( T inValue )
+SourceDestBufferImpl::SourceDestBufferImpl( ImageFileImplWeakPtr destImageFile,
+                                            const ustring &pathName, StringArena *b,
+                                            size_t capacity ) :
+   destImageFile_( destImageFile ), pathName_( pathName ), memoryRepresentation_( UString ),
+   capacity_( capacity ), arena_( b )
 {
-   static_assert( std::is_same<T, double>::value || std::is_same<T, float>::value,
-                  "_setNextReal() requires float or double type" );
-
-   /// don't checkImageFileOpen
-
-   /// Verify have room
-   if ( nextIndex_ >= capacity_ )
-   {
-      throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
-   }
-
-   /// Calc start of memory location, index into buffer using stride_ (the
-   /// distance between elements).
-   char *p = &base_[nextIndex_ * stride_];
-
-   switch ( memoryRepresentation_ )
-   {
-      case Int8:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         //??? fault if get special value: NaN, NegInf...  (all other ints below
-         // too)
-         if ( inValue < INT8_MIN || INT8_MAX < inValue )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( inValue ) );
-         }
-         *reinterpret_cast<int8_t *>( p ) = static_cast<int8_t>( inValue );
-         break;
-      case UInt8:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         if ( inValue < UINT8_MIN || UINT8_MAX < inValue )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( inValue ) );
-         }
-         *reinterpret_cast<uint8_t *>( p ) = static_cast<uint8_t>( inValue );
-         break;
-      case Int16:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         if ( inValue < INT16_MIN || INT16_MAX < inValue )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( inValue ) );
-         }
-         *reinterpret_cast<int16_t *>( p ) = static_cast<int16_t>( inValue );
-         break;
-      case UInt16:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         if ( inValue < UINT16_MIN || UINT16_MAX < inValue )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( inValue ) );
-         }
-         *reinterpret_cast<uint16_t *>( p ) = static_cast<uint16_t>( inValue );
-         break;
-      case Int32:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         if ( inValue < INT32_MIN || ( inValue > static_cast<T>( INT32_MAX ) ) )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( inValue ) );
-         }
-         *reinterpret_cast<int32_t *>( p ) = static_cast<int32_t>( inValue );
-         break;
-      case UInt32:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         if ( inValue < UINT32_MIN || ( inValue > ( static_cast<T>( UINT32_MAX ) ) ) )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( inValue ) );
-         }
-         *reinterpret_cast<uint32_t *>( p ) = static_cast<uint32_t>( inValue );
-         break;
-      case Int64:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         if ( inValue < INT64_MIN || ( inValue > ( static_cast<T>( INT64_MAX ) ) ) )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( inValue ) );
-         }
-         *reinterpret_cast<int64_t *>( p ) = static_cast<int64_t>( inValue );
-         break;
-      case Bool:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         *reinterpret_cast<bool *>( p ) = ( inValue ? false : true );
-         break;
-      case Real32:
-         if ( std::is_same<T, double>::value )
-         {
-            /// Does this count as conversion?  It loses information.
-            /// Check for really large exponents that can't fit in a single
-            /// precision
-            if ( inValue < DOUBLE_MIN || DOUBLE_MAX < inValue )
-            {
-               throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                     "pathName=" + pathName_ + " value=" + toString( inValue ) );
-            }
-            *reinterpret_cast<float *>( p ) = static_cast<float>( inValue );
-         }
-         else
-         {
-#ifdef _MSC_VER
-            // MSVC is not smart enough to realize 'inValue' cannot be a double here, so disable
-            // warning
-#pragma warning( disable : 4244 )
-            *reinterpret_cast<float *>( p ) = inValue;
-#pragma warning( default : 4244 )
-#else
-            *reinterpret_cast<float *>( p ) = inValue;
-#endif
-         }
-         break;
-      case Real64:
-         //??? does this count as a conversion?
-         *reinterpret_cast<double *>( p ) = static_cast<double>( inValue );
-         break;
-      case UString:
-         throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
-   }
+   /// don't checkImageFileOpen, checkState_ will do it
 
-   nextIndex_++;
+   checkState_();
 }
 
+
 void SourceDestBufferImpl::checkState_() const
 {
    /// Implement checkImageFileOpen functionality for SourceDestBufferImpl ctors
@@ -302,510 +393,1210 @@ void SourceDestBufferImpl::checkState_() const
       {
          throw E57_EXCEPTION2( ErrorBadBuffer, "pathName=" + pathName_ );
       }
+      if ( ( memoryRepresentation_ == Bits ) && ( stride_ != 1 ) && ( stride_ != 2 ) &&
+           ( stride_ != 4 ) && ( stride_ != 8 ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadBuffer,
+                               "pathName=" + pathName_ + " bitsPerValue=" + toString( stride_ ) );
+      }
       //??? check base alignment, depending on CPU type
       //??? check if stride too small, positive or negative
    }
    else
    {
-      if ( ustrings_ == nullptr )
+      if ( ustrings_ == nullptr && arena_ == nullptr )
       {
          throw E57_EXCEPTION2( ErrorBadBuffer, "pathName=" + pathName_ );
       }
    }
 }
 
-int64_t SourceDestBufferImpl::getNextInt64()
+/// Call convert() on each of the next count elements of the buffer (which hold T) and store the
+/// results in out. The type is chosen once by the caller, so this is a tight loop. If convert()
+/// throws, nextIndex_ is left at the element which failed.
+template <typename T, typename OutT, typename Convert>
+void SourceDestBufferImpl::loadNext( size_t count, OutT *out, Convert convert )
 {
-   /// don't checkImageFileOpen
+   const char *p = &base_[nextIndex_ * stride_];
 
-   /// Verify index is within bounds
-   if ( nextIndex_ >= capacity_ )
-   {
-      throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
-   }
+   size_t i = 0;
 
-   /// Fetch value from source buffer.
-   /// Convert from non-integer formats if requested.
-   char *p = &base_[nextIndex_ * stride_];
-   int64_t value;
-   switch ( memoryRepresentation_ )
+   try
    {
-      case Int8:
-         value = static_cast<int64_t>( *reinterpret_cast<int8_t *>( p ) );
-         break;
-      case UInt8:
-         value = static_cast<int64_t>( *reinterpret_cast<uint8_t *>( p ) );
-         break;
-      case Int16:
-         value = static_cast<int64_t>( *reinterpret_cast<int16_t *>( p ) );
-         break;
-      case UInt16:
-         value = static_cast<int64_t>( *reinterpret_cast<uint16_t *>( p ) );
-         break;
-      case Int32:
-         value = static_cast<int64_t>( *reinterpret_cast<int32_t *>( p ) );
-         break;
-      case UInt32:
-         value = static_cast<int64_t>( *reinterpret_cast<uint32_t *>( p ) );
-         break;
-      case Int64:
-         value = *reinterpret_cast<int64_t *>( p );
-         break;
-      case Bool:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         /// Convert bool to 0/1, all non-zero values map to 1.0
-         value = ( *reinterpret_cast<bool *>( p ) ) ? 1 : 0;
-         break;
-      case Real32:
-         if ( !doConversion_ )
+      if ( stride_ == sizeof( T ) )
+      {
+         const auto in = reinterpret_cast<const T *>( p );
+
+         for ( ; i < count; ++i )
          {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
+            out[i] = convert( in[i] );
          }
-         //??? fault if get special value: NaN, NegInf...
-         value = static_cast<int64_t>( *reinterpret_cast<float *>( p ) );
-         break;
-      case Real64:
-         if ( !doConversion_ )
+      }
+      else
+      {
+         for ( ; i < count; ++i, p += stride_ )
          {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
+            out[i] = convert( *reinterpret_cast<const T *>( p ) );
          }
-         //??? fault if get special value: NaN, NegInf...
-         value = static_cast<int64_t>( *reinterpret_cast<double *>( p ) );
-         break;
-      case UString:
-         throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
-      default:
-         throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
+      }
    }
-   nextIndex_++;
-   return ( value );
+   catch ( ... )
+   {
+      nextIndex_ += static_cast<unsigned>( i );
+      throw;
+   }
+
+   nextIndex_ += static_cast<unsigned>( count );
 }
 
-int64_t SourceDestBufferImpl::getNextInt64( double scale, double offset )
+/// Call convert() on each of count values from in and store the results (which are T) in the
+/// next elements of the buffer. If convert() throws, nextIndex_ is left at the element which
+/// failed.
+template <typename T, typename InT, typename Convert>
+void SourceDestBufferImpl::storeNext( size_t count, const InT *in, Convert convert )
 {
-   /// don't checkImageFileOpen
+   char *p = &base_[nextIndex_ * stride_];
 
-   /// Reverse scale (undo scaling) of a user's number to get raw value to put
-   /// in file.
+   size_t i = 0;
 
-   /// Incorporating the scale is optional (requested by user when constructing
-   /// the sdbuf). If the user did not request scaling, then we get raw values
-   /// from user's buffer.
-   if ( !doScaling_ )
+   try
    {
-      /// Just return raw value.
-      return ( getNextInt64() );
-   }
+      if ( stride_ == sizeof( T ) )
+      {
+         const auto out = reinterpret_cast<T *>( p );
 
-   /// Double check non-zero scale.  Going to divide by it below.
-   if ( scale == 0 )
+         for ( ; i < count; ++i )
+         {
+            out[i] = convert( in[i] );
+         }
+      }
+      else
+      {
+         for ( ; i < count; ++i, p += stride_ )
+         {
+            *reinterpret_cast<T *>( p ) = convert( in[i] );
+         }
+      }
+   }
+   catch ( ... )
+   {
+      nextIndex_ += static_cast<unsigned>( i );
+      throw;
+   }
+
+   nextIndex_ += static_cast<unsigned>( count );
+}
+
+/// The ::Bits version of loadNext(): call convert() on each of the next count values (which are
+/// unsigned) and store the results in out.
+template <typename OutT, typename Convert>
+void SourceDestBufferImpl::loadNextBits( size_t count, OutT *out, Convert convert )
+{
+   const PackedBits bits = packedBits();
+
+   size_t i = 0;
+
+   try
+   {
+      for ( ; i < count; ++i )
+      {
+         out[i] = convert( bits.get( nextIndex_ + i ) );
+      }
+   }
+   catch ( ... )
+   {
+      nextIndex_ += static_cast<unsigned>( i );
+      throw;
+   }
+
+   nextIndex_ += static_cast<unsigned>( count );
+}
+
+/// The ::Bits version of storeNext(): call convert() (which returns a value checked by
+/// checkedBits()) on each of count values from in and store the results in the next values.
+template <typename InT, typename Convert>
+void SourceDestBufferImpl::storeNextBits( size_t count, const InT *in, Convert convert )
+{
+   const PackedBits bits = packedBits();
+
+   size_t i = 0;
+
+   try
+   {
+      for ( ; i < count; ++i )
+      {
+         bits.set( nextIndex_ + i, convert( in[i] ) );
+      }
+   }
+   catch ( ... )
+   {
+      nextIndex_ += static_cast<unsigned>( i );
+      throw;
+   }
+
+   nextIndex_ += static_cast<unsigned>( count );
+}
+
+/// Convert value to T, throwing errorCode if it is out of T's range.
+template <typename T, typename V>
+T SourceDestBufferImpl::checkedValue( V value, ErrorCode errorCode, const char *valueName ) const
+{
+   if ( !inRangeOf<T>( value ) )
+   {
+      throw E57_EXCEPTION2( errorCode,
+                            "pathName=" + pathName_ + " " + valueName + "=" + toString( value ) );
+   }
+
+   return static_cast<T>( value );
+}
+
+/// Convert value to one of the values of a ::Bits buffer, throwing errorCode if it doesn't fit
+/// in stride_ bits. NaN doesn't fit.
+template <typename V>
+unsigned SourceDestBufferImpl::checkedBits( V value, ErrorCode errorCode,
+                                            const char *valueName ) const
+{
+   if ( !( value >= 0 ) || ( value > static_cast<V>( packedBits().maximum() ) ) )
+   {
+      throw E57_EXCEPTION2( errorCode, "pathName=" + pathName_ + " " + valueName + "=" +
+                                          toString( value ) +
+                                          " bitsPerValue=" + toString( stride_ ) );
+   }
+
+   return static_cast<unsigned>( value );
+}
+
+/// Round value to the nearest Float16, throwing errorCode if it is larger than
+/// Float16::maximum() in magnitude. Like the other conversions, NaN is let through.
+Float16 SourceDestBufferImpl::checkedFloat16( double value, ErrorCode errorCode,
+                                              const char *valueName ) const
+{
+   if ( std::fabs( value ) > Float16::maximum() )
+   {
+      throw E57_EXCEPTION2( errorCode,
+                            "pathName=" + pathName_ + " " + valueName + "=" + toString( value ) );
+   }
+
+   return Float16( value );
+}
+
+/// Copy the element at index (which is a T) into the next count elements of the buffer.
+template <typename T> void SourceDestBufferImpl::repeatElement( unsigned index, size_t count )
+{
+   const T value = *reinterpret_cast<const T *>( &base_[index * stride_] );
+
+   char *p = &base_[nextIndex_ * stride_];
+
+   if ( stride_ == sizeof( T ) )
+   {
+      std::fill_n( reinterpret_cast<T *>( p ), count, value );
+   }
+   else
+   {
+      for ( size_t i = 0; i < count; ++i, p += stride_ )
+      {
+         *reinterpret_cast<T *>( p ) = value;
+      }
+   }
+
+   nextIndex_ += static_cast<unsigned>( count );
+}
+
+void SourceDestBufferImpl::repeatElement( unsigned index, size_t count )
+{
+   switch ( memoryRepresentation_ )
+   {
+      case Int8:
+         repeatElement<int8_t>( index, count );
+         break;
+      case UInt8:
+         repeatElement<uint8_t>( index, count );
+         break;
+      case Int16:
+         repeatElement<int16_t>( index, count );
+         break;
+      case UInt16:
+         repeatElement<uint16_t>( index, count );
+         break;
+      case Int32:
+         repeatElement<int32_t>( index, count );
+         break;
+      case UInt32:
+         repeatElement<uint32_t>( index, count );
+         break;
+      case Int64:
+         repeatElement<int64_t>( index, count );
+         break;
+      case Bool:
+         repeatElement<bool>( index, count );
+         break;
+      case Real32:
+         repeatElement<float>( index, count );
+         break;
+      case Real64:
+         repeatElement<double>( index, count );
+         break;
+      case Real16:
+         repeatElement<Float16>( index, count );
+         break;
+      case Bits:
+      {
+         const PackedBits bits = packedBits();
+         const unsigned value = bits.get( index );
+
+         for ( size_t i = 0; i < count; ++i )
+         {
+            bits.set( nextIndex_ + i, value );
+         }
+
+         nextIndex_ += static_cast<unsigned>( count );
+         break;
+      }
+      case UString:
+         throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
+   }
+}
+
+/// Verify there are at least count elements left in the buffer.
+void SourceDestBufferImpl::checkRemaining( size_t count ) const
+{
+   if ( count > capacity_ - nextIndex_ )
    {
       throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
    }
+}
+
+/// Throw if the user didn't allow conversions between integer and floating point.
+void SourceDestBufferImpl::checkConversionAllowed() const
+{
+   if ( !doConversion_ )
+   {
+      throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
+   }
+}
+
+void SourceDestBufferImpl::getNextInt64s( int64_t *values, size_t count )
+{
+   /// don't checkImageFileOpen
 
    /// Verify index is within bounds
-   if ( nextIndex_ >= capacity_ )
+   checkRemaining( count );
+
+   const auto toInt64 = []( auto value ) { return static_cast<int64_t>( value ); };
+
+   /// Floating point values are relative to the origin
+   const auto realToInt64 = [this]( auto value ) {
+      return static_cast<int64_t>( static_cast<double>( value ) + origin_ );
+   };
+
+   /// Fetch values from source buffer.
+   /// Convert from non-integer formats if requested.
+   switch ( memoryRepresentation_ )
+   {
+      case Int8:
+         loadNext<int8_t>( count, values, toInt64 );
+         break;
+      case UInt8:
+         loadNext<uint8_t>( count, values, toInt64 );
+         break;
+      case Int16:
+         loadNext<int16_t>( count, values, toInt64 );
+         break;
+      case UInt16:
+         loadNext<uint16_t>( count, values, toInt64 );
+         break;
+      case Int32:
+         loadNext<int32_t>( count, values, toInt64 );
+         break;
+      case UInt32:
+         loadNext<uint32_t>( count, values, toInt64 );
+         break;
+      case Int64:
+         loadNext<int64_t>( count, values, toInt64 );
+         break;
+      case Bool:
+         checkConversionAllowed();
+
+         /// Convert bool to 0/1, all non-zero values map to 1.0
+         loadNext<bool>( count, values,
+                         []( bool value ) { return value ? int64_t{ 1 } : int64_t{ 0 }; } );
+         break;
+      case Real32:
+         checkConversionAllowed();
+
+         //??? fault if get special value: NaN, NegInf...
+         loadNext<float>( count, values, realToInt64 );
+         break;
+      case Real64:
+         checkConversionAllowed();
+
+         //??? fault if get special value: NaN, NegInf...
+         loadNext<double>( count, values, realToInt64 );
+         break;
+      case Real16:
+         checkConversionAllowed();
+         loadNext<Float16>( count, values, realToInt64 );
+         break;
+      case Bits:
+         loadNextBits( count, values, toInt64 );
+         break;
+      case UString:
+         throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
+      default:
+         throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
+   }
+}
+
+void SourceDestBufferImpl::getNextInt64s( int64_t *values, size_t count, double scale,
+                                          double offset )
+{
+   /// don't checkImageFileOpen
+
+   /// Reverse scale (undo scaling) of a user's number to get raw value to put
+   /// in file.
+
+   /// Incorporating the scale is optional (requested by user when constructing
+   /// the sdbuf). If the user did not request scaling, then we get raw values
+   /// from user's buffer.
+   if ( !doScaling_ )
+   {
+      /// Just return raw values.
+      getNextInt64s( values, count );
+      return;
+   }
+
+   /// Double check non-zero scale.  Going to divide by it below.
+   if ( scale == 0 )
    {
       throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
    }
 
-   /// Fetch value from source buffer.
+   /// Verify index is within bounds
+   checkRemaining( count );
+
+   /// Calc (x-offset)/scale rounded to nearest integer, but keep in
+   /// floating point until sure is in bounds
+   const auto unscale = [this, scale, offset]( auto value ) {
+      const double doubleRawValue = floor( ( value - offset ) / scale + 0.5 );
+
+      /// Make sure that value is representable in an int64_t
+      return checkedValue<int64_t>( doubleRawValue, ErrorScaledValueNotRepresentable, "value" );
+   };
+
+   /// Floating point values are relative to the origin
+   const auto unscaleReal = [this, &unscale]( auto value ) {
+      return unscale( static_cast<double>( value ) + origin_ );
+   };
+
+   /// Fetch values from source buffer.
    /// Convert from non-integer formats if requested
-   char *p = &base_[nextIndex_ * stride_];
-   double doubleRawValue;
    switch ( memoryRepresentation_ )
    {
       case Int8:
-         /// Calc (x-offset)/scale rounded to nearest integer, but keep in
-         /// floating point until sure is in bounds
-         doubleRawValue = floor( ( *reinterpret_cast<int8_t *>( p ) - offset ) / scale + 0.5 );
+         loadNext<int8_t>( count, values, unscale );
          break;
       case UInt8:
-         /// Calc (x-offset)/scale rounded to nearest integer, but keep in
-         /// floating point until sure is in bounds
-         doubleRawValue = floor( ( *reinterpret_cast<uint8_t *>( p ) - offset ) / scale + 0.5 );
+         loadNext<uint8_t>( count, values, unscale );
          break;
       case Int16:
-         /// Calc (x-offset)/scale rounded to nearest integer, but keep in
-         /// floating point until sure is in bounds
-         doubleRawValue = floor( ( *reinterpret_cast<int16_t *>( p ) - offset ) / scale + 0.5 );
+         loadNext<int16_t>( count, values, unscale );
          break;
       case UInt16:
-         /// Calc (x-offset)/scale rounded to nearest integer, but keep in
-         /// floating point until sure is in bounds
-         doubleRawValue = floor( ( *reinterpret_cast<uint16_t *>( p ) - offset ) / scale + 0.5 );
+         loadNext<uint16_t>( count, values, unscale );
          break;
       case Int32:
-         /// Calc (x-offset)/scale rounded to nearest integer, but keep in
-         /// floating point until sure is in bounds
-         doubleRawValue = floor( ( *reinterpret_cast<int32_t *>( p ) - offset ) / scale + 0.5 );
+         loadNext<int32_t>( count, values, unscale );
          break;
       case UInt32:
-         /// Calc (x-offset)/scale rounded to nearest integer, but keep in
-         /// floating point until sure is in bounds
-         doubleRawValue = floor( ( *reinterpret_cast<uint32_t *>( p ) - offset ) / scale + 0.5 );
+         loadNext<uint32_t>( count, values, unscale );
          break;
       case Int64:
-         /// Calc (x-offset)/scale rounded to nearest integer, but keep in
-         /// floating point until sure is in bounds
-         doubleRawValue = floor( ( *reinterpret_cast<int64_t *>( p ) - offset ) / scale + 0.5 );
+         loadNext<int64_t>( count, values, unscale );
          break;
       case Bool:
-         if ( *reinterpret_cast<bool *>( p ) )
-         {
-            doubleRawValue = floor( ( 1 - offset ) / scale + 0.5 );
-         }
-         else
-         {
-            doubleRawValue = floor( ( 0 - offset ) / scale + 0.5 );
-         }
+         loadNext<bool>( count, values,
+                         [&unscale]( bool value ) { return unscale( value ? 1 : 0 ); } );
          break;
       case Real32:
-         if ( !doConversion_ )
+         checkConversionAllowed();
+
+         //??? fault if get special value: NaN, NegInf...
+         loadNext<float>( count, values, unscaleReal );
+         break;
+      case Real64:
+         checkConversionAllowed();
+
+         // Contiguous doubles are unscaled a block at a time. Anything it can't do (a value
+         // which doesn't fit, or NaN) is left for loadNext() to convert and report.
+         if ( ( stride_ == sizeof( double ) ) && ( origin_ == 0.0 ) )
          {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
+            const size_t done = unscaleValues(
+               reinterpret_cast<const double *>( &base_[nextIndex_ * stride_] ), count, scale,
+               offset, values );
+
+            nextIndex_ += static_cast<unsigned>( done );
+            values += done;
+            count -= done;
          }
+
          //??? fault if get special value: NaN, NegInf...
+         loadNext<double>( count, values, unscaleReal );
+         break;
+      case Real16:
+         checkConversionAllowed();
+         loadNext<Float16>( count, values, unscaleReal );
+         break;
+      case Bits:
+         loadNextBits( count, values, unscale );
+         break;
+      case UString:
+         throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
+      default:
+         throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
+   }
+}
+
+void SourceDestBufferImpl::getNextFloats( float *values, size_t count, bool checkRange )
+{
+   /// don't checkImageFileOpen
+
+   /// Verify index is within bounds
+   checkRemaining( count );
+
+   const auto toFloat = []( auto value ) { return static_cast<float>( value ); };
+
+   /// Floating point values are relative to the origin. Adding -0.0 leaves every value as it is
+   /// (even -0.0), so it stands in for no origin.
+   const double origin = ( origin_ != 0.0 ) ? origin_ : -0.0;
 
-         /// Calc (x-offset)/scale rounded to nearest integer, but keep in
-         /// floating point until sure is in bounds
-         doubleRawValue = floor( ( *reinterpret_cast<float *>( p ) - offset ) / scale + 0.5 );
+   /// With an origin, even a float may not fit.
+   const auto realToFloat = [this, checkRange, origin]( auto value ) {
+      const double d = static_cast<double>( value ) + origin;
+
+      ///??? silently limit here?
+      if ( checkRange && ( d < DOUBLE_MIN || DOUBLE_MAX < d ) )
+      {
+         throw E57_EXCEPTION2( ErrorReal64TooLarge,
+                               "pathName=" + pathName_ + " value=" + toString( d ) );
+      }
+      return static_cast<float>( d );
+   };
+
+   /// Fetch values from source buffer.
+   /// Convert from other formats to floating point if requested
+   switch ( memoryRepresentation_ )
+   {
+      case Int8:
+         checkConversionAllowed();
+         loadNext<int8_t>( count, values, toFloat );
+         break;
+      case UInt8:
+         checkConversionAllowed();
+         loadNext<uint8_t>( count, values, toFloat );
+         break;
+      case Int16:
+         checkConversionAllowed();
+         loadNext<int16_t>( count, values, toFloat );
+         break;
+      case UInt16:
+         checkConversionAllowed();
+         loadNext<uint16_t>( count, values, toFloat );
+         break;
+      case Int32:
+         checkConversionAllowed();
+         loadNext<int32_t>( count, values, toFloat );
+         break;
+      case UInt32:
+         checkConversionAllowed();
+         loadNext<uint32_t>( count, values, toFloat );
+         break;
+      case Int64:
+         checkConversionAllowed();
+         loadNext<int64_t>( count, values, toFloat );
+         break;
+      case Bool:
+         checkConversionAllowed();
+
+         /// Convert bool to 0/1, all non-zero values map to 1.0
+         loadNext<bool>( count, values, []( bool value ) { return value ? 1.0F : 0.0F; } );
+         break;
+      case Real32:
+         if ( origin_ == 0.0 )
+         {
+            loadNext<float>( count, values, toFloat );
+         }
+         else
+         {
+            loadNext<float>( count, values, realToFloat );
+         }
          break;
       case Real64:
-         if ( !doConversion_ )
+         /// The caller may have checked the range already
+         if ( !checkRange && ( origin_ == 0.0 ) )
          {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
+            loadNext<double>( count, values, toFloat );
+            break;
          }
-         //??? fault if get special value: NaN, NegInf...
 
-         /// Calc (x-offset)/scale rounded to nearest integer, but keep in
-         /// floating point until sure is in bounds
-         doubleRawValue = floor( ( *reinterpret_cast<double *>( p ) - offset ) / scale + 0.5 );
+         /// Check that exponent of user's value is not too large for single
+         /// precision number in file.
+         loadNext<double>( count, values, realToFloat );
+         break;
+      case Real16:
+         loadNext<Float16>( count, values, realToFloat );
+         break;
+      case Bits:
+         checkConversionAllowed();
+         loadNextBits( count, values, toFloat );
          break;
       case UString:
          throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
       default:
          throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
    }
+}
+
+void SourceDestBufferImpl::getNextDoubles( double *values, size_t count )
+{
+   /// don't checkImageFileOpen
+
+   /// Verify index is within bounds
+   checkRemaining( count );
+
+   const auto toDouble = []( auto value ) { return static_cast<double>( value ); };
+
+   /// Floating point values are relative to the origin. Adding -0.0 leaves every value as it is
+   /// (even -0.0), so it stands in for no origin.
+   const double origin = ( origin_ != 0.0 ) ? origin_ : -0.0;
+
+   const auto realToDouble = [origin]( auto value ) {
+      return static_cast<double>( value ) + origin;
+   };
 
-   /// Make sure that value is representable in an int64_t
-   if ( doubleRawValue < INT64_MIN || ( doubleRawValue > ( static_cast<double>( INT64_MAX ) ) ) )
+   /// Fetch values from source buffer.
+   /// Convert from other formats to floating point if requested
+   switch ( memoryRepresentation_ )
    {
-      throw E57_EXCEPTION2( ErrorScaledValueNotRepresentable,
-                            "pathName=" + pathName_ + " value=" + toString( doubleRawValue ) );
+      case Int8:
+         checkConversionAllowed();
+         loadNext<int8_t>( count, values, toDouble );
+         break;
+      case UInt8:
+         checkConversionAllowed();
+         loadNext<uint8_t>( count, values, toDouble );
+         break;
+      case Int16:
+         checkConversionAllowed();
+         loadNext<int16_t>( count, values, toDouble );
+         break;
+      case UInt16:
+         checkConversionAllowed();
+         loadNext<uint16_t>( count, values, toDouble );
+         break;
+      case Int32:
+         checkConversionAllowed();
+         loadNext<int32_t>( count, values, toDouble );
+         break;
+      case UInt32:
+         checkConversionAllowed();
+         loadNext<uint32_t>( count, values, toDouble );
+         break;
+      case Int64:
+         checkConversionAllowed();
+         loadNext<int64_t>( count, values, toDouble );
+         break;
+      case Bool:
+         checkConversionAllowed();
+
+         /// Convert bool to 0/1, all non-zero values map to 1.0
+         loadNext<bool>( count, values, []( bool value ) { return value ? 1.0 : 0.0; } );
+         break;
+      case Real32:
+         loadNext<float>( count, values, realToDouble );
+         break;
+      case Real64:
+         loadNext<double>( count, values, realToDouble );
+         break;
+      case Real16:
+         loadNext<Float16>( count, values, realToDouble );
+         break;
+      case Bits:
+         checkConversionAllowed();
+         loadNextBits( count, values, toDouble );
+         break;
+      case UString:
+         throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
+      default:
+         throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
    }
+}
 
-   auto rawValue = static_cast<int64_t>( doubleRawValue );
+int64_t SourceDestBufferImpl::getNextInt64()
+{
+   int64_t value;
+   getNextInt64s( &value, 1 );
+   return value;
+}
 
-   nextIndex_++;
-   return ( rawValue );
+int64_t SourceDestBufferImpl::getNextInt64( double scale, double offset )
+{
+   int64_t value;
+   getNextInt64s( &value, 1, scale, offset );
+   return value;
 }
 
 float SourceDestBufferImpl::getNextFloat()
+{
+   float value;
+   getNextFloats( &value, 1 );
+   return value;
+}
+
+double SourceDestBufferImpl::getNextDouble()
+{
+   double value;
+   getNextDoubles( &value, 1 );
+   return value;
+}
+
+ustring SourceDestBufferImpl::getNextString()
 {
    /// don't checkImageFileOpen
 
+   /// Check have correct type buffer
+   if ( memoryRepresentation_ != UString )
+   {
+      throw E57_EXCEPTION2( ErrorExpectingUString, "pathName=" + pathName_ );
+   }
+
    /// Verify index is within bounds
    if ( nextIndex_ >= capacity_ )
    {
       throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
    }
 
-   /// Fetch value from source buffer.
-   /// Convert from other formats to floating point if requested
+   if ( arena_ != nullptr )
+   {
+      size_t length = 0;
+      const char *value = getNextString( length );
+
+      return { value, length };
+   }
+
+   /// Get ustring from vector
+   return ( ( *ustrings_ )[nextIndex_++] );
+}
+
+const char *SourceDestBufferImpl::getNextString( size_t &length )
+{
+   /// don't checkImageFileOpen
+
+   /// Check have correct type buffer
+   if ( memoryRepresentation_ != UString )
+   {
+      throw E57_EXCEPTION2( ErrorExpectingUString, "pathName=" + pathName_ );
+   }
+
+   /// Verify index is within bounds
+   if ( nextIndex_ >= capacity_ )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
+   }
+
+   if ( arena_ == nullptr )
+   {
+      const ustring &value = ( *ustrings_ )[nextIndex_++];
+
+      length = value.length();
+      return value.data();
+   }
+
+   /// The arena's size isn't tied to the capacity, so it may not have this many strings
+   if ( nextIndex_ >= arena_->size() )
+   {
+      throw E57_EXCEPTION2( ErrorBadBuffer, "pathName=" + pathName_ + " arenaSize=" +
+                                               toString( arena_->size() ) +
+                                               " index=" + toString( nextIndex_ ) );
+   }
+
+   length = arena_->length( nextIndex_ );
+   return arena_->string( nextIndex_++ );
+}
+
+void SourceDestBufferImpl::fillNextInt64( int64_t value, size_t count )
+{
+   /// don't checkImageFileOpen
+
+   if ( count == 0 )
+   {
+      return;
+   }
+
+   /// Verify have room
+   checkRemaining( count );
+
+   /// Every element gets the same value, so convert the first one and copy it
+   const unsigned first = nextIndex_;
+
+   setNextInt64( value );
+   repeatElement( first, count - 1 );
+}
+
+void SourceDestBufferImpl::fillNextInt64( int64_t value, size_t count, double scale,
+                                          double offset )
+{
+   /// don't checkImageFileOpen
+
+   if ( count == 0 )
+   {
+      return;
+   }
+
+   /// Verify have room
+   checkRemaining( count );
+
+   /// Every element gets the same value, so scale the first one and copy it
+   const unsigned first = nextIndex_;
+
+   setNextInt64( value, scale, offset );
+   repeatElement( first, count - 1 );
+}
+
+void SourceDestBufferImpl::skipNext( size_t count )
+{
+   /// Verify have room
+   checkRemaining( count );
+
+   nextIndex_ += static_cast<unsigned>( count );
+}
+
+/// Return the address of the next count elements and move past them, for callers which read or
+/// write the elements directly instead of one at a time.
+char *SourceDestBufferImpl::nextElements( size_t count )
+{
+   /// Verify have room
+   if ( count > capacity_ - nextIndex_ )
+   {
+      throw E57_EXCEPTION2( ErrorInternal,
+                            "pathName=" + pathName_ + " count=" + toString( count ) );
+   }
+
    char *p = &base_[nextIndex_ * stride_];
-   float value;
+
+   nextIndex_ += static_cast<unsigned>( count );
+
+   return p;
+}
+
+/// Find the smallest and largest of the first count values in the buffer, as they are in memory
+/// (i.e. before any conversion or scaling) plus the origin. Returns false if there are none, or
+/// this is a string buffer.
+bool SourceDestBufferImpl::valueRange( size_t count, double &minimum, double &maximum ) const
+{
+   count = std::min( count, capacity_ );
+
+   if ( count == 0 )
+   {
+      return false;
+   }
+
+   const auto addOrigin = [this, &minimum, &maximum]( bool found ) {
+      if ( found && ( origin_ != 0.0 ) )
+      {
+         minimum += origin_;
+         maximum += origin_;
+      }
+
+      return found;
+   };
+
+   switch ( memoryRepresentation_ )
+   {
+      case Int8:
+         return rangeOf<int8_t>( base_, stride_, count, minimum, maximum );
+      case UInt8:
+         return rangeOf<uint8_t>( base_, stride_, count, minimum, maximum );
+      case Int16:
+         return rangeOf<int16_t>( base_, stride_, count, minimum, maximum );
+      case UInt16:
+         return rangeOf<uint16_t>( base_, stride_, count, minimum, maximum );
+      case Int32:
+         return rangeOf<int32_t>( base_, stride_, count, minimum, maximum );
+      case UInt32:
+         return rangeOf<uint32_t>( base_, stride_, count, minimum, maximum );
+      case Int64:
+         return rangeOf<int64_t>( base_, stride_, count, minimum, maximum );
+      case Bool:
+         return rangeOf<bool>( base_, stride_, count, minimum, maximum );
+      case Real32:
+         return addOrigin( rangeOf<float>( base_, stride_, count, minimum, maximum ) );
+      case Real64:
+         return addOrigin( rangeOf<double>( base_, stride_, count, minimum, maximum ) );
+      case Real16:
+         return addOrigin( rangeOfFloat16( base_, stride_, count, minimum, maximum ) );
+      case Bits:
+         rangeOfBits( packedBits(), count, minimum, maximum );
+         return true;
+      case UString:
+         break;
+   }
+
+   return false;
+}
+
+void SourceDestBufferImpl::keepInRange( size_t begin, size_t count, double minimum,
+                                        double maximum, uint8_t *keep ) const
+{
+   const char *base = base_ + begin * stride_;
+
+   switch ( memoryRepresentation_ )
+   {
+      case Int8:
+         ::keepInRange<int8_t>( base, stride_, count, minimum, maximum, keep );
+         break;
+      case UInt8:
+         ::keepInRange<uint8_t>( base, stride_, count, minimum, maximum, keep );
+         break;
+      case Int16:
+         ::keepInRange<int16_t>( base, stride_, count, minimum, maximum, keep );
+         break;
+      case UInt16:
+         ::keepInRange<uint16_t>( base, stride_, count, minimum, maximum, keep );
+         break;
+      case Int32:
+         ::keepInRange<int32_t>( base, stride_, count, minimum, maximum, keep );
+         break;
+      case UInt32:
+         ::keepInRange<uint32_t>( base, stride_, count, minimum, maximum, keep );
+         break;
+      case Int64:
+         ::keepInRange<int64_t>( base, stride_, count, minimum, maximum, keep );
+         break;
+      case Bool:
+         ::keepInRange<bool>( base, stride_, count, minimum, maximum, keep );
+         break;
+      case Real32:
+         ::keepInRange<float>( base, stride_, count, minimum, maximum, keep, origin_ );
+         break;
+      case Real64:
+         ::keepInRange<double>( base, stride_, count, minimum, maximum, keep, origin_ );
+         break;
+      case Real16:
+         ::keepInRange<Float16>( base, stride_, count, minimum, maximum, keep, origin_ );
+         break;
+      case Bits:
+         keepBitsInRange( packedBits(), begin, count, minimum, maximum, keep );
+         break;
+      case UString:
+         throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
+   }
+}
+
+void SourceDestBufferImpl::keepElements( size_t begin, const uint8_t *keep )
+{
+   if ( begin >= nextIndex_ )
+   {
+      return;
+   }
+
+   const size_t count = nextIndex_ - begin;
+   char *base = base_ + begin * stride_;
+   size_t kept = 0;
+
    switch ( memoryRepresentation_ )
    {
       case Int8:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<float>( *reinterpret_cast<int8_t *>( p ) );
+         kept = ::keepElements<int8_t>( base, stride_, count, keep );
          break;
       case UInt8:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<float>( *reinterpret_cast<uint8_t *>( p ) );
+         kept = ::keepElements<uint8_t>( base, stride_, count, keep );
          break;
       case Int16:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<float>( *reinterpret_cast<int16_t *>( p ) );
+         kept = ::keepElements<int16_t>( base, stride_, count, keep );
          break;
       case UInt16:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<float>( *reinterpret_cast<uint16_t *>( p ) );
+         kept = ::keepElements<uint16_t>( base, stride_, count, keep );
          break;
       case Int32:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<float>( *reinterpret_cast<int32_t *>( p ) );
+         kept = ::keepElements<int32_t>( base, stride_, count, keep );
          break;
       case UInt32:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<float>( *reinterpret_cast<uint32_t *>( p ) );
+         kept = ::keepElements<uint32_t>( base, stride_, count, keep );
          break;
       case Int64:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<float>( *reinterpret_cast<int64_t *>( p ) );
+         kept = ::keepElements<int64_t>( base, stride_, count, keep );
          break;
       case Bool:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-
-         /// Convert bool to 0/1, all non-zero values map to 1.0
-         value = ( *reinterpret_cast<bool *>( p ) ) ? 1.0F : 0.0F;
+         kept = ::keepElements<bool>( base, stride_, count, keep );
          break;
       case Real32:
-         value = *reinterpret_cast<float *>( p );
+         kept = ::keepElements<float>( base, stride_, count, keep );
          break;
       case Real64:
-      {
-         /// Check that exponent of user's value is not too large for single
-         /// precision number in file.
-         double d = *reinterpret_cast<double *>( p );
+         kept = ::keepElements<double>( base, stride_, count, keep );
+         break;
+      case Real16:
+         kept = ::keepElements<Float16>( base, stride_, count, keep );
+         break;
+      case Bits:
+         kept = keepBits( packedBits(), begin, count, keep );
+         break;
+      case UString:
+         if ( arena_ != nullptr )
+         {
+            kept = keepArenaStrings( begin, count, keep );
+            break;
+         }
 
-         ///??? silently limit here?
-         if ( d < DOUBLE_MIN || DOUBLE_MAX < d )
+         for ( size_t i = 0; i < count; ++i )
          {
-            throw E57_EXCEPTION2( ErrorReal64TooLarge,
-                                  "pathName=" + pathName_ + " value=" + toString( d ) );
+            if ( keep[i] != 0 )
+            {
+               if ( kept != i )
+               {
+                  ( *ustrings_ )[begin + kept] = std::move( ( *ustrings_ )[begin + i] );
+               }
+
+               ++kept;
+            }
          }
-         value = static_cast<float>( d );
          break;
-      }
-      case UString:
-         throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
-      default:
-         throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
    }
-   nextIndex_++;
-   return ( value );
+
+   nextIndex_ = static_cast<unsigned>( begin + kept );
 }
 
-double SourceDestBufferImpl::getNextDouble()
+/// The arena version of keepElements(): move the characters of the kept strings down over the
+/// dropped ones and rebuild their offsets.
+size_t SourceDestBufferImpl::keepArenaStrings( size_t begin, size_t count, const uint8_t *keep )
 {
-   /// don't checkImageFileOpen
+   std::vector<char> &data = arena_->data;
+   std::vector<size_t> &offsets = arena_->offsets;
 
-   /// Verify index is within bounds
-   if ( nextIndex_ >= capacity_ )
+   size_t end = offsets[begin];
+   size_t kept = 0;
+
+   for ( size_t i = 0; i < count; ++i )
    {
-      throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
+      if ( keep[i] != 0 )
+      {
+         const size_t first = offsets[begin + i];
+         const size_t length = offsets[begin + i + 1] - first;
+
+         if ( first != end )
+         {
+            std::memmove( &data[end], &data[first], length );
+         }
+
+         end += length;
+         ++kept;
+         offsets[begin + kept] = end;
+      }
    }
 
-   /// Fetch value from source buffer.
-   /// Convert from other formats to floating point if requested
-   char *p = &base_[nextIndex_ * stride_];
-   double value;
+   offsets.resize( begin + kept + 1 );
+   data.resize( end );
+
+   return kept;
+}
+
+template <typename T> void SourceDestBufferImpl::setNextReals( const T *values, size_t count )
+{
+   static_assert( std::is_same<T, double>::value || std::is_same<T, float>::value,
+                  "setNextReals() requires float or double type" );
+
+   /// don't checkImageFileOpen
+
+   /// Verify have room
+   checkRemaining( count );
+
+   const auto toInteger = [this]( auto tag, T value ) {
+      using IntT = decltype( tag );
+
+      return checkedValue<IntT>( value, ErrorValueNotRepresentable, "value" );
+   };
+
    switch ( memoryRepresentation_ )
    {
       case Int8:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<double>( *reinterpret_cast<int8_t *>( p ) );
+         checkConversionAllowed();
+
+         //??? fault if get special value: NaN, NegInf...  (all other ints below
+         // too)
+         storeNext<int8_t>( count, values,
+                            [&toInteger]( T value ) { return toInteger( int8_t{}, value ); } );
          break;
       case UInt8:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<double>( *reinterpret_cast<uint8_t *>( p ) );
+         checkConversionAllowed();
+         storeNext<uint8_t>( count, values,
+                             [&toInteger]( T value ) { return toInteger( uint8_t{}, value ); } );
          break;
       case Int16:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<double>( *reinterpret_cast<int16_t *>( p ) );
+         checkConversionAllowed();
+         storeNext<int16_t>( count, values,
+                             [&toInteger]( T value ) { return toInteger( int16_t{}, value ); } );
          break;
       case UInt16:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<double>( *reinterpret_cast<uint16_t *>( p ) );
+         checkConversionAllowed();
+         storeNext<uint16_t>( count, values,
+                              [&toInteger]( T value ) { return toInteger( uint16_t{}, value ); } );
          break;
       case Int32:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<double>( *reinterpret_cast<int32_t *>( p ) );
+         checkConversionAllowed();
+         storeNext<int32_t>( count, values,
+                             [&toInteger]( T value ) { return toInteger( int32_t{}, value ); } );
          break;
       case UInt32:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<double>( *reinterpret_cast<uint32_t *>( p ) );
+         checkConversionAllowed();
+         storeNext<uint32_t>( count, values,
+                              [&toInteger]( T value ) { return toInteger( uint32_t{}, value ); } );
          break;
       case Int64:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         value = static_cast<double>( *reinterpret_cast<int64_t *>( p ) );
+         checkConversionAllowed();
+         storeNext<int64_t>( count, values,
+                             [&toInteger]( T value ) { return toInteger( int64_t{}, value ); } );
          break;
       case Bool:
-         if ( !doConversion_ )
-         {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
-         }
-         /// Convert bool to 0/1, all non-zero values map to 1.0
-         value = ( *reinterpret_cast<bool *>( p ) ) ? 1.0 : 0.0;
+         checkConversionAllowed();
+         storeNext<bool>( count, values, []( T value ) { return ( value ? false : true ); } );
          break;
       case Real32:
-         value = static_cast<double>( *reinterpret_cast<float *>( p ) );
+         if ( std::is_same<T, double>::value || ( origin_ != 0.0 ) )
+         {
+            /// Does this count as conversion?  It loses information.
+            /// Check for really large exponents that can't fit in a single
+            /// precision
+            storeNext<float>( count, values, [this]( T value ) {
+               const double shifted = value - origin_;
+
+               if ( shifted < DOUBLE_MIN || DOUBLE_MAX < shifted )
+               {
+                  throw E57_EXCEPTION2( ErrorValueNotRepresentable,
+                                        "pathName=" + pathName_ + " value=" + toString( value ) );
+               }
+               return static_cast<float>( shifted );
+            } );
+         }
+         else
+         {
+            storeNext<float>( count, values,
+                              []( T value ) { return static_cast<float>( value ); } );
+         }
          break;
       case Real64:
-         value = *reinterpret_cast<double *>( p );
+         //??? does this count as a conversion?
+         storeNext<double>( count, values,
+                            [this]( T value ) { return static_cast<double>( value ) - origin_; } );
+         break;
+      case Real16:
+         storeNext<Float16>( count, values, [this]( T value ) {
+            return checkedFloat16( static_cast<double>( value ) - origin_,
+                                   ErrorValueNotRepresentable, "value" );
+         } );
+         break;
+      case Bits:
+         checkConversionAllowed();
+         storeNextBits( count, values, [this]( T value ) {
+            return checkedBits( value, ErrorValueNotRepresentable, "value" );
+         } );
          break;
       case UString:
          throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
-      default:
-         throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
-   }
-   nextIndex_++;
-   return ( value );
-}
-
-ustring SourceDestBufferImpl::getNextString()
-{
-   /// don't checkImageFileOpen
-
-   /// Check have correct type buffer
-   if ( memoryRepresentation_ != UString )
-   {
-      throw E57_EXCEPTION2( ErrorExpectingUString, "pathName=" + pathName_ );
-   }
-
-   /// Verify index is within bounds
-   if ( nextIndex_ >= capacity_ )
-   {
-      throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
    }
-
-   /// Get ustring from vector
-   return ( ( *ustrings_ )[nextIndex_++] );
 }
 
-void SourceDestBufferImpl::setNextInt64( int64_t value )
+void SourceDestBufferImpl::setNextInt64s( const int64_t *values, size_t count )
 {
    /// don't checkImageFileOpen
 
    /// Verify have room
-   if ( nextIndex_ >= capacity_ )
-   {
-      throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
-   }
+   checkRemaining( count );
 
-   /// Calc start of memory location, index into buffer using stride_ (the
-   /// distance between elements).
-   char *p = &base_[nextIndex_ * stride_];
+   const auto toInteger = [this]( auto tag, int64_t value ) {
+      using IntT = decltype( tag );
+
+      return checkedValue<IntT>( value, ErrorValueNotRepresentable, "value" );
+   };
 
    switch ( memoryRepresentation_ )
    {
       case Int8:
-         if ( value < INT8_MIN || INT8_MAX < value )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( value ) );
-         }
-         *reinterpret_cast<int8_t *>( p ) = static_cast<int8_t>( value );
+         storeNext<int8_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( int8_t{}, value );
+         } );
          break;
       case UInt8:
-         if ( value < UINT8_MIN || UINT8_MAX < value )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( value ) );
-         }
-         *reinterpret_cast<uint8_t *>( p ) = static_cast<uint8_t>( value );
+         storeNext<uint8_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( uint8_t{}, value );
+         } );
          break;
       case Int16:
-         if ( value < INT16_MIN || INT16_MAX < value )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( value ) );
-         }
-         *reinterpret_cast<int16_t *>( p ) = static_cast<int16_t>( value );
+         storeNext<int16_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( int16_t{}, value );
+         } );
          break;
       case UInt16:
-         if ( value < UINT16_MIN || UINT16_MAX < value )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( value ) );
-         }
-         *reinterpret_cast<uint16_t *>( p ) = static_cast<uint16_t>( value );
+         storeNext<uint16_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( uint16_t{}, value );
+         } );
          break;
       case Int32:
-         if ( value < INT32_MIN || INT32_MAX < value )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( value ) );
-         }
-         *reinterpret_cast<int32_t *>( p ) = static_cast<int32_t>( value );
+         storeNext<int32_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( int32_t{}, value );
+         } );
          break;
       case UInt32:
-         if ( value < UINT32_MIN || UINT32_MAX < value )
-         {
-            throw E57_EXCEPTION2( ErrorValueNotRepresentable,
-                                  "pathName=" + pathName_ + " value=" + toString( value ) );
-         }
-         *reinterpret_cast<uint32_t *>( p ) = static_cast<uint32_t>( value );
+         storeNext<uint32_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( uint32_t{}, value );
+         } );
          break;
       case Int64:
-         *reinterpret_cast<int64_t *>( p ) = static_cast<int64_t>( value );
+         storeNext<int64_t>( count, values, []( int64_t value ) { return value; } );
          break;
       case Bool:
-         *reinterpret_cast<bool *>( p ) = ( value ? false : true );
+         storeNext<bool>( count, values, []( int64_t value ) { return ( value ? false : true ); } );
          break;
       case Real32:
-         if ( !doConversion_ )
+         checkConversionAllowed();
+
+         //??? very large integers may lose some lowest bits here. error?
+         if ( origin_ == 0.0 )
          {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
+            storeNext<float>( count, values,
+                              []( int64_t value ) { return static_cast<float>( value ); } );
          }
-         //??? very large integers may lose some lowest bits here. error?
-         *reinterpret_cast<float *>( p ) = static_cast<float>( value );
-         break;
-      case Real64:
-         if ( !doConversion_ )
+         else
          {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
+            storeNext<float>( count, values, [this]( int64_t value ) {
+               return static_cast<float>( static_cast<double>( value ) - origin_ );
+            } );
          }
-         *reinterpret_cast<double *>( p ) = static_cast<double>( value );
+         break;
+      case Real64:
+         checkConversionAllowed();
+         storeNext<double>( count, values, [this]( int64_t value ) {
+            return static_cast<double>( value ) - origin_;
+         } );
+         break;
+      case Real16:
+         checkConversionAllowed();
+         storeNext<Float16>( count, values, [this]( int64_t value ) {
+            return checkedFloat16( static_cast<double>( value ) - origin_,
+                                   ErrorValueNotRepresentable, "value" );
+         } );
+         break;
+      case Bits:
+         storeNextBits( count, values, [this]( int64_t value ) {
+            return checkedBits( value, ErrorValueNotRepresentable, "value" );
+         } );
          break;
       case UString:
          throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
    }
-
-   nextIndex_++;
 }
 
-void SourceDestBufferImpl::setNextInt64( int64_t value, double scale, double offset )
+void SourceDestBufferImpl::setNextInt64s( const int64_t *values, size_t count, double scale,
+                                          double offset )
 {
    /// don't checkImageFileOpen
 
@@ -818,135 +1609,179 @@ void SourceDestBufferImpl::setNextInt64( int64_t value, double scale, double off
    if ( !doScaling_ )
    {
       /// Use raw value routine, then bail out.
-      setNextInt64( value );
+      setNextInt64s( values, count );
       return;
    }
 
    /// Verify have room
-   if ( nextIndex_ >= capacity_ )
-   {
-      throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
-   }
-
-   /// Calc start of memory location, index into buffer using stride_ (the
-   /// distance between elements).
-   char *p = &base_[nextIndex_ * stride_];
+   checkRemaining( count );
 
    /// Calc x*scale+offset
-   double scaledValue;
-   if ( memoryRepresentation_ == Real32 || memoryRepresentation_ == Real64 )
-   {
-      /// Value will be stored in some floating point rep in user's buffer, so
-      /// keep full resolution here.
-      scaledValue = value * scale + offset;
-   }
-   else
-   {
-      /// Value will represented as some integer in user's buffer, so round to
-      /// nearest integer here. But keep in floating point rep until we know
-      /// that the value is representable in the user's buffer.
-      scaledValue = floor( value * scale + offset + 0.5 );
-   }
+
+   /// Value will be stored in some floating point rep in user's buffer, so
+   /// keep full resolution here. It is relative to the buffer's origin.
+   const auto scaleReal = [this, scale, offset]( int64_t value ) {
+      return value * scale + offset - origin_;
+   };
+
+   /// Value will represented as some integer in user's buffer, so round to
+   /// nearest integer here. But keep in floating point rep until we know
+   /// that the value is representable in the user's buffer.
+   const auto toInteger = [this, scale, offset]( auto tag, int64_t value ) {
+      using IntT = decltype( tag );
+
+      const double scaledValue = floor( value * scale + offset + 0.5 );
+
+      return checkedValue<IntT>( scaledValue, ErrorScaledValueNotRepresentable, "scaledValue" );
+   };
 
    switch ( memoryRepresentation_ )
    {
       case Int8:
-         if ( scaledValue < INT8_MIN || INT8_MAX < scaledValue )
-         {
-            throw E57_EXCEPTION2( ErrorScaledValueNotRepresentable,
-                                  "pathName=" + pathName_ +
-                                     " scaledValue=" + toString( scaledValue ) );
-         }
-         *reinterpret_cast<int8_t *>( p ) = static_cast<int8_t>( scaledValue );
+         storeNext<int8_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( int8_t{}, value );
+         } );
          break;
       case UInt8:
-         if ( scaledValue < UINT8_MIN || UINT8_MAX < scaledValue )
-         {
-            throw E57_EXCEPTION2( ErrorScaledValueNotRepresentable,
-                                  "pathName=" + pathName_ +
-                                     " scaledValue=" + toString( scaledValue ) );
-         }
-         *reinterpret_cast<uint8_t *>( p ) = static_cast<uint8_t>( scaledValue );
+         storeNext<uint8_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( uint8_t{}, value );
+         } );
          break;
       case Int16:
-         if ( scaledValue < INT16_MIN || INT16_MAX < scaledValue )
-         {
-            throw E57_EXCEPTION2( ErrorScaledValueNotRepresentable,
-                                  "pathName=" + pathName_ +
-                                     " scaledValue=" + toString( scaledValue ) );
-         }
-         *reinterpret_cast<int16_t *>( p ) = static_cast<int16_t>( scaledValue );
+         storeNext<int16_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( int16_t{}, value );
+         } );
          break;
       case UInt16:
-         if ( scaledValue < UINT16_MIN || UINT16_MAX < scaledValue )
-         {
-            throw E57_EXCEPTION2( ErrorScaledValueNotRepresentable,
-                                  "pathName=" + pathName_ +
-                                     " scaledValue=" + toString( scaledValue ) );
-         }
-         *reinterpret_cast<uint16_t *>( p ) = static_cast<uint16_t>( scaledValue );
+         storeNext<uint16_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( uint16_t{}, value );
+         } );
          break;
       case Int32:
-         if ( scaledValue < INT32_MIN || INT32_MAX < scaledValue )
-         {
-            throw E57_EXCEPTION2( ErrorScaledValueNotRepresentable,
-                                  "pathName=" + pathName_ +
-                                     " scaledValue=" + toString( scaledValue ) );
-         }
-         *reinterpret_cast<int32_t *>( p ) = static_cast<int32_t>( scaledValue );
+         storeNext<int32_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( int32_t{}, value );
+         } );
          break;
       case UInt32:
-         if ( scaledValue < UINT32_MIN || UINT32_MAX < scaledValue )
-         {
-            throw E57_EXCEPTION2( ErrorScaledValueNotRepresentable,
-                                  "pathName=" + pathName_ +
-                                     " scaledValue=" + toString( scaledValue ) );
-         }
-         *reinterpret_cast<uint32_t *>( p ) = static_cast<uint32_t>( scaledValue );
+         storeNext<uint32_t>( count, values, [&toInteger]( int64_t value ) {
+            return toInteger( uint32_t{}, value );
+         } );
          break;
       case Int64:
-         *reinterpret_cast<int64_t *>( p ) = static_cast<int64_t>( scaledValue );
+         storeNext<int64_t>( count, values, [scale, offset]( int64_t value ) {
+            return static_cast<int64_t>( floor( value * scale + offset + 0.5 ) );
+         } );
          break;
       case Bool:
-         *reinterpret_cast<bool *>( p ) = ( scaledValue ? false : true );
+         storeNext<bool>( count, values, [scale, offset]( int64_t value ) {
+            return ( floor( value * scale + offset + 0.5 ) ? false : true );
+         } );
          break;
       case Real32:
-         if ( !doConversion_ )
+         checkConversionAllowed();
+
+         /// Contiguous floats are scaled a block at a time. The result of a finite scale and
+         /// offset always fits the check below.
+         if ( stride_ == sizeof( float ) )
          {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
+            scaleValues( values, count, scale, offset, origin_,
+                         reinterpret_cast<float *>( &base_[nextIndex_ * stride_] ) );
+
+            nextIndex_ += static_cast<unsigned>( count );
+            break;
          }
+
          /// Check that exponent of result is not too big for single precision
          /// float
-         if ( scaledValue < DOUBLE_MIN || DOUBLE_MAX < scaledValue )
+         storeNext<float>( count, values, [this, &scaleReal]( int64_t value ) {
+            const double scaledValue = scaleReal( value );
+
+            if ( scaledValue < DOUBLE_MIN || DOUBLE_MAX < scaledValue )
+            {
+               throw E57_EXCEPTION2( ErrorScaledValueNotRepresentable,
+                                     "pathName=" + pathName_ +
+                                        " scaledValue=" + toString( scaledValue ) );
+            }
+            return static_cast<float>( scaledValue );
+         } );
+         break;
+      case Real64:
+         checkConversionAllowed();
+
+         if ( stride_ == sizeof( double ) )
+         {
+            scaleValues( values, count, scale, offset, origin_,
+                         reinterpret_cast<double *>( &base_[nextIndex_ * stride_] ) );
+
+            nextIndex_ += static_cast<unsigned>( count );
+         }
+         else
          {
-            throw E57_EXCEPTION2( ErrorScaledValueNotRepresentable,
-                                  "pathName=" + pathName_ +
-                                     " scaledValue=" + toString( scaledValue ) );
+            storeNext<double>( count, values, scaleReal );
          }
-         *reinterpret_cast<float *>( p ) = static_cast<float>( scaledValue );
          break;
-      case Real64:
-         if ( !doConversion_ )
+      case Real16:
+      {
+         checkConversionAllowed();
+
+         // Contiguous halves are scaled a block at a time. A value too large for them is left
+         // for storeNext() to report.
+         if ( stride_ == sizeof( Float16 ) )
          {
-            throw E57_EXCEPTION2( ErrorConversionRequired, "pathName=" + pathName_ );
+            const size_t done =
+               scaleValues( values, count, scale, offset, origin_,
+                            reinterpret_cast<Float16 *>( &base_[nextIndex_ * stride_] ) );
+
+            nextIndex_ += static_cast<unsigned>( done );
+            values += done;
+            count -= done;
          }
-         *reinterpret_cast<double *>( p ) = scaledValue;
+
+         storeNext<Float16>( count, values, [this, &scaleReal]( int64_t value ) {
+            return checkedFloat16( scaleReal( value ), ErrorScaledValueNotRepresentable,
+                                   "scaledValue" );
+         } );
+         break;
+      }
+      case Bits:
+         storeNextBits( count, values, [this, scale, offset]( int64_t value ) {
+            return checkedBits( floor( value * scale + offset + 0.5 ),
+                                ErrorScaledValueNotRepresentable, "scaledValue" );
+         } );
          break;
       case UString:
          throw E57_EXCEPTION2( ErrorExpectingNumeric, "pathName=" + pathName_ );
    }
+}
 
-   nextIndex_++;
+void SourceDestBufferImpl::setNextFloats( const float *values, size_t count )
+{
+   setNextReals( values, count );
+}
+
+void SourceDestBufferImpl::setNextDoubles( const double *values, size_t count )
+{
+   setNextReals( values, count );
+}
+
+void SourceDestBufferImpl::setNextInt64( int64_t value )
+{
+   setNextInt64s( &value, 1 );
+}
+
+void SourceDestBufferImpl::setNextInt64( int64_t value, double scale, double offset )
+{
+   setNextInt64s( &value, 1, scale, offset );
 }
 
 void SourceDestBufferImpl::setNextFloat( float value )
 {
-   _setNextReal( value );
+   setNextReals( &value, 1 );
 }
 
 void SourceDestBufferImpl::setNextDouble( double value )
 {
-   _setNextReal( value );
+   setNextReals( &value, 1 );
 }
 
 void SourceDestBufferImpl::setNextString( const ustring &value )
@@ -964,8 +1799,65 @@ void SourceDestBufferImpl::setNextString( const ustring &value )
       throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
    }
 
-   /// Assign to already initialized element in vector
-   ( *ustrings_ )[nextIndex_] = value;
+   beginNextString();
+   appendNextString( value.data(), value.length() );
+   endNextString();
+}
+
+void SourceDestBufferImpl::beginNextString()
+{
+   /// don't checkImageFileOpen
+
+   if ( memoryRepresentation_ != UString )
+   {
+      throw E57_EXCEPTION2( ErrorExpectingUString, "pathName=" + pathName_ );
+   }
+
+   /// Verify have room.
+   if ( nextIndex_ >= capacity_ )
+   {
+      throw E57_EXCEPTION2( ErrorInternal, "pathName=" + pathName_ );
+   }
+
+   if ( arena_ == nullptr )
+   {
+      /// Reuse the memory of the element already in the vector
+      ( *ustrings_ )[nextIndex_].clear();
+      return;
+   }
+
+   /// The arena holds only the strings set since the buffer was rewound, so it starts again at
+   /// the first one. Anything after the end of the last string is a string which wasn't ended.
+   if ( nextIndex_ == 0 )
+   {
+      arena_->clear();
+   }
+   else
+   {
+      arena_->offsets.resize( nextIndex_ + 1 );
+      arena_->data.resize( arena_->offsets.back() );
+   }
+}
+
+void SourceDestBufferImpl::appendNextString( const char *value, size_t length )
+{
+   if ( arena_ == nullptr )
+   {
+      ( *ustrings_ )[nextIndex_].append( value, length );
+   }
+   else
+   {
+      arena_->data.insert( arena_->data.end(), value, value + length );
+   }
+}
+
+void SourceDestBufferImpl::endNextString()
+{
+   if ( arena_ != nullptr )
+   {
+      arena_->offsets.push_back( arena_->data.size() );
+   }
+
    nextIndex_++;
 }
 
@@ -1001,6 +1893,12 @@ void SourceDestBufferImpl::checkCompatible(
                             "stride=" + toString( stride_ ) +
                                " newStride=" + toString( newBuf->stride() ) );
    }
+   if ( origin_ != newBuf->origin() )
+   {
+      throw E57_EXCEPTION2( ErrorBuffersNotCompatible,
+                            "origin=" + toString( origin_ ) +
+                               " newOrigin=" + toString( newBuf->origin() ) );
+   }
 }
 
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
@@ -1042,9 +1940,15 @@ void SourceDestBufferImpl::dump( int indent, std::ostream &os )
       case Real64:
          os << "double" << std::endl;
          break;
+      case Real16:
+         os << "float16" << std::endl;
+         break;
       case UString:
          os << "ustring" << std::endl;
          break;
+      case Bits:
+         os << "bits" << std::endl;
+         break;
       default:
          os << "<unknown>" << std::endl;
          break;
@@ -1053,10 +1957,13 @@ void SourceDestBufferImpl::dump( int indent, std::ostream &os )
       << std::endl;
    os << space( indent ) << "ustrings:             " << static_cast<const void *>( ustrings_ )
       << std::endl;
+   os << space( indent ) << "arena:                " << static_cast<const void *>( arena_ )
+      << std::endl;
    os << space( indent ) << "capacity:             " << capacity_ << std::endl;
    os << space( indent ) << "doConversion:         " << doConversion_ << std::endl;
    os << space( indent ) << "doScaling:            " << doScaling_ << std::endl;
    os << space( indent ) << "stride:               " << stride_ << std::endl;
+   os << space( indent ) << "origin:               " << origin_ << std::endl;
    os << space( indent ) << "nextIndex:            " << nextIndex_ << std::endl;
 }
 #endif
@@ -27,6 +27,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+
 #include "Common.h"
 
 namespace e57
@@ -41,9 +44,15 @@ namespace e57
 
       template <typename T> void setTypeInfo( T *base, size_t stride = sizeof( T ) );
 
+      /// Make this a ::Bits buffer of @a bits, whose bits per value are kept in stride()
+      void setBitsInfo( PackedBits bits );
+
       SourceDestBufferImpl( ImageFileImplWeakPtr destImageFile, const ustring &pathName,
                             StringList *b );
 
+      SourceDestBufferImpl( ImageFileImplWeakPtr destImageFile, const ustring &pathName,
+                            StringArena *b, size_t capacity );
+
       ImageFileImplWeakPtr destImageFile() const
       {
          return destImageFile_;
@@ -69,6 +78,11 @@ namespace e57
          return ustrings_;
       }
 
+      StringArena *arena() const
+      {
+         return arena_;
+      }
+
       bool doConversion() const
       {
          return doConversion_;
@@ -84,11 +98,31 @@ namespace e57
          return stride_;
       }
 
+      /// Subtracted from each value stored in the buffer, and added to each one taken from it
+      double origin() const
+      {
+         return origin_;
+      }
+
+      void setOrigin( double origin );
+
       size_t capacity() const
       {
          return capacity_;
       }
 
+      /// Index at which decoders stop filling the buffer. This is capacity() unless
+      /// setLimit() was used to fill it a tile at a time.
+      size_t limit() const
+      {
+         return std::min( capacity_, limit_ );
+      }
+
+      void setLimit( size_t limit )
+      {
+         limit_ = limit;
+      }
+
       unsigned nextIndex() const
       {
          return nextIndex_;
@@ -99,6 +133,14 @@ namespace e57
          nextIndex_ = 0;
       }
 
+      char *nextElements( size_t count );
+
+      /// The memory of a ::Bits buffer
+      PackedBits packedBits() const
+      {
+         return { reinterpret_cast<uint8_t *>( base_ ), static_cast<unsigned>( stride_ ) };
+      }
+
       int64_t getNextInt64();
       int64_t getNextInt64( double scale, double offset );
       float getNextFloat();
@@ -110,6 +152,47 @@ namespace e57
       void setNextDouble( double value );
       void setNextString( const ustring &value );
 
+      /// Get the next string without copying it. The characters stay valid until the buffer's
+      /// strings are changed.
+      const char *getNextString( size_t &length );
+
+      /// Set the next string a piece at a time: beginNextString() empties it, appendNextString()
+      /// adds characters to it and endNextString() finishes it. For an arena the characters are
+      /// copied straight into it.
+      void beginNextString();
+      void appendNextString( const char *value, size_t length );
+      void endNextString();
+
+      /// Bulk versions of the above, for count elements at a time. They check and convert the
+      /// same way, but pick the conversion once per call instead of once per element.
+      void getNextInt64s( int64_t *values, size_t count );
+      void getNextInt64s( int64_t *values, size_t count, double scale, double offset );
+      void getNextFloats( float *values, size_t count, bool checkRange = true );
+      void getNextDoubles( double *values, size_t count );
+      void setNextInt64s( const int64_t *values, size_t count );
+      void setNextInt64s( const int64_t *values, size_t count, double scale, double offset );
+      void setNextFloats( const float *values, size_t count );
+      void setNextDoubles( const double *values, size_t count );
+
+      /// Set the next count elements to value, which is converted (and checked) only once.
+      void fillNextInt64( int64_t value, size_t count );
+      void fillNextInt64( int64_t value, size_t count, double scale, double offset );
+
+      /// Move past the next count elements without reading them.
+      void skipNext( size_t count );
+
+      bool valueRange( size_t count, double &minimum, double &maximum ) const;
+
+      /// Clear keep[i] for each of the count elements from index begin whose value isn't in
+      /// [minimum, maximum] (or is NaN).
+      void keepInRange( size_t begin, size_t count, double minimum, double maximum,
+                        uint8_t *keep ) const;
+
+      /// Move the elements from index begin up to nextIndex() for which keep is set down to
+      /// begin, keeping their order, and drop the rest, so nextIndex() is the end of the kept
+      /// ones. keep is indexed from begin.
+      void keepElements( size_t begin, const uint8_t *keep );
+
       void checkCompatible( const std::shared_ptr<SourceDestBufferImpl> &newBuf ) const;
 
 #ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
@@ -117,7 +200,27 @@ namespace e57
 #endif
 
    private:
-      template <typename T> void _setNextReal( T inValue );
+      template <typename T> void setNextReals( const T *values, size_t count );
+
+      template <typename T, typename OutT, typename Convert>
+      void loadNext( size_t count, OutT *out, Convert convert );
+      template <typename T, typename InT, typename Convert>
+      void storeNext( size_t count, const InT *in, Convert convert );
+      template <typename OutT, typename Convert>
+      void loadNextBits( size_t count, OutT *out, Convert convert );
+      template <typename InT, typename Convert>
+      void storeNextBits( size_t count, const InT *in, Convert convert );
+      template <typename T, typename V>
+      T checkedValue( V value, ErrorCode errorCode, const char *valueName ) const;
+      template <typename V>
+      unsigned checkedBits( V value, ErrorCode errorCode, const char *valueName ) const;
+      Float16 checkedFloat16( double value, ErrorCode errorCode, const char *valueName ) const;
+      size_t keepArenaStrings( size_t begin, size_t count, const uint8_t *keep );
+      template <typename T> void repeatElement( unsigned index, size_t count );
+      void repeatElement( unsigned index, size_t count );
+
+      void checkRemaining( size_t count ) const;
+      void checkConversionAllowed() const;
 
       /// Common routine to check that constructor arguments were ok, throws if not
       void checkState_() const;
@@ -136,13 +239,20 @@ namespace e57
       /// Total number of elements in array
       size_t capacity_ = 0;
 
+      /// See limit()
+      size_t limit_ = SIZE_MAX;
+
       /// Convert memory representation to/from disk representation
       bool doConversion_ = false;
 
       /// Apply scale factor for integer type
       bool doScaling_ = false;
 
-      /// Distance between each element (different from size_ if elements not contiguous)
+      /// See origin(). Only floating point buffers have one.
+      double origin_ = 0.0;
+
+      /// Distance between each element (different from size_ if elements not contiguous), or the
+      /// number of bits in each value for ::Bits
       size_t stride_ = 0;
 
       /// Number of elements that have been set (dest buffer) or read (source buffer) since
@@ -151,5 +261,9 @@ namespace e57
 
       /// Optional array of ustrings (used if memoryRepresentation_ == ::UString)
       StringList *ustrings_ = nullptr;
+
+      /// Optional arena of strings (used instead of ustrings_ if memoryRepresentation_ ==
+      /// ::UString)
+      StringArena *arena_ = nullptr;
    };
 }
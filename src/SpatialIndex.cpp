@@ -0,0 +1,289 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "InterleavedPoints.h"
+#include "SpatialIndex.h"
+
+namespace
+{
+   constexpr char cPrefix[] = "sidx";
+   constexpr char cURI[] = "urn:libE57Format:E57_EXT_chunk_bounds";
+   constexpr char cNodeName[] = "sidx:chunkBounds";
+
+   // Field names in the order of ChunkBounds::bounds
+   constexpr const char *cBoundsNames[] = { "sidx:xMinimum", "sidx:xMaximum", "sidx:yMinimum",
+                                            "sidx:yMaximum", "sidx:zMinimum", "sidx:zMaximum" };
+
+   double *boundsField( e57::CartesianBounds &bounds, size_t index )
+   {
+      double *fields[] = { &bounds.xMinimum, &bounds.xMaximum, &bounds.yMinimum,
+                           &bounds.yMaximum, &bounds.zMinimum, &bounds.zMaximum };
+
+      return fields[index];
+   }
+
+   // Bounds of each run of chunkSize points. getPoint( i, x, y, z ) gets the coordinates of point
+   // i, returning false if they aren't valid.
+   template <typename GetPoint>
+   std::vector<e57::ChunkBounds> chunkBounds( size_t pointCount, size_t chunkSize,
+                                              GetPoint getPoint )
+   {
+      std::vector<e57::ChunkBounds> chunks;
+
+      if ( chunkSize == 0 )
+      {
+         return chunks;
+      }
+
+      for ( size_t start = 0; start < pointCount; start += chunkSize )
+      {
+         const size_t end = std::min( start + chunkSize, pointCount );
+
+         e57::ChunkBounds chunk;
+         chunk.startRecord = static_cast<int64_t>( start );
+         chunk.recordCount = static_cast<int64_t>( end - start );
+
+         e57::CartesianBounds &bounds = chunk.bounds;
+         bool haveValidPoint = false;
+
+         for ( size_t i = start; i < end; ++i )
+         {
+            double x = 0.0;
+            double y = 0.0;
+            double z = 0.0;
+
+            if ( !getPoint( i, x, y, z ) )
+            {
+               continue;
+            }
+
+            if ( !haveValidPoint )
+            {
+               bounds.xMinimum = bounds.xMaximum = x;
+               bounds.yMinimum = bounds.yMaximum = y;
+               bounds.zMinimum = bounds.zMaximum = z;
+
+               haveValidPoint = true;
+               continue;
+            }
+
+            bounds.xMinimum = std::min( bounds.xMinimum, x );
+            bounds.xMaximum = std::max( bounds.xMaximum, x );
+            bounds.yMinimum = std::min( bounds.yMinimum, y );
+            bounds.yMaximum = std::max( bounds.yMaximum, y );
+            bounds.zMinimum = std::min( bounds.zMinimum, z );
+            bounds.zMaximum = std::max( bounds.zMaximum, z );
+         }
+
+         if ( haveValidPoint )
+         {
+            chunks.push_back( chunk );
+         }
+      }
+
+      return chunks;
+   }
+}
+
+namespace e57
+{
+   bool boundsIntersect( const CartesianBounds &a, const CartesianBounds &b )
+   {
+      return ( a.xMinimum <= b.xMaximum ) && ( b.xMinimum <= a.xMaximum ) &&
+             ( a.yMinimum <= b.yMaximum ) && ( b.yMinimum <= a.yMaximum ) &&
+             ( a.zMinimum <= b.zMaximum ) && ( b.zMinimum <= a.zMaximum );
+   }
+
+   template <typename COORDTYPE>
+   std::vector<ChunkBounds> calculateChunkBounds( const Data3DPointsData_t<COORDTYPE> &buffers,
+                                                  size_t pointCount, size_t chunkSize )
+   {
+      if ( ( buffers.cartesianX == nullptr ) || ( buffers.cartesianY == nullptr ) ||
+           ( buffers.cartesianZ == nullptr ) )
+      {
+         return {};
+      }
+
+      return chunkBounds( pointCount, chunkSize,
+                          [&buffers]( size_t i, double &x, double &y, double &z ) {
+                             if ( ( buffers.cartesianInvalidState != nullptr ) &&
+                                  ( buffers.cartesianInvalidState[i] != 0 ) )
+                             {
+                                return false;
+                             }
+
+                             if ( ( buffers.cartesianInvalidStateBits.data != nullptr ) &&
+                                  ( buffers.cartesianInvalidStateBits.get( i ) != 0 ) )
+                             {
+                                return false;
+                             }
+
+                             x = buffers.cartesianX[i];
+                             y = buffers.cartesianY[i];
+                             z = buffers.cartesianZ[i];
+
+                             return true;
+                          } );
+   }
+
+   std::vector<ChunkBounds> calculateChunkBounds( const Data3DPointsInterleaved &points,
+                                                  size_t pointCount, size_t chunkSize )
+   {
+      const Data3DPointField *xField = findField( points, "cartesianX" );
+      const Data3DPointField *yField = findField( points, "cartesianY" );
+      const Data3DPointField *zField = findField( points, "cartesianZ" );
+      const Data3DPointField *invalidField = findField( points, "cartesianInvalidState" );
+
+      if ( ( xField == nullptr ) || ( yField == nullptr ) || ( zField == nullptr ) )
+      {
+         return {};
+      }
+
+      return chunkBounds( pointCount, chunkSize,
+                          [&]( size_t i, double &x, double &y, double &z ) {
+                             if ( ( invalidField != nullptr ) &&
+                                  ( fieldValue( points, *invalidField, i ) != 0.0 ) )
+                             {
+                                return false;
+                             }
+
+                             x = fieldValue( points, *xField, i );
+                             y = fieldValue( points, *yField, i );
+                             z = fieldValue( points, *zField, i );
+
+                             return true;
+                          } );
+   }
+
+   void writeChunkBounds( ImageFile imf, StructureNode &scan,
+                          const std::vector<ChunkBounds> &chunks )
+   {
+      if ( !imf.extensionsLookupPrefix( cPrefix ) )
+      {
+         imf.extensionsAdd( cPrefix, cURI );
+      }
+
+      int64_t maxStartRecord = 0;
+      int64_t maxRecordCount = 0;
+
+      for ( const auto &chunk : chunks )
+      {
+         maxStartRecord = std::max( maxStartRecord, chunk.startRecord );
+         maxRecordCount = std::max( maxRecordCount, chunk.recordCount );
+      }
+
+      StructureNode proto( imf );
+      proto.set( "sidx:startRecord", IntegerNode( imf, 0, 0, maxStartRecord ) );
+      proto.set( "sidx:recordCount", IntegerNode( imf, 0, 0, maxRecordCount ) );
+
+      for ( const char *name : cBoundsNames )
+      {
+         proto.set( name, FloatNode( imf, 0.0, PrecisionDouble ) );
+      }
+
+      VectorNode codecs( imf, true );
+      CompressedVectorNode cv( imf, proto, codecs );
+      scan.set( cNodeName, cv );
+
+      // SourceDestBuffers can't be empty, even if there is nothing to write
+      const size_t cCount = chunks.size();
+      const size_t cCapacity = std::max( cCount, size_t{ 1 } );
+
+      std::vector<int64_t> startRecord( cCapacity );
+      std::vector<int64_t> recordCount( cCapacity );
+      std::vector<std::vector<double>> bounds( 6, std::vector<double>( cCapacity ) );
+
+      for ( size_t i = 0; i < cCount; ++i )
+      {
+         startRecord[i] = chunks[i].startRecord;
+         recordCount[i] = chunks[i].recordCount;
+
+         CartesianBounds chunkBounds = chunks[i].bounds;
+
+         for ( size_t field = 0; field < bounds.size(); ++field )
+         {
+            bounds[field][i] = *boundsField( chunkBounds, field );
+         }
+      }
+
+      std::vector<SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "sidx:startRecord", startRecord.data(), cCapacity, true );
+      sbufs.emplace_back( imf, "sidx:recordCount", recordCount.data(), cCapacity, true );
+
+      for ( size_t field = 0; field < bounds.size(); ++field )
+      {
+         sbufs.emplace_back( imf, cBoundsNames[field], bounds[field].data(), cCapacity );
+      }
+
+      CompressedVectorWriter writer = cv.writer( sbufs );
+
+      if ( cCount > 0 )
+      {
+         writer.write( cCount );
+      }
+
+      writer.close();
+   }
+
+   bool readChunkBounds( ImageFile imf, const StructureNode &scan,
+                         std::vector<ChunkBounds> &chunks )
+   {
+      chunks.clear();
+
+      if ( !scan.isDefined( cNodeName ) )
+      {
+         return false;
+      }
+
+      CompressedVectorNode cv( scan.get( cNodeName ) );
+      const auto cCount = static_cast<size_t>( cv.childCount() );
+
+      if ( cCount == 0 )
+      {
+         return true;
+      }
+
+      std::vector<int64_t> startRecord( cCount );
+      std::vector<int64_t> recordCount( cCount );
+      std::vector<std::vector<double>> bounds( 6, std::vector<double>( cCount ) );
+
+      std::vector<SourceDestBuffer> dbufs;
+      dbufs.emplace_back( imf, "sidx:startRecord", startRecord.data(), cCount, true );
+      dbufs.emplace_back( imf, "sidx:recordCount", recordCount.data(), cCount, true );
+
+      for ( size_t field = 0; field < bounds.size(); ++field )
+      {
+         dbufs.emplace_back( imf, cBoundsNames[field], bounds[field].data(), cCount );
+      }
+
+      CompressedVectorReader reader = cv.reader( dbufs );
+
+      const unsigned cRead = reader.read();
+
+      reader.close();
+
+      chunks.resize( cRead );
+
+      for ( size_t i = 0; i < cRead; ++i )
+      {
+         chunks[i].startRecord = startRecord[i];
+         chunks[i].recordCount = recordCount[i];
+
+         for ( size_t field = 0; field < bounds.size(); ++field )
+         {
+            *boundsField( chunks[i].bounds, field ) = bounds[field][i];
+         }
+      }
+
+      return true;
+   }
+
+   // Explicit template instantiation
+   template std::vector<ChunkBounds> calculateChunkBounds(
+      const Data3DPointsData_t<float> &buffers, size_t pointCount, size_t chunkSize );
+
+   template std::vector<ChunkBounds> calculateChunkBounds(
+      const Data3DPointsData_t<double> &buffers, size_t pointCount, size_t chunkSize );
+}
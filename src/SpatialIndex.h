@@ -0,0 +1,44 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for the chunk bounds extension used by the Simple API. A Data3D may have a
+// "sidx:chunkBounds" CompressedVectorNode holding the cartesian bounds of each run of
+// chunkSize points, so readers can skip the points which can't be in an area of interest.
+
+#include <vector>
+
+#include "E57Format.h"
+#include "E57SimpleData.h"
+
+namespace e57
+{
+   /// The cartesian bounds of the valid points in one run of records.
+   struct ChunkBounds
+   {
+      int64_t startRecord = 0;
+      int64_t recordCount = 0;
+      CartesianBounds bounds;
+   };
+
+   /// Return true if the boxes overlap (touching counts).
+   bool boundsIntersect( const CartesianBounds &a, const CartesianBounds &b );
+
+   /// Calculate the bounds of each run of @a chunkSize points in @a buffers. Points without valid
+   /// cartesian coordinates are ignored, and runs with none at all are left out.
+   template <typename COORDTYPE>
+   std::vector<ChunkBounds> calculateChunkBounds( const Data3DPointsData_t<COORDTYPE> &buffers,
+                                                  size_t pointCount, size_t chunkSize );
+
+   /// @overload
+   std::vector<ChunkBounds> calculateChunkBounds( const Data3DPointsInterleaved &points,
+                                                  size_t pointCount, size_t chunkSize );
+
+   /// Add @a chunks to @a scan (declaring the extension if needed) and write them.
+   void writeChunkBounds( ImageFile imf, StructureNode &scan,
+                          const std::vector<ChunkBounds> &chunks );
+
+   /// Read the chunk bounds of @a scan into @a chunks. Returns false if it doesn't have any.
+   bool readChunkBounds( ImageFile imf, const StructureNode &scan,
+                         std::vector<ChunkBounds> &chunks );
+}
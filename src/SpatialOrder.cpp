@@ -0,0 +1,254 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cstring>
+
+#include "Common.h"
+#include "InterleavedPoints.h"
+#include "SourceDestBufferImpl.h"
+#include "SpatialOrder.h"
+#include "StringFunctions.h"
+
+namespace
+{
+   constexpr unsigned cBitsPerAxis = 21;
+   constexpr uint32_t cAxisMaximum = ( 1U << cBitsPerAxis ) - 1;
+
+   size_t memorySize( e57::MemoryRepresentation type )
+   {
+      using namespace e57;
+
+      switch ( type )
+      {
+         case Int8:
+         case UInt8:
+            return 1;
+         case Int16:
+         case UInt16:
+            return 2;
+         case Int32:
+         case UInt32:
+         case Real32:
+            return 4;
+         case Int64:
+         case Real64:
+            return 8;
+         case Bool:
+            return sizeof( bool );
+         default:
+            // Strings can't be sorted in place
+            throw E57_EXCEPTION2( ErrorNotImplemented, "memoryRepresentation=" + toString( type ) );
+      }
+   }
+
+   // Spread the low 21 bits of value out to every third bit
+   uint64_t spreadBits( uint32_t value )
+   {
+      uint64_t bits = value & cAxisMaximum;
+
+      bits = ( bits | ( bits << 32 ) ) & 0x001f00000000ffffULL;
+      bits = ( bits | ( bits << 16 ) ) & 0x001f0000ff0000ffULL;
+      bits = ( bits | ( bits << 8 ) ) & 0x100f00f00f00f00fULL;
+      bits = ( bits | ( bits << 4 ) ) & 0x10c30c30c30c30c3ULL;
+      bits = ( bits | ( bits << 2 ) ) & 0x1249249249249249ULL;
+
+      return bits;
+   }
+
+   uint64_t mortonKey( uint32_t x, uint32_t y, uint32_t z )
+   {
+      return ( spreadBits( x ) << 2 ) | ( spreadBits( y ) << 1 ) | spreadBits( z );
+   }
+
+   // Skilling's algorithm ("Programming the Hilbert curve", 2004): transform the coordinates so
+   // that interleaving their bits gives the distance along the curve.
+   uint64_t hilbertKey( uint32_t x, uint32_t y, uint32_t z )
+   {
+      uint32_t axes[3] = { x, y, z };
+      constexpr uint32_t cTop = 1U << ( cBitsPerAxis - 1 );
+
+      for ( uint32_t q = cTop; q > 1; q >>= 1 )
+      {
+         const uint32_t p = q - 1;
+
+         for ( auto &axis : axes )
+         {
+            if ( ( axis & q ) != 0 )
+            {
+               axes[0] ^= p;
+            }
+            else
+            {
+               const uint32_t t = ( axes[0] ^ axis ) & p;
+               axes[0] ^= t;
+               axis ^= t;
+            }
+         }
+      }
+
+      axes[1] ^= axes[0];
+      axes[2] ^= axes[1];
+
+      uint32_t t = 0;
+
+      for ( uint32_t q = cTop; q > 1; q >>= 1 )
+      {
+         if ( ( axes[2] & q ) != 0 )
+         {
+            t ^= q - 1;
+         }
+      }
+
+      return mortonKey( axes[0] ^ t, axes[1] ^ t, axes[2] ^ t );
+   }
+}
+
+namespace e57
+{
+   uint64_t spatialOrderKey( SpatialOrder order, uint32_t x, uint32_t y, uint32_t z )
+   {
+      return ( order == SpatialOrder::Hilbert ) ? hilbertKey( x, y, z ) : mortonKey( x, y, z );
+   }
+
+   SpatialOrderStage::SpatialOrderStage( SpatialOrder order,
+                                         const std::vector<SourceDestBuffer> &sourceBuffers,
+                                         size_t chunkSize ) :
+      order_( order )
+   {
+      sources_.reserve( sourceBuffers.size() );
+
+      size_t stride = 0;
+
+      for ( const auto &buffer : sourceBuffers )
+      {
+         Source source;
+         source.size = memorySize( buffer.memoryRepresentation() );
+         source.points.base = buffer.impl()->base();
+         source.points.stride = buffer.stride();
+         source.points.fields.push_back( { buffer.pathName(), buffer.memoryRepresentation(), 0 } );
+
+         sources_.push_back( source );
+
+         // Each field is aligned for its type
+         stride = ( stride + source.size - 1 ) / source.size * source.size;
+
+         points_.fields.push_back( { buffer.pathName(), buffer.memoryRepresentation(), stride } );
+
+         stride += source.size;
+      }
+
+      stride = ( stride + sizeof( double ) - 1 ) / sizeof( double ) * sizeof( double );
+
+      // Use doubles so the memory is aligned for all the types
+      memory_.resize( std::max( stride / sizeof( double ) * chunkSize, size_t{ 1 } ) );
+
+      points_.base = memory_.data();
+      points_.stride = stride;
+
+      x_ = findSource( "cartesianX" );
+      y_ = findSource( "cartesianY" );
+      z_ = findSource( "cartesianZ" );
+      invalid_ = findSource( "cartesianInvalidState" );
+
+      keys_.reserve( chunkSize );
+   }
+
+   bool SpatialOrderStage::canOrder() const
+   {
+      return ( x_ != nullptr ) && ( y_ != nullptr ) && ( z_ != nullptr );
+   }
+
+   const SpatialOrderStage::Source *SpatialOrderStage::findSource( const char *name ) const
+   {
+      for ( const auto &source : sources_ )
+      {
+         if ( source.points.fields.front().name == name )
+         {
+            return &source;
+         }
+      }
+
+      return nullptr;
+   }
+
+   void SpatialOrderStage::stage( size_t start, size_t count )
+   {
+      const auto value = []( const Source &source, size_t index ) {
+         return fieldValue( source.points, source.points.fields.front(), index );
+      };
+
+      const auto valid = [&]( size_t index ) {
+         return ( invalid_ == nullptr ) || ( value( *invalid_, index ) == 0.0 );
+      };
+
+      // Quantize to the bounds of the run's valid points
+      CartesianBounds bounds;
+      bounds.xMinimum = bounds.yMinimum = bounds.zMinimum = DOUBLE_MAX;
+      bounds.xMaximum = bounds.yMaximum = bounds.zMaximum = DOUBLE_MIN;
+
+      for ( size_t i = start; i < start + count; ++i )
+      {
+         if ( valid( i ) )
+         {
+            const double x = value( *x_, i );
+            const double y = value( *y_, i );
+            const double z = value( *z_, i );
+
+            bounds.xMinimum = std::min( bounds.xMinimum, x );
+            bounds.xMaximum = std::max( bounds.xMaximum, x );
+            bounds.yMinimum = std::min( bounds.yMinimum, y );
+            bounds.yMaximum = std::max( bounds.yMaximum, y );
+            bounds.zMinimum = std::min( bounds.zMinimum, z );
+            bounds.zMaximum = std::max( bounds.zMaximum, z );
+         }
+      }
+
+      const auto quantize = []( double coordinate, double minimum, double maximum ) {
+         if ( maximum <= minimum )
+         {
+            return uint32_t{ 0 };
+         }
+
+         const double scaled = ( coordinate - minimum ) / ( maximum - minimum ) * cAxisMaximum;
+
+         return static_cast<uint32_t>( std::min( std::max( scaled, 0.0 ), 1.0 * cAxisMaximum ) );
+      };
+
+      keys_.clear();
+
+      for ( size_t i = start; i < start + count; ++i )
+      {
+         uint64_t key = UINT64_MAX;
+
+         if ( valid( i ) )
+         {
+            key = spatialOrderKey(
+               order_, quantize( value( *x_, i ), bounds.xMinimum, bounds.xMaximum ),
+               quantize( value( *y_, i ), bounds.yMinimum, bounds.yMaximum ),
+               quantize( value( *z_, i ), bounds.zMinimum, bounds.zMaximum ) );
+         }
+
+         keys_.emplace_back( key, i );
+      }
+
+      // Ties keep their order, since the index is compared too
+      std::sort( keys_.begin(), keys_.end() );
+
+      auto *out = reinterpret_cast<char *>( memory_.data() );
+
+      for ( const auto &key : keys_ )
+      {
+         for ( size_t field = 0; field < sources_.size(); ++field )
+         {
+            const Source &source = sources_[field];
+            const char *in =
+               static_cast<const char *>( source.points.base ) + key.second * source.points.stride;
+
+            memcpy( out + points_.fields[field].offset, in, source.size );
+         }
+
+         out += points_.stride;
+      }
+   }
+}
@@ -0,0 +1,65 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for WriterOptions::spatialOrder. Points are copied a run at a time into interleaved
+// points, sorted along a space-filling curve through their cartesian coordinates, and written from
+// there.
+
+#include <vector>
+
+#include "E57SimpleData.h"
+#include "E57SimpleWriter.h"
+
+namespace e57
+{
+   /// Holds one run of points sorted along a curve.
+   class SpatialOrderStage
+   {
+   public:
+      /// Stage up to @a chunkSize of the points in @a sourceBuffers at a time.
+      SpatialOrderStage( SpatialOrder order, const std::vector<SourceDestBuffer> &sourceBuffers,
+                         size_t chunkSize );
+
+      /// Returns false if the points have no cartesian coordinates to sort them by.
+      bool canOrder() const;
+
+      /// The staged points, in the layout used for all of them.
+      const Data3DPointsInterleaved &points() const
+      {
+         return points_;
+      }
+
+      /// Copy the @a count points starting at @a start into points(), sorted. Points without
+      /// valid cartesian coordinates go at the end.
+      void stage( size_t start, size_t count );
+
+   private:
+      /// A source buffer as a single field of interleaved points, so fieldValue() can read it
+      struct Source
+      {
+         Data3DPointsInterleaved points;
+         size_t size = 0;
+      };
+
+      const Source *findSource( const char *name ) const;
+
+      SpatialOrder order_;
+      std::vector<Source> sources_;
+
+      const Source *x_ = nullptr;
+      const Source *y_ = nullptr;
+      const Source *z_ = nullptr;
+      const Source *invalid_ = nullptr;
+
+      std::vector<double> memory_;
+      Data3DPointsInterleaved points_;
+
+      /// Curve position and source index of each staged point
+      std::vector<std::pair<uint64_t, size_t>> keys_;
+   };
+
+   /// Position of a point along @a order with the coordinates quantized to @a x, @a y, and @a z
+   /// (of 21 bits each).
+   uint64_t spatialOrderKey( SpatialOrder order, uint32_t x, uint32_t y, uint32_t z );
+}
@@ -0,0 +1,93 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <initializer_list>
+
+#include "Statistics.h"
+#include "Packet.h"
+
+namespace
+{
+   double toSeconds( const e57::Statistics::Counter &nanoseconds )
+   {
+      return static_cast<double>( nanoseconds.load( std::memory_order_relaxed ) ) * 1.0e-9;
+   }
+}
+
+namespace e57
+{
+   void Statistics::addChannels( std::vector<ChannelStatistics> &channels )
+   {
+      std::lock_guard<std::mutex> lock( channelsMutex_ );
+
+      for ( auto &channel : channels )
+      {
+         auto &total = channels_[channel.pathName];
+
+         total.pathName = channel.pathName;
+         total.packetsDecoded += channel.packetsDecoded;
+         total.recordsRead += channel.recordsRead;
+
+         channel.packetsDecoded = 0;
+         channel.recordsRead = 0;
+      }
+   }
+
+   ImageFileStatistics Statistics::snapshot() const
+   {
+      ImageFileStatistics statistics;
+
+#ifdef E57_ENABLE_STATISTICS
+      statistics.enabled = true;
+#endif
+
+      statistics.bytesRead = bytesRead.load( std::memory_order_relaxed );
+      statistics.pagesRead = pagesRead.load( std::memory_order_relaxed );
+      statistics.bytesWritten = bytesWritten.load( std::memory_order_relaxed );
+      statistics.pagesWritten = pagesWritten.load( std::memory_order_relaxed );
+      statistics.checksumsVerified = checksumsVerified.load( std::memory_order_relaxed );
+      statistics.packetCacheHits = packetCacheHits.load( std::memory_order_relaxed );
+      statistics.packetCacheMisses = packetCacheMisses.load( std::memory_order_relaxed );
+      statistics.sharedPacketCacheHits = sharedPacketCacheHits.load( std::memory_order_relaxed );
+      statistics.dataPacketsWritten = dataPacketsWritten.load( std::memory_order_relaxed );
+      statistics.dataPacketBytesWritten = dataPacketBytesWritten.load( std::memory_order_relaxed );
+
+      if ( statistics.dataPacketsWritten > 0 )
+      {
+         statistics.dataPacketFillRatio =
+            static_cast<double>( statistics.dataPacketBytesWritten ) /
+            ( static_cast<double>( statistics.dataPacketsWritten ) * DATA_PACKET_MAX );
+      }
+
+      statistics.xmlParseSeconds = toSeconds( xmlParseNanoseconds );
+      statistics.decodeSeconds = toSeconds( decodeNanoseconds );
+      statistics.ioSeconds = toSeconds( ioNanoseconds );
+
+      std::lock_guard<std::mutex> lock( channelsMutex_ );
+
+      statistics.channels.reserve( channels_.size() );
+
+      for ( const auto &channel : channels_ )
+      {
+         statistics.channels.push_back( channel.second );
+      }
+
+      return statistics;
+   }
+
+   void Statistics::reset()
+   {
+      for ( Counter *counter :
+            { &bytesRead, &pagesRead, &bytesWritten, &pagesWritten, &checksumsVerified,
+              &packetCacheHits, &packetCacheMisses, &sharedPacketCacheHits, &dataPacketsWritten,
+              &dataPacketBytesWritten, &xmlParseNanoseconds, &decodeNanoseconds,
+              &ioNanoseconds } )
+      {
+         counter->store( 0, std::memory_order_relaxed );
+      }
+
+      std::lock_guard<std::mutex> lock( channelsMutex_ );
+
+      channels_.clear();
+   }
+}
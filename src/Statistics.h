@@ -0,0 +1,85 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for ImageFile::statistics(). The counters are only updated if built with
+// E57_ENABLE_STATISTICS, so code which updates them is wrapped in #ifdef E57_ENABLE_STATISTICS.
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+#include "E57Format.h"
+
+namespace e57
+{
+   /// The counters behind ImageFileStatistics for one ImageFile. Any thread may update them.
+   class Statistics
+   {
+   public:
+      using Counter = std::atomic<uint64_t>;
+
+      /// Add @a amount to @a counter. The counters are independent, so no ordering is needed.
+      static void add( Counter &counter, uint64_t amount = 1 )
+      {
+         counter.fetch_add( amount, std::memory_order_relaxed );
+      }
+
+      /// Add the packets decoded and records read for each channel of a reader. The counts of
+      /// @a channels are set to zero.
+      void addChannels( std::vector<ChannelStatistics> &channels );
+
+      ImageFileStatistics snapshot() const;
+      void reset();
+
+      Counter bytesRead{ 0 };
+      Counter pagesRead{ 0 };
+      Counter bytesWritten{ 0 };
+      Counter pagesWritten{ 0 };
+      Counter checksumsVerified{ 0 };
+      Counter packetCacheHits{ 0 };
+      Counter packetCacheMisses{ 0 };
+      Counter sharedPacketCacheHits{ 0 };
+      Counter dataPacketsWritten{ 0 };
+      Counter dataPacketBytesWritten{ 0 };
+
+      Counter xmlParseNanoseconds{ 0 };
+      Counter decodeNanoseconds{ 0 };
+      Counter ioNanoseconds{ 0 };
+
+   private:
+      mutable std::mutex channelsMutex_;
+      std::map<ustring, ChannelStatistics> channels_;
+   };
+
+   /// Adds the time from its construction to its destruction to a counter, if it has one.
+   class StatisticsTimer
+   {
+   public:
+      explicit StatisticsTimer( Statistics::Counter *nanoseconds ) :
+         nanoseconds_( nanoseconds ), start_( std::chrono::steady_clock::now() )
+      {
+      }
+
+      ~StatisticsTimer()
+      {
+         if ( nanoseconds_ != nullptr )
+         {
+            const auto elapsed = std::chrono::steady_clock::now() - start_;
+
+            Statistics::add(
+               *nanoseconds_, static_cast<uint64_t>(
+                                 std::chrono::duration_cast<std::chrono::nanoseconds>( elapsed )
+                                    .count() ) );
+         }
+      }
+
+      StatisticsTimer( const StatisticsTimer & ) = delete;
+      StatisticsTimer &operator=( const StatisticsTimer & ) = delete;
+
+   private:
+      Statistics::Counter *nanoseconds_;
+      std::chrono::steady_clock::time_point start_;
+   };
+}
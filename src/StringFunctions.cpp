@@ -9,10 +9,18 @@ namespace e57
    {
       static_assert( std::is_floating_point<FTYPE>::value, "Floating point type required." );
 
-      std::stringstream ss;
-      ss.imbue( std::locale::classic() );
+      // Constructing and imbuing a stream costs more than formatting, so reuse one per thread
+      thread_local std::ostringstream ss = [] {
+         std::ostringstream stream;
+         stream.imbue( std::locale::classic() );
+         stream << std::scientific;
+         return stream;
+      }();
 
-      ss << std::scientific << std::setprecision( precision ) << value;
+      ss.str( std::string() );
+      ss.clear();
+
+      ss << std::setprecision( precision ) << value;
 
       // Try to remove trailing zeroes and decimal point
       // e.g. 1.23456000000000000e+005  ==> 1.23456e+005
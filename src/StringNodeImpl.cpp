@@ -90,7 +90,7 @@ namespace e57
       }
       else
       {
-         fieldName = elementName_;
+         fieldName = elementNameRef();
       }
 
       cf << space( indent ) << "<" << fieldName << " type=\"String\"";
@@ -34,12 +34,30 @@
 
 using namespace e57;
 
+namespace
+{
+   /// Number of children at which StructureNodeImpl starts indexing them by name
+   constexpr size_t cChildIndexThreshold = 8;
+}
+
 StructureNodeImpl::StructureNodeImpl( ImageFileImplWeakPtr destImageFile ) :
    NodeImpl( destImageFile )
 {
    checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
 }
 
+StructureNodeImpl::~StructureNodeImpl()
+{
+   // XML which was never parsed isn't held any more
+   if ( isDeferred_.load( std::memory_order_relaxed ) )
+   {
+      if ( ImageFileImplSharedPtr imf = destImageFile_.lock() )
+      {
+         imf->memoryAccount()->release( MemoryAccount::Xml, deferredXml_.size() );
+      }
+   }
+}
+
 NodeType StructureNodeImpl::type() const
 {
    // don't checkImageFileOpen
@@ -60,6 +78,9 @@ bool StructureNodeImpl::isTypeEquivalent( NodeImplSharedPtr ni )
    // Downcast to shared_ptr<StructureNodeImpl>
    std::shared_ptr<StructureNodeImpl> si( std::static_pointer_cast<StructureNodeImpl>( ni ) );
 
+   loadDeferredChildren();
+   si->loadDeferredChildren();
+
    // Same number of children?
    if ( childCount() != si->childCount() )
    {
@@ -69,9 +90,9 @@ bool StructureNodeImpl::isTypeEquivalent( NodeImplSharedPtr ni )
    // Check each child is equivalent
    for ( unsigned i = 0; i < childCount(); i++ )
    { //??? vector iterator?
-      ustring myChildsFieldName = children_.at( i )->elementName();
+      const ustring &myChildsFieldName = children_.at( i )->elementNameRef();
       // Check if matching field name is in same position (to speed things up)
-      if ( myChildsFieldName == si->children_.at( i )->elementName() )
+      if ( children_.at( i )->hasSameElementName( *si->children_.at( i ) ) )
       {
          if ( !children_.at( i )->isTypeEquivalent( si->children_.at( i ) ) )
          {
@@ -108,7 +129,8 @@ void StructureNodeImpl::setAttachedRecursive()
    // Mark this node as attached to an ImageFile
    isAttached_ = true;
 
-   // Not a leaf node, so mark all our children
+   // Not a leaf node, so mark all our children. Children which are parsed later are marked when
+   // they are added.
    for ( auto &child : children_ )
    {
       child->setAttachedRecursive();
@@ -118,6 +140,7 @@ void StructureNodeImpl::setAttachedRecursive()
 int64_t StructureNodeImpl::childCount() const
 {
    checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+   loadDeferredChildren();
 
    return children_.size();
 }
@@ -125,6 +148,8 @@ int64_t StructureNodeImpl::childCount() const
 NodeImplSharedPtr StructureNodeImpl::get( int64_t index )
 {
    checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+   loadDeferredChildren();
+
    if ( index < 0 || index >= static_cast<int64_t>( children_.size() ) )
    { // %%% Possible truncation on platforms where size_t = uint64
       throw E57_EXCEPTION2( ErrorChildIndexOutOfBounds,
@@ -150,7 +175,19 @@ NodeImplSharedPtr StructureNodeImpl::get( const ustring &pathName )
 NodeImplSharedPtr StructureNodeImpl::lookup( const ustring &pathName )
 {
    // don't checkImageFileOpen
-   //??? use lookup(fields, level) instead, for speed.
+   loadDeferredChildren();
+
+   // Most lookups are of one of our children by name, which doesn't need the path parsed. A
+   // name which isn't found is parsed below so bad names are still reported.
+   if ( pathName.find( '/' ) == ustring::npos )
+   {
+      NodeImplSharedPtr child( findChild( pathName ) );
+      if ( child )
+      {
+         return child;
+      }
+   }
+
    bool isRelative;
    std::vector<ustring> fields;
    ImageFileImplSharedPtr imf( destImageFile_ );
@@ -169,44 +206,87 @@ NodeImplSharedPtr StructureNodeImpl::lookup( const ustring &pathName )
          return ( root );
       }
 
-      // Find child with elementName that matches first field in path
-      unsigned i;
-      for ( i = 0; i < children_.size(); i++ )
-      {
-         if ( fields.at( 0 ) == children_.at( i )->elementName() )
-         {
-            break;
-         }
-      }
-      if ( i == children_.size() )
+      return lookupFields( fields, 0 );
+   }
+
+   // Absolute pathname and we aren't at the root
+   // Find root of the tree
+   NodeImplSharedPtr root( getRoot() );
+
+   // Call lookup on root
+   return ( root->lookup( pathName ) );
+}
+
+NodeImplSharedPtr StructureNodeImpl::lookupFields( const StringList &fields, size_t level )
+{
+   // don't checkImageFileOpen
+   loadDeferredChildren();
+
+   // Find child with elementName that matches this field in path
+   NodeImplSharedPtr child( findChild( fields.at( level ) ) );
+
+   if ( !child || ( level == fields.size() - 1 ) )
+   {
+      return child;
+   }
+
+   // Only Structures and Vectors (which are Structures underneath) have children to look in
+   if ( ( child->type() != TypeStructure ) && ( child->type() != TypeVector ) )
+   {
+      return {}; // empty pointer
+   }
+
+   return std::static_pointer_cast<StructureNodeImpl>( child )->lookupFields( fields, level + 1 );
+}
+
+NodeImplSharedPtr StructureNodeImpl::findChild( const ustring &elementName ) const
+{
+   // don't checkImageFileOpen
+   if ( !childIndex_.empty() )
+   {
+      const auto found = childIndex_.find( std::cref( elementName ) );
+
+      if ( found == childIndex_.end() )
       {
          return {}; // empty pointer
       }
 
-      if ( fields.size() == 1 )
+      return children_[found->second];
+   }
+
+   for ( const auto &child : children_ )
+   {
+      if ( elementName == child->elementNameRef() )
       {
-         return ( children_.at( i ) );
+         return child;
       }
-
-      //??? use level here rather than unparse
-      // Remove first field in path
-      fields.erase( fields.begin() );
-
-      // Call lookup on child object with remaining fields in path name
-      return children_.at( i )->lookup( imf->pathNameUnparse( true, fields ) );
    }
 
-   // Absolute pathname and we aren't at the root
-   // Find root of the tree
-   NodeImplSharedPtr root( getRoot() );
+   return {}; // empty pointer
+}
 
-   // Call lookup on root
-   return ( root->lookup( pathName ) );
+void StructureNodeImpl::addChild( const NodeImplSharedPtr &ni )
+{
+   // don't checkImageFileOpen
+   children_.push_back( ni );
+
+   if ( !childIndex_.empty() )
+   {
+      childIndex_.emplace( std::cref( ni->elementNameRef() ), children_.size() - 1 );
+   }
+   else if ( children_.size() >= cChildIndexThreshold )
+   {
+      for ( size_t i = 0; i < children_.size(); ++i )
+      {
+         childIndex_.emplace( std::cref( children_[i]->elementNameRef() ), i );
+      }
+   }
 }
 
 void StructureNodeImpl::set( int64_t index64, NodeImplSharedPtr ni )
 {
    checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+   loadDeferredChildren();
 
    auto index = static_cast<unsigned>( index64 );
 
@@ -246,7 +326,7 @@ void StructureNodeImpl::set( int64_t index64, NodeImplSharedPtr ni )
    }
 
    ni->setParent( shared_from_this(), elementName.str() );
-   children_.push_back( ni );
+   addChild( ni );
 }
 
 void StructureNodeImpl::set( const ustring &pathName, NodeImplSharedPtr ni, bool autoPathCreate )
@@ -292,6 +372,8 @@ void StructureNodeImpl::set( const std::vector<ustring> &fields, unsigned level,
 #endif
 
    checkImageFileOpen( __FILE__, __LINE__, static_cast<const char *>( __FUNCTION__ ) );
+   loadDeferredChildren();
+
    //??? check if field is numeric string (e.g. "17"), verify number is same as
    // index, else throw
    // bad_path
@@ -302,23 +384,21 @@ void StructureNodeImpl::set( const std::vector<ustring> &fields, unsigned level,
       throw E57_EXCEPTION2( ErrorSetTwice, "this->pathName=" + this->pathName() + " element=/" );
    }
 
-   // Serial search for matching field name, if find match, have error since can't set twice
-   for ( auto &child : children_ )
+   // Search for matching field name, if find match, have error since can't set twice
+   NodeImplSharedPtr existing( findChild( fields.at( level ) ) );
+   if ( existing )
    {
-      if ( fields.at( level ) == child->elementName() )
+      if ( level == fields.size() - 1 )
       {
-         if ( level == fields.size() - 1 )
-         {
-            // Enforce "set once" policy, don't allow reset
-            throw E57_EXCEPTION2( ErrorSetTwice, "this->pathName=" + this->pathName() +
-                                                    " element=" + fields[level] );
-         }
+         // Enforce "set once" policy, don't allow reset
+         throw E57_EXCEPTION2( ErrorSetTwice, "this->pathName=" + this->pathName() +
+                                                 " element=" + fields[level] );
+      }
 
-         // Recurse on child
-         child->set( fields, level + 1, ni );
+      // Recurse on child
+      existing->set( fields, level + 1, ni );
 
-         return;
-      }
+      return;
    }
    // Didn't find matching field name, so have a new child.
 
@@ -333,7 +413,7 @@ void StructureNodeImpl::set( const std::vector<ustring> &fields, unsigned level,
    {
       // At bottom, so append node at end of children
       ni->setParent( shared_from_this(), fields.at( level ) );
-      children_.push_back( ni );
+      addChild( ni );
    }
    else
    {
@@ -369,6 +449,7 @@ void StructureNodeImpl::append( NodeImplSharedPtr ni )
 void StructureNodeImpl::checkLeavesInSet( const StringSet &pathNames, NodeImplSharedPtr origin )
 {
    // don't checkImageFileOpen
+   loadDeferredChildren();
 
    // Not a leaf node, so check all our children
    for ( auto &child : children_ )
@@ -382,6 +463,7 @@ void StructureNodeImpl::writeXml( ImageFileImplSharedPtr imf, CheckedFile &cf, i
                                   const char *forcedFieldName )
 {
    // don't checkImageFileOpen
+   loadDeferredChildren();
 
    ustring fieldName;
    if ( forcedFieldName != nullptr )
@@ -390,7 +472,7 @@ void StructureNodeImpl::writeXml( ImageFileImplSharedPtr imf, CheckedFile &cf, i
    }
    else
    {
-      fieldName = elementName_;
+      fieldName = elementNameRef();
    }
 
    cf << space( indent ) << "<" << fieldName << " type=\"Structure\"";
@@ -454,6 +536,8 @@ void StructureNodeImpl::writeXml( ImageFileImplSharedPtr imf, CheckedFile &cf, i
 void StructureNodeImpl::dump( int indent, std::ostream &os ) const
 {
    // don't checkImageFileOpen
+   loadDeferredChildren();
+
    os << space( indent ) << "type:        Structure" << " (" << type() << ")" << std::endl;
    NodeImpl::dump( indent, os );
    for ( unsigned i = 0; i < children_.size(); i++ )
@@ -463,3 +547,60 @@ void StructureNodeImpl::dump( int indent, std::ostream &os ) const
    }
 }
 #endif
+
+void StructureNodeImpl::setDeferredXml( std::string xml )
+{
+   // don't checkImageFileOpen
+   deferredXml_ = std::move( xml );
+   isDeferred_ = true;
+
+   if ( ImageFileImplSharedPtr imf = destImageFile_.lock() )
+   {
+      imf->memoryAccount()->add( MemoryAccount::Xml, deferredXml_.size() );
+   }
+}
+
+void StructureNodeImpl::loadDeferredChildren() const
+{
+   // don't checkImageFileOpen
+   if ( !isDeferred_.load( std::memory_order_acquire ) )
+   {
+      return;
+   }
+
+   ImageFileImplSharedPtr imf( destImageFile_ );
+   std::lock_guard<std::recursive_mutex> lock( imf->deferredXmlMutex_ );
+
+   // Another thread may have parsed them while we waited. The parser adds the children using
+   // set(), which brings us back here on this thread while they are being parsed.
+   if ( !isDeferred_.load( std::memory_order_relaxed ) || isLoadingDeferred_ )
+   {
+      return;
+   }
+
+   auto self = std::const_pointer_cast<StructureNodeImpl>(
+      std::static_pointer_cast<const StructureNodeImpl>( shared_from_this() ) );
+
+   isLoadingDeferred_ = true;
+
+   try
+   {
+      imf->loadDeferredXml( self, deferredXml_ );
+   }
+   catch ( ... )
+   {
+      // Leave it to be tried again
+      self->children_.clear();
+      self->childIndex_.clear();
+      isLoadingDeferred_ = false;
+
+      throw;
+   }
+
+   isLoadingDeferred_ = false;
+
+   imf->memoryAccount()->release( MemoryAccount::Xml, deferredXml_.size() );
+   deferredXml_ = std::string();
+
+   isDeferred_.store( false, std::memory_order_release );
+}
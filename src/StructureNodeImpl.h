@@ -27,6 +27,10 @@
 
 #pragma once
 
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+
 #include "NodeImpl.h"
 
 namespace e57
@@ -36,7 +40,7 @@ namespace e57
    {
    public:
       explicit StructureNodeImpl( ImageFileImplWeakPtr destImageFile );
-      ~StructureNodeImpl() override = default;
+      ~StructureNodeImpl() override;
 
       NodeType type() const override;
       bool isTypeEquivalent( NodeImplSharedPtr ni ) override;
@@ -55,6 +59,10 @@ namespace e57
                 bool autoPathCreate = false ) override;
       virtual void append( NodeImplSharedPtr ni );
 
+      /// Keep the XML of our children to parse the first time they are needed (see
+      /// ImageFileOptions::lazyLoadXml).
+      void setDeferredXml( std::string xml );
+
       void checkLeavesInSet( const StringSet &pathNames, NodeImplSharedPtr origin ) override;
 
       void writeXml( ImageFileImplSharedPtr imf, CheckedFile &cf, int indent,
@@ -69,6 +77,30 @@ namespace e57
 
       NodeImplSharedPtr lookup( const ustring &pathName ) override;
 
+      /// Look up @a fields from @a level on, starting at this node.
+      NodeImplSharedPtr lookupFields( const StringList &fields, size_t level );
+
+      /// Return the child named @a elementName, or an empty pointer.
+      NodeImplSharedPtr findChild( const ustring &elementName ) const;
+
+      /// Append @a ni (which has already had its parent set) to our children.
+      void addChild( const NodeImplSharedPtr &ni );
+
+      /// Parse our children if setDeferredXml() was used and they haven't been yet.
+      void loadDeferredChildren() const;
+
       std::vector<NodeImplSharedPtr> children_;
+
+      /// Index of each of children_ by element name. Only built once there are enough children
+      /// for it to be faster than searching them.
+      std::unordered_map<std::reference_wrapper<const ustring>, size_t, std::hash<ustring>,
+                         std::equal_to<ustring>>
+         childIndex_;
+
+      /// XML of our children until they are parsed. Guarded by the ImageFileImpl's
+      /// deferredXmlMutex_.
+      mutable std::string deferredXml_;
+      mutable std::atomic<bool> isDeferred_{ false };
+      mutable bool isLoadingDeferred_ = false;
    };
 }
@@ -0,0 +1,111 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "Common.h"
+#include "TaskQueue.h"
+
+namespace e57
+{
+   TaskQueue::TaskQueue( const std::shared_ptr<Executor> &executor ) :
+      state_( std::make_shared<State>() )
+   {
+      state_->executor =
+         ( executor != nullptr ) ? executor : WorkStealingExecutor::defaultExecutor();
+   }
+
+   TaskQueue::~TaskQueue()
+   {
+      wait();
+   }
+
+   void TaskQueue::post( std::function<void()> task )
+   {
+      std::unique_lock<std::mutex> lock( state_->mutex );
+
+      state_->tasks.push_back( std::move( task ) );
+
+      if ( !state_->scheduled && !state_->running )
+      {
+         state_->scheduled = true;
+
+         lock.unlock();
+         schedule( state_ );
+      }
+   }
+
+   void TaskQueue::wait( size_t maxPending )
+   {
+      std::unique_lock<std::mutex> lock( state_->mutex );
+
+      if ( state_->running && ( state_->runner == std::this_thread::get_id() ) )
+      {
+         return;
+      }
+
+      for ( ;; )
+      {
+         const size_t pending = state_->tasks.size() + ( state_->running ? 1 : 0 );
+
+         if ( pending <= maxPending )
+         {
+            break;
+         }
+
+         if ( state_->running )
+         {
+            state_->taskDone.wait( lock );
+         }
+         else
+         {
+            runNext( *state_, lock );
+         }
+      }
+
+      // The executor's task stops while we run them, so hand it the rest again
+      if ( !state_->tasks.empty() && !state_->running && !state_->scheduled )
+      {
+         state_->scheduled = true;
+
+         lock.unlock();
+         schedule( state_ );
+      }
+   }
+
+   void TaskQueue::schedule( const std::shared_ptr<State> &state )
+   {
+      state->executor->execute( [state] { runTasks( state, 0 ); } );
+   }
+
+   // Run the queued tasks until no more than maxPending are left. If a waiter is running one,
+   // leave them to it, since it schedules the rest when it stops.
+   void TaskQueue::runTasks( const std::shared_ptr<State> &state, size_t maxPending )
+   {
+      std::unique_lock<std::mutex> lock( state->mutex );
+
+      state->scheduled = false;
+
+      while ( !state->running && ( state->tasks.size() > maxPending ) )
+      {
+         runNext( *state, lock );
+      }
+   }
+
+   // Run the oldest task. Called with the lock held and nothing running, and returns with it held.
+   void TaskQueue::runNext( State &state, std::unique_lock<std::mutex> &lock )
+   {
+      std::function<void()> task = std::move( state.tasks.front() );
+      state.tasks.pop_front();
+
+      state.running = true;
+      state.runner = std::this_thread::get_id();
+
+      lock.unlock();
+      task();
+      lock.lock();
+
+      state.running = false;
+      state.runner = std::thread::id();
+
+      state.taskDone.notify_all();
+   }
+}
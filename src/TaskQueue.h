@@ -0,0 +1,62 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace e57
+{
+   class Executor;
+
+   /// Runs tasks one after another, in the order they were posted, on an Executor. Any number of
+   /// queues share its threads, but the tasks of one queue never run at the same time, so each
+   /// may use whatever the queue's owner uses without locking.
+   class TaskQueue
+   {
+   public:
+      /// @param executor Where the tasks run. nullptr uses
+      /// WorkStealingExecutor::defaultExecutor().
+      explicit TaskQueue( const std::shared_ptr<Executor> &executor = nullptr );
+
+      /// Waits for the tasks already posted.
+      ~TaskQueue();
+
+      TaskQueue( const TaskQueue & ) = delete;
+      TaskQueue &operator=( const TaskQueue & ) = delete;
+
+      /// Queue @a task to run after the ones already posted. It must not throw.
+      void post( std::function<void()> task );
+
+      /// Wait until no more than @a maxPending of the tasks posted are still to finish. Tasks
+      /// which haven't started yet are run on the calling thread instead of waiting for the
+      /// executor. Returns straight away when called from one of the queue's own tasks, since it
+      /// would otherwise wait for itself.
+      void wait( size_t maxPending = 0 );
+
+   private:
+      /// What the executor's tasks use, so a task may destroy its queue
+      struct State
+      {
+         std::shared_ptr<Executor> executor;
+
+         std::mutex mutex; // protects everything below
+         std::condition_variable taskDone;
+         std::deque<std::function<void()>> tasks;
+         bool running = false;   // one of the tasks is running
+         bool scheduled = false; // the executor has been given a task to run them
+         std::thread::id runner;
+      };
+
+      static void schedule( const std::shared_ptr<State> &state );
+      static void runTasks( const std::shared_ptr<State> &state, size_t maxPending );
+      static void runNext( State &state, std::unique_lock<std::mutex> &lock );
+
+      std::shared_ptr<State> state_;
+   };
+}
@@ -0,0 +1,144 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <vector>
+
+#include "Common.h"
+#include "Tracing.h"
+
+namespace
+{
+   struct Event
+   {
+      const char *name;
+      uint32_t threadId;
+      int64_t startNanoseconds; // since the trace started
+      int64_t durationNanoseconds;
+      uint64_t bytes;
+   };
+
+   std::mutex sEventsMutex;
+   std::vector<Event> sEvents;
+   std::chrono::steady_clock::time_point sOrigin;
+
+   std::atomic<uint32_t> sNextThreadId{ 1 };
+
+   // Small numbers are easier to read on the timeline than std::thread::id hashes
+   uint32_t currentThreadId()
+   {
+      thread_local const uint32_t threadId = sNextThreadId++;
+
+      return threadId;
+   }
+
+   int64_t toNanoseconds( std::chrono::steady_clock::duration duration )
+   {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>( duration ).count();
+   }
+
+   // Chrome trace timestamps are in microseconds
+   void writeMicroseconds( std::ostream &stream, int64_t nanoseconds )
+   {
+      char buffer[32];
+      std::snprintf( buffer, sizeof( buffer ), "%.3f",
+                     static_cast<double>( nanoseconds ) / 1000.0 );
+
+      stream << buffer;
+   }
+}
+
+namespace e57
+{
+   namespace Tracing
+   {
+      std::atomic<bool> recording{ false };
+
+      void record( const char *name, std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point end, uint64_t bytes )
+      {
+         const uint32_t threadId = currentThreadId();
+
+         std::lock_guard<std::mutex> lock( sEventsMutex );
+
+         // An event which started before start() was called is dropped
+         if ( start < sOrigin )
+         {
+            return;
+         }
+
+         sEvents.push_back( { name, threadId, toNanoseconds( start - sOrigin ),
+                              toNanoseconds( end - start ), bytes } );
+      }
+
+      bool start()
+      {
+#ifdef E57_ENABLE_TRACING
+         {
+            std::lock_guard<std::mutex> lock( sEventsMutex );
+
+            sEvents.clear();
+            sOrigin = std::chrono::steady_clock::now();
+         }
+
+         recording = true;
+
+         return true;
+#else
+         return false;
+#endif
+      }
+
+      void stop( const ustring &fileName )
+      {
+         recording = false;
+
+         std::vector<Event> events;
+         {
+            std::lock_guard<std::mutex> lock( sEventsMutex );
+
+            events.swap( sEvents );
+         }
+
+         std::ofstream stream( fileName, std::ios::out | std::ios::trunc );
+
+         if ( !stream.is_open() )
+         {
+            throw E57_EXCEPTION2( ErrorOpenFailed, "fileName=" + fileName );
+         }
+
+         stream << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+         bool first = true;
+
+         for ( const auto &event : events )
+         {
+            stream << ( first ? "\n" : ",\n" ) << R"({"name":")" << event.name
+                   << R"(","cat":"e57","ph":"X","pid":1,"tid":)" << event.threadId << R"(,"ts":)";
+            writeMicroseconds( stream, event.startNanoseconds );
+            stream << R"(,"dur":)";
+            writeMicroseconds( stream, event.durationNanoseconds );
+
+            if ( event.bytes != 0 )
+            {
+               stream << R"(,"args":{"bytes":)" << event.bytes << "}";
+            }
+
+            stream << "}";
+
+            first = false;
+         }
+
+         stream << "\n]}\n";
+
+         stream.close();
+
+         if ( stream.fail() )
+         {
+            throw E57_EXCEPTION2( ErrorWriteFailed, "fileName=" + fileName );
+         }
+      }
+   }
+}
@@ -0,0 +1,55 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for e57::Tracing. Events are only recorded if built with E57_ENABLE_TRACING, so code
+// which records them is wrapped in #ifdef E57_ENABLE_TRACING.
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace e57
+{
+   namespace Tracing
+   {
+      /// Set between Tracing::start() and Tracing::stop()
+      extern std::atomic<bool> recording;
+
+      /// Add a complete event to the trace. @a name must be a string literal.
+      void record( const char *name, std::chrono::steady_clock::time_point start,
+                   std::chrono::steady_clock::time_point end, uint64_t bytes );
+   }
+
+   /// Records an event from its construction to its destruction, if tracing is on.
+   /// @a bytes (if not zero) is shown with the event.
+   class TraceScope
+   {
+   public:
+      explicit TraceScope( const char *name, uint64_t bytes = 0 ) :
+         name_( Tracing::recording.load( std::memory_order_relaxed ) ? name : nullptr ),
+         bytes_( bytes )
+      {
+         if ( name_ != nullptr )
+         {
+            start_ = std::chrono::steady_clock::now();
+         }
+      }
+
+      ~TraceScope()
+      {
+         if ( name_ != nullptr )
+         {
+            Tracing::record( name_, start_, std::chrono::steady_clock::now(), bytes_ );
+         }
+      }
+
+      TraceScope( const TraceScope & ) = delete;
+      TraceScope &operator=( const TraceScope & ) = delete;
+
+   private:
+      const char *name_;
+      uint64_t bytes_;
+      std::chrono::steady_clock::time_point start_;
+   };
+}
@@ -0,0 +1,328 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "UringReadSource.h"
+
+#if defined( E57_ENABLE_IO_URING ) && defined( __linux__ )
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "StringFunctions.h"
+
+namespace
+{
+   // Most reads a ring has in flight at once
+   constexpr unsigned cRingEntries = 64;
+
+   template <typename T> T *ringPointer( void *base, uint32_t offset )
+   {
+      return reinterpret_cast<T *>( static_cast<char *>( base ) + offset );
+   }
+
+   // The kernel and this process both update the ring indices
+   inline uint32_t loadAcquire( const uint32_t *index )
+   {
+      return __atomic_load_n( index, __ATOMIC_ACQUIRE );
+   }
+
+   inline void storeRelease( uint32_t *index, uint32_t value )
+   {
+      __atomic_store_n( index, value, __ATOMIC_RELEASE );
+   }
+}
+
+namespace e57
+{
+   /// One io_uring instance, used by one thread at a time
+   class UringReadSource::Ring
+   {
+   public:
+      /// Returns nullptr if the ring can't be set up
+      static std::unique_ptr<Ring> create()
+      {
+         std::unique_ptr<Ring> ring( new Ring );
+
+         if ( !ring->setUp() )
+         {
+            return nullptr;
+         }
+
+         return ring;
+      }
+
+      ~Ring()
+      {
+         if ( sqes_ != nullptr )
+         {
+            ::munmap( sqes_, sqesSize_ );
+         }
+
+         if ( cqRing_ != nullptr && cqRing_ != sqRing_ )
+         {
+            ::munmap( cqRing_, cqRingSize_ );
+         }
+
+         if ( sqRing_ != nullptr )
+         {
+            ::munmap( sqRing_, sqRingSize_ );
+         }
+
+         if ( ringFd_ >= 0 )
+         {
+            ::close( ringFd_ );
+         }
+      }
+
+      Ring( const Ring & ) = delete;
+      Ring &operator=( const Ring & ) = delete;
+
+      /// Submit up to cRingEntries reads and wait for all of them. Sets bytesRead[i] to the number
+      /// of bytes read for ranges[i], or to -errno.
+      void read( int fd, const ReadSource::Range *ranges, size_t count,
+                 std::vector<int64_t> &bytesRead )
+      {
+         bytesRead.assign( count, 0 );
+
+         uint32_t tail = *sqTail_;
+
+         for ( size_t i = 0; i < count; ++i )
+         {
+            const uint32_t index = tail & *sqMask_;
+
+            io_uring_sqe &sqe = sqes_[index];
+            memset( &sqe, 0, sizeof( sqe ) );
+
+            sqe.opcode = IORING_OP_READ;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<uint64_t>( ranges[i].buffer );
+            sqe.len = static_cast<uint32_t>( ranges[i].count );
+            sqe.off = ranges[i].offset;
+            sqe.user_data = i;
+
+            sqArray_[index] = index;
+            ++tail;
+         }
+
+         storeRelease( sqTail_, tail );
+
+         size_t toSubmit = count;
+         size_t completed = 0;
+
+         while ( completed < count )
+         {
+            const long result =
+               ::syscall( __NR_io_uring_enter, ringFd_, static_cast<unsigned>( toSubmit ), 1U,
+                          IORING_ENTER_GETEVENTS, nullptr, 0 );
+
+            if ( result < 0 )
+            {
+               if ( errno == EINTR )
+               {
+                  continue;
+               }
+
+               throw E57_EXCEPTION2( ErrorReadFailed, "io_uring_enter errno=" + toString( errno ) );
+            }
+
+            toSubmit -= std::min( toSubmit, static_cast<size_t>( result ) );
+
+            uint32_t head = *cqHead_;
+            const uint32_t cqTail = loadAcquire( cqTail_ );
+
+            while ( head != cqTail )
+            {
+               const io_uring_cqe &cqe = cqes_[head & *cqMask_];
+
+               bytesRead[cqe.user_data] = cqe.res;
+
+               ++head;
+               ++completed;
+            }
+
+            storeRelease( cqHead_, head );
+         }
+      }
+
+   private:
+      Ring() = default;
+
+      bool setUp()
+      {
+         io_uring_params params;
+         memset( &params, 0, sizeof( params ) );
+
+         ringFd_ = static_cast<int>( ::syscall( __NR_io_uring_setup, cRingEntries, &params ) );
+
+         if ( ringFd_ < 0 )
+         {
+            return false;
+         }
+
+         sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof( uint32_t );
+         cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+
+         const bool singleMap = ( params.features & IORING_FEAT_SINGLE_MMAP ) != 0;
+
+         if ( singleMap )
+         {
+            sqRingSize_ = std::max( sqRingSize_, cqRingSize_ );
+         }
+
+         sqRing_ = map( sqRingSize_, IORING_OFF_SQ_RING );
+
+         if ( sqRing_ == nullptr )
+         {
+            return false;
+         }
+
+         cqRing_ = singleMap ? sqRing_ : map( cqRingSize_, IORING_OFF_CQ_RING );
+
+         if ( cqRing_ == nullptr )
+         {
+            return false;
+         }
+
+         sqesSize_ = params.sq_entries * sizeof( io_uring_sqe );
+
+         sqes_ = static_cast<io_uring_sqe *>( map( sqesSize_, IORING_OFF_SQES ) );
+
+         if ( sqes_ == nullptr )
+         {
+            return false;
+         }
+
+         sqTail_ = ringPointer<uint32_t>( sqRing_, params.sq_off.tail );
+         sqMask_ = ringPointer<uint32_t>( sqRing_, params.sq_off.ring_mask );
+         sqArray_ = ringPointer<uint32_t>( sqRing_, params.sq_off.array );
+
+         cqHead_ = ringPointer<uint32_t>( cqRing_, params.cq_off.head );
+         cqTail_ = ringPointer<uint32_t>( cqRing_, params.cq_off.tail );
+         cqMask_ = ringPointer<uint32_t>( cqRing_, params.cq_off.ring_mask );
+         cqes_ = ringPointer<io_uring_cqe>( cqRing_, params.cq_off.cqes );
+
+         return true;
+      }
+
+      void *map( size_t size, uint64_t offset ) const
+      {
+         void *data = ::mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              ringFd_, static_cast<off_t>( offset ) );
+
+         return ( data == MAP_FAILED ) ? nullptr : data;
+      }
+
+      int ringFd_ = -1;
+
+      void *sqRing_ = nullptr;
+      size_t sqRingSize_ = 0;
+      void *cqRing_ = nullptr;
+      size_t cqRingSize_ = 0;
+      io_uring_sqe *sqes_ = nullptr;
+      size_t sqesSize_ = 0;
+
+      uint32_t *sqTail_ = nullptr;
+      uint32_t *sqMask_ = nullptr;
+      uint32_t *sqArray_ = nullptr;
+
+      uint32_t *cqHead_ = nullptr;
+      uint32_t *cqTail_ = nullptr;
+      uint32_t *cqMask_ = nullptr;
+      io_uring_cqe *cqes_ = nullptr;
+   };
+
+   UringReadSource::UringReadSource( int fd, const ustring &fileName, uint64_t size ) :
+      FileReadSource( fd, fileName, size ), fd_( fd )
+   {
+      // Find out now whether io_uring works, and keep the ring for the first read
+      std::unique_ptr<Ring> ring = Ring::create();
+
+      if ( ring != nullptr )
+      {
+         available_ = true;
+         rings_.push_back( std::move( ring ) );
+      }
+   }
+
+   UringReadSource::~UringReadSource() = default;
+
+   void UringReadSource::readAt( uint64_t offset, char *buffer, size_t count )
+   {
+      // A single read gains nothing from a ring
+      FileReadSource::readAt( offset, buffer, count );
+   }
+
+   void UringReadSource::readRanges( const std::vector<Range> &ranges )
+   {
+      if ( !available_ || ( ranges.size() < 2 ) )
+      {
+         FileReadSource::readRanges( ranges );
+         return;
+      }
+
+      std::unique_ptr<Ring> ring = acquireRing();
+
+      if ( ring == nullptr )
+      {
+         FileReadSource::readRanges( ranges );
+         return;
+      }
+
+      // If anything throws, the ring is dropped rather than reused
+      std::vector<int64_t> bytesRead;
+
+      for ( size_t first = 0; first < ranges.size(); first += cRingEntries )
+      {
+         const size_t count = std::min( ranges.size() - first, size_t{ cRingEntries } );
+
+         ring->read( fd_, &ranges[first], count, bytesRead );
+
+         // Finish short reads (and retry failed ones, so errors are reported the usual way)
+         for ( size_t i = 0; i < count; ++i )
+         {
+            const Range &range = ranges[first + i];
+            const auto done = static_cast<size_t>( std::max( bytesRead[i], int64_t{ 0 } ) );
+
+            if ( done < range.count )
+            {
+               FileReadSource::readAt( range.offset + done, range.buffer + done,
+                                       range.count - done );
+            }
+         }
+      }
+
+      releaseRing( std::move( ring ) );
+   }
+
+   std::unique_ptr<UringReadSource::Ring> UringReadSource::acquireRing()
+   {
+      {
+         std::lock_guard<std::mutex> lock( ringsMutex_ );
+
+         if ( !rings_.empty() )
+         {
+            std::unique_ptr<Ring> ring = std::move( rings_.back() );
+            rings_.pop_back();
+
+            return ring;
+         }
+      }
+
+      return Ring::create();
+   }
+
+   void UringReadSource::releaseRing( std::unique_ptr<Ring> ring )
+   {
+      std::lock_guard<std::mutex> lock( ringsMutex_ );
+
+      rings_.push_back( std::move( ring ) );
+   }
+}
+
+#endif
@@ -0,0 +1,50 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Reading local files with io_uring on Linux (see E57_ENABLE_IO_URING). The rings are set up with
+// the raw system calls, so liburing isn't needed.
+
+#if defined( E57_ENABLE_IO_URING ) && defined( __linux__ )
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "ReadSource.h"
+
+namespace e57
+{
+   /// A FileReadSource which submits the ranges given to readRanges() together, so many of them
+   /// are in flight at once. Each thread reading at the same time gets a ring of its own. If the
+   /// kernel doesn't support io_uring (or it isn't allowed), it reads like a FileReadSource.
+   class UringReadSource : public FileReadSource
+   {
+   public:
+      UringReadSource( int fd, const ustring &fileName, uint64_t size );
+      ~UringReadSource() override;
+
+      void readAt( uint64_t offset, char *buffer, size_t count ) override;
+      void readRanges( const std::vector<Range> &ranges ) override;
+
+      /// True if reads go through io_uring
+      bool isAvailable() const
+      {
+         return available_;
+      }
+
+   private:
+      class Ring;
+
+      std::unique_ptr<Ring> acquireRing();
+      void releaseRing( std::unique_ptr<Ring> ring );
+
+      const int fd_;
+      bool available_ = false;
+
+      std::mutex ringsMutex_;
+      std::vector<std::unique_ptr<Ring>> rings_; // rings not in use
+   };
+}
+
+#endif
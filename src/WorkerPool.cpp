@@ -0,0 +1,97 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+
+#include "Common.h"
+#include "WorkerPool.h"
+
+namespace e57
+{
+   WorkerPool::WorkerPool( unsigned threadCount, const std::shared_ptr<Executor> &executor ) :
+      threadCount_( std::max( threadCount, 1U ) ),
+      executor_( ( executor != nullptr ) ? executor : WorkStealingExecutor::defaultExecutor() )
+   {
+   }
+
+   unsigned WorkerPool::threadCount() const
+   {
+      return threadCount_;
+   }
+
+   void WorkerPool::parallelFor( size_t count, const std::function<void( size_t )> &task )
+   {
+      // Nothing to share, so avoid the synchronization.
+      if ( ( threadCount_ < 2 ) || ( count < 2 ) )
+      {
+         for ( size_t i = 0; i < count; ++i )
+         {
+            task( i );
+         }
+         return;
+      }
+
+      auto job = std::make_shared<Job>();
+      job->task = &task;
+      job->count = count;
+      job->tasksRemaining = count;
+
+      // The calling thread is one of the threads
+      const size_t helperCount = std::min( size_t{ threadCount_ } - 1, count - 1 );
+
+      for ( size_t i = 0; i < helperCount; ++i )
+      {
+         executor_->execute( [job] { runTasks( *job ); } );
+      }
+
+      runTasks( *job );
+
+      std::unique_lock<std::mutex> lock( job->mutex );
+
+      job->done.wait( lock, [&] { return job->tasksRemaining == 0; } );
+
+      if ( job->error )
+      {
+         std::exception_ptr error = job->error;
+
+         lock.unlock();
+         std::rethrow_exception( error );
+      }
+   }
+
+   // Claim and run tasks from the job until there are none left. Helpers which only start once
+   // they have all been claimed return without touching the task, which may be gone by then.
+   void WorkerPool::runTasks( Job &job )
+   {
+      std::unique_lock<std::mutex> lock( job.mutex );
+
+      while ( job.nextTask < job.count )
+      {
+         const size_t index = job.nextTask++;
+
+         lock.unlock();
+
+         std::exception_ptr error;
+         try
+         {
+            ( *job.task )( index );
+         }
+         catch ( ... )
+         {
+            error = std::current_exception();
+         }
+
+         lock.lock();
+
+         if ( error && !job.error )
+         {
+            job.error = error;
+         }
+
+         if ( --job.tasksRemaining == 0 )
+         {
+            job.done.notify_all();
+         }
+      }
+   }
+}
@@ -0,0 +1,61 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace e57
+{
+   class Executor;
+
+   /// Runs independent pieces of work concurrently on an Executor's threads and the calling
+   /// thread.
+   class WorkerPool
+   {
+   public:
+      /// @param threadCount Number of threads to share the work, including the calling thread.
+      /// Values less than 2 mean everything runs on the calling thread.
+      /// @param executor Where the other threads come from. nullptr uses
+      /// WorkStealingExecutor::defaultExecutor().
+      explicit WorkerPool( unsigned threadCount,
+                           const std::shared_ptr<Executor> &executor = nullptr );
+
+      WorkerPool( const WorkerPool & ) = delete;
+      WorkerPool &operator=( const WorkerPool & ) = delete;
+
+      /// Number of threads which share the work, including the calling thread.
+      unsigned threadCount() const;
+
+      /// Call task( i ) for every i in [0, count), spread across the executor and the calling
+      /// thread, and wait for all of them to finish. If any task throws, the first exception is
+      /// rethrown once all the tasks have completed. The calling thread keeps claiming tasks, so
+      /// this finishes even if the executor doesn't get to them.
+      void parallelFor( size_t count, const std::function<void( size_t )> &task );
+
+   private:
+      /// One call of parallelFor(), shared with the executor tasks helping with it, which may
+      /// only start after it has returned
+      struct Job
+      {
+         const std::function<void( size_t )> *task = nullptr;
+         size_t count = 0;
+
+         std::mutex mutex; // protects everything below
+         std::condition_variable done;
+         size_t nextTask = 0;
+         size_t tasksRemaining = 0;
+         std::exception_ptr error;
+      };
+
+      static void runTasks( Job &job );
+
+      const unsigned threadCount_;
+      std::shared_ptr<Executor> executor_;
+   };
+}
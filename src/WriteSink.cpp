@@ -0,0 +1,88 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+
+#include "Common.h"
+#include "StringFunctions.h"
+
+namespace e57
+{
+   ustring WriteSink::name() const
+   {
+      return "<WriteSink>";
+   }
+
+   void WriteSink::reserve( uint64_t size )
+   {
+      E57_UNUSED( size );
+   }
+
+   MemoryWriteSink::MemoryWriteSink( const ustring &name ) : name_( name )
+   {
+   }
+
+   ustring MemoryWriteSink::name() const
+   {
+      return name_;
+   }
+
+   uint64_t MemoryWriteSink::size() const
+   {
+      return buffer_.size();
+   }
+
+   void MemoryWriteSink::writeAt( uint64_t offset, const char *buffer, size_t count )
+   {
+      const uint64_t end = offset + count;
+
+      if ( end > SIZE_MAX )
+      {
+         throw E57_EXCEPTION2( ErrorWriteFailed, "fileName=" + name_ + " offset=" +
+                                                    toString( offset ) +
+                                                    " count=" + toString( count ) );
+      }
+
+      if ( end > buffer_.size() )
+      {
+         buffer_.resize( static_cast<size_t>( end ) );
+      }
+
+      memcpy( buffer_.data() + offset, buffer, count );
+   }
+
+   void MemoryWriteSink::readAt( uint64_t offset, char *buffer, size_t count )
+   {
+      if ( ( offset > buffer_.size() ) || ( count > buffer_.size() - offset ) )
+      {
+         throw E57_EXCEPTION2( ErrorReadFailed, "fileName=" + name_ + " offset=" +
+                                                   toString( offset ) + " count=" +
+                                                   toString( count ) +
+                                                   " size=" + toString( buffer_.size() ) );
+      }
+
+      memcpy( buffer, buffer_.data() + offset, count );
+   }
+
+   void MemoryWriteSink::reserve( uint64_t size )
+   {
+      // Growing the buffer a little at a time would copy it over and over
+      if ( size <= SIZE_MAX )
+      {
+         buffer_.reserve( static_cast<size_t>( size ) );
+      }
+   }
+
+   const std::vector<char> &MemoryWriteSink::buffer() const
+   {
+      return buffer_;
+   }
+
+   std::vector<char> MemoryWriteSink::takeBuffer()
+   {
+      std::vector<char> buffer;
+      buffer.swap( buffer_ );
+
+      return buffer;
+   }
+}
@@ -26,12 +26,21 @@
  * DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
 
 #include "WriterImpl.h"
 
 #include "Common.h"
+#include "DeltaCodec.h"
 #include "E57Version.h"
+#include "InterleavedPoints.h"
+#include "LevelsOfDetail.h"
+#include "SpatialIndex.h"
+#include "SpatialOrder.h"
+#include "XorCodec.h"
+#include "ZstdCodec.h"
 
 namespace
 {
@@ -71,6 +80,87 @@ namespace
                .append( std::to_string( static_cast<int>( inNodeType ) ) );
       }
    }
+
+   /// Number of bits the bitpack codec needs for values from @a inMinimum to @a inMaximum.
+   unsigned bitsNeeded( int64_t inMinimum, int64_t inMaximum )
+   {
+      auto range = static_cast<uint64_t>( inMaximum ) - static_cast<uint64_t>( inMinimum );
+      unsigned bits = 0;
+
+      while ( range > 0 )
+      {
+         ++bits;
+         range >>= 1;
+      }
+
+      return bits;
+   }
+
+   /// Rough size of @a inPointCount points with the fields in @a inProto as written by the
+   /// bitpack codec, plus a little for the packet headers.
+   uint64_t estimatedPointsSize( const e57::StructureNode &inProto, int64_t inPointCount )
+   {
+      uint64_t bitsPerPoint = 0;
+
+      for ( int64_t i = 0; i < inProto.childCount(); ++i )
+      {
+         const e57::Node field = inProto.get( i );
+
+         switch ( field.type() )
+         {
+            case e57::TypeFloat:
+               bitsPerPoint +=
+                  ( e57::FloatNode( field ).precision() == e57::PrecisionSingle ) ? 32 : 64;
+               break;
+
+            case e57::TypeInteger:
+            {
+               const e57::IntegerNode integer( field );
+               bitsPerPoint += bitsNeeded( integer.minimum(), integer.maximum() );
+               break;
+            }
+
+            case e57::TypeScaledInteger:
+            {
+               const e57::ScaledIntegerNode scaled( field );
+               bitsPerPoint += bitsNeeded( scaled.minimum(), scaled.maximum() );
+               break;
+            }
+
+            default:
+               break;
+         }
+      }
+
+      const uint64_t bytes = ( static_cast<uint64_t>( inPointCount ) * bitsPerPoint + 7 ) / 8;
+
+      return bytes + bytes / 64;
+   }
+
+   e57::ImageFileOptions imageFileOptions( const e57::WriterOptions &inOptions )
+   {
+      e57::ImageFileOptions options;
+      options.directIo = inOptions.directIo;
+      options.journalInterval = inOptions.journalInterval;
+      options.executor = inOptions.executor;
+      options.memoryBudget = inOptions.memoryBudget;
+
+      return options;
+   }
+
+   /// The VectorNode @a inName in the root of @a inImageFile if it has one (e.g. when appending),
+   /// or else a new one for the Writer to add.
+   e57::VectorNode rootVector( const e57::ImageFile &inImageFile, const char *inName )
+   {
+      const e57::StructureNode root = inImageFile.root();
+
+      if ( root.isDefined( inName ) )
+      {
+         return e57::VectorNode( root.get( inName ) );
+      }
+
+      return e57::VectorNode( inImageFile, true );
+   }
 }
 
 namespace e57
@@ -80,59 +170,108 @@ namespace e57
 
    @param image 1 of 3 projects or the visual
    @param imageType identifies the image format desired.
-   @param pBuffer pointer the buffer
-   @param start position in the block to start reading
-   @param count size of desired chunk or buffer size
+   @param writeBlob writes the data to the image's blob
+
+   @return whether the image has a blob of @a imageType
    */
-   static size_t _writeImage2DNode( const StructureNode &image, Image2DType imageType,
-                                    uint8_t *pBuffer, int64_t start, size_t count )
+   static bool _writeImage2DNode( const StructureNode &image, Image2DType imageType,
+                                  const std::function<void( BlobNode & )> &writeBlob )
    {
-      size_t transferred = 0;
+      const char *blobName = nullptr;
 
       switch ( imageType )
       {
          case ImageNone:
-            return 0;
+            return false;
 
          case ImageJPEG:
-            if ( image.isDefined( "jpegImage" ) )
-            {
-               BlobNode jpegImage( image.get( "jpegImage" ) );
-               jpegImage.write( pBuffer, start, count );
-               transferred = count;
-            }
+            blobName = "jpegImage";
             break;
 
          case ImagePNG:
-            if ( image.isDefined( "pngImage" ) )
-            {
-               BlobNode pngImage( image.get( "pngImage" ) );
-               pngImage.write( pBuffer, start, count );
-               transferred = count;
-            }
+            blobName = "pngImage";
             break;
 
          case ImageMaskPNG:
-            if ( image.isDefined( "imageMask" ) )
-            {
-               BlobNode imageMask( image.get( "imageMask" ) );
-               imageMask.write( pBuffer, start, count );
-               transferred = count;
-            }
+            blobName = "imageMask";
             break;
       }
 
-      return transferred;
+      if ( ( blobName == nullptr ) || !image.isDefined( blobName ) )
+      {
+         return false;
+      }
+
+      BlobNode blob( image.get( blobName ) );
+      writeBlob( blob );
+
+      return true;
    }
 
    WriterImpl::WriterImpl( const ustring &filePath, const WriterOptions &options ) :
-      imf_( filePath, "w" ), root_( imf_.root() ), data3D_( imf_, true ), images2D_( imf_, true )
+      imf_( filePath, options.append ? "a" : "w", imageFileOptions( options ) ),
+      root_( imf_.root() ),
+      spatialIndexChunkSize_( options.spatialIndexChunkSize ),
+      levelOfDetailCount_( options.levelOfDetailCount ), spatialOrder_( options.spatialOrder ),
+      spatialOrderChunkSize_( options.spatialOrderChunkSize ),
+      computeBounds_( options.computeBounds ), deltaEncodePoints_( options.deltaEncodePoints ),
+      xorEncodeFloats_( options.xorEncodeFloats ), reserveSpace_( options.reserveSpace ),
+      computeSpherical_( options.computeSpherical ), pointPrecision_( options.pointPrecision ),
+      zstdLevel_( options.zstdLevel ), imageThreadCount_( options.imageThreadCount ),
+      data3D_( rootVector( imf_, "data3D" ) ), images2D_( rootVector( imf_, "images2D" ) )
    {
       // We are using the E57 v1.0 data format standard fieldnames.
       // The standard fieldnames are used without an extension prefix (in the default namespace).
       // We explicitly register it for completeness (the reference implementation would do it for
       // us, if we didn't).
-      imf_.extensionsAdd( "", e57::VERSION_1_0_URI );
+      if ( !imf_.extensionsLookupPrefix( "" ) )
+      {
+         imf_.extensionsAdd( "", e57::VERSION_1_0_URI );
+      }
+
+      if ( ( spatialOrder_ != SpatialOrder::None ) && ( spatialOrderChunkSize_ == 0 ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument, "spatialOrderChunkSize=0" );
+      }
+
+      // Both write the points from copies which wouldn't have the spherical coordinates
+      if ( computeSpherical_ &&
+           ( ( spatialOrder_ != SpatialOrder::None ) || ( levelOfDetailCount_ != 0 ) ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                               "computeSpherical can't be used with spatialOrder or "
+                               "levelOfDetailCount" );
+      }
+
+      if ( !( pointPrecision_ >= 0.0 ) || std::isinf( pointPrecision_ ) )
+      {
+         throw E57_EXCEPTION2( ErrorBadAPIArgument,
+                               "pointPrecision=" + std::to_string( pointPrecision_ ) );
+      }
+
+      pointsWriterOptions_.writeIndexPackets = options.writeIndexPackets;
+      pointsWriterOptions_.encodeThreadCount = options.encodeThreadCount;
+      pointsWriterOptions_.writeBehindPacketCount = options.writeBehindPacketCount;
+      pointsWriterOptions_.stageInMemory = options.stageInMemory;
+      pointsWriterOptions_.columnarRunPackets = options.columnarRunPackets;
+      pointsWriterOptions_.validatePerWrite = options.validatePerWrite;
+      pointsWriterOptions_.progress = options.progress;
+      pointsWriterOptions_.cancellation = options.cancellation;
+
+      // A file being appended to already has them
+      if ( options.append )
+      {
+         if ( !root_.isDefined( "data3D" ) )
+         {
+            root_.set( "data3D", data3D_ );
+         }
+         if ( !root_.isDefined( "images2D" ) )
+         {
+            root_.set( "images2D", images2D_ );
+         }
+
+         return;
+      }
 
       // Set per-file properties.
       // Path names: "/formatName", "/majorVersion", "/minorVersion", "/coordinateMetadata"
@@ -193,10 +332,99 @@ namespace e57
          return false;
       }
 
+      // Data3D which never had any points written keep the coordinates of their headers
+      {
+         std::lock_guard<std::mutex> lock( pendingPointsMutex_ );
+
+         for ( const auto &pending : pendingPoints_ )
+         {
+            StructureNode scan( data3D_.get( pending.dataIndex ) );
+
+            addPoints( scan, pending.header );
+         }
+
+         pendingPoints_.clear();
+      }
+
+      writePendingBounds();
+
       imf_.close();
       return true;
    }
 
+   void WriterImpl::writePendingBounds()
+   {
+      std::lock_guard<std::mutex> lock( pendingBoundsMutex_ );
+
+      // Combine what each of a Data3D's writers saw (usually there is only one).
+      const auto limits = []( const PendingBounds &pending, const char *pathName, double &minimum,
+                              double &maximum ) {
+         bool found = false;
+
+         for ( const auto &writer : pending.writers )
+         {
+            double writerMinimum = 0.0;
+            double writerMaximum = 0.0;
+
+            if ( writer.fieldLimits( pathName, writerMinimum, writerMaximum ) )
+            {
+               minimum = found ? std::min( minimum, writerMinimum ) : writerMinimum;
+               maximum = found ? std::max( maximum, writerMaximum ) : writerMaximum;
+               found = true;
+            }
+         }
+
+         return found;
+      };
+
+      for ( const auto &pending : pendingBounds_ )
+      {
+         StructureNode scan( data3D_.get( pending.dataIndex ) );
+
+         CartesianBounds cartesian;
+
+         if ( pending.cartesian &&
+              limits( pending, "cartesianX", cartesian.xMinimum, cartesian.xMaximum ) &&
+              limits( pending, "cartesianY", cartesian.yMinimum, cartesian.yMaximum ) &&
+              limits( pending, "cartesianZ", cartesian.zMinimum, cartesian.zMaximum ) )
+         {
+            StructureNode bbox( imf_ );
+
+            bbox.set( "xMinimum", FloatNode( imf_, cartesian.xMinimum ) );
+            bbox.set( "xMaximum", FloatNode( imf_, cartesian.xMaximum ) );
+            bbox.set( "yMinimum", FloatNode( imf_, cartesian.yMinimum ) );
+            bbox.set( "yMaximum", FloatNode( imf_, cartesian.yMaximum ) );
+            bbox.set( "zMinimum", FloatNode( imf_, cartesian.zMinimum ) );
+            bbox.set( "zMaximum", FloatNode( imf_, cartesian.zMaximum ) );
+
+            scan.set( "cartesianBounds", bbox );
+         }
+
+         SphericalBounds spherical;
+
+         if ( pending.spherical &&
+              limits( pending, "sphericalRange", spherical.rangeMinimum,
+                      spherical.rangeMaximum ) &&
+              limits( pending, "sphericalElevation", spherical.elevationMinimum,
+                      spherical.elevationMaximum ) &&
+              limits( pending, "sphericalAzimuth", spherical.azimuthStart, spherical.azimuthEnd ) )
+         {
+            StructureNode sbox( imf_ );
+
+            sbox.set( "rangeMinimum", FloatNode( imf_, spherical.rangeMinimum ) );
+            sbox.set( "rangeMaximum", FloatNode( imf_, spherical.rangeMaximum ) );
+            sbox.set( "elevationMinimum", FloatNode( imf_, spherical.elevationMinimum ) );
+            sbox.set( "elevationMaximum", FloatNode( imf_, spherical.elevationMaximum ) );
+            sbox.set( "azimuthStart", FloatNode( imf_, spherical.azimuthStart ) );
+            sbox.set( "azimuthEnd", FloatNode( imf_, spherical.azimuthEnd ) );
+
+            scan.set( "sphericalBounds", sbox );
+         }
+      }
+
+      pendingBounds_.clear();
+   }
+
    int64_t WriterImpl::NewImage2D( Image2D &image2DHeader )
    {
       StructureNode image( imf_ );
@@ -420,10 +648,47 @@ namespace e57
    size_t WriterImpl::WriteImage2DData( int64_t imageIndex, Image2DType imageType,
                                         Image2DProjection imageProjection, uint8_t *pBuffer,
                                         int64_t start, size_t count )
+   {
+      const auto writeBuffer = [&]( BlobNode &blob ) {
+         blob.write( pBuffer, start, count, imageThreadCount_ );
+      };
+
+      return writeImage2D( imageIndex, imageType, imageProjection, writeBuffer ) ? count : 0;
+   }
+
+   size_t WriterImpl::WriteImage2DData( int64_t imageIndex, Image2DType imageType,
+                                        Image2DProjection imageProjection,
+                                        const BlobSource &source, int64_t start, size_t count )
+   {
+      const auto writeSource = [&]( BlobNode &blob ) {
+         blob.write( source, start, count, imageThreadCount_ );
+      };
+
+      return writeImage2D( imageIndex, imageType, imageProjection, writeSource ) ? count : 0;
+   }
+
+   int64_t WriterImpl::WriteImage2DFile( int64_t imageIndex, Image2DType imageType,
+                                         Image2DProjection imageProjection,
+                                         const ustring &fileName )
+   {
+      int64_t written = 0;
+
+      const auto importFile = [&]( BlobNode &blob ) {
+         written = blob.importFile( fileName, 0, imageThreadCount_ );
+      };
+
+      writeImage2D( imageIndex, imageType, imageProjection, importFile );
+
+      return written;
+   }
+
+   bool WriterImpl::writeImage2D( int64_t imageIndex, Image2DType imageType,
+                                  Image2DProjection imageProjection,
+                                  const std::function<void( BlobNode & )> &writeBlob )
    {
       if ( ( imageIndex < 0 ) || ( imageIndex >= images2D_.childCount() ) )
       {
-         return 0;
+         return false;
       }
 
       const StructureNode image( images2D_.get( imageIndex ) );
@@ -431,15 +696,14 @@ namespace e57
       switch ( imageProjection )
       {
          case ProjectionNone:
-            return 0;
+            return false;
 
          case ProjectionVisual:
             if ( image.isDefined( "visualReferenceRepresentation" ) )
             {
                StructureNode visualReferenceRepresentation(
                   image.get( "visualReferenceRepresentation" ) );
-               return _writeImage2DNode( visualReferenceRepresentation, imageType, pBuffer, start,
-                                         count );
+               return _writeImage2DNode( visualReferenceRepresentation, imageType, writeBlob );
             }
             break;
 
@@ -447,7 +711,7 @@ namespace e57
             if ( image.isDefined( "pinholeRepresentation" ) )
             {
                StructureNode pinholeRepresentation( image.get( "pinholeRepresentation" ) );
-               return _writeImage2DNode( pinholeRepresentation, imageType, pBuffer, start, count );
+               return _writeImage2DNode( pinholeRepresentation, imageType, writeBlob );
             }
             break;
 
@@ -455,8 +719,7 @@ namespace e57
             if ( image.isDefined( "sphericalRepresentation" ) )
             {
                StructureNode sphericalRepresentation( image.get( "sphericalRepresentation" ) );
-               return _writeImage2DNode( sphericalRepresentation, imageType, pBuffer, start,
-                                         count );
+               return _writeImage2DNode( sphericalRepresentation, imageType, writeBlob );
             }
             break;
 
@@ -464,13 +727,12 @@ namespace e57
             if ( image.isDefined( "cylindricalRepresentation" ) )
             {
                StructureNode cylindricalRepresentation( image.get( "cylindricalRepresentation" ) );
-               return _writeImage2DNode( cylindricalRepresentation, imageType, pBuffer, start,
-                                         count );
+               return _writeImage2DNode( cylindricalRepresentation, imageType, writeBlob );
             }
             break;
       }
 
-      return 0;
+      return false;
    }
 
    int64_t WriterImpl::NewData3D( Data3D &data3DHeader )
@@ -822,6 +1084,54 @@ namespace e57
          scan.set( "pointGroupingSchemes", pointGroupingSchemes );
       }
 
+      // With pointPrecision, coordinates which would be floats are stored as scaled integers.
+      // Their limits come from the bounds in the header, or else the points are added when they
+      // are first written, so they can come from the points themselves.
+      if ( usesPointPrecision( data3DHeader ) )
+      {
+         Data3D header( data3DHeader );
+
+         if ( setPointPrecision( header ) )
+         {
+            addPoints( scan, header );
+         }
+         else
+         {
+            std::lock_guard<std::mutex> lock( pendingPointsMutex_ );
+
+            pendingPoints_.push_back( { pos, data3DHeader } );
+         }
+      }
+      else
+      {
+         addPoints( scan, data3DHeader );
+      }
+
+      // Bounds left out above can be filled in from the points as they are written
+      if ( computeBounds_ )
+      {
+         const auto &fields = data3DHeader.pointFields;
+
+         const bool cartesian = fields.cartesianXField && fields.cartesianYField &&
+                                fields.cartesianZField &&
+                                ( data3DHeader.cartesianBounds == CartesianBounds{} );
+         const bool spherical = fields.sphericalRangeField && fields.sphericalAzimuthField &&
+                                fields.sphericalElevationField &&
+                                ( data3DHeader.sphericalBounds == SphericalBounds{} );
+
+         if ( cartesian || spherical )
+         {
+            std::lock_guard<std::mutex> lock( pendingBoundsMutex_ );
+
+            pendingBounds_.push_back( { pos, cartesian, spherical, {} } );
+         }
+      }
+
+      return pos;
+   }
+
+   void WriterImpl::addPoints( StructureNode &scan, const Data3D &data3DHeader )
+   {
       // Make a prototype of datatypes that will be stored in points record.
       // This prototype will be used in creating the points CompressedVector.
       // Using this proto in a CompressedVector will define path names like:
@@ -1143,7 +1453,67 @@ namespace e57
 
       // Make empty codecs vector for use in creating points CompressedVector.
       // If this vector is empty, it is assumed that all fields will use the BitPack codec.
-      const VectorNode codecs( imf_, true );
+      VectorNode codecs( imf_, true );
+
+      // Coordinates and indices of neighbouring points are usually close together, so store
+      // the integer ones as differences if asked to.
+      if ( deltaEncodePoints_ )
+      {
+         std::vector<ustring> deltaFields;
+
+         for ( const char *name :
+               { "cartesianX", "cartesianY", "cartesianZ", "rowIndex", "columnIndex" } )
+         {
+            if ( proto.isDefined( name ) )
+            {
+               const NodeType cType = proto.get( name ).type();
+
+               if ( cType == TypeInteger || cType == TypeScaledInteger )
+               {
+                  deltaFields.emplace_back( name );
+               }
+            }
+         }
+
+         if ( !deltaFields.empty() )
+         {
+            addDeltaCodec( imf_, codecs, deltaFields );
+         }
+      }
+
+      // Float values close to the previous one share their high bits
+      if ( xorEncodeFloats_ )
+      {
+         std::vector<ustring> xorFields;
+
+         for ( int64_t i = 0; i < proto.childCount(); ++i )
+         {
+            const Node field = proto.get( i );
+
+            if ( field.type() == TypeFloat )
+            {
+               xorFields.push_back( field.elementName() );
+            }
+         }
+
+         if ( !xorFields.empty() )
+         {
+            addXorCodec( imf_, codecs, xorFields );
+         }
+      }
+
+      // zstd goes on top of whatever encoding the fields have, so it can cover all of them
+      if ( zstdLevel_ != 0 )
+      {
+         std::vector<ustring> zstdFields;
+
+         for ( int64_t i = 0; i < proto.childCount(); ++i )
+         {
+            zstdFields.push_back( proto.get( i ).elementName() );
+         }
+
+         addZstdCodec( imf_, codecs, zstdFields, zstdLevel_ );
+      }
 
       // Create CompressedVector for storing points.  Path Name: "/data3D/0/points".
       // We use the prototype and empty codecs tree from above.
@@ -1152,7 +1522,204 @@ namespace e57
 
       scan.set( "points", points );
 
-      return pos;
+      // The points are written after everything already in the file, so reserve room for them
+      if ( reserveSpace_ && ( data3DHeader.pointCount > 0 ) )
+      {
+         imf_.reserveSpace( estimatedPointsSize( proto, data3DHeader.pointCount ) );
+      }
+   }
+
+   bool WriterImpl::usesPointPrecision( const Data3D &data3DHeader ) const
+   {
+      const auto &fields = data3DHeader.pointFields;
+
+      return ( pointPrecision_ > 0.0 ) &&
+             ( ( fields.pointRangeNodeType == NumericalNodeType::Float ) ||
+               ( fields.pointRangeNodeType == NumericalNodeType::Double ) ) &&
+             ( fields.cartesianXField || fields.cartesianYField || fields.cartesianZField ||
+               fields.sphericalRangeField );
+   }
+
+   bool WriterImpl::setPointPrecision( Data3D &data3DHeader ) const
+   {
+      const auto &fields = data3DHeader.pointFields;
+      const auto &cartesian = data3DHeader.cartesianBounds;
+      const auto &spherical = data3DHeader.sphericalBounds;
+
+      double minimum = DOUBLE_MAX;
+      double maximum = -DOUBLE_MAX;
+
+      // Bounds still at their defaults aren't known
+      const auto addBounds = [&]( bool used, double lower, double upper ) {
+         if ( used )
+         {
+            minimum = std::min( minimum, lower );
+            maximum = std::max( maximum, upper );
+         }
+
+         return !used || ( ( lower != -DOUBLE_MAX ) && ( upper != DOUBLE_MAX ) );
+      };
+
+      if ( !addBounds( fields.cartesianXField, cartesian.xMinimum, cartesian.xMaximum ) ||
+           !addBounds( fields.cartesianYField, cartesian.yMinimum, cartesian.yMaximum ) ||
+           !addBounds( fields.cartesianZField, cartesian.zMinimum, cartesian.zMaximum ) ||
+           !addBounds( fields.sphericalRangeField, spherical.rangeMinimum,
+                       spherical.rangeMaximum ) )
+      {
+         return false;
+      }
+
+      setPointPrecision( data3DHeader, minimum, maximum );
+
+      return true;
+   }
+
+   void WriterImpl::setPointPrecision( Data3D &data3DHeader, double minimum,
+                                       double maximum ) const
+   {
+      // Limits which don't fit in the raw integers (exactly) are left as floats
+      constexpr double cRawLimit = 9007199254740992.0; // 2^53
+
+      const double rawMinimum = std::floor( minimum / pointPrecision_ + 0.5 );
+      const double rawMaximum = std::floor( maximum / pointPrecision_ + 0.5 );
+
+      if ( !( rawMinimum <= rawMaximum ) || ( rawMinimum < -cRawLimit ) ||
+           ( rawMaximum > cRawLimit ) )
+      {
+         return;
+      }
+
+      auto &fields = data3DHeader.pointFields;
+
+      fields.pointRangeNodeType = NumericalNodeType::ScaledInteger;
+      fields.pointRangeScale = pointPrecision_;
+      fields.pointRangeMinimum = minimum;
+      fields.pointRangeMaximum = maximum;
+   }
+
+   void WriterImpl::addPendingPoints( int64_t dataIndex, size_t count,
+                                      const std::vector<SourceDestBuffer> &sourceBuffers )
+   {
+      std::lock_guard<std::mutex> lock( pendingPointsMutex_ );
+
+      const auto pending = std::find_if(
+         pendingPoints_.begin(), pendingPoints_.end(),
+         [dataIndex]( const PendingPoints &points ) { return points.dataIndex == dataIndex; } );
+
+      if ( pending == pendingPoints_.end() )
+      {
+         return;
+      }
+
+      Data3D header = pending->header;
+      const auto &fields = header.pointFields;
+
+      double minimum = DOUBLE_MAX;
+      double maximum = -DOUBLE_MAX;
+      bool found = false;
+
+      // The furthest cartesian coordinate, for ranges worked out from them (computeSpherical)
+      double furthest = -1.0;
+      bool hasRange = false;
+
+      for ( const auto &buffer : sourceBuffers )
+      {
+         const ustring name = buffer.pathName();
+         const bool isCartesian =
+            ( name == "cartesianX" ) || ( name == "cartesianY" ) || ( name == "cartesianZ" );
+
+         const bool used = ( ( name == "cartesianX" ) && fields.cartesianXField ) ||
+                           ( ( name == "cartesianY" ) && fields.cartesianYField ) ||
+                           ( ( name == "cartesianZ" ) && fields.cartesianZField ) ||
+                           ( ( name == "sphericalRange" ) && fields.sphericalRangeField );
+
+         double lower = 0.0;
+         double upper = 0.0;
+
+         if ( ( used || isCartesian ) && bufferRange( buffer, count, lower, upper ) )
+         {
+            if ( used )
+            {
+               minimum = std::min( minimum, lower );
+               maximum = std::max( maximum, upper );
+               found = true;
+            }
+
+            if ( isCartesian )
+            {
+               furthest = std::max( { furthest, std::fabs( lower ), std::fabs( upper ) } );
+            }
+         }
+
+         hasRange = hasRange || ( name == "sphericalRange" );
+      }
+
+      // Ranges worked out from the cartesian coordinates are no further away than the corner of
+      // the cube around them
+      if ( fields.sphericalRangeField && !hasRange && ( furthest >= 0.0 ) )
+      {
+         minimum = std::min( minimum, 0.0 );
+         maximum = std::max( maximum, std::sqrt( 3.0 ) * furthest );
+         found = true;
+      }
+
+      if ( found )
+      {
+         setPointPrecision( header, minimum, maximum );
+      }
+
+      StructureNode scan( data3D_.get( dataIndex ) );
+
+      addPoints( scan, header );
+
+      pendingPoints_.erase( pending );
+   }
+
+   template <typename COORDTYPE>
+   CompressedVectorNode WriterImpl::pointsNode( int64_t dataIndex, size_t count,
+                                                const Data3DPointsData_t<COORDTYPE> &buffers )
+   {
+      bool pending = false;
+      {
+         std::lock_guard<std::mutex> lock( pendingPointsMutex_ );
+
+         pending = std::any_of(
+            pendingPoints_.begin(), pendingPoints_.end(),
+            [dataIndex]( const PendingPoints &points ) { return points.dataIndex == dataIndex; } );
+      }
+
+      if ( pending )
+      {
+         std::vector<SourceDestBuffer> coordinates;
+
+         const auto addCoordinate = [&]( const char *name, COORDTYPE *values ) {
+            if ( values != nullptr )
+            {
+               coordinates.emplace_back( imf_, name, values, count, true, true );
+            }
+         };
+
+         addCoordinate( "cartesianX", buffers.cartesianX );
+         addCoordinate( "cartesianY", buffers.cartesianY );
+         addCoordinate( "cartesianZ", buffers.cartesianZ );
+         addCoordinate( "sphericalRange", buffers.sphericalRange );
+
+         addPendingPoints( dataIndex, count, coordinates );
+      }
+
+      const StructureNode scan( data3D_.get( dataIndex ) );
+
+      return CompressedVectorNode( scan.get( "points" ) );
+   }
+
+   CompressedVectorNode WriterImpl::pointsNode( int64_t dataIndex, size_t count,
+                                                const Data3DPointsInterleaved &points )
+   {
+      addPendingPoints( dataIndex, count, interleavedBuffers( imf_, points, count ) );
+
+      const StructureNode scan( data3D_.get( dataIndex ) );
+
+      return CompressedVectorNode( scan.get( "points" ) );
    }
 
    template <typename COORDTYPE>
@@ -1161,8 +1728,18 @@ namespace e57
    {
       static_assert( std::is_floating_point<COORDTYPE>::value, "Floating point type required." );
 
-      const StructureNode scan( data3D_.get( dataIndex ) );
-      CompressedVectorNode points( scan.get( "points" ) );
+      CompressedVectorNode points = pointsNode( dataIndex, count, buffers );
+
+      std::vector<SourceDestBuffer> sourceBuffers = pointsBuffers( points, count, buffers );
+
+      return createPointsWriter( dataIndex, points, sourceBuffers );
+   }
+
+   template <typename COORDTYPE>
+   std::vector<SourceDestBuffer> WriterImpl::pointsBuffers(
+      const CompressedVectorNode &points, size_t count,
+      const Data3DPointsData_t<COORDTYPE> &buffers ) const
+   {
       const StructureNode proto( points.prototype() );
       std::vector<SourceDestBuffer> sourceBuffers;
 
@@ -1250,6 +1827,12 @@ namespace e57
          sourceBuffers.emplace_back( imf_, "cartesianInvalidState", buffers.cartesianInvalidState,
                                      count, true );
       }
+      else if ( proto.isDefined( "cartesianInvalidState" ) &&
+                ( buffers.cartesianInvalidStateBits.data != nullptr ) )
+      {
+         sourceBuffers.emplace_back( imf_, "cartesianInvalidState",
+                                     buffers.cartesianInvalidStateBits, count, true );
+      }
 
       if ( proto.isDefined( "sphericalInvalidState" ) &&
            ( buffers.sphericalInvalidState != nullptr ) )
@@ -1257,23 +1840,47 @@ namespace e57
          sourceBuffers.emplace_back( imf_, "sphericalInvalidState", buffers.sphericalInvalidState,
                                      count, true );
       }
+      else if ( proto.isDefined( "sphericalInvalidState" ) &&
+                ( buffers.sphericalInvalidStateBits.data != nullptr ) )
+      {
+         sourceBuffers.emplace_back( imf_, "sphericalInvalidState",
+                                     buffers.sphericalInvalidStateBits, count, true );
+      }
 
       if ( proto.isDefined( "isIntensityInvalid" ) && ( buffers.isIntensityInvalid != nullptr ) )
       {
          sourceBuffers.emplace_back( imf_, "isIntensityInvalid", buffers.isIntensityInvalid, count,
                                      true );
       }
+      else if ( proto.isDefined( "isIntensityInvalid" ) &&
+                ( buffers.isIntensityInvalidBits.data != nullptr ) )
+      {
+         sourceBuffers.emplace_back( imf_, "isIntensityInvalid", buffers.isIntensityInvalidBits,
+                                     count, true );
+      }
 
       if ( proto.isDefined( "isColorInvalid" ) && ( buffers.isColorInvalid != nullptr ) )
       {
          sourceBuffers.emplace_back( imf_, "isColorInvalid", buffers.isColorInvalid, count, true );
       }
+      else if ( proto.isDefined( "isColorInvalid" ) &&
+                ( buffers.isColorInvalidBits.data != nullptr ) )
+      {
+         sourceBuffers.emplace_back( imf_, "isColorInvalid", buffers.isColorInvalidBits, count,
+                                     true );
+      }
 
       if ( proto.isDefined( "isTimeStampInvalid" ) && ( buffers.isTimeStampInvalid != nullptr ) )
       {
          sourceBuffers.emplace_back( imf_, "isTimeStampInvalid", buffers.isTimeStampInvalid, count,
                                      true );
       }
+      else if ( proto.isDefined( "isTimeStampInvalid" ) &&
+                ( buffers.isTimeStampInvalidBits.data != nullptr ) )
+      {
+         sourceBuffers.emplace_back( imf_, "isTimeStampInvalid", buffers.isTimeStampInvalidBits,
+                                     count, true );
+      }
 
       // E57_EXT_surface_normals
       if ( imf_.extensionsLookupPrefix( "nor" ) )
@@ -1294,12 +1901,317 @@ namespace e57
          }
       }
 
+      return sourceBuffers;
+   }
+
+   CompressedVectorWriter WriterImpl::SetUpData3DPointsData( int64_t dataIndex, size_t count,
+                                                             const Data3DPointsInterleaved &points )
+   {
+      CompressedVectorNode node = pointsNode( dataIndex, count, points );
+
+      std::vector<SourceDestBuffer> sourceBuffers = interleavedBuffers( imf_, points, count );
+
+      return createPointsWriter( dataIndex, node, sourceBuffers );
+   }
+
+   CompressedVectorWriter WriterImpl::createPointsWriter(
+      int64_t dataIndex, CompressedVectorNode &points,
+      std::vector<SourceDestBuffer> &sourceBuffers )
+   {
+      std::lock_guard<std::mutex> lock( pendingBoundsMutex_ );
+
+      const auto pending = std::find_if(
+         pendingBounds_.begin(), pendingBounds_.end(),
+         [dataIndex]( const PendingBounds &bounds ) { return bounds.dataIndex == dataIndex; } );
+
+      CompressedVectorWriterOptions options = pointsWriterOptions_;
+      options.collectFieldLimits = ( pending != pendingBounds_.end() );
+
       // create the writer, all buffers must be setup before this call
-      CompressedVectorWriter writer = points.writer( sourceBuffers );
+      CompressedVectorWriter writer = points.writer( sourceBuffers, options );
+
+      if ( pending != pendingBounds_.end() )
+      {
+         pending->writers.push_back( writer );
+      }
 
       return writer;
    }
 
+   template <typename COORDTYPE>
+   void WriterImpl::WriteData3DPoints( int64_t dataIndex, size_t pointCount,
+                                       const Data3DPointsData_t<COORDTYPE> &buffers )
+   {
+      if ( computeSpherical_ && writeComputingSpherical( dataIndex, pointCount, buffers ) )
+      {
+         WriteData3DChunkBounds( dataIndex, pointCount, buffers );
+         return;
+      }
+
+      if ( spatialOrder_ != SpatialOrder::None )
+      {
+         const CompressedVectorNode points = pointsNode( dataIndex, pointCount, buffers );
+
+         if ( writeSpatiallyOrdered( dataIndex, pointCount,
+                                     pointsBuffers( points, pointCount, buffers ) ) )
+         {
+            return;
+         }
+      }
+
+      CompressedVectorWriter writer = SetUpData3DPointsData( dataIndex, pointCount, buffers );
+
+      writer.write( pointCount );
+      writer.close();
+
+      WriteData3DChunkBounds( dataIndex, pointCount, buffers );
+   }
+
+   void WriterImpl::WriteData3DPoints( int64_t dataIndex, size_t pointCount,
+                                       const Data3DPointsInterleaved &points )
+   {
+      if ( spatialOrder_ != SpatialOrder::None )
+      {
+         // The points node has to be there before they are staged
+         pointsNode( dataIndex, pointCount, points );
+
+         if ( writeSpatiallyOrdered( dataIndex, pointCount,
+                                     interleavedBuffers( imf_, points, pointCount ) ) )
+         {
+            return;
+         }
+      }
+
+      CompressedVectorWriter writer = SetUpData3DPointsData( dataIndex, pointCount, points );
+
+      writer.write( pointCount );
+      writer.close();
+
+      WriteData3DChunkBounds( dataIndex, pointCount, points );
+   }
+
+   template <typename COORDTYPE>
+   bool WriterImpl::writeComputingSpherical( int64_t dataIndex, size_t pointCount,
+                                             const Data3DPointsData_t<COORDTYPE> &buffers )
+   {
+      CompressedVectorNode points = pointsNode( dataIndex, pointCount, buffers );
+      const StructureNode proto( points.prototype() );
+
+      const bool needed = proto.isDefined( "sphericalRange" ) &&
+                          proto.isDefined( "sphericalAzimuth" ) &&
+                          proto.isDefined( "sphericalElevation" ) &&
+                          ( buffers.sphericalRange == nullptr ) &&
+                          ( buffers.sphericalAzimuth == nullptr ) &&
+                          ( buffers.sphericalElevation == nullptr ) &&
+                          ( buffers.cartesianX != nullptr ) && ( buffers.cartesianY != nullptr ) &&
+                          ( buffers.cartesianZ != nullptr );
+
+      if ( !needed || ( pointCount == 0 ) )
+      {
+         return false;
+      }
+
+      std::vector<SourceDestBuffer> sourceBuffers = pointsBuffers( points, pointCount, buffers );
+
+      if ( proto.isDefined( "sphericalInvalidState" ) &&
+           ( buffers.sphericalInvalidState == nullptr ) &&
+           ( buffers.sphericalInvalidStateBits.data == nullptr ) )
+      {
+         if ( buffers.cartesianInvalidState != nullptr )
+         {
+            sourceBuffers.emplace_back( imf_, "sphericalInvalidState",
+                                        buffers.cartesianInvalidState, pointCount, true );
+         }
+         else if ( buffers.cartesianInvalidStateBits.data != nullptr )
+         {
+            sourceBuffers.emplace_back( imf_, "sphericalInvalidState",
+                                        buffers.cartesianInvalidStateBits, pointCount, true );
+         }
+      }
+
+      constexpr size_t cBlockSize = 65'536;
+
+      const size_t blockSize = std::min( cBlockSize, pointCount );
+
+      std::vector<COORDTYPE> spherical( 3 * blockSize );
+      COORDTYPE *range = spherical.data();
+      COORDTYPE *azimuth = range + blockSize;
+      COORDTYPE *elevation = azimuth + blockSize;
+
+      // Work out the spherical coordinates of the block of points from start, and make the
+      // buffers to write it
+      const auto blockBuffers = [&]( size_t start, size_t count ) {
+         for ( size_t i = 0; i < count; ++i )
+         {
+            const double x = buffers.cartesianX[start + i];
+            const double y = buffers.cartesianY[start + i];
+            const double z = buffers.cartesianZ[start + i];
+            const double xy = std::hypot( x, y );
+
+            range[i] = static_cast<COORDTYPE>( std::hypot( xy, z ) );
+            azimuth[i] = static_cast<COORDTYPE>( std::atan2( y, x ) );
+            elevation[i] = static_cast<COORDTYPE>( std::atan2( z, xy ) );
+         }
+
+         std::vector<SourceDestBuffer> result;
+         result.reserve( sourceBuffers.size() + 3 );
+
+         // Every block's buffers need the same capacity
+         for ( const auto &buffer : sourceBuffers )
+         {
+            result.push_back( offsetBuffer( imf_, buffer, start, blockSize ) );
+         }
+
+         result.emplace_back( imf_, "sphericalRange", range, blockSize, true, true );
+         result.emplace_back( imf_, "sphericalAzimuth", azimuth, blockSize, true, true );
+         result.emplace_back( imf_, "sphericalElevation", elevation, blockSize, true, true );
+
+         return result;
+      };
+
+      std::vector<SourceDestBuffer> firstBuffers = blockBuffers( 0, blockSize );
+      CompressedVectorWriter writer = createPointsWriter( dataIndex, points, firstBuffers );
+
+      writer.write( blockSize );
+
+      for ( size_t start = blockSize; start < pointCount; start += blockSize )
+      {
+         const size_t count = std::min( blockSize, pointCount - start );
+         std::vector<SourceDestBuffer> nextBuffers = blockBuffers( start, count );
+
+         writer.write( nextBuffers, count );
+      }
+
+      writer.close();
+
+      return true;
+   }
+
+   bool WriterImpl::writeSpatiallyOrdered( int64_t dataIndex, size_t pointCount,
+                                           const std::vector<SourceDestBuffer> &sourceBuffers )
+   {
+      if ( pointCount == 0 )
+      {
+         return false;
+      }
+
+      const size_t cChunkSize = std::min( spatialOrderChunkSize_, pointCount );
+
+      SpatialOrderStage stage( spatialOrder_, sourceBuffers, cChunkSize );
+
+      if ( !stage.canOrder() )
+      {
+         return false;
+      }
+
+      StructureNode scan( data3D_.get( dataIndex ) );
+      CompressedVectorNode points( scan.get( "points" ) );
+
+      std::vector<SourceDestBuffer> stageBuffers =
+         interleavedBuffers( imf_, stage.points(), cChunkSize );
+
+      CompressedVectorWriter writer = createPointsWriter( dataIndex, points, stageBuffers );
+
+      std::vector<ChunkBounds> chunks;
+
+      for ( size_t start = 0; start < pointCount; start += cChunkSize )
+      {
+         const size_t count = std::min( cChunkSize, pointCount - start );
+
+         stage.stage( start, count );
+         writer.write( count );
+
+         // The bounds have to be of the points as written
+         for ( auto chunk : calculateChunkBounds( stage.points(), count, spatialIndexChunkSize_ ) )
+         {
+            chunk.startRecord += static_cast<int64_t>( start );
+            chunks.push_back( chunk );
+         }
+      }
+
+      writer.close();
+
+      if ( !chunks.empty() )
+      {
+         writeChunkBounds( imf_, scan, chunks );
+      }
+
+      return true;
+   }
+
+   template <typename COORDTYPE>
+   void WriterImpl::WriteData3DChunkBounds( int64_t dataIndex, size_t pointCount,
+                                            const Data3DPointsData_t<COORDTYPE> &buffers )
+   {
+      if ( spatialIndexChunkSize_ == 0 )
+      {
+         return;
+      }
+
+      StructureNode scan( data3D_.get( dataIndex ) );
+      const StructureNode proto( CompressedVectorNode( scan.get( "points" ) ).prototype() );
+
+      // Only cartesian coordinates are indexed
+      if ( !proto.isDefined( "cartesianX" ) || !proto.isDefined( "cartesianY" ) ||
+           !proto.isDefined( "cartesianZ" ) )
+      {
+         return;
+      }
+
+      writeChunkBounds( imf_, scan,
+                        calculateChunkBounds( buffers, pointCount, spatialIndexChunkSize_ ) );
+   }
+
+   void WriterImpl::WriteData3DChunkBounds( int64_t dataIndex, size_t pointCount,
+                                            const Data3DPointsInterleaved &points )
+   {
+      if ( spatialIndexChunkSize_ == 0 )
+      {
+         return;
+      }
+
+      StructureNode scan( data3D_.get( dataIndex ) );
+
+      const std::vector<ChunkBounds> chunks =
+         calculateChunkBounds( points, pointCount, spatialIndexChunkSize_ );
+
+      // Only cartesian coordinates are indexed
+      if ( !chunks.empty() )
+      {
+         writeChunkBounds( imf_, scan, chunks );
+      }
+   }
+
+   template <typename COORDTYPE>
+   void WriterImpl::WriteData3DLevelsOfDetail( int64_t dataIndex, size_t pointCount,
+                                               const Data3DPointsData_t<COORDTYPE> &buffers )
+   {
+      if ( levelOfDetailCount_ == 0 )
+      {
+         return;
+      }
+
+      StructureNode scan( data3D_.get( dataIndex ) );
+      const CompressedVectorNode points = pointsNode( dataIndex, pointCount, buffers );
+
+      writeLevelsOfDetail( imf_, scan, pointsBuffers( points, pointCount, buffers ), pointCount,
+                           levelOfDetailCount_, pointsWriterOptions_ );
+   }
+
+   void WriterImpl::WriteData3DLevelsOfDetail( int64_t dataIndex, size_t pointCount,
+                                               const Data3DPointsInterleaved &points )
+   {
+      if ( levelOfDetailCount_ == 0 )
+      {
+         return;
+      }
+
+      StructureNode scan( data3D_.get( dataIndex ) );
+
+      writeLevelsOfDetail( imf_, scan, interleavedBuffers( imf_, points, pointCount ), pointCount,
+                           levelOfDetailCount_, pointsWriterOptions_ );
+   }
+
    // Explicit template instantiation
    template CompressedVectorWriter WriterImpl::SetUpData3DPointsData(
       int64_t dataIndex, size_t pointCount, const Data3DPointsData_t<float> &buffers );
@@ -1307,6 +2219,24 @@ namespace e57
    template CompressedVectorWriter WriterImpl::SetUpData3DPointsData(
       int64_t dataIndex, size_t pointCount, const Data3DPointsData_t<double> &buffers );
 
+   template void WriterImpl::WriteData3DPoints( int64_t dataIndex, size_t pointCount,
+                                                const Data3DPointsData_t<float> &buffers );
+
+   template void WriterImpl::WriteData3DPoints( int64_t dataIndex, size_t pointCount,
+                                                const Data3DPointsData_t<double> &buffers );
+
+   template void WriterImpl::WriteData3DChunkBounds( int64_t dataIndex, size_t pointCount,
+                                                     const Data3DPointsData_t<float> &buffers );
+
+   template void WriterImpl::WriteData3DChunkBounds( int64_t dataIndex, size_t pointCount,
+                                                     const Data3DPointsData_t<double> &buffers );
+
+   template void WriterImpl::WriteData3DLevelsOfDetail(
+      int64_t dataIndex, size_t pointCount, const Data3DPointsData_t<float> &buffers );
+
+   template void WriterImpl::WriteData3DLevelsOfDetail(
+      int64_t dataIndex, size_t pointCount, const Data3DPointsData_t<double> &buffers );
+
    // This function writes out the group data
    bool WriterImpl::WriteData3DGroupsData( int64_t dataIndex, size_t groupCount,
                                            int64_t *idElementValue, int64_t *startPointIndex,
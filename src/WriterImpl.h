@@ -28,6 +28,9 @@
 
 #pragma once
 
+#include <functional>
+#include <mutex>
+
 #include "E57SimpleData.h"
 #include "E57SimpleWriter.h"
 
@@ -55,12 +58,43 @@ namespace e57
                                Image2DProjection imageProjection, uint8_t *pBuffer, int64_t start,
                                size_t count );
 
+      size_t WriteImage2DData( int64_t imageIndex, Image2DType imageType,
+                               Image2DProjection imageProjection, const BlobSource &source,
+                               int64_t start, size_t count );
+
+      int64_t WriteImage2DFile( int64_t imageIndex, Image2DType imageType,
+                                Image2DProjection imageProjection, const ustring &fileName );
+
       int64_t NewData3D( Data3D &data3DHeader );
 
       template <typename COORDTYPE>
       CompressedVectorWriter SetUpData3DPointsData( int64_t dataIndex, size_t pointCount,
                                                     const Data3DPointsData_t<COORDTYPE> &buffers );
 
+      CompressedVectorWriter SetUpData3DPointsData( int64_t dataIndex, size_t pointCount,
+                                                    const Data3DPointsInterleaved &points );
+
+      template <typename COORDTYPE>
+      void WriteData3DPoints( int64_t dataIndex, size_t pointCount,
+                              const Data3DPointsData_t<COORDTYPE> &buffers );
+
+      void WriteData3DPoints( int64_t dataIndex, size_t pointCount,
+                              const Data3DPointsInterleaved &points );
+
+      template <typename COORDTYPE>
+      void WriteData3DChunkBounds( int64_t dataIndex, size_t pointCount,
+                                   const Data3DPointsData_t<COORDTYPE> &buffers );
+
+      void WriteData3DChunkBounds( int64_t dataIndex, size_t pointCount,
+                                   const Data3DPointsInterleaved &points );
+
+      template <typename COORDTYPE>
+      void WriteData3DLevelsOfDetail( int64_t dataIndex, size_t pointCount,
+                                      const Data3DPointsData_t<COORDTYPE> &buffers );
+
+      void WriteData3DLevelsOfDetail( int64_t dataIndex, size_t pointCount,
+                                      const Data3DPointsInterleaved &points );
+
       bool WriteData3DGroupsData( int64_t dataIndex, size_t groupCount, int64_t *idElementValue,
                                   int64_t *startPointIndex, int64_t *pointCount );
 
@@ -73,9 +107,102 @@ namespace e57
       ImageFile GetRawIMF();
 
    private:
+      /// A Data3D whose bounds are worked out by the points writers (WriterOptions::computeBounds)
+      struct PendingBounds
+      {
+         int64_t dataIndex;
+         bool cartesian;
+         bool spherical;
+         std::vector<CompressedVectorWriter> writers;
+      };
+
+      /// A Data3D whose points node waits for its first points (WriterOptions::pointPrecision)
+      struct PendingPoints
+      {
+         int64_t dataIndex;
+         Data3D header;
+      };
+
+      void writePendingBounds();
+
+      /// Call @a writeBlob with the blob of Image2D @a imageIndex holding @a imageType in
+      /// @a imageProjection, returning false if there isn't one
+      bool writeImage2D( int64_t imageIndex, Image2DType imageType,
+                         Image2DProjection imageProjection,
+                         const std::function<void( BlobNode & )> &writeBlob );
+
+      /// Add the points node described by @a data3DHeader to @a scan
+      void addPoints( StructureNode &scan, const Data3D &data3DHeader );
+
+      /// Does pointPrecision_ change the point coordinates of @a data3DHeader?
+      bool usesPointPrecision( const Data3D &data3DHeader ) const;
+
+      /// Make the point coordinates of @a data3DHeader scaled integers of pointPrecision_, with
+      /// the limits in its bounds. Returns false if it has no bounds.
+      bool setPointPrecision( Data3D &data3DHeader ) const;
+
+      /// Make the point coordinates of @a data3DHeader scaled integers of pointPrecision_ which
+      /// hold [minimum, maximum].
+      void setPointPrecision( Data3D &data3DHeader, double minimum, double maximum ) const;
+
+      /// Add the points node of Data3D @a dataIndex if it is still pending, with limits from the
+      /// coordinates in @a sourceBuffers.
+      void addPendingPoints( int64_t dataIndex, size_t count,
+                             const std::vector<SourceDestBuffer> &sourceBuffers );
+
+      /// The points node of Data3D @a dataIndex, added first if it is waiting for @a buffers
+      template <typename COORDTYPE>
+      CompressedVectorNode pointsNode( int64_t dataIndex, size_t count,
+                                       const Data3DPointsData_t<COORDTYPE> &buffers );
+
+      CompressedVectorNode pointsNode( int64_t dataIndex, size_t count,
+                                       const Data3DPointsInterleaved &points );
+
+      /// Write the points of Data3D @a dataIndex from @a sourceBuffers in spatialOrder_, with
+      /// their chunk bounds. Returns false if they can't be sorted.
+      bool writeSpatiallyOrdered( int64_t dataIndex, size_t pointCount,
+                                  const std::vector<SourceDestBuffer> &sourceBuffers );
+
+      /// Write the points of Data3D @a dataIndex with spherical coordinates worked out from the
+      /// cartesian ones in @a buffers (WriterOptions::computeSpherical). Returns false if the
+      /// points don't need them.
+      template <typename COORDTYPE>
+      bool writeComputingSpherical( int64_t dataIndex, size_t pointCount,
+                                    const Data3DPointsData_t<COORDTYPE> &buffers );
+
+      /// The buffers for writing the fields of @a points which are in @a buffers
+      template <typename COORDTYPE>
+      std::vector<SourceDestBuffer> pointsBuffers(
+         const CompressedVectorNode &points, size_t count,
+         const Data3DPointsData_t<COORDTYPE> &buffers ) const;
+
+      /// Create the writer for the points of Data3D @a dataIndex from @a sourceBuffers
+      CompressedVectorWriter createPointsWriter( int64_t dataIndex, CompressedVectorNode &points,
+                                                 std::vector<SourceDestBuffer> &sourceBuffers );
+
       ImageFile imf_;
       StructureNode root_;
 
+      CompressedVectorWriterOptions pointsWriterOptions_;
+      size_t spatialIndexChunkSize_;
+      size_t levelOfDetailCount_;
+      SpatialOrder spatialOrder_;
+      size_t spatialOrderChunkSize_;
+
+      std::vector<PendingBounds> pendingBounds_;
+      std::mutex pendingBoundsMutex_; // Data3D may be written on several threads (stageInMemory)
+      bool computeBounds_;
+      bool deltaEncodePoints_;
+      bool xorEncodeFloats_;
+      bool reserveSpace_;
+      bool computeSpherical_;
+
+      std::vector<PendingPoints> pendingPoints_;
+      std::mutex pendingPointsMutex_;
+      double pointPrecision_;
+      int zstdLevel_;
+      unsigned imageThreadCount_;
+
       VectorNode data3D_;
 
       VectorNode images2D_;
@@ -0,0 +1,171 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <xercesc/sax2/SAX2XMLReader.hpp>
+#include <xercesc/sax2/XMLReaderFactory.hpp>
+#include <xercesc/util/PlatformUtils.hpp>
+#include <xercesc/util/XMLException.hpp>
+#include <xercesc/util/XMLString.hpp>
+#include <xercesc/util/XMLUni.hpp>
+
+#include "Common.h"
+#include "XmlReaderPool.h"
+
+using namespace XERCES_CPP_NAMESPACE;
+
+namespace e57
+{
+   namespace
+   {
+      /// Idle readers kept for each configuration, which is enough for a few threads opening
+      /// files at the same time
+      constexpr size_t cMaxIdleReaders = 8;
+
+      SAX2XMLReader *createReader( bool validate )
+      {
+         SAX2XMLReader *reader = XMLReaderFactory::createXMLReader();
+
+         if ( reader == nullptr )
+         {
+            throw E57_EXCEPTION2( ErrorXMLParserInit, "could not create the xml reader" );
+         }
+
+         try
+         {
+            //??? check these are right
+            reader->setFeature( XMLUni::fgSAX2CoreValidation, validate );
+            reader->setFeature( XMLUni::fgXercesDynamic, validate );
+            reader->setFeature( XMLUni::fgSAX2CoreNameSpaces, true );
+            reader->setFeature( XMLUni::fgXercesSchema, validate );
+            reader->setFeature( XMLUni::fgXercesSchemaFullChecking, validate );
+            reader->setFeature( XMLUni::fgSAX2CoreNameSpacePrefixes, true );
+
+            // Without validation there is no need to read a DTD referred to by the document
+            reader->setFeature( XMLUni::fgXercesLoadExternalDTD, validate );
+         }
+         catch ( ... )
+         {
+            delete reader;
+
+            throw;
+         }
+
+         return reader;
+      }
+   }
+
+   XmlReaderPool &XmlReaderPool::instance()
+   {
+      static XmlReaderPool pool;
+
+      return pool;
+   }
+
+   XmlReaderPool::~XmlReaderPool()
+   {
+      for ( auto &idle : idle_ )
+      {
+         for ( SAX2XMLReader *reader : idle )
+         {
+            delete reader;
+            --readerCount_;
+         }
+      }
+
+      // Readers still in use at exit keep Xerces as it is
+      if ( readerCount_ == 0 )
+      {
+         XMLPlatformUtils::Terminate();
+      }
+   }
+
+   SAX2XMLReader *XmlReaderPool::acquire( bool validate )
+   {
+      XmlReaderPool &pool = instance();
+
+      {
+         std::lock_guard<std::mutex> lock( pool.mutex_ );
+
+         auto &idle = pool.idle_[validate ? 1 : 0];
+
+         if ( !idle.empty() )
+         {
+            SAX2XMLReader *reader = idle.back();
+            idle.pop_back();
+
+            return reader;
+         }
+
+         // XMLPlatformUtils::Initialize() isn't thread safe, so it is only called under the lock
+         if ( pool.readerCount_ == 0 )
+         {
+            try
+            {
+               XMLPlatformUtils::Initialize();
+            }
+            catch ( const XMLException &ex )
+            {
+               // Turn parser exception into E57Exception
+               throw E57_EXCEPTION2(
+                  ErrorXMLParserInit,
+                  "parserMessage=" + ustring( XMLString::transcode( ex.getMessage() ) ) );
+            }
+         }
+
+         ++pool.readerCount_;
+      }
+
+      try
+      {
+         return createReader( validate );
+      }
+      catch ( ... )
+      {
+         pool.destroy( nullptr );
+
+         throw;
+      }
+   }
+
+   void XmlReaderPool::release( SAX2XMLReader *reader, bool validate, bool reusable )
+   {
+      if ( reader == nullptr )
+      {
+         return;
+      }
+
+      XmlReaderPool &pool = instance();
+
+      // The parser the handlers belong to is going away
+      reader->setContentHandler( nullptr );
+      reader->setErrorHandler( nullptr );
+
+      if ( reusable )
+      {
+         std::lock_guard<std::mutex> lock( pool.mutex_ );
+
+         auto &idle = pool.idle_[validate ? 1 : 0];
+
+         if ( idle.size() < cMaxIdleReaders )
+         {
+            idle.push_back( reader );
+
+            return;
+         }
+      }
+
+      pool.destroy( reader );
+   }
+
+   void XmlReaderPool::destroy( SAX2XMLReader *reader )
+   {
+      delete reader;
+
+      std::lock_guard<std::mutex> lock( mutex_ );
+
+      if ( --readerCount_ == 0 )
+      {
+         XMLPlatformUtils::Terminate();
+      }
+   }
+}
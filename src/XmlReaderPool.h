@@ -0,0 +1,54 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include <xercesc/util/XercesDefs.hpp>
+
+namespace XERCES_CPP_NAMESPACE
+{
+   class SAX2XMLReader;
+}
+
+namespace e57
+{
+   /// SAX2 readers set up for parsing E57 XML, which parsers take and hand back instead of each
+   /// creating and configuring their own. Xerces is initialized by the first reader created and
+   /// terminated once there are none left, so it is only set up once while files are opened one
+   /// after another or on several threads at a time.
+   class XmlReaderPool
+   {
+   public:
+      XmlReaderPool( const XmlReaderPool & ) = delete;
+      XmlReaderPool &operator=( const XmlReaderPool & ) = delete;
+
+      /// Take a reader with validation and schema processing turned on if @a validate (see
+      /// ImageFileOptions::validateXml). It has no content or error handler.
+      static XERCES_CPP_NAMESPACE::SAX2XMLReader *acquire( bool validate );
+
+      /// Hand back a reader from acquire() with the same @a validate. It is deleted instead of
+      /// kept if it isn't @a reusable (its last parse failed) or enough readers are kept already.
+      static void release( XERCES_CPP_NAMESPACE::SAX2XMLReader *reader, bool validate,
+                           bool reusable );
+
+   private:
+      XmlReaderPool() = default;
+      ~XmlReaderPool();
+
+      static XmlReaderPool &instance();
+
+      /// Delete @a reader, terminating Xerces if it was the last one
+      void destroy( XERCES_CPP_NAMESPACE::SAX2XMLReader *reader );
+
+      std::mutex mutex_; // protects everything below
+
+      /// Readers which aren't being used, without and with validation
+      std::vector<XERCES_CPP_NAMESPACE::SAX2XMLReader *> idle_[2];
+
+      /// Readers which exist, used or not. Xerces is initialized while this isn't 0.
+      size_t readerCount_ = 0;
+   };
+}
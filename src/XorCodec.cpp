@@ -0,0 +1,78 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include "XorCodec.h"
+#include "CompressedVectorNodeImpl.h"
+#include "DeltaCodec.h"
+#include "IntegerNodeImpl.h"
+#include "StringFunctions.h"
+
+namespace
+{
+   constexpr char cPrefix[] = "xor";
+   constexpr char cURI[] = "urn:libE57Format:E57_EXT_xor_codec";
+   constexpr char cCodecName[] = "xorCodec";
+   constexpr char cResetIntervalName[] = "resetInterval";
+}
+
+namespace e57
+{
+   bool findXorCodec( const CompressedVectorNodeImpl &cVector, const ustring &pathName,
+                      uint64_t &resetInterval )
+   {
+      ustring prefix;
+      const NodeImplSharedPtr parameters =
+         findCodecParameters( cVector, pathName, cURI, cCodecName, prefix );
+
+      if ( !parameters )
+      {
+         return false;
+      }
+
+      const ustring intervalName = prefix + ":" + cResetIntervalName;
+
+      if ( !parameters->isDefined( intervalName ) ||
+           parameters->get( intervalName )->type() != TypeInteger )
+      {
+         throw E57_EXCEPTION2( ErrorBadCodecs, "pathName=" + pathName );
+      }
+
+      const int64_t interval =
+         std::static_pointer_cast<IntegerNodeImpl>( parameters->get( intervalName ) )->value();
+
+      if ( interval <= 0 )
+      {
+         throw E57_EXCEPTION2( ErrorBadCodecs,
+                               "pathName=" + pathName + " resetInterval=" + toString( interval ) );
+      }
+
+      resetInterval = static_cast<uint64_t>( interval );
+      return true;
+   }
+
+   void addXorCodec( ImageFile imf, VectorNode &codecs, const std::vector<ustring> &pathNames )
+   {
+      ustring prefix;
+      if ( !imf.extensionsLookupUri( cURI, prefix ) )
+      {
+         prefix = cPrefix;
+         imf.extensionsAdd( prefix, cURI );
+      }
+
+      VectorNode inputs( imf, false );
+      for ( const auto &pathName : pathNames )
+      {
+         inputs.append( StringNode( imf, pathName ) );
+      }
+
+      StructureNode parameters( imf );
+      parameters.set( prefix + ":" + cResetIntervalName,
+                      IntegerNode( imf, cXorCodecResetInterval, 1, INT64_MAX ) );
+
+      StructureNode codec( imf );
+      codec.set( "inputs", inputs );
+      codec.set( prefix + ":" + cCodecName, parameters );
+
+      codecs.append( codec );
+   }
+}
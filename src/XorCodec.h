@@ -0,0 +1,47 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for the XOR codec extension. An entry in a CompressedVectorNode's codecs like this:
+//
+//    <codecs type="Vector" allowHeterogeneousChildren="1">
+//       <vectorChild type="Structure">
+//          <inputs type="Vector" allowHeterogeneousChildren="0">
+//             <vectorChild type="String"><![CDATA[timeStamp]]></vectorChild>
+//          </inputs>
+//          <xor:xorCodec type="Structure">
+//             <xor:resetInterval type="Integer" minimum="1">64</xor:resetInterval>
+//          </xor:xorCodec>
+//       </vectorChild>
+//    </codecs>
+//
+// says the Float fields listed in inputs are stored as the XOR of their IEEE-754 bits with those of
+// the previous record instead of as raw values. Each record is a LEB128 varint of
+// ( bits ^ previous ), where previous is 0 for the first record and for every record whose index
+// is a multiple of resetInterval. Neighbouring values share their sign, exponent and high mantissa
+// bits, so the XOR is a small number which takes few bytes. It is lossless for every value,
+// including NaNs.
+//
+// As with the delta codec, resetInterval must divide the first record of every chunk the index
+// packets point to, so a reader can start decoding there. The varints can be compressed further
+// with the zstd codec (see ZstdCodec.h).
+
+#include <vector>
+
+#include "Common.h"
+#include "E57Format.h"
+
+namespace e57
+{
+   /// Interval at which the predictor is reset in the files we write (see
+   /// cDeltaCodecResetInterval).
+   constexpr int64_t cXorCodecResetInterval = 64;
+
+   /// If @a cVector's codecs say @a pathName is XOR encoded, set @a resetInterval and return true.
+   bool findXorCodec( const CompressedVectorNodeImpl &cVector, const ustring &pathName,
+                      uint64_t &resetInterval );
+
+   /// Add an entry to @a codecs (declaring the extension if needed) to XOR encode the prototype
+   /// fields @a pathNames.
+   void addXorCodec( ImageFile imf, VectorNode &codecs, const std::vector<ustring> &pathNames );
+}
@@ -0,0 +1,482 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+
+#ifdef E57_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "ZstdCodec.h"
+#include "CompressedVectorNodeImpl.h"
+#include "Decoder.h"
+#include "DeltaCodec.h"
+#include "Encoder.h"
+#include "IntegerNodeImpl.h"
+#include "StringFunctions.h"
+
+namespace
+{
+   constexpr char cPrefix[] = "zst";
+   constexpr char cURI[] = "urn:libE57Format:E57_EXT_zstd_codec";
+   constexpr char cCodecName[] = "zstdCodec";
+   constexpr char cLevelName[] = "level";
+
+#ifdef E57_ENABLE_ZSTD
+   using namespace e57;
+
+   // Encoded bytes compressed into each frame, unless a chunk ends first
+   constexpr size_t cFrameSize = 128 * 1024;
+
+   // Decompressed bytes held for the decoder at a time
+   constexpr size_t cDecompressedSize = 64 * 1024;
+
+   class ZstdEncoder : public Encoder
+   {
+   public:
+      ZstdEncoder( std::shared_ptr<Encoder> encoder, int level ) :
+         Encoder( encoder->bytestreamNumber() ), encoder_( std::move( encoder ) ), level_( level ),
+         context_( ZSTD_createCCtx() )
+      {
+         if ( context_ == nullptr )
+         {
+            throw E57_EXCEPTION2( ErrorInternal, "ZSTD_createCCtx failed" );
+         }
+      }
+
+      ~ZstdEncoder() override
+      {
+         ZSTD_freeCCtx( context_ );
+      }
+
+      ZstdEncoder( const ZstdEncoder & ) = delete;
+      ZstdEncoder &operator=( const ZstdEncoder & ) = delete;
+
+      uint64_t processRecords( size_t recordCount ) override
+      {
+         const uint64_t result = encoder_->processRecords( recordCount );
+
+         takeEncoded();
+
+         if ( encoded_.size() >= cFrameSize )
+         {
+            compressFrame();
+         }
+
+         return result;
+      }
+
+      unsigned sourceBufferNextIndex() override
+      {
+         return encoder_->sourceBufferNextIndex();
+      }
+
+      uint64_t currentRecordIndex() override
+      {
+         return encoder_->currentRecordIndex();
+      }
+
+      // Before compression. It's only an estimate anyway.
+      float bitsPerRecord() override
+      {
+         return encoder_->bitsPerRecord();
+      }
+
+      bool registerFlushToOutput() override
+      {
+         const bool result = encoder_->registerFlushToOutput();
+
+         takeEncoded();
+         compressFrame();
+
+         return result;
+      }
+
+      void finishChunk() override
+      {
+         encoder_->finishChunk();
+
+         takeEncoded();
+         compressFrame();
+      }
+
+      // A reader can decompress the frames so far, and the next one just follows them
+      void flushOutput() override
+      {
+         encoder_->flushOutput();
+
+         takeEncoded();
+         compressFrame();
+      }
+
+      size_t maxOutputForRecords( size_t /*recordCount*/ ) const override
+      {
+         // Nothing comes out until a whole frame is compressed
+         return SIZE_MAX;
+      }
+
+      size_t outputAvailable() const override
+      {
+         return output_.size() - outputFirst_;
+      }
+
+      void outputRead( char *dest, size_t byteCount ) override
+      {
+         if ( byteCount > outputAvailable() )
+         {
+            throw E57_EXCEPTION2( ErrorInternal,
+                                  "byteCount=" + toString( byteCount ) +
+                                     " outputAvailable=" + toString( outputAvailable() ) );
+         }
+
+         if ( byteCount == 0 )
+         {
+            return;
+         }
+
+         memcpy( dest, &output_[outputFirst_], byteCount );
+         outputFirst_ += byteCount;
+
+         if ( outputFirst_ == output_.size() )
+         {
+            outputClear();
+         }
+      }
+
+      void outputClear() override
+      {
+         output_.clear();
+         outputFirst_ = 0;
+      }
+
+      void sourceBufferSetNew( std::vector<SourceDestBuffer> &sbufs ) override
+      {
+         encoder_->sourceBufferSetNew( sbufs );
+      }
+
+      size_t outputGetMaxSize() override
+      {
+         return encoder_->outputGetMaxSize();
+      }
+
+      void outputSetMaxSize( unsigned byteCount ) override
+      {
+         encoder_->outputSetMaxSize( byteCount );
+      }
+
+      void skipValueChecks() override
+      {
+         encoder_->skipValueChecks();
+      }
+
+      size_t bufferSize() const override
+      {
+         return encoder_->bufferSize() + encoded_.capacity() + output_.capacity() +
+                ZSTD_sizeof_CCtx( context_ );
+      }
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+      void dump( int indent, std::ostream &os ) const override
+      {
+         Encoder::dump( indent, os );
+         os << space( indent ) << "level:                    " << level_ << std::endl;
+         os << space( indent ) << "encoded.size:             " << encoded_.size() << std::endl;
+         os << space( indent ) << "outputAvailable:          " << outputAvailable() << std::endl;
+         os << space( indent ) << "encoder:" << std::endl;
+         encoder_->dump( indent + 4, os );
+      }
+#endif
+
+   private:
+      // Move everything the encoder has output into encoded_
+      void takeEncoded()
+      {
+         const size_t count = encoder_->outputAvailable();
+
+         if ( count > 0 )
+         {
+            const size_t size = encoded_.size();
+
+            encoded_.resize( size + count );
+            encoder_->outputRead( &encoded_[size], count );
+         }
+      }
+
+      // Compress encoded_ into a frame on the end of output_
+      void compressFrame()
+      {
+         if ( encoded_.empty() )
+         {
+            return;
+         }
+
+         // Shuffle down what has already been read so output_ doesn't keep growing
+         if ( outputFirst_ > 0 )
+         {
+            output_.erase( output_.begin(),
+                           output_.begin() + static_cast<std::ptrdiff_t>( outputFirst_ ) );
+            outputFirst_ = 0;
+         }
+
+         const size_t bound = ZSTD_compressBound( encoded_.size() );
+         const size_t size = output_.size();
+
+         output_.resize( size + bound );
+
+         const size_t result = ZSTD_compressCCtx( context_, &output_[size], bound, encoded_.data(),
+                                                  encoded_.size(), level_ );
+
+         if ( ZSTD_isError( result ) )
+         {
+            throw E57_EXCEPTION2( ErrorInternal, "bytestreamNumber=" +
+                                                    toString( bytestreamNumber_ ) + " zstdError=" +
+                                                    ZSTD_getErrorName( result ) );
+         }
+
+         output_.resize( size + result );
+         encoded_.clear();
+      }
+
+      std::shared_ptr<Encoder> encoder_;
+      int level_;
+      ZSTD_CCtx *context_;
+
+      /// Output of encoder_ waiting to be compressed
+      std::vector<char> encoded_;
+
+      /// Compressed frames, from outputFirst_
+      std::vector<char> output_;
+      size_t outputFirst_ = 0;
+   };
+
+   class ZstdDecoder : public Decoder
+   {
+   public:
+      explicit ZstdDecoder( std::shared_ptr<Decoder> decoder ) :
+         Decoder( decoder->bytestreamNumber() ), decoder_( std::move( decoder ) ),
+         context_( ZSTD_createDCtx() )
+      {
+         if ( context_ == nullptr )
+         {
+            throw E57_EXCEPTION2( ErrorInternal, "ZSTD_createDCtx failed" );
+         }
+      }
+
+      ~ZstdDecoder() override
+      {
+         ZSTD_freeDCtx( context_ );
+      }
+
+      ZstdDecoder( const ZstdDecoder & ) = delete;
+      ZstdDecoder &operator=( const ZstdDecoder & ) = delete;
+
+      void destBufferSetNew( std::vector<SourceDestBuffer> &dbufs ) override
+      {
+         decoder_->destBufferSetNew( dbufs );
+      }
+
+      uint64_t totalRecordsCompleted() override
+      {
+         return decoder_->totalRecordsCompleted();
+      }
+
+      size_t inputProcess( const char *source, size_t count ) override
+      {
+         static const char cNothing = 0;
+
+         decoder_->setRecordStride( recordStride_ );
+
+         size_t consumed = 0;
+
+         while ( true )
+         {
+            // Give the decoder what it will take of what is already decompressed. Even with nothing
+            // new it may have some input of its own left to decode.
+            const size_t available = decompressed_.size() - decompressedFirst_;
+
+            decompressedFirst_ += decoder_->inputProcess(
+               ( available > 0 ) ? &decompressed_[decompressedFirst_] : nullptr, available );
+
+            // If it didn't take it all, its dest buffer is full
+            if ( decompressedFirst_ < decompressed_.size() )
+            {
+               break;
+            }
+
+            // Decompress some more. With no input left this gets anything zstd is holding on
+            // to.
+            decompressed_.resize( cDecompressedSize );
+            decompressedFirst_ = 0;
+
+            ZSTD_inBuffer in = { ( source != nullptr ) ? source + consumed : &cNothing,
+                                 count - consumed, 0 };
+            ZSTD_outBuffer out = { decompressed_.data(), decompressed_.size(), 0 };
+
+            const size_t result = ZSTD_decompressStream( context_, &out, &in );
+
+            if ( ZSTD_isError( result ) )
+            {
+               throw E57_EXCEPTION2( ErrorBadCVPacket, "bytestreamNumber=" +
+                                                          toString( bytestreamNumber_ ) +
+                                                          " zstdError=" +
+                                                          ZSTD_getErrorName( result ) );
+            }
+
+            consumed += in.pos;
+            decompressed_.resize( out.pos );
+
+            if ( ( in.pos == 0 ) && ( out.pos == 0 ) )
+            {
+               break;
+            }
+         }
+
+         return consumed;
+      }
+
+      void stateReset() override
+      {
+         resetDecompression();
+         decoder_->stateReset();
+      }
+
+      // Records are variable length once compressed
+      unsigned bitsPerRecord() const override
+      {
+         return 0;
+      }
+
+      size_t bufferSize() const override
+      {
+         return decoder_->bufferSize() + decompressed_.capacity() + ZSTD_sizeof_DCtx( context_ );
+      }
+
+      void seek( uint64_t recordIndex, size_t firstBit, uint64_t skipCount ) override
+      {
+         // Chunks start a new frame
+         resetDecompression();
+         decoder_->seek( recordIndex, firstBit, skipCount );
+      }
+
+      void setMaxRecordCount( uint64_t maxRecordCount ) override
+      {
+         decoder_->setMaxRecordCount( maxRecordCount );
+      }
+
+      uint64_t skipCount() const override
+      {
+         return decoder_->skipCount();
+      }
+
+#ifdef E57_ENABLE_DIAGNOSTIC_OUTPUT
+      void dump( int indent, std::ostream &os ) override
+      {
+         os << space( indent ) << "bytestreamNumber:         " << bytestreamNumber_ << std::endl;
+         os << space( indent ) << "decompressed:             "
+            << decompressed_.size() - decompressedFirst_ << std::endl;
+         os << space( indent ) << "decoder:" << std::endl;
+         decoder_->dump( indent + 4, os );
+      }
+#endif
+
+   private:
+      void resetDecompression()
+      {
+         ZSTD_DCtx_reset( context_, ZSTD_reset_session_only );
+
+         decompressed_.clear();
+         decompressedFirst_ = 0;
+      }
+
+      std::shared_ptr<Decoder> decoder_;
+      ZSTD_DCtx *context_;
+
+      /// Decompressed input not yet taken by decoder_, from decompressedFirst_
+      std::vector<char> decompressed_;
+      size_t decompressedFirst_ = 0;
+   };
+#endif
+}
+
+namespace e57
+{
+   bool findZstdCodec( const CompressedVectorNodeImpl &cVector, const ustring &pathName,
+                       int &level )
+   {
+      ustring prefix;
+      const NodeImplSharedPtr parameters =
+         findCodecParameters( cVector, pathName, cURI, cCodecName, prefix );
+
+      if ( !parameters )
+      {
+         return false;
+      }
+
+      level = cZstdCodecDefaultLevel;
+
+      const ustring levelName = prefix + ":" + cLevelName;
+
+      if ( parameters->isDefined( levelName ) )
+      {
+         if ( parameters->get( levelName )->type() != TypeInteger )
+         {
+            throw E57_EXCEPTION2( ErrorBadCodecs, "pathName=" + pathName );
+         }
+
+         level = static_cast<int>(
+            std::static_pointer_cast<IntegerNodeImpl>( parameters->get( levelName ) )->value() );
+      }
+
+      return true;
+   }
+
+   void addZstdCodec( ImageFile imf, VectorNode &codecs, const std::vector<ustring> &pathNames,
+                      int level )
+   {
+      ustring prefix;
+      if ( !imf.extensionsLookupUri( cURI, prefix ) )
+      {
+         prefix = cPrefix;
+         imf.extensionsAdd( prefix, cURI );
+      }
+
+      VectorNode inputs( imf, false );
+      for ( const auto &pathName : pathNames )
+      {
+         inputs.append( StringNode( imf, pathName ) );
+      }
+
+      StructureNode parameters( imf );
+      parameters.set( prefix + ":" + cLevelName, IntegerNode( imf, level ) );
+
+      StructureNode codec( imf );
+      codec.set( "inputs", inputs );
+      codec.set( prefix + ":" + cCodecName, parameters );
+
+      codecs.append( codec );
+   }
+
+   std::shared_ptr<Encoder> zstdEncoder( std::shared_ptr<Encoder> encoder, int level )
+   {
+#ifdef E57_ENABLE_ZSTD
+      return std::make_shared<ZstdEncoder>( std::move( encoder ), level );
+#else
+      E57_UNUSED( level );
+
+      throw E57_EXCEPTION2( ErrorNotImplemented,
+                            "zstd codec (build with E57_ENABLE_ZSTD) bytestreamNumber=" +
+                               toString( encoder->bytestreamNumber() ) );
+#endif
+   }
+
+   std::shared_ptr<Decoder> zstdDecoder( std::shared_ptr<Decoder> decoder )
+   {
+#ifdef E57_ENABLE_ZSTD
+      return std::make_shared<ZstdDecoder>( std::move( decoder ) );
+#else
+      throw E57_EXCEPTION2( ErrorNotImplemented,
+                            "zstd codec (build with E57_ENABLE_ZSTD) bytestreamNumber=" +
+                               toString( decoder->bytestreamNumber() ) );
+#endif
+   }
+}
@@ -0,0 +1,55 @@
+#pragma once
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Support for the zstd codec extension. An entry in a CompressedVectorNode's codecs like this:
+//
+//    <codecs type="Vector" allowHeterogeneousChildren="1">
+//       <vectorChild type="Structure">
+//          <inputs type="Vector" allowHeterogeneousChildren="0">
+//             <vectorChild type="String"><![CDATA[intensity]]></vectorChild>
+//          </inputs>
+//          <zst:zstdCodec type="Structure">
+//             <zst:level type="Integer" minimum="-131072" maximum="22">3</zst:level>
+//          </zst:zstdCodec>
+//       </vectorChild>
+//    </codecs>
+//
+// says the bytestreams of the fields listed in inputs are compressed with zstd after they are
+// encoded as usual (bit-packed, or with any other codec for them such as the delta codec). The
+// bytestream is a series of zstd frames split across the data packets wherever the writer likes.
+// Every chunk the index packets point to starts a new frame, so a reader can start decompressing
+// there. The level is only used when writing, and is optional (the default is 3).
+//
+// zstd is only available if the library was built with E57_ENABLE_ZSTD. Otherwise reading or
+// writing fields which use it throws ErrorNotImplemented.
+
+#include <vector>
+
+#include "Common.h"
+#include "E57Format.h"
+
+namespace e57
+{
+   class Decoder;
+   class Encoder;
+
+   /// Level used when the codec doesn't give one
+   constexpr int cZstdCodecDefaultLevel = 3;
+
+   /// If @a cVector's codecs say @a pathName is compressed with zstd, set @a level and return
+   /// true.
+   bool findZstdCodec( const CompressedVectorNodeImpl &cVector, const ustring &pathName,
+                       int &level );
+
+   /// Add an entry to @a codecs (declaring the extension if needed) to compress the prototype
+   /// fields @a pathNames with zstd at @a level.
+   void addZstdCodec( ImageFile imf, VectorNode &codecs, const std::vector<ustring> &pathNames,
+                      int level );
+
+   /// An encoder which compresses the output of @a encoder at @a level.
+   std::shared_ptr<Encoder> zstdEncoder( std::shared_ptr<Encoder> encoder, int level );
+
+   /// A decoder which decompresses its input and passes it to @a decoder.
+   std::shared_ptr<Decoder> zstdDecoder( std::shared_ptr<Decoder> decoder );
+}
@@ -0,0 +1,600 @@
+// libE57Format testing Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "BitpackKernels.h"
+#include "E57Format.h"
+
+namespace
+{
+   const e57::KernelInstructions cAllInstructions[] = {
+      e57::KernelInstructions::None, e57::KernelInstructions::SSE41,
+      e57::KernelInstructions::AVX2, e57::KernelInstructions::NEON,
+      e57::KernelInstructions::Best,
+   };
+
+   const char *instructionsName( e57::KernelInstructions instructions )
+   {
+      switch ( instructions )
+      {
+         case e57::KernelInstructions::None:
+            return "None";
+         case e57::KernelInstructions::SSE41:
+            return "SSE41";
+         case e57::KernelInstructions::AVX2:
+            return "AVX2";
+         case e57::KernelInstructions::NEON:
+            return "NEON";
+         case e57::KernelInstructions::Best:
+            return "Best";
+      }
+
+      return "?";
+   }
+
+   // Run check() once with each set of instructions the CPU has, then go back to the best ones.
+   template <typename Check> void forEachInstructions( Check check )
+   {
+      for ( const auto instructions : cAllInstructions )
+      {
+         if ( !e57::useKernelInstructions( instructions ) )
+         {
+            continue;
+         }
+
+         SCOPED_TRACE( instructionsName( instructions ) );
+
+         check();
+      }
+
+      e57::useKernelInstructions( e57::KernelInstructions::Best );
+   }
+
+   // Pseudo-random values of bitsPerRecord bits, the same ones each run.
+   std::vector<uint64_t> randomRaw( size_t count, unsigned bitsPerRecord )
+   {
+      std::mt19937_64 engine( 57 + bitsPerRecord );
+
+      const uint64_t mask =
+         ( bitsPerRecord == 64 ) ? ~uint64_t( 0 ) : ( ( uint64_t( 1 ) << bitsPerRecord ) - 1 );
+
+      std::vector<uint64_t> raw( count );
+      for ( auto &value : raw )
+      {
+         value = engine() & mask;
+      }
+
+      return raw;
+   }
+
+   // Pack the values one bit at a time, least significant bit first, starting at bit firstBit.
+   // The bits before firstBit are taken from filler, and the ones after the last value are zero.
+   std::vector<char> referencePack( const std::vector<uint64_t> &raw, unsigned bitsPerRecord,
+                                    size_t firstBit, uint8_t filler = 0 )
+   {
+      const size_t bitCount = firstBit + raw.size() * bitsPerRecord;
+
+      std::vector<char> packed( ( bitCount + 7 ) / 8, 0 );
+
+      for ( size_t bit = 0; bit < firstBit; ++bit )
+      {
+         if ( ( filler >> ( bit % 8 ) ) & 1 )
+         {
+            packed[bit / 8] = static_cast<char>( packed[bit / 8] | ( 1 << ( bit % 8 ) ) );
+         }
+      }
+
+      size_t bit = firstBit;
+      for ( const uint64_t value : raw )
+      {
+         for ( unsigned i = 0; i < bitsPerRecord; ++i, ++bit )
+         {
+            if ( ( value >> i ) & 1 )
+            {
+               packed[bit / 8] = static_cast<char>( packed[bit / 8] | ( 1 << ( bit % 8 ) ) );
+            }
+         }
+      }
+
+      return packed;
+   }
+
+   // Unpack raw from a buffer holding exactly its bits, and compare with raw + minimum.
+   template <typename T>
+   void checkUnpack( const std::vector<uint64_t> &raw, unsigned bitsPerRecord, size_t firstBit,
+                     int64_t minimum )
+   {
+      const std::vector<char> packed = referencePack( raw, bitsPerRecord, firstBit );
+
+      std::vector<T> out( raw.size() );
+      e57::unpackBits( packed.data(), packed.size(), firstBit, bitsPerRecord, minimum, raw.size(),
+                       out.data() );
+
+      for ( size_t i = 0; i < raw.size(); ++i )
+      {
+         const auto expected =
+            static_cast<T>( static_cast<int64_t>( raw[i] + static_cast<uint64_t>( minimum ) ) );
+
+         ASSERT_EQ( out[i], expected ) << "bitsPerRecord=" << bitsPerRecord
+                                       << " firstBit=" << firstBit << " i=" << i;
+      }
+   }
+}
+
+TEST( BitpackKernels, UseKernelInstructions )
+{
+   EXPECT_TRUE( e57::useKernelInstructions( e57::KernelInstructions::None ) );
+   EXPECT_TRUE( e57::useKernelInstructions( e57::KernelInstructions::Best ) );
+}
+
+// Every width at each bit offset in the first two bytes, with enough values to go through the
+// kernels' loops and the scalar code after them.
+TEST( BitpackKernels, UnpackBitsMatchesReference )
+{
+   constexpr size_t cCount = 531;
+
+   forEachInstructions( [] {
+      for ( unsigned bitsPerRecord = 1; bitsPerRecord <= 64; ++bitsPerRecord )
+      {
+         const std::vector<uint64_t> raw = randomRaw( cCount, bitsPerRecord );
+
+         for ( size_t firstBit = 0; firstBit < 16; ++firstBit )
+         {
+            checkUnpack<int64_t>( raw, bitsPerRecord, firstBit, -12345 );
+
+            // The smallest type holding the values, with a minimum which uses its whole range
+            const int64_t minimum =
+               ( bitsPerRecord < 64 ) ? -( int64_t( 1 ) << ( bitsPerRecord - 1 ) ) : 0;
+
+            if ( bitsPerRecord <= 8 )
+            {
+               checkUnpack<int8_t>( raw, bitsPerRecord, firstBit, minimum );
+            }
+            else if ( bitsPerRecord <= 16 )
+            {
+               checkUnpack<int16_t>( raw, bitsPerRecord, firstBit, minimum );
+            }
+            else if ( bitsPerRecord <= 32 )
+            {
+               checkUnpack<int32_t>( raw, bitsPerRecord, firstBit, minimum );
+            }
+         }
+      }
+   } );
+}
+
+// Bytes worked out by hand, repeated so the kernels see them too.
+TEST( BitpackKernels, UnpackBitsKnownBytes )
+{
+   struct Pattern
+   {
+      unsigned bitsPerRecord;
+      std::vector<uint8_t> bytes;
+      std::vector<uint64_t> values;
+   };
+
+   const Pattern patterns[] = {
+      { 1, { 0x8D }, { 1, 0, 1, 1, 0, 0, 0, 1 } },
+      { 3, { 0xD1, 0x58, 0x1F }, { 1, 2, 3, 4, 5, 6, 7, 0 } },
+      { 8, { 0x00, 0x7F, 0x80, 0xFF }, { 0x00, 0x7F, 0x80, 0xFF } },
+      { 12, { 0x23, 0x61, 0x45 }, { 0x123, 0x456 } },
+      { 16, { 0x34, 0x12, 0xFF, 0xFF }, { 0x1234, 0xFFFF } },
+      { 32, { 0x78, 0x56, 0x34, 0x12 }, { 0x12345678 } },
+      { 64,
+        { 0xEF, 0xCD, 0xAB, 0x89, 0x67, 0x45, 0x23, 0x01 },
+        { UINT64_C( 0x0123456789ABCDEF ) } },
+   };
+
+   constexpr size_t cRepeat = 100;
+
+   forEachInstructions( [&] {
+      for ( const auto &pattern : patterns )
+      {
+         std::vector<char> bytes;
+         std::vector<uint64_t> expected;
+
+         for ( size_t i = 0; i < cRepeat; ++i )
+         {
+            bytes.insert( bytes.end(), pattern.bytes.begin(), pattern.bytes.end() );
+            expected.insert( expected.end(), pattern.values.begin(), pattern.values.end() );
+         }
+
+         ASSERT_EQ( referencePack( expected, pattern.bitsPerRecord, 0 ), bytes );
+
+         std::vector<int64_t> out( expected.size() );
+         e57::unpackBits( bytes.data(), bytes.size(), 0, pattern.bitsPerRecord, 0,
+                          expected.size(), out.data() );
+
+         for ( size_t i = 0; i < expected.size(); ++i )
+         {
+            ASSERT_EQ( static_cast<uint64_t>( out[i] ), expected[i] )
+               << "bitsPerRecord=" << pattern.bitsPerRecord << " i=" << i;
+         }
+      }
+   } );
+
+   // A 64 bit value starting half way through a byte
+   const uint8_t shifted[] = { 0xFA, 0xDE, 0xBC, 0x9A, 0x78, 0x56, 0x34, 0x12, 0x00 };
+
+   int64_t value = 0;
+   e57::unpackBits( reinterpret_cast<const char *>( shifted ), sizeof( shifted ), 4, 64, 0, 1,
+                    &value );
+
+   EXPECT_EQ( static_cast<uint64_t>( value ), UINT64_C( 0x0123456789ABCDEF ) );
+}
+
+// packBits() gives exactly the reference's bytes for every width and bit offset, keeping the
+// bits before firstBit and clearing the ones after the last value.
+TEST( BitpackKernels, PackBitsMatchesReference )
+{
+   constexpr size_t cCount = 531;
+   constexpr uint8_t cFiller = 0xA5;
+
+   forEachInstructions( [] {
+      for ( unsigned bitsPerRecord = 1; bitsPerRecord <= 64; ++bitsPerRecord )
+      {
+         const std::vector<uint64_t> raw = randomRaw( cCount, bitsPerRecord );
+         const std::vector<uint32_t> raw32( raw.begin(), raw.end() );
+
+         for ( size_t firstBit = 0; firstBit < 16; ++firstBit )
+         {
+            const std::vector<char> expected =
+               referencePack( raw, bitsPerRecord, firstBit, cFiller );
+
+            // packBits() may write up to 16 bytes after the last one
+            std::vector<char> packed( expected.size() + 16, static_cast<char>( cFiller ) );
+
+            e57::packBits( raw.data(), cCount, bitsPerRecord, firstBit, packed.data() );
+
+            ASSERT_TRUE( std::equal( expected.begin(), expected.end(), packed.begin() ) )
+               << "uint64_t bitsPerRecord=" << bitsPerRecord << " firstBit=" << firstBit;
+
+            if ( bitsPerRecord <= 32 )
+            {
+               packed.assign( expected.size() + 16, static_cast<char>( cFiller ) );
+
+               e57::packBits( raw32.data(), cCount, bitsPerRecord, firstBit, packed.data() );
+
+               ASSERT_TRUE( std::equal( expected.begin(), expected.end(), packed.begin() ) )
+                  << "uint32_t bitsPerRecord=" << bitsPerRecord << " firstBit=" << firstBit;
+            }
+         }
+      }
+   } );
+}
+
+namespace
+{
+   // What a kernel returned, and the bytes it stored
+   struct KernelResult
+   {
+      size_t count = 0;
+      std::vector<char> bytes;
+   };
+
+   template <typename T> KernelResult kernelResult( size_t count, const std::vector<T> &out )
+   {
+      const auto bytes = reinterpret_cast<const char *>( out.data() );
+
+      return { count, std::vector<char>( bytes, bytes + out.size() * sizeof( T ) ) };
+   }
+
+   // Run run() with only the scalar code, and then with each set of instructions the CPU has,
+   // and check they all return the same count and store exactly the same bits.
+   template <typename Run> void checkSameAsScalar( Run run )
+   {
+      e57::useKernelInstructions( e57::KernelInstructions::None );
+
+      const KernelResult expected = run();
+
+      forEachInstructions( [&] {
+         const KernelResult result = run();
+
+         EXPECT_EQ( result.count, expected.count );
+         EXPECT_TRUE( result.bytes == expected.bytes );
+      } );
+   }
+
+   // Raw values around the edges of the 48 and 16 bit halves the kernels convert separately,
+   // values which round when converted to double, and the extremes.
+   std::vector<int64_t> edgeRawValues()
+   {
+      std::vector<int64_t> raw{ 0, INT64_MAX, INT64_MIN, INT64_MIN + 1 };
+
+      for ( const unsigned bit : { 15u, 16u, 17u, 31u, 32u, 47u, 48u, 49u, 51u, 52u, 53u, 62u } )
+      {
+         const int64_t power = int64_t( 1 ) << bit;
+
+         for ( const int64_t delta : { -1, 0, 1 } )
+         {
+            raw.push_back( power + delta );
+            raw.push_back( -power - delta );
+         }
+      }
+
+      // Below and above halfway between doubles (256 apart here), and ties
+      for ( const int64_t low : { 0x7F, 0x80, 0x81, 0x180, 0x7FFF, 0x8000, 0xFFFF } )
+      {
+         raw.push_back( ( int64_t( 1 ) << 60 ) + low );
+         raw.push_back( -( int64_t( 1 ) << 60 ) - low );
+         raw.push_back( INT64_C( 0x0123456789AB0000 ) + low );
+      }
+
+      std::mt19937_64 engine( 57 );
+
+      for ( unsigned i = 0; i < 500; ++i )
+      {
+         const auto value = static_cast<int64_t>( engine() );
+
+         // Full range, and small enough to scale exactly
+         raw.push_back( value );
+         raw.push_back( value >> 40 );
+      }
+
+      return raw;
+   }
+
+   struct ScaleParameters
+   {
+      double scale;
+      double offset;
+      double origin;
+   };
+
+   const ScaleParameters cScaleParameters[] = {
+      { 1.0, 0.0, 0.0 },           { 0.001, 0.0, 0.0 },         { 0.1, 1.0e6, 0.0 },
+      { 1.0e-5, -3.5, 1000.25 },   { 3.0, 0.0, 0.0 },           { 0.0005, 123.456, 123.0 },
+      { 1.0e-12, 0.0, 0.0 },       { -0.25, 0.0, -17.0 },
+   };
+}
+
+// Scaling gives exactly the same doubles and floats with every instruction set, for every count
+// up to a few vectors and for the whole array.
+TEST( BitpackKernels, ScaleValuesMatchesScalar )
+{
+   const std::vector<int64_t> raw = edgeRawValues();
+
+   for ( const auto &parameters : cScaleParameters )
+   {
+      SCOPED_TRACE( "scale=" + std::to_string( parameters.scale ) );
+
+      for ( size_t count = 0; count <= raw.size(); count = ( count < 17 ) ? count + 1 : raw.size() )
+      {
+         checkSameAsScalar( [&] {
+            std::vector<double> out( count );
+            e57::scaleValues( raw.data(), count, parameters.scale, parameters.offset,
+                              parameters.origin, out.data() );
+
+            return kernelResult( count, out );
+         } );
+
+         checkSameAsScalar( [&] {
+            std::vector<float> out( count );
+            e57::scaleValues( raw.data(), count, parameters.scale, parameters.offset,
+                              parameters.origin, out.data() );
+
+            return kernelResult( count, out );
+         } );
+
+         if ( count == raw.size() )
+         {
+            break;
+         }
+      }
+   }
+}
+
+// Scaling to half precision stops at the first value too large for it, wherever that is.
+TEST( BitpackKernels, ScaleValuesFloat16Stop )
+{
+   constexpr size_t cCount = 600;
+
+   for ( const size_t stop : { size_t( 0 ), size_t( 1 ), size_t( 2 ), size_t( 3 ), size_t( 4 ),
+                               size_t( 5 ), size_t( 7 ), size_t( 8 ), size_t( 255 ), size_t( 256 ),
+                               size_t( 257 ), size_t( 599 ), cCount } )
+   {
+      SCOPED_TRACE( "stop=" + std::to_string( stop ) );
+
+      std::vector<int64_t> raw( cCount );
+      for ( size_t i = 0; i < cCount; ++i )
+      {
+         raw[i] = static_cast<int64_t>( i ) - 300;
+      }
+
+      if ( stop < cCount )
+      {
+         raw[stop] = 6551; // 65510.5 when scaled
+      }
+
+      checkSameAsScalar( [&] {
+         std::vector<e57::Float16> out( cCount );
+         const size_t count = e57::scaleValues( raw.data(), cCount, 10.0, 0.5, 0.0, out.data() );
+
+         EXPECT_EQ( count, stop );
+
+         std::vector<uint16_t> bits( count );
+         for ( size_t i = 0; i < count; ++i )
+         {
+            bits[i] = out[i].bits;
+         }
+
+         return kernelResult( count, bits );
+      } );
+   }
+}
+
+// Unscaling gives exactly the same raw values with every instruction set, and stops at the same
+// place: the first result which is NaN or not less than 2^51 in magnitude.
+TEST( BitpackKernels, UnscaleValuesMatchesScalar )
+{
+   constexpr double cLimit = 2251799813685248.0; // 2^51
+
+   std::vector<double> in{ 0.0,
+                           -0.0,
+                           0.5,
+                           -0.5,
+                           1.5,
+                           2.5,
+                           -2.5,
+                           0.49999999999999994,
+                           cLimit - 1.0,
+                           -( cLimit - 1.0 ),
+                           cLimit - 1.5,
+                           -cLimit + 0.5,
+                           1.0e15,
+                           -1.0e15,
+                           std::nextafter( 0.5, 0.0 ),
+                           std::nextafter( -0.5, 0.0 ) };
+
+   std::mt19937_64 engine( 57 );
+   std::uniform_real_distribution<double> distribution( -1.0e9, 1.0e9 );
+
+   while ( in.size() < 1000 )
+   {
+      in.push_back( distribution( engine ) );
+   }
+
+   for ( const auto &parameters : cScaleParameters )
+   {
+      SCOPED_TRACE( "scale=" + std::to_string( parameters.scale ) );
+
+      // Only these parameters keep the edge values in range
+      const bool edgesInRange = ( parameters.scale == 1.0 ) && ( parameters.offset == 0.0 );
+
+      const size_t first = edgesInRange ? 0 : 16;
+
+      checkSameAsScalar( [&] {
+         std::vector<int64_t> raw( in.size() - first );
+         const size_t count = e57::unscaleValues( in.data() + first, raw.size(),
+                                                  parameters.scale, parameters.offset, raw.data() );
+
+         return kernelResult( count, raw );
+      } );
+   }
+
+   // Values which stop it, at each position in the vectors and after them
+   const double cStoppers[] = {
+      std::numeric_limits<double>::quiet_NaN(),
+      std::numeric_limits<double>::infinity(),
+      -std::numeric_limits<double>::infinity(),
+      cLimit,
+      -cLimit,
+      cLimit - 0.5, // rounds up to 2^51
+      -cLimit - 0.5,
+      1.0e300,
+   };
+
+   for ( const double stopper : cStoppers )
+   {
+      for ( const size_t stop : { size_t( 0 ), size_t( 1 ), size_t( 2 ), size_t( 3 ), size_t( 4 ),
+                                  size_t( 5 ), size_t( 6 ), size_t( 7 ), size_t( 8 ),
+                                  size_t( 9 ), size_t( 500 ), size_t( 983 ) } )
+      {
+         SCOPED_TRACE( "stopper=" + std::to_string( stopper ) +
+                       " stop=" + std::to_string( stop ) );
+
+         std::vector<double> stopped( in.begin() + 16, in.end() );
+         stopped[stop] = stopper;
+
+         checkSameAsScalar( [&] {
+            std::vector<int64_t> raw( stopped.size() );
+            const size_t count = e57::unscaleValues( stopped.data(), stopped.size(), 1.0, 0.0,
+                                                     raw.data() );
+
+            EXPECT_EQ( count, stop );
+
+            raw.resize( count );
+
+            return kernelResult( count, raw );
+         } );
+      }
+   }
+}
+
+// BitUnpacker and BitPacker pick their functions from tables indexed by the width. Check each
+// entry, including width 0 and 32 bit values packed into wider fields, reusing the objects for
+// runs of values which carry on from where the last one stopped.
+TEST( BitpackKernels, WidthTables )
+{
+   constexpr size_t cFirstBit = 3;
+   constexpr uint8_t cFiller = 0xA5;
+
+   // The runs of values, with the ones after them making up 531 in all
+   const size_t cRuns[] = { 1, 7, 8, 64, 100, 9, 342 };
+
+   forEachInstructions( [&] {
+      for ( unsigned bitsPerRecord = 0; bitsPerRecord <= 64; ++bitsPerRecord )
+      {
+         SCOPED_TRACE( "bitsPerRecord=" + std::to_string( bitsPerRecord ) );
+
+         const e57::BitUnpacker unpacker( bitsPerRecord );
+         const e57::BitPacker packer( bitsPerRecord );
+
+         ASSERT_EQ( unpacker.bitsPerRecord(), bitsPerRecord );
+         ASSERT_EQ( packer.bitsPerRecord(), bitsPerRecord );
+
+         const std::vector<uint64_t> raw = randomRaw( 531, bitsPerRecord );
+
+         std::vector<uint32_t> raw32( raw.size() );
+         std::vector<uint64_t> low32( raw.size() );
+
+         for ( size_t i = 0; i < raw.size(); ++i )
+         {
+            raw32[i] = static_cast<uint32_t>( raw[i] );
+            low32[i] = raw32[i];
+         }
+
+         const std::vector<char> packed = referencePack( raw, bitsPerRecord, cFirstBit, cFiller );
+
+         // Unpack in runs, each starting at the bit after the last
+         std::vector<int64_t> out( raw.size() );
+
+         size_t done = 0;
+         for ( const size_t run : cRuns )
+         {
+            unpacker.unpack( packed.data(), packed.size(), cFirstBit + done * bitsPerRecord,
+                             -5, run, out.data() + done );
+            done += run;
+         }
+
+         ASSERT_EQ( done, raw.size() );
+
+         for ( size_t i = 0; i < raw.size(); ++i )
+         {
+            ASSERT_EQ( static_cast<uint64_t>( out[i] + 5 ), raw[i] ) << "i=" << i;
+         }
+
+         // Pack the same runs, 64 and 32 bit values, into buffers starting with the filler
+         const auto packRuns = [&]( const auto *values ) {
+            std::vector<char> buffer( packed.size() + 16, static_cast<char>( cFiller ) );
+
+            size_t packedCount = 0;
+            for ( const size_t run : cRuns )
+            {
+               packer.pack( values + packedCount, run, cFirstBit + packedCount * bitsPerRecord,
+                            buffer.data() );
+               packedCount += run;
+            }
+
+            return buffer;
+         };
+
+         const std::vector<char> packed64 = packRuns( raw.data() );
+         EXPECT_TRUE( std::equal( packed.begin(), packed.end(), packed64.begin() ) );
+
+         const std::vector<char> expected32 =
+            referencePack( low32, bitsPerRecord, cFirstBit, cFiller );
+         const std::vector<char> packed32 = packRuns( raw32.data() );
+
+         EXPECT_TRUE( std::equal( expected32.begin(), expected32.end(), packed32.begin() ) );
+      }
+   } );
+}
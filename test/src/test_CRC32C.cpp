@@ -0,0 +1,123 @@
+// libE57Format testing Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "CRC.h"
+
+#include "CRC32C.h"
+
+namespace
+{
+   // CRCpp's table-driven CRC-32C, which is what the library used before it had the hardware one.
+   uint32_t crc32cTable( const char *buf, size_t size )
+   {
+      static const CRC::Parameters<crcpp_uint32, 32> sCRCParams{ 0x1EDC6F41, 0xFFFFFFFF, 0xFFFFFFFF,
+                                                                 true, true };
+
+      static const CRC::Table<crcpp_uint32, 32> sCRCTable = sCRCParams.MakeTable();
+
+      return CRC::Calculate<crcpp_uint32, 32>( buf, size, sCRCTable );
+   }
+
+   // Pseudo-random bytes, the same ones each run.
+   std::vector<char> randomBytes( size_t inSize )
+   {
+      std::mt19937 engine( 57 );
+      std::uniform_int_distribution<int> distribution( 0, 255 );
+
+      std::vector<char> bytes( inSize );
+      for ( auto &byte : bytes )
+      {
+         byte = static_cast<char>( distribution( engine ) );
+      }
+
+      return bytes;
+   }
+}
+
+// The check values from RFC 3720 (iSCSI), appendix B.4
+TEST( CRC32C, KnownValues )
+{
+   std::vector<char> bytes( 32, 0 );
+   EXPECT_EQ( e57::crc32c( bytes.data(), bytes.size() ), 0x8A9136AAu );
+   EXPECT_EQ( e57::crc32c( bytes.data(), 0 ), 0u );
+
+   bytes.assign( 32, static_cast<char>( 0xFF ) );
+   EXPECT_EQ( e57::crc32c( bytes.data(), bytes.size() ), 0x62A8AB43u );
+
+   for ( size_t i = 0; i < bytes.size(); ++i )
+   {
+      bytes[i] = static_cast<char>( i );
+   }
+   EXPECT_EQ( e57::crc32c( bytes.data(), bytes.size() ), 0x46DD794Eu );
+
+   for ( size_t i = 0; i < bytes.size(); ++i )
+   {
+      bytes[i] = static_cast<char>( 31 - i );
+   }
+   EXPECT_EQ( e57::crc32c( bytes.data(), bytes.size() ), 0x113FDB5Cu );
+
+   EXPECT_EQ( e57::crc32c( "123456789", 9 ), 0xE3069283u );
+}
+
+// Every length up to two pages, starting at every alignment, so the hardware version's word loop
+// and the bytes before and after it are all covered.
+TEST( CRC32C, MatchesTable )
+{
+   constexpr size_t cMaxSize = 2048;
+   constexpr size_t cMaxOffset = 16;
+
+   const std::vector<char> bytes = randomBytes( cMaxSize + cMaxOffset );
+
+   for ( size_t offset = 0; offset < cMaxOffset; ++offset )
+   {
+      for ( size_t size = 0; size <= cMaxSize; ++size )
+      {
+         const char *start = bytes.data() + offset;
+
+         ASSERT_EQ( e57::crc32c( start, size ), crc32cTable( start, size ) )
+            << "offset=" << offset << " size=" << size;
+      }
+   }
+}
+
+// Each block's CRC is the one crc32c() gives it, for enough blocks to go through the groups of
+// four and the ones left over, and nothing after the last one is written.
+TEST( CRC32C, BlocksMatchSingle )
+{
+   constexpr size_t cMaxCount = 9;
+   constexpr size_t cStride = 1024;
+
+   const std::vector<char> bytes = randomBytes( cMaxCount * cStride + 16 );
+
+   // Pages' logical parts (as CheckedFile uses it), whole blocks, and sizes around the word loop
+   for ( const size_t size : { size_t( 1020 ), size_t( 1024 ), size_t( 1 ), size_t( 7 ),
+                               size_t( 8 ), size_t( 9 ), size_t( 100 ) } )
+   {
+      for ( const size_t offset : { size_t( 0 ), size_t( 3 ) } )
+      {
+         for ( size_t count = 1; count <= cMaxCount; ++count )
+         {
+            const char *start = bytes.data() + offset;
+
+            std::vector<uint32_t> crcs( cMaxCount + 1, 0xDEADBEEF );
+            e57::crc32cBlocks( start, cStride, size, count, crcs.data() );
+
+            for ( size_t i = 0; i < count; ++i )
+            {
+               ASSERT_EQ( crcs[i], e57::crc32c( start + i * cStride, size ) )
+                  << "size=" << size << " offset=" << offset << " count=" << count << " i=" << i;
+            }
+
+            for ( size_t i = count; i < crcs.size(); ++i )
+            {
+               ASSERT_EQ( crcs[i], 0xDEADBEEFu ) << "count=" << count << " i=" << i;
+            }
+         }
+      }
+   }
+}
@@ -0,0 +1,137 @@
+// libE57Format testing Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <random>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "CheckedFile.h"
+
+namespace
+{
+   // The size of the buffer text is written through, from CheckedFile::operator<<
+   constexpr size_t cTextBufferSize = 1024 * 1024;
+
+   // Pseudo-random printable text and line ends, the same each run.
+   std::string randomText( size_t inSize )
+   {
+      std::mt19937 engine( 57 );
+      std::uniform_int_distribution<int> distribution( 31, 126 );
+
+      std::string text( inSize, ' ' );
+      for ( auto &c : text )
+      {
+         const int value = distribution( engine );
+         c = ( value == 31 ) ? '\n' : static_cast<char>( value );
+      }
+
+      return text;
+   }
+
+   // The first inSize logical bytes of a file written by CheckedFile. (Its length is a whole
+   // number of pages when it is read.)
+   std::string readStart( const std::string &inFileName, size_t inSize )
+   {
+      e57::CheckedFile file( inFileName, e57::CheckedFile::Read, e57::ChecksumAll );
+
+      std::string contents( inSize, '\0' );
+      file.read( &contents[0], contents.size() );
+
+      file.close();
+
+      return contents;
+   }
+}
+
+// Text written with operator<<, in pieces and in one piece larger than the buffer, with reads of
+// the position part way through, comes back byte for byte.
+TEST( CheckedFile, TextOverBufferSize )
+{
+   const std::string cFileName = "./CheckedFileText.e57";
+   const std::string cBigText = randomText( cTextBufferSize + cTextBufferSize / 2 );
+
+   std::string expected;
+
+   {
+      e57::CheckedFile file( cFileName, e57::CheckedFile::Write, e57::ChecksumAll );
+
+      // Binary sections come before the XML
+      const std::string binary = randomText( 5000 );
+      file.write( binary.data(), binary.size() );
+      expected += binary;
+
+      for ( int64_t i = 0; expected.size() < 2 * cTextBufferSize; ++i )
+      {
+         const std::string element = "<child" + std::to_string( i ) + " type=\"Integer\">";
+
+         file << element << i << "</child>\n";
+         expected += element + std::to_string( i ) + "</child>\n";
+
+         // Something which flushes the text now and then
+         if ( i % 10007 == 0 )
+         {
+            ASSERT_EQ( file.position(), expected.size() );
+         }
+      }
+
+      file << cBigText << UINT64_MAX << "\n";
+      expected += cBigText + std::to_string( UINT64_MAX ) + "\n";
+
+      EXPECT_EQ( file.length(), expected.size() );
+
+      // What is still in the buffer is written when the file is closed
+      file << "</e57Root>\n";
+      expected += "</e57Root>\n";
+
+      file.close();
+   }
+
+   EXPECT_TRUE( readStart( cFileName, expected.size() ) == expected );
+}
+
+// An XML section of more than one buffer reads back with the same values.
+TEST( CheckedFile, XmlOverBufferSize )
+{
+   const std::string cFileName = "./CheckedFileXml.e57";
+   const std::string cBigText = randomText( cTextBufferSize + cTextBufferSize / 2 );
+
+   constexpr int64_t cCount = 50000;
+
+   {
+      e57::ImageFile imf( cFileName, "w" );
+
+      e57::StructureNode root = imf.root();
+      root.set( "text", e57::StringNode( imf, cBigText ) );
+
+      e57::VectorNode values( imf, true );
+      root.set( "values", values );
+
+      for ( int64_t i = 0; i < cCount; ++i )
+      {
+         values.append( e57::IntegerNode( imf, i * 7919 ) );
+         values.append( e57::FloatNode( imf, static_cast<double>( i ) / 3.0 ) );
+      }
+
+      imf.close();
+   }
+
+   {
+      e57::ImageFile imf( cFileName, "r" );
+
+      e57::StructureNode root = imf.root();
+      EXPECT_TRUE( e57::StringNode( root.get( "text" ) ).value() == cBigText );
+
+      const e57::VectorNode values( root.get( "values" ) );
+      ASSERT_EQ( values.childCount(), 2 * cCount );
+
+      for ( int64_t i = 0; i < cCount; ++i )
+      {
+         ASSERT_EQ( e57::IntegerNode( values.get( 2 * i ) ).value(), i * 7919 );
+         ASSERT_EQ( e57::FloatNode( values.get( 2 * i + 1 ) ).value(),
+                    static_cast<double>( i ) / 3.0 );
+      }
+
+      imf.close();
+   }
+}
@@ -0,0 +1,3474 @@
+// libE57Format testing Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "E57Format.h"
+#include "E57Transcode.h"
+#include "E57TypedReader.h"
+
+#include "Helpers.h"
+
+namespace
+{
+   constexpr int64_t cNumRecords = 20000;
+   constexpr int64_t cConstantValue = 7;
+   constexpr size_t cBufferSize = 100;
+
+   inline std::string labelFor( int64_t inIndex )
+   {
+      return "r" + std::to_string( inIndex );
+   }
+
+   // Add a CompressedVector called "inName" with fixed-width integer & float fields, a string
+   // field, and a constant integer field to the root of "ioImageFile".
+   e57::CompressedVectorNode addTestVector( e57::ImageFile &ioImageFile,
+                                            const e57::ustring &inName )
+   {
+      e57::StructureNode proto( ioImageFile );
+      proto.set( "index", e57::IntegerNode( ioImageFile, 0, 0, cNumRecords - 1 ) );
+      proto.set( "value", e57::FloatNode( ioImageFile, 0.0, e57::PrecisionSingle ) );
+      proto.set( "label", e57::StringNode( ioImageFile ) );
+      proto.set( "constant", e57::IntegerNode( ioImageFile, cConstantValue, cConstantValue,
+                                               cConstantValue ) );
+
+      e57::VectorNode codecs( ioImageFile, true );
+      e57::CompressedVectorNode cv( ioImageFile, proto, codecs );
+      ioImageFile.root().set( inName, cv );
+
+      return cv;
+   }
+
+   // Write the test records to a CompressedVector created by addTestVector(). There are enough of
+   // them to span several data packets.
+   void writeTestRecords( e57::ImageFile &ioImageFile, e57::CompressedVectorNode &ioVector,
+                          const e57::CompressedVectorWriterOptions &inOptions )
+   {
+      std::vector<int64_t> index( cBufferSize );
+      std::vector<float> value( cBufferSize );
+      std::vector<e57::ustring> label( cBufferSize );
+      std::vector<int64_t> constant( cBufferSize );
+
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( ioImageFile, "index", index.data(), cBufferSize, true );
+      sbufs.emplace_back( ioImageFile, "value", value.data(), cBufferSize );
+      sbufs.emplace_back( ioImageFile, "label", &label );
+      sbufs.emplace_back( ioImageFile, "constant", constant.data(), cBufferSize, true );
+
+      e57::CompressedVectorWriter writer = ioVector.writer( sbufs, inOptions );
+
+      for ( int64_t start = 0; start < cNumRecords; start += cBufferSize )
+      {
+         for ( size_t i = 0; i < cBufferSize; ++i )
+         {
+            const int64_t record = start + static_cast<int64_t>( i );
+
+            index[i] = record;
+            value[i] = static_cast<float>( record ) * 0.5f;
+            label[i] = labelFor( record );
+            constant[i] = cConstantValue;
+         }
+
+         writer.write( cBufferSize );
+      }
+
+      writer.close();
+   }
+
+   // Write a file called "inFileName" containing one test CompressedVector called "points".
+   void writeTestFile( const e57::ustring &inFileName,
+                       const e57::CompressedVectorWriterOptions &inOptions = {},
+                       const e57::ImageFileOptions &inImageFileOptions = {} )
+   {
+      e57::ImageFile imf( inFileName, "w", inImageFileOptions );
+
+      e57::CompressedVectorNode cv = addTestVector( imf, "points" );
+
+      writeTestRecords( imf, cv, inOptions );
+
+      imf.close();
+   }
+
+   std::vector<char> fileContents( const std::string &inFileName )
+   {
+      std::ifstream file( inFileName, std::ifstream::binary );
+
+      return { std::istreambuf_iterator<char>( file ), std::istreambuf_iterator<char>() };
+   }
+
+   // Seek to "inRecord" and check that the next read returns the records starting there.
+   void checkSeek( e57::CompressedVectorReader &ioReader, int64_t inRecord,
+                   const std::vector<int64_t> &inIndex, const std::vector<float> &inValue,
+                   const std::vector<e57::ustring> &inLabel,
+                   const std::vector<int64_t> &inConstant )
+   {
+      E57_ASSERT_NO_THROW( ioReader.seek( inRecord ) );
+
+      unsigned count = 0;
+      E57_ASSERT_NO_THROW( count = ioReader.read() );
+
+      const auto cExpected = static_cast<unsigned>(
+         std::min( static_cast<int64_t>( cBufferSize ), cNumRecords - inRecord ) );
+
+      ASSERT_EQ( count, cExpected );
+
+      for ( unsigned i = 0; i < count; ++i )
+      {
+         const int64_t record = inRecord + i;
+
+         ASSERT_EQ( inIndex[i], record );
+         ASSERT_EQ( inValue[i], static_cast<float>( record ) * 0.5f );
+         ASSERT_EQ( inLabel[i], labelFor( record ) );
+         ASSERT_EQ( inConstant[i], cConstantValue );
+      }
+   }
+
+   // Check seeking around the file written by writeTestFile().
+   void checkSeeks( const e57::ustring &inFileName )
+   {
+      e57::ImageFile imf( inFileName, "r" );
+      e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+      ASSERT_EQ( cv.childCount(), cNumRecords );
+
+      std::vector<int64_t> index( cBufferSize );
+      std::vector<float> value( cBufferSize );
+      std::vector<e57::ustring> label( cBufferSize );
+      std::vector<int64_t> constant( cBufferSize );
+
+      std::vector<e57::SourceDestBuffer> dbufs;
+      dbufs.emplace_back( imf, "index", index.data(), cBufferSize, true );
+      dbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+      dbufs.emplace_back( imf, "label", &label );
+      dbufs.emplace_back( imf, "constant", constant.data(), cBufferSize, true );
+
+      e57::CompressedVectorReader reader = cv.reader( dbufs );
+
+      // Forwards, backwards, unaligned, and in the last partial buffer
+      for ( const int64_t record : { int64_t{ 0 }, int64_t{ 15000 }, int64_t{ 3 }, int64_t{ 9999 },
+                                     int64_t{ 12345 }, int64_t{ 1 }, cNumRecords - 42 } )
+      {
+         checkSeek( reader, record, index, value, label, constant );
+      }
+
+      // Seeking to the end is allowed, but there is nothing to read
+      E57_ASSERT_NO_THROW( reader.seek( cNumRecords ) );
+      EXPECT_EQ( reader.read(), 0U );
+
+      // ...and we can come back from there
+      checkSeek( reader, 500, index, value, label, constant );
+
+      E57_ASSERT_THROW( reader.seek( cNumRecords + 1 ) );
+
+      reader.close();
+      imf.close();
+   }
+
+   // Read the test CompressedVector called "inName" from "inImageFile" using "inOptions" and
+   // check every record.
+   void checkReadAll( e57::ImageFile &inImageFile,
+                      const e57::CompressedVectorReaderOptions &inOptions,
+                      const e57::ustring &inName = "points" )
+   {
+      e57::CompressedVectorNode cv( inImageFile.root().get( inName ) );
+
+      std::vector<int64_t> index( cBufferSize );
+      std::vector<float> value( cBufferSize );
+      std::vector<e57::ustring> label( cBufferSize );
+      std::vector<int64_t> constant( cBufferSize );
+
+      std::vector<e57::SourceDestBuffer> dbufs;
+      dbufs.emplace_back( inImageFile, "index", index.data(), cBufferSize, true );
+      dbufs.emplace_back( inImageFile, "value", value.data(), cBufferSize );
+      dbufs.emplace_back( inImageFile, "label", &label );
+      dbufs.emplace_back( inImageFile, "constant", constant.data(), cBufferSize, true );
+
+      e57::CompressedVectorReader reader = cv.reader( dbufs, inOptions );
+
+      // With a stride, only every recordStride'th record is read
+      const auto stride = static_cast<int64_t>( inOptions.recordStride );
+
+      int64_t record = 0;
+      int64_t recordsRead = 0;
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         for ( unsigned i = 0; i < count; ++i, record += stride )
+         {
+            ASSERT_EQ( index[i], record );
+            ASSERT_EQ( value[i], static_cast<float>( record ) * 0.5f );
+            ASSERT_EQ( label[i], labelFor( record ) );
+            ASSERT_EQ( constant[i], cConstantValue );
+         }
+
+         recordsRead += count;
+      }
+
+      EXPECT_EQ( recordsRead, ( cNumRecords + stride - 1 ) / stride );
+
+      reader.close();
+   }
+
+   // Read the whole file written by writeTestFile() using "inOptions" and check every record.
+   void checkReadAll( const e57::ustring &inFileName,
+                      const e57::CompressedVectorReaderOptions &inOptions )
+   {
+      e57::ImageFile imf( inFileName, "r" );
+
+      checkReadAll( imf, inOptions );
+
+      imf.close();
+   }
+
+   // Values of the scan-like records written by writeDeltaTestFile()
+   inline int64_t deltaTestX( int64_t inIndex )
+   {
+      return 300000 + ( inIndex % 1000 ) * 3;
+   }
+
+   inline int64_t deltaTestRow( int64_t inIndex )
+   {
+      return inIndex / 1000;
+   }
+
+   // Add the empty CompressedVector written by writeDeltaTestFile() to "imf" as "points".
+   e57::CompressedVectorNode addDeltaTestNode( e57::ImageFile &imf, bool inDelta, bool inZstd )
+   {
+      e57::StructureNode proto( imf );
+      proto.set( "x", e57::ScaledIntegerNode( imf, 0, -1000000, 1000000, 0.001 ) );
+      proto.set( "row", e57::IntegerNode( imf, 0, 0, cNumRecords ) );
+      proto.set( "value", e57::FloatNode( imf, 0.0, e57::PrecisionSingle ) );
+
+      e57::VectorNode codecs( imf, true );
+
+      if ( inDelta )
+      {
+         imf.extensionsAdd( "dlt", "urn:libE57Format:E57_EXT_delta_codec" );
+
+         e57::VectorNode inputs( imf, false );
+         inputs.append( e57::StringNode( imf, "x" ) );
+         inputs.append( e57::StringNode( imf, "row" ) );
+
+         e57::StructureNode parameters( imf );
+         parameters.set( "dlt:resetInterval", e57::IntegerNode( imf, 64, 1, INT64_MAX ) );
+
+         e57::StructureNode codec( imf );
+         codec.set( "inputs", inputs );
+         codec.set( "dlt:deltaCodec", parameters );
+
+         codecs.append( codec );
+      }
+
+      if ( inZstd )
+      {
+         imf.extensionsAdd( "zst", "urn:libE57Format:E57_EXT_zstd_codec" );
+
+         e57::VectorNode inputs( imf, false );
+         inputs.append( e57::StringNode( imf, "x" ) );
+         inputs.append( e57::StringNode( imf, "row" ) );
+         inputs.append( e57::StringNode( imf, "value" ) );
+
+         e57::StructureNode parameters( imf );
+         parameters.set( "zst:level", e57::IntegerNode( imf, 3, -131072, 22 ) );
+
+         e57::StructureNode codec( imf );
+         codec.set( "inputs", inputs );
+         codec.set( "zst:zstdCodec", parameters );
+
+         codecs.append( codec );
+      }
+
+      e57::CompressedVectorNode cv( imf, proto, codecs );
+      imf.root().set( "points", cv );
+
+      return cv;
+   }
+
+   // Write scan-like records to a CompressedVector called "points", storing its integer fields
+   // with the delta codec if "inDelta" is set, and compressing all of them with zstd if "inZstd" is
+   // set.
+   void writeDeltaTestFile( const e57::ustring &inFileName, bool inDelta,
+                            const e57::CompressedVectorWriterOptions &inOptions = {},
+                            bool inZstd = false )
+   {
+      e57::ImageFile imf( inFileName, "w" );
+
+      e57::CompressedVectorNode cv = addDeltaTestNode( imf, inDelta, inZstd );
+
+      std::vector<int64_t> x( cBufferSize );
+      std::vector<int64_t> row( cBufferSize );
+      std::vector<float> value( cBufferSize );
+
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "x", x.data(), cBufferSize, true );
+      sbufs.emplace_back( imf, "row", row.data(), cBufferSize, true );
+      sbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs, inOptions );
+
+      for ( int64_t start = 0; start < cNumRecords; start += cBufferSize )
+      {
+         for ( size_t i = 0; i < cBufferSize; ++i )
+         {
+            const int64_t record = start + static_cast<int64_t>( i );
+
+            x[i] = deltaTestX( record );
+            row[i] = deltaTestRow( record );
+            value[i] = static_cast<float>( record ) * 0.5f;
+         }
+
+         writer.write( cBufferSize );
+      }
+
+      writer.close();
+      imf.close();
+   }
+
+   // Read the file written by writeDeltaTestFile() from the start, then seek around it.
+   void checkDeltaTestFile( const e57::ustring &inFileName )
+   {
+      e57::ImageFile imf( inFileName, "r" );
+      e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+      ASSERT_EQ( cv.childCount(), cNumRecords );
+
+      std::vector<int64_t> x( cBufferSize );
+      std::vector<int64_t> row( cBufferSize );
+      std::vector<float> value( cBufferSize );
+
+      std::vector<e57::SourceDestBuffer> dbufs;
+      dbufs.emplace_back( imf, "x", x.data(), cBufferSize, true );
+      dbufs.emplace_back( imf, "row", row.data(), cBufferSize, true );
+      dbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+
+      e57::CompressedVectorReader reader = cv.reader( dbufs );
+
+      auto checkRecords = [&]( int64_t inFirst, unsigned inCount ) {
+         for ( unsigned i = 0; i < inCount; ++i )
+         {
+            const int64_t record = inFirst + i;
+
+            ASSERT_EQ( x[i], deltaTestX( record ) );
+            ASSERT_EQ( row[i], deltaTestRow( record ) );
+            ASSERT_EQ( value[i], static_cast<float>( record ) * 0.5f );
+         }
+      };
+
+      int64_t total = 0;
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         checkRecords( total, count );
+         total += count;
+      }
+
+      ASSERT_EQ( total, cNumRecords );
+
+      for ( const int64_t record : { int64_t{ 0 }, int64_t{ 63 }, int64_t{ 64 }, int64_t{ 1000 },
+                                     int64_t{ 12345 }, cNumRecords - 10, int64_t{ 7 } } )
+      {
+         E57_ASSERT_NO_THROW( reader.seek( record ) );
+         E57_ASSERT_NO_THROW( count = reader.read() );
+
+         ASSERT_EQ( count, std::min( cBufferSize, static_cast<size_t>( cNumRecords - record ) ) );
+         checkRecords( record, count );
+      }
+
+      reader.close();
+      imf.close();
+   }
+
+   // Values of the records written by writeXorTestFile()
+   inline double xorTestTime( int64_t inIndex )
+   {
+      return 1.7e9 + static_cast<double>( inIndex ) * 1.0e-5;
+   }
+
+   inline float xorTestValue( int64_t inIndex )
+   {
+      return static_cast<float>( inIndex % 97 ) * 0.25f - 3.0f;
+   }
+
+   // Write records of a double "timeStamp" and a float "value" to a CompressedVector called
+   // "points", storing both with the XOR codec if "inXor" is set.
+   void writeXorTestFile( const e57::ustring &inFileName, bool inXor,
+                          const e57::CompressedVectorWriterOptions &inOptions = {} )
+   {
+      e57::ImageFile imf( inFileName, "w" );
+
+      e57::StructureNode proto( imf );
+      proto.set( "timeStamp", e57::FloatNode( imf, 0.0, e57::PrecisionDouble ) );
+      proto.set( "value", e57::FloatNode( imf, 0.0, e57::PrecisionSingle ) );
+
+      e57::VectorNode codecs( imf, true );
+
+      if ( inXor )
+      {
+         imf.extensionsAdd( "xor", "urn:libE57Format:E57_EXT_xor_codec" );
+
+         e57::VectorNode inputs( imf, false );
+         inputs.append( e57::StringNode( imf, "timeStamp" ) );
+         inputs.append( e57::StringNode( imf, "value" ) );
+
+         e57::StructureNode parameters( imf );
+         parameters.set( "xor:resetInterval", e57::IntegerNode( imf, 64, 1, INT64_MAX ) );
+
+         e57::StructureNode codec( imf );
+         codec.set( "inputs", inputs );
+         codec.set( "xor:xorCodec", parameters );
+
+         codecs.append( codec );
+      }
+
+      e57::CompressedVectorNode cv( imf, proto, codecs );
+      imf.root().set( "points", cv );
+
+      std::vector<double> time( cBufferSize );
+      std::vector<float> value( cBufferSize );
+
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "timeStamp", time.data(), cBufferSize );
+      sbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs, inOptions );
+
+      for ( int64_t start = 0; start < cNumRecords; start += cBufferSize )
+      {
+         for ( size_t i = 0; i < cBufferSize; ++i )
+         {
+            time[i] = xorTestTime( start + static_cast<int64_t>( i ) );
+            value[i] = xorTestValue( start + static_cast<int64_t>( i ) );
+         }
+
+         writer.write( cBufferSize );
+      }
+
+      writer.close();
+      imf.close();
+   }
+
+   // Read the file written by writeXorTestFile() from the start, then seek around it.
+   void checkXorTestFile( const e57::ustring &inFileName )
+   {
+      e57::ImageFile imf( inFileName, "r" );
+      e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+      ASSERT_EQ( cv.childCount(), cNumRecords );
+
+      std::vector<double> time( cBufferSize );
+      std::vector<float> value( cBufferSize );
+
+      std::vector<e57::SourceDestBuffer> dbufs;
+      dbufs.emplace_back( imf, "timeStamp", time.data(), cBufferSize );
+      dbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+
+      e57::CompressedVectorReader reader = cv.reader( dbufs );
+
+      // Lossless, so the values must be exactly the same
+      auto checkRecords = [&]( int64_t inFirst, unsigned inCount ) {
+         for ( unsigned i = 0; i < inCount; ++i )
+         {
+            ASSERT_EQ( time[i], xorTestTime( inFirst + i ) );
+            ASSERT_EQ( value[i], xorTestValue( inFirst + i ) );
+         }
+      };
+
+      int64_t total = 0;
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         checkRecords( total, count );
+         total += count;
+      }
+
+      ASSERT_EQ( total, cNumRecords );
+
+      for ( const int64_t record : { int64_t{ 0 }, int64_t{ 63 }, int64_t{ 64 }, int64_t{ 1000 },
+                                     int64_t{ 12345 }, cNumRecords - 10, int64_t{ 7 } } )
+      {
+         E57_ASSERT_NO_THROW( reader.seek( record ) );
+         E57_ASSERT_NO_THROW( count = reader.read() );
+
+         ASSERT_EQ( count, std::min( cBufferSize, static_cast<size_t>( cNumRecords - record ) ) );
+         checkRecords( record, count );
+      }
+
+      reader.close();
+      imf.close();
+   }
+}
+
+TEST( CompressedVector, Seek )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorSeek.e57" ) );
+
+   checkSeeks( "./CompressedVectorSeek.e57" );
+}
+
+TEST( CompressedVector, SeekWithIndexPackets )
+{
+   e57::CompressedVectorWriterOptions options;
+   options.writeIndexPackets = true;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorSeekIndexed.e57", options ) );
+
+   checkSeeks( "./CompressedVectorSeekIndexed.e57" );
+}
+
+TEST( CompressedVector, ReadWithDecodeThreads )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorDecodeThreads.e57" ) );
+
+   e57::CompressedVectorReaderOptions options;
+   options.decodeThreadCount = 4;
+
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorDecodeThreads.e57", options ) );
+}
+
+TEST( CompressedVector, WriteWithEncodeThreads )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorEncodeSerial.e57" ) );
+
+   e57::CompressedVectorWriterOptions options;
+   options.encodeThreadCount = 4;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorEncodeThreads.e57", options ) );
+
+   // Must be byte-for-byte the same as the serial version
+   EXPECT_EQ( fileContents( "./CompressedVectorEncodeSerial.e57" ),
+              fileContents( "./CompressedVectorEncodeThreads.e57" ) );
+
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorEncodeThreads.e57", {} ) );
+}
+
+TEST( CompressedVector, WriteBehind )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorWriteSerial.e57" ) );
+
+   e57::CompressedVectorWriterOptions options;
+   options.writeBehindPacketCount = 2;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorWriteBehind.e57", options ) );
+
+   // Must be byte-for-byte the same as the serial version
+   EXPECT_EQ( fileContents( "./CompressedVectorWriteSerial.e57" ),
+              fileContents( "./CompressedVectorWriteBehind.e57" ) );
+
+   // ...including when index packets are written too
+   options.writeIndexPackets = true;
+   options.encodeThreadCount = 4;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorWriteBehindIndexed.e57", options ) );
+
+   checkSeeks( "./CompressedVectorWriteBehindIndexed.e57" );
+}
+
+TEST( CompressedVector, ReadWithReadAhead )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorReadAhead.e57" ) );
+
+   e57::CompressedVectorReaderOptions options;
+   options.readAheadPacketCount = 4;
+
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorReadAhead.e57", options ) );
+
+   options.decodeThreadCount = 4;
+
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorReadAhead.e57", options ) );
+}
+
+TEST( CompressedVector, PacketCacheSize )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorCacheSize.e57" ) );
+
+   e57::CompressedVectorReaderOptions options;
+
+   for ( const unsigned size : { 1U, 2U, 256U } )
+   {
+      options.packetCacheSize = size;
+
+      E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorCacheSize.e57", options ) );
+   }
+
+   options.packetCacheSize = 0;
+
+   E57_ASSERT_THROW( checkReadAll( "./CompressedVectorCacheSize.e57", options ) );
+}
+
+TEST( CompressedVector, DecodeTiles )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorDecodeTiles.e57" ) );
+
+   e57::CompressedVectorReaderOptions options;
+
+   // Tiles which do and don't divide the buffer size, and one larger than the buffers
+   for ( const unsigned size : { 1U, 7U, 50U, 1000U } )
+   {
+      options.decodeTileSize = size;
+
+      E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorDecodeTiles.e57", options ) );
+   }
+
+   options.decodeTileSize = 7;
+   options.decodeThreadCount = 4;
+
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorDecodeTiles.e57", options ) );
+}
+
+// Records which aren't a whole number of bytes span packets, so the decoders have to carry the
+// end of one packet over to the next.
+TEST( CompressedVector, RecordsSpanningPackets )
+{
+   constexpr int64_t cRecordCount = 200'001;
+
+   auto packed = []( int64_t inRecord ) { return ( inRecord * 7919 ) % 8192; };
+
+   e57::ImageFile imf( "./CompressedVectorRecordsSpanningPackets.e57", "w" );
+
+   e57::StructureNode proto( imf );
+   proto.set( "packed", e57::IntegerNode( imf, 0, 0, 8191 ) );
+   proto.set( "value", e57::FloatNode( imf, 0.0, e57::PrecisionDouble ) );
+
+   e57::VectorNode codecs( imf, true );
+   e57::CompressedVectorNode cv( imf, proto, codecs );
+   imf.root().set( "points", cv );
+
+   {
+      std::vector<int64_t> packedBuffer( 777 );
+      std::vector<double> valueBuffer( 777 );
+
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "packed", packedBuffer.data(), packedBuffer.size(), true );
+      sbufs.emplace_back( imf, "value", valueBuffer.data(), valueBuffer.size() );
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs );
+
+      for ( int64_t start = 0; start < cRecordCount; start += 777 )
+      {
+         const auto cCount = static_cast<size_t>( std::min<int64_t>( 777, cRecordCount - start ) );
+
+         for ( size_t i = 0; i < cCount; ++i )
+         {
+            packedBuffer[i] = packed( start + static_cast<int64_t>( i ) );
+            valueBuffer[i] = static_cast<double>( start + static_cast<int64_t>( i ) ) * 1.5;
+         }
+
+         writer.write( cCount );
+      }
+
+      writer.close();
+   }
+
+   // Buffers which hold one record, and many records
+   for ( const size_t size : { size_t{ 1 }, size_t{ 13 }, size_t{ 65'536 } } )
+   {
+      std::vector<int64_t> packedBuffer( size );
+      std::vector<double> valueBuffer( size );
+
+      std::vector<e57::SourceDestBuffer> dbufs;
+      dbufs.emplace_back( imf, "packed", packedBuffer.data(), size, true );
+      dbufs.emplace_back( imf, "value", valueBuffer.data(), size );
+
+      e57::CompressedVectorReader reader = cv.reader( dbufs );
+
+      int64_t record = 0;
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         for ( unsigned i = 0; i < count; ++i, ++record )
+         {
+            ASSERT_EQ( packedBuffer[i], packed( record ) );
+            ASSERT_EQ( valueBuffer[i], static_cast<double>( record ) * 1.5 );
+         }
+      }
+
+      reader.close();
+
+      EXPECT_EQ( record, cRecordCount );
+   }
+
+   imf.close();
+}
+
+TEST( CompressedVector, StringArena )
+{
+   constexpr int64_t cRecordCount = 20'000;
+
+   // Short strings, and ones long enough to need the 8 byte length prefix
+   auto name = []( int64_t inRecord ) {
+      return ( inRecord % 5 == 0 ) ? std::string( 130 + inRecord % 300, 'a' + inRecord % 26 )
+                                   : labelFor( inRecord );
+   };
+
+   e57::ImageFile imf( "./CompressedVectorStringArena.e57", "w" );
+
+   e57::StructureNode proto( imf );
+   proto.set( "name", e57::StringNode( imf ) );
+   proto.set( "keep", e57::IntegerNode( imf, 0, 0, 1 ) );
+
+   e57::VectorNode codecs( imf, true );
+   e57::CompressedVectorNode cv( imf, proto, codecs );
+   imf.root().set( "points", cv );
+
+   {
+      e57::StringArena nameArena;
+      std::vector<int64_t> keepBuffer( 999 );
+
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "name", &nameArena, keepBuffer.size() );
+      sbufs.emplace_back( imf, "keep", keepBuffer.data(), keepBuffer.size(), true );
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs );
+
+      for ( int64_t start = 0; start < cRecordCount; start += 999 )
+      {
+         const auto cCount = static_cast<size_t>( std::min<int64_t>( 999, cRecordCount - start ) );
+
+         nameArena.clear();
+
+         for ( size_t i = 0; i < cCount; ++i )
+         {
+            nameArena.append( name( start + static_cast<int64_t>( i ) ) );
+            keepBuffer[i] = ( ( start + static_cast<int64_t>( i ) ) % 3 ) != 0;
+         }
+
+         writer.write( cCount );
+      }
+
+      writer.close();
+   }
+
+   // An arena must hold as many strings as are written
+   {
+      e57::StringArena nameArena;
+      nameArena.append( "only one" );
+
+      std::vector<int64_t> keepBuffer( 2 );
+
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "name", &nameArena, 2 );
+      sbufs.emplace_back( imf, "keep", keepBuffer.data(), keepBuffer.size(), true );
+
+      e57::CompressedVectorNode cv2( imf, proto, e57::VectorNode( imf, true ) );
+      imf.root().set( "points2", cv2 );
+
+      e57::CompressedVectorWriter writer = cv2.writer( sbufs );
+
+      E57_ASSERT_THROW( writer.write( 2 ) );
+   }
+
+   e57::CompressedVectorReaderOptions filtered;
+   filtered.recordFilter.push_back( { "keep", 1, 1 } );
+
+   e57::CompressedVectorReaderOptions strided;
+   strided.recordStride = 7;
+
+   const std::vector<std::pair<e57::CompressedVectorReaderOptions, int64_t>> cReads{
+      { {}, 1 }, { filtered, 1 }, { strided, 7 } };
+
+   // Read everything, checking the names of the records kept
+   const auto check = [&]( std::vector<e57::SourceDestBuffer> &ioDbufs,
+                           const e57::CompressedVectorReaderOptions &inOptions, int64_t inStride,
+                           const std::function<e57::ustring( unsigned )> &inName ) {
+      e57::CompressedVectorReader reader = cv.reader( ioDbufs, inOptions );
+
+      int64_t record = 0;
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         for ( unsigned i = 0; i < count; ++i, record += inStride )
+         {
+            if ( !inOptions.recordFilter.empty() && ( record % 3 == 0 ) )
+            {
+               ++record;
+            }
+
+            ASSERT_EQ( inName( i ), name( record ) );
+         }
+      }
+
+      reader.close();
+
+      EXPECT_GE( record, cRecordCount );
+      EXPECT_LT( record, cRecordCount + inStride );
+   };
+
+   // Buffers which hold one record, and many records
+   for ( const size_t size : { size_t{ 1 }, size_t{ 13 }, size_t{ 4096 } } )
+   {
+      for ( const auto &read : cReads )
+      {
+         e57::StringArena nameArena;
+
+         std::vector<e57::SourceDestBuffer> dbufs;
+         dbufs.emplace_back( imf, "name", &nameArena, size );
+
+         check( dbufs, read.first, read.second, [&]( unsigned inIndex ) {
+            EXPECT_LT( inIndex, nameArena.size() );
+            return nameArena.get( inIndex );
+         } );
+
+         // The same strings are read into a vector
+         std::vector<e57::ustring> nameVector( size );
+
+         dbufs.clear();
+         dbufs.emplace_back( imf, "name", &nameVector );
+
+         check( dbufs, read.first, read.second,
+                [&]( unsigned inIndex ) { return nameVector[inIndex]; } );
+      }
+   }
+
+   imf.close();
+}
+
+TEST( CompressedVector, ValidatePerWrite )
+{
+   constexpr size_t cCount = 1000;
+
+   e57::ImageFile imf( "./CompressedVectorValidatePerWrite.e57", "w" );
+
+   e57::StructureNode proto( imf );
+   proto.set( "index", e57::IntegerNode( imf, 0, -10, 1000 ) );
+   proto.set( "scaled", e57::ScaledIntegerNode( imf, 0, -1000, 1000, 0.01, 5.0 ) );
+   proto.set( "single", e57::FloatNode( imf, 0.0, e57::PrecisionSingle ) );
+   proto.set( "constant", e57::IntegerNode( imf, 3, 3, 3 ) );
+
+   e57::CompressedVectorNode cv( imf, proto, e57::VectorNode( imf, true ) );
+   imf.root().set( "points", cv );
+
+   std::vector<int32_t> index( cCount );
+   std::vector<double> scaled( cCount );
+   std::vector<double> single( cCount );
+   std::vector<int64_t> constant( cCount, 3 );
+
+   e57::CompressedVectorWriterOptions options;
+   options.validatePerWrite = true;
+
+   {
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "index", index.data(), cCount );
+      sbufs.emplace_back( imf, "scaled", scaled.data(), cCount, true, true );
+      sbufs.emplace_back( imf, "single", single.data(), cCount );
+      sbufs.emplace_back( imf, "constant", constant.data(), cCount );
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs, options );
+
+      const auto fill = [&]( size_t inFirst ) {
+         for ( size_t i = 0; i < cCount; ++i )
+         {
+            index[i] = static_cast<int32_t>( ( inFirst + i ) % 1011 ) - 10;
+            scaled[i] = 5.0 + static_cast<double>( ( inFirst + i ) % 2001 ) * 0.01 - 10.0;
+            single[i] = static_cast<double>( inFirst + i ) * 0.25;
+         }
+      };
+
+      fill( 0 );
+      E57_ASSERT_NO_THROW( writer.write( cCount ) );
+
+      // Every kind of value out of range makes the whole write() fail and write nothing
+      fill( cCount );
+      index[17] = 1001;
+      E57_ASSERT_THROW( writer.write( cCount ) );
+
+      fill( cCount );
+      scaled[cCount - 1] = 5.0 + 1000.0 * 0.01 + 0.006;
+      E57_ASSERT_THROW( writer.write( cCount ) );
+
+      fill( cCount );
+      single[3] = std::numeric_limits<double>::infinity();
+      E57_ASSERT_THROW( writer.write( cCount ) );
+
+      fill( cCount );
+      constant[500] = 4;
+      E57_ASSERT_THROW( writer.write( cCount ) );
+      constant[500] = 3;
+
+      try
+      {
+         fill( cCount );
+         index[0] = -11;
+         writer.write( cCount );
+         FAIL() << "out of range value was written";
+      }
+      catch ( e57::E57Exception &err )
+      {
+         EXPECT_EQ( err.errorCode(), e57::ErrorValueOutOfBounds );
+      }
+
+      fill( cCount );
+      E57_ASSERT_NO_THROW( writer.write( cCount ) );
+
+      writer.close();
+   }
+
+   ASSERT_EQ( cv.childCount(), static_cast<int64_t>( 2 * cCount ) );
+
+   std::vector<int32_t> readIndex( cCount );
+   std::vector<double> readScaled( cCount );
+   std::vector<float> readSingle( cCount );
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "index", readIndex.data(), cCount );
+   dbufs.emplace_back( imf, "scaled", readScaled.data(), cCount, true, true );
+   dbufs.emplace_back( imf, "single", readSingle.data(), cCount );
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs );
+
+   for ( const size_t first : { size_t{ 0 }, cCount } )
+   {
+      ASSERT_EQ( reader.read(), cCount );
+
+      for ( size_t i = 0; i < cCount; ++i )
+      {
+         const double cScaled = 5.0 + static_cast<double>( ( first + i ) % 2001 ) * 0.01 - 10.0;
+
+         ASSERT_EQ( readIndex[i], static_cast<int32_t>( ( first + i ) % 1011 ) - 10 );
+         ASSERT_NEAR( readScaled[i], cScaled, 1e-9 );
+         ASSERT_EQ( readSingle[i], static_cast<float>( static_cast<double>( first + i ) * 0.25 ) );
+      }
+   }
+
+   EXPECT_EQ( reader.read(), 0U );
+   reader.close();
+
+   imf.close();
+}
+
+TEST( CompressedVector, ColumnarRuns )
+{
+   e57::CompressedVectorWriterOptions options;
+   options.columnarRunPackets = 2;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorColumnarSerial.e57", options ) );
+
+   options.encodeThreadCount = 4;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorColumnarThreads.e57", options ) );
+
+   // The bytestreams are encoded independently, so threads don't change the file
+   EXPECT_EQ( fileContents( "./CompressedVectorColumnarSerial.e57" ),
+              fileContents( "./CompressedVectorColumnarThreads.e57" ) );
+
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorColumnarSerial.e57", {} ) );
+   E57_ASSERT_NO_THROW( checkSeeks( "./CompressedVectorColumnarSerial.e57" ) );
+
+   // Chunks need all the bytestreams to share packets
+   options.writeIndexPackets = true;
+
+   E57_ASSERT_THROW( writeTestFile( "./CompressedVectorColumnarIndex.e57", options ) );
+}
+
+TEST( CompressedVector, MaxPacketRecords )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorFullPackets.e57" ) );
+
+   e57::CompressedVectorWriterOptions options;
+   options.maxPacketRecords = 100;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorMaxPacketRecords.e57", options ) );
+
+   options.encodeThreadCount = 4;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorMaxPacketRecordsThreads.e57", options ) );
+
+   // Threads stop at the same packets
+   EXPECT_EQ( fileContents( "./CompressedVectorMaxPacketRecords.e57" ),
+              fileContents( "./CompressedVectorMaxPacketRecordsThreads.e57" ) );
+
+   // Many more packets, each with its own header
+   EXPECT_GT( fileContents( "./CompressedVectorMaxPacketRecords.e57" ).size(),
+              fileContents( "./CompressedVectorFullPackets.e57" ).size() );
+
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorMaxPacketRecords.e57", {} ) );
+   E57_ASSERT_NO_THROW( checkSeeks( "./CompressedVectorMaxPacketRecords.e57" ) );
+
+   // Column packets only hold one bytestream
+   options.columnarRunPackets = 2;
+
+   E57_ASSERT_THROW( writeTestFile( "./CompressedVectorMaxPacketRecordsColumnar.e57", options ) );
+}
+
+TEST( CompressedVector, Flush )
+{
+   const e57::ustring cFileName = "./CompressedVectorFlush.e57";
+
+   const auto fileSize = [&]() {
+      return static_cast<int64_t>(
+         std::ifstream( cFileName, std::ifstream::binary | std::ifstream::ate ).tellg() );
+   };
+
+   e57::CompressedVectorWriterOptions options;
+   options.maxPacketLatencyMs = 1;
+
+   {
+      e57::ImageFile imf( cFileName, "w" );
+      e57::CompressedVectorNode cv = addTestVector( imf, "points" );
+
+      std::vector<int64_t> index( cBufferSize );
+      std::vector<float> value( cBufferSize );
+      std::vector<e57::ustring> label( cBufferSize );
+      std::vector<int64_t> constant( cBufferSize, cConstantValue );
+
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "index", index.data(), cBufferSize, true );
+      sbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+      sbufs.emplace_back( imf, "label", &label );
+      sbufs.emplace_back( imf, "constant", constant.data(), cBufferSize, true );
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs, options );
+
+      const auto writeRecords = [&]( int64_t inStart ) {
+         for ( size_t i = 0; i < cBufferSize; ++i )
+         {
+            const int64_t record = inStart + static_cast<int64_t>( i );
+
+            index[i] = record;
+            value[i] = static_cast<float>( record ) * 0.5f;
+            label[i] = labelFor( record );
+         }
+
+         writer.write( cBufferSize );
+      };
+
+      int64_t start = 0;
+      int64_t size = fileSize();
+
+      // Far less than a packet, so only the flush writes it
+      writeRecords( start );
+      start += cBufferSize;
+
+      E57_ASSERT_NO_THROW( writer.flush() );
+
+      ASSERT_GT( fileSize(), size );
+      size = fileSize();
+
+      // Once the records are old enough, the next write() writes them
+      writeRecords( start );
+      start += cBufferSize;
+
+      std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+
+      writeRecords( start );
+      start += cBufferSize;
+
+      ASSERT_GT( fileSize(), size );
+
+      while ( start < cNumRecords )
+      {
+         writeRecords( start );
+         start += cBufferSize;
+      }
+
+      writer.close();
+
+      // Closed writers can't be flushed
+      E57_ASSERT_THROW( writer.flush() );
+
+      imf.close();
+   }
+
+   E57_ASSERT_NO_THROW( checkReadAll( cFileName, {} ) );
+}
+
+TEST( CompressedVector, ReadSomeFields )
+{
+   e57::CompressedVectorWriterOptions options;
+   options.columnarRunPackets = 2;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorSomeFields.e57", options ) );
+
+   e57::ImageFile imf( "./CompressedVectorSomeFields.e57", "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   imf.resetStatistics();
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) );
+
+   const uint64_t allFieldsBytesRead = imf.statistics().bytesRead;
+
+   imf.resetStatistics();
+
+   // Only the value packets need to be read
+   std::vector<float> value( cBufferSize );
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs );
+
+   int64_t record = 0;
+   unsigned count = 0;
+
+   while ( ( count = reader.read() ) > 0 )
+   {
+      for ( unsigned i = 0; i < count; ++i, ++record )
+      {
+         ASSERT_EQ( value[i], static_cast<float>( record ) * 0.5f );
+      }
+   }
+
+   EXPECT_EQ( record, cNumRecords );
+
+   E57_ASSERT_NO_THROW( reader.seek( 12345 ) );
+   ASSERT_EQ( reader.read(), cBufferSize );
+   EXPECT_EQ( value[0], 12345 * 0.5f );
+
+   reader.close();
+
+   if ( imf.statistics().enabled )
+   {
+      EXPECT_LT( imf.statistics().bytesRead, allFieldsBytesRead );
+   }
+
+   imf.close();
+}
+
+TEST( CompressedVector, RecordStride )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorStride.e57" ) );
+
+   e57::CompressedVectorWriterOptions writerOptions;
+   writerOptions.writeIndexPackets = true;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorStrideIndexed.e57", writerOptions ) );
+
+   writerOptions.writeIndexPackets = false;
+   writerOptions.columnarRunPackets = 2;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorStrideColumnar.e57", writerOptions ) );
+
+   e57::CompressedVectorReaderOptions options;
+
+   // Strides which do and don't divide the buffer size, and one larger than a packet
+   for ( const unsigned stride : { 2U, 7U, 100U, 5000U } )
+   {
+      options.recordStride = stride;
+
+      E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorStride.e57", options ) );
+      E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorStrideIndexed.e57", options ) );
+      E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorStrideColumnar.e57", options ) );
+   }
+
+   options.recordStride = 7;
+   options.decodeThreadCount = 4;
+   options.decodeTileSize = 10;
+
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorStrideIndexed.e57", options ) );
+
+   // Reading carries on every recordStride records from where we seek to
+   e57::ImageFile imf( "./CompressedVectorStrideIndexed.e57", "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   std::vector<int64_t> index( cBufferSize );
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "index", index.data(), cBufferSize, true );
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs, options );
+
+   E57_ASSERT_NO_THROW( reader.seek( 12345 ) );
+   ASSERT_EQ( reader.read(), cBufferSize );
+
+   for ( size_t i = 0; i < cBufferSize; ++i )
+   {
+      ASSERT_EQ( index[i], static_cast<int64_t>( 12345 + i * 7 ) );
+   }
+
+   reader.close();
+
+   options.recordStride = 0;
+
+   E57_ASSERT_THROW( cv.reader( dbufs, options ) );
+
+   imf.close();
+}
+
+TEST( CompressedVector, RecordFilter )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorFilter.e57" ) );
+
+   e57::ImageFile imf( "./CompressedVectorFilter.e57", "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   std::vector<int64_t> index( cBufferSize );
+   std::vector<float> value( cBufferSize );
+   std::vector<e57::ustring> label( cBufferSize );
+
+   // Read everything, checking the records kept are [inFirst, inLast] in order
+   const auto check = [&]( std::vector<e57::SourceDestBuffer> &ioDbufs,
+                           const e57::CompressedVectorReaderOptions &inOptions, int64_t inFirst,
+                           int64_t inLast, bool inHaveIndex ) {
+      e57::CompressedVectorReader reader = cv.reader( ioDbufs, inOptions );
+
+      int64_t record = inFirst;
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         for ( unsigned i = 0; i < count; ++i, ++record )
+         {
+            ASSERT_TRUE( !inHaveIndex || ( index[i] == record ) );
+            ASSERT_EQ( value[i], static_cast<float>( record ) * 0.5f );
+            ASSERT_EQ( label[i], labelFor( record ) );
+         }
+      }
+
+      EXPECT_EQ( record, inLast + 1 );
+
+      reader.close();
+   };
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "index", index.data(), cBufferSize, true );
+   dbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+   dbufs.emplace_back( imf, "label", &label );
+
+   e57::CompressedVectorReaderOptions options;
+   options.recordFilter = { { "value", 1000.0, 2999.5 } };
+
+   {
+      SCOPED_TRACE( "filter a field which is read" );
+      check( dbufs, options, 2000, 5999, true );
+   }
+
+   options.decodeThreadCount = 4;
+   options.decodeTileSize = 16;
+
+   {
+      SCOPED_TRACE( "tiles" );
+      check( dbufs, options, 2000, 5999, true );
+   }
+
+   // The filter's field needn't be read, and every range must match
+   options.recordFilter = { { "index", 10'000.0 }, { "index", -1.0, 10'049.0 } };
+
+   dbufs.erase( dbufs.begin() );
+
+   {
+      SCOPED_TRACE( "filter a field which isn't read" );
+      check( dbufs, options, 10'000, 10'049, false );
+   }
+
+   options.recordFilter = { { "nothing" } };
+
+   E57_ASSERT_THROW( cv.reader( dbufs, options ) );
+
+   options.recordFilter = { { "label" } };
+
+   E57_ASSERT_THROW( cv.reader( dbufs, options ) );
+
+   imf.close();
+}
+
+namespace
+{
+   // Counts the records read, and the values of "value" in bins of 1000
+   class ValueHistogram : public e57::CompressedVectorReduction
+   {
+   public:
+      std::unique_ptr<e57::CompressedVectorReduction> makePartial() const override
+      {
+         return std::unique_ptr<e57::CompressedVectorReduction>( new ValueHistogram );
+      }
+
+      void reduce( const e57::RecordBlock &inBlock ) override
+      {
+         const e57::StridedSpan<float> values = inBlock.values<float>( "value" );
+
+         for ( size_t i = 0; i < values.size(); ++i )
+         {
+            ++bins[static_cast<size_t>( values[i] / 1000.0f )];
+         }
+
+         recordCount += inBlock.recordCount;
+      }
+
+      void combine( const e57::CompressedVectorReduction &inPartial ) override
+      {
+         const auto &partial = static_cast<const ValueHistogram &>( inPartial );
+
+         for ( size_t i = 0; i < bins.size(); ++i )
+         {
+            bins[i] += partial.bins[i];
+         }
+
+         recordCount += partial.recordCount;
+      }
+
+      std::array<uint64_t, 10> bins = {};
+      uint64_t recordCount = 0;
+   };
+}
+
+TEST( CompressedVector, Reductions )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorReductions.e57" ) );
+
+   e57::ImageFile imf( "./CompressedVectorReductions.e57", "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   std::vector<float> value( cBufferSize );
+   std::vector<e57::ustring> label( cBufferSize );
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+   dbufs.emplace_back( imf, "label", &label );
+
+   // Read everything, checking the histogram of the records kept matches
+   const auto check = [&]( const e57::CompressedVectorReaderOptions &inOptions,
+                           const std::array<uint64_t, 10> &inBins ) {
+      auto histogram = std::make_shared<ValueHistogram>();
+
+      e57::CompressedVectorReaderOptions options = inOptions;
+      options.reductions = { histogram };
+
+      e57::CompressedVectorReader reader = cv.reader( dbufs, options );
+
+      uint64_t total = 0;
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         total += count;
+
+         // Each read() is reduced by the time it returns
+         ASSERT_EQ( histogram->recordCount, total );
+      }
+
+      reader.close();
+
+      for ( size_t i = 0; i < inBins.size(); ++i )
+      {
+         EXPECT_EQ( histogram->bins[i], inBins[i] ) << "bin " << i;
+      }
+   };
+
+   // 2000 records per bin of 1000
+   std::array<uint64_t, 10> bins;
+   bins.fill( 2000 );
+
+   e57::CompressedVectorReaderOptions options;
+
+   {
+      SCOPED_TRACE( "one thread" );
+      check( options, bins );
+   }
+
+   options.decodeThreadCount = 4;
+   options.decodeTileSize = 16;
+
+   {
+      SCOPED_TRACE( "tiles" );
+      check( options, bins );
+   }
+
+   // Only the records kept are reduced
+   options.recordFilter = { { "index", 0.0, 2999.0 } };
+
+   bins.fill( 0 );
+   bins[0] = 2000;
+   bins[1] = 1000;
+
+   {
+      SCOPED_TRACE( "filter" );
+      check( options, bins );
+   }
+
+   options.reductions = { nullptr };
+
+   E57_ASSERT_THROW( cv.reader( dbufs, options ) );
+
+   imf.close();
+}
+
+TEST( CompressedVector, ReducedPrecision )
+{
+   constexpr size_t cCount = 10000;
+   constexpr double cScale = 0.001;
+   constexpr double cOffset = 100000.0;
+
+   e57::ImageFile imf( "./CompressedVectorReducedPrecision.e57", "w" );
+
+   e57::StructureNode proto( imf );
+   proto.set( "scaled", e57::ScaledIntegerNode( imf, 0, -2000000, 2000000, cScale, cOffset ) );
+   proto.set( "double", e57::FloatNode( imf, 0.0, e57::PrecisionDouble ) );
+
+   e57::CompressedVectorNode cv( imf, proto, e57::VectorNode( imf, true ) );
+   imf.root().set( "points", cv );
+
+   std::vector<int64_t> raw( cCount );
+   std::vector<e57::Float16> written( cCount );
+
+   for ( size_t i = 0; i < cCount; ++i )
+   {
+      raw[i] = static_cast<int64_t>( ( i * 7919 ) % 4000001 ) - 2000000;
+      written[i] = e57::Float16( static_cast<double>( i ) * 0.125 - 600.0 );
+   }
+
+   {
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "scaled", raw.data(), cCount );
+      sbufs.emplace_back( imf, "double", written.data(), cCount, true );
+
+      // Written relative to the origin, so stored around cOffset
+      sbufs.back().setOrigin( cOffset );
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs );
+      E57_ASSERT_NO_THROW( writer.write( cCount ) );
+      writer.close();
+   }
+
+   std::vector<e57::Float16> half( cCount );
+   std::vector<float> single( cCount );
+   std::vector<double> stored( cCount );
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "scaled", half.data(), cCount, true, true );
+   dbufs.back().setOrigin( cOffset );
+   dbufs.emplace_back( imf, "double", stored.data(), cCount );
+
+   {
+      e57::CompressedVectorReader reader = cv.reader( dbufs );
+      ASSERT_EQ( reader.read(), cCount );
+      reader.close();
+   }
+
+   for ( size_t i = 0; i < cCount; ++i )
+   {
+      const double value = static_cast<double>( raw[i] ) * cScale + cOffset - cOffset;
+
+      ASSERT_EQ( half[i].bits, e57::Float16( value ).bits ) << "record " << i;
+      ASSERT_EQ( stored[i], static_cast<double>( written[i] ) + cOffset ) << "record " << i;
+   }
+
+   dbufs[0] = e57::SourceDestBuffer( imf, "scaled", single.data(), cCount, true, true );
+   dbufs[0].setOrigin( cOffset - 1000.0 );
+   dbufs[1] = e57::SourceDestBuffer( imf, "double", half.data(), cCount, true );
+   dbufs[1].setOrigin( cOffset );
+
+   {
+      e57::CompressedVectorReader reader = cv.reader( dbufs );
+      ASSERT_EQ( reader.read(), cCount );
+      reader.close();
+   }
+
+   for ( size_t i = 0; i < cCount; ++i )
+   {
+      const double value = static_cast<double>( raw[i] ) * cScale + cOffset - ( cOffset - 1000.0 );
+
+      ASSERT_EQ( single[i], static_cast<float>( value ) ) << "record " << i;
+      ASSERT_EQ( half[i].bits, written[i].bits ) << "record " << i;
+   }
+
+   // Without an origin the scaled values are too large for half precision
+   dbufs[0] = e57::SourceDestBuffer( imf, "scaled", half.data(), cCount, true, true );
+
+   try
+   {
+      e57::CompressedVectorReader reader = cv.reader( dbufs );
+      reader.read();
+      FAIL() << "unrepresentable value was read";
+   }
+   catch ( e57::E57Exception &err )
+   {
+      EXPECT_EQ( err.errorCode(), e57::ErrorScaledValueNotRepresentable );
+   }
+
+   // Only real buffers have an origin
+   std::vector<int64_t> integers( cCount );
+   e57::SourceDestBuffer integerBuffer( imf, "scaled", integers.data(), cCount );
+
+   E57_ASSERT_THROW( integerBuffer.setOrigin( 1.0 ) );
+   E57_ASSERT_NO_THROW( integerBuffer.setOrigin( 0.0 ) );
+
+   imf.close();
+}
+
+namespace
+{
+   template <typename T> struct IndexField
+   {
+      using type = T;
+      static const char *name()
+      {
+         return "index";
+      }
+   };
+
+   template <typename T> struct ValueField
+   {
+      using type = T;
+      static const char *name()
+      {
+         return "value";
+      }
+   };
+
+   template <typename T> struct ConstantField
+   {
+      using type = T;
+      static const char *name()
+      {
+         return "constant";
+      }
+   };
+
+   struct LabelField
+   {
+      using type = int32_t;
+      static const char *name()
+      {
+         return "label";
+      }
+   };
+}
+
+TEST( CompressedVector, TypedReader )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorTypedReader.e57" ) );
+
+   e57::ImageFile imf( "./CompressedVectorTypedReader.e57", "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   {
+      e57::TypedCompressedVectorReader<IndexField<uint16_t>, ValueField<float>,
+                                       ConstantField<double>>
+         reader( cv, 1000 );
+
+      int64_t record = 0;
+      size_t count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         for ( size_t i = 0; i < count; ++i, ++record )
+         {
+            ASSERT_EQ( reader.get<0>( i ), record );
+            ASSERT_EQ( reader.get<1>( i ), static_cast<float>( record ) * 0.5f );
+            ASSERT_EQ( reader.get<2>( i ), static_cast<double>( cConstantValue ) );
+         }
+      }
+
+      EXPECT_EQ( record, cNumRecords );
+
+      reader.seek( 12345 );
+      ASSERT_EQ( reader.read(), 1000U );
+      EXPECT_EQ( std::get<0>( reader.records()[0] ), 12345 );
+
+      reader.close();
+   }
+
+   // The index is too big for 8 bits, floats can't be read into integers, and strings and
+   // missing fields can't be read at all
+   using TooSmall = e57::TypedCompressedVectorReader<IndexField<int8_t>>;
+   using FloatToInteger = e57::TypedCompressedVectorReader<ValueField<int32_t>>;
+   using String = e57::TypedCompressedVectorReader<LabelField>;
+   using Missing = e57::TypedCompressedVectorReader<e57::TypedFields::CartesianX<float>>;
+
+   E57_ASSERT_THROW( TooSmall( cv, 1000 ) );
+   E57_ASSERT_THROW( FloatToInteger( cv, 1000 ) );
+   E57_ASSERT_THROW( String( cv, 1000 ) );
+   E57_ASSERT_THROW( Missing( cv, 1000 ) );
+
+   // No room for any records
+   E57_ASSERT_THROW( ( e57::TypedCompressedVectorReader<IndexField<int64_t>>( cv, 0 ) ) );
+
+   imf.close();
+}
+
+TEST( CompressedVector, ConcurrentReaders )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorConcurrentReaders.e57" ) );
+
+   e57::ImageFile imf( "./CompressedVectorConcurrentReaders.e57", "r" );
+
+   std::vector<std::thread> threads;
+
+   for ( int i = 0; i < 4; ++i )
+   {
+      threads.emplace_back( [&imf] { E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) ); } );
+   }
+
+   for ( auto &thread : threads )
+   {
+      thread.join();
+   }
+
+   EXPECT_EQ( imf.readerCount(), 0 );
+
+   imf.close();
+}
+
+TEST( CompressedVector, SharedPacketCache )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorSharedPacketCache.e57" ) );
+
+   e57::ImageFileOptions options;
+   options.sharedPacketCacheSize = 64;
+
+   e57::ImageFile imf( "./CompressedVectorSharedPacketCache.e57", "r", options );
+
+   // The second reader finds every packet the first one read
+   E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) );
+
+   imf.resetStatistics();
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) );
+
+   const e57::ImageFileStatistics statistics = imf.statistics();
+
+   if ( statistics.enabled )
+   {
+      EXPECT_GT( statistics.sharedPacketCacheHits, 0U );
+      EXPECT_LE( statistics.sharedPacketCacheHits, statistics.packetCacheMisses );
+   }
+
+   EXPECT_GT( imf.memoryUsage().packetCache, 0U );
+
+   // Readers on other threads share them too, with read-ahead
+   e57::CompressedVectorReaderOptions readerOptions;
+   readerOptions.readAheadPacketCount = 2;
+   readerOptions.packetCacheSize = 1;
+
+   std::vector<std::thread> threads;
+
+   for ( int i = 0; i < 4; ++i )
+   {
+      threads.emplace_back(
+         [&imf, &readerOptions] { E57_ASSERT_NO_THROW( checkReadAll( imf, readerOptions ) ); } );
+   }
+
+   for ( auto &thread : threads )
+   {
+      thread.join();
+   }
+
+   imf.close();
+}
+
+TEST( CompressedVector, ReadAsync )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorReadAsync.e57" ) );
+
+   e57::ImageFile imf( "./CompressedVectorReadAsync.e57", "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   // Two sets of buffers, so one is read into while the other is checked
+   std::array<std::vector<int64_t>, 2> index;
+   std::array<std::vector<e57::SourceDestBuffer>, 2> dbufs;
+
+   for ( size_t i = 0; i < 2; ++i )
+   {
+      index[i].resize( cBufferSize );
+      dbufs[i].emplace_back( imf, "index", index[i].data(), cBufferSize, true );
+   }
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs[0] );
+
+   std::future<unsigned> pending = reader.readAsync( dbufs[0] );
+   int64_t record = 0;
+   size_t current = 0;
+
+   for ( ;; )
+   {
+      std::future<unsigned> next = reader.readAsync( dbufs[1 - current] );
+
+      const unsigned count = pending.get();
+
+      if ( count == 0 )
+      {
+         EXPECT_EQ( next.get(), 0U );
+         break;
+      }
+
+      for ( unsigned i = 0; i < count; ++i )
+      {
+         ASSERT_EQ( index[current][i], record++ );
+      }
+
+      pending = std::move( next );
+      current = 1 - current;
+   }
+
+   EXPECT_EQ( record, cNumRecords );
+
+   // Each completion starts the next read until there are no more records
+   E57_ASSERT_NO_THROW( reader.seek( 0 ) );
+
+   std::promise<int64_t> total;
+   int64_t recordsRead = 0;
+   e57::ReadCompletion done;
+
+   done = [&]( unsigned count, std::exception_ptr error ) {
+      if ( error || ( count == 0 ) )
+      {
+         total.set_value( error ? -1 : recordsRead );
+         return;
+      }
+
+      recordsRead += count;
+      reader.readAsync( done );
+   };
+
+   reader.readAsync( done );
+
+   EXPECT_EQ( total.get_future().get(), cNumRecords );
+
+   // A synchronous read waits for the ones started before it
+   E57_ASSERT_NO_THROW( reader.seek( 0 ) );
+
+   std::future<unsigned> first = reader.readAsync( dbufs[0] );
+
+   EXPECT_EQ( reader.read( dbufs[1] ), cBufferSize );
+   EXPECT_EQ( first.get(), cBufferSize );
+   EXPECT_EQ( index[0][0], 0 );
+   EXPECT_EQ( index[1][0], static_cast<int64_t>( cBufferSize ) );
+
+   // Errors are given to the future
+   reader.close();
+
+   std::future<unsigned> closed = reader.readAsync();
+
+   E57_ASSERT_THROW( closed.get() );
+
+   imf.close();
+}
+
+TEST( CompressedVector, ConcurrentReadersAndBlobs )
+{
+   constexpr int64_t cBlobSize = 100000;
+
+   {
+      e57::ImageFile imf( "./CompressedVectorConcurrentBlobs.e57", "w" );
+
+      e57::CompressedVectorNode cv = addTestVector( imf, "points" );
+      writeTestRecords( imf, cv, {} );
+
+      std::vector<uint8_t> contents( cBlobSize );
+      for ( int64_t i = 0; i < cBlobSize; ++i )
+      {
+         contents[i] = static_cast<uint8_t>( i % 251 );
+      }
+
+      e57::BlobNode blob( imf, cBlobSize );
+      imf.root().set( "blob", blob );
+      blob.write( contents.data(), 0, cBlobSize );
+
+      imf.close();
+   }
+
+   e57::ImageFile imf( "./CompressedVectorConcurrentBlobs.e57", "r" );
+   e57::BlobNode blob( imf.root().get( "blob" ) );
+
+   std::vector<std::thread> threads;
+
+   for ( int i = 0; i < 4; ++i )
+   {
+      threads.emplace_back( [&imf] { E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) ); } );
+
+      // Each thread reads the blob in pieces starting at a different place
+      threads.emplace_back( [&blob, i] {
+         const int64_t cPieceSize = 777;
+         std::vector<uint8_t> piece( cPieceSize );
+
+         for ( int64_t start = i * 1000; start + cPieceSize <= cBlobSize; start += cPieceSize )
+         {
+            E57_ASSERT_NO_THROW( blob.read( piece.data(), start, cPieceSize ) );
+
+            for ( int64_t j = 0; j < cPieceSize; ++j )
+            {
+               ASSERT_EQ( piece[j], static_cast<uint8_t>( ( start + j ) % 251 ) );
+            }
+         }
+      } );
+   }
+
+   for ( auto &thread : threads )
+   {
+      thread.join();
+   }
+
+   EXPECT_EQ( imf.readerCount(), 0 );
+
+   imf.close();
+}
+
+TEST( CompressedVector, ConcurrentStagedWriters )
+{
+   const std::vector<e57::ustring> cNames{ "points", "points1", "points2", "points3" };
+
+   {
+      e57::ImageFile imf( "./CompressedVectorStagedWriters.e57", "w" );
+
+      // The tree is built on one thread...
+      std::vector<e57::CompressedVectorNode> vectors;
+
+      for ( const auto &name : cNames )
+      {
+         vectors.push_back( addTestVector( imf, name ) );
+      }
+
+      // ...and the points are written on several at once.
+      e57::CompressedVectorWriterOptions options;
+      options.stageInMemory = true;
+      options.writeIndexPackets = true;
+
+      std::vector<std::thread> threads;
+
+      for ( auto &cv : vectors )
+      {
+         threads.emplace_back( [&imf, &cv, &options] {
+            E57_ASSERT_NO_THROW( writeTestRecords( imf, cv, options ) );
+         } );
+      }
+
+      for ( auto &thread : threads )
+      {
+         thread.join();
+      }
+
+      EXPECT_EQ( imf.writerCount(), 0 );
+
+      imf.close();
+   }
+
+   {
+      e57::ImageFile imf( "./CompressedVectorStagedWriters.e57", "r" );
+
+      for ( const auto &name : cNames )
+      {
+         E57_ASSERT_NO_THROW( checkReadAll( imf, {}, name ) );
+      }
+
+      imf.close();
+   }
+
+   checkSeeks( "./CompressedVectorStagedWriters.e57" );
+}
+
+// Staged writers can be open together, but a writer straight to the file can't be open with
+// any other. One which fails to open isn't left counted.
+TEST( CompressedVector, WriterCount )
+{
+   e57::ImageFile imf( "./CompressedVectorWriterCount.e57", "w" );
+
+   e57::CompressedVectorNode cv = addTestVector( imf, "points" );
+   e57::CompressedVectorNode cv1 = addTestVector( imf, "points1" );
+   e57::CompressedVectorNode cv2 = addTestVector( imf, "points2" );
+
+   std::vector<int64_t> index( cBufferSize );
+   std::vector<float> value( cBufferSize );
+   std::vector<e57::ustring> label( cBufferSize );
+   std::vector<int64_t> constant( cBufferSize );
+
+   std::vector<e57::SourceDestBuffer> sbufs;
+   sbufs.emplace_back( imf, "index", index.data(), cBufferSize, true );
+   sbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+   sbufs.emplace_back( imf, "label", &label );
+   sbufs.emplace_back( imf, "constant", constant.data(), cBufferSize, true );
+
+   e57::CompressedVectorWriterOptions staged;
+   staged.stageInMemory = true;
+
+   e57::CompressedVectorWriterOptions badOptions;
+   badOptions.progressPacketInterval = 0;
+
+   {
+      e57::CompressedVectorWriter writer = cv.writer( sbufs, staged );
+      e57::CompressedVectorWriter writer1 = cv1.writer( sbufs, staged );
+
+      EXPECT_EQ( imf.writerCount(), 2 );
+
+      E57_ASSERT_THROW( cv2.writer( sbufs, {} ) );
+      E57_ASSERT_THROW( cv2.writer( sbufs, badOptions ) );
+
+      EXPECT_EQ( imf.writerCount(), 2 );
+
+      writer.close();
+      writer1.close();
+   }
+
+   EXPECT_EQ( imf.writerCount(), 0 );
+
+   {
+      E57_ASSERT_THROW( cv2.writer( sbufs, badOptions ) );
+
+      EXPECT_EQ( imf.writerCount(), 0 );
+
+      e57::CompressedVectorWriter writer = cv2.writer( sbufs, {} );
+
+      E57_ASSERT_THROW( cv.writer( sbufs, staged ) );
+
+      EXPECT_EQ( imf.writerCount(), 1 );
+
+      writer.close();
+   }
+
+   EXPECT_EQ( imf.writerCount(), 0 );
+
+   imf.close();
+}
+
+// write( sbufs, n ) takes the records from the buffers it is given, not the ones the writer was
+// created with or last wrote from.
+TEST( CompressedVector, WriteWithNewBuffers )
+{
+   const e57::ustring cFileName = "./CompressedVectorWriteNewBuffers.e57";
+
+   {
+      e57::ImageFile imf( cFileName, "w" );
+
+      e57::CompressedVectorNode cv = addTestVector( imf, "points" );
+
+      // Two sets of buffers, used in turn
+      std::array<std::vector<int64_t>, 2> index;
+      std::array<std::vector<float>, 2> value;
+      std::array<std::vector<e57::ustring>, 2> label;
+      std::array<std::vector<int64_t>, 2> constant;
+      std::array<std::vector<e57::SourceDestBuffer>, 2> sbufs;
+
+      for ( size_t set = 0; set < 2; ++set )
+      {
+         index[set].resize( cBufferSize );
+         value[set].resize( cBufferSize );
+         label[set].resize( cBufferSize );
+         constant[set].resize( cBufferSize );
+
+         sbufs[set].emplace_back( imf, "index", index[set].data(), cBufferSize, true );
+         sbufs[set].emplace_back( imf, "value", value[set].data(), cBufferSize );
+         sbufs[set].emplace_back( imf, "label", &label[set] );
+         sbufs[set].emplace_back( imf, "constant", constant[set].data(), cBufferSize, true );
+      }
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs[0] );
+
+      for ( int64_t start = 0; start < cNumRecords; start += cBufferSize )
+      {
+         const size_t set = ( start / cBufferSize ) % 2;
+         const size_t other = 1 - set;
+
+         for ( size_t i = 0; i < cBufferSize; ++i )
+         {
+            const int64_t record = start + static_cast<int64_t>( i );
+
+            index[set][i] = record;
+            value[set][i] = static_cast<float>( record ) * 0.5f;
+            label[set][i] = labelFor( record );
+            constant[set][i] = cConstantValue;
+
+            // Valid records, but the wrong ones
+            index[other][i] = cNumRecords - 1 - record;
+            value[other][i] = -1.0f;
+            label[other][i] = "wrong";
+         }
+
+         E57_ASSERT_NO_THROW( writer.write( sbufs[set], cBufferSize ) );
+      }
+
+      writer.close();
+      imf.close();
+   }
+
+   E57_ASSERT_NO_THROW( checkReadAll( cFileName, {} ) );
+}
+
+// read( dbufs ) fills the buffers it is given, and later read()s carry on with them, leaving
+// the buffers used before untouched.
+TEST( CompressedVector, ReadWithNewBuffers )
+{
+   const e57::ustring cFileName = "./CompressedVectorReadNewBuffers.e57";
+
+   E57_ASSERT_NO_THROW( writeTestFile( cFileName ) );
+
+   e57::ImageFile imf( cFileName, "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   std::array<std::vector<int64_t>, 2> index;
+   std::array<std::vector<float>, 2> value;
+   std::array<std::vector<e57::ustring>, 2> label;
+   std::array<std::vector<int64_t>, 2> constant;
+   std::array<std::vector<e57::SourceDestBuffer>, 2> dbufs;
+
+   for ( size_t set = 0; set < 2; ++set )
+   {
+      index[set].assign( cBufferSize, -1 );
+      value[set].assign( cBufferSize, -1.0f );
+      label[set].assign( cBufferSize, "untouched" );
+      constant[set].assign( cBufferSize, -1 );
+
+      dbufs[set].emplace_back( imf, "index", index[set].data(), cBufferSize, true );
+      dbufs[set].emplace_back( imf, "value", value[set].data(), cBufferSize );
+      dbufs[set].emplace_back( imf, "label", &label[set] );
+      dbufs[set].emplace_back( imf, "constant", constant[set].data(), cBufferSize, true );
+   }
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs[0] );
+
+   const auto size = static_cast<int64_t>( cBufferSize );
+
+   // Check set holds the cBufferSize records from start.
+   const auto checkRecords = [&]( size_t set, int64_t start ) {
+      for ( size_t i = 0; i < cBufferSize; ++i )
+      {
+         const int64_t record = start + static_cast<int64_t>( i );
+
+         ASSERT_EQ( index[set][i], record );
+         ASSERT_EQ( value[set][i], static_cast<float>( record ) * 0.5f );
+         ASSERT_EQ( label[set][i], labelFor( record ) );
+         ASSERT_EQ( constant[set][i], cConstantValue );
+      }
+   };
+
+   ASSERT_EQ( reader.read(), cBufferSize );
+   checkRecords( 0, 0 );
+
+   ASSERT_EQ( reader.read( dbufs[1] ), cBufferSize );
+   checkRecords( 1, size );
+   checkRecords( 0, 0 );
+
+   // Carries on with the new buffers
+   ASSERT_EQ( reader.read(), cBufferSize );
+   checkRecords( 1, 2 * size );
+   checkRecords( 0, 0 );
+
+   // ...and back again
+   ASSERT_EQ( reader.read( dbufs[0] ), cBufferSize );
+   checkRecords( 0, 3 * size );
+   checkRecords( 1, 2 * size );
+
+   // Alternating to the end
+   int64_t start = 4 * size;
+   size_t set = 1;
+   unsigned count = 0;
+
+   while ( ( count = reader.read( dbufs[set] ) ) > 0 )
+   {
+      ASSERT_EQ( count, cBufferSize );
+      checkRecords( set, start );
+      checkRecords( 1 - set, start - size );
+
+      start += size;
+      set = 1 - set;
+   }
+
+   EXPECT_EQ( start, cNumRecords );
+
+   reader.close();
+   imf.close();
+}
+
+TEST( CompressedVector, DeltaCodec )
+{
+   writeDeltaTestFile( "./CompressedVectorBitpack.e57", false );
+   writeDeltaTestFile( "./CompressedVectorDelta.e57", true );
+
+   checkDeltaTestFile( "./CompressedVectorDelta.e57" );
+
+   // Neighbouring records are close together, so they take fewer bits as differences
+   EXPECT_LT( fileContents( "./CompressedVectorDelta.e57" ).size(),
+              fileContents( "./CompressedVectorBitpack.e57" ).size() );
+
+   // With index packets, seeks start decoding at a chunk
+   e57::CompressedVectorWriterOptions options;
+   options.writeIndexPackets = true;
+   options.encodeThreadCount = 2;
+
+   writeDeltaTestFile( "./CompressedVectorDeltaIndexed.e57", true, options );
+
+   checkDeltaTestFile( "./CompressedVectorDeltaIndexed.e57" );
+}
+
+TEST( CompressedVector, XorCodec )
+{
+   writeXorTestFile( "./CompressedVectorFloats.e57", false );
+   writeXorTestFile( "./CompressedVectorXor.e57", true );
+
+   checkXorTestFile( "./CompressedVectorXor.e57" );
+
+   // Neighbouring timestamps share most of their bits
+   EXPECT_LT( fileContents( "./CompressedVectorXor.e57" ).size(),
+              fileContents( "./CompressedVectorFloats.e57" ).size() );
+
+   // With index packets, seeks start decoding at a chunk
+   e57::CompressedVectorWriterOptions options;
+   options.writeIndexPackets = true;
+   options.encodeThreadCount = 2;
+
+   writeXorTestFile( "./CompressedVectorXorIndexed.e57", true, options );
+
+   checkXorTestFile( "./CompressedVectorXorIndexed.e57" );
+}
+
+TEST( CompressedVector, ZstdCodec )
+{
+   try
+   {
+      writeDeltaTestFile( "./CompressedVectorZstd.e57", false, {}, true );
+   }
+   catch ( const e57::E57Exception &err )
+   {
+      if ( err.errorCode() == e57::ErrorNotImplemented )
+      {
+         GTEST_SKIP() << "library built without E57_ENABLE_ZSTD";
+      }
+
+      throw;
+   }
+
+   writeDeltaTestFile( "./CompressedVectorBitpack.e57", false );
+
+   checkDeltaTestFile( "./CompressedVectorZstd.e57" );
+
+   // The records repeat every 1000, so they compress well
+   EXPECT_LT( fileContents( "./CompressedVectorZstd.e57" ).size(),
+              fileContents( "./CompressedVectorBitpack.e57" ).size() );
+
+   // With index packets, seeks start decompressing at a chunk, also when zstd is on top of the
+   // delta codec
+   e57::CompressedVectorWriterOptions options;
+   options.writeIndexPackets = true;
+   options.encodeThreadCount = 2;
+
+   writeDeltaTestFile( "./CompressedVectorZstdIndexed.e57", false, options, true );
+   writeDeltaTestFile( "./CompressedVectorDeltaZstdIndexed.e57", true, options, true );
+
+   checkDeltaTestFile( "./CompressedVectorZstdIndexed.e57" );
+   checkDeltaTestFile( "./CompressedVectorDeltaZstdIndexed.e57" );
+}
+
+TEST( CompressedVector, CopyFrom )
+{
+   e57::CompressedVectorWriterOptions options;
+   options.writeIndexPackets = true;
+
+   writeDeltaTestFile( "./CompressedVectorCopySource.e57", false );
+   writeDeltaTestFile( "./CompressedVectorCopySourceIndexed.e57", true, options );
+
+   auto copyFile = []( const e57::ustring &inSourceName, const e57::ustring &inDestName,
+                       bool inDelta ) {
+      e57::ImageFile source( inSourceName, "r" );
+      e57::ImageFile dest( inDestName, "w" );
+
+      // Put something in front so the section lands at a different offset
+      std::vector<uint8_t> blobData( 5000, 0x5a );
+      e57::BlobNode blob( dest, static_cast<int64_t>( blobData.size() ) );
+      dest.root().set( "blob", blob );
+      blob.write( blobData.data(), 0, blobData.size() );
+
+      e57::CompressedVectorNode cv = addDeltaTestNode( dest, inDelta, false );
+      const e57::CompressedVectorNode sourceCV( source.root().get( "points" ) );
+
+      E57_ASSERT_NO_THROW( cv.copyFrom( sourceCV ) );
+
+      ASSERT_EQ( cv.childCount(), cNumRecords );
+
+      dest.close();
+      source.close();
+   };
+
+   copyFile( "./CompressedVectorCopySource.e57", "./CompressedVectorCopy.e57", false );
+   copyFile( "./CompressedVectorCopySourceIndexed.e57", "./CompressedVectorCopyIndexed.e57", true );
+
+   checkDeltaTestFile( "./CompressedVectorCopy.e57" );
+   checkDeltaTestFile( "./CompressedVectorCopyIndexed.e57" );
+
+   // The records can't be copied into a CompressedVector which would read them differently
+   {
+      e57::ImageFile source( "./CompressedVectorCopySourceIndexed.e57", "r" );
+      e57::ImageFile dest( "./CompressedVectorCopyMismatch.e57", "w" );
+
+      e57::CompressedVectorNode cv = addDeltaTestNode( dest, false, false );
+      const e57::CompressedVectorNode sourceCV( source.root().get( "points" ) );
+
+      E57_ASSERT_THROW( cv.copyFrom( sourceCV ) );
+
+      dest.close();
+      source.close();
+   }
+}
+
+TEST( CompressedVector, JournalRecovery )
+{
+   const e57::ustring fileName = "./CompressedVectorJournal.e57";
+   const e57::ustring partialName = "./CompressedVectorJournalPartial.e57";
+   const e57::ustring writtenName = "./CompressedVectorJournalWritten.e57";
+
+   // A copy of the file and its journal is what a program which stopped then would leave
+   auto copyFiles = [&]( const e57::ustring &inDestName ) {
+      for ( const char *suffix : { "", ".journal" } )
+      {
+         std::ifstream source( fileName + suffix, std::ifstream::binary );
+         std::ofstream dest( inDestName + suffix, std::ofstream::binary );
+
+         ASSERT_TRUE( source.good() );
+
+         dest << source.rdbuf();
+      }
+   };
+
+   {
+      e57::ImageFileOptions options;
+      options.journalInterval = 1;
+
+      e57::ImageFile imf( fileName, "w", options );
+      e57::CompressedVectorNode cv = addDeltaTestNode( imf, true, false );
+
+      std::vector<int64_t> x( cBufferSize );
+      std::vector<int64_t> row( cBufferSize );
+      std::vector<float> value( cBufferSize );
+
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "x", x.data(), cBufferSize, true );
+      sbufs.emplace_back( imf, "row", row.data(), cBufferSize, true );
+      sbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs );
+
+      for ( int64_t start = 0; start < cNumRecords; start += cBufferSize )
+      {
+         for ( size_t i = 0; i < cBufferSize; ++i )
+         {
+            const int64_t record = start + static_cast<int64_t>( i );
+
+            x[i] = deltaTestX( record );
+            row[i] = deltaTestRow( record );
+            value[i] = static_cast<float>( record ) * 0.5f;
+         }
+
+         writer.write( cBufferSize );
+
+         if ( start == cNumRecords * 3 / 4 )
+         {
+            copyFiles( partialName );
+         }
+      }
+
+      writer.close();
+
+      copyFiles( writtenName );
+
+      imf.close();
+   }
+
+   // Closing removes the journal
+   ASSERT_FALSE( std::ifstream( fileName + ".journal" ).good() );
+
+   checkDeltaTestFile( fileName );
+
+   // Everything was in the journal once the writer closed
+   E57_ASSERT_NO_THROW( e57::ImageFile::recover( writtenName ) );
+   ASSERT_FALSE( std::ifstream( writtenName + ".journal" ).good() );
+
+   checkDeltaTestFile( writtenName );
+
+   // Only the records of the packets written before the last journal are recovered
+   E57_ASSERT_NO_THROW( e57::ImageFile::recover( partialName ) );
+
+   e57::ImageFile imf( partialName, "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   const int64_t recovered = cv.childCount();
+
+   ASSERT_GT( recovered, 0 );
+   ASSERT_LT( recovered, cNumRecords );
+
+   std::vector<int64_t> x( cBufferSize );
+   std::vector<int64_t> row( cBufferSize );
+   std::vector<float> value( cBufferSize );
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "x", x.data(), cBufferSize, true );
+   dbufs.emplace_back( imf, "row", row.data(), cBufferSize, true );
+   dbufs.emplace_back( imf, "value", value.data(), cBufferSize );
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs );
+
+   int64_t total = 0;
+   unsigned count = 0;
+
+   while ( ( count = reader.read() ) > 0 )
+   {
+      for ( unsigned i = 0; i < count; ++i )
+      {
+         const int64_t record = total + i;
+
+         ASSERT_EQ( x[i], deltaTestX( record ) );
+         ASSERT_EQ( row[i], deltaTestRow( record ) );
+         ASSERT_EQ( value[i], static_cast<float>( record ) * 0.5f );
+      }
+
+      total += count;
+   }
+
+   ASSERT_EQ( total, recovered );
+
+   reader.close();
+   imf.close();
+}
+
+TEST( CompressedVector, FollowWhileWriting )
+{
+   const e57::ustring fileName = "./CompressedVectorFollow.e57";
+
+   e57::ImageFileOptions writeOptions;
+   writeOptions.journalInterval = 1;
+
+   e57::ImageFile writeImf( fileName, "w", writeOptions );
+   e57::CompressedVectorNode writeCv = addDeltaTestNode( writeImf, true, false );
+
+   std::vector<int64_t> x( cBufferSize );
+   std::vector<int64_t> row( cBufferSize );
+   std::vector<float> value( cBufferSize );
+
+   std::vector<e57::SourceDestBuffer> sbufs;
+   sbufs.emplace_back( writeImf, "x", x.data(), cBufferSize, true );
+   sbufs.emplace_back( writeImf, "row", row.data(), cBufferSize, true );
+   sbufs.emplace_back( writeImf, "value", value.data(), cBufferSize );
+
+   e57::CompressedVectorWriter writer = writeCv.writer( sbufs );
+
+   auto writeRecords = [&]( int64_t start, int64_t end ) {
+      for ( ; start < end; start += cBufferSize )
+      {
+         for ( size_t i = 0; i < cBufferSize; ++i )
+         {
+            const int64_t record = start + static_cast<int64_t>( i );
+
+            x[i] = deltaTestX( record );
+            row[i] = deltaTestRow( record );
+            value[i] = static_cast<float>( record ) * 0.5f;
+         }
+
+         writer.write( cBufferSize );
+      }
+   };
+
+   // Write enough for a journal, so there is something to follow
+   writeRecords( 0, cNumRecords / 2 );
+
+   e57::ImageFileOptions readOptions;
+   readOptions.follow = true;
+
+   e57::ImageFile readImf( fileName, "r", readOptions );
+   e57::CompressedVectorNode readCv( readImf.root().get( "points" ) );
+
+   const int64_t followed = readCv.childCount();
+
+   ASSERT_GT( followed, 0 );
+   ASSERT_LE( followed, cNumRecords / 2 );
+
+   std::vector<int64_t> readX( cBufferSize );
+   std::vector<int64_t> readRow( cBufferSize );
+   std::vector<float> readValue( cBufferSize );
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( readImf, "x", readX.data(), cBufferSize, true );
+   dbufs.emplace_back( readImf, "row", readRow.data(), cBufferSize, true );
+   dbufs.emplace_back( readImf, "value", readValue.data(), cBufferSize );
+
+   e57::CompressedVectorReader reader = readCv.reader( dbufs );
+
+   int64_t total = 0;
+
+   auto readRecords = [&]() {
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         for ( unsigned i = 0; i < count; ++i )
+         {
+            const int64_t record = total + i;
+
+            ASSERT_EQ( readX[i], deltaTestX( record ) );
+            ASSERT_EQ( readRow[i], deltaTestRow( record ) );
+            ASSERT_EQ( readValue[i], static_cast<float>( record ) * 0.5f );
+         }
+
+         total += count;
+      }
+   };
+
+   readRecords();
+
+   ASSERT_EQ( total, followed );
+
+   // Nothing has been journaled since
+   ASSERT_FALSE( readImf.refresh() );
+
+   // The reader carries on into what is written next
+   writeRecords( cNumRecords / 2, cNumRecords );
+   writer.close();
+
+   ASSERT_TRUE( readImf.refresh() );
+   ASSERT_EQ( readCv.childCount(), cNumRecords );
+
+   readRecords();
+
+   ASSERT_EQ( total, cNumRecords );
+
+   // Once the writer closes the file it is complete, and no longer followed
+   writeImf.close();
+
+   ASSERT_TRUE( readImf.refresh() );
+   ASSERT_FALSE( readImf.refresh() );
+
+   reader.seek( 0 );
+   total = 0;
+
+   readRecords();
+
+   ASSERT_EQ( total, cNumRecords );
+
+   reader.close();
+   readImf.close();
+}
+
+TEST( CompressedVector, Statistics )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorStatistics.e57" ) );
+
+   e57::ImageFile imf( "./CompressedVectorStatistics.e57", "r" );
+
+   e57::ImageFileStatistics statistics = imf.statistics();
+
+   // Without E57_ENABLE_STATISTICS nothing is counted
+   if ( !statistics.enabled )
+   {
+      EXPECT_EQ( statistics.bytesRead, 0U );
+      EXPECT_EQ( statistics.checksumsVerified, 0U );
+      EXPECT_TRUE( statistics.channels.empty() );
+
+      imf.close();
+      return;
+   }
+
+   // Opening the file reads its header and XML section
+   EXPECT_GT( statistics.bytesRead, 0U );
+   EXPECT_GT( statistics.pagesRead, 0U );
+   EXPECT_GT( statistics.checksumsVerified, 0U );
+   EXPECT_EQ( statistics.bytesWritten, 0U );
+
+   imf.resetStatistics();
+
+   statistics = imf.statistics();
+
+   EXPECT_EQ( statistics.bytesRead, 0U );
+   EXPECT_EQ( statistics.checksumsVerified, 0U );
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) );
+
+   statistics = imf.statistics();
+
+   EXPECT_GT( statistics.bytesRead, 0U );
+   EXPECT_GT( statistics.packetCacheMisses, 0U );
+   EXPECT_GT( statistics.packetCacheHits, 0U );
+
+   ASSERT_EQ( statistics.channels.size(), 4U );
+
+   for ( const auto &channel : statistics.channels )
+   {
+      EXPECT_EQ( channel.recordsRead, static_cast<uint64_t>( cNumRecords ) ) << channel.pathName;
+   }
+
+   const auto valueChannel = std::find_if(
+      statistics.channels.begin(), statistics.channels.end(),
+      []( const e57::ChannelStatistics &channel ) { return channel.pathName == "/points/value"; } );
+
+   ASSERT_NE( valueChannel, statistics.channels.end() );
+   EXPECT_GT( valueChannel->packetsDecoded, 1U );
+
+   imf.close();
+}
+
+TEST( CompressedVector, PacketFill )
+{
+   // A 1-bit flag next to a 64-bit timestamp
+   constexpr int64_t cRecordCount = 200'000;
+
+   std::vector<int64_t> flag( cBufferSize );
+   std::vector<double> time( cBufferSize );
+
+   {
+      e57::ImageFile imf( "./CompressedVectorPacketFill.e57", "w" );
+
+      e57::StructureNode proto( imf );
+      proto.set( "flag", e57::IntegerNode( imf, 0, 0, 1 ) );
+      proto.set( "time", e57::FloatNode( imf, 0.0, e57::PrecisionDouble ) );
+
+      e57::VectorNode codecs( imf, true );
+      e57::CompressedVectorNode cv( imf, proto, codecs );
+      imf.root().set( "points", cv );
+
+      std::vector<e57::SourceDestBuffer> sbufs;
+      sbufs.emplace_back( imf, "flag", flag.data(), cBufferSize, true );
+      sbufs.emplace_back( imf, "time", time.data(), cBufferSize );
+
+      e57::CompressedVectorWriter writer = cv.writer( sbufs );
+
+      // Empty writes add nothing but the packet every section needs
+      writer.write( 0 );
+      writer.write( 0 );
+
+      for ( int64_t start = 0; start < cRecordCount; start += cBufferSize )
+      {
+         for ( size_t i = 0; i < cBufferSize; ++i )
+         {
+            const int64_t record = start + static_cast<int64_t>( i );
+
+            flag[i] = static_cast<int64_t>( record % 3 == 0 );
+            time[i] = static_cast<double>( record ) * 0.25;
+         }
+
+         writer.write( cBufferSize );
+      }
+
+      writer.write( 0 );
+      writer.close();
+
+      const e57::ImageFileStatistics statistics = imf.statistics();
+
+      if ( statistics.enabled )
+      {
+         // Every packet but the empty one and the last is nearly full
+         ASSERT_GT( statistics.dataPacketsWritten, 2U );
+         EXPECT_GT( static_cast<double>( statistics.dataPacketBytesWritten ),
+                    0.95 * 65536.0 * static_cast<double>( statistics.dataPacketsWritten - 2 ) );
+         EXPECT_GT( statistics.dataPacketFillRatio, 0.0 );
+         EXPECT_LE( statistics.dataPacketFillRatio, 1.0 );
+      }
+
+      imf.close();
+   }
+
+   e57::ImageFile imf( "./CompressedVectorPacketFill.e57", "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "flag", flag.data(), cBufferSize, true );
+   dbufs.emplace_back( imf, "time", time.data(), cBufferSize );
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs );
+
+   int64_t record = 0;
+   unsigned count = 0;
+
+   while ( ( count = reader.read() ) > 0 )
+   {
+      for ( unsigned i = 0; i < count; ++i, ++record )
+      {
+         ASSERT_EQ( flag[i], static_cast<int64_t>( record % 3 == 0 ) ) << record;
+         ASSERT_EQ( time[i], static_cast<double>( record ) * 0.25 ) << record;
+      }
+   }
+
+   EXPECT_EQ( record, cRecordCount );
+
+   reader.close();
+   imf.close();
+}
+
+TEST( CompressedVector, Tracing )
+{
+   const bool cTracing = e57::Tracing::start();
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorTracing.e57" ) );
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorTracing.e57", {} ) );
+
+   E57_ASSERT_NO_THROW( e57::Tracing::stop( "./CompressedVectorTracing.json" ) );
+
+   const std::vector<char> cContents = fileContents( "./CompressedVectorTracing.json" );
+   const std::string cTrace( cContents.begin(), cContents.end() );
+
+   EXPECT_EQ( cTrace.find( R"({"displayTimeUnit":"ms","traceEvents":[)" ), 0U );
+
+   // Without E57_ENABLE_TRACING nothing is recorded
+   if ( !cTracing )
+   {
+      EXPECT_EQ( cTrace.find( R"("ph":"X")" ), std::string::npos );
+      return;
+   }
+
+   for ( const char *name :
+         { "CompressedVectorWriterImpl::packetWrite", "CheckedFile::writePhysicalPages",
+           "E57XmlParser::parse", "CompressedVectorReaderImpl::read",
+           "CompressedVectorReaderImpl::feedPacketToDecoders", "PacketReadCache::readPacket",
+           "CheckedFile::readPhysicalPages" } )
+   {
+      EXPECT_NE( cTrace.find( std::string( "\"name\":\"" ) + name + "\"" ), std::string::npos )
+         << name;
+   }
+
+   // Nothing is recorded once stopped
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorTracing.e57" ) );
+   E57_ASSERT_NO_THROW( e57::Tracing::stop( "./CompressedVectorTracing.json" ) );
+
+   EXPECT_EQ( fileContents( "./CompressedVectorTracing.json" ).size(),
+              std::string( "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n]}\n" ).size() );
+}
+
+namespace
+{
+   // Reads a copy of a file held in memory without exposing it through data(), so every page is
+   // read with readAt() like a remote source would be.
+   class VectorReadSource : public e57::ReadSource
+   {
+   public:
+      explicit VectorReadSource( std::vector<char> contents ) : contents_( std::move( contents ) )
+      {
+      }
+
+      e57::ustring name() const override
+      {
+         return "memory:test";
+      }
+
+      uint64_t size() const override
+      {
+         return contents_.size();
+      }
+
+      void readAt( uint64_t offset, char *buffer, size_t count ) override
+      {
+         if ( failReads || ( offset + count > contents_.size() ) )
+         {
+            throw std::runtime_error( "readAt failed" );
+         }
+
+         std::copy_n( contents_.begin() + static_cast<std::ptrdiff_t>( offset ), count, buffer );
+
+         ++readCount;
+      }
+
+      void readRanges( const std::vector<Range> &ranges ) override
+      {
+         ++readRangesCount;
+
+         e57::ReadSource::readRanges( ranges );
+      }
+
+      std::atomic<bool> failReads{ false };
+      std::atomic<int> readCount{ 0 };
+      std::atomic<int> readRangesCount{ 0 };
+
+   private:
+      const std::vector<char> contents_;
+   };
+}
+
+TEST( CompressedVector, ReadSource )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorReadSource.e57" ) );
+
+   auto source =
+      std::make_shared<VectorReadSource>( fileContents( "./CompressedVectorReadSource.e57" ) );
+
+   e57::ImageFile imf( source );
+
+   EXPECT_EQ( imf.fileName(), "memory:test" );
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) );
+
+   e57::CompressedVectorReaderOptions options;
+   options.decodeThreadCount = 4;
+   options.readAheadPacketCount = 4;
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, options ) );
+
+   EXPECT_GT( source->readCount, 0 );
+
+   imf.close();
+
+   // Errors from the source are reported as ErrorReadFailed
+   source->failReads = true;
+
+   try
+   {
+      e57::ImageFile failing( source );
+
+      FAIL() << "opened a source which can't be read";
+   }
+   catch ( e57::E57Exception &err )
+   {
+      EXPECT_EQ( err.errorCode(), e57::ErrorReadFailed );
+   }
+
+   const std::shared_ptr<e57::ReadSource> cNoSource;
+
+   E57_ASSERT_THROW( e57::ImageFile noFile( cNoSource ) );
+}
+
+TEST( CompressedVector, ReadSourceLargeBlob )
+{
+   constexpr size_t cBlobSize = 4 * 1024 * 1024;
+
+   std::vector<uint8_t> blob( cBlobSize );
+   for ( size_t i = 0; i < cBlobSize; ++i )
+   {
+      blob[i] = static_cast<uint8_t>( i * 7 + i / 1000 );
+   }
+
+   {
+      e57::ImageFile imf( "./CompressedVectorReadSourceBlob.e57", "w" );
+      e57::BlobNode blobNode( imf, static_cast<int64_t>( cBlobSize ) );
+      imf.root().set( "blob", blobNode );
+
+      blobNode.write( blob.data(), 0, cBlobSize );
+
+      imf.close();
+   }
+
+   auto source = std::make_shared<VectorReadSource>(
+      fileContents( "./CompressedVectorReadSourceBlob.e57" ) );
+
+   e57::ImageFile imf( source );
+   e57::BlobNode blobNode( imf.root().get( "blob" ) );
+
+   // Large reads ask the source for several ranges at once
+   std::vector<uint8_t> contents( cBlobSize );
+   E57_ASSERT_NO_THROW( blobNode.read( contents.data(), 0, cBlobSize ) );
+
+   EXPECT_EQ( contents, blob );
+   EXPECT_GT( source->readRangesCount, 0 );
+
+   imf.close();
+}
+
+namespace
+{
+   // Everything in a file written by the MemoryMappedRead test.
+   struct MappedTestData
+   {
+      std::vector<int64_t> index;
+      std::vector<float> value;
+      std::vector<e57::ustring> label;
+      std::vector<uint8_t> blob;
+   };
+
+   MappedTestData readMappedTestData( e57::ImageFile &inImageFile,
+                                      const e57::CompressedVectorReaderOptions &inOptions )
+   {
+      MappedTestData data;
+
+      e57::CompressedVectorNode cv( inImageFile.root().get( "points" ) );
+
+      std::vector<int64_t> index( cBufferSize );
+      std::vector<float> value( cBufferSize );
+      std::vector<e57::ustring> label( cBufferSize );
+
+      std::vector<e57::SourceDestBuffer> dbufs;
+      dbufs.emplace_back( inImageFile, "index", index.data(), cBufferSize, true );
+      dbufs.emplace_back( inImageFile, "value", value.data(), cBufferSize );
+      dbufs.emplace_back( inImageFile, "label", &label );
+
+      e57::CompressedVectorReader reader = cv.reader( dbufs, inOptions );
+
+      unsigned count = 0;
+
+      while ( ( count = reader.read() ) > 0 )
+      {
+         data.index.insert( data.index.end(), index.begin(), index.begin() + count );
+         data.value.insert( data.value.end(), value.begin(), value.begin() + count );
+         data.label.insert( data.label.end(), label.begin(), label.begin() + count );
+      }
+
+      reader.close();
+
+      e57::BlobNode blobNode( inImageFile.root().get( "blob" ) );
+
+      data.blob.resize( static_cast<size_t>( blobNode.byteCount() ) );
+      blobNode.read( data.blob.data(), 0, data.blob.size() );
+
+      return data;
+   }
+}
+
+// A file opened by name is read through a memory map when built with E57_ENABLE_MMAP (the
+// default). Check that it reads the same as through a ReadSource, which is never mapped.
+TEST( CompressedVector, MemoryMappedRead )
+{
+   constexpr size_t cBlobSize = 300 * 1024;
+
+   std::vector<uint8_t> blob( cBlobSize );
+   for ( size_t i = 0; i < cBlobSize; ++i )
+   {
+      blob[i] = static_cast<uint8_t>( i * 13 + i / 777 );
+   }
+
+   {
+      e57::ImageFile imf( "./CompressedVectorMemoryMapped.e57", "w" );
+
+      e57::CompressedVectorNode cv = addTestVector( imf, "points" );
+      writeTestRecords( imf, cv, {} );
+
+      e57::BlobNode blobNode( imf, static_cast<int64_t>( cBlobSize ) );
+      imf.root().set( "blob", blobNode );
+
+      blobNode.write( blob.data(), 0, cBlobSize );
+
+      imf.close();
+   }
+
+   e57::CompressedVectorReaderOptions threaded;
+   threaded.decodeThreadCount = 4;
+   threaded.readAheadPacketCount = 4;
+
+   for ( const auto &options : { e57::CompressedVectorReaderOptions{}, threaded } )
+   {
+      e57::ImageFile mapped( "./CompressedVectorMemoryMapped.e57", "r" );
+
+      const MappedTestData cMapped = readMappedTestData( mapped, options );
+
+      mapped.close();
+
+      auto source = std::make_shared<VectorReadSource>(
+         fileContents( "./CompressedVectorMemoryMapped.e57" ) );
+
+      e57::ImageFile unmapped( source );
+
+      const MappedTestData cUnmapped = readMappedTestData( unmapped, options );
+
+      unmapped.close();
+
+      EXPECT_GT( source->readCount, 0 );
+
+      ASSERT_EQ( cMapped.index.size(), static_cast<size_t>( cNumRecords ) );
+
+      for ( size_t i = 0; i < cMapped.index.size(); ++i )
+      {
+         ASSERT_EQ( cMapped.index[i], static_cast<int64_t>( i ) );
+      }
+
+      EXPECT_EQ( cMapped.index, cUnmapped.index );
+      EXPECT_EQ( cMapped.value, cUnmapped.value );
+      EXPECT_EQ( cMapped.label, cUnmapped.label );
+
+      EXPECT_EQ( cMapped.blob, blob );
+      EXPECT_EQ( cUnmapped.blob, blob );
+   }
+}
+
+TEST( CompressedVector, BlockCacheReadSource )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorBlockCache.e57" ) );
+
+   auto source =
+      std::make_shared<VectorReadSource>( fileContents( "./CompressedVectorBlockCache.e57" ) );
+   auto cache = std::make_shared<e57::BlockCacheReadSource>( source, 64 * 1024, 4 );
+
+   EXPECT_EQ( cache->size(), source->size() );
+
+   e57::ImageFile imf( cache );
+
+   EXPECT_EQ( imf.fileName(), "memory:test" );
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) );
+   E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) );
+
+   // Each page is read from the cache, and the source is only asked for whole blocks
+   EXPECT_GT( cache->fetchCount(), 0u );
+   EXPECT_EQ( static_cast<uint64_t>( source->readCount ), cache->fetchCount() );
+   EXPECT_LE( cache->bytesFetched(), cache->fetchCount() * 4 * 64 * 1024 );
+
+   imf.close();
+
+   // Reading past the end
+   std::vector<char> buffer( 16 );
+   E57_ASSERT_THROW( cache->readAt( cache->size() - 8, buffer.data(), buffer.size() ) );
+
+   const std::shared_ptr<e57::ReadSource> cNoSource;
+
+   E57_ASSERT_THROW( e57::BlockCacheReadSource noCache( cNoSource ) );
+   E57_ASSERT_THROW( e57::BlockCacheReadSource zeroBlocks( source, 1024, 0 ) );
+}
+
+TEST( CompressedVector, OpenOnManyThreads )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorOpenOnManyThreads.e57" ) );
+
+   // Files opened one after another and on several threads at a time share the XML readers
+   std::vector<std::thread> threads;
+
+   for ( int i = 0; i < 4; ++i )
+   {
+      threads.emplace_back( [i] {
+         e57::ImageFileOptions options;
+         options.validateXml = ( i % 2 == 0 );
+
+         for ( int j = 0; j < 10; ++j )
+         {
+            e57::ImageFile imf( "./CompressedVectorOpenOnManyThreads.e57", "r", options );
+            e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+            ASSERT_EQ( cv.childCount(), cNumRecords );
+
+            imf.close();
+         }
+      } );
+   }
+
+   for ( auto &thread : threads )
+   {
+      thread.join();
+   }
+}
+
+TEST( CompressedVector, MemoryWriteSink )
+{
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorWriteSink.e57" ) );
+
+   auto sink = std::make_shared<e57::MemoryWriteSink>( "memory:out" );
+
+   {
+      e57::ImageFile imf( sink );
+
+      EXPECT_EQ( imf.fileName(), "memory:out" );
+
+      e57::CompressedVectorNode cv = addTestVector( imf, "points" );
+      E57_ASSERT_NO_THROW( writeTestRecords( imf, cv, {} ) );
+
+      imf.close();
+   }
+
+   // The sink holds the same bytes as the file
+   const std::vector<char> contents = sink->takeBuffer();
+
+   EXPECT_EQ( contents, fileContents( "./CompressedVectorWriteSink.e57" ) );
+   EXPECT_EQ( sink->size(), 0u );
+
+   e57::ImageFile imf( contents.data(), contents.size() );
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) );
+
+   imf.close();
+
+   const std::shared_ptr<e57::WriteSink> cNoSink;
+
+   E57_ASSERT_THROW( e57::ImageFile noFile( cNoSink ) );
+}
+
+TEST( CompressedVector, DirectIo )
+{
+   e57::ImageFileOptions options;
+   options.directIo = true;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorDirectIo.e57", {}, options ) );
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorBuffered.e57" ) );
+
+   // The file is the same however it is written
+   EXPECT_EQ( fileContents( "./CompressedVectorDirectIo.e57" ),
+              fileContents( "./CompressedVectorBuffered.e57" ) );
+
+   E57_ASSERT_NO_THROW( checkReadAll( "./CompressedVectorDirectIo.e57", {} ) );
+
+   // A blob bigger than the direct I/O buffer, written in pieces which don't line up with pages
+   constexpr size_t cBlobSize = 20 * 1024 * 1024 + 123;
+   constexpr size_t cPieceSize = 777777;
+
+   std::vector<uint8_t> blob( cBlobSize );
+   for ( size_t i = 0; i < cBlobSize; ++i )
+   {
+      blob[i] = static_cast<uint8_t>( i * 13 + i / 4099 );
+   }
+
+   const auto writeBlobFile = [&]( const e57::ustring &fileName,
+                                  const e57::ImageFileOptions &imageFileOptions ) {
+      e57::ImageFile imf( fileName, "w", imageFileOptions );
+      e57::BlobNode blobNode( imf, static_cast<int64_t>( cBlobSize ) );
+      imf.root().set( "blob", blobNode );
+
+      for ( size_t start = 0; start < cBlobSize; start += cPieceSize )
+      {
+         blobNode.write( blob.data() + start, static_cast<int64_t>( start ),
+                         std::min( cPieceSize, cBlobSize - start ) );
+      }
+
+      imf.close();
+   };
+
+   E57_ASSERT_NO_THROW( writeBlobFile( "./CompressedVectorDirectIoBlob.e57", options ) );
+   E57_ASSERT_NO_THROW( writeBlobFile( "./CompressedVectorBufferedBlob.e57", {} ) );
+
+   EXPECT_EQ( fileContents( "./CompressedVectorDirectIoBlob.e57" ),
+              fileContents( "./CompressedVectorBufferedBlob.e57" ) );
+}
+
+TEST( CompressedVector, ParallelBlob )
+{
+   // Big enough for several batches of pages on each thread, starting partway through a page
+   constexpr size_t cBlobSize = 24 * 1024 * 1024 + 321;
+   constexpr size_t cStart = 1000;
+
+   std::vector<uint8_t> blob( cBlobSize );
+   for ( size_t i = 0; i < cBlobSize; ++i )
+   {
+      blob[i] = static_cast<uint8_t>( i * 7 + i / 1021 );
+   }
+
+   const auto writeBlobFile = [&]( const e57::ustring &fileName,
+                                   const std::function<void( e57::BlobNode & )> &writeBlob ) {
+      e57::ImageFile imf( fileName, "w" );
+      e57::BlobNode blobNode( imf, static_cast<int64_t>( cBlobSize ) );
+      imf.root().set( "blob", blobNode );
+
+      blobNode.write( blob.data(), 0, cStart );
+      writeBlob( blobNode );
+
+      imf.close();
+   };
+
+   E57_ASSERT_NO_THROW( writeBlobFile( "./CompressedVectorSerialBlob.e57",
+                                       [&]( e57::BlobNode &b ) {
+                                          b.write( blob.data() + cStart, cStart,
+                                                   cBlobSize - cStart );
+                                       } ) );
+
+   E57_ASSERT_NO_THROW( writeBlobFile( "./CompressedVectorParallelBlob.e57",
+                                       [&]( e57::BlobNode &b ) {
+                                          b.write( blob.data() + cStart, cStart,
+                                                   cBlobSize - cStart, 4 );
+                                       } ) );
+
+   // The source gives a few bytes less than it is asked for each time
+   size_t position = cStart;
+
+   const e57::BlobSource source = [&]( uint8_t *buffer, size_t count ) {
+      const size_t n = std::max<size_t>( 1, count - std::min<size_t>( count, 17 ) );
+
+      memcpy( buffer, blob.data() + position, n );
+      position += n;
+
+      return n;
+   };
+
+   E57_ASSERT_NO_THROW( writeBlobFile( "./CompressedVectorStreamedBlob.e57",
+                                       [&]( e57::BlobNode &b ) {
+                                          b.write( source, cStart, cBlobSize - cStart, 3 );
+                                       } ) );
+
+   const std::vector<char> serial = fileContents( "./CompressedVectorSerialBlob.e57" );
+
+   EXPECT_EQ( fileContents( "./CompressedVectorParallelBlob.e57" ), serial );
+   EXPECT_EQ( fileContents( "./CompressedVectorStreamedBlob.e57" ), serial );
+
+   // A source which runs out early
+   const e57::BlobSource emptySource = []( uint8_t *, size_t ) { return size_t( 0 ); };
+
+   E57_ASSERT_THROW( writeBlobFile( "./CompressedVectorEmptySourceBlob.e57",
+                                    [&]( e57::BlobNode &b ) {
+                                       b.write( emptySource, cStart, cBlobSize - cStart );
+                                    } ) );
+
+   e57::ImageFile imf( "./CompressedVectorParallelBlob.e57", "r" );
+   e57::BlobNode blobNode( imf.root().get( "blob" ) );
+
+   std::vector<uint8_t> read( cBlobSize );
+
+   E57_ASSERT_NO_THROW( blobNode.read( read.data(), 0, cBlobSize, 4 ) );
+   EXPECT_EQ( read, blob );
+
+   imf.close();
+}
+
+TEST( CompressedVector, ImportBlob )
+{
+   // Big enough for several batches of pages on each thread, and not a whole number of pages
+   constexpr size_t cBlobSize = 5 * 1024 * 1024 + 321;
+   constexpr size_t cStart = 1000;
+
+   std::vector<uint8_t> blob( cBlobSize );
+   for ( size_t i = 0; i < cBlobSize; ++i )
+   {
+      blob[i] = static_cast<uint8_t>( i * 13 + i / 1019 );
+   }
+
+   {
+      std::ofstream source( "./CompressedVectorImportSource.bin", std::ios::binary );
+      source.write( reinterpret_cast<const char *>( blob.data() + cStart ), cBlobSize - cStart );
+   }
+
+   const auto writeBlobFile = [&]( const e57::ustring &fileName,
+                                   const std::function<void( e57::BlobNode & )> &writeBlob ) {
+      e57::ImageFile imf( fileName, "w" );
+      e57::BlobNode blobNode( imf, static_cast<int64_t>( cBlobSize ) );
+      imf.root().set( "blob", blobNode );
+
+      blobNode.write( blob.data(), 0, cStart );
+      writeBlob( blobNode );
+
+      imf.close();
+   };
+
+   E57_ASSERT_NO_THROW( writeBlobFile( "./CompressedVectorCopiedBlob.e57",
+                                       [&]( e57::BlobNode &b ) {
+                                          b.write( blob.data() + cStart, cStart,
+                                                   cBlobSize - cStart );
+                                       } ) );
+
+   for ( unsigned threadCount : { 1u, 4u } )
+   {
+      E57_ASSERT_NO_THROW( writeBlobFile( "./CompressedVectorImportedBlob.e57",
+                                          [&]( e57::BlobNode &b ) {
+                                             EXPECT_EQ( b.importFile(
+                                                           "./CompressedVectorImportSource.bin",
+                                                           cStart, threadCount ),
+                                                        int64_t( cBlobSize - cStart ) );
+                                          } ) );
+
+      EXPECT_EQ( fileContents( "./CompressedVectorImportedBlob.e57" ),
+                 fileContents( "./CompressedVectorCopiedBlob.e57" ) );
+   }
+
+   // The file doesn't fit after the start given
+   E57_ASSERT_THROW( writeBlobFile( "./CompressedVectorImportedBlob.e57", []( e57::BlobNode &b ) {
+      b.importFile( "./CompressedVectorImportSource.bin", 2 * cStart );
+   } ) );
+
+   E57_ASSERT_THROW( writeBlobFile( "./CompressedVectorImportedBlob.e57", []( e57::BlobNode &b ) {
+      b.importFile( "./CompressedVectorNoSuchFile.bin", cStart );
+   } ) );
+}
+
+TEST( CompressedVector, Executor )
+{
+   // Passes everything on to a WorkStealingExecutor, counting the tasks
+   class CountingExecutor : public e57::Executor
+   {
+   public:
+      void execute( std::function<void()> task ) override
+      {
+         ++taskCount;
+         executor_.execute( std::move( task ) );
+      }
+
+      unsigned concurrency() const override
+      {
+         return executor_.concurrency();
+      }
+
+      std::atomic<unsigned> taskCount{ 0 };
+
+   private:
+      e57::WorkStealingExecutor executor_{ 2 };
+   };
+
+   auto executor = std::make_shared<CountingExecutor>();
+
+   e57::ImageFileOptions imageFileOptions;
+   imageFileOptions.executor = executor;
+
+   e57::CompressedVectorWriterOptions writerOptions;
+   writerOptions.encodeThreadCount = 4;
+   writerOptions.writeBehindPacketCount = 2;
+
+   E57_ASSERT_NO_THROW(
+      writeTestFile( "./CompressedVectorExecutor.e57", writerOptions, imageFileOptions ) );
+
+   EXPECT_GT( executor->taskCount, 0U );
+
+   executor->taskCount = 0;
+
+   e57::CompressedVectorReaderOptions readerOptions;
+   readerOptions.decodeThreadCount = 4;
+   readerOptions.readAheadPacketCount = 4;
+
+   e57::ImageFile imf( "./CompressedVectorExecutor.e57", "r", imageFileOptions );
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, readerOptions ) );
+
+   imf.close();
+
+   EXPECT_GT( executor->taskCount, 0U );
+}
+
+TEST( CompressedVector, MemoryUsage )
+{
+   constexpr uint64_t cPacketSize = 64 * 1024;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorMemoryUsage.e57" ) );
+
+   e57::ImageFile imf( "./CompressedVectorMemoryUsage.e57", "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   e57::ImageFileMemoryUsage usage = imf.memoryUsage();
+
+   EXPECT_GT( usage.nodes, 0U );
+   EXPECT_EQ( usage.packetCache, 0U );
+   EXPECT_EQ( usage.budget, 0U );
+
+   std::vector<int64_t> index( cBufferSize );
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "index", index.data(), cBufferSize, true );
+
+   e57::CompressedVectorReaderOptions options;
+   options.packetCacheSize = 8;
+   options.readAheadPacketCount = 4;
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs, options );
+
+   usage = imf.memoryUsage();
+
+   EXPECT_GE( usage.packetCache, 8 * cPacketSize );
+   EXPECT_EQ( usage.readAhead, 4 * cPacketSize );
+   EXPECT_GT( usage.decoders, 0U );
+   EXPECT_EQ( usage.total, usage.packetCache + usage.readAhead + usage.decoders + usage.encoders +
+                              usage.writeBuffers + usage.nodes + usage.xml );
+   EXPECT_GE( usage.peak, usage.total );
+
+   reader.close();
+
+   usage = imf.memoryUsage();
+
+   EXPECT_EQ( usage.packetCache, 0U );
+   EXPECT_EQ( usage.readAhead, 0U );
+   EXPECT_EQ( usage.decoders, 0U );
+
+   // With a budget there is only room for part of the cache, and none for read-ahead
+   imf.setMemoryBudget( usage.total + 3 * cPacketSize );
+
+   reader = cv.reader( dbufs, options );
+
+   usage = imf.memoryUsage();
+
+   EXPECT_GT( usage.packetCache, 0U );
+   EXPECT_LT( usage.packetCache, 3 * cPacketSize );
+   EXPECT_EQ( usage.readAhead, 0U );
+
+   reader.close();
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, options ) );
+
+   imf.close();
+
+   // Write-behind is left out when there is no room for it, which writes the same file
+   e57::CompressedVectorWriterOptions writerOptions;
+   writerOptions.writeBehindPacketCount = 4;
+
+   e57::ImageFileOptions imageFileOptions;
+   imageFileOptions.memoryBudget = 1;
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorMemoryBudget.e57", writerOptions,
+                                       imageFileOptions ) );
+
+   EXPECT_EQ( fileContents( "./CompressedVectorMemoryUsage.e57" ),
+              fileContents( "./CompressedVectorMemoryBudget.e57" ) );
+}
+
+TEST( CompressedVector, ProgressAndCancellation )
+{
+   // Each call is at least as far on as the one before
+   const auto checkProgress = []( const std::vector<e57::CompressedVectorProgress> &progress ) {
+      for ( size_t i = 1; i < progress.size(); ++i )
+      {
+         EXPECT_GE( progress[i].recordsDone, progress[i - 1].recordsDone );
+         EXPECT_GE( progress[i].bytesDone, progress[i - 1].bytesDone );
+      }
+   };
+
+   std::vector<e57::CompressedVectorProgress> writeProgress;
+
+   e57::CompressedVectorWriterOptions writerOptions;
+   writerOptions.progressPacketInterval = 1;
+   writerOptions.progress = [&]( const e57::CompressedVectorProgress &progress ) {
+      writeProgress.push_back( progress );
+   };
+
+   E57_ASSERT_NO_THROW( writeTestFile( "./CompressedVectorProgress.e57", writerOptions ) );
+
+   // One call for each write(), and one for each packet
+   ASSERT_GT( writeProgress.size(), static_cast<size_t>( cNumRecords / cBufferSize ) );
+   EXPECT_EQ( writeProgress.back().recordsDone, static_cast<uint64_t>( cNumRecords ) );
+   EXPECT_GT( writeProgress.back().bytesDone, 0U );
+   EXPECT_EQ( writeProgress.back().recordCount, 0U );
+   checkProgress( writeProgress );
+
+   std::vector<e57::CompressedVectorProgress> readProgress;
+
+   e57::CompressedVectorReaderOptions readerOptions;
+   readerOptions.progressPacketInterval = 1;
+   readerOptions.progress = [&]( const e57::CompressedVectorProgress &progress ) {
+      readProgress.push_back( progress );
+   };
+
+   e57::ImageFile imf( "./CompressedVectorProgress.e57", "r" );
+
+   E57_ASSERT_NO_THROW( checkReadAll( imf, readerOptions ) );
+
+   ASSERT_FALSE( readProgress.empty() );
+   EXPECT_EQ( readProgress.back().recordsDone, static_cast<uint64_t>( cNumRecords ) );
+   EXPECT_EQ( readProgress.back().recordCount, static_cast<uint64_t>( cNumRecords ) );
+   EXPECT_GT( readProgress.back().byteCount, 0U );
+   EXPECT_EQ( readProgress.back().bytesDone, readProgress.back().byteCount );
+   checkProgress( readProgress );
+
+   // Cancelling stops the read at the next packet
+   auto cancellation = std::make_shared<e57::CancellationToken>();
+
+   readerOptions.cancellation = cancellation;
+   readerOptions.progress = [&]( const e57::CompressedVectorProgress & ) {
+      cancellation->cancel();
+   };
+
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   std::vector<int64_t> index( cBufferSize );
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "index", index.data(), cBufferSize, true );
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs, readerOptions );
+
+   try
+   {
+      while ( reader.read() > 0 )
+      {
+      }
+
+      FAIL() << "read() wasn't cancelled";
+   }
+   catch ( const e57::E57Exception &err )
+   {
+      EXPECT_EQ( err.errorCode(), e57::ErrorCancelled );
+   }
+
+   reader.close();
+   imf.close();
+
+   // A cancelled writer writes nothing more, and the file is cancelled
+   cancellation = std::make_shared<e57::CancellationToken>();
+
+   writerOptions.cancellation = cancellation;
+   writerOptions.progress = [&]( const e57::CompressedVectorProgress & ) {
+      cancellation->cancel();
+   };
+
+   e57::ImageFile cancelledImf( "./CompressedVectorCancelled.e57", "w" );
+   e57::CompressedVectorNode cancelledCV = addTestVector( cancelledImf, "points" );
+
+   try
+   {
+      writeTestRecords( cancelledImf, cancelledCV, writerOptions );
+
+      FAIL() << "write() wasn't cancelled";
+   }
+   catch ( const e57::E57Exception &err )
+   {
+      EXPECT_EQ( err.errorCode(), e57::ErrorCancelled );
+   }
+
+   E57_ASSERT_NO_THROW( cancelledImf.cancel() );
+}
+
+TEST( CompressedVector, Transcode )
+{
+   // A file with a blob before the points
+   {
+      e57::ImageFile imf( "./CompressedVectorTranscodeSource.e57", "w" );
+
+      std::vector<uint8_t> blobData( 5000, 0x5a );
+      e57::BlobNode blob( imf, static_cast<int64_t>( blobData.size() ) );
+      imf.root().set( "blob", blob );
+      blob.write( blobData.data(), 0, blobData.size() );
+
+      e57::CompressedVectorNode cv = addTestVector( imf, "points" );
+
+      writeTestRecords( imf, cv, {} );
+
+      imf.close();
+   }
+
+   // Without conversions, the points are copied without decoding them
+   E57_ASSERT_NO_THROW( e57::transcode( "./CompressedVectorTranscodeSource.e57",
+                                        "./CompressedVectorTranscoded.e57" ) );
+
+   {
+      e57::ImageFile imf( "./CompressedVectorTranscoded.e57", "r" );
+
+      E57_ASSERT_NO_THROW( checkReadAll( imf, {} ) );
+
+      e57::BlobNode blob( imf.root().get( "blob" ) );
+      std::vector<uint8_t> blobData( static_cast<size_t>( blob.byteCount() ) );
+      blob.read( blobData.data(), 0, blobData.size() );
+
+      EXPECT_EQ( blobData, std::vector<uint8_t>( 5000, 0x5a ) );
+
+      imf.close();
+   }
+
+   // The limits of a Float field are those of its precision, which are too wide to be scaled
+   e57::TranscodeOptions options;
+
+   e57::TranscodeFieldConversion conversion;
+   conversion.fieldName = "value";
+   conversion.type = e57::TypeScaledInteger;
+   conversion.scale = 0.5;
+
+   options.conversions.push_back( conversion );
+
+   E57_ASSERT_THROW( e57::transcode( "./CompressedVectorTranscodeSource.e57",
+                                     "./CompressedVectorTranscodedScaled.e57", options ) );
+
+   // Decoded and encoded in blocks (of a size which doesn't divide the records) with threads
+   options.conversions.back().minimum = 0.0;
+   options.conversions.back().maximum = cNumRecords * 0.5;
+   options.blockRecordCount = 999;
+   options.readerOptions.decodeThreadCount = 2;
+   options.readerOptions.readAheadPacketCount = 2;
+   options.writerOptions.encodeThreadCount = 2;
+   options.writerOptions.writeBehindPacketCount = 2;
+   options.writerOptions.writeIndexPackets = true;
+
+   E57_ASSERT_NO_THROW( e57::transcode( "./CompressedVectorTranscodeSource.e57",
+                                        "./CompressedVectorTranscodedScaled.e57", options ) );
+
+   e57::ImageFile imf( "./CompressedVectorTranscodedScaled.e57", "r" );
+   e57::CompressedVectorNode cv( imf.root().get( "points" ) );
+
+   ASSERT_EQ( cv.childCount(), cNumRecords );
+   ASSERT_EQ( e57::StructureNode( cv.prototype() ).get( "value" ).type(), e57::TypeScaledInteger );
+
+   std::vector<int64_t> index( cBufferSize );
+   std::vector<double> value( cBufferSize );
+   std::vector<e57::ustring> label( cBufferSize );
+
+   std::vector<e57::SourceDestBuffer> dbufs;
+   dbufs.emplace_back( imf, "index", index.data(), cBufferSize, true );
+   dbufs.emplace_back( imf, "value", value.data(), cBufferSize, true, true );
+   dbufs.emplace_back( imf, "label", &label );
+
+   e57::CompressedVectorReader reader = cv.reader( dbufs );
+
+   int64_t record = 0;
+
+   while ( const unsigned count = reader.read() )
+   {
+      for ( unsigned i = 0; i < count; ++i, ++record )
+      {
+         ASSERT_EQ( index[i], record );
+         ASSERT_EQ( value[i], static_cast<double>( record ) * 0.5 );
+         ASSERT_EQ( label[i], labelFor( record ) );
+      }
+   }
+
+   EXPECT_EQ( record, cNumRecords );
+
+   reader.close();
+   imf.close();
+}
@@ -0,0 +1,100 @@
+// libE57Format testing Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "ImageFileImpl.h"
+#include "StructureNodeImpl.h"
+
+namespace
+{
+   // A Structure with children named inNames, added to the root as inName.
+   e57::StructureNode addStructure( e57::ImageFile &imf, const e57::ustring &inName,
+                                    const std::vector<e57::ustring> &inNames )
+   {
+      e57::StructureNode structure( imf );
+      imf.root().set( inName, structure );
+
+      for ( const auto &name : inNames )
+      {
+         structure.set( name, e57::IntegerNode( imf ) );
+      }
+
+      return structure;
+   }
+
+   const e57::ustring *namePointer( const e57::StructureNode &inStructure,
+                                    const e57::ustring &inPathName )
+   {
+      return &inStructure.get( inPathName ).impl()->elementNameRef();
+   }
+
+   void checkInterned( e57::ImageFile &imf )
+   {
+      const e57::StructureNode first( imf.root().get( "first" ) );
+      const e57::StructureNode second( imf.root().get( "second" ) );
+
+      // One string for each name, shared by every node with it
+      EXPECT_EQ( namePointer( first, "cartesianX" ), namePointer( second, "cartesianX" ) );
+      EXPECT_EQ( namePointer( first, "cartesianY" ), namePointer( second, "cartesianY" ) );
+      EXPECT_NE( namePointer( first, "cartesianX" ), namePointer( first, "cartesianY" ) );
+
+      EXPECT_EQ( namePointer( first, "cartesianX" ),
+                 imf.impl()->internName( "cartesianX" ).get() );
+      EXPECT_EQ( first.get( "cartesianX" ).elementName(), "cartesianX" );
+   }
+}
+
+TEST( NodeImpl, InternedNames )
+{
+   const std::vector<e57::ustring> cNames{ "cartesianX", "cartesianY" };
+
+   {
+      e57::ImageFile imf( "./NodeImplInternedNames.e57", "w" );
+
+      addStructure( imf, "first", cNames );
+      addStructure( imf, "second", cNames );
+
+      checkInterned( imf );
+
+      imf.close();
+   }
+
+   // Names are interned the same way when they are read
+   {
+      e57::ImageFile imf( "./NodeImplInternedNames.e57", "r" );
+
+      checkInterned( imf );
+
+      imf.close();
+   }
+}
+
+// Each ImageFile has its own names, so nodes of different files are compared by their strings.
+TEST( NodeImpl, TypeEquivalentAcrossFiles )
+{
+   e57::ImageFile imf( "./NodeImplTypeEquivalent.e57", "w" );
+   e57::ImageFile other( "./NodeImplTypeEquivalentOther.e57", "w" );
+
+   const e57::StructureNode structure = addStructure( imf, "points", { "x", "y" } );
+   const e57::StructureNode same = addStructure( other, "points", { "x", "y" } );
+   const e57::StructureNode renamed = addStructure( other, "renamed", { "x", "z" } );
+
+   EXPECT_NE( namePointer( structure, "x" ), namePointer( same, "x" ) );
+
+   EXPECT_TRUE( structure.impl()->isTypeEquivalent( same.impl() ) );
+   EXPECT_TRUE( same.impl()->isTypeEquivalent( structure.impl() ) );
+   EXPECT_FALSE( structure.impl()->isTypeEquivalent( renamed.impl() ) );
+
+   // And within a file, by pointer
+   const e57::StructureNode copy = addStructure( imf, "copy", { "x", "y" } );
+   const e57::StructureNode different = addStructure( imf, "different", { "x", "z" } );
+
+   EXPECT_TRUE( structure.impl()->isTypeEquivalent( copy.impl() ) );
+   EXPECT_FALSE( structure.impl()->isTypeEquivalent( different.impl() ) );
+
+   other.close();
+   imf.close();
+}
@@ -93,6 +93,102 @@ TEST( SimpleDataHeader, HeaderMinMaxDouble )
    EXPECT_EQ( dataHeader.pointFields.timeMaximum, e57::DOUBLE_MAX );
 }
 
+TEST( SimpleDataBuffers, Aligned )
+{
+   e57::Data3D dataHeader;
+
+   dataHeader.pointCount = 1001;
+   dataHeader.pointFields.cartesianXField = true;
+   dataHeader.pointFields.cartesianYField = true;
+   dataHeader.pointFields.cartesianZField = true;
+   dataHeader.pointFields.cartesianInvalidStateField = true;
+   dataHeader.pointFields.colorRedField = true;
+   dataHeader.pointFields.timeStampField = true;
+
+   e57::Data3DPointsFloat pointsData( dataHeader );
+
+   const std::vector<const void *> cBuffers = { pointsData.cartesianX,
+                                                pointsData.cartesianY,
+                                                pointsData.cartesianZ,
+                                                pointsData.cartesianInvalidState,
+                                                pointsData.colorRed,
+                                                pointsData.timeStamp };
+
+   for ( const void *buffer : cBuffers )
+   {
+      ASSERT_NE( buffer, nullptr );
+      EXPECT_EQ( reinterpret_cast<uintptr_t>( buffer ) % e57::Data3DPointsFloat::cAlignment, 0U );
+   }
+
+   EXPECT_EQ( pointsData.intensity, nullptr );
+
+   // The buffers mustn't overlap
+   pointsData.cartesianX[1000] = 1.0f;
+   pointsData.cartesianInvalidState[1000] = 2;
+   pointsData.colorRed[1000] = 3;
+   pointsData.timeStamp[1000] = 4.0;
+
+   std::fill_n( pointsData.cartesianY, 1001, 0.0f );
+   std::fill_n( pointsData.cartesianZ, 1001, 0.0f );
+
+   EXPECT_EQ( pointsData.cartesianX[1000], 1.0f );
+   EXPECT_EQ( pointsData.cartesianInvalidState[1000], 2 );
+   EXPECT_EQ( pointsData.colorRed[1000], 3 );
+   EXPECT_EQ( pointsData.timeStamp[1000], 4.0 );
+
+   // Moving hands the buffers over
+   e57::Data3DPointsFloat moved( std::move( pointsData ) );
+
+   EXPECT_EQ( moved.cartesianX, cBuffers[0] );
+   EXPECT_EQ( moved.timeStamp, cBuffers[5] );
+   EXPECT_EQ( pointsData.cartesianX, nullptr );
+   EXPECT_EQ( pointsData.timeStamp, nullptr );
+
+   pointsData = std::move( moved );
+
+   EXPECT_EQ( pointsData.cartesianX, cBuffers[0] );
+   EXPECT_EQ( moved.cartesianX, nullptr );
+}
+
+TEST( SimpleDataBuffers, Pool )
+{
+   e57::Data3D dataHeader;
+
+   dataHeader.pointCount = 5000;
+   dataHeader.pointFields.cartesianXField = true;
+   dataHeader.pointFields.cartesianYField = true;
+   dataHeader.pointFields.cartesianZField = true;
+
+   e57::Data3DPointsBufferPool pool;
+
+   const void *first = nullptr;
+
+   {
+      const e57::Data3DPointsDouble pointsData( dataHeader, &pool );
+
+      first = pointsData.cartesianX;
+
+      EXPECT_EQ( reinterpret_cast<uintptr_t>( first ) % e57::Data3DPointsDouble::cAlignment, 0U );
+      EXPECT_EQ( pool.cachedSize(), 0U );
+   }
+
+   EXPECT_EQ( pool.cachedSize(), 3 * 5000 * sizeof( double ) );
+
+   // A smaller Data3D reuses the block
+   dataHeader.pointCount = 100;
+
+   {
+      const e57::Data3DPointsDouble pointsData( dataHeader, &pool );
+
+      EXPECT_EQ( pointsData.cartesianX, first );
+      EXPECT_EQ( pool.cachedSize(), 0U );
+   }
+
+   pool.release();
+
+   EXPECT_EQ( pool.cachedSize(), 0U );
+}
+
 // Checks that the Data3D header and the the cartesianX FloatNode data are the same when read,
 // written, and read again. https://github.com/asmaloney/libE57Format/issues/126
 TEST( SimpleData, ReadWrite )
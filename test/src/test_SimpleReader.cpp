@@ -1,6 +1,9 @@
 // libE57Format testing Copyright © 2022 Andy Maloney <asmaloney@gmail.com>
 // SPDX-License-Identifier: MIT
 
+#include <cstddef>
+#include <vector>
+
 #include "gtest/gtest.h"
 
 #include "E57SimpleReader.h"
@@ -254,6 +257,152 @@ TEST( SimpleReaderData, ColouredCubeFloatToDouble )
    delete reader;
 }
 
+TEST( SimpleReaderData, ColouredCubeFloatChunked )
+{
+   e57::Reader *reader = nullptr;
+
+   E57_ASSERT_NO_THROW(
+      reader = new e57::Reader( TestData::Path() + "/self/ColouredCubeFloat.e57", {} ) );
+
+   ASSERT_TRUE( reader->IsOpen() );
+   ASSERT_EQ( reader->GetData3DCount(), 1 );
+
+   e57::Data3D data3DHeader;
+   ASSERT_TRUE( reader->ReadData3D( 0, data3DHeader ) );
+
+   ASSERT_EQ( data3DHeader.pointCount, 7'680 );
+
+   const uint64_t cNumPoints = data3DHeader.pointCount;
+
+   // Read everything in one go to compare against
+   e57::Data3DPointsFloat pointsData( data3DHeader );
+
+   auto vectorReader = reader->SetUpData3DPointsData( 0, cNumPoints, pointsData );
+
+   ASSERT_EQ( vectorReader.read(), cNumPoints );
+
+   vectorReader.close();
+
+   constexpr size_t cChunkSize = 1'000;
+
+   uint64_t pointIndex = 0;
+   unsigned chunkCount = 0;
+
+   int64_t numRead = 0;
+
+   E57_ASSERT_NO_THROW(
+      numRead = reader->ReadData3DPointsChunked(
+         0, cChunkSize, [&]( const e57::Data3DPointsFloat &chunk, size_t count ) {
+            EXPECT_LE( count, cChunkSize );
+
+            for ( size_t i = 0; i < count; ++i, ++pointIndex )
+            {
+               EXPECT_EQ( chunk.cartesianX[i], pointsData.cartesianX[pointIndex] );
+               EXPECT_EQ( chunk.cartesianY[i], pointsData.cartesianY[pointIndex] );
+               EXPECT_EQ( chunk.cartesianZ[i], pointsData.cartesianZ[pointIndex] );
+               EXPECT_EQ( chunk.colorRed[i], pointsData.colorRed[pointIndex] );
+            }
+
+            ++chunkCount;
+
+            return true;
+         } ) );
+
+   EXPECT_EQ( numRead, static_cast<int64_t>( cNumPoints ) );
+   EXPECT_EQ( pointIndex, cNumPoints );
+   EXPECT_EQ( chunkCount, 8U );
+
+   // Stop after the first block
+   E57_ASSERT_NO_THROW(
+      numRead = reader->ReadData3DPointsChunked(
+         0, cChunkSize, []( const e57::Data3DPointsFloat &, size_t ) { return false; } ) );
+
+   EXPECT_EQ( numRead, static_cast<int64_t>( cChunkSize ) );
+
+   E57_ASSERT_THROW( reader->ReadData3DPointsChunked(
+      0, 0, []( const e57::Data3DPointsFloat &, size_t ) { return true; } ) );
+
+   delete reader;
+}
+
+TEST( SimpleReaderData, ColouredCubeFloatInterleaved )
+{
+   struct InterleavedPoint
+   {
+      double x;
+      double y;
+      double z;
+      uint8_t red;
+      uint8_t green;
+      uint8_t blue;
+      float intensity;
+   };
+
+   e57::Reader *reader = nullptr;
+
+   E57_ASSERT_NO_THROW(
+      reader = new e57::Reader( TestData::Path() + "/self/ColouredCubeFloat.e57", {} ) );
+
+   ASSERT_TRUE( reader->IsOpen() );
+   ASSERT_EQ( reader->GetData3DCount(), 1 );
+
+   e57::Data3D data3DHeader;
+   ASSERT_TRUE( reader->ReadData3D( 0, data3DHeader ) );
+
+   ASSERT_EQ( data3DHeader.pointCount, 7'680 );
+
+   const uint64_t cNumPoints = data3DHeader.pointCount;
+
+   // Read into separate buffers to compare against
+   e57::Data3DPointsFloat pointsData( data3DHeader );
+
+   auto vectorReader = reader->SetUpData3DPointsData( 0, cNumPoints, pointsData );
+
+   ASSERT_EQ( vectorReader.read(), cNumPoints );
+
+   vectorReader.close();
+
+   // The file has no intensity, so it should be left alone
+   std::vector<InterleavedPoint> points( cNumPoints, { 0.0, 0.0, 0.0, 0, 0, 0, -1.0f } );
+
+   e57::Data3DPointsInterleaved interleaved;
+   interleaved.base = points.data();
+   interleaved.stride = sizeof( InterleavedPoint );
+   interleaved.fields = {
+      { "cartesianX", e57::Real64, offsetof( InterleavedPoint, x ) },
+      { "cartesianY", e57::Real64, offsetof( InterleavedPoint, y ) },
+      { "cartesianZ", e57::Real64, offsetof( InterleavedPoint, z ) },
+      { "colorRed", e57::UInt8, offsetof( InterleavedPoint, red ) },
+      { "colorGreen", e57::UInt8, offsetof( InterleavedPoint, green ) },
+      { "colorBlue", e57::UInt8, offsetof( InterleavedPoint, blue ) },
+      { "intensity", e57::Real32, offsetof( InterleavedPoint, intensity ) },
+   };
+
+   auto interleavedReader = reader->SetUpData3DPointsData( 0, cNumPoints, interleaved );
+
+   ASSERT_EQ( interleavedReader.read(), cNumPoints );
+
+   interleavedReader.close();
+
+   for ( uint64_t i = 0; i < cNumPoints; ++i )
+   {
+      ASSERT_EQ( points[i].x, pointsData.cartesianX[i] );
+      ASSERT_EQ( points[i].y, pointsData.cartesianY[i] );
+      ASSERT_EQ( points[i].z, pointsData.cartesianZ[i] );
+      ASSERT_EQ( points[i].red, pointsData.colorRed[i] );
+      ASSERT_EQ( points[i].green, pointsData.colorGreen[i] );
+      ASSERT_EQ( points[i].blue, pointsData.colorBlue[i] );
+      ASSERT_EQ( points[i].intensity, -1.0f );
+   }
+
+   // A stride too small for the fields
+   interleaved.stride = sizeof( double );
+
+   E57_ASSERT_THROW( reader->SetUpData3DPointsData( 0, cNumPoints, interleaved ) );
+
+   delete reader;
+}
+
 TEST( SimpleReaderData, BunnyDouble )
 {
    e57::Reader *reader = nullptr;
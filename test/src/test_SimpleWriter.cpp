@@ -1,11 +1,20 @@
 // libE57Format testing Copyright © 2022 Andy Maloney <asmaloney@gmail.com>
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
 #include <fstream>
+#include <map>
+#include <mutex>
 
 #include "gtest/gtest.h"
 
+#include "E57DatasetReader.h"
+#include "E57SimpleReader.h"
 #include "E57SimpleWriter.h"
 
 #include "Helpers.h"
@@ -505,6 +514,2287 @@ TEST( SimpleWriter, CartesianPoints )
    delete writer;
 }
 
+TEST( SimpleWriter, SpatialIndex )
+{
+   constexpr int64_t cNumPoints = 10'000;
+
+   // Points along the X axis, with every 7th one invalid.
+   const auto writeFile = []( const e57::ustring &inFileName, size_t inChunkSize ) {
+      e57::WriterOptions options;
+      options.guid = "Spatial Index File GUID";
+      options.writeIndexPackets = true;
+      options.spatialIndexChunkSize = inChunkSize;
+
+      e57::Writer writer( inFileName, options );
+
+      e57::Data3D header;
+      header.guid = "Spatial Index Header GUID";
+      header.pointCount = cNumPoints;
+      header.pointFields.cartesianXField = true;
+      header.pointFields.cartesianYField = true;
+      header.pointFields.cartesianZField = true;
+      header.pointFields.cartesianInvalidStateField = true;
+
+      e57::Data3DPointsDouble pointsData( header );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         pointsData.cartesianX[i] = static_cast<double>( i );
+         pointsData.cartesianY[i] = 1.0;
+         pointsData.cartesianZ[i] = 2.0;
+         pointsData.cartesianInvalidState[i] = ( i % 7 == 0 ) ? 2 : 0;
+      }
+
+      writer.WriteData3DData( header, pointsData );
+      writer.Close();
+   };
+
+   E57_ASSERT_NO_THROW( writeFile( "./SpatialIndex.e57", 500 ) );
+   E57_ASSERT_NO_THROW( writeFile( "./SpatialIndexNone.e57", 0 ) );
+
+   e57::CartesianBounds box;
+   box.xMinimum = 2'600.0;
+   box.xMaximum = 3'100.0;
+
+   int64_t expected = 0;
+
+   for ( int64_t i = 2'600; i <= 3'100; ++i )
+   {
+      expected += ( i % 7 == 0 ) ? 0 : 1;
+   }
+
+   // With or without the index, we get the same points
+   for ( const auto *fileName : { "./SpatialIndex.e57", "./SpatialIndexNone.e57" } )
+   {
+      e57::Reader reader( fileName, {} );
+
+      std::vector<double> xs;
+      int64_t numRead = 0;
+
+      E57_ASSERT_NO_THROW(
+         numRead = reader.ReadData3DPointsInBox(
+            0, box, 128, [&]( const e57::Data3DPointsDouble &points, size_t count ) {
+               EXPECT_GT( count, 0U );
+               EXPECT_LE( count, 128U );
+
+               for ( size_t i = 0; i < count; ++i )
+               {
+                  EXPECT_EQ( points.cartesianInvalidState[i], 0 );
+                  EXPECT_EQ( points.cartesianY[i], 1.0 );
+
+                  xs.push_back( points.cartesianX[i] );
+               }
+
+               return true;
+            } ) );
+
+      EXPECT_EQ( numRead, expected );
+      ASSERT_EQ( static_cast<int64_t>( xs.size() ), expected );
+
+      EXPECT_TRUE( std::is_sorted( xs.begin(), xs.end() ) );
+      EXPECT_EQ( xs.front(), 2'600.0 );
+      EXPECT_EQ( xs.back(), 3'100.0 );
+
+      // Nothing is in a box off to the side
+      e57::CartesianBounds emptyBox;
+      emptyBox.yMinimum = 5.0;
+
+      E57_ASSERT_NO_THROW(
+         numRead = reader.ReadData3DPointsInBox(
+            0, emptyBox, 128, []( const e57::Data3DPointsDouble &, size_t ) { return true; } ) );
+
+      EXPECT_EQ( numRead, 0 );
+
+      E57_ASSERT_THROW( reader.ReadData3DPointsInBox(
+         0, box, 0, []( const e57::Data3DPointsDouble &, size_t ) { return true; } ) );
+   }
+}
+
+TEST( SimpleWriter, LevelsOfDetail )
+{
+   constexpr int64_t cNumPoints = 10'000;
+
+   const auto writeFile = []( const e57::ustring &inFileName, size_t inLevelCount ) {
+      e57::WriterOptions options;
+      options.guid = "Levels Of Detail File GUID";
+      options.levelOfDetailCount = inLevelCount;
+
+      e57::Writer writer( inFileName, options );
+
+      e57::Data3D header;
+      header.guid = "Levels Of Detail Header GUID";
+      header.pointCount = cNumPoints;
+      header.pointFields.cartesianXField = true;
+      header.pointFields.cartesianYField = true;
+      header.pointFields.cartesianZField = true;
+      header.pointFields.colorRedField = true;
+      header.pointFields.colorGreenField = true;
+      header.pointFields.colorBlueField = true;
+      header.colorLimits.colorRedMaximum = 255;
+      header.colorLimits.colorGreenMaximum = 255;
+      header.colorLimits.colorBlueMaximum = 255;
+
+      e57::Data3DPointsDouble pointsData( header );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         pointsData.cartesianX[i] = static_cast<double>( i );
+         pointsData.cartesianY[i] = 1.0;
+         pointsData.cartesianZ[i] = 2.0;
+         pointsData.colorRed[i] = static_cast<uint16_t>( i % 256 );
+         pointsData.colorGreen[i] = 0;
+         pointsData.colorBlue[i] = 255;
+      }
+
+      writer.WriteData3DData( header, pointsData );
+      writer.Close();
+   };
+
+   E57_ASSERT_NO_THROW( writeFile( "./LevelsOfDetail.e57", 3 ) );
+   E57_ASSERT_NO_THROW( writeFile( "./LevelsOfDetailNone.e57", 0 ) );
+
+   e57::Reader reader( "./LevelsOfDetail.e57", {} );
+
+   int64_t level = -1;
+   int64_t pointCount = 0;
+
+   // Each level has one in eight of the points of the one before
+   ASSERT_TRUE( reader.GetData3DLevelOfDetail( 0, cNumPoints, level, pointCount ) );
+   EXPECT_EQ( level, 0 );
+   EXPECT_EQ( pointCount, cNumPoints );
+
+   ASSERT_TRUE( reader.GetData3DLevelOfDetail( 0, 2'000, level, pointCount ) );
+   EXPECT_EQ( level, 1 );
+   EXPECT_EQ( pointCount, 1'250 );
+
+   ASSERT_TRUE( reader.GetData3DLevelOfDetail( 0, 1'000, level, pointCount ) );
+   EXPECT_EQ( level, 2 );
+   EXPECT_EQ( pointCount, 157 );
+
+   // Nothing fits, so we get the smallest
+   ASSERT_TRUE( reader.GetData3DLevelOfDetail( 0, 10, level, pointCount ) );
+   EXPECT_EQ( level, 3 );
+   EXPECT_EQ( pointCount, 20 );
+
+   EXPECT_FALSE( reader.GetData3DLevelOfDetail( 1, 10, level, pointCount ) );
+
+   e57::Data3D readHeader;
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+
+   readHeader.pointCount = 1'250;
+   e57::Data3DPointsDouble pointsData( readHeader );
+
+   e57::CompressedVectorReader dataReader =
+      reader.SetUpData3DLevelOfDetailData( 0, 1, 1'250, pointsData );
+
+   ASSERT_EQ( dataReader.read(), 1'250U );
+
+   for ( int64_t i = 0; i < 1'250; ++i )
+   {
+      ASSERT_EQ( pointsData.cartesianX[i], static_cast<double>( i * 8 ) );
+      ASSERT_EQ( pointsData.cartesianY[i], 1.0 );
+      ASSERT_EQ( pointsData.colorRed[i], ( i * 8 ) % 256 );
+      ASSERT_EQ( pointsData.colorBlue[i], 255 );
+   }
+
+   EXPECT_EQ( dataReader.read(), 0U );
+   dataReader.close();
+
+   E57_ASSERT_THROW( reader.SetUpData3DLevelOfDetailData( 0, 4, 1'250, pointsData ) );
+
+   // Without levels, the points are all there is
+   e57::Reader readerNone( "./LevelsOfDetailNone.e57", {} );
+
+   ASSERT_TRUE( readerNone.GetData3DLevelOfDetail( 0, 10, level, pointCount ) );
+   EXPECT_EQ( level, 0 );
+   EXPECT_EQ( pointCount, cNumPoints );
+
+   E57_ASSERT_THROW( readerNone.SetUpData3DLevelOfDetailData( 0, 1, 1'250, pointsData ) );
+}
+
+TEST( SimpleWriter, SpatialOrder )
+{
+   constexpr int64_t cSide = 100;
+   constexpr int64_t cNumPoints = cSide * cSide;
+
+   // A grid, with the points given in a shuffled order and the last column invalid
+   std::vector<int64_t> order( cNumPoints );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      order[i] = ( i * 7'919 ) % cNumPoints;
+   }
+
+   const auto writeFile = [&]( const e57::ustring &inFileName, e57::SpatialOrder inOrder ) {
+      e57::WriterOptions options;
+      options.guid = "Spatial Order File GUID";
+      options.spatialOrder = inOrder;
+      options.spatialOrderChunkSize = 4'000;
+      options.spatialIndexChunkSize = 250;
+
+      e57::Writer writer( inFileName, options );
+
+      e57::Data3D header;
+      header.guid = "Spatial Order Header GUID";
+      header.pointCount = cNumPoints;
+      header.pointFields.cartesianXField = true;
+      header.pointFields.cartesianYField = true;
+      header.pointFields.cartesianZField = true;
+      header.pointFields.cartesianInvalidStateField = true;
+      header.pointFields.rowIndexField = true;
+      header.pointFields.rowIndexMaximum = cSide - 1;
+      header.pointFields.columnIndexField = true;
+      header.pointFields.columnIndexMaximum = cSide - 1;
+
+      e57::Data3DPointsDouble pointsData( header );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         const int64_t row = order[i] / cSide;
+         const int64_t column = order[i] % cSide;
+
+         pointsData.cartesianX[i] = static_cast<double>( column );
+         pointsData.cartesianY[i] = static_cast<double>( row );
+         pointsData.cartesianZ[i] = 0.0;
+         pointsData.cartesianInvalidState[i] = ( column == cSide - 1 ) ? 2 : 0;
+         pointsData.rowIndex[i] = static_cast<int32_t>( row );
+         pointsData.columnIndex[i] = static_cast<int32_t>( column );
+      }
+
+      writer.WriteData3DData( header, pointsData );
+      writer.Close();
+   };
+
+   E57_ASSERT_NO_THROW( writeFile( "./SpatialOrderNone.e57", e57::SpatialOrder::None ) );
+   E57_ASSERT_NO_THROW( writeFile( "./SpatialOrderMorton.e57", e57::SpatialOrder::Morton ) );
+   E57_ASSERT_NO_THROW( writeFile( "./SpatialOrderHilbert.e57", e57::SpatialOrder::Hilbert ) );
+
+   // Total distance from each point to the next in the file
+   const auto readFile = []( const e57::ustring &inFileName ) {
+      e57::Reader reader( inFileName, {} );
+
+      e57::Data3D header;
+      EXPECT_TRUE( reader.ReadData3D( 0, header ) );
+
+      e57::Data3DPointsDouble pointsData( header );
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( 0, header.pointCount, pointsData );
+
+      EXPECT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+      dataReader.close();
+
+      std::vector<bool> seen( cNumPoints, false );
+      double distance = 0.0;
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         // The fields of each point stay together
+         const int64_t row = pointsData.rowIndex[i];
+         const int64_t column = pointsData.columnIndex[i];
+
+         EXPECT_EQ( pointsData.cartesianX[i], static_cast<double>( column ) );
+         EXPECT_EQ( pointsData.cartesianY[i], static_cast<double>( row ) );
+         EXPECT_EQ( pointsData.cartesianInvalidState[i] != 0, column == cSide - 1 );
+
+         EXPECT_FALSE( seen[row * cSide + column] );
+         seen[row * cSide + column] = true;
+
+         if ( ( i > 0 ) && ( pointsData.cartesianInvalidState[i] == 0 ) &&
+              ( pointsData.cartesianInvalidState[i - 1] == 0 ) )
+         {
+            distance += std::abs( pointsData.cartesianX[i] - pointsData.cartesianX[i - 1] ) +
+                        std::abs( pointsData.cartesianY[i] - pointsData.cartesianY[i - 1] );
+         }
+      }
+
+      // The chunk bounds match the points as written
+      e57::CartesianBounds box;
+      box.xMinimum = 10.0;
+      box.xMaximum = 19.0;
+      box.yMinimum = 40.0;
+      box.yMaximum = 49.0;
+      box.zMinimum = 0.0;
+      box.zMaximum = 0.0;
+
+      const int64_t numRead = reader.ReadData3DPointsInBox(
+         0, box, 128, []( const e57::Data3DPointsDouble &, size_t ) { return true; } );
+
+      EXPECT_EQ( numRead, 100 );
+
+      return distance;
+   };
+
+   const double unordered = readFile( "./SpatialOrderNone.e57" );
+   const double morton = readFile( "./SpatialOrderMorton.e57" );
+   const double hilbert = readFile( "./SpatialOrderHilbert.e57" );
+
+   EXPECT_LT( morton * 4.0, unordered );
+   EXPECT_LT( hilbert * 4.0, unordered );
+   EXPECT_LE( hilbert, morton );
+
+   e57::WriterOptions badOptions;
+   badOptions.spatialOrder = e57::SpatialOrder::Morton;
+   badOptions.spatialOrderChunkSize = 0;
+
+   E57_ASSERT_THROW( e57::Writer( "./SpatialOrderBad.e57", badOptions ) );
+}
+
+TEST( SimpleWriter, Data3DGrid )
+{
+   constexpr int64_t cRows = 50;
+   constexpr int64_t cColumns = 40;
+
+   // Each row is scanned backwards, and some cells have no point
+   const auto present = []( int64_t row, int64_t column ) { return ( row + column ) % 11 != 0; };
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Grid File GUID";
+      options.writeIndexPackets = true;
+
+      e57::Writer writer( "./Data3DGrid.e57", options );
+
+      // The same points without and with line groups
+      for ( const bool grouped : { false, true } )
+      {
+         std::vector<int64_t> idElementValue;
+         std::vector<int64_t> startPointIndex;
+         std::vector<int64_t> pointCount;
+         int64_t numPoints = 0;
+
+         for ( int64_t row = 0; row < cRows; ++row )
+         {
+            idElementValue.push_back( row );
+            startPointIndex.push_back( numPoints );
+            pointCount.push_back( 0 );
+
+            for ( int64_t column = 0; column < cColumns; ++column )
+            {
+               if ( present( row, column ) )
+               {
+                  ++pointCount.back();
+                  ++numPoints;
+               }
+            }
+         }
+
+         e57::Data3D header;
+         header.guid = "Grid Header GUID";
+         header.pointCount = numPoints;
+         header.pointFields.cartesianXField = true;
+         header.pointFields.cartesianYField = true;
+         header.pointFields.cartesianZField = true;
+         header.pointFields.intensityField = true;
+         header.intensityLimits.intensityMaximum = 1'000'000.0;
+         header.pointFields.rowIndexField = true;
+         header.pointFields.rowIndexMaximum = cRows - 1;
+         header.pointFields.columnIndexField = true;
+         header.pointFields.columnIndexMaximum = cColumns - 1;
+         header.indexBounds.rowMaximum = cRows - 1;
+         header.indexBounds.columnMaximum = cColumns - 1;
+
+         if ( grouped )
+         {
+            header.pointGroupingSchemes.groupingByLine.idElementName = "rowIndex";
+            header.pointGroupingSchemes.groupingByLine.groupsSize = cRows;
+            header.pointGroupingSchemes.groupingByLine.pointCountSize = cColumns;
+         }
+
+         e57::Data3DPointsDouble pointsData( header );
+         int64_t i = 0;
+
+         for ( int64_t row = 0; row < cRows; ++row )
+         {
+            for ( int64_t column = cColumns - 1; column >= 0; --column )
+            {
+               if ( !present( row, column ) )
+               {
+                  continue;
+               }
+
+               pointsData.cartesianX[i] = static_cast<double>( column );
+               pointsData.cartesianY[i] = static_cast<double>( row );
+               pointsData.cartesianZ[i] = static_cast<double>( row * cColumns + column );
+               pointsData.intensity[i] = static_cast<double>( row * 1'000 + column );
+               pointsData.rowIndex[i] = static_cast<int32_t>( row );
+               pointsData.columnIndex[i] = static_cast<int32_t>( column );
+               ++i;
+            }
+         }
+
+         const int64_t scanIndex = writer.WriteData3DData( header, pointsData );
+
+         if ( grouped )
+         {
+            writer.WriteData3DGroupsData( scanIndex, cRows, idElementValue.data(),
+                                          startPointIndex.data(), pointCount.data() );
+         }
+      }
+   }
+
+   e57::Reader reader( "./Data3DGrid.e57", {} );
+
+   for ( int64_t scanIndex = 0; scanIndex < 2; ++scanIndex )
+   {
+      for ( const unsigned threadCount : { 1U, 4U } )
+      {
+         // All the rows, or a band of them
+         for ( const int64_t firstRow : { int64_t{ -1 }, int64_t{ 10 } } )
+         {
+            const int64_t rowCount = ( firstRow < 0 ) ? cRows : 5;
+            const int64_t gridFirstRow = std::max( firstRow, int64_t{ 0 } );
+
+            e57::Data3D gridHeader;
+            gridHeader.pointCount = rowCount * cColumns;
+            gridHeader.pointFields.cartesianXField = true;
+            gridHeader.pointFields.cartesianZField = true;
+            gridHeader.pointFields.intensityField = true;
+
+            e57::Data3DPointsDouble grid( gridHeader );
+            std::fill_n( grid.cartesianX, gridHeader.pointCount, -1.0 );
+
+            int64_t placed = 0;
+
+            if ( firstRow < 0 )
+            {
+               E57_ASSERT_NO_THROW( placed =
+                                       reader.ReadData3DGrid( scanIndex, grid, threadCount ) );
+            }
+            else
+            {
+               E57_ASSERT_NO_THROW( placed = reader.ReadData3DGridRows(
+                                       scanIndex, firstRow, rowCount, grid, threadCount ) );
+            }
+
+            int64_t expected = 0;
+
+            for ( int64_t row = gridFirstRow; row < gridFirstRow + rowCount; ++row )
+            {
+               for ( int64_t column = 0; column < cColumns; ++column )
+               {
+                  const int64_t cell = ( row - gridFirstRow ) * cColumns + column;
+
+                  if ( !present( row, column ) )
+                  {
+                     ASSERT_EQ( grid.cartesianX[cell], -1.0 );
+                     continue;
+                  }
+
+                  ++expected;
+
+                  ASSERT_EQ( grid.cartesianX[cell], static_cast<double>( column ) );
+                  ASSERT_EQ( grid.cartesianZ[cell],
+                             static_cast<double>( row * cColumns + column ) );
+                  ASSERT_EQ( grid.intensity[cell], static_cast<double>( row * 1'000 + column ) );
+               }
+            }
+
+            EXPECT_EQ( placed, expected );
+         }
+      }
+   }
+
+   EXPECT_EQ( reader.ReadData3DGrid( 2, e57::Data3DPointsDouble() ), 0 );
+}
+
+TEST( SimpleWriter, Data3DLines )
+{
+   constexpr int64_t cRows = 60;
+
+   // Row r has r % 7 + 1 points
+   const auto rowLength = []( int64_t row ) { return row % 7 + 1; };
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Lines File GUID";
+      options.writeIndexPackets = true;
+
+      e57::Writer writer( "./Data3DLines.e57", options );
+
+      for ( const bool grouped : { false, true } )
+      {
+         std::vector<int64_t> idElementValue;
+         std::vector<int64_t> startPointIndex;
+         std::vector<int64_t> pointCount;
+         int64_t numPoints = 0;
+
+         for ( int64_t row = 0; row < cRows; ++row )
+         {
+            idElementValue.push_back( row );
+            startPointIndex.push_back( numPoints );
+            pointCount.push_back( rowLength( row ) );
+
+            numPoints += rowLength( row );
+         }
+
+         e57::Data3D header;
+         header.guid = "Lines Header GUID";
+         header.pointCount = numPoints;
+         header.pointFields.cartesianXField = true;
+         header.pointFields.cartesianYField = true;
+         header.pointFields.cartesianZField = true;
+         header.pointFields.rowIndexField = true;
+         header.pointFields.rowIndexMaximum = cRows - 1;
+
+         if ( grouped )
+         {
+            header.pointGroupingSchemes.groupingByLine.idElementName = "rowIndex";
+            header.pointGroupingSchemes.groupingByLine.groupsSize = cRows;
+            header.pointGroupingSchemes.groupingByLine.pointCountSize = 7;
+         }
+
+         e57::Data3DPointsFloat pointsData( header );
+         int64_t i = 0;
+
+         for ( int64_t row = 0; row < cRows; ++row )
+         {
+            for ( int64_t column = 0; column < rowLength( row ); ++column )
+            {
+               pointsData.cartesianX[i] = static_cast<float>( column );
+               pointsData.cartesianY[i] = static_cast<float>( row );
+               pointsData.cartesianZ[i] = 1.0f;
+               pointsData.rowIndex[i] = static_cast<int32_t>( row );
+               ++i;
+            }
+         }
+
+         const int64_t scanIndex = writer.WriteData3DData( header, pointsData );
+
+         if ( grouped )
+         {
+            writer.WriteData3DGroupsData( scanIndex, cRows, idElementValue.data(),
+                                          startPointIndex.data(), pointCount.data() );
+         }
+      }
+   }
+
+   e57::Reader reader( "./Data3DLines.e57", {} );
+
+   const auto ignore = []( int64_t, const e57::Data3DPointsFloat &, size_t ) {};
+
+   E57_ASSERT_THROW( reader.ReadData3DLines( 0, { 1 }, 1, ignore ) );
+
+   // Line 1000 doesn't exist
+   const std::vector<int64_t> lines = { 42, 3, 17, 1000, 59, 0 };
+
+   for ( const unsigned threadCount : { 1U, 3U } )
+   {
+      std::mutex mutex;
+      std::map<int64_t, size_t> counts;
+
+      int64_t numRead = 0;
+
+      E57_ASSERT_NO_THROW(
+         numRead = reader.ReadData3DLines(
+            1, lines, threadCount,
+            [&]( int64_t line, const e57::Data3DPointsFloat &points, size_t count ) {
+               for ( size_t i = 0; i < count; ++i )
+               {
+                  ASSERT_EQ( points.rowIndex[i], line );
+                  ASSERT_EQ( points.cartesianX[i], static_cast<float>( i ) );
+                  ASSERT_EQ( points.cartesianY[i], static_cast<float>( line ) );
+               }
+
+               const std::lock_guard<std::mutex> lock( mutex );
+
+               counts[line] += count;
+            } ) );
+
+      int64_t expected = 0;
+
+      for ( const int64_t line : { 42, 3, 17, 59, 0 } )
+      {
+         EXPECT_EQ( counts[line], static_cast<size_t>( rowLength( line ) ) );
+
+         expected += rowLength( line );
+      }
+
+      EXPECT_EQ( counts.count( 1000 ), 0u );
+      EXPECT_EQ( numRead, expected );
+   }
+
+   EXPECT_EQ( reader.ReadData3DLines( 2, lines, 1, ignore ), 0 );
+}
+
+TEST( SimpleWriter, ApplyPose )
+{
+   constexpr int64_t cNumPoints = 1'000;
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Pose File GUID";
+      options.spatialIndexChunkSize = 100;
+
+      e57::Writer writer( "./ApplyPose.e57", options );
+
+      e57::Data3D header;
+      header.guid = "Pose Header GUID";
+      header.pointCount = cNumPoints;
+      header.pointFields.cartesianXField = true;
+      header.pointFields.cartesianYField = true;
+      header.pointFields.cartesianZField = true;
+
+      // Turn 90° about z, then move
+      header.pose.rotation.w = std::sqrt( 0.5 );
+      header.pose.rotation.z = std::sqrt( 0.5 );
+      header.pose.translation.x = 10.0;
+      header.pose.translation.y = 20.0;
+      header.pose.translation.z = 30.0;
+
+      e57::Data3DPointsDouble pointsData( header );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         pointsData.cartesianX[i] = static_cast<double>( i );
+         pointsData.cartesianY[i] = 0.0;
+         pointsData.cartesianZ[i] = 0.0;
+      }
+
+      writer.WriteData3DData( header, pointsData );
+   }
+
+   // Read every point, checking point i is near ( x, y + i * step, z )
+   const auto check = []( const e57::ReaderOptions &inOptions, auto &pointsData, double inX,
+                          double inY, double inStep, double inZ, double inTolerance ) {
+      e57::Reader reader( "./ApplyPose.e57", inOptions );
+
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( 0, cNumPoints, pointsData );
+
+      ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+      dataReader.close();
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         ASSERT_NEAR( pointsData.cartesianX[i], inX, inTolerance );
+         ASSERT_NEAR( pointsData.cartesianY[i], inY + static_cast<double>( i ) * inStep,
+                      inTolerance );
+         ASSERT_NEAR( pointsData.cartesianZ[i], inZ, inTolerance );
+      }
+   };
+
+   e57::Data3D header;
+   header.pointCount = cNumPoints;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+
+   e57::Data3DPointsDouble doubles( header );
+   e57::Data3DPointsFloat floats( header );
+
+   // Untransformed, the points lie along x
+   {
+      SCOPED_TRACE( "no transform" );
+      check( {}, doubles, 0.0, 0.0, 0.0, 0.0, 0.0 );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         ASSERT_EQ( doubles.cartesianX[i], static_cast<double>( i ) );
+      }
+   }
+
+   e57::ReaderOptions options;
+   options.applyPose = true;
+   options.decodeTileSize = 64;
+
+   {
+      SCOPED_TRACE( "pose" );
+      check( options, doubles, 10.0, 20.0, 1.0, 30.0, 1.0e-9 );
+   }
+
+   // Scale by 2 after the pose
+   options.transform[0] = 2.0;
+   options.transform[5] = 2.0;
+   options.transform[10] = 2.0;
+
+   {
+      SCOPED_TRACE( "pose and transform" );
+      check( options, floats, 20.0, 40.0, 2.0, 60.0, 1.0e-3 );
+   }
+
+   // The chunk bounds are transformed to match the box
+   {
+      e57::Reader reader( "./ApplyPose.e57", options );
+
+      e57::CartesianBounds box;
+      box.xMinimum = 19.0;
+      box.xMaximum = 21.0;
+      box.yMinimum = 239.0;
+      box.yMaximum = 258.5;
+      box.zMinimum = 59.0;
+      box.zMaximum = 61.0;
+
+      const int64_t numRead = reader.ReadData3DPointsInBox(
+         0, box, 128, []( const e57::Data3DPointsDouble &, size_t ) { return true; } );
+
+      // Points 100 - 109
+      EXPECT_EQ( numRead, 10 );
+   }
+
+   options.transform[15] = 2.0;
+
+   E57_ASSERT_THROW( e57::Reader( "./ApplyPose.e57", options ) );
+}
+
+TEST( SimpleWriter, SphericalToCartesian )
+{
+   // More than one block of the points written with computeSpherical
+   constexpr int64_t cNumPoints = 100'000;
+
+   e57::Data3D cartesianHeader;
+   cartesianHeader.pointCount = cNumPoints;
+   cartesianHeader.pointFields.cartesianXField = true;
+   cartesianHeader.pointFields.cartesianYField = true;
+   cartesianHeader.pointFields.cartesianZField = true;
+   cartesianHeader.pointFields.cartesianInvalidStateField = true;
+
+   e57::Data3DPointsDouble cartesian( cartesianHeader );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      const double angle = static_cast<double>( i ) * 0.001;
+
+      cartesian.cartesianX[i] = 5.0 * std::cos( angle );
+      cartesian.cartesianY[i] = 5.0 * std::sin( angle );
+      cartesian.cartesianZ[i] = static_cast<double>( i % 100 ) * 0.1 - 5.0;
+      cartesian.cartesianInvalidState[i] = static_cast<int8_t>( i % 3 );
+   }
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Spherical File GUID";
+      options.computeSpherical = true;
+
+      e57::Writer writer( "./SphericalToCartesian.e57", options );
+
+      // Only spherical coordinates are stored, worked out from the cartesian buffers
+      e57::Data3D header;
+      header.guid = "Spherical Header GUID";
+      header.pointCount = cNumPoints;
+      header.pointFields.sphericalRangeField = true;
+      header.pointFields.sphericalAzimuthField = true;
+      header.pointFields.sphericalElevationField = true;
+      header.pointFields.sphericalInvalidStateField = true;
+      header.pointFields.pointRangeNodeType = e57::NumericalNodeType::Double;
+      header.pointFields.angleNodeType = e57::NumericalNodeType::Double;
+
+      writer.WriteData3DData( header, cartesian );
+   }
+
+   {
+      e57::Reader reader( "./SphericalToCartesian.e57", {} );
+
+      e57::Data3D header;
+      ASSERT_TRUE( reader.ReadData3D( 0, header ) );
+      ASSERT_TRUE( header.pointFields.sphericalRangeField );
+      ASSERT_FALSE( header.pointFields.cartesianXField );
+
+      e57::Data3DPointsDouble pointsData( header );
+
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( 0, cNumPoints, pointsData );
+
+      ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+      dataReader.close();
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         const double z = cartesian.cartesianZ[i];
+
+         ASSERT_NEAR( pointsData.sphericalRange[i], std::sqrt( 25.0 + z * z ), 1.0e-9 );
+         ASSERT_NEAR( pointsData.sphericalElevation[i], std::atan2( z, 5.0 ), 1.0e-9 );
+         ASSERT_EQ( pointsData.sphericalInvalidState[i], cartesian.cartesianInvalidState[i] );
+      }
+   }
+
+   e57::ReaderOptions options;
+   options.sphericalToCartesian = true;
+   options.decodeTileSize = 1'000;
+
+   e57::Reader reader( "./SphericalToCartesian.e57", options );
+
+   // The Data3D looks like it has cartesian coordinates
+   e57::Data3D header;
+   ASSERT_TRUE( reader.ReadData3D( 0, header ) );
+   ASSERT_TRUE( header.pointFields.cartesianXField );
+   ASSERT_TRUE( header.pointFields.cartesianInvalidStateField );
+   ASSERT_FALSE( header.pointFields.sphericalRangeField );
+   ASSERT_FALSE( header.pointFields.sphericalInvalidStateField );
+
+   e57::Data3DPointsDouble pointsData( header );
+
+   e57::CompressedVectorReader dataReader =
+      reader.SetUpData3DPointsData( 0, cNumPoints, pointsData );
+
+   ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+   dataReader.close();
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      ASSERT_NEAR( pointsData.cartesianX[i], cartesian.cartesianX[i], 1.0e-9 );
+      ASSERT_NEAR( pointsData.cartesianY[i], cartesian.cartesianY[i], 1.0e-9 );
+      ASSERT_NEAR( pointsData.cartesianZ[i], cartesian.cartesianZ[i], 1.0e-9 );
+      ASSERT_EQ( pointsData.cartesianInvalidState[i], cartesian.cartesianInvalidState[i] );
+   }
+}
+
+TEST( SimpleWriter, PointFilter )
+{
+   constexpr int64_t cNumPoints = 10'000;
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Filter File GUID";
+
+      e57::Writer writer( "./PointFilter.e57", options );
+
+      e57::Data3D header;
+      header.guid = "Filter Header GUID";
+      header.pointCount = cNumPoints;
+      header.pointFields.cartesianXField = true;
+      header.pointFields.cartesianYField = true;
+      header.pointFields.cartesianZField = true;
+      header.pointFields.cartesianInvalidStateField = true;
+      header.pointFields.intensityField = true;
+      header.intensityLimits.intensityMaximum = 1.0;
+
+      e57::Data3DPointsDouble pointsData( header );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         pointsData.cartesianX[i] = static_cast<double>( i );
+         pointsData.cartesianY[i] = 0.0;
+         pointsData.cartesianZ[i] = 0.0;
+
+         // One in four is invalid
+         pointsData.cartesianInvalidState[i] = ( i % 4 == 0 ) ? 2 : 0;
+         pointsData.intensity[i] = static_cast<double>( i ) / cNumPoints;
+      }
+
+      writer.WriteData3DData( header, pointsData );
+   }
+
+   // Read all the points in blocks, checking they are the ones kept by inKeep
+   const auto check = [&]( const e57::ReaderOptions &inOptions, const auto &inKeep ) {
+      e57::Reader reader( "./PointFilter.e57", inOptions );
+
+      e57::Data3D header;
+      ASSERT_TRUE( reader.ReadData3D( 0, header ) );
+
+      // The invalid states aren't read
+      header.pointFields.cartesianInvalidStateField = false;
+      header.pointCount = 1'000;
+
+      e57::Data3DPointsFloat pointsData( header );
+
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( 0, 1'000, pointsData );
+
+      int64_t point = 0;
+      unsigned count = 0;
+
+      while ( ( count = dataReader.read() ) > 0 )
+      {
+         for ( unsigned i = 0; i < count; ++i, ++point )
+         {
+            while ( !inKeep( point ) )
+            {
+               ++point;
+            }
+
+            ASSERT_EQ( pointsData.cartesianX[i], static_cast<float>( point ) );
+         }
+      }
+
+      dataReader.close();
+
+      while ( ( point < cNumPoints ) && !inKeep( point ) )
+      {
+         ++point;
+      }
+
+      EXPECT_EQ( point, cNumPoints );
+   };
+
+   e57::ReaderOptions options;
+   options.skipInvalidPoints = true;
+
+   {
+      SCOPED_TRACE( "skip invalid points" );
+      check( options, []( int64_t inPoint ) { return inPoint % 4 != 0; } );
+   }
+
+   // Bright points in a box, in tiles
+   options.decodeTileSize = 64;
+   options.pointFilter = { { "intensity", 0.5 }, { "cartesianX", -1.0, 8000.0 } };
+
+   {
+      SCOPED_TRACE( "point filter" );
+      check( options, [&]( int64_t inPoint ) {
+         return ( inPoint % 4 != 0 ) && ( inPoint >= cNumPoints / 2 ) && ( inPoint <= 8000 );
+      } );
+   }
+
+   // Chunked reads are filtered too
+   e57::Reader reader( "./PointFilter.e57", options );
+
+   const e57::Data3DPointsCallback<double> cCallback = []( const e57::Data3DPointsDouble &,
+                                                            size_t ) { return true; };
+
+   EXPECT_EQ( reader.ReadData3DPointsChunked( 0, 512, cCallback ), 2'250 );
+}
+
+TEST( SimpleWriter, ComputeBounds )
+{
+   constexpr int64_t cNumPoints = 1'000;
+   constexpr int64_t cBlockSize = 300;
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Compute Bounds File GUID";
+      options.computeBounds = true;
+
+      e57::Writer writer( "./ComputeBounds.e57", options );
+
+      e57::Data3D header;
+      header.guid = "Compute Bounds Header GUID";
+      header.pointCount = cBlockSize;
+      header.pointFields.cartesianXField = true;
+      header.pointFields.cartesianYField = true;
+      header.pointFields.cartesianZField = true;
+
+      e57::Data3DPointsDouble pointsData( header );
+
+      header.pointCount = cNumPoints;
+
+      const int64_t scanIndex = writer.NewData3D( header );
+
+      e57::CompressedVectorWriter dataWriter =
+         writer.SetUpData3DPointsData( scanIndex, cBlockSize, pointsData );
+
+      // Stream the points through in blocks, so no block holds all the extremes
+      for ( int64_t start = 0; start < cNumPoints; start += cBlockSize )
+      {
+         const int64_t count = std::min( cBlockSize, cNumPoints - start );
+
+         for ( int64_t i = 0; i < count; ++i )
+         {
+            const auto value = static_cast<double>( start + i );
+
+            pointsData.cartesianX[i] = value;
+            pointsData.cartesianY[i] = -value;
+            pointsData.cartesianZ[i] = value * 0.5 - 10.0;
+         }
+
+         dataWriter.write( static_cast<size_t>( count ) );
+      }
+
+      dataWriter.close();
+      writer.Close();
+   }
+
+   e57::Reader reader( "./ComputeBounds.e57", {} );
+
+   e57::Data3D header;
+   ASSERT_TRUE( reader.ReadData3D( 0, header ) );
+
+   EXPECT_EQ( header.cartesianBounds.xMinimum, 0.0 );
+   EXPECT_EQ( header.cartesianBounds.xMaximum, 999.0 );
+   EXPECT_EQ( header.cartesianBounds.yMinimum, -999.0 );
+   EXPECT_EQ( header.cartesianBounds.yMaximum, 0.0 );
+   EXPECT_EQ( header.cartesianBounds.zMinimum, -10.0 );
+   EXPECT_EQ( header.cartesianBounds.zMaximum, 489.5 );
+
+   // Not using spherical coordinates, so there aren't any spherical bounds
+   EXPECT_EQ( header.sphericalBounds, e57::SphericalBounds{} );
+}
+
+TEST( SimpleWriter, DeltaEncodePoints )
+{
+   constexpr int64_t cNumRows = 40;
+   constexpr int64_t cNumColumns = 50;
+   constexpr int64_t cNumPoints = cNumRows * cNumColumns;
+
+   e57::Data3D header;
+   header.guid = "Delta Encode Points Header GUID";
+   header.pointCount = cNumPoints;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+   header.pointFields.rowIndexField = true;
+   header.pointFields.rowIndexMaximum = cNumRows - 1;
+   header.pointFields.columnIndexField = true;
+   header.pointFields.columnIndexMaximum = cNumColumns - 1;
+   header.pointFields.pointRangeNodeType = e57::NumericalNodeType::ScaledInteger;
+   header.pointFields.pointRangeScale = 0.001;
+   header.pointFields.pointRangeMinimum = -100.0;
+   header.pointFields.pointRangeMaximum = 100.0;
+
+   auto pointAt = []( int64_t inRow, int64_t inColumn, double &outX, double &outY,
+                      double &outZ ) {
+      outX = static_cast<double>( inColumn ) * 0.01;
+      outY = static_cast<double>( inRow ) * -0.01;
+      outZ = 5.0 + static_cast<double>( inColumn % 7 ) * 0.002;
+   };
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Delta Encode Points File GUID";
+      options.deltaEncodePoints = true;
+      options.writeIndexPackets = true;
+
+      e57::Writer writer( "./DeltaEncodePoints.e57", options );
+
+      e57::Data3DPointsDouble pointsData( header );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         pointsData.rowIndex[i] = static_cast<int32_t>( i / cNumColumns );
+         pointsData.columnIndex[i] = static_cast<int32_t>( i % cNumColumns );
+
+         pointAt( i / cNumColumns, i % cNumColumns, pointsData.cartesianX[i],
+                  pointsData.cartesianY[i], pointsData.cartesianZ[i] );
+      }
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( header, pointsData ) );
+   }
+
+   e57::Reader reader( "./DeltaEncodePoints.e57", {} );
+
+   e57::Data3D readHeader;
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+
+   e57::Data3DPointsDouble pointsData( readHeader );
+   e57::CompressedVectorReader dataReader =
+      reader.SetUpData3DPointsData( 0, static_cast<size_t>( cNumPoints ), pointsData );
+
+   ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      double x = 0.0;
+      double y = 0.0;
+      double z = 0.0;
+      pointAt( i / cNumColumns, i % cNumColumns, x, y, z );
+
+      ASSERT_EQ( pointsData.rowIndex[i], i / cNumColumns );
+      ASSERT_EQ( pointsData.columnIndex[i], i % cNumColumns );
+      ASSERT_NEAR( pointsData.cartesianX[i], x, 0.0005 );
+      ASSERT_NEAR( pointsData.cartesianY[i], y, 0.0005 );
+      ASSERT_NEAR( pointsData.cartesianZ[i], z, 0.0005 );
+   }
+
+   dataReader.close();
+}
+
+TEST( SimpleWriter, PointPrecision )
+{
+   constexpr int64_t cNumPoints = 2'000;
+
+   e57::Data3D header;
+   header.pointCount = cNumPoints;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+   header.pointFields.pointRangeNodeType = e57::NumericalNodeType::Double;
+
+   e57::Data3DPointsDouble pointsData( header );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      pointsData.cartesianX[i] = static_cast<double>( i % 50 ) * 0.01;
+      pointsData.cartesianY[i] = static_cast<double>( i / 50 ) * -0.01;
+      pointsData.cartesianZ[i] = 5.0 + static_cast<double>( i % 7 ) * 0.002;
+   }
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Point Precision File GUID";
+      options.pointPrecision = 0.001;
+
+      e57::Writer writer( "./PointPrecision.e57", options );
+
+      // The limits of the first come from its bounds, and of the second from its points
+      e57::Data3D boundedHeader = header;
+      boundedHeader.guid = "Point Precision Bounded Header GUID";
+      boundedHeader.cartesianBounds.xMinimum = -1.0;
+      boundedHeader.cartesianBounds.xMaximum = 1.0;
+      boundedHeader.cartesianBounds.yMinimum = -1.0;
+      boundedHeader.cartesianBounds.yMaximum = 1.0;
+      boundedHeader.cartesianBounds.zMinimum = 0.0;
+      boundedHeader.cartesianBounds.zMaximum = 10.0;
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( boundedHeader, pointsData ) );
+
+      e57::Data3D unboundedHeader = header;
+      unboundedHeader.guid = "Point Precision Unbounded Header GUID";
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( unboundedHeader, pointsData ) );
+   }
+
+   e57::Reader reader( "./PointPrecision.e57", {} );
+
+   const auto checkLimits = [&]( const char *path, int64_t minimum, int64_t maximum ) {
+      const e57::CompressedVectorNode points( reader.GetRawData3D().get( path ) );
+      const e57::StructureNode proto( points.prototype() );
+
+      for ( const char *name : { "cartesianX", "cartesianY", "cartesianZ" } )
+      {
+         ASSERT_EQ( proto.get( name ).type(), e57::TypeScaledInteger );
+
+         const e57::ScaledIntegerNode coordinate( proto.get( name ) );
+
+         EXPECT_EQ( coordinate.scale(), 0.001 );
+         EXPECT_EQ( coordinate.minimum(), minimum );
+         EXPECT_EQ( coordinate.maximum(), maximum );
+      }
+   };
+
+   checkLimits( "/data3D/0/points", -1'000, 10'000 );
+   checkLimits( "/data3D/1/points", -390, 5'012 );
+
+   for ( int64_t index = 0; index < 2; ++index )
+   {
+      e57::Data3D readHeader;
+      ASSERT_TRUE( reader.ReadData3D( index, readHeader ) );
+
+      e57::Data3DPointsDouble readData( readHeader );
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( index, static_cast<size_t>( cNumPoints ), readData );
+
+      ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         ASSERT_NEAR( readData.cartesianX[i], pointsData.cartesianX[i], 0.0005 );
+         ASSERT_NEAR( readData.cartesianY[i], pointsData.cartesianY[i], 0.0005 );
+         ASSERT_NEAR( readData.cartesianZ[i], pointsData.cartesianZ[i], 0.0005 );
+      }
+
+      dataReader.close();
+   }
+}
+
+TEST( SimpleWriter, XorEncodeFloats )
+{
+   constexpr int64_t cNumPoints = 3000;
+
+   e57::Data3D header;
+   header.guid = "XOR Encode Floats Header GUID";
+   header.pointCount = cNumPoints;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+   header.pointFields.timeStampField = true;
+   header.pointFields.timeNodeType = e57::NumericalNodeType::Double;
+
+   e57::Data3DPointsDouble pointsData( header );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      pointsData.cartesianX[i] = static_cast<double>( i ) * 0.013;
+      pointsData.cartesianY[i] = -1.5;
+      pointsData.cartesianZ[i] = static_cast<double>( i % 11 ) * 0.7;
+      pointsData.timeStamp[i] = 1.7e9 + static_cast<double>( i ) * 1.0e-5;
+   }
+
+   {
+      e57::WriterOptions options;
+      options.guid = "XOR Encode Floats File GUID";
+      options.xorEncodeFloats = true;
+
+      e57::Writer writer( "./XorEncodeFloats.e57", options );
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( header, pointsData ) );
+   }
+
+   e57::Reader reader( "./XorEncodeFloats.e57", {} );
+
+   e57::Data3D readHeader;
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+
+   e57::Data3DPointsDouble readData( readHeader );
+   e57::CompressedVectorReader dataReader =
+      reader.SetUpData3DPointsData( 0, static_cast<size_t>( cNumPoints ), readData );
+
+   ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+
+   // Lossless, so the values must be exactly the same
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      ASSERT_EQ( readData.cartesianX[i], pointsData.cartesianX[i] );
+      ASSERT_EQ( readData.cartesianY[i], pointsData.cartesianY[i] );
+      ASSERT_EQ( readData.cartesianZ[i], pointsData.cartesianZ[i] );
+      ASSERT_EQ( readData.timeStamp[i], pointsData.timeStamp[i] );
+   }
+
+   dataReader.close();
+}
+
+TEST( SimpleWriter, ZstdLevel )
+{
+   constexpr int64_t cNumPoints = 5000;
+
+   e57::Data3D header;
+   header.guid = "Zstd Level Header GUID";
+   header.pointCount = cNumPoints;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+   header.pointFields.intensityField = true;
+   header.intensityLimits.intensityMinimum = 0.0;
+   header.intensityLimits.intensityMaximum = 1.0;
+
+   e57::Data3DPointsFloat pointsData( header );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      pointsData.cartesianX[i] = static_cast<float>( i % 100 ) * 0.5f;
+      pointsData.cartesianY[i] = static_cast<float>( i / 100 ) * 0.5f;
+      pointsData.cartesianZ[i] = 1.0f;
+      pointsData.intensity[i] = static_cast<float>( i % 10 ) * 0.1f;
+   }
+
+   try
+   {
+      e57::WriterOptions options;
+      options.guid = "Zstd Level File GUID";
+      options.zstdLevel = 5;
+
+      e57::Writer writer( "./ZstdLevel.e57", options );
+
+      writer.WriteData3DData( header, pointsData );
+   }
+   catch ( const e57::E57Exception &err )
+   {
+      if ( err.errorCode() == e57::ErrorNotImplemented )
+      {
+         GTEST_SKIP() << "library built without E57_ENABLE_ZSTD";
+      }
+
+      throw;
+   }
+
+   e57::Reader reader( "./ZstdLevel.e57", {} );
+
+   e57::Data3D readHeader;
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+
+   e57::Data3DPointsFloat readData( readHeader );
+   e57::CompressedVectorReader dataReader =
+      reader.SetUpData3DPointsData( 0, static_cast<size_t>( cNumPoints ), readData );
+
+   ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      ASSERT_EQ( readData.cartesianX[i], pointsData.cartesianX[i] );
+      ASSERT_EQ( readData.cartesianY[i], pointsData.cartesianY[i] );
+      ASSERT_EQ( readData.cartesianZ[i], pointsData.cartesianZ[i] );
+      ASSERT_EQ( readData.intensity[i], pointsData.intensity[i] );
+   }
+
+   dataReader.close();
+}
+
+TEST( SimpleWriter, Append )
+{
+   constexpr int64_t cNumPoints = 2000;
+
+   auto makeHeader = []( const char *inGuid ) {
+      e57::Data3D header;
+      header.guid = inGuid;
+      header.pointCount = cNumPoints;
+      header.pointFields.cartesianXField = true;
+      header.pointFields.cartesianYField = true;
+      header.pointFields.cartesianZField = true;
+
+      return header;
+   };
+
+   auto pointX = []( int scan, int64_t i ) { return static_cast<double>( scan * 10000 + i ); };
+
+   auto writeScan = [&]( e57::Writer &writer, const char *inGuid, int scan ) {
+      e57::Data3D header = makeHeader( inGuid );
+      e57::Data3DPointsDouble pointsData( header );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         pointsData.cartesianX[i] = pointX( scan, i );
+         pointsData.cartesianY[i] = 1.0;
+         pointsData.cartesianZ[i] = -1.0;
+      }
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( header, pointsData ) );
+   };
+
+   auto readFile = []( const char *inFileName ) {
+      std::ifstream file( inFileName, std::ifstream::binary );
+
+      return std::string( std::istreambuf_iterator<char>( file ), {} );
+   };
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Append File GUID";
+
+      e57::Writer writer( "./Append.e57", options );
+
+      writeScan( writer, "Append Scan 0 GUID", 0 );
+   }
+
+   const std::string original = readFile( "./Append.e57" );
+
+   // Cancelling leaves the file as it was
+   {
+      e57::ImageFile imf( "./Append.e57", "a" );
+
+      ASSERT_TRUE( imf.isWritable() );
+
+      std::vector<uint8_t> blobData( 3000, 0x42 );
+      e57::BlobNode blob( imf, static_cast<int64_t>( blobData.size() ) );
+      imf.root().set( "blob", blob );
+      blob.write( blobData.data(), 0, blobData.size() );
+
+      imf.cancel();
+   }
+
+   ASSERT_EQ( readFile( "./Append.e57" ), original );
+
+   std::vector<uint8_t> imageData( 1000 );
+
+   for ( size_t i = 0; i < imageData.size(); ++i )
+   {
+      imageData[i] = static_cast<uint8_t>( i * 7 );
+   }
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Ignored GUID";
+      options.append = true;
+
+      e57::Writer writer( "./Append.e57", options );
+
+      writeScan( writer, "Append Scan 1 GUID", 1 );
+
+      e57::Image2D image2DHeader;
+      image2DHeader.name = "Append Image";
+      image2DHeader.guid = "Append Image GUID";
+      image2DHeader.visualReferenceRepresentation.imageWidth = 10;
+      image2DHeader.visualReferenceRepresentation.imageHeight = 10;
+      image2DHeader.visualReferenceRepresentation.jpegImageSize =
+         static_cast<int64_t>( imageData.size() );
+
+      writer.WriteImage2DData( image2DHeader, e57::ImageJPEG, e57::ProjectionVisual, 0,
+                               imageData.data(), static_cast<int64_t>( imageData.size() ) );
+   }
+
+   // Only the page with the file header was rewritten
+   const std::string appended = readFile( "./Append.e57" );
+
+   ASSERT_GT( appended.size(), original.size() );
+   ASSERT_EQ( appended.compare( 1024, original.size() - 1024, original, 1024 ), 0 );
+
+   e57::Reader reader( "./Append.e57", {} );
+
+   e57::E57Root fileHeader;
+   ASSERT_TRUE( reader.GetE57Root( fileHeader ) );
+   EXPECT_EQ( fileHeader.guid, "Append File GUID" );
+
+   ASSERT_EQ( reader.GetData3DCount(), 2 );
+   ASSERT_EQ( reader.GetImage2DCount(), 1 );
+
+   for ( int scan = 0; scan < 2; ++scan )
+   {
+      e57::Data3D readHeader;
+      ASSERT_TRUE( reader.ReadData3D( scan, readHeader ) );
+      EXPECT_EQ( readHeader.guid, "Append Scan " + std::to_string( scan ) + " GUID" );
+
+      e57::Data3DPointsDouble readData( readHeader );
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( scan, static_cast<size_t>( cNumPoints ), readData );
+
+      ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         ASSERT_EQ( readData.cartesianX[i], pointX( scan, i ) );
+      }
+
+      dataReader.close();
+   }
+
+   std::vector<uint8_t> readImage( imageData.size() );
+
+   ASSERT_EQ( reader.ReadImage2DData( 0, e57::ProjectionVisual, e57::ImageJPEG, readImage.data(),
+                                      0, static_cast<int64_t>( readImage.size() ) ),
+              static_cast<int64_t>( readImage.size() ) );
+   ASSERT_EQ( readImage, imageData );
+}
+
+TEST( SimpleWriter, FollowWhileWriting )
+{
+   constexpr int64_t cNumPoints = 20'000;
+   constexpr int64_t cBlockSize = 1'000;
+
+   const e57::ustring fileName = "./FollowWhileWriting.e57";
+
+   e57::WriterOptions writerOptions;
+   writerOptions.guid = "Follow While Writing File GUID";
+   writerOptions.journalInterval = 1;
+
+   e57::Writer writer( fileName, writerOptions );
+
+   e57::Data3D header;
+   header.guid = "Follow While Writing Header GUID";
+   header.pointCount = cBlockSize;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+
+   e57::Data3DPointsDouble pointsData( header );
+
+   header.pointCount = cNumPoints;
+
+   const int64_t scanIndex = writer.NewData3D( header );
+
+   e57::CompressedVectorWriter dataWriter =
+      writer.SetUpData3DPointsData( scanIndex, cBlockSize, pointsData );
+
+   auto writePoints = [&]( int64_t start, int64_t end ) {
+      for ( ; start < end; start += cBlockSize )
+      {
+         for ( int64_t i = 0; i < cBlockSize; ++i )
+         {
+            const auto value = static_cast<double>( start + i );
+
+            pointsData.cartesianX[i] = value;
+            pointsData.cartesianY[i] = -value;
+            pointsData.cartesianZ[i] = value * 0.5;
+         }
+
+         dataWriter.write( cBlockSize );
+      }
+   };
+
+   // Write enough for a journal, so there is something to follow
+   writePoints( 0, cNumPoints / 2 );
+
+   e57::ReaderOptions readerOptions;
+   readerOptions.follow = true;
+
+   e57::Reader reader( fileName, readerOptions );
+
+   ASSERT_EQ( reader.GetData3DCount(), 1 );
+
+   e57::Data3D readHeader;
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+
+   const auto followed = static_cast<int64_t>( readHeader.pointCount );
+
+   ASSERT_GT( followed, 0 );
+   ASSERT_LE( followed, cNumPoints / 2 );
+
+   readHeader.pointCount = cBlockSize;
+
+   e57::Data3DPointsDouble readData( readHeader );
+   e57::CompressedVectorReader dataReader =
+      reader.SetUpData3DPointsData( 0, cBlockSize, readData );
+
+   int64_t total = 0;
+
+   auto readPoints = [&]() {
+      unsigned count = 0;
+
+      while ( ( count = dataReader.read() ) > 0 )
+      {
+         for ( unsigned i = 0; i < count; ++i )
+         {
+            const auto value = static_cast<double>( total + i );
+
+            ASSERT_EQ( readData.cartesianX[i], value );
+            ASSERT_EQ( readData.cartesianY[i], -value );
+            ASSERT_EQ( readData.cartesianZ[i], value * 0.5 );
+         }
+
+         total += count;
+      }
+   };
+
+   readPoints();
+
+   ASSERT_EQ( total, followed );
+
+   // Nothing has been journaled since
+   ASSERT_FALSE( reader.Refresh() );
+
+   // The reader carries on into what is written next
+   writePoints( cNumPoints / 2, cNumPoints );
+   dataWriter.close();
+
+   ASSERT_TRUE( reader.Refresh() );
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+   ASSERT_EQ( readHeader.pointCount, static_cast<size_t>( cNumPoints ) );
+
+   readPoints();
+
+   ASSERT_EQ( total, cNumPoints );
+
+   // Once the Writer closes the file it is complete, and no longer followed
+   writer.Close();
+
+   ASSERT_TRUE( reader.Refresh() );
+   ASSERT_FALSE( reader.Refresh() );
+
+   dataReader.close();
+   reader.Close();
+}
+
+TEST( SimpleWriter, LazyLoadXml )
+{
+   constexpr int64_t cNumScans = 3;
+   constexpr int64_t cNumPoints = 100;
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Lazy Load XML File GUID";
+
+      e57::Writer writer( "./LazyLoadXml.e57", options );
+
+      for ( int64_t scan = 0; scan < cNumScans; ++scan )
+      {
+         e57::Data3D header;
+         header.guid = "Lazy Load XML Header GUID " + std::to_string( scan );
+         header.name = "Scan " + std::to_string( scan );
+         header.pointCount = cNumPoints;
+         header.pointFields.cartesianXField = true;
+         header.pointFields.cartesianYField = true;
+         header.pointFields.cartesianZField = true;
+
+         e57::Data3DPointsFloat pointsData( header );
+
+         for ( int64_t i = 0; i < cNumPoints; ++i )
+         {
+            pointsData.cartesianX[i] = static_cast<float>( scan );
+            pointsData.cartesianY[i] = static_cast<float>( i );
+            pointsData.cartesianZ[i] = 1.0f;
+         }
+
+         E57_ASSERT_NO_THROW( writer.WriteData3DData( header, pointsData ) );
+      }
+   }
+
+   // Low-level API: the scans are parsed when first used
+   {
+      e57::ImageFileOptions options;
+      options.lazyLoadXml = true;
+
+      e57::ImageFile imf( "./LazyLoadXml.e57", "r", options );
+      const e57::VectorNode data3D( imf.root().get( "/data3D" ) );
+
+      ASSERT_EQ( data3D.childCount(), cNumScans );
+
+      const e57::StructureNode scan( data3D.get( 1 ) );
+      EXPECT_TRUE( scan.isDefined( "points" ) );
+      EXPECT_EQ( e57::StringNode( imf.root().get( "/data3D/2/name" ) ).value(), "Scan 2" );
+      EXPECT_EQ( e57::StringNode( scan.get( "guid" ) ).value(), "Lazy Load XML Header GUID 1" );
+      EXPECT_TRUE( scan.get( "points" ).isAttached() );
+
+      imf.close();
+   }
+
+   // Simple API, compared with opening the file normally
+   e57::ReaderOptions lazyOptions;
+   lazyOptions.lazyLoadXml = true;
+
+   e57::Reader lazyReader( "./LazyLoadXml.e57", lazyOptions );
+   e57::Reader reader( "./LazyLoadXml.e57", {} );
+
+   ASSERT_EQ( lazyReader.GetData3DCount(), cNumScans );
+
+   for ( int64_t scan = cNumScans - 1; scan >= 0; --scan )
+   {
+      e57::Data3D lazyHeader;
+      e57::Data3D header;
+      ASSERT_TRUE( lazyReader.ReadData3D( scan, lazyHeader ) );
+      ASSERT_TRUE( reader.ReadData3D( scan, header ) );
+
+      EXPECT_EQ( lazyHeader.guid, header.guid );
+      EXPECT_EQ( lazyHeader.name, header.name );
+      EXPECT_EQ( lazyHeader.pointCount, header.pointCount );
+
+      e57::Data3DPointsFloat pointsData( lazyHeader );
+      e57::CompressedVectorReader dataReader =
+         lazyReader.SetUpData3DPointsData( scan, cNumPoints, pointsData );
+
+      ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+      EXPECT_EQ( pointsData.cartesianX[0], static_cast<float>( scan ) );
+      EXPECT_EQ( pointsData.cartesianY[cNumPoints - 1], static_cast<float>( cNumPoints - 1 ) );
+
+      dataReader.close();
+   }
+}
+
+TEST( SimpleWriter, ReadWithoutXmlValidation )
+{
+   e57::Data3D header;
+   header.guid = "Read Without XML Validation Header GUID";
+   header.name = "No Validation";
+   header.pointCount = 1;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Read Without XML Validation File GUID";
+
+      e57::Writer writer( "./ReadWithoutXmlValidation.e57", options );
+
+      e57::Data3DPointsFloat pointsData( header );
+      pointsData.cartesianX[0] = 1.0f;
+      pointsData.cartesianY[0] = 2.0f;
+      pointsData.cartesianZ[0] = 3.0f;
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( header, pointsData ) );
+   }
+
+   e57::ReaderOptions options;
+   options.validateXml = false;
+
+   e57::Reader reader( "./ReadWithoutXmlValidation.e57", options );
+
+   e57::E57Root fileHeader;
+   ASSERT_TRUE( reader.GetE57Root( fileHeader ) );
+   EXPECT_EQ( fileHeader.guid, "Read Without XML Validation File GUID" );
+
+   e57::Data3D readHeader;
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+   EXPECT_EQ( readHeader.name, "No Validation" );
+   EXPECT_EQ( readHeader.pointCount, 1u );
+}
+
+TEST( SimpleWriter, ReadWithNodeArena )
+{
+   constexpr int64_t cNumPoints = 10;
+
+   e57::Data3D header;
+   header.guid = "Read With Node Arena Header GUID";
+   header.pointCount = cNumPoints;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Read With Node Arena File GUID";
+
+      e57::Writer writer( "./ReadWithNodeArena.e57", options );
+
+      e57::Data3DPointsDouble pointsData( header );
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         pointsData.cartesianX[i] = static_cast<double>( i );
+      }
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( header, pointsData ) );
+   }
+
+   {
+      e57::ReaderOptions options;
+      options.useNodeArena = true;
+      options.lazyLoadXml = true;
+
+      e57::Reader reader( "./ReadWithNodeArena.e57", options );
+
+      e57::Data3D readHeader;
+      ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+      EXPECT_EQ( readHeader.guid, "Read With Node Arena Header GUID" );
+
+      e57::Data3DPointsDouble pointsData( readHeader );
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( 0, cNumPoints, pointsData );
+
+      ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+      EXPECT_EQ( pointsData.cartesianX[cNumPoints - 1], static_cast<double>( cNumPoints - 1 ) );
+
+      dataReader.close();
+   }
+
+   // Nodes may outlive their ImageFile, and keep the arena with them
+   std::unique_ptr<e57::Node> node;
+   {
+      e57::ImageFileOptions options;
+      options.useNodeArena = true;
+
+      e57::ImageFile imf( "./ReadWithNodeArena.e57", "r", options );
+      node.reset( new e57::Node( imf.root().get( "/data3D/0/guid" ) ) );
+
+      imf.close();
+   }
+
+   EXPECT_EQ( node->type(), e57::TypeString );
+   node.reset();
+}
+
+TEST( SimpleWriter, VerifyChecksums )
+{
+   constexpr int64_t cNumPoints = 10000;
+
+   e57::Data3D header;
+   header.guid = "Verify Checksums Header GUID";
+   header.pointCount = cNumPoints;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Verify Checksums File GUID";
+
+      e57::Writer writer( "./VerifyChecksums.e57", options );
+
+      e57::Data3DPointsDouble pointsData( header );
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         pointsData.cartesianX[i] = static_cast<double>( i );
+         pointsData.cartesianY[i] = static_cast<double>( i ) * 2.0;
+      }
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( header, pointsData ) );
+   }
+
+   {
+      e57::ImageFile imf( "./VerifyChecksums.e57", "r" );
+
+      E57_ASSERT_NO_THROW( imf.verifyChecksums( 4 ) );
+
+      imf.close();
+   }
+
+   {
+      e57::ReaderOptions options;
+      options.verifyChecksumThreadCount = 4;
+
+      e57::Reader reader( "./VerifyChecksums.e57", options );
+
+      e57::Data3D readHeader;
+      ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+
+      e57::Data3DPointsDouble pointsData( readHeader );
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( 0, cNumPoints, pointsData );
+
+      ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+      EXPECT_EQ( pointsData.cartesianY[cNumPoints - 1],
+                 static_cast<double>( cNumPoints - 1 ) * 2.0 );
+
+      dataReader.close();
+   }
+
+   // Change a byte of the points (not the XML at the end, or the checksum of its page) so the
+   // file can still be opened without checking the checksums
+   {
+      std::fstream file( "./VerifyChecksums.e57",
+                         std::ios::in | std::ios::out | std::ios::binary );
+
+      file.seekg( 8 * 1024 + 100 );
+      const auto original = static_cast<char>( file.get() );
+
+      file.seekp( 8 * 1024 + 100 );
+      file.put( static_cast<char>( ~original ) );
+   }
+
+   e57::ImageFile imf( "./VerifyChecksums.e57", "r", e57::ChecksumNone );
+
+   E57_ASSERT_THROW( imf.verifyChecksums( 4 ) );
+
+   imf.close();
+
+   e57::ImageFileOptions options;
+   options.verifyChecksumThreadCount = 2;
+
+   E57_ASSERT_THROW( e57::ImageFile( "./VerifyChecksums.e57", "r", options ) );
+}
+
+TEST( SimpleWriter, ReserveSpace )
+{
+   constexpr int64_t cNumPoints = 100000;
+
+   e57::Data3D header;
+   header.guid = "Reserve Space Header GUID";
+   header.pointCount = cNumPoints;
+   header.pointFields.cartesianXField = true;
+   header.pointFields.cartesianYField = true;
+   header.pointFields.cartesianZField = true;
+
+   e57::Data3DPointsFloat pointsData( header );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      auto floati = static_cast<float>( i );
+      pointsData.cartesianX[i] = floati;
+      pointsData.cartesianY[i] = -floati;
+      pointsData.cartesianZ[i] = floati * 0.5f;
+   }
+
+   const auto writeFile = [&]( const e57::ustring &fileName, bool reserveSpace ) {
+      e57::WriterOptions options;
+      options.guid = "Reserve Space File GUID";
+      options.reserveSpace = reserveSpace;
+
+      e57::Writer writer( fileName, options );
+
+      writer.WriteData3DData( header, pointsData );
+   };
+
+   E57_ASSERT_NO_THROW( writeFile( "./ReserveSpace.e57", true ) );
+   E57_ASSERT_NO_THROW( writeFile( "./ReserveSpaceNone.e57", false ) );
+
+   // Space which wasn't used is given back, so the file doesn't change
+   const auto fileSize = []( const char *fileName ) {
+      std::ifstream file( fileName, std::ifstream::binary | std::ifstream::ate );
+
+      return static_cast<int64_t>( file.tellg() );
+   };
+
+   EXPECT_EQ( fileSize( "./ReserveSpace.e57" ), fileSize( "./ReserveSpaceNone.e57" ) );
+
+   e57::Reader reader( "./ReserveSpace.e57", {} );
+
+   e57::Data3D readHeader;
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+   ASSERT_EQ( static_cast<int64_t>( readHeader.pointCount ), cNumPoints );
+
+   e57::Data3DPointsFloat readData( readHeader );
+   e57::CompressedVectorReader dataReader =
+      reader.SetUpData3DPointsData( 0, static_cast<size_t>( cNumPoints ), readData );
+
+   ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      ASSERT_EQ( readData.cartesianY[i], -static_cast<float>( i ) );
+   }
+
+   dataReader.close();
+
+   // Only files being written have space reserved
+   e57::ImageFile imf( "./ReserveSpace.e57", "r" );
+
+   E57_ASSERT_THROW( imf.reserveSpace( 1024 ) );
+}
+
+TEST( SimpleWriter, MetadataSummary )
+{
+   constexpr int64_t cNumPoints = 1000;
+   const e57::ustring cFileName = "./MetadataSummary.e57";
+   const e57::ustring cSidecarName = e57::Reader::MetadataSummarySidecarPath( cFileName );
+
+   std::remove( cSidecarName.c_str() );
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Metadata Summary File GUID";
+
+      e57::Writer writer( cFileName, options );
+
+      for ( int scan = 0; scan < 2; ++scan )
+      {
+         e57::Data3D header;
+         header.guid = "Metadata Summary Scan GUID " + std::to_string( scan );
+         header.name = "Scan " + std::to_string( scan );
+         header.pointCount = cNumPoints;
+         header.pose.translation.x = 10.0 * scan;
+         header.pointFields.cartesianXField = true;
+         header.pointFields.cartesianYField = true;
+         header.pointFields.cartesianZField = true;
+         header.pointFields.intensityField = ( scan == 1 );
+         header.intensityLimits.intensityMaximum = 1.0;
+
+         e57::Data3DPointsFloat pointsData( header );
+
+         for ( int64_t i = 0; i < cNumPoints; ++i )
+         {
+            pointsData.cartesianX[i] = static_cast<float>( i );
+            pointsData.cartesianY[i] = static_cast<float>( scan );
+            pointsData.cartesianZ[i] = 0.0f;
+
+            if ( pointsData.intensity != nullptr )
+            {
+               pointsData.intensity[i] = 0.5f;
+            }
+         }
+
+         writer.WriteData3DData( header, pointsData );
+      }
+   }
+
+   e57::MetadataSummary summary;
+   ASSERT_TRUE( e57::Reader::ReadMetadataSummary( cFileName, summary ) );
+
+   EXPECT_EQ( summary.guid, "Metadata Summary File GUID" );
+   EXPECT_GT( summary.fileSize, 0u );
+   ASSERT_EQ( summary.data3D.size(), 2u );
+   EXPECT_TRUE( summary.images2D.empty() );
+
+   for ( size_t scan = 0; scan < 2; ++scan )
+   {
+      const e57::Data3DSummary &scanSummary = summary.data3D[scan];
+
+      EXPECT_EQ( scanSummary.guid, "Metadata Summary Scan GUID " + std::to_string( scan ) );
+      EXPECT_EQ( scanSummary.name, "Scan " + std::to_string( scan ) );
+      EXPECT_EQ( scanSummary.pointCount, cNumPoints );
+      EXPECT_EQ( scanSummary.pose.translation.x, 10.0 * static_cast<double>( scan ) );
+      EXPECT_TRUE( scanSummary.hasCartesian );
+      EXPECT_FALSE( scanSummary.hasSpherical );
+      EXPECT_EQ( scanSummary.hasIntensity, scan == 1 );
+      EXPECT_FALSE( scanSummary.hasColor );
+   }
+
+   // The summary from an open Reader is the same apart from the key
+   {
+      e57::Reader reader( cFileName, {} );
+
+      e57::MetadataSummary fromReader;
+      ASSERT_TRUE( reader.GetMetadataSummary( fromReader ) );
+
+      EXPECT_EQ( fromReader.fileSize, summary.fileSize );
+      EXPECT_EQ( fromReader.serialize(), summary.serialize() );
+   }
+
+   // A sidecar was written, and is used while the file doesn't change
+   e57::MetadataSummary edited = summary;
+   edited.data3D[0].name = "From Sidecar";
+
+   {
+      const std::vector<char> data = edited.serialize();
+      std::ofstream sidecar( cSidecarName, std::ofstream::binary | std::ofstream::trunc );
+
+      sidecar.write( data.data(), static_cast<std::streamsize>( data.size() ) );
+   }
+
+   e57::MetadataSummary cached;
+   ASSERT_TRUE( e57::Reader::ReadMetadataSummary( cFileName, cached ) );
+   EXPECT_EQ( cached.data3D[0].name, "From Sidecar" );
+
+   // Out-of-date and damaged sidecars are replaced
+   edited.fileSize += 1;
+
+   {
+      const std::vector<char> data = edited.serialize();
+      std::ofstream sidecar( cSidecarName, std::ofstream::binary | std::ofstream::trunc );
+
+      sidecar.write( data.data(), static_cast<std::streamsize>( data.size() / 2 ) );
+   }
+
+   ASSERT_TRUE( e57::Reader::ReadMetadataSummary( cFileName, cached ) );
+   EXPECT_EQ( cached.data3D[0].name, "Scan 0" );
+
+   ASSERT_TRUE( e57::Reader::ReadMetadataSummary( cFileName, cached ) );
+   EXPECT_EQ( cached.serialize(), summary.serialize() );
+
+   // Data which isn't a summary is rejected
+   std::vector<char> data = summary.serialize();
+   data[0] = 'X';
+
+   EXPECT_FALSE( cached.deserialize( data ) );
+   EXPECT_FALSE( cached.deserialize( {} ) );
+}
+
+TEST( SimpleWriter, DatasetReader )
+{
+   constexpr int64_t cNumPoints = 100;
+
+   // Three files holding 2, 0, and 1 Data3D
+   const std::vector<int> scanCounts{ 2, 0, 1 };
+
+   for ( size_t file = 0; file < scanCounts.size(); ++file )
+   {
+      const e57::ustring fileName = "./DatasetReader" + std::to_string( file ) + ".dataset.e57";
+
+      std::remove( e57::Reader::MetadataSummarySidecarPath( fileName ).c_str() );
+
+      e57::WriterOptions writerOptions;
+      e57::Writer writer( fileName, writerOptions );
+
+      for ( int scan = 0; scan < scanCounts[file]; ++scan )
+      {
+         e57::Data3D header;
+         header.name = "File " + std::to_string( file ) + " Scan " + std::to_string( scan );
+         header.guid = header.name + " GUID";
+         header.pointCount = cNumPoints;
+         header.pointFields.cartesianXField = true;
+         header.pointFields.cartesianYField = true;
+         header.pointFields.cartesianZField = true;
+
+         e57::Data3DPointsFloat pointsData( header );
+
+         for ( int64_t i = 0; i < cNumPoints; ++i )
+         {
+            pointsData.cartesianX[i] = static_cast<float>( i );
+            pointsData.cartesianY[i] = static_cast<float>( file );
+            pointsData.cartesianZ[i] = static_cast<float>( scan );
+         }
+
+         writer.WriteData3DData( header, pointsData );
+      }
+   }
+
+   const std::vector<e57::ustring> paths = e57::DatasetReader::FindFiles( ".", ".Dataset.E57" );
+
+   ASSERT_EQ( paths.size(), scanCounts.size() );
+   EXPECT_EQ( paths[0], "./DatasetReader0.dataset.e57" );
+   EXPECT_EQ( paths[2], "./DatasetReader2.dataset.e57" );
+
+   E57_ASSERT_THROW( e57::DatasetReader::FindFiles( "./DatasetReaderMissing" ) );
+
+   // Open the files, then use their summaries, which come from the sidecars the last time
+   for ( int pass = 0; pass < 3; ++pass )
+   {
+      e57::DatasetReaderOptions options;
+      options.threadCount = 3;
+      options.useMetadataSummaries = ( pass > 0 );
+
+      e57::DatasetReader dataset( paths, options );
+
+      ASSERT_EQ( dataset.GetFileCount(), scanCounts.size() );
+      ASSERT_EQ( dataset.GetData3DCount(), 3 );
+      EXPECT_EQ( dataset.GetImage2DCount(), 0 );
+
+      const e57::DatasetLocation location = dataset.GetData3DLocation( 2 );
+
+      EXPECT_EQ( location.fileIndex, 2u );
+      EXPECT_EQ( location.index, 0 );
+
+      E57_ASSERT_THROW( dataset.GetData3DLocation( 3 ) );
+
+      e57::Data3DSummary summary;
+      ASSERT_TRUE( dataset.GetData3DSummary( 1, summary ) );
+      EXPECT_EQ( summary.name, "File 0 Scan 1" );
+      EXPECT_EQ( summary.pointCount, cNumPoints );
+      EXPECT_FALSE( dataset.GetData3DSummary( 3, summary ) );
+
+      e57::Data3D header;
+      ASSERT_TRUE( dataset.ReadData3D( 2, header ) );
+      EXPECT_EQ( header.name, "File 2 Scan 0" );
+
+      // Each Data3D is read once, and those of each file in order
+      std::vector<int64_t> pointsRead( 3, 0 );
+
+      dataset.ForEachData3D(
+         [&]( int64_t dataIndex, e57::Reader &reader, int64_t fileDataIndex ) {
+            e57::Data3D scanHeader;
+            ASSERT_TRUE( reader.ReadData3D( fileDataIndex, scanHeader ) );
+
+            e57::Data3DPointsFloat pointsData( scanHeader );
+            e57::CompressedVectorReader points =
+               reader.SetUpData3DPointsData( fileDataIndex, cNumPoints, pointsData );
+
+            pointsRead[static_cast<size_t>( dataIndex )] += points.read();
+            points.close();
+
+            EXPECT_EQ( pointsData.cartesianZ[0], static_cast<float>( fileDataIndex ) );
+         } );
+
+      for ( const int64_t count : pointsRead )
+      {
+         EXPECT_EQ( count, cNumPoints );
+      }
+
+      dataset.Close();
+   }
+}
+
+TEST( SimpleWriter, InterleavedPoints )
+{
+   struct InterleavedPoint
+   {
+      float x;
+      float y;
+      float z;
+      uint16_t red;
+      uint16_t green;
+      uint16_t blue;
+   };
+
+   constexpr int64_t cNumPoints = 5000;
+
+   std::vector<InterleavedPoint> points( cNumPoints );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      auto floati = static_cast<float>( i );
+      points[i] = { floati * 0.1f, -floati * 0.1f, 1.5f, static_cast<uint16_t>( i % 256 ),
+                    static_cast<uint16_t>( ( i / 256 ) % 256 ), 255 };
+   }
+
+   e57::Data3DPointsInterleaved interleaved;
+   interleaved.base = points.data();
+   interleaved.stride = sizeof( InterleavedPoint );
+   interleaved.fields = {
+      { "cartesianX", e57::Real32, offsetof( InterleavedPoint, x ) },
+      { "cartesianY", e57::Real32, offsetof( InterleavedPoint, y ) },
+      { "cartesianZ", e57::Real32, offsetof( InterleavedPoint, z ) },
+      { "colorRed", e57::UInt16, offsetof( InterleavedPoint, red ) },
+      { "colorGreen", e57::UInt16, offsetof( InterleavedPoint, green ) },
+      { "colorBlue", e57::UInt16, offsetof( InterleavedPoint, blue ) },
+   };
+
+   e57::Data3D header;
+   header.guid = "Interleaved Points Header GUID";
+   header.pointCount = cNumPoints;
+
+   setUsingColouredCartesianPoints( header );
+
+   // Scaled integer coordinates, so the values are scaled as they are read from the points
+   header.pointFields.pointRangeNodeType = e57::NumericalNodeType::ScaledInteger;
+   header.pointFields.pointRangeScale = 0.001;
+   header.pointFields.pointRangeMinimum = -1000.0;
+   header.pointFields.pointRangeMaximum = 1000.0;
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Interleaved Points File GUID";
+      options.spatialIndexChunkSize = 1000;
+
+      e57::Writer writer( "./InterleavedPoints.e57", options );
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( header, interleaved ) );
+
+      // A field which goes past the end of each point
+      e57::Data3DPointsInterleaved badField = interleaved;
+      badField.fields[0].offset = sizeof( InterleavedPoint ) - 2;
+
+      e57::Data3D badHeader = header;
+      E57_ASSERT_THROW( writer.WriteData3DData( badHeader, badField ) );
+   }
+
+   e57::Reader reader( "./InterleavedPoints.e57", {} );
+
+   e57::Data3D readHeader;
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+   ASSERT_EQ( static_cast<int64_t>( readHeader.pointCount ), cNumPoints );
+
+   e57::Data3DPointsFloat pointsData( readHeader );
+   e57::CompressedVectorReader dataReader =
+      reader.SetUpData3DPointsData( 0, static_cast<size_t>( cNumPoints ), pointsData );
+
+   ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      ASSERT_NEAR( pointsData.cartesianX[i], points[i].x, 0.0005 );
+      ASSERT_NEAR( pointsData.cartesianY[i], points[i].y, 0.0005 );
+      ASSERT_NEAR( pointsData.cartesianZ[i], points[i].z, 0.0005 );
+      ASSERT_EQ( pointsData.colorRed[i], points[i].red );
+      ASSERT_EQ( pointsData.colorGreen[i], points[i].green );
+      ASSERT_EQ( pointsData.colorBlue[i], points[i].blue );
+   }
+
+   dataReader.close();
+
+   // The chunk bounds were written from the interleaved points too
+   e57::CartesianBounds box;
+   box.xMinimum = 0.0;
+   box.xMaximum = 9.95;
+   box.yMinimum = -10.0;
+   box.yMaximum = 0.0;
+   box.zMinimum = 0.0;
+   box.zMaximum = 2.0;
+
+   int64_t numRead = 0;
+
+   E57_ASSERT_NO_THROW(
+      numRead = reader.ReadData3DPointsInBox(
+         0, box, 128, []( const e57::Data3DPointsFloat &, size_t ) { return true; } ) );
+
+   EXPECT_EQ( numRead, 100 );
+}
+
+TEST( SimpleWriter, PackedInvalidStates )
+{
+   // Not a multiple of 8, and enough for several packets
+   constexpr int64_t cNumPoints = 100'003;
+
+   e57::Data3D header;
+   header.guid = "Packed Invalid States Header GUID";
+   header.pointCount = cNumPoints;
+
+   setUsingColouredCartesianPoints( header );
+
+   header.pointFields.cartesianInvalidStateField = true;
+   header.pointFields.isColorInvalidField = true;
+
+   const auto invalidState = []( int64_t i ) { return static_cast<unsigned>( ( i / 7 ) % 3 ); };
+   const auto colorInvalid = []( int64_t i ) { return static_cast<unsigned>( i % 5 == 0 ); };
+
+   {
+      e57::WriterOptions options;
+      options.guid = "Packed Invalid States File GUID";
+
+      e57::Writer writer( "./PackedInvalidStates.e57", options );
+
+      e57::Data3DPointsFloat pointsData( header, nullptr, true );
+
+      ASSERT_EQ( pointsData.cartesianInvalidState, nullptr );
+      ASSERT_EQ( pointsData.isColorInvalid, nullptr );
+      ASSERT_NE( pointsData.cartesianInvalidStateBits.data, nullptr );
+      ASSERT_NE( pointsData.isColorInvalidBits.data, nullptr );
+
+      for ( int64_t i = 0; i < cNumPoints; ++i )
+      {
+         auto floati = static_cast<float>( i );
+         pointsData.cartesianX[i] = floati;
+         pointsData.cartesianY[i] = floati;
+         pointsData.cartesianZ[i] = floati;
+
+         pointsData.colorRed[i] = 0;
+         pointsData.colorGreen[i] = 0;
+         pointsData.colorBlue[i] = 255;
+
+         pointsData.cartesianInvalidStateBits.set( i, invalidState( i ) );
+         pointsData.isColorInvalidBits.set( i, colorInvalid( i ) );
+      }
+
+      E57_ASSERT_NO_THROW( writer.WriteData3DData( header, pointsData ) );
+
+      // 3 doesn't fit in cartesianInvalidState
+      pointsData.cartesianInvalidStateBits.set( 10, 3 );
+
+      e57::Data3D badHeader = header;
+      E57_ASSERT_THROW( writer.WriteData3DData( badHeader, pointsData ) );
+   }
+
+   e57::Reader reader( "./PackedInvalidStates.e57", {} );
+
+   e57::Data3D readHeader;
+   ASSERT_TRUE( reader.ReadData3D( 0, readHeader ) );
+   ASSERT_EQ( static_cast<int64_t>( readHeader.pointCount ), cNumPoints );
+
+   // Packed buffers read the same values as the int8_t ones
+   e57::Data3DPointsFloat packed( readHeader, nullptr, true );
+   e57::Data3DPointsFloat unpacked( readHeader );
+
+   for ( auto *pointsData : { &packed, &unpacked } )
+   {
+      e57::CompressedVectorReader dataReader =
+         reader.SetUpData3DPointsData( 0, static_cast<size_t>( cNumPoints ), *pointsData );
+
+      ASSERT_EQ( dataReader.read(), static_cast<unsigned>( cNumPoints ) );
+
+      dataReader.close();
+   }
+
+   for ( int64_t i = 0; i < cNumPoints; ++i )
+   {
+      ASSERT_EQ( packed.cartesianInvalidStateBits.get( i ), invalidState( i ) );
+      ASSERT_EQ( packed.isColorInvalidBits.get( i ), colorInvalid( i ) );
+      ASSERT_EQ( unpacked.cartesianInvalidState[i], static_cast<int8_t>( invalidState( i ) ) );
+      ASSERT_EQ( unpacked.isColorInvalid[i], static_cast<int8_t>( colorInvalid( i ) ) );
+   }
+}
+
 TEST( SimpleWriter, ColouredCartesianPoints )
 {
    e57::WriterOptions options;
@@ -0,0 +1,194 @@
+// libE57Format testing Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "SourceDestBufferImpl.h"
+
+namespace
+{
+   constexpr size_t cCapacity = 100;
+
+   // The code and context of the E57Exception thrown by code.
+   struct Error
+   {
+      e57::ErrorCode code = e57::Success;
+      std::string context;
+   };
+
+   template <typename Code> Error errorFrom( Code code )
+   {
+      try
+      {
+         code();
+      }
+      catch ( e57::E57Exception &err )
+      {
+         return { err.errorCode(), err.context() };
+      }
+
+      ADD_FAILURE() << "no exception";
+      return {};
+   }
+
+   // A point with the field the buffers point to between others, so the buffer has a stride.
+   template <typename T> struct Point
+   {
+      double before = 0.5;
+      T value;
+      int16_t after = -2;
+   };
+
+   // Check the values filled into a strided buffer are the ones setNextInt64() stores, and the
+   // other fields are untouched.
+   template <typename T>
+   void checkStridedFill( e57::ImageFile &imf, int64_t value, bool doScaling, double scale,
+                          double offset )
+   {
+      std::vector<Point<T>> points( cCapacity );
+      std::vector<T> expected( cCapacity );
+
+      e57::SourceDestBuffer filled( imf, "value", &points[0].value, cCapacity, true, doScaling,
+                                    sizeof( Point<T> ) );
+      e57::SourceDestBuffer single( imf, "value", expected.data(), cCapacity, true, doScaling );
+
+      filled.impl()->fillNextInt64( value, cCapacity, scale, offset );
+
+      for ( size_t i = 0; i < cCapacity; ++i )
+      {
+         single.impl()->setNextInt64( value, scale, offset );
+      }
+
+      EXPECT_EQ( filled.impl()->nextIndex(), cCapacity );
+
+      for ( size_t i = 0; i < cCapacity; ++i )
+      {
+         // Compare the bits, so floating point values must be exactly the same
+         ASSERT_EQ( std::memcmp( &points[i].value, &expected[i], sizeof( T ) ), 0 ) << "i=" << i;
+         ASSERT_EQ( points[i].before, 0.5 );
+         ASSERT_EQ( points[i].after, -2 );
+      }
+   }
+}
+
+TEST( SourceDestBufferImpl, FillContiguous )
+{
+   e57::ImageFile imf( "./SourceDestBufferFillContiguous.e57", "w" );
+
+   std::vector<int16_t> values( cCapacity, -1 );
+   e57::SourceDestBuffer sdb( imf, "value", values.data(), cCapacity );
+
+   const auto impl = sdb.impl();
+
+   impl->fillNextInt64( 1234, 0 );
+   EXPECT_EQ( impl->nextIndex(), 0u );
+
+   impl->fillNextInt64( 1234, 60 );
+   EXPECT_EQ( impl->nextIndex(), 60u );
+
+   impl->fillNextInt64( -7, cCapacity - 60 );
+   EXPECT_EQ( impl->nextIndex(), cCapacity );
+
+   for ( size_t i = 0; i < cCapacity; ++i )
+   {
+      ASSERT_EQ( values[i], ( i < 60 ) ? 1234 : -7 ) << "i=" << i;
+   }
+
+   // There is no room left
+   EXPECT_EQ( errorFrom( [&] { impl->fillNextInt64( 1, 1 ); } ).code, e57::ErrorInternal );
+
+   imf.close();
+}
+
+TEST( SourceDestBufferImpl, FillStrided )
+{
+   e57::ImageFile imf( "./SourceDestBufferFillStrided.e57", "w" );
+
+   checkStridedFill<int8_t>( imf, -100, false, 1.0, 0.0 );
+   checkStridedFill<uint16_t>( imf, 60000, false, 1.0, 0.0 );
+   checkStridedFill<int32_t>( imf, 123456, false, 1.0, 0.0 );
+   checkStridedFill<int64_t>( imf, INT64_MIN, false, 1.0, 0.0 );
+   checkStridedFill<float>( imf, 123456789, false, 1.0, 0.0 );
+   checkStridedFill<double>( imf, INT64_MAX, false, 1.0, 0.0 );
+
+   // Scaled into floating point and (rounded) into integers
+   checkStridedFill<double>( imf, 12345, true, 0.001, 100.0 );
+   checkStridedFill<float>( imf, -12345, true, 0.001, 100.0 );
+   checkStridedFill<int32_t>( imf, 12345, true, 0.001, 100.0 );
+
+   imf.close();
+}
+
+// A value which doesn't fit is reported just as setNextInt64() reports it, and nothing is stored.
+TEST( SourceDestBufferImpl, FillOutOfRange )
+{
+   e57::ImageFile imf( "./SourceDestBufferFillOutOfRange.e57", "w" );
+
+   std::vector<int8_t> values( cCapacity, 5 );
+   e57::SourceDestBuffer filled( imf, "value", values.data(), cCapacity, false, true );
+   e57::SourceDestBuffer single( imf, "value", values.data(), cCapacity, false, true );
+
+   const auto checkSameError = [&]( const Error &fillError, const Error &singleError ) {
+      EXPECT_NE( fillError.code, e57::Success );
+      EXPECT_EQ( fillError.code, singleError.code );
+      EXPECT_EQ( fillError.context, singleError.context );
+
+      EXPECT_EQ( filled.impl()->nextIndex(), 0u );
+      EXPECT_EQ( values, std::vector<int8_t>( cCapacity, 5 ) );
+   };
+
+   // Raw values
+   checkSameError( errorFrom( [&] { filled.impl()->fillNextInt64( 300, cCapacity ); } ),
+                   errorFrom( [&] { single.impl()->setNextInt64( 300 ); } ) );
+
+   // Scaled values
+   checkSameError(
+      errorFrom( [&] { filled.impl()->fillNextInt64( 100, cCapacity, 2.0, 0.0 ); } ),
+      errorFrom( [&] { single.impl()->setNextInt64( 100, 2.0, 0.0 ); } ) );
+
+   EXPECT_EQ( errorFrom( [&] { filled.impl()->fillNextInt64( 300, cCapacity ); } ).code,
+              e57::ErrorValueNotRepresentable );
+
+   // Integers into floating point without conversion
+   std::vector<float> floats( cCapacity );
+   e57::SourceDestBuffer unconverted( imf, "value", floats.data(), cCapacity, false );
+
+   EXPECT_EQ( errorFrom( [&] { unconverted.impl()->fillNextInt64( 1, cCapacity ); } ).code,
+              e57::ErrorConversionRequired );
+
+   imf.close();
+}
+
+TEST( SourceDestBufferImpl, SkipNext )
+{
+   e57::ImageFile imf( "./SourceDestBufferSkipNext.e57", "w" );
+
+   std::vector<int64_t> values( 30, -1 );
+   e57::SourceDestBuffer sdb( imf, "value", values.data(), values.size() );
+
+   const auto impl = sdb.impl();
+
+   impl->skipNext( 10 );
+   EXPECT_EQ( impl->nextIndex(), 10u );
+   EXPECT_EQ( values, std::vector<int64_t>( 30, -1 ) );
+
+   impl->fillNextInt64( 5, 10 );
+
+   // Past the end
+   EXPECT_EQ( errorFrom( [&] { impl->skipNext( 11 ); } ).code, e57::ErrorInternal );
+   EXPECT_EQ( impl->nextIndex(), 20u );
+
+   impl->skipNext( 10 );
+   EXPECT_EQ( impl->nextIndex(), 30u );
+
+   for ( size_t i = 0; i < values.size(); ++i )
+   {
+      ASSERT_EQ( values[i], ( ( i >= 10 ) && ( i < 20 ) ) ? 5 : -1 ) << "i=" << i;
+   }
+
+   imf.close();
+}
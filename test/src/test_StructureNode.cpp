@@ -0,0 +1,172 @@
+// libE57Format testing Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "E57Format.h"
+
+#include "Helpers.h"
+
+namespace
+{
+   // More than the number of children a Structure needs before it indexes them by name
+   constexpr int64_t cChildCount = 20;
+
+   e57::ustring childName( int64_t i )
+   {
+      return "child" + std::to_string( i );
+   }
+
+   // Add children "child0", "child1", ... to inStructure, holding their index.
+   void addChildren( e57::ImageFile &imf, e57::StructureNode &inStructure )
+   {
+      for ( int64_t i = 0; i < cChildCount; ++i )
+      {
+         inStructure.set( childName( i ), e57::IntegerNode( imf, i, 0, cChildCount ) );
+      }
+   }
+
+   // Run code, and check it throws an E57Exception with inErrorCode.
+   template <typename Code> void expectError( e57::ErrorCode inErrorCode, Code code )
+   {
+      try
+      {
+         code();
+         ADD_FAILURE() << "no exception";
+      }
+      catch ( e57::E57Exception &err )
+      {
+         EXPECT_EQ( err.errorCode(), inErrorCode ) << err.context();
+      }
+   }
+
+   // Build /a/b/c, with more children than the index threshold at each level, and a Vector /v.
+   void buildTree( e57::ImageFile &imf )
+   {
+      e57::StructureNode root = imf.root();
+
+      e57::StructureNode a( imf );
+      e57::StructureNode b( imf );
+
+      root.set( "a", a );
+      a.set( "b", b );
+      b.set( "c", e57::StringNode( imf, "leaf" ) );
+
+      addChildren( imf, root );
+      addChildren( imf, a );
+      addChildren( imf, b );
+
+      e57::VectorNode v( imf, true );
+      root.set( "v", v );
+
+      for ( int64_t i = 0; i < cChildCount; ++i )
+      {
+         v.append( e57::IntegerNode( imf, i, 0, cChildCount ) );
+      }
+   }
+
+   void checkTree( e57::ImageFile &imf )
+   {
+      e57::StructureNode root = imf.root();
+
+      // Children keep the order they were added in, and are found by name
+      ASSERT_EQ( root.childCount(), cChildCount + 2 );
+
+      EXPECT_EQ( root.get( 0 ).elementName(), "a" );
+
+      for ( int64_t i = 0; i < cChildCount; ++i )
+      {
+         const e57::Node byIndex = root.get( i + 1 );
+
+         ASSERT_EQ( byIndex.elementName(), childName( i ) );
+         ASSERT_TRUE( root.isDefined( childName( i ) ) );
+         ASSERT_EQ( e57::IntegerNode( root.get( childName( i ) ) ).value(), i );
+      }
+
+      EXPECT_FALSE( root.isDefined( childName( cChildCount ) ) );
+
+      // Paths of several levels, relative and absolute, from the root and from below it
+      const e57::StructureNode a( root.get( "a" ) );
+      const e57::StructureNode b( a.get( "b" ) );
+
+      EXPECT_EQ( e57::StringNode( root.get( "a/b/c" ) ).value(), "leaf" );
+      EXPECT_EQ( e57::StringNode( root.get( "/a/b/c" ) ).value(), "leaf" );
+      EXPECT_EQ( e57::StringNode( a.get( "b/c" ) ).value(), "leaf" );
+      EXPECT_EQ( e57::StringNode( b.get( "/a/b/c" ) ).value(), "leaf" );
+      EXPECT_EQ( e57::IntegerNode( root.get( "a/b/child7" ) ).value(), 7 );
+      EXPECT_EQ( e57::IntegerNode( b.get( "/a/child13" ) ).value(), 13 );
+
+      EXPECT_TRUE( root.isDefined( "/" ) );
+      EXPECT_TRUE( b.get( "/" ).isRoot() );
+
+      // Vector children by index
+      EXPECT_EQ( e57::IntegerNode( root.get( "/v/11" ) ).value(), 11 );
+      EXPECT_EQ( e57::IntegerNode( b.get( "/v/19" ) ).value(), 19 );
+      EXPECT_FALSE( root.isDefined( "v/20" ) );
+
+      // Missing levels, and leaves with nothing below them
+      EXPECT_FALSE( root.isDefined( "a/x/c" ) );
+      EXPECT_FALSE( root.isDefined( "a/b/c/d" ) );
+      EXPECT_FALSE( root.isDefined( "a/child1/c" ) );
+      EXPECT_FALSE( a.isDefined( "a/b" ) );
+
+      expectError( e57::ErrorPathUndefined, [&] { root.get( "a/b/missing" ); } );
+      expectError( e57::ErrorPathUndefined, [&] { a.get( "missing" ); } );
+
+      // Bad path names are reported, whether or not they have several levels
+      expectError( e57::ErrorBadPathName, [&] { root.isDefined( "bad name" ); } );
+      expectError( e57::ErrorBadPathName, [&] { root.isDefined( "9lives" ); } );
+      expectError( e57::ErrorBadPathName, [&] { root.isDefined( "a//c" ); } );
+      expectError( e57::ErrorBadPathName, [&] { root.get( "a/b/bad name" ); } );
+      expectError( e57::ErrorBadPathName, [&] { a.get( "/a/9lives" ); } );
+   }
+}
+
+TEST( StructureNode, ManyChildren )
+{
+   {
+      e57::ImageFile imf( "./StructureNodeManyChildren.e57", "w" );
+
+      buildTree( imf );
+      checkTree( imf );
+
+      imf.close();
+   }
+
+   {
+      e57::ImageFile imf( "./StructureNodeManyChildren.e57", "r" );
+
+      checkTree( imf );
+
+      imf.close();
+   }
+}
+
+TEST( StructureNode, SetTwice )
+{
+   e57::ImageFile imf( "./StructureNodeSetTwice.e57", "w" );
+
+   buildTree( imf );
+
+   e57::StructureNode root = imf.root();
+
+   // Children found through the index, the first one added, and ones below it
+   expectError( e57::ErrorSetTwice, [&] { root.set( "child11", e57::StringNode( imf ) ); } );
+   expectError( e57::ErrorSetTwice, [&] { root.set( "a", e57::StringNode( imf ) ); } );
+   expectError( e57::ErrorSetTwice, [&] { root.set( "a/b/c", e57::StringNode( imf ) ); } );
+   expectError( e57::ErrorSetTwice, [&] { root.set( "/a/child3", e57::StringNode( imf ) ); } );
+
+   expectError( e57::ErrorBadPathName, [&] { root.set( "bad name", e57::StringNode( imf ) ); } );
+
+   EXPECT_EQ( root.childCount(), cChildCount + 2 );
+
+   // New names are still added, and found
+   E57_ASSERT_NO_THROW( root.set( "a/b/d", e57::StringNode( imf, "new" ) ) );
+
+   EXPECT_EQ( e57::StringNode( root.get( "/a/b/d" ) ).value(), "new" );
+   EXPECT_EQ( e57::StructureNode( root.get( "a/b" ) ).childCount(), cChildCount + 2 );
+
+   imf.close();
+}
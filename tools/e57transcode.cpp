@@ -0,0 +1,184 @@
+// Copyright © 2024 Andy Maloney <asmaloney@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Copies an E57 file, changing how its points are stored. See usage() below.
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "E57Exception.h"
+#include "E57Transcode.h"
+
+namespace
+{
+   void usage()
+   {
+      std::cerr
+         << "Usage: e57transcode [options] <input.e57> <output.e57>\n"
+            "\n"
+            "Copies input.e57 to output.e57. CompressedVectors with converted fields (or all of\n"
+            "them with --reencode) are decoded and encoded again; the others are copied as\n"
+            "they are.\n"
+            "\n"
+            "Options:\n"
+            "  --scaled <field>:<scale>[:<offset>]  Store field as a ScaledInteger\n"
+            "  --float <field>                     Store field as a double precision Float\n"
+            "  --single <field>                    Store field as a single precision Float\n"
+            "  --reencode                          Encode every CompressedVector again\n"
+            "  --codecs                            Replace the codecs of those encoded again\n"
+            "  --delta <field>                     With --codecs, delta encode field\n"
+            "  --xor                               With --codecs, XOR encode Float fields\n"
+            "  --zstd <level>                      With --codecs, compress fields with zstd\n"
+            "  --index                             Write index packets\n"
+            "  --threads <count>                   Threads to decode and encode with\n"
+            "  --block <records>                   Records decoded and encoded at a time\n"
+            "  --progress                          Show the progress of each CompressedVector\n";
+   }
+
+   /// Splits "field:a:b" at its colons
+   std::vector<std::string> split( const std::string &text )
+   {
+      std::vector<std::string> parts( 1 );
+
+      for ( const char c : text )
+      {
+         if ( c == ':' )
+         {
+            parts.emplace_back();
+         }
+         else
+         {
+            parts.back() += c;
+         }
+      }
+
+      return parts;
+   }
+}
+
+int main( int argc, char **argv )
+{
+   e57::TranscodeOptions options;
+   std::vector<std::string> paths;
+
+   for ( int i = 1; i < argc; ++i )
+   {
+      const std::string arg = argv[i];
+      const bool hasValue = ( i + 1 < argc );
+
+      if ( ( arg == "--scaled" ) && hasValue )
+      {
+         const std::vector<std::string> parts = split( argv[++i] );
+
+         if ( ( parts.size() < 2 ) || ( parts.size() > 3 ) )
+         {
+            usage();
+            return EXIT_FAILURE;
+         }
+
+         e57::TranscodeFieldConversion conversion;
+         conversion.fieldName = parts[0];
+         conversion.type = e57::TypeScaledInteger;
+         conversion.scale = std::strtod( parts[1].c_str(), nullptr );
+         conversion.offset = ( parts.size() == 3 ) ? std::strtod( parts[2].c_str(), nullptr ) : 0.0;
+
+         options.conversions.push_back( conversion );
+      }
+      else if ( ( ( arg == "--float" ) || ( arg == "--single" ) ) && hasValue )
+      {
+         e57::TranscodeFieldConversion conversion;
+         conversion.fieldName = argv[++i];
+         conversion.type = e57::TypeFloat;
+         conversion.precision = ( arg == "--single" ) ? e57::PrecisionSingle : e57::PrecisionDouble;
+
+         options.conversions.push_back( conversion );
+      }
+      else if ( arg == "--reencode" )
+      {
+         options.reencode = true;
+      }
+      else if ( arg == "--codecs" )
+      {
+         options.replaceCodecs = true;
+      }
+      else if ( ( arg == "--delta" ) && hasValue )
+      {
+         options.deltaFields.emplace_back( argv[++i] );
+      }
+      else if ( arg == "--xor" )
+      {
+         options.xorEncodeFloats = true;
+      }
+      else if ( ( arg == "--zstd" ) && hasValue )
+      {
+         options.zstdLevel = std::atoi( argv[++i] );
+      }
+      else if ( arg == "--index" )
+      {
+         options.writerOptions.writeIndexPackets = true;
+      }
+      else if ( ( arg == "--threads" ) && hasValue )
+      {
+         const auto threadCount = static_cast<unsigned>( std::strtoul( argv[++i], nullptr, 10 ) );
+
+         options.readerOptions.decodeThreadCount = threadCount;
+         options.readerOptions.readAheadPacketCount = 4;
+         options.writerOptions.encodeThreadCount = threadCount;
+         options.writerOptions.writeBehindPacketCount = 4;
+         options.blobThreadCount = threadCount;
+      }
+      else if ( ( arg == "--block" ) && hasValue )
+      {
+         options.blockRecordCount = std::strtoul( argv[++i], nullptr, 10 );
+      }
+      else if ( arg == "--progress" )
+      {
+         options.readerOptions.progress = []( const e57::CompressedVectorProgress &progress ) {
+            if ( progress.recordCount != 0 )
+            {
+               std::cerr << "\r" << ( 100 * progress.recordsDone / progress.recordCount ) << "% "
+                         << std::flush;
+            }
+         };
+      }
+      else if ( ( arg.size() > 1 ) && ( arg[0] == '-' ) )
+      {
+         usage();
+         return EXIT_FAILURE;
+      }
+      else
+      {
+         paths.push_back( arg );
+      }
+   }
+
+   if ( paths.size() != 2 )
+   {
+      usage();
+      return EXIT_FAILURE;
+   }
+
+   try
+   {
+      e57::transcode( paths[0], paths[1], options );
+   }
+   catch ( const e57::E57Exception &e )
+   {
+      std::cerr << "\ne57transcode: " << e.errorStr() << ": " << e.context() << std::endl;
+      return EXIT_FAILURE;
+   }
+   catch ( const std::exception &e )
+   {
+      std::cerr << "\ne57transcode: " << e.what() << std::endl;
+      return EXIT_FAILURE;
+   }
+
+   if ( options.readerOptions.progress )
+   {
+      std::cerr << "\rdone" << std::endl;
+   }
+
+   return EXIT_SUCCESS;
+}